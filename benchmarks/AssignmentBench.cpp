@@ -0,0 +1,52 @@
+//===-- AssignmentBench.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Expr.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// Sum of all zero-extended bytes of \p array, the shape seed replay
+/// and counterexample caching evaluate constantly.
+ref<Expr> byteSum(const Array *array, unsigned size) {
+  UpdateList ul(array, 0);
+  ref<Expr> sum = ConstantExpr::create(0, Expr::Int32);
+  for (unsigned i = 0; i != size; ++i)
+    sum = AddExpr::create(
+        sum, ZExtExpr::create(
+                 ReadExpr::create(ul, ConstantExpr::create(i, Expr::Int32)),
+                 Expr::Int32));
+  return sum;
+}
+
+void BM_AssignmentEvaluate(benchmark::State &state) {
+  const unsigned Size = static_cast<unsigned>(state.range(0));
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("bench", Size);
+  std::vector<const Array *> objects(1, array);
+  std::vector<std::vector<unsigned char>> values(
+      1, std::vector<unsigned char>(Size, 7));
+  Assignment assignment(objects, values, /*_allowFreeValues=*/true);
+  ref<Expr> e = byteSum(array, Size);
+  for (auto _ : state) {
+    ref<Expr> result = assignment.evaluate(e);
+    benchmark::DoNotOptimize(result.get());
+  }
+  state.SetItemsProcessed(state.iterations() * Size);
+}
+BENCHMARK(BM_AssignmentEvaluate)->Arg(16)->Arg(64)->Arg(256);
+
+} // namespace
@@ -0,0 +1,70 @@
+//===-- ConstraintsBench.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+
+using namespace klee;
+
+namespace {
+
+ref<Expr> readByte(const Array *array, unsigned i) {
+  UpdateList ul(array, 0);
+  return ReadExpr::create(ul, ConstantExpr::create(i, Expr::Int32));
+}
+
+/// Pin the first \p n bytes of \p array to constants, the pattern a
+/// parser path accumulates byte by byte.
+void addByteEqualities(ConstraintManager &cm, const Array *array, unsigned n) {
+  for (unsigned i = 0; i != n; ++i)
+    cm.addConstraint(
+        EqExpr::create(readByte(array, i), ConstantExpr::create(i, Expr::Int8)));
+}
+
+/// Simplification of an expression over already-constrained bytes,
+/// hitting the per-set memo table after the first iteration. This is
+/// the steady-state cost of re-simplifying along one path.
+void BM_SimplifyExprCached(benchmark::State &state) {
+  const unsigned NumConstraints = static_cast<unsigned>(state.range(0));
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("bench", NumConstraints + 1);
+  ConstraintSet constraints;
+  ConstraintManager cm(constraints);
+  addByteEqualities(cm, array, NumConstraints);
+  ref<Expr> e = AddExpr::create(readByte(array, 0),
+                                readByte(array, NumConstraints / 2));
+  for (auto _ : state) {
+    ref<Expr> simplified = ConstraintManager::simplifyExpr(constraints, e);
+    benchmark::DoNotOptimize(simplified.get());
+  }
+}
+BENCHMARK(BM_SimplifyExprCached)->Arg(16)->Arg(128);
+
+/// Same query against a freshly built constraint set every iteration,
+/// measuring equality-index construction plus one cold simplification.
+void BM_SimplifyExprCold(benchmark::State &state) {
+  const unsigned NumConstraints = static_cast<unsigned>(state.range(0));
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("bench", NumConstraints + 1);
+  ref<Expr> e = AddExpr::create(readByte(array, 0),
+                                readByte(array, NumConstraints / 2));
+  for (auto _ : state) {
+    ConstraintSet constraints;
+    ConstraintManager cm(constraints);
+    addByteEqualities(cm, array, NumConstraints);
+    ref<Expr> simplified = ConstraintManager::simplifyExpr(constraints, e);
+    benchmark::DoNotOptimize(simplified.get());
+  }
+}
+BENCHMARK(BM_SimplifyExprCold)->Arg(16)->Arg(128);
+
+} // namespace
@@ -0,0 +1,75 @@
+//===-- ExprBench.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprBuilder.h"
+
+#include <memory>
+
+using namespace klee;
+
+namespace {
+
+/// Build the kind of expression the interpreter produces all day: a
+/// running sum of zero-extended symbolic bytes compared against a
+/// constant bound. Returns the number of builder calls made.
+unsigned buildWorkload(ExprBuilder &builder, const UpdateList &ul) {
+  const unsigned NumBytes = 32;
+  ref<Expr> sum = builder.Constant(0, Expr::Int32);
+  for (unsigned i = 0; i != NumBytes; ++i) {
+    ref<Expr> byte = builder.Read(ul, builder.Constant(i, Expr::Int32));
+    sum = builder.Add(sum, builder.ZExt(byte, Expr::Int32));
+  }
+  ref<Expr> bounded = builder.Ult(sum, builder.Constant(4096, Expr::Int32));
+  benchmark::DoNotOptimize(bounded.get());
+  return 4 * NumBytes + 2;
+}
+
+void BM_DefaultBuilder(benchmark::State &state) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("bench", 32);
+  UpdateList ul(array, 0);
+  std::unique_ptr<ExprBuilder> builder(createDefaultExprBuilder());
+  unsigned calls = 0;
+  for (auto _ : state)
+    calls = buildWorkload(*builder, ul);
+  state.SetItemsProcessed(state.iterations() * calls);
+}
+BENCHMARK(BM_DefaultBuilder);
+
+void BM_ConstantFoldingBuilder(benchmark::State &state) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("bench", 32);
+  UpdateList ul(array, 0);
+  std::unique_ptr<ExprBuilder> builder(
+      createConstantFoldingExprBuilder(createDefaultExprBuilder()));
+  unsigned calls = 0;
+  for (auto _ : state)
+    calls = buildWorkload(*builder, ul);
+  state.SetItemsProcessed(state.iterations() * calls);
+}
+BENCHMARK(BM_ConstantFoldingBuilder);
+
+void BM_SimplifyingBuilder(benchmark::State &state) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("bench", 32);
+  UpdateList ul(array, 0);
+  std::unique_ptr<ExprBuilder> builder(createSimplifyingExprBuilder(
+      createConstantFoldingExprBuilder(createDefaultExprBuilder())));
+  unsigned calls = 0;
+  for (auto _ : state)
+    calls = buildWorkload(*builder, ul);
+  state.SetItemsProcessed(state.iterations() * calls);
+}
+BENCHMARK(BM_SimplifyingBuilder);
+
+} // namespace
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON outputs (or directories of them).
+
+Usage: compare.py [--threshold PCT] <baseline> <current>
+
+Prints a per-benchmark table of cpu_time deltas and exits non-zero if
+any benchmark regressed by more than the threshold (default 10%), so it
+can gate an upgrade in CI:
+
+    cmake --build build --target run-benchmarks
+    benchmarks/compare.py baselines/ build/benchmarks/
+"""
+
+import argparse
+import json
+import os
+import sys
+
+
+def load_results(path):
+    """Map benchmark name -> (cpu_time, time_unit) from a file or all
+    *.json files in a directory."""
+    results = {}
+    if os.path.isdir(path):
+        files = [os.path.join(path, f) for f in sorted(os.listdir(path))
+                 if f.endswith(".json")]
+    else:
+        files = [path]
+    for f in files:
+        with open(f) as fp:
+            data = json.load(fp)
+        for bench in data.get("benchmarks", []):
+            if bench.get("run_type", "iteration") != "iteration":
+                continue
+            results[bench["name"]] = (bench["cpu_time"], bench["time_unit"])
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="regression threshold in percent (default 10)")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    args = parser.parse_args()
+
+    baseline = load_results(args.baseline)
+    current = load_results(args.current)
+    if not baseline or not current:
+        print("no benchmark results found", file=sys.stderr)
+        return 1
+
+    width = max(len(name) for name in sorted(set(baseline) | set(current)))
+    print("%-*s %12s %12s %8s" % (width, "benchmark", "baseline", "current",
+                                  "delta"))
+    regressions = []
+    for name in sorted(set(baseline) | set(current)):
+        if name not in baseline:
+            print("%-*s %12s %12.1f   (new)" % (width, name, "-",
+                                                current[name][0]))
+            continue
+        if name not in current:
+            print("%-*s %12.1f %12s   (gone)" % (width, name,
+                                                 baseline[name][0], "-"))
+            continue
+        base, unit = baseline[name]
+        cur = current[name][0]
+        delta = (cur - base) / base * 100.0 if base else 0.0
+        print("%-*s %12.1f %12.1f %+7.1f%%" % (width, name, base, cur, delta))
+        if delta > args.threshold:
+            regressions.append((name, delta))
+
+    if regressions:
+        print()
+        for name, delta in regressions:
+            print("REGRESSION: %s is %.1f%% slower" % (name, delta))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -10,31 +10,127 @@
 #ifndef KLEE_BITARRAY_H
 #define KLEE_BITARRAY_H
 
+#include <cstdint>
+#include <cstring>
+
 namespace klee {
 
-  // XXX would be nice not to have
-  // two allocations here for allocated
-  // BitArrays
 class BitArray {
 private:
+  // Data words, followed by the summary words: one summary bit per
+  // 64-bit block of data, set whenever the block may contain set bits.
+  // The summary is conservative; unset() leaves it alone and
+  // findNextSet() clears bits that turn out to be stale.
   uint32_t *bits;
-  
+  uint32_t words;
+
 protected:
   static uint32_t length(unsigned size) { return (size+31)/32; }
+  static uint32_t summaryLength(unsigned size) {
+    return ((size + 63) / 64 + 31) / 32;
+  }
+
+  uint32_t *summary() { return bits + words; }
+  const uint32_t *summary() const { return bits + words; }
 
 public:
-  BitArray(unsigned size, bool value = false) : bits(new uint32_t[length(size)]) {
-    memset(bits, value?0xFF:0, sizeof(*bits)*length(size));
+  BitArray(unsigned size, bool value = false)
+      : bits(new uint32_t[length(size) + summaryLength(size)]),
+        words(length(size)) {
+    memset(bits, value ? 0xFF : 0,
+           sizeof(*bits) * (length(size) + summaryLength(size)));
   }
-  BitArray(const BitArray &b, unsigned size) : bits(new uint32_t[length(size)]) {
-    memcpy(bits, b.bits, sizeof(*bits)*length(size));
+  BitArray(const BitArray &b, unsigned size)
+      : bits(new uint32_t[length(size) + summaryLength(size)]),
+        words(length(size)) {
+    memcpy(bits, b.bits, sizeof(*bits) * (length(size) + summaryLength(size)));
   }
   ~BitArray() { delete[] bits; }
 
-  bool get(unsigned idx) { return (bool) ((bits[idx/32]>>(idx&0x1F))&1); }
-  void set(unsigned idx) { bits[idx/32] |= 1<<(idx&0x1F); }
+  bool get(unsigned idx) const {
+    return (bool) ((bits[idx/32]>>(idx&0x1F))&1);
+  }
+  void set(unsigned idx) {
+    bits[idx/32] |= 1<<(idx&0x1F);
+    summary()[idx / 2048] |= 1 << ((idx / 64) & 0x1F);
+  }
   void unset(unsigned idx) { bits[idx/32] &= ~(1<<(idx&0x1F)); }
   void set(unsigned idx, bool value) { if (value) set(idx); else unset(idx); }
+
+  /// Unset all bits in [begin, end), clearing whole words at once.
+  void unsetRange(unsigned begin, unsigned end) {
+    if (begin >= end)
+      return;
+    unsigned firstWord = begin / 32, lastWord = (end - 1) / 32;
+    uint32_t headMask = ~0u << (begin & 0x1F);
+    uint32_t tailMask = ~0u >> (31 - ((end - 1) & 0x1F));
+    if (firstWord == lastWord) {
+      bits[firstWord] &= ~(headMask & tailMask);
+      return;
+    }
+    bits[firstWord] &= ~headMask;
+    for (unsigned w = firstWord + 1; w < lastWord; ++w)
+      bits[w] = 0;
+    bits[lastWord] &= ~tailMask;
+  }
+
+  /// Return true iff every bit in [begin, end) is set, testing whole
+  /// words at once.
+  bool allSetRange(unsigned begin, unsigned end) const {
+    if (begin >= end)
+      return true;
+    unsigned firstWord = begin / 32, lastWord = (end - 1) / 32;
+    uint32_t headMask = ~0u << (begin & 0x1F);
+    uint32_t tailMask = ~0u >> (31 - ((end - 1) & 0x1F));
+    if (firstWord == lastWord) {
+      uint32_t mask = headMask & tailMask;
+      return (bits[firstWord] & mask) == mask;
+    }
+    if ((bits[firstWord] & headMask) != headMask)
+      return false;
+    for (unsigned w = firstWord + 1; w < lastWord; ++w)
+      if (bits[w] != ~0u)
+        return false;
+    return (bits[lastWord] & tailMask) == tailMask;
+  }
+
+  /// Return the index of the first set bit in [begin, end), or \p end if
+  /// there is none. Blocks without set bits are skipped through the
+  /// summary, so scanning a fully unset range costs O(range/2048) words
+  /// once the summary has caught up.
+  unsigned findNextSet(unsigned begin, unsigned end) {
+    unsigned idx = begin;
+    while (idx < end) {
+      const unsigned block = idx / 64;
+      uint32_t &sum = summary()[block / 32];
+      const uint32_t summaryBit = 1u << (block & 0x1F);
+
+      if (!(sum & summaryBit)) {
+        idx = (block + 1) * 64;
+        continue;
+      }
+
+      uint64_t blockBits = uint64_t(bits[2 * block]);
+      if (2 * block + 1 < words)
+        blockBits |= uint64_t(bits[2 * block + 1]) << 32;
+      if (!blockBits) {
+        // the summary bit was stale; clear it so later scans skip the
+        // block right away
+        sum &= ~summaryBit;
+        idx = (block + 1) * 64;
+        continue;
+      }
+
+      blockBits >>= idx & 63;
+      if (!blockBits) {
+        idx = (block + 1) * 64;
+        continue;
+      }
+      idx += __builtin_ctzll(blockBits);
+      return idx < end ? idx : end;
+    }
+    return end;
+  }
 };
 
 } // End klee namespace
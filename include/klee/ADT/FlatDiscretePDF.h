@@ -0,0 +1,178 @@
+//===-- FlatDiscretePDF.h ---------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FLATDISCRETEPDF_H
+#define KLEE_FLATDISCRETEPDF_H
+
+#include <cassert>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+  /// Cache-friendly replacement for DiscretePDF: items live in a
+  /// contiguous array addressed by slot index and weighted choice uses
+  /// an implicit Fenwick tree of prefix sums over that array, so both
+  /// update and choose walk O(log n) adjacent machine words instead of
+  /// chasing tree node pointers. Weight updates are batched: they only
+  /// touch the weight array and are folded into the prefix sums on the
+  /// next choose, as point updates when few slots are stale and as a
+  /// single rebuilding pass over the array when many are.
+  template <class T, class Comparator = std::less<T>>
+  class FlatDiscretePDF {
+    // Comparator is accepted for interface compatibility with
+    // DiscretePDF; the flat layout needs no ordering.
+    typedef double weight_type;
+
+  public:
+    bool empty() const { return items.empty(); }
+
+    bool inTree(T item) { return slots.count(item) != 0; }
+
+    weight_type getWeight(T item) {
+      auto it = slots.find(item);
+      assert(it != slots.end() && "item not in tree");
+      return weights[it->second];
+    }
+
+    void insert(T item, weight_type weight) {
+      assert(!inTree(item) && "already in tree");
+      unsigned slot = items.size();
+      slots[item] = slot;
+      items.push_back(item);
+      weights.push_back(weight);
+      applied.push_back(0);
+      if (tree.size() < items.size() + 1) {
+        // The Fenwick array must grow; cheaper to rebuild it wholesale
+        // on the next choose than to shift partial sums around.
+        tree.resize(2 * items.size() + 1);
+        rebuild = true;
+      } else if (!rebuild) {
+        stale.push_back(slot);
+      }
+    }
+
+    void update(T item, weight_type newWeight) {
+      auto it = slots.find(item);
+      assert(it != slots.end() && "item not in tree");
+      weights[it->second] = newWeight;
+      if (!rebuild)
+        stale.push_back(it->second);
+    }
+
+    void remove(T item) {
+      auto it = slots.find(item);
+      assert(it != slots.end() && "item not in tree");
+      flush();
+      unsigned slot = it->second;
+      unsigned last = items.size() - 1;
+      if (slot != last) {
+        // Keep the array dense: move the last item into the vacated
+        // slot and fix up both prefix sums.
+        add(slot, weights[last] - applied[slot]);
+        items[slot] = items[last];
+        weights[slot] = weights[last];
+        applied[slot] = weights[last];
+        slots[items[slot]] = slot;
+      }
+      add(last, -applied[last]);
+      items.pop_back();
+      weights.pop_back();
+      applied.pop_back();
+      slots.erase(it);
+    }
+
+    /* pick an element according to its weight. p should be in [0,1). */
+    T choose(double p) {
+      assert(!empty() && "choose: tree is empty");
+      flush();
+      unsigned n = items.size();
+      weight_type total = prefixSum(n);
+      if (total <= 0)
+        return items[static_cast<unsigned>(p * n)];
+
+      // Descend the implicit tree: find the first slot whose
+      // cumulative weight exceeds the target.
+      weight_type target = p * total;
+      unsigned pos = 0;
+      unsigned step = 1;
+      while (2 * step <= n)
+        step *= 2;
+      for (; step; step >>= 1) {
+        unsigned next = pos + step;
+        if (next <= n && tree[next] <= target) {
+          target -= tree[next];
+          pos = next;
+        }
+      }
+      return items[pos < n ? pos : n - 1];
+    }
+
+  private:
+    /// Items by slot, densely packed.
+    std::vector<T> items;
+    /// Current weight of each slot; the authoritative values.
+    std::vector<weight_type> weights;
+    /// Weight of each slot as currently reflected in \ref tree.
+    std::vector<weight_type> applied;
+    /// One-based Fenwick array of partial weight sums.
+    std::vector<weight_type> tree;
+    /// Slot of each item.
+    std::unordered_map<T, unsigned> slots;
+    /// Slots whose weight changed since the sums were last folded.
+    std::vector<unsigned> stale;
+    /// When set the whole Fenwick array is rebuilt on the next flush.
+    bool rebuild = false;
+
+    void add(unsigned slot, weight_type delta) {
+      for (unsigned i = slot + 1; i <= items.size(); i += i & -i)
+        tree[i] += delta;
+    }
+
+    weight_type prefixSum(unsigned count) const {
+      weight_type sum = 0;
+      for (unsigned i = count; i; i -= i & -i)
+        sum += tree[i];
+      return sum;
+    }
+
+    /// Fold pending weight changes into the prefix sums: point updates
+    /// while few slots are stale, one linear rebuilding pass once that
+    /// would be slower than starting over.
+    void flush() {
+      unsigned n = items.size();
+      unsigned logN = 1;
+      while ((1u << logN) < n)
+        ++logN;
+      if (!rebuild && stale.size() * logN > n)
+        rebuild = true;
+
+      if (rebuild) {
+        std::fill(tree.begin(), tree.end(), 0);
+        for (unsigned i = 1; i <= n; ++i) {
+          tree[i] += weights[i - 1];
+          unsigned parent = i + (i & -i);
+          if (parent <= n)
+            tree[parent] += tree[i];
+        }
+        applied = weights;
+        rebuild = false;
+      } else {
+        for (unsigned slot : stale) {
+          add(slot, weights[slot] - applied[slot]);
+          applied[slot] = weights[slot];
+        }
+      }
+      stale.clear();
+    }
+  };
+
+}
+
+#endif /* KLEE_FLATDISCRETEPDF_H */
@@ -0,0 +1,703 @@
+//===-- ImmutableBTree.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_IMMUTABLEBTREE_H
+#define KLEE_IMMUTABLEBTREE_H
+
+#include "ImmutableTree.h" // FixedStack
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+  /// A persistent ordered tree with wide, shallow nodes.
+  ///
+  /// Same interface and copy-on-write forking behaviour as
+  /// ImmutableTree, but values live in leaves of up to MaxElts entries
+  /// and internal nodes route through the minimal key of each child
+  /// subtree, so a lookup touches a handful of nodes instead of one
+  /// heap node per element of the search path. Node memory comes from
+  /// per-thread, size-segregated slab pools, and dead subtrees are torn
+  /// down incrementally (a few nodes per subsequent allocation), so
+  /// releasing a large tree has O(1) observable cost.
+  ///
+  /// Removal does not rebalance: underfull nodes are tolerated (empty
+  /// ones are dropped and a single-child root is collapsed), which
+  /// keeps deletion a simple path copy. The height never grows on
+  /// removal and the insert path keeps split nodes at least half full.
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree {
+  public:
+    static size_t allocated;
+    class iterator;
+
+    typedef K key_type;
+    typedef V value_type;
+    typedef KOV key_of_value;
+    typedef CMP key_compare;
+
+    /// Entries per node; wide enough that a million-entry tree is five
+    /// levels deep.
+    enum { MaxElts = 16 };
+
+  private:
+    struct Node {
+      unsigned references;
+      /// Distance to the leaves; 0 for leaf nodes.
+      std::uint8_t height;
+      /// Number of occupied value or child slots.
+      std::uint8_t count;
+
+      explicit Node(std::uint8_t _height)
+          : references(1), height(_height), count(0) {
+        ++allocated;
+      }
+      ~Node() { --allocated; }
+
+      bool isLeaf() const { return height == 0; }
+    };
+
+    struct LeafNode : Node {
+      value_type values[MaxElts];
+      LeafNode() : Node(0) {}
+    };
+
+    struct InternalNode : Node {
+      /// keys[i] is the minimal key of the subtree children[i].
+      key_type keys[MaxElts];
+      Node *children[MaxElts];
+      explicit InternalNode(std::uint8_t _height) : Node(_height) {}
+    };
+
+    Node *root; // null for the empty tree
+
+    explicit ImmutableBTree(Node *_root) : root(_root) {}
+
+    /***/
+
+    enum {
+      /// Nodes per slab allocation.
+      SlabNodes = 256,
+      /// Dead nodes torn down per node allocation. Any constant budget
+      /// eventually catches up (every dead node was once allocated);
+      /// this one keeps the backlog short without noticeable pauses.
+      ReclaimPerAlloc = 8
+    };
+
+    /// Size-segregated node allocator: memory is carved from slabs of
+    /// SlabNodes nodes and recycled through a freelist. Slabs are never
+    /// returned to the system (thread exit abandons them, as the old
+    /// per-node freelists already abandoned their entries).
+    class NodePool {
+      size_t nodeSize;
+      std::vector<void *> freeList;
+      char *bump = nullptr, *bumpEnd = nullptr;
+
+    public:
+      explicit NodePool(size_t _nodeSize) : nodeSize(_nodeSize) {}
+
+      void *allocate() {
+        if (!freeList.empty()) {
+          void *m = freeList.back();
+          freeList.pop_back();
+          return m;
+        }
+        if (bump == bumpEnd) {
+          bump = static_cast<char *>(::operator new(SlabNodes * nodeSize));
+          bumpEnd = bump + SlabNodes * nodeSize;
+        }
+        void *m = bump;
+        bump += nodeSize;
+        return m;
+      }
+
+      void release(void *m) { freeList.push_back(m); }
+    };
+
+    static NodePool &leafPool() {
+      static thread_local NodePool pool(sizeof(LeafNode));
+      return pool;
+    }
+    static NodePool &internalPool() {
+      static thread_local NodePool pool(sizeof(InternalNode));
+      return pool;
+    }
+
+    /// Dead nodes whose teardown (child releases and destructor) is
+    /// still pending; reclaimPending() walks a few per allocation, so
+    /// dropping the last reference to a whole tree — a dying state's
+    /// address space — costs one push here instead of a pause
+    /// proportional to the tree's unshared size.
+    static std::vector<Node *> &pendingFree() {
+      static thread_local std::vector<Node *> pending;
+      return pending;
+    }
+
+    static void reclaimPending(unsigned budget) {
+      std::vector<Node *> &pending = pendingFree();
+      while (budget-- && !pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->isLeaf()) {
+          LeafNode *l = static_cast<LeafNode *>(n);
+          l->~LeafNode();
+          leafPool().release(l);
+        } else {
+          InternalNode *in = static_cast<InternalNode *>(n);
+          for (unsigned i = 0; i < in->count; ++i)
+            decref(in->children[i]);
+          in->~InternalNode();
+          internalPool().release(in);
+        }
+      }
+    }
+
+    static LeafNode *newLeaf() {
+      reclaimPending(ReclaimPerAlloc);
+      return new (leafPool().allocate()) LeafNode();
+    }
+    static InternalNode *newInternal(std::uint8_t height) {
+      reclaimPending(ReclaimPerAlloc);
+      return new (internalPool().allocate()) InternalNode(height);
+    }
+
+    static Node *incref(Node *n) {
+      ++n->references;
+      return n;
+    }
+
+    static void decref(Node *n) {
+      if (--n->references == 0)
+        pendingFree().push_back(n);
+    }
+
+    static LeafNode *cloneLeaf(const LeafNode *l) {
+      LeafNode *n = newLeaf();
+      n->count = l->count;
+      for (unsigned i = 0; i < l->count; ++i)
+        n->values[i] = l->values[i];
+      return n;
+    }
+
+    static InternalNode *cloneInternal(const InternalNode *o) {
+      InternalNode *n = newInternal(o->height);
+      n->count = o->count;
+      for (unsigned i = 0; i < o->count; ++i) {
+        n->keys[i] = o->keys[i];
+        n->children[i] = incref(o->children[i]);
+      }
+      return n;
+    }
+
+    /***/
+
+    static bool keyLT(const key_type &a, const key_type &b) {
+      return key_compare()(a, b);
+    }
+    static const key_type &keyOf(const value_type &v) {
+      return key_of_value()(v);
+    }
+
+    static const key_type &minKey(const Node *n) {
+      while (!n->isLeaf())
+        n = static_cast<const InternalNode *>(n)->children[0];
+      return keyOf(static_cast<const LeafNode *>(n)->values[0]);
+    }
+
+    /// Last child whose minimal key is <= k, or 0 if k sorts before
+    /// every subtree.
+    static unsigned childIndex(const InternalNode *n, const key_type &k) {
+      unsigned i = n->count - 1;
+      while (i > 0 && keyLT(k, n->keys[i]))
+        --i;
+      return i;
+    }
+
+    /***/
+
+    /// Insert v into the subtree rooted at n by path copying. Returns
+    /// an owning reference to the new subtree (which is n itself if the
+    /// key exists and replaceExisting is not set); when the node had to
+    /// split, *split receives an owning reference to the new right
+    /// sibling.
+    static Node *insertRec(Node *n, const value_type &v, bool replaceExisting,
+                           Node **split) {
+      if (n->isLeaf())
+        return insertLeaf(static_cast<LeafNode *>(n), v, replaceExisting,
+                          split);
+      return insertInternal(static_cast<InternalNode *>(n), v, replaceExisting,
+                            split);
+    }
+
+    static Node *insertLeaf(LeafNode *l, const value_type &v,
+                            bool replaceExisting, Node **split) {
+      const key_type &k = keyOf(v);
+      unsigned pos = 0;
+      while (pos < l->count && keyLT(keyOf(l->values[pos]), k))
+        ++pos;
+
+      if (pos < l->count && !keyLT(k, keyOf(l->values[pos]))) {
+        // Key already present.
+        if (!replaceExisting)
+          return incref(l);
+        LeafNode *n = cloneLeaf(l);
+        n->values[pos] = v;
+        return n;
+      }
+
+      if (l->count < MaxElts) {
+        LeafNode *n = newLeaf();
+        n->count = l->count + 1;
+        for (unsigned j = 0; j < n->count; ++j)
+          n->values[j] = j == pos ? v : l->values[j < pos ? j : j - 1];
+        return n;
+      }
+
+      // Full: distribute the MaxElts+1 values over two leaves, the
+      // extra one going left.
+      const unsigned total = MaxElts + 1;
+      const unsigned leftCount = total - total / 2;
+      LeafNode *left = newLeaf(), *right = newLeaf();
+      left->count = leftCount;
+      right->count = total - leftCount;
+      for (unsigned j = 0; j < total; ++j) {
+        const value_type &src = j == pos ? v : l->values[j < pos ? j : j - 1];
+        if (j < leftCount)
+          left->values[j] = src;
+        else
+          right->values[j - leftCount] = src;
+      }
+      *split = right;
+      return left;
+    }
+
+    static Node *insertInternal(InternalNode *o, const value_type &v,
+                                bool replaceExisting, Node **split) {
+      unsigned ci = childIndex(o, keyOf(v));
+      Node *childSplit = nullptr;
+      Node *child = insertRec(o->children[ci], v, replaceExisting, &childSplit);
+      if (child == o->children[ci] && !childSplit) {
+        // Nothing changed below.
+        decref(child);
+        return incref(o);
+      }
+
+      InternalNode *n = cloneInternal(o);
+      decref(n->children[ci]);
+      n->children[ci] = child;
+      n->keys[ci] = minKey(child);
+      if (!childSplit)
+        return n;
+
+      const unsigned ip = ci + 1;
+      if (n->count < MaxElts) {
+        for (unsigned j = n->count; j > ip; --j) {
+          n->children[j] = n->children[j - 1];
+          n->keys[j] = n->keys[j - 1];
+        }
+        n->children[ip] = childSplit;
+        n->keys[ip] = minKey(childSplit);
+        ++n->count;
+        return n;
+      }
+
+      // Full: distribute the MaxElts+1 children over two nodes.
+      const unsigned total = MaxElts + 1;
+      const unsigned leftCount = total - total / 2;
+      InternalNode *left = newInternal(n->height);
+      InternalNode *right = newInternal(n->height);
+      left->count = leftCount;
+      right->count = total - leftCount;
+      for (unsigned j = 0; j < total; ++j) {
+        Node *c = j == ip ? childSplit : n->children[j < ip ? j : j - 1];
+        const key_type &ck =
+            j == ip ? minKey(childSplit) : n->keys[j < ip ? j : j - 1];
+        if (j < leftCount) {
+          left->children[j] = incref(c);
+          left->keys[j] = ck;
+        } else {
+          right->children[j - leftCount] = incref(c);
+          right->keys[j - leftCount] = ck;
+        }
+      }
+      decref(n);
+      decref(childSplit);
+      *split = right;
+      return left;
+    }
+
+    /// Remove k from the subtree rooted at n by path copying. Returns
+    /// an owning reference to the new subtree: n itself if the key is
+    /// absent, or null if the subtree became empty.
+    static Node *removeRec(Node *n, const key_type &k) {
+      if (n->isLeaf()) {
+        LeafNode *l = static_cast<LeafNode *>(n);
+        unsigned pos = 0;
+        while (pos < l->count && keyLT(keyOf(l->values[pos]), k))
+          ++pos;
+        if (pos == l->count || keyLT(k, keyOf(l->values[pos])))
+          return incref(l);
+        if (l->count == 1)
+          return nullptr;
+        LeafNode *res = newLeaf();
+        res->count = l->count - 1;
+        for (unsigned j = 0, t = 0; j < l->count; ++j)
+          if (j != pos)
+            res->values[t++] = l->values[j];
+        return res;
+      }
+
+      InternalNode *o = static_cast<InternalNode *>(n);
+      unsigned ci = childIndex(o, k);
+      Node *child = removeRec(o->children[ci], k);
+      if (child == o->children[ci]) {
+        decref(child);
+        return incref(o);
+      }
+      if (!child) {
+        if (o->count == 1)
+          return nullptr;
+        InternalNode *res = newInternal(o->height);
+        res->count = o->count - 1;
+        for (unsigned j = 0, t = 0; j < o->count; ++j) {
+          if (j == ci)
+            continue;
+          res->children[t] = incref(o->children[j]);
+          res->keys[t] = o->keys[j];
+          ++t;
+        }
+        return res;
+      }
+      InternalNode *res = cloneInternal(o);
+      decref(res->children[ci]);
+      res->children[ci] = child;
+      res->keys[ci] = minKey(child);
+      return res;
+    }
+
+    static size_t sizeRec(const Node *n) {
+      if (!n)
+        return 0;
+      if (n->isLeaf())
+        return n->count;
+      const InternalNode *in = static_cast<const InternalNode *>(n);
+      size_t res = 0;
+      for (unsigned i = 0; i < in->count; ++i)
+        res += sizeRec(in->children[i]);
+      return res;
+    }
+
+  public:
+    ImmutableBTree() : root(nullptr) {}
+    ImmutableBTree(const ImmutableBTree &s)
+        : root(s.root ? incref(s.root) : nullptr) {}
+    ~ImmutableBTree() {
+      if (root)
+        decref(root);
+    }
+
+    ImmutableBTree &operator=(const ImmutableBTree &s) {
+      Node *n = s.root ? incref(s.root) : nullptr;
+      if (root)
+        decref(root);
+      root = n;
+      return *this;
+    }
+
+    bool empty() const { return !root; }
+
+    /// Structural-sharing identity: true iff both trees share the same
+    /// root node, which implies equal contents. A false result says
+    /// nothing about the contents.
+    bool isIdenticalTo(const ImmutableBTree &b) const { return root == b.root; }
+
+    size_t count(const key_type &key) const { return lookup(key) ? 1 : 0; }
+
+    const value_type *lookup(const key_type &k) const {
+      const Node *n = root;
+      if (!n)
+        return nullptr;
+      while (!n->isLeaf()) {
+        const InternalNode *in = static_cast<const InternalNode *>(n);
+        n = in->children[childIndex(in, k)];
+      }
+      const LeafNode *l = static_cast<const LeafNode *>(n);
+      for (unsigned i = 0; i < l->count; ++i) {
+        const key_type &key = keyOf(l->values[i]);
+        if (keyLT(k, key))
+          break;
+        if (!keyLT(key, k))
+          return &l->values[i];
+      }
+      return nullptr;
+    }
+
+    // find the last value less than or equal to key, or null if
+    // no such value exists
+    const value_type *lookup_previous(const key_type &k) const {
+      const Node *n = root;
+      if (!n)
+        return nullptr;
+      while (!n->isLeaf()) {
+        const InternalNode *in = static_cast<const InternalNode *>(n);
+        n = in->children[childIndex(in, k)];
+      }
+      const LeafNode *l = static_cast<const LeafNode *>(n);
+      for (unsigned i = l->count; i-- > 0;)
+        if (!keyLT(k, keyOf(l->values[i])))
+          return &l->values[i];
+      return nullptr;
+    }
+
+    const value_type &min() const {
+      const Node *n = root;
+      assert(n);
+      while (!n->isLeaf())
+        n = static_cast<const InternalNode *>(n)->children[0];
+      return static_cast<const LeafNode *>(n)->values[0];
+    }
+
+    const value_type &max() const {
+      const Node *n = root;
+      assert(n);
+      while (!n->isLeaf())
+        n = static_cast<const InternalNode *>(n)->children[n->count - 1];
+      const LeafNode *l = static_cast<const LeafNode *>(n);
+      return l->values[l->count - 1];
+    }
+
+    size_t size() const { return sizeRec(root); }
+
+    ImmutableBTree insert(const value_type &value) const {
+      if (!root) {
+        LeafNode *l = newLeaf();
+        l->count = 1;
+        l->values[0] = value;
+        return ImmutableBTree(l);
+      }
+      Node *split = nullptr;
+      Node *n = insertRec(root, value, false, &split);
+      if (!split)
+        return ImmutableBTree(n);
+      InternalNode *r = newInternal(n->height + 1);
+      r->count = 2;
+      r->children[0] = n;
+      r->keys[0] = minKey(n);
+      r->children[1] = split;
+      r->keys[1] = minKey(split);
+      return ImmutableBTree(r);
+    }
+
+    ImmutableBTree replace(const value_type &value) const {
+      if (!root)
+        return insert(value);
+      Node *split = nullptr;
+      Node *n = insertRec(root, value, true, &split);
+      if (!split)
+        return ImmutableBTree(n);
+      InternalNode *r = newInternal(n->height + 1);
+      r->count = 2;
+      r->children[0] = n;
+      r->keys[0] = minKey(n);
+      r->children[1] = split;
+      r->keys[1] = minKey(split);
+      return ImmutableBTree(r);
+    }
+
+    ImmutableBTree remove(const key_type &key) const {
+      if (!root)
+        return ImmutableBTree(nullptr);
+      Node *n = removeRec(root, key);
+      // Collapse single-child roots so the height can shrink again.
+      while (n && !n->isLeaf() && n->count == 1) {
+        InternalNode *in = static_cast<InternalNode *>(n);
+        Node *child = incref(in->children[0]);
+        decref(n);
+        n = child;
+      }
+      return ImmutableBTree(n);
+    }
+
+    ImmutableBTree popMin(value_type &valueOut) const {
+      valueOut = min();
+      return remove(keyOf(valueOut));
+    }
+
+    ImmutableBTree popMax(value_type &valueOut) const {
+      valueOut = max();
+      return remove(keyOf(valueOut));
+    }
+
+    iterator begin() const { return iterator(root, true); }
+    iterator end() const { return iterator(root, false); }
+
+    iterator lower_bound(const key_type &k) const {
+      iterator it(root, false);
+      if (!root)
+        return it;
+      Node *n = root;
+      while (!n->isLeaf()) {
+        InternalNode *in = static_cast<InternalNode *>(n);
+        unsigned ci = childIndex(in, k);
+        it.stack.push_back(std::make_pair(n, ci));
+        n = in->children[ci];
+      }
+      LeafNode *l = static_cast<LeafNode *>(n);
+      unsigned pos = 0;
+      while (pos < l->count && keyLT(keyOf(l->values[pos]), k))
+        ++pos;
+      if (pos == l->count) {
+        // Everything in this leaf sorts before k; step to the successor.
+        it.stack.push_back(std::make_pair(n, (unsigned)l->count - 1));
+        ++it;
+      } else {
+        it.stack.push_back(std::make_pair(n, pos));
+      }
+      return it;
+    }
+
+    iterator upper_bound(const key_type &key) const {
+      iterator end(root, false), it = lower_bound(key);
+      if (it != end &&
+          !keyLT(key, keyOf(*it))) // no need to loop, no duplicates
+        ++it;
+      return it;
+    }
+
+    iterator find(const key_type &key) const {
+      iterator end(root, false), it = lower_bound(key);
+      if (it == end || keyLT(key, keyOf(*it)))
+        return end;
+      return it;
+    }
+
+    static size_t getAllocated() { return allocated; }
+  };
+
+  /***/
+
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree<K,V,KOV,CMP>::iterator {
+    friend class ImmutableBTree<K,V,KOV,CMP>;
+  private:
+    Node *root; // so we can back up from end
+    /// Path from the root to the current entry: (node, slot index).
+    FixedStack<std::pair<Node *, unsigned>> stack;
+
+    void descendMin(Node *n) {
+      while (!n->isLeaf()) {
+        stack.push_back(std::make_pair(n, 0u));
+        n = static_cast<InternalNode *>(n)->children[0];
+      }
+      stack.push_back(std::make_pair(n, 0u));
+    }
+
+    void descendMax(Node *n) {
+      while (!n->isLeaf()) {
+        stack.push_back(std::make_pair(n, (unsigned)n->count - 1));
+        n = static_cast<InternalNode *>(n)->children[n->count - 1];
+      }
+      stack.push_back(std::make_pair(n, (unsigned)n->count - 1));
+    }
+
+  public:
+    iterator(Node *_root, bool atBeginning)
+        : root(_root ? incref(_root) : nullptr),
+          stack(_root ? _root->height + 1u : 0u) {
+      if (atBeginning && root)
+        descendMin(root);
+    }
+    iterator(const iterator &i) : root(i.root ? incref(i.root) : nullptr),
+                                  stack(i.stack) {}
+    ~iterator() {
+      if (root)
+        decref(root);
+    }
+
+    iterator &operator=(const iterator &b) {
+      Node *n = b.root ? incref(b.root) : nullptr;
+      if (root)
+        decref(root);
+      root = n;
+      stack = b.stack;
+      return *this;
+    }
+
+    const value_type &operator*() {
+      std::pair<Node *, unsigned> &e = stack.back();
+      return static_cast<LeafNode *>(e.first)->values[e.second];
+    }
+
+    const value_type *operator->() { return &**this; }
+
+    bool operator==(const iterator &b) { return stack == b.stack; }
+    bool operator!=(const iterator &b) { return stack != b.stack; }
+
+    iterator &operator++() {
+      assert(!stack.empty());
+      {
+        std::pair<Node *, unsigned> &e = stack.back();
+        if (e.second + 1 < e.first->count) {
+          ++e.second;
+          return *this;
+        }
+      }
+      stack.pop_back();
+      while (!stack.empty()) {
+        std::pair<Node *, unsigned> &e = stack.back();
+        if (e.second + 1 < e.first->count) {
+          ++e.second;
+          descendMin(static_cast<InternalNode *>(e.first)->children[e.second]);
+          return *this;
+        }
+        stack.pop_back();
+      }
+      return *this; // now == end()
+    }
+
+    iterator &operator--() {
+      if (stack.empty()) {
+        if (root)
+          descendMax(root);
+        return *this;
+      }
+      {
+        std::pair<Node *, unsigned> &e = stack.back();
+        if (e.second > 0) {
+          --e.second;
+          return *this;
+        }
+      }
+      stack.pop_back();
+      while (!stack.empty()) {
+        std::pair<Node *, unsigned> &e = stack.back();
+        if (e.second > 0) {
+          --e.second;
+          descendMax(static_cast<InternalNode *>(e.first)->children[e.second]);
+          return *this;
+        }
+        stack.pop_back();
+      }
+      return *this; // stepped before begin()
+    }
+  };
+
+  /***/
+
+  template<class K, class V, class KOV, class CMP>
+  size_t ImmutableBTree<K,V,KOV,CMP>::allocated = 0;
+
+}
+
+#endif /* KLEE_IMMUTABLEBTREE_H */
@@ -12,7 +12,7 @@
 
 #include <functional>
 
-#include "ImmutableTree.h"
+#include "ImmutableBTree.h"
 
 namespace klee {
   template<class V, class D>
@@ -27,7 +27,7 @@ namespace klee {
     typedef K key_type;
     typedef std::pair<K,D> value_type;
 
-    typedef ImmutableTree<K, value_type, _Select1st<value_type,key_type>, CMP> Tree;
+    typedef ImmutableBTree<K, value_type, _Select1st<value_type,key_type>, CMP> Tree;
     typedef typename Tree::iterator iterator;
 
   private:
@@ -42,8 +42,13 @@ namespace klee {
 
     ImmutableMap &operator=(const ImmutableMap &b) { elts = b.elts; return *this; }
     
-    bool empty() const { 
-      return elts.empty(); 
+    bool empty() const {
+      return elts.empty();
+    }
+    /// Structural-sharing identity: true iff both maps share the same
+    /// underlying tree, which implies equal contents.
+    bool isIdenticalTo(const ImmutableMap &b) const {
+      return elts.isIdenticalTo(b.elts);
     }
     size_t count(const key_type &key) const { 
       return elts.count(key); 
@@ -54,6 +54,45 @@ extern "C" {
 
   void  kTest_free(KTest *);
 
+  /* === KTEST v2: memory-mapped container with lazy object access === */
+
+  /* An open KTEST v2 file. Only the fixed header and the object
+     directory are parsed on open; object names and bytes are served
+     straight from the file mapping, and compressed objects are decoded
+     on first access. */
+  typedef struct KTest2 KTest2;
+
+  /* return true iff file at path has the KTEST v2 magic */
+  int kTest_isKTest2File(const char *path);
+
+  /* Write in the KTEST v2 format. When compress is non-zero and zlib
+     support is compiled in, object data is compressed per object;
+     objects that do not shrink are stored uncompressed. Returns 1 on
+     success, 0 on (unspecified) error. */
+  int kTest_toFile2(KTest *, const char *path, int compress);
+
+  /* returns NULL on (unspecified) error */
+  KTest2 *kTest2_open(const char *path);
+
+  unsigned kTest2_numArgs(const KTest2 *);
+  const char *kTest2_arg(const KTest2 *, unsigned index);
+  unsigned kTest2_symArgvs(const KTest2 *);
+  unsigned kTest2_symArgvLen(const KTest2 *);
+  unsigned kTest2_numObjects(const KTest2 *);
+
+  /* name and size come from the object directory and never touch the
+     object data */
+  const char *kTest2_objectName(const KTest2 *, unsigned index);
+  unsigned kTest2_objectNumBytes(const KTest2 *, unsigned index);
+
+  /* Pointer to the object's bytes, valid until kTest2_close(). For
+     uncompressed objects this points into the file mapping; compressed
+     objects are decoded (and cached) on first access. Returns NULL if
+     the object cannot be decoded. */
+  const unsigned char *kTest2_objectBytes(KTest2 *, unsigned index);
+
+  void kTest2_close(KTest2 *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,13 +11,13 @@
 #define KLEE_MAPOFSETS_H
 
 #include <cassert>
+#include <functional>
 #include <vector>
 #include <set>
 #include <map>
 
 // This should really be broken down into TreeOfSets on top of which
-// SetOfSets and MapOfSets are easily implemeted. It should also be
-// parameterized on the underlying set type. Neither are hard to do,
+// SetOfSets and MapOfSets are easily implemeted. Neither is hard to do,
 // just not worth it at the moment.
 //
 // I also broke some STLish conventions because I was bored.
@@ -26,7 +26,7 @@ namespace klee {
 
   /** This implements the UBTree data structure (see Hoffmann and
       Koehler, "A New Method to Index and Query Sets", IJCAI 1999) */
-  template<class K, class V>
+  template<class K, class V, class C = std::less<K>>
   class MapOfSets {
   public:
     class iterator;
@@ -36,22 +36,22 @@ namespace klee {
 
     void clear();
 
-    void insert(const std::set<K> &set, const V &value);
+    void insert(const std::set<K, C> &set, const V &value);
 
-    V *lookup(const std::set<K> &set);
+    V *lookup(const std::set<K, C> &set);
 
     iterator begin();
     iterator end();
 
-    void subsets(const std::set<K> &set, 
-                 std::vector< std::pair<std::set<K>, V> > &resultOut);
-    void supersets(const std::set<K> &set, 
-                   std::vector< std::pair<std::set<K>, V> > &resultOut);
+    void subsets(const std::set<K, C> &set, 
+                 std::vector< std::pair<std::set<K, C>, V> > &resultOut);
+    void supersets(const std::set<K, C> &set, 
+                   std::vector< std::pair<std::set<K, C>, V> > &resultOut);
     
     template<class Predicate>
-    V *findSuperset(const std::set<K> &set, const Predicate &p);
+    V *findSuperset(const std::set<K, C> &set, const Predicate &p);
     template<class Predicate>
-    V *findSubset(const std::set<K> &set, const Predicate &p);
+    V *findSubset(const std::set<K, C> &set, const Predicate &p);
 
   private:
     class Node;
@@ -60,52 +60,52 @@ namespace klee {
 
     template<class Iterator, class Vector>
     void findSubsets(Node *n, 
-                     const std::set<K> &accum,
+                     const std::set<K, C> &accum,
                      Iterator begin, 
                      Iterator end,
                      Vector &resultsOut);
     template<class Iterator, class Vector>
     void findSupersets(Node *n, 
-                       const std::set<K> &accum,
+                       const std::set<K, C> &accum,
                        Iterator begin, 
                        Iterator end,
                        Vector &resultsOut);
     template<class Predicate>
     V *findSuperset(Node *n, 
-                    typename std::set<K>::iterator begin, 
-                    typename std::set<K>::iterator end,
+                    typename std::set<K, C>::iterator begin, 
+                    typename std::set<K, C>::iterator end,
                     const Predicate &p);
     template<class Predicate>
     V *findSubset(Node *n, 
-                  typename std::set<K>::iterator begin, 
-                  typename std::set<K>::iterator end,
+                  typename std::set<K, C>::iterator begin, 
+                  typename std::set<K, C>::iterator end,
                   const Predicate &p);
   };
 
   /***/
 
-  template<class K, class V>
-  class MapOfSets<K,V>::Node {
-    friend class MapOfSets<K,V>;
-    friend class MapOfSets<K,V>::iterator;
+  template<class K, class V, class C>
+  class MapOfSets<K,V,C>::Node {
+    friend class MapOfSets<K,V,C>;
+    friend class MapOfSets<K,V,C>::iterator;
 
   public:
-    typedef std::map<K, Node> children_ty;
+    typedef std::map<K, Node, C> children_ty;
 
     V value;
 
   private:
     bool isEndOfSet;
-    std::map<K, Node> children;
+    std::map<K, Node, C> children;
     
   public:
     Node() : value(), isEndOfSet(false) {}
   };
   
-  template<class K, class V>
-  class MapOfSets<K,V>::iterator {
-    typedef std::vector< typename std::map<K, Node>::iterator > stack_ty;
-    friend class MapOfSets<K,V>;
+  template<class K, class V, class C>
+  class MapOfSets<K,V,C>::iterator {
+    typedef std::vector< typename std::map<K, Node, C>::iterator > stack_ty;
+    friend class MapOfSets<K,V,C>;
   private:
     Node *root;
     bool onEntry;
@@ -156,9 +156,9 @@ namespace klee {
         step();
     }
 
-    const std::pair<const std::set<K>, const V> operator*() {
+    const std::pair<const std::set<K, C>, const V> operator*() {
       assert(onEntry || !stack.empty());
-      std::set<K> s;
+      std::set<K, C> s;
       for (typename stack_ty::iterator it = stack.begin(), ie = stack.end();
            it != ie; ++it)
         s.insert((*it)->first);
@@ -181,11 +181,11 @@ namespace klee {
 
   /***/
 
-  template<class K, class V>
-  MapOfSets<K,V>::MapOfSets() {}  
+  template<class K, class V, class C>
+  MapOfSets<K,V,C>::MapOfSets() {}  
 
-  template<class K, class V>
-  void MapOfSets<K,V>::insert(const std::set<K> &set, const V &value) {
+  template<class K, class V, class C>
+  void MapOfSets<K,V,C>::insert(const std::set<K, C> &set, const V &value) {
     Node *n = &root;
     for (auto const& element : set) {
       n = &n->children.insert(std::make_pair(element, Node())).first->second;
@@ -194,10 +194,10 @@ namespace klee {
     n->value = value;
   }
 
-  template<class K, class V>
-  V *MapOfSets<K,V>::lookup(const std::set<K> &set) {
+  template<class K, class V, class C>
+  V *MapOfSets<K,V,C>::lookup(const std::set<K, C> &set) {
     Node *n = &root;
-    for (typename std::set<K>::const_iterator it = set.begin(), ie = set.end();
+    for (typename std::set<K, C>::const_iterator it = set.begin(), ie = set.end();
          it != ie; ++it) {
       typename Node::children_ty::iterator kit = n->children.find(*it);
       if (kit==n->children.end()) {
@@ -213,18 +213,18 @@ namespace klee {
     }
   }
 
-  template<class K, class V>
-  typename MapOfSets<K,V>::iterator 
-  MapOfSets<K,V>::begin() { return iterator(&root); }
+  template<class K, class V, class C>
+  typename MapOfSets<K,V,C>::iterator 
+  MapOfSets<K,V,C>::begin() { return iterator(&root); }
   
-  template<class K, class V>
-  typename MapOfSets<K,V>::iterator 
-  MapOfSets<K,V>::end() { return iterator(); }
+  template<class K, class V, class C>
+  typename MapOfSets<K,V,C>::iterator 
+  MapOfSets<K,V,C>::end() { return iterator(); }
 
-  template<class K, class V>
+  template<class K, class V, class C>
   template<class Iterator, class Vector>
-  void MapOfSets<K,V>::findSubsets(Node *n, 
-                                  const std::set<K> &accum,
+  void MapOfSets<K,V,C>::findSubsets(Node *n, 
+                                  const std::set<K, C> &accum,
                                   Iterator begin, 
                                   Iterator end,
                                   Vector &resultsOut) {
@@ -237,24 +237,24 @@ namespace klee {
       typename Node::children_ty::iterator kit = n->children.find(elt);
       it++;
       if (kit!=n->children.end()) {
-        std::set<K> nacc = accum;
+        std::set<K, C> nacc = accum;
         nacc.insert(elt);
         findSubsets(&kit->second, nacc, it, end, resultsOut);
       }
     }
   }
 
-  template<class K, class V>
-  void MapOfSets<K,V>::subsets(const std::set<K> &set,
-                               std::vector< std::pair<std::set<K>, 
+  template<class K, class V, class C>
+  void MapOfSets<K,V,C>::subsets(const std::set<K, C> &set,
+                               std::vector< std::pair<std::set<K, C>, 
                                                       V> > &resultOut) {
-    findSubsets(&root, std::set<K>(), set.begin(), set.end(), resultOut);
+    findSubsets(&root, std::set<K, C>(), set.begin(), set.end(), resultOut);
   }
 
-  template<class K, class V>
+  template<class K, class V, class C>
   template<class Iterator, class Vector>
-  void MapOfSets<K,V>::findSupersets(Node *n, 
-                                     const std::set<K> &accum,
+  void MapOfSets<K,V,C>::findSupersets(Node *n, 
+                                     const std::set<K, C> &accum,
                                      Iterator begin, 
                                      Iterator end,
                                      Vector &resultsOut) {
@@ -263,7 +263,7 @@ namespace klee {
         resultsOut.push_back(std::make_pair(accum, n->value));
       for (typename Node::children_ty::iterator it = n->children.begin(),
              ie = n->children.end(); it != ie; ++it) {
-        std::set<K> nacc = accum;
+        std::set<K, C> nacc = accum;
         nacc.insert(it->first);
         findSupersets(&it->second, nacc, begin, end, resultsOut);
       }
@@ -273,7 +273,7 @@ namespace klee {
       ++next;
       for (typename Node::children_ty::iterator it = n->children.begin(),
              ie = n->children.end(); it != ie; ++it) {
-        std::set<K> nacc = accum;
+        std::set<K, C> nacc = accum;
         nacc.insert(it->first);
         if (elt==it->first) {
           findSupersets(&it->second, nacc, next, end, resultsOut);
@@ -286,17 +286,17 @@ namespace klee {
     }
   }
 
-  template<class K, class V>
-  void MapOfSets<K,V>::supersets(const std::set<K> &set,
-                               std::vector< std::pair<std::set<K>, V> > &resultOut) {
-    findSupersets(&root, std::set<K>(), set.begin(), set.end(), resultOut);
+  template<class K, class V, class C>
+  void MapOfSets<K,V,C>::supersets(const std::set<K, C> &set,
+                               std::vector< std::pair<std::set<K, C>, V> > &resultOut) {
+    findSupersets(&root, std::set<K, C>(), set.begin(), set.end(), resultOut);
   }
 
-  template<class K, class V>
+  template<class K, class V, class C>
   template<class Predicate>
-  V *MapOfSets<K,V>::findSubset(Node *n, 
-                                typename std::set<K>::iterator begin, 
-                                typename std::set<K>::iterator end,
+  V *MapOfSets<K,V,C>::findSubset(Node *n, 
+                                typename std::set<K, C>::iterator begin, 
+                                typename std::set<K, C>::iterator end,
                                 const Predicate &p) {   
     if (n->isEndOfSet && p(n->value)) {
       return &n->value;
@@ -306,7 +306,7 @@ namespace klee {
       typename Node::children_ty::iterator kend = n->children.end();
       typename Node::children_ty::iterator 
         kbegin = n->children.lower_bound(*begin);
-      typename std::set<K>::iterator it = begin;
+      typename std::set<K, C>::iterator it = begin;
       if (kbegin==kend)
         return 0;
       for (;;) { // kbegin!=kend && *it <= kbegin->first
@@ -330,11 +330,11 @@ namespace klee {
     }
   }
   
-  template<class K, class V>
+  template<class K, class V, class C>
   template<class Predicate>
-  V *MapOfSets<K,V>::findSuperset(Node *n, 
-                                  typename std::set<K>::iterator begin, 
-                                  typename std::set<K>::iterator end,
+  V *MapOfSets<K,V,C>::findSuperset(Node *n, 
+                                  typename std::set<K, C>::iterator begin, 
+                                  typename std::set<K, C>::iterator end,
                                   const Predicate &p) {   
     if (begin==end) {
       if (n->isEndOfSet && p(n->value))
@@ -345,35 +345,37 @@ namespace klee {
         if (res) return res;
       }
     } else {
-      typename Node::children_ty::iterator kmid = 
-        n->children.lower_bound(*begin);
-      for (typename Node::children_ty::iterator it = n->children.begin(),
-             ie = n->children.end(); it != ie; ++it) {
-        V *res = findSuperset(&it->second, begin, end, p);
-        if (res) return res;
-      }
-      if (kmid!=n->children.end() && *begin==kmid->first) {
-        V *res = findSuperset(&kmid->second, ++begin, end, p);
+      // Keys strictly increase along any path (sets are inserted in
+      // sorted order), so once a child's key passes *begin no descendant
+      // can supply *begin and the whole subtree is pruned.
+      typename Node::children_ty::iterator kend =
+        n->children.upper_bound(*begin);
+      for (typename Node::children_ty::iterator it = n->children.begin();
+           it != kend; ++it) {
+        typename std::set<K, C>::iterator next = begin;
+        if (it->first==*begin)
+          ++next;
+        V *res = findSuperset(&it->second, next, end, p);
         if (res) return res;
       }
     }
     return 0;
   }
 
-  template<class K, class V>
+  template<class K, class V, class C>
   template<class Predicate>
-  V *MapOfSets<K,V>::findSuperset(const std::set<K> &set, const Predicate &p) {    
+  V *MapOfSets<K,V,C>::findSuperset(const std::set<K, C> &set, const Predicate &p) {    
     return findSuperset(&root, set.begin(), set.end(), p);
   }
 
-  template<class K, class V>
+  template<class K, class V, class C>
   template<class Predicate>
-  V *MapOfSets<K,V>::findSubset(const std::set<K> &set, const Predicate &p) {    
+  V *MapOfSets<K,V,C>::findSubset(const std::set<K, C> &set, const Predicate &p) {    
     return findSubset(&root, set.begin(), set.end(), p);
   }
 
-  template<class K, class V>
-  void MapOfSets<K,V>::clear() {
+  template<class K, class V, class C>
+  void MapOfSets<K,V,C>::clear() {
     root.isEndOfSet = false;
     root.value = V();
     root.children.clear();
@@ -10,6 +10,8 @@
 #ifndef KLEE_RNG_H
 #define KLEE_RNG_H
 
+#include <cstdint>
+
 namespace klee {
   class RNG {
   private:
@@ -47,6 +49,43 @@ namespace klee {
     /* generators a random flop */
     bool getBool();
   };
+
+  /// Small splittable generator (xoshiro256**) for per-state random
+  /// streams. It carries 32 bytes of state per copy, and split()
+  /// derives a deterministic, statistically independent child stream.
+  /// Random decisions along one path are therefore reproducible from
+  /// the fork path alone, independent of how exploration interleaves
+  /// states, and need no generator shared across threads.
+  class SplittableRNG {
+  private:
+    std::uint64_t s[4];
+
+    std::uint64_t next();
+
+  public:
+    /* seeds from -rng-initial-seed */
+    SplittableRNG();
+    explicit SplittableRNG(std::uint64_t seed);
+
+    /* set seed value */
+    void seed(std::uint64_t seed);
+
+    /* derive the stream for a state forked off this one; tag
+       distinguishes siblings created at the same fork (e.g. the branch
+       index) */
+    SplittableRNG split(std::uint64_t tag);
+
+    /* same intervals as the corresponding RNG generators */
+    unsigned int getInt32();
+    int getInt31();
+    double getDoubleLR();
+    float getFloatLR();
+    double getDoubleL();
+    float getFloatL();
+    double getDouble();
+    float getFloat();
+    bool getBool();
+  };
 }
 
 #endif /* KLEE_RNG_H */
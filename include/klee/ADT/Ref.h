@@ -31,7 +31,9 @@
 
 #include "klee/Support/Casting.h"
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <iosfwd> // FIXME: Remove this when LLVM 4.0 support is removed!!!
 
 namespace llvm {
@@ -43,14 +45,101 @@ namespace klee {
 template<class T>
 class ref;
 
-/// Reference counter to be used as part of a ref-managed struct or class
+/// Reference counter to be used as part of a ref-managed struct or class.
+///
+/// The counter is biased towards the thread that took the first
+/// reference: that thread counts its references in a plain integer,
+/// keeping the single-threaded hot path free of atomic operations,
+/// while every other thread counts through a shared atomic. When the
+/// owning thread drops its last reference it surrenders the bias and
+/// routes that drop through the shared path, so exactly one thread
+/// observes the count reaching zero no matter which thread drops last.
+/// This lets parallel workers and background readers share ref-managed
+/// objects without taxing ordinary execution.
+///
+/// The one discipline this scheme requires: a thread must not drop
+/// more references to an object than it took, i.e. hand references to
+/// another thread by copying (the receiving side's copy is counted on
+/// its own thread), never by moving a ref across threads. The parallel
+/// execution modes cannot honour it -- stolen states and queued solver
+/// work move whole ref graphs to the thread that eventually destroys
+/// them -- so every component that spawns threads handling ref-managed
+/// objects calls \ref disableBias first, and objects created from then
+/// on count all references through the shared atomic.
 class ReferenceCounter {
   template<class T>
   friend class ref;
 
-  /// Count how often the object has been referenced.
+  /// Sentinel owner value once the bias has been surrendered.
+  static const std::uint32_t Unbiased = ~static_cast<std::uint32_t>(0);
+
+  /// References held by the owning thread; modified without atomics.
   unsigned refCount = 0;
 
+  /// References taken or dropped by threads other than the owner, plus
+  /// the owner's surrendered bias token.
+  std::atomic<unsigned> sharedCount{0};
+
+  /// Numeric id of the thread the counter is biased towards: 0 before
+  /// the first reference is taken, \ref Unbiased after the owner let
+  /// go. Only ever written by the owning (or claiming) thread.
+  std::atomic<std::uint32_t> owner{0};
+
+  /// Small dense id of the calling thread; never reused.
+  static std::uint32_t threadID() {
+    static std::atomic<std::uint32_t> next{1};
+    static thread_local std::uint32_t id =
+        next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+  }
+
+  /// True once \ref disableBias ran; objects created after that never
+  /// claim an owner and count everything through the shared atomic.
+  static std::atomic<bool> &biasDisabled() {
+    static std::atomic<bool> disabled{false};
+    return disabled;
+  }
+
+  void increment() {
+    const std::uint32_t tid = threadID();
+    const std::uint32_t o = owner.load(std::memory_order_relaxed);
+    if (o == tid) {
+      ++refCount;
+      return;
+    }
+    if (o == 0 && !biasDisabled().load(std::memory_order_relaxed)) {
+      // First reference: bias the counter towards the creating thread.
+      // An object without references cannot be visible to any other
+      // thread yet, so the claim cannot race.
+      owner.store(tid, std::memory_order_relaxed);
+      ++refCount;
+      return;
+    }
+    sharedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Drop a reference.
+  /// \return true iff this was the last reference and the object must
+  /// be deleted by the caller.
+  bool decrement() {
+    if (owner.load(std::memory_order_relaxed) == threadID()) {
+      if (--refCount)
+        return false;
+      // Surrender the bias and route the owner's final drop through
+      // the shared path: the fetch_sub below is then the single point
+      // deciding which thread sees the count hit zero.
+      sharedCount.fetch_add(1, std::memory_order_relaxed);
+      owner.store(Unbiased, std::memory_order_release);
+    }
+    if (sharedCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return false;
+    // Zero is final only once no bias is outstanding: either the owner
+    // surrendered it, or the object never claimed one (created with
+    // the bias disabled).
+    const std::uint32_t o = owner.load(std::memory_order_acquire);
+    return o == Unbiased || o == 0;
+  }
+
 public:
   ReferenceCounter() = default;
   ~ReferenceCounter() = default;
@@ -62,7 +151,20 @@ public:
 
   /// Returns the number of parallel references of this objects
   /// \return number of references on this object
-  unsigned getCount() {return refCount;}
+  unsigned getCount() {
+    return refCount + sharedCount.load(std::memory_order_relaxed);
+  }
+
+  /// Stop biasing counters of newly created objects towards their
+  /// creating thread; they fall back to a plain atomic count that any
+  /// thread may increment or decrement freely. Components that spawn
+  /// threads handling ref-managed objects must call this before
+  /// starting them and before creating any object those threads may
+  /// end up destroying -- objects that already claimed a bias keep it
+  /// and remain subject to the copy-don't-move discipline above.
+  static void disableBias() {
+    biasDisabled().store(true, std::memory_order_relaxed);
+  }
 
   // Copy assignment operator
   ReferenceCounter &operator=(const ReferenceCounter &a) {
@@ -70,6 +172,8 @@ public:
       return *this;
     // The new copy won't be referenced
     refCount = 0;
+    sharedCount.store(0, std::memory_order_relaxed);
+    owner.store(0, std::memory_order_relaxed);
     return *this;
   }
 
@@ -91,11 +195,11 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->_refCount.refCount;
+      ptr->_refCount.increment();
   }
 
   void dec() const {
-    if (ptr && --ptr->_refCount.refCount == 0)
+    if (ptr && ptr->_refCount.decrement())
       delete ptr;
   }
 
@@ -10,7 +10,9 @@
 #ifndef KLEE_TREESTREAM_H
 #define KLEE_TREESTREAM_H
 
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace klee {
@@ -30,8 +32,21 @@ namespace klee {
     std::string path;
     std::ofstream *output;
     unsigned ids;
+    uint64_t fileOffset;
+
+    /// Parent stream of each allocated id (index 0 unused).
+    std::vector<unsigned> parents;
+    /// File offset at which each stream was forked off its parent;
+    /// parent data beyond this point does not belong to the child.
+    std::vector<uint64_t> forkOffsets;
+    /// Per stream, the (payload offset, size) of its data records in
+    /// file order; lets readStream() seek straight to a given stream's
+    /// path instead of scanning the whole file.
+    std::vector<std::vector<std::pair<uint64_t, unsigned> > > index;
 
     void write(TreeOStream &os, const char *s, unsigned size);
+    void writeVarint(uint64_t value);
+    void writeRecord(unsigned id, const char *s, unsigned size);
     void flushBuffer();
 
   public:
@@ -0,0 +1,66 @@
+//===-- WorkStealingQueue.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WORKSTEALINGQUEUE_H
+#define KLEE_WORKSTEALINGQUEUE_H
+
+#include <algorithm>
+#include <deque>
+
+namespace klee {
+
+/// A double-ended work queue following the usual work-stealing
+/// discipline: the owning worker pushes and pops at the bottom (LIFO,
+/// for locality), while other workers steal from the top (FIFO, taking
+/// the oldest and typically largest unit of work).
+///
+/// The queue itself performs no synchronization; in the parallel
+/// execution mode all queue operations are made while holding the
+/// global interpreter lock, which is only released around solver
+/// queries.
+template <class T> class WorkStealingQueue {
+  std::deque<T> items;
+
+public:
+  /// Push \p item onto the bottom of the queue. Owner only.
+  void push(const T &item) { items.push_back(item); }
+
+  /// Pop the most recently pushed item, or a default-constructed T if
+  /// the queue is empty. Owner only.
+  T pop() {
+    if (items.empty())
+      return T();
+    T item = items.back();
+    items.pop_back();
+    return item;
+  }
+
+  /// Steal the oldest item, or a default-constructed T if the queue is
+  /// empty. Called by other workers.
+  T steal() {
+    if (items.empty())
+      return T();
+    T item = items.front();
+    items.pop_front();
+    return item;
+  }
+
+  /// Remove all occurrences of \p item (e.g. when a queued state is
+  /// terminated early due to memory pressure).
+  void remove(const T &item) {
+    items.erase(std::remove(items.begin(), items.end(), item), items.end());
+  }
+
+  bool empty() const { return items.empty(); }
+  size_t size() const { return items.size(); }
+};
+
+} // namespace klee
+
+#endif /* KLEE_WORKSTEALINGQUEUE_H */
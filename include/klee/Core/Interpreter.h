@@ -125,13 +125,32 @@ public:
 
   // supply a list of branch decisions specifying which direction to
   // take on forks. this can be used to drive the interpretation down
-  // a user specified path. use null to reset.
-  virtual void setReplayPath(const std::vector<bool> *path) = 0;
+  // a user specified path. use null to reset. when isPrefix is set,
+  // exploration continues normally once the decisions are exhausted,
+  // which reconstructs the state at the end of the prefix and explores
+  // only the subtree below it.
+  virtual void setReplayPath(const std::vector<bool> *path,
+                             bool isPrefix = false) = 0;
+
+  // supply the branch paths of a checkpointed state set (one list of
+  // decisions per live state). the frontier is reconstructed by
+  // replaying the paths from the initial state, forking where they
+  // diverge, and exploration continues normally from each frontier
+  // state.
+  virtual void setResumePaths(std::vector<std::vector<bool>> &&paths) = 0;
 
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
 
+  // run one exploration session with \p f as the entry point. an
+  // interpreter on which setModule has completed may run any number of
+  // sessions; the prepared module, the solver chain with the caches it
+  // accumulated, and any compiled instruction sequences carry over
+  // between them, while globals, heap memory and the state set are
+  // reinitialized per session. replay, resume and seed inputs supplied
+  // through the setters above apply to the next session started after
+  // they are set. sessions must not overlap.
   virtual void runFunctionAsMain(llvm::Function *f,
                                  int argc,
                                  char **argv,
@@ -139,6 +158,8 @@ public:
 
   /*** Runtime options ***/
 
+  // request the current session stop at the next safe point. cleared
+  // automatically when the session ends.
   virtual void setHaltExecution(bool value) = 0;
 
   virtual void setInhibitForking(bool value) = 0;
@@ -0,0 +1,67 @@
+//===-- SearcherPlugin.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SEARCHERPLUGIN_H
+#define KLEE_SEARCHERPLUGIN_H
+
+#include <stdint.h>
+
+/// Stable C interface for out-of-tree search heuristics, loaded with
+/// -searcher-plugin=<shared object>. The plugin exports
+///
+///   extern "C" double klee_score_state(const KleeStateFeatures *);
+///
+/// which returns a positive weight; states are drawn with probability
+/// proportional to their weight, exactly like the built-in NURS
+/// searchers. The scoring function is called once per state at fork,
+/// termination and scheduling boundaries and must be cheap, pure and
+/// thread-agnostic -- it sees only the feature vector, never klee
+/// internals, so custom heuristics and learned models need no patches
+/// against the searcher code.
+extern "C" {
+
+/// Packed per-state feature vector handed to the scoring function.
+/// Sized to a single cache line. Fields are append-only across klee
+/// versions -- never reordered or removed -- so plugins built against
+/// an older header keep working; check \ref version before reading
+/// fields newer than the one you compiled against.
+struct KleeStateFeatures {
+  /// Interface revision, currently 1.
+  uint32_t version;
+  /// Forks taken along the state's path.
+  uint32_t depth;
+  /// Instructions the state itself has executed.
+  uint64_t instructions;
+  /// Time the state has spent in the solver, in microseconds.
+  uint64_t queryCostUSec;
+  /// Instructions executed (across all states) at the state's current
+  /// location.
+  uint64_t locationInstructions;
+  /// Instructions executed (across all states) in the state's current
+  /// call path.
+  uint64_t callPathInstructions;
+  /// Instructions the state has executed since it last covered new
+  /// code.
+  uint32_t instsSinceCovNew;
+  /// Static distance from the state's pc to the nearest uncovered
+  /// instruction; 0 when unknown or everything is covered.
+  uint32_t minDistToUncovered;
+  /// Constraints on the state's path condition.
+  uint32_t numConstraints;
+  /// Nonzero when the state has been throttled for runaway expression
+  /// growth (-expr-node-hard-watermark). Built-in heuristics send such
+  /// states to the back of every queue.
+  uint32_t throttled;
+};
+
+/// Signature of the exported scoring function.
+typedef double (*KleeStateScoreFn)(const struct KleeStateFeatures *);
+}
+
+#endif /* KLEE_SEARCHERPLUGIN_H */
@@ -59,13 +59,30 @@ public:
                            Expr::Width _domain = Expr::Int32,
                            Expr::Width _range = Expr::Int8);
 
+  /// Delete arrays that can no longer appear in any expression: arrays
+  /// that are neither referenced by an UpdateList nor listed in \p live.
+  /// \p live should name the arrays reachable outside the expression
+  /// graph, e.g. the symbolics of the running states. The addresses of
+  /// reclaimed arrays may be reused, so arrayCacheGeneration is bumped to
+  /// tell the solver builders to drop their per-array caches.
+  ///
+  /// \return The number of arrays reclaimed.
+  unsigned collect(const std::unordered_set<const Array *> &live);
+
 private:
   typedef std::unordered_set<const Array *, klee::ArrayHashFn,
                              klee::EquivArrayCmpFn>
       ArrayHashMap;
-  ArrayHashMap cachedSymbolicArrays;
+  /// Symbolic arrays, sharded by hash so that no single table has to
+  /// rehash millions of entries at once as the cache grows.
+  static const unsigned NumShards = 64;
+  ArrayHashMap cachedSymbolicArrays[NumShards];
   typedef std::vector<const Array *> ArrayPtrVec;
   ArrayPtrVec concreteArrays;
+
+  ArrayHashMap &shardFor(const Array *array) {
+    return cachedSymbolicArrays[klee::ArrayHashFn()(array) % NumShards];
+  }
 };
 }
 
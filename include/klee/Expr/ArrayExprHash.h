@@ -14,11 +14,34 @@
 #include "klee/Statistics/TimerStatIncrementer.h"
 #include "klee/Solver/SolverStats.h"
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 namespace klee {
-  
+
+/// Bumped by ArrayCache::collect() whenever Array objects are deleted.
+/// Their addresses may be reused for new arrays, so an ArrayExprHash
+/// built against an older generation must drop its entries before being
+/// consulted again.
+extern std::atomic<std::uint64_t> arrayCacheGeneration;
+
+/// Record the arrays reclaimed by the collection that produced \p
+/// generation, so ArrayExprHash instances can evict exactly those
+/// entries instead of dropping everything. Only a bounded number of
+/// recent generations is retained.
+void publishReclaimedArrays(std::uint64_t generation,
+                            std::vector<const Array *> &&dead);
+
+/// Accumulate into \p dead the arrays reclaimed by generations in
+/// (\p from, \p to]. Returns false if the log no longer covers that
+/// range, in which case the caller must fall back to a full clear.
+bool getReclaimedArrays(std::uint64_t from, std::uint64_t to,
+                        std::vector<const Array *> &dead);
+
 struct ArrayHashFn  {
   unsigned operator()(const Array* array) const {
     return(array ? array->hash() : 0);
@@ -29,7 +52,16 @@ struct ArrayCmpFn {
   bool operator()(const Array* array1, const Array* array2) const {
     return(array1 == array2);
   }
-};  
+};
+
+/// Identity hash matching ArrayCmpFn's pointer equality. Entries keyed
+/// this way can be evicted by address after the Array has been deleted,
+/// since the key is never dereferenced.
+struct ArrayPtrHashFn {
+  std::size_t operator()(const Array *array) const {
+    return reinterpret_cast<std::uintptr_t>(array) * 0x9e3779b97f4a7c15ULL;
+  }
+};
   
 struct UpdateNodeHashFn  {
   unsigned operator()(const UpdateNode* un) const {
@@ -44,90 +76,170 @@ struct UpdateNodeCmpFn {
 };  
 
 template<class T>
-class ArrayExprHash {  
+class ArrayExprHash {
 public:
-  
+
   ArrayExprHash() {};
-  // Note: Extend the class and overload the destructor if the objects of type T
-  // that are to be hashed need to be explicitly destroyed
+  // Note: Extend the class and override releaseArrayExpr() /
+  // releaseUpdateNodeExpr() if the objects of type T that are to be hashed
+  // need to be explicitly destroyed on eviction.
   // As an example, see class STPArrayExprHash
   virtual ~ArrayExprHash() {};
-   
-  bool lookupArrayExpr(const Array* array, T& exp) const;
-  void hashArrayExpr(const Array* array, T& exp);  
-  
-  bool lookupUpdateNodeExpr(const UpdateNode* un, T& exp) const;
-  void hashUpdateNodeExpr(const UpdateNode* un, T& exp);  
-  
+
+  /// Drop all cached entries.
+  void clear();
+
+  bool lookupArrayExpr(const Array* array, T& exp);
+  void hashArrayExpr(const Array* array, T& exp);
+
+  bool lookupUpdateNodeExpr(const UpdateNode* un, T& exp);
+  void hashUpdateNodeExpr(const UpdateNode* un, T& exp);
+
+  /// Returns a fresh number on each call, for naming solver-side array
+  /// declarations. Unlike the entry count it never repeats, so evicted
+  /// and re-declared arrays cannot collide with live ones.
+  std::uint64_t nextUniqueId() { return _unique_ids++; }
+
 protected:
-  typedef std::unordered_map<const Array*, T, ArrayHashFn, ArrayCmpFn> ArrayHash;
+  typedef std::unordered_map<const Array*, T, ArrayPtrHashFn, ArrayCmpFn> ArrayHash;
   typedef typename ArrayHash::iterator ArrayHashIter;
   typedef typename ArrayHash::const_iterator ArrayHashConstIter;
-  
+
   typedef std::unordered_map<const UpdateNode*, T, UpdateNodeHashFn, UpdateNodeCmpFn> UpdateNodeHash;
   typedef typename UpdateNodeHash::iterator UpdateNodeHashIter;
   typedef typename UpdateNodeHash::const_iterator UpdateNodeHashConstIter;
-  
-  ArrayHash      _array_hash;
-  UpdateNodeHash _update_node_hash;  
+
+  /// Both tables are sharded by key hash so that no single table has to
+  /// rehash millions of entries at once (mirroring ArrayCache).
+  static const unsigned NumShards = 16;
+  ArrayHash      _array_hash[NumShards];
+  UpdateNodeHash _update_node_hash[NumShards];
+
+  std::uint64_t _unique_ids = 0;
+
+  /// Generation of the ArrayCache the entries were built against; see
+  /// arrayCacheGeneration.
+  std::uint64_t _generation = 0;
+
+  /// Destroy a cached value on eviction; default is a no-op for
+  /// self-managing handle types.
+  virtual void releaseArrayExpr(T &exp) {}
+  virtual void releaseUpdateNodeExpr(T &exp) {}
+
+  ArrayHash &arrayShard(const Array *array) {
+    return _array_hash[ArrayPtrHashFn()(array) % NumShards];
+  }
+  UpdateNodeHash &updateNodeShard(const UpdateNode *un) {
+    return _update_node_hash[UpdateNodeHashFn()(un) % NumShards];
+  }
+
+  /// Bring the entries up to date with the current array generation.
+  /// When behind, evict exactly the entries of reclaimed arrays (their
+  /// addresses may be reused) and adopt the current generation; if the
+  /// reclamation log no longer covers the gap, fall back to dropping
+  /// everything. Update nodes cannot be attributed to their arrays
+  /// cheaply, so that table is always dropped wholesale on a change.
+  void checkGeneration() {
+    std::uint64_t current = arrayCacheGeneration.load(std::memory_order_relaxed);
+    if (_generation == current)
+      return;
+
+    std::vector<const Array *> dead;
+    if (getReclaimedArrays(_generation, current, dead)) {
+      for (const Array *array : dead) {
+        ArrayHash &shard = arrayShard(array);
+        ArrayHashIter it = shard.find(array);
+        if (it != shard.end()) {
+          releaseArrayExpr(it->second);
+          shard.erase(it);
+        }
+      }
+      for (unsigned i = 0; i < NumShards; ++i) {
+        for (auto &entry : _update_node_hash[i])
+          releaseUpdateNodeExpr(entry.second);
+        _update_node_hash[i].clear();
+      }
+    } else {
+      clear();
+    }
+    _generation = current;
+  }
 };
 
+template<class T>
+void ArrayExprHash<T>::clear() {
+  for (unsigned i = 0; i < NumShards; ++i) {
+    for (auto &entry : _array_hash[i])
+      releaseArrayExpr(entry.second);
+    _array_hash[i].clear();
+    for (auto &entry : _update_node_hash[i])
+      releaseUpdateNodeExpr(entry.second);
+    _update_node_hash[i].clear();
+  }
+}
+
 
 template<class T>
-bool ArrayExprHash<T>::lookupArrayExpr(const Array* array, T& exp) const {
+bool ArrayExprHash<T>::lookupArrayExpr(const Array* array, T& exp) {
   bool res = false;
-  
+
 #ifdef KLEE_ARRAY_DEBUG
   TimerStatIncrementer t(stats::arrayHashTime);
 #endif
-  
-  assert(array);  
-  ArrayHashConstIter it = _array_hash.find(array);
-  if (it != _array_hash.end()) {
+
+  assert(array);
+  checkGeneration();
+  ArrayHash &shard = arrayShard(array);
+  ArrayHashConstIter it = shard.find(array);
+  if (it != shard.end()) {
     exp = it->second;
     res = true;
-  }  
+  }
   return res;
 }
 
 template<class T>
 void ArrayExprHash<T>::hashArrayExpr(const Array* array, T& exp) {
-  
+
 #ifdef KLEE_ARRAY_DEBUG
    TimerStatIncrementer t(stats::arrayHashTime);
 #endif
-   
+
    assert(array);
-  _array_hash[array] = exp;
+  checkGeneration();
+  arrayShard(array)[array] = exp;
 }
 
 template<class T>
-bool ArrayExprHash<T>::lookupUpdateNodeExpr(const UpdateNode* un, T& exp) const
+bool ArrayExprHash<T>::lookupUpdateNodeExpr(const UpdateNode* un, T& exp)
 {
   bool res = false;
-  
+
 #ifdef KLEE_ARRAY_DEBUG
   TimerStatIncrementer t(stats::arrayHashTime);
 #endif
-  
+
   assert(un);
-  UpdateNodeHashConstIter it = _update_node_hash.find(un);
-  if (it != _update_node_hash.end()) {
+  checkGeneration();
+  UpdateNodeHash &shard = updateNodeShard(un);
+  UpdateNodeHashConstIter it = shard.find(un);
+  if (it != shard.end()) {
     exp = it->second;
     res = true;
-  }  
+  }
   return res;
 }
 
 template<class T>
-void ArrayExprHash<T>::hashUpdateNodeExpr(const UpdateNode* un, T& exp) 
+void ArrayExprHash<T>::hashUpdateNodeExpr(const UpdateNode* un, T& exp)
 {
 #ifdef KLEE_ARRAY_DEBUG
   TimerStatIncrementer t(stats::arrayHashTime);
 #endif
-  
+
   assert(un);
-  _update_node_hash[un] = exp;
+  checkGeneration();
+  updateNodeShard(un)[un] = exp;
 }
 
 }
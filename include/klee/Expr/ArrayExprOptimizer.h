@@ -10,6 +10,7 @@
 #ifndef KLEE_ARRAYEXPROPTIMIZER_H
 #define KLEE_ARRAYEXPROPTIMIZER_H
 
+#include <array>
 #include <cstdint>
 #include <map>
 #include <unordered_map>
@@ -30,8 +31,17 @@ using mapIndexOptimizedExpr_ty = std::map<ref<Expr>, std::vector<ref<Expr>>>;
 
 class ExprOptimizer {
 private:
-  ExprHashMap<ref<Expr>> cacheExprOptimized;
-  ExprHashSet cacheExprUnapplicable;
+  /// Whole-expression results, indexed by the valueOnly flag: an
+  /// expression the value transformation cannot improve may still be
+  /// amenable to the index transformation, so the two modes must not
+  /// share negative entries.
+  std::array<ExprHashMap<ref<Expr>>, 2> cacheExprOptimized;
+  std::array<ExprHashSet, 2> cacheExprUnapplicable;
+
+  /// Per-read transformations. A ReadExpr hashes its whole update list,
+  /// so the key covers the array contents (i.e. its version) as well as
+  /// the index; entries stay valid across states and as the constraint
+  /// set grows.
   ExprHashMap<ref<Expr>> cacheReadExprOptimized;
 
 public:
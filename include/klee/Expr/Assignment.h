@@ -45,6 +45,12 @@ namespace klee {
     
     ref<Expr> evaluate(const Array *mo, unsigned index) const;
     ref<Expr> evaluate(ref<Expr> e);
+    /// Returns true iff \p e evaluates to constant true under this
+    /// assignment. Equivalent to evaluate(e)->isTrue() but runs
+    /// expressions compiled to flat bytecode (cached per expression)
+    /// when possible, so probing the same constraints against many
+    /// candidate assignments does not re-walk the Expr trees.
+    bool evaluatesToTrue(const ref<Expr> &e);
     ConstraintSet createConstraintsFromAssignment() const;
 
     template<typename InputIterator>
@@ -89,9 +95,8 @@ namespace klee {
 
   template<typename InputIterator>
   inline bool Assignment::satisfies(InputIterator begin, InputIterator end) {
-    AssignmentEvaluator v(*this);
     for (; begin!=end; ++begin)
-      if (!v.visit(*begin)->isTrue())
+      if (!evaluatesToTrue(*begin))
         return false;
     return true;
   }
@@ -0,0 +1,98 @@
+//===-- CompiledExpr.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COMPILEDEXPR_H
+#define KLEE_COMPILEDEXPR_H
+
+#include "klee/Expr/Expr.h"
+
+#include <memory>
+#include <vector>
+
+namespace klee {
+class Assignment;
+
+/// CompiledExpr - An expression compiled once into a flat postfix
+/// bytecode that can then be evaluated against many assignments in a
+/// tight loop, without walking the Expr tree or allocating intermediate
+/// ConstantExprs.
+///
+/// Only the common fragment is compiled: expressions of width <= 64 bits
+/// whose reads index directly into symbolic or constant root arrays.
+/// Anything else (wide integers, reads through update lists) fails
+/// compilation and the caller falls back to the interpretive evaluator.
+/// The evaluation semantics of the compiled fragment match
+/// AssignmentEvaluator exactly; cases whose result would not be a
+/// constant (free array values, division by zero) fail at evaluation
+/// time instead.
+class CompiledExpr {
+public:
+  enum Opcode : unsigned char {
+    Const,
+    ReadSymbolic,
+    ReadConstant,
+    Select,
+    Concat,
+    Extract,
+    ZExt,
+    SExt,
+    Add,
+    Sub,
+    Mul,
+    UDiv,
+    SDiv,
+    URem,
+    SRem,
+    Not,
+    And,
+    Or,
+    Xor,
+    Shl,
+    LShr,
+    AShr,
+    Eq,
+    Ne,
+    Ult,
+    Ule,
+    Slt,
+    Sle
+  };
+
+  struct Instruction {
+    Opcode op;
+    /// Result width in bits (<= 64).
+    unsigned char width;
+    /// Opcode-specific: source width for SExt, bit offset for Extract,
+    /// right operand width for Concat.
+    unsigned char aux;
+    /// Constant value for Const.
+    uint64_t imm;
+    /// Root array for the Read opcodes.
+    const Array *array;
+  };
+
+  /// Compile \p e into bytecode, or return null if it uses features the
+  /// bytecode does not support.
+  static std::unique_ptr<CompiledExpr> compile(const ref<Expr> &e);
+
+  /// Evaluate against \p a. Returns false when the result would not be a
+  /// constant under this assignment; \p result is then unspecified.
+  bool evaluate(const Assignment &a, uint64_t &result) const;
+
+private:
+  CompiledExpr() = default;
+
+  bool compileInto(const ref<Expr> &e);
+
+  std::vector<Instruction> code;
+};
+
+} // namespace klee
+
+#endif /* KLEE_COMPILEDEXPR_H */
@@ -10,6 +10,8 @@
 #ifndef KLEE_CONSTANTDIVISION_H
 #define KLEE_CONSTANTDIVISION_H
 
+#include "klee/Expr/Expr.h"
+
 #include <stdint.h>
 
 namespace klee {
@@ -43,9 +45,38 @@ void ComputeUDivConstants32(uint32_t d, uint32_t &mprime, uint32_t &sh1,
 /// @param [out] mprime
 /// @param [out] dsign
 /// @param [out] shpost
-void ComputeSDivConstants32(int32_t d, int32_t &mprime, int32_t &dsign, 
+void ComputeSDivConstants32(int32_t d, int32_t &mprime, int32_t &dsign,
                             int32_t &shpost);
 
+/// Magic constants for ComputeUDivConstants32, memoized per divisor by
+/// getUDivMagic().
+struct UDivMagic {
+  uint32_t mprime, sh1, sh2;
+};
+
+/// Magic constants for ComputeSDivConstants32, memoized per divisor by
+/// getSDivMagic().
+struct SDivMagic {
+  int32_t mprime, dsign, shpost;
+};
+
+/// Return the (cached) magic constants for unsigned 32-bit division by
+/// \p d. \p d must be non-zero. The cache is thread local, so solver
+/// builders on different threads never contend.
+const UDivMagic &getUDivMagic(uint32_t d);
+
+/// Return the (cached) magic constants for signed 32-bit division by
+/// \p d. \p d must be non-zero.
+const SDivMagic &getSDivMagic(int32_t d);
+
+/// Build n/d for a 32-bit expression \p n and non-zero constant \p d
+/// as two adds, three shifts and one 64-bit multiply instead of a
+/// division node, for backends where symbolic division is expensive.
+ref<Expr> getUDivByConstantExpr(const ref<Expr> &n, uint32_t d);
+
+/// Signed counterpart of getUDivByConstantExpr.
+ref<Expr> getSDivByConstantExpr(const ref<Expr> &n, int32_t d);
+
 }
 
 #endif /* KLEE_CONSTANTDIVISION_H */
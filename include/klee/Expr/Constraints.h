@@ -11,9 +11,42 @@
 #define KLEE_CONSTRAINTS_H
 
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
 
 namespace klee {
 
+/// One link in the persistent constraint chain of a ConstraintSet:
+/// holds one constraint and the chain built before it. Sets copied at a
+/// fork share their common prefix structurally, so the copy costs one
+/// reference count instead of a vector of N expressions.
+struct ConstraintNode {
+  /// @brief Required by klee::ref-managed objects
+  class ReferenceCounter _refCount;
+
+  const ref<ConstraintNode> parent;
+  const ref<Expr> constraint;
+
+  ConstraintNode(ref<ConstraintNode> parent, ref<Expr> constraint)
+      : parent(std::move(parent)), constraint(std::move(constraint)) {}
+
+  ~ConstraintNode() {
+    // Unlink the chain iteratively: sets can hold thousands of
+    // constraints and recursive destruction through `parent` could
+    // overflow the stack.
+    ref<ConstraintNode> p =
+        std::move(const_cast<ref<ConstraintNode> &>(parent));
+    while (p && p->_refCount.getCount() == 1) {
+      ref<ConstraintNode> next =
+          std::move(const_cast<ref<ConstraintNode> &>(p->parent));
+      p = std::move(next);
+    }
+  }
+};
+
 /// Resembles a set of constraints that can be passed around
 ///
 class ConstraintSet {
@@ -31,17 +64,86 @@ public:
   constraint_iterator end() const;
   size_t size() const noexcept;
 
-  explicit ConstraintSet(constraints_ty cs) : constraints(std::move(cs)) {}
+  explicit ConstraintSet(constraints_ty cs);
   ConstraintSet() = default;
 
   void push_back(const ref<Expr> &e);
 
-  bool operator==(const ConstraintSet &b) const {
-    return constraints == b.constraints;
-  }
+  /// Version stamp with the property that two sets carrying the same
+  /// stamp hold identical constraints (the converse need not hold:
+  /// equal sets built independently get distinct stamps). Copies share
+  /// the stamp and every mutation takes a fresh one, so clients can key
+  /// caches by constraint-set content without ever comparing it.
+  std::uint64_t version() const { return versionStamp; }
+
+  /// Order-sensitive hash over the constraint contents, maintained in
+  /// O(1) per append. Unlike version(), equal sets built independently
+  /// hash equally, so solver caches can key on this integer instead of
+  /// rehashing the whole set per lookup.
+  std::uint64_t hash() const { return contentHash; }
+
+  bool operator==(const ConstraintSet &b) const;
+
+  /// Equality-substitution index over the constraints: an entry
+  /// x -> c for every constraint Eq(c, x) with constant c, and e -> true
+  /// for every other constraint. kindMask has bit k set when some key
+  /// has kind k, so visitation can reject non-matching nodes without
+  /// hashing them.
+  struct EqualityIndex {
+    ExprHashMap<ref<Expr>> map;
+    std::uint64_t kindMask = 0;
+
+    void insert(const ref<Expr> &constraint);
+  };
+
+  /// Memo table for simplifyExpr results over this exact constraint
+  /// set. The mutex serializes use, since the prefetch solver thread may
+  /// simplify against a copy sharing this table.
+  struct SimplifyCache {
+    std::mutex mutex;
+    ExprHashMap<ref<Expr>> visited;
+  };
 
 private:
-  constraints_ty constraints;
+  /// Returns a process-unique stamp for \ref versionStamp.
+  static std::uint64_t nextVersion();
+
+  /// Folds one appended constraint into \ref contentHash.
+  static std::uint64_t combineHash(std::uint64_t h, const ref<Expr> &e) {
+    return (h * UINT64_C(0x100000001b3)) ^ e->hash();
+  }
+
+  /// Rebuilds \ref flat from the chain when it is missing.
+  void materialize() const;
+
+  /// Newest constraint; the chain through its parent links holds the
+  /// whole set, shared structurally with the sets this one was copied
+  /// from or to.
+  ref<ConstraintNode> tail;
+
+  /// Number of constraints in the chain.
+  size_t count = 0;
+
+  /// Oldest-first array view of the chain that begin()/end() iterate,
+  /// materialized on first use and shared with copies until either
+  /// side appends. Mutated on const paths under the same single-writer
+  /// discipline as \ref equalities.
+  mutable std::shared_ptr<const constraints_ty> flat;
+
+  /// See version(). Zero on default-constructed (empty) sets.
+  std::uint64_t versionStamp = 0;
+
+  /// See hash(). Zero on empty sets.
+  std::uint64_t contentHash = 0;
+
+  /// Immutable once published and extended copy-on-write by push_back,
+  /// so forked states share the index until their constraints diverge.
+  /// Materialized on first use by ConstraintManager::simplifyExpr.
+  mutable std::shared_ptr<const EqualityIndex> equalities;
+
+  /// Shared with forked copies and dropped whenever a constraint is
+  /// added, as new constraints can enable further rewrites.
+  mutable std::shared_ptr<SimplifyCache> simplifyCache;
 };
 
 class ExprVisitor;
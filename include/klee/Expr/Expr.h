@@ -12,6 +12,7 @@
 
 #include "klee/ADT/Bits.h"
 #include "klee/ADT/Ref.h"
+#include "klee/Support/PoolAllocator.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/DenseSet.h"
@@ -19,6 +20,8 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
+#include <memory>
 #include <sstream>
 #include <set>
 #include <vector>
@@ -40,6 +43,11 @@ template<class T> class ref;
 
 extern llvm::cl::OptionCategory ExprCat;
 
+/// Immutable, id-sorted list of symbolic arrays referenced by an
+/// expression or update node. Shared between nodes with equal sets, so
+/// long common chains cost one vector.
+typedef std::shared_ptr<const std::vector<const Array *> > SymbolicArraySet;
+
 /// Class representing symbolic expressions.
 /**
 
@@ -91,6 +99,18 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 class Expr {
 public:
   static unsigned count;
+
+  /// Construction-time id, dense and unique for the life of the
+  /// process. Comparing ids is an integer-compare total order over
+  /// expressions that deduplicates by object identity only:
+  /// structurally equal duplicates get distinct ids unless they are
+  /// interned (\see createHashConsingExprBuilder). \see ExprIDLess
+  const std::uint64_t id;
+
+private:
+  static std::atomic<std::uint64_t> nextID;
+
+public:
   static const unsigned MAGIC_HASH_CONSTANT = 39;
 
   /// The type of an expression is simply its width, in bits. 
@@ -176,7 +196,12 @@ public:
   /// @brief Required by klee::ref-managed objects
   class ReferenceCounter _refCount;
 
-protected:  
+  /// Cached set of symbolic arrays this expression reads; computed on
+  /// demand by findSymbolicObjects. Only accessed under the lock in
+  /// ExprUtil.cpp since queries traverse shared expressions in parallel.
+  mutable SymbolicArraySet symbolicArrays;
+
+protected:
   unsigned hashValue;
 
   /// Compares `b` to `this` Expr and determines how they are ordered
@@ -204,8 +229,18 @@ protected:
   virtual int compareContents(const Expr &b) const = 0;
 
 public:
-  Expr() { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  Expr() : id(nextID.fetch_add(1, std::memory_order_relaxed)) {
+    Expr::count++;
+  }
+  virtual ~Expr() { Expr::count--; }
+
+  /// Expr nodes are small and churn constantly; route them through the
+  /// pooled size-class allocator. The virtual destructor guarantees the
+  /// sized delete sees the most-derived size.
+  void *operator new(size_t size) { return PoolAllocator::allocate(size); }
+  void operator delete(void *ptr, size_t size) {
+    PoolAllocator::deallocate(ptr, size);
+  }
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -327,6 +362,18 @@ inline bool operator>=(const Expr &lhs, const Expr &rhs) {
   return !(lhs < rhs);
 }
 
+/// Orders expressions by their construction-time id: an integer
+/// compare instead of the recursive structural walk of Expr::compare.
+/// Only object identity deduplicates, so a structurally equal duplicate
+/// becomes a distinct key; use it for containers where that merely
+/// costs a cache miss. Under the hash-consing builder equal structure
+/// implies one interned node, and id order refines structural order.
+struct ExprIDLess {
+  bool operator()(const ref<Expr> &lhs, const ref<Expr> &rhs) const {
+    return lhs->id < rhs->id;
+  }
+};
+
 // Printing operators
 
 inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const Expr &e) {
@@ -461,6 +508,10 @@ public:
   /// @brief Required by klee::ref-managed objects
   mutable class ReferenceCounter _refCount;
 
+  /// Cached set of symbolic arrays referenced from this node onwards
+  /// (index, value and older updates); see Expr::symbolicArrays.
+  mutable SymbolicArraySet symbolicArrays;
+
 private:
   /// size of this update sequence, including this update
   unsigned size;
@@ -477,6 +528,13 @@ public:
   UpdateNode() = delete;
   ~UpdateNode() = default;
 
+  /// Like Expr nodes, UpdateNodes are small and churn constantly; route
+  /// them through the pooled size-class allocator.
+  void *operator new(size_t size) { return PoolAllocator::allocate(size); }
+  void operator delete(void *ptr, size_t size) {
+    PoolAllocator::deallocate(ptr, size);
+  }
+
   unsigned computeHash();
 };
 
@@ -497,9 +555,18 @@ public:
   /// the array size.
   const std::vector<ref<ConstantExpr> > constantValues;
 
+  /// Unique id, assigned in creation order. Gives arrays a stable
+  /// ordering that survives reclamation and address reuse.
+  const unsigned id;
+
 private:
   unsigned hashValue;
 
+  /// Number of UpdateLists currently referencing this array. Maintained
+  /// by UpdateList so that ArrayCache::collect() can reclaim arrays that
+  /// no expression can reach anymore.
+  mutable unsigned refCount;
+
   // FIXME: Make =delete when we switch to C++11
   Array(const Array& array);
 
@@ -533,6 +600,7 @@ public:
   unsigned computeHash();
   unsigned hash() const { return hashValue; }
   friend class ArrayCache;
+  friend class UpdateList;
 };
 
 /// Class representing a complete list of updates into an array.
@@ -547,16 +615,22 @@ public:
 
 public:
   UpdateList(const Array *_root, const ref<UpdateNode> &_head);
-  UpdateList(const UpdateList &b) = default;
-  ~UpdateList() = default;
+  UpdateList(const UpdateList &b);
+  ~UpdateList();
 
-  UpdateList &operator=(const UpdateList &b) = default;
+  UpdateList &operator=(const UpdateList &b);
 
   /// size of this update list
   unsigned getSize() const { return head ? head->getSize() : 0; }
 
   void extend(const ref<Expr> &index, const ref<Expr> &value);
 
+  /// Rebuild the list without constant-index writes that are shadowed by
+  /// a later write to the same index; such writes can never be observed,
+  /// whatever lies between them. Expressions holding the old head are
+  /// unaffected. Returns true if any node was dropped.
+  bool compact();
+
   int compare(const UpdateList &b) const;
   unsigned hash() const;
 };
@@ -1062,7 +1136,16 @@ public:
   static ref<Expr> fromMemory(void *address, Width w);
   void toMemory(void *address);
 
+  /// Return the immortal interned node for \arg v if it is one of the
+  /// hot constant leaves (booleans and small values of the common
+  /// widths), or null. Interned nodes are allocated once per process,
+  /// so the most frequent leaves cost neither an allocation nor ever
+  /// reach a zero reference count.
+  static ref<ConstantExpr> tryIntern(const llvm::APInt &v);
+
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
+    if (ref<ConstantExpr> interned = tryIntern(v))
+      return interned;
     ref<ConstantExpr> r(new ConstantExpr(v));
     r->computeHash();
     return r;
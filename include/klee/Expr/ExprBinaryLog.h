@@ -0,0 +1,168 @@
+//===-- ExprBinaryLog.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRBINARYLOG_H
+#define KLEE_EXPRBINARYLOG_H
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace klee {
+struct Query;
+
+/// Compact binary query-log format (the .qbin files written by
+/// -use-query-log=all:bin and solver:bin).
+///
+/// A log is the eight magic bytes followed by a stream of records.
+/// Arrays, update nodes and expressions are defined once, the first time
+/// a query mentions them, and referred to by integer id afterwards, so
+/// structure shared between queries is written exactly once. Each query
+/// record additionally states how many leading constraints it has in
+/// common with the previous query and only lists the changed suffix.
+/// All integers are LEB128 encoded.
+namespace binlog {
+
+/// The file header. The last byte is the format version.
+extern const char Magic[8];
+
+/// \return true if data starts with the binary query-log magic.
+bool isBinaryLog(llvm::StringRef data);
+
+/// Tags recording which solver entry point issued a query.
+enum QueryType : std::uint8_t {
+  QueryTruth = 't',         ///< computeTruth
+  QueryValidity = 'v',      ///< computeValidity
+  QueryValue = 'c',         ///< computeValue
+  QueryInitialValues = 'i', ///< computeInitialValues
+};
+
+/// Serializes queries into the binary query-log format. The id tables
+/// persist for the lifetime of the writer; queries are written inside
+/// beginQuery()/commit() transactions so a buffered query that ends up
+/// being discarded (rollback()) does not leave later queries referring
+/// to definition records that were never written out.
+class Writer {
+public:
+  explicit Writer(llvm::raw_ostream &_os) : os(_os) {}
+
+  /// Write the file header. Call once on the final output file before
+  /// any records are written.
+  static void writeMagic(llvm::raw_ostream &os);
+
+  /// Start a query transaction.
+  void beginQuery();
+
+  /// Write the definition records the query needs followed by its query
+  /// record. evalExprs and objects may be null.
+  void writeQuery(QueryType type, std::uint64_t instructions,
+                  const Query &query, const std::vector<ref<Expr> > *evalExprs,
+                  const std::vector<const Array *> *objects);
+
+  /// Write the outcome record for the current query.
+  void writeResult(bool success, std::uint64_t elapsedUSec);
+
+  /// Make the ids assigned since beginQuery() permanent. Idempotent.
+  void commit();
+
+  /// Forget the ids assigned since beginQuery(), for use when the
+  /// buffered records are discarded instead of written to the log.
+  void rollback();
+
+private:
+  std::uint64_t defineArray(const Array *array);
+  std::uint64_t defineExpr(const ref<Expr> &e);
+
+  llvm::raw_ostream &os;
+
+  ExprHashMap<std::uint64_t> exprIds;
+  std::unordered_map<const UpdateNode *, std::uint64_t> updateIds;
+  std::unordered_map<const Array *, std::uint64_t> arrayIds;
+  std::uint64_t nextExprId = 1;
+  std::uint64_t nextUpdateId = 1;
+  std::uint64_t nextArrayId = 1;
+
+  /// Constraints of the last committed query; the delta base.
+  std::vector<ref<Expr> > prevConstraints;
+  std::vector<ref<Expr> > pendingConstraints;
+
+  /// Ids assigned by the open transaction, unwound by rollback().
+  bool inQuery = false;
+  std::vector<ref<Expr> > newExprs;
+  std::vector<const UpdateNode *> newUpdates;
+  std::vector<const Array *> newArrays;
+};
+
+/// One query replayed from a log.
+struct LoggedQuery {
+  QueryType type;
+  std::vector<ref<Expr> > constraints;
+  ref<Expr> expr;
+  std::vector<ref<Expr> > evalExprs;
+  std::vector<const Array *> objects;
+  std::uint64_t instructions = 0;
+
+  /// Filled in from the outcome record when the log contains one.
+  bool haveResult = false;
+  bool success = false;
+  std::uint64_t elapsedUSec = 0;
+};
+
+/// Reconstructs the queries of a binary log in order. Arrays are
+/// recreated through the supplied cache; expressions are rebuilt with
+/// the create() constant folders, so a replayed query is semantically
+/// equal (not necessarily node-for-node identical) to the logged one.
+class Reader {
+public:
+  Reader(llvm::StringRef _data, ArrayCache &_arrayCache);
+
+  /// Read the next query. \return false at end of log or on a malformed
+  /// record; the two are distinguished by error() being non-empty.
+  bool readQuery(LoggedQuery &result);
+
+  const std::string &error() const { return errorMessage; }
+
+private:
+  bool fail(const char *message);
+  bool readByte(std::uint8_t &byte);
+  bool readVarint(std::uint64_t &value);
+  bool readArrayRecord();
+  bool readUpdateRecord();
+  bool readExprRecord();
+  bool readQueryRecord(LoggedQuery &result);
+
+  llvm::StringRef data;
+  std::size_t pos;
+  ArrayCache &arrayCache;
+  std::string errorMessage;
+
+  /// Id tables; index 0 is unused.
+  std::vector<ref<Expr> > exprs;
+  std::vector<ref<UpdateNode> > updates;
+  std::vector<const Array *> arrays;
+
+  /// Constraints of the previous query; the delta base.
+  std::vector<ref<Expr> > prevConstraints;
+};
+
+} // namespace binlog
+} // namespace klee
+
+#endif /* KLEE_EXPRBINARYLOG_H */
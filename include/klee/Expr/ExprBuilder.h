@@ -86,6 +86,20 @@ namespace klee {
   ///
   /// Base - The base builder to use when constructing expressions.
   ExprBuilder *createSimplifyingExprBuilder(ExprBuilder *Base);
+
+  /// createHashConsingExprBuilder - Create an expression builder which
+  /// interns expressions constructed by the base builder so structurally
+  /// identical subtrees are shared and mostly compare by pointer.
+  ///
+  /// Base - The base builder to use when constructing expressions.
+  ExprBuilder *createHashConsingExprBuilder(ExprBuilder *Base);
+
+  /// createFusedSimplifyingExprBuilder - Create the canonical
+  /// simplifying stack (simplification over constant folding over the
+  /// default builder) with the chain composed at compile time, so the
+  /// per-node rules apply without the virtual chaining of the generic
+  /// builders.
+  ExprBuilder *createFusedSimplifyingExprBuilder();
 }
 
 #endif /* KLEE_EXPRBUILDER_H */
@@ -0,0 +1,46 @@
+//===-- ExprCanonicalizer.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRCANONICALIZER_H
+#define KLEE_EXPRCANONICALIZER_H
+
+#include "klee/Expr/ExprVisitor.h"
+
+namespace klee {
+
+/// Rewrites expressions into a canonical form so that structurally
+/// different but equivalent expressions -- sums built in different
+/// association orders, scattered constants, reordered masks -- end up
+/// with identical structure. The builders fold locally as expressions
+/// are constructed; this is the batch pass over whole expressions run
+/// when enough of them have accumulated, and exists purely to raise hit
+/// rates of every cache keyed on structure (CexCache, CachingSolver,
+/// the independence and simplification caches).
+///
+/// The rule set is deliberately small: chains of the associative and
+/// commutative operators (Add, Mul, And, Or, Xor) are flattened, their
+/// constants folded into a single leading term, and their remaining
+/// operands sorted into the canonical expression order.
+class ExprCanonicalizer {
+public:
+  /// Return the canonical form of \p e. Results are memoized across
+  /// calls, so repeatedly canonicalizing largely shared constraint sets
+  /// only walks new structure.
+  ref<Expr> canonicalize(const ref<Expr> &e);
+
+private:
+  /// Memo table shared by all visitor runs; dropped wholesale once it
+  /// grows past \ref MaxTableSize to bound retained memory.
+  static const size_t MaxTableSize = 1 << 20;
+  ExprVisitor::visited_ty visited;
+};
+
+} // namespace klee
+
+#endif /* KLEE_EXPRCANONICALIZER_H */
@@ -12,8 +12,14 @@
 
 #include "klee/Expr/Expr.h"
 
-#include <unordered_map>
-#include <unordered_set>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace klee {
 
@@ -21,22 +27,360 @@ namespace klee {
     struct ExprHash  {
       unsigned operator()(const ref<Expr> &e) const { return e->hash(); }
     };
-    
+
     struct ExprCmp {
       bool operator()(const ref<Expr> &a, const ref<Expr> &b) const {
         return a==b;
       }
     };
+
+    /// Flat open-addressing hash table backing ExprHashMap and
+    /// ExprHashSet. Entries live in one contiguous allocation with a
+    /// control byte each, probed linearly from the hash bucket, so a
+    /// lookup costs no pointer chase and a miss usually stays within one
+    /// cache line; small tables use inline storage, so the common
+    /// visited-set case never allocates. \p KeyFn extracts the ref<Expr>
+    /// key from a stored value.
+    ///
+    /// Semantic differences from the std::unordered_* containers these
+    /// replaced: any insert may rehash, invalidating all iterators and
+    /// references (erase uses tombstones and invalidates only the erased
+    /// entry). No caller may hold a reference into the table across an
+    /// insert.
+    template <class Value, class KeyFn> class FlatExprTable {
+      enum : std::uint8_t { SlotEmpty = 0, SlotTombstone = 1, SlotFull = 2 };
+      static const std::size_t InlineCapacity = 8;
+
+      std::uint8_t *control;
+      Value *slots;
+      std::size_t capacity; // always a power of two
+      std::size_t numEntries;
+      std::size_t numUsed; // entries plus tombstones
+
+      std::uint8_t inlineControl[InlineCapacity];
+      typename std::aligned_storage<sizeof(Value) * InlineCapacity,
+                                    alignof(Value)>::type inlineSlots;
+
+      static std::size_t bucketFor(const ref<Expr> &key, std::size_t mask) {
+        // Mix the cached 32-bit expression hash; the low bits of the
+        // product alone are too regular for masking.
+        std::uint64_t h = key->hash() * UINT64_C(0x9e3779b97f4a7c15);
+        return static_cast<std::size_t>(h >> 32) & mask;
+      }
+
+      bool isInline() const {
+        return slots == reinterpret_cast<const Value *>(&inlineSlots);
+      }
+
+      void initInline() {
+        control = inlineControl;
+        slots = reinterpret_cast<Value *>(&inlineSlots);
+        capacity = InlineCapacity;
+        numEntries = numUsed = 0;
+        std::memset(inlineControl, SlotEmpty, InlineCapacity);
+      }
+
+      void destroyEntries() {
+        for (std::size_t i = 0; i != capacity; ++i)
+          if (control[i] == SlotFull)
+            slots[i].~Value();
+      }
+
+      void freeStorage() {
+        if (!isInline()) {
+          delete[] control;
+          ::operator delete(slots);
+        }
+      }
+
+      /// Move all entries into a fresh table of \p newCapacity slots,
+      /// dropping tombstones.
+      void rehash(std::size_t newCapacity) {
+        std::uint8_t *oldControl = control;
+        Value *oldSlots = slots;
+        std::size_t oldCapacity = capacity;
+        bool wasInline = isInline();
+
+        control = new std::uint8_t[newCapacity];
+        std::memset(control, SlotEmpty, newCapacity);
+        slots = static_cast<Value *>(::operator new(sizeof(Value) *
+                                                    newCapacity));
+        capacity = newCapacity;
+        numUsed = numEntries;
+
+        std::size_t mask = newCapacity - 1;
+        for (std::size_t i = 0; i != oldCapacity; ++i) {
+          if (oldControl[i] != SlotFull)
+            continue;
+          std::size_t idx = bucketFor(KeyFn()(oldSlots[i]), mask);
+          while (control[idx] == SlotFull)
+            idx = (idx + 1) & mask;
+          new (&slots[idx]) Value(std::move(oldSlots[i]));
+          control[idx] = SlotFull;
+          oldSlots[i].~Value();
+        }
+
+        if (!wasInline) {
+          delete[] oldControl;
+          ::operator delete(oldSlots);
+        }
+      }
+
+      void growIfNeeded() {
+        // Keep the load factor (including tombstones) below 3/4 so
+        // probe chains stay short and always terminate.
+        if ((numUsed + 1) * 4 > capacity * 3) {
+          // Double only when actual entries warrant it; otherwise the
+          // rehash just compacts tombstones away.
+          std::size_t newCapacity =
+              (numEntries + 1) * 4 > capacity * 3 ? capacity * 2 : capacity;
+          rehash(newCapacity);
+        }
+      }
+
+    public:
+      typedef Value value_type;
+
+      template <bool IsConst> class iterator_impl {
+        typedef typename std::conditional<IsConst, const FlatExprTable,
+                                          FlatExprTable>::type table_ty;
+        table_ty *table;
+        std::size_t index;
+
+        friend class FlatExprTable;
+        friend class iterator_impl<true>;
+
+        void skipToFull() {
+          while (index != table->capacity &&
+                 table->control[index] != SlotFull)
+            ++index;
+        }
+
+        iterator_impl(table_ty *table, std::size_t index)
+            : table(table), index(index) {}
+
+      public:
+        typedef typename std::conditional<IsConst, const Value, Value>::type
+            reference_value_ty;
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Value value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef reference_value_ty *pointer;
+        typedef reference_value_ty &reference;
+
+        iterator_impl() : table(nullptr), index(0) {}
+        iterator_impl(const iterator_impl &) = default;
+        iterator_impl &operator=(const iterator_impl &) = default;
+        /// Conversion from iterator to const_iterator; constrained so
+        /// same-type copies use the defaulted operations above.
+        template <bool WasConst = IsConst,
+                  typename = typename std::enable_if<WasConst>::type>
+        iterator_impl(const iterator_impl<false> &other)
+            : table(other.table), index(other.index) {}
+
+        reference_value_ty &operator*() const { return table->slots[index]; }
+        reference_value_ty *operator->() const { return &table->slots[index]; }
+
+        iterator_impl &operator++() {
+          ++index;
+          skipToFull();
+          return *this;
+        }
+        iterator_impl operator++(int) {
+          iterator_impl res = *this;
+          ++*this;
+          return res;
+        }
+
+        bool operator==(const iterator_impl &b) const {
+          return table == b.table && index == b.index;
+        }
+        bool operator!=(const iterator_impl &b) const { return !(*this == b); }
+      };
+
+      typedef iterator_impl<false> iterator;
+      typedef iterator_impl<true> const_iterator;
+
+      FlatExprTable() { initInline(); }
+
+      FlatExprTable(const FlatExprTable &other) {
+        initInline();
+        for (const Value &v : other)
+          insert(v);
+      }
+
+      FlatExprTable(FlatExprTable &&other) {
+        if (other.isInline()) {
+          initInline();
+          for (std::size_t i = 0; i != other.capacity; ++i)
+            if (other.control[i] == SlotFull)
+              insert(std::move(other.slots[i]));
+          other.clear();
+        } else {
+          control = other.control;
+          slots = other.slots;
+          capacity = other.capacity;
+          numEntries = other.numEntries;
+          numUsed = other.numUsed;
+          other.initInline();
+        }
+      }
+
+      FlatExprTable &operator=(const FlatExprTable &other) {
+        if (this != &other) {
+          clear();
+          for (const Value &v : other)
+            insert(v);
+        }
+        return *this;
+      }
+
+      FlatExprTable &operator=(FlatExprTable &&other) {
+        if (this != &other) {
+          destroyEntries();
+          freeStorage();
+          if (other.isInline()) {
+            initInline();
+            for (std::size_t i = 0; i != other.capacity; ++i)
+              if (other.control[i] == SlotFull)
+                insert(std::move(other.slots[i]));
+            other.clear();
+          } else {
+            control = other.control;
+            slots = other.slots;
+            capacity = other.capacity;
+            numEntries = other.numEntries;
+            numUsed = other.numUsed;
+            other.initInline();
+          }
+        }
+        return *this;
+      }
+
+      ~FlatExprTable() {
+        destroyEntries();
+        freeStorage();
+      }
+
+      iterator begin() {
+        iterator it(this, 0);
+        it.skipToFull();
+        return it;
+      }
+      const_iterator begin() const {
+        const_iterator it(this, 0);
+        it.skipToFull();
+        return it;
+      }
+      iterator end() { return iterator(this, capacity); }
+      const_iterator end() const { return const_iterator(this, capacity); }
+
+      std::size_t size() const { return numEntries; }
+      bool empty() const { return numEntries == 0; }
+
+      iterator find(const ref<Expr> &key) {
+        std::size_t mask = capacity - 1;
+        std::size_t idx = bucketFor(key, mask);
+        while (control[idx] != SlotEmpty) {
+          if (control[idx] == SlotFull && KeyFn()(slots[idx]) == key)
+            return iterator(this, idx);
+          idx = (idx + 1) & mask;
+        }
+        return end();
+      }
+      const_iterator find(const ref<Expr> &key) const {
+        return const_cast<FlatExprTable *>(this)->find(key);
+      }
+
+      std::size_t count(const ref<Expr> &key) const {
+        return find(key) != end() ? 1 : 0;
+      }
+
+      std::pair<iterator, bool> insert(const Value &value) {
+        return emplaceValue(value);
+      }
+      std::pair<iterator, bool> insert(Value &&value) {
+        return emplaceValue(std::move(value));
+      }
+
+      iterator erase(iterator it) {
+        assert(it.table == this && "iterator from a different table");
+        slots[it.index].~Value();
+        control[it.index] = SlotTombstone;
+        --numEntries;
+        ++it;
+        return it;
+      }
+
+      std::size_t erase(const ref<Expr> &key) {
+        iterator it = find(key);
+        if (it == end())
+          return 0;
+        erase(it);
+        return 1;
+      }
+
+      void clear() {
+        destroyEntries();
+        freeStorage();
+        initInline();
+      }
+
+    private:
+      template <class V> std::pair<iterator, bool> emplaceValue(V &&value) {
+        growIfNeeded();
+        const ref<Expr> &key = KeyFn()(value);
+        std::size_t mask = capacity - 1;
+        std::size_t idx = bucketFor(key, mask);
+        std::size_t insertAt = capacity; // first tombstone on the chain
+        while (control[idx] != SlotEmpty) {
+          if (control[idx] == SlotFull && KeyFn()(slots[idx]) == key)
+            return std::make_pair(iterator(this, idx), false);
+          if (control[idx] == SlotTombstone && insertAt == capacity)
+            insertAt = idx;
+          idx = (idx + 1) & mask;
+        }
+        if (insertAt == capacity) {
+          insertAt = idx;
+          ++numUsed; // filling an empty slot, not recycling a tombstone
+        }
+        new (&slots[insertAt]) Value(std::forward<V>(value));
+        control[insertAt] = SlotFull;
+        ++numEntries;
+        return std::make_pair(iterator(this, insertAt), true);
+      }
+    };
+
+    template <class T> struct PairKeyFn {
+      const ref<Expr> &operator()(const std::pair<ref<Expr>, T> &v) const {
+        return v.first;
+      }
+    };
+
+    struct IdentityKeyFn {
+      const ref<Expr> &operator()(const ref<Expr> &v) const { return v; }
+    };
   }
 
   template <class T>
   class ExprHashMap
-      : public std::unordered_map<ref<Expr>, T, klee::util::ExprHash,
-                                  klee::util::ExprCmp> {};
+      : public util::FlatExprTable<std::pair<ref<Expr>, T>,
+                                   util::PairKeyFn<T>> {
+  public:
+    T &operator[](const ref<Expr> &key) {
+      return this->insert(std::make_pair(key, T())).first->second;
+    }
+  };
 
-  typedef std::unordered_set<ref<Expr>, klee::util::ExprHash,
-                             klee::util::ExprCmp>
-      ExprHashSet;
+  class ExprHashSet
+      : public util::FlatExprTable<ref<Expr>, util::IdentityKeyFn> {
+  public:
+    ExprHashSet() = default;
+    template <class InputIt> ExprHashSet(InputIt first, InputIt last) {
+      for (; first != last; ++first)
+        insert(*first);
+    }
+  };
 } // namespace klee
 
 #endif /* KLEE_EXPRHASHMAP_H */
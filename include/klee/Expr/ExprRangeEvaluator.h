@@ -13,6 +13,8 @@
 #include "klee/ADT/Bits.h"
 #include "klee/Expr/Expr.h"
 
+#include <unordered_map>
+
 namespace klee {
 
 /*
@@ -37,6 +39,7 @@ public:
   ValueType binaryOr(ValueType &);
   ValueType binaryXor(ValueType &);
   ValueType concat(ValueType &, unsigned width);
+  ValueType extract(uint64_t lowBit, uint64_t maxBit);
   ValueType add(ValueType &, unsigned width);
   ValueType sub(ValueType &, unsigned width);
   ValueType mul(ValueType &, unsigned width);
@@ -54,6 +57,17 @@ public:
 
 template<class T>
 class ExprRangeEvaluator {
+  /// Ranges computed for shared subtrees during the current top-level
+  /// evaluate() call. The data underneath (array value ranges) may
+  /// change between calls, so the memo is cleared on every entry;
+  /// within one call it makes the walk linear in the size of the DAG,
+  /// where plain recursion revisits a shared subtree once per path
+  /// reaching it.
+  std::unordered_map<const Expr *, T> memo;
+
+  /// The per-kind evaluation switch; always called through \ref eval.
+  T evalNode(const ref<Expr> &e);
+
 protected:
   /// getInitialReadRange - Return a range for the initial value of the given
   /// array (which may be constant), for the given range of indices.
@@ -61,11 +75,16 @@ protected:
 
   T evalRead(const UpdateList &ul, T index);
 
+  T eval(const ref<Expr> &e);
+
 public:
   ExprRangeEvaluator() {}
   virtual ~ExprRangeEvaluator() {}
 
-  T evaluate(const ref<Expr> &e);
+  T evaluate(const ref<Expr> &e) {
+    memo.clear();
+    return eval(e);
+  }
 };
 
 template<class T>
@@ -74,12 +93,12 @@ T ExprRangeEvaluator<T>::evalRead(const UpdateList &ul,
   T res;
 
   for (const UpdateNode *un = ul.head.get(); un; un = un->next.get()) {
-    T ui = evaluate(un->index);
+    T ui = eval(un->index);
 
     if (ui.mustEqual(index)) {
-      return res.set_union(evaluate(un->value));
+      return res.set_union(eval(un->value));
     } else if (ui.mayEqual(index)) {
-      res = res.set_union(evaluate(un->value));
+      res = res.set_union(eval(un->value));
       if (res.isFullRange(8)) {
         return res;
       } 
@@ -90,7 +109,28 @@ T ExprRangeEvaluator<T>::evalRead(const UpdateList &ul,
 }
 
 template<class T>
-T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
+T ExprRangeEvaluator<T>::eval(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return T(cast<ConstantExpr>(e));
+
+  // Only nodes referenced more than once can be reached along several
+  // paths; everything else would just churn the memo.
+  const bool shared = e->_refCount.getCount() > 1;
+  if (shared) {
+    typename std::unordered_map<const Expr *, T>::iterator it =
+        memo.find(e.get());
+    if (it != memo.end())
+      return it->second;
+  }
+
+  T res = evalNode(e);
+  if (shared)
+    memo.emplace(e.get(), res);
+  return res;
+}
+
+template<class T>
+T ExprRangeEvaluator<T>::evalNode(const ref<Expr> &e) {
   switch (e->getKind()) {
   case Expr::Constant:
     return T(cast<ConstantExpr>(e));
@@ -100,7 +140,7 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
 
   case Expr::Read: {
     const ReadExpr *re = cast<ReadExpr>(e);
-    T index = evaluate(re->index);
+    T index = eval(re->index);
 
     assert(re->updates.root && re->getWidth() == re->updates.root->range && "unexpected multibyte read");
 
@@ -109,14 +149,14 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
 
   case Expr::Select: {
     const SelectExpr *se = cast<SelectExpr>(e);
-    T cond = evaluate(se->cond);
+    T cond = eval(se->cond);
       
     if (cond.mustEqual(1)) {
-      return evaluate(se->trueExpr);
+      return eval(se->trueExpr);
     } else if (cond.mustEqual(0)) {
-      return evaluate(se->falseExpr);
+      return eval(se->falseExpr);
     } else {
-      return evaluate(se->trueExpr).set_union(evaluate(se->falseExpr));
+      return eval(se->trueExpr).set_union(eval(se->falseExpr));
     }
   }
 
@@ -125,78 +165,102 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
     const Expr *ep = e.get();
     T res(0);
     for (unsigned i=0; i<ep->getNumKids(); i++)
-      res = res.concat(evaluate(ep->getKid(i)),8);
+      res = res.concat(eval(ep->getKid(i)),8);
     return res;
   }
 
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    return eval(ee->expr).extract(ee->offset, ee->offset + ee->width);
+  }
+
+    // Casting
+
+  case Expr::ZExt: {
+    // The range is unchanged, only the width grows.
+    return eval(cast<CastExpr>(e)->src);
+  }
+  case Expr::SExt: {
+    const CastExpr *ce = cast<CastExpr>(e);
+    T src = eval(ce->src);
+    unsigned srcBits = ce->src->getWidth();
+
+    // If the sign bit can never be set, sign extension is the identity.
+    // Otherwise the range wraps to the top of the new width; fall through
+    // to the conservative result.
+    if (src.max() < (static_cast<uint64_t>(1) << (srcBits - 1)))
+      return src;
+    break;
+  }
+
     // Arithmetic
 
   case Expr::Add: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).add(evaluate(be->right), width);
+    return eval(be->left).add(eval(be->right), width);
   }
   case Expr::Sub: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).sub(evaluate(be->right), width);
+    return eval(be->left).sub(eval(be->right), width);
   }
   case Expr::Mul: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).mul(evaluate(be->right), width);
+    return eval(be->left).mul(eval(be->right), width);
   }
   case Expr::UDiv: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).udiv(evaluate(be->right), width);
+    return eval(be->left).udiv(eval(be->right), width);
   }
   case Expr::SDiv: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).sdiv(evaluate(be->right), width);
+    return eval(be->left).sdiv(eval(be->right), width);
   }
   case Expr::URem: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).urem(evaluate(be->right), width);
+    return eval(be->left).urem(eval(be->right), width);
   }
   case Expr::SRem: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
     unsigned width = be->left->getWidth();
-    return evaluate(be->left).srem(evaluate(be->right), width);
+    return eval(be->left).srem(eval(be->right), width);
   }
 
     // Binary
 
   case Expr::And: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    return evaluate(be->left).binaryAnd(evaluate(be->right));
+    return eval(be->left).binaryAnd(eval(be->right));
   }
   case Expr::Or: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    return evaluate(be->left).binaryOr(evaluate(be->right));
+    return eval(be->left).binaryOr(eval(be->right));
   }
   case Expr::Xor: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    return evaluate(be->left).binaryXor(evaluate(be->right));
+    return eval(be->left).binaryXor(eval(be->right));
   }
   case Expr::Shl: {
     //    BinaryExpr *be = cast<BinaryExpr>(e);
     //    unsigned width = be->left->getWidth();
-    //    return evaluate(be->left).shl(evaluate(be->right), width);
+    //    return eval(be->left).shl(eval(be->right), width);
     break;
   }
   case Expr::LShr: {
     //    BinaryExpr *be = cast<BinaryExpr>(e);
     //    unsigned width = be->left->getWidth();
-    //    return evaluate(be->left).lshr(evaluate(be->right), width);
+    //    return eval(be->left).lshr(eval(be->right), width);
     break;
   }
   case Expr::AShr: {
     //    BinaryExpr *be = cast<BinaryExpr>(e);
     //    unsigned width = be->left->getWidth();
-    //    return evaluate(be->left).ashr(evaluate(be->right), width);
+    //    return eval(be->left).ashr(eval(be->right), width);
     break;
   }
 
@@ -204,8 +268,8 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
 
   case Expr::Eq: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    T left = evaluate(be->left);
-    T right = evaluate(be->right);
+    T left = eval(be->left);
+    T right = eval(be->right);
       
     if (left.mustEqual(right)) {
       return T(1);
@@ -217,8 +281,8 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
 
   case Expr::Ult: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    T left = evaluate(be->left);
-    T right = evaluate(be->right);
+    T left = eval(be->left);
+    T right = eval(be->right);
       
     if (left.max() < right.min()) {
       return T(1);
@@ -229,8 +293,8 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
   }
   case Expr::Ule: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    T left = evaluate(be->left);
-    T right = evaluate(be->right);
+    T left = eval(be->left);
+    T right = eval(be->right);
       
     if (left.max() <= right.min()) {
       return T(1);
@@ -241,8 +305,8 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
   }
   case Expr::Slt: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    T left = evaluate(be->left);
-    T right = evaluate(be->right);
+    T left = eval(be->left);
+    T right = eval(be->right);
     unsigned bits = be->left->getWidth();
 
     if (left.maxSigned(bits) < right.minSigned(bits)) {
@@ -254,8 +318,8 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
   }
   case Expr::Sle: {
     const BinaryExpr *be = cast<BinaryExpr>(e);
-    T left = evaluate(be->left);
-    T right = evaluate(be->right);
+    T left = eval(be->left);
+    T right = eval(be->right);
     unsigned bits = be->left->getWidth();
       
     if (left.maxSigned(bits) <= right.minSigned(bits)) {
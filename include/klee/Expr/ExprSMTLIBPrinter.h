@@ -13,15 +13,20 @@
 
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Support/PrintContext.h"
 
+#include "llvm/ADT/SmallString.h"
+
 #include <map>
-#include <set>
+#include <memory>
 #include <string>
+#include <unordered_set>
 
 namespace llvm {
 class raw_ostream;
+class raw_svector_ostream;
 }
 
 namespace klee {
@@ -212,10 +217,10 @@ public:
 
 protected:
   /// Contains the arrays found during scans
-  std::set<const Array *> usedArrays;
+  std::unordered_set<const Array *> usedArrays;
 
   /// Set of expressions seen during scan.
-  std::set<ref<Expr> > seenExprs;
+  ExprHashSet seenExprs;
 
   typedef std::map<const ref<Expr>, int> BindingMap;
 
@@ -344,9 +349,6 @@ protected:
 
   void printSeperator();
 
-  /// Helper function for scan() that scans the expressions of an update node
-  void scanUpdates(const UpdateNode *un);
-
   /// Helper printer class
   PrintContext *p;
 
@@ -379,6 +381,14 @@ private:
   // call.
   const std::vector<const Array *> *arraysToCallGetValueOn;
 
+  /// Stream passed to setOutput(). The query is serialized through "o"
+  /// and "p" into outputBuffer and written here in a single call by
+  /// generateOutput(); the buffer keeps its capacity across queries so
+  /// steady-state serialization does not allocate.
+  llvm::raw_ostream *finalOutput;
+  llvm::SmallString<4096> outputBuffer;
+  std::unique_ptr<llvm::raw_svector_ostream> bufferOS;
+
   ConstantDisplayMode cdm;
   AbbreviationMode abbrMode;
 };
@@ -40,9 +40,20 @@ namespace klee {
       static Action skipChildren() { return Action(SkipChildren); }
     };
 
+  public:
+    /// Memo table mapping visited expressions to their results.
+    typedef ExprHashMap< ref<Expr> > visited_ty;
+
   protected:
+    /// \param _recursive Visit the result of a rebuild again.
+    /// \param _sharedVisited If non-null, use this memo table instead of
+    /// the per-instance one; the owner keeps it alive so results persist
+    /// across visitor instances. Only sound when every instance sharing
+    /// the table performs the same rewrite (same visitor kind and same
+    /// parameters).
     explicit
-    ExprVisitor(bool _recursive=false) : recursive(_recursive) {}
+    ExprVisitor(bool _recursive=false, visited_ty *_sharedVisited=nullptr)
+      : sharedVisited(_sharedVisited), recursive(_recursive) {}
     virtual ~ExprVisitor() {}
 
     virtual Action visitExpr(const Expr&);
@@ -81,12 +92,13 @@ namespace klee {
     virtual Action visitSge(const SgeExpr&);
 
   private:
-    typedef ExprHashMap< ref<Expr> > visited_ty;
     visited_ty visited;
+    visited_ty *sharedVisited;
     bool recursive;
 
-    ref<Expr> visitActual(const ref<Expr> &e);
-    
+    /// Run visitExpr and the kind-specific hook for e.
+    Action visitDispatch(Expr &e);
+
   public:
     // apply the visitor to the expression and return a possibly
     // modified new expression.
@@ -11,6 +11,7 @@
 #define KLEE_INSTRUCTIONINFOTABLE_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -63,16 +64,51 @@ namespace klee {
     FunctionInfo(FunctionInfo &&) = default;
   };
 
+  class DebugInfoExtractor;
+
+  /// @brief Maps instructions and functions of a module to their debug
+  /// information.
+  ///
+  /// Ids are assigned for the whole module upfront so that indexed
+  /// statistics can be sized before execution, but the debug information
+  /// itself is only extracted per function the first time an entry of
+  /// that function is requested.
   class InstructionInfoTable {
-    std::unordered_map<const llvm::Instruction *,
-                       std::unique_ptr<InstructionInfo>>
+    mutable std::unordered_map<const llvm::Instruction *,
+                               std::unique_ptr<InstructionInfo>>
         infos;
-    std::unordered_map<const llvm::Function *, std::unique_ptr<FunctionInfo>>
+    mutable std::unordered_map<const llvm::Function *,
+                               std::unique_ptr<FunctionInfo>>
         functionInfos;
-    std::vector<std::unique_ptr<std::string>> internedStrings;
+    mutable std::vector<std::unique_ptr<std::string>> internedStrings;
+
+    /// Compact side index assigned at construction time: the id of each
+    /// function and of its first instruction; the remaining instructions
+    /// of a function are numbered consecutively in instruction order.
+    struct IdRange {
+      unsigned functionId;
+      unsigned firstInstructionId;
+    };
+    std::unordered_map<const llvm::Function *, IdRange> idRanges;
+    unsigned maxID = 0;
+
+    const llvm::Module &module;
+
+    /// Extractor for lazy population; holds the (sizeable) assembly line
+    /// table and is released once every function has been populated.
+    mutable std::unique_ptr<DebugInfoExtractor> extractor;
+    mutable unsigned unpopulatedFunctions = 0;
+
+    /// Serializes lazy population against concurrent lookups.
+    mutable std::mutex populationMutex;
+
+    /// Extract the debug information of all instructions of \p f. The
+    /// caller must hold populationMutex.
+    void populateFunction(const llvm::Function &f) const;
 
   public:
     explicit InstructionInfoTable(const llvm::Module &m);
+    ~InstructionInfoTable();
 
     unsigned getMaxID() const;
     const InstructionInfo &getInfo(const llvm::Instruction &) const;
@@ -11,6 +11,7 @@
 #define KLEE_KINSTRUCTION_H
 
 #include "klee/Config/Version.h"
+#include "klee/Expr/Expr.h"
 #include "klee/Module/InstructionInfoTable.h"
 
 #include "llvm/Support/DataTypes.h"
@@ -19,20 +20,25 @@
 #include <vector>
 
 namespace llvm {
+  class Function;
   class Instruction;
 }
 
 namespace klee {
+  class ExecutionState;
   class Executor;
   struct InstructionInfo;
   class KModule;
+  struct SpecialFunctionBinding;
 
 
   /// KInstruction - Intermediate instruction representation used
   /// during execution.
   struct KInstruction {
-    llvm::Instruction *inst;    
-    const InstructionInfo *info;
+    llvm::Instruction *inst;
+    /// Debug information; null until the containing function is
+    /// materialized (\see KModule::materializeDebugInfo()).
+    const InstructionInfo *info = nullptr;
 
     /// Value numbers for each operand. -1 is an invalid value,
     /// otherwise negative numbers are indices (negated and offset by
@@ -42,6 +48,33 @@ namespace klee {
     /// Destination register index.
     unsigned dest;
 
+    /// Handler implementing this instruction, precomputed once per
+    /// module so that execution dispatches through an indirect call
+    /// instead of the opcode switch (\see
+    /// Executor::installInstructionHandlers()). Null for instructions
+    /// that dispatch through the generic switch in
+    /// Executor::executeInstruction().
+    void (*handler)(Executor &executor, ExecutionState &state,
+                    KInstruction *ki) = nullptr;
+
+    /// When set, the instruction following this one in the same basic
+    /// block consumes this instruction's only use, and the executor
+    /// runs both in one dispatch step (\see KFunction's
+    /// superinstruction recognition). Restricted to a fixed set of hot
+    /// pairs -- compare feeding a conditional branch, address
+    /// computation feeding a load, arithmetic feeding a store -- whose
+    /// first half can neither fork nor terminate the state.
+    bool fuseNext = false;
+
+    /// Cached special-function lookup for calls made by this
+    /// instruction: \ref sfhCallee is the callee the cache was resolved
+    /// for (indirect call sites may reach different callees) and \ref
+    /// sfhBinding points at its handler entry, or is null when that
+    /// callee is not a special function. Maintained by
+    /// SpecialFunctionHandler::handle().
+    llvm::Function *sfhCallee = nullptr;
+    const SpecialFunctionBinding *sfhBinding = nullptr;
+
   public:
     virtual ~KInstruction();
     std::string getSourceLocation() const;
@@ -58,6 +91,11 @@ namespace klee {
     /// offset - A constant offset to add to the pointer operand to execute the
     /// instruction.
     uint64_t offset;
+
+    /// Fully folded result for getelementptr instructions whose base and
+    /// indices are all constant, computed once at bind time
+    /// (\see Executor::bindInstructionConstants()); null otherwise.
+    ref<ConstantExpr> constantResult;
   };
 }
 
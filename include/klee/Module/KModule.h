@@ -15,8 +15,11 @@
 
 #include "llvm/ADT/ArrayRef.h"
 
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 
@@ -49,10 +52,75 @@ namespace klee {
 
     std::map<llvm::BasicBlock*, unsigned> basicBlockEntry;
 
+    /// For every basic block ending in a conditional branch or switch,
+    /// the first instruction of its immediate post-dominator. Used as
+    /// automatically inferred merge points (\see -use-auto-merge).
+    std::map<llvm::BasicBlock*, llvm::Instruction*> mergePoints;
+
+    /// A counting loop whose effects have a closed form (\see
+    /// -summarize-loops): the induction phi advances by one towards a
+    /// loop-invariant bound, and every other phi in the header is an
+    /// accumulator advanced by a loop-invariant step per iteration.
+    struct KLoopSummary {
+      struct Accumulator {
+        KInstruction *phi;
+        /// The add in the latch computing the phi's next value.
+        KInstruction *add;
+        /// Operand index of the loop-invariant step within \ref add.
+        unsigned stepOperand;
+      };
+
+      /// The induction phi and the header compare that exits the loop.
+      KInstruction *indvar;
+      KInstruction *cmp;
+      /// Operand index of the loop-invariant bound within \ref cmp.
+      unsigned boundOperand;
+      /// Whether \ref cmp is a signed (slt) rather than unsigned (ult)
+      /// compare.
+      bool isSigned;
+      std::vector<Accumulator> accumulators;
+      /// The unique exit block; its only predecessor is the header.
+      llvm::BasicBlock *exit;
+    };
+
+    /// Loops the executor may replace by their closed-form exit values
+    /// instead of unrolling, keyed by loop header.
+    std::map<llvm::BasicBlock*, KLoopSummary> loopSummaries;
+
+    /// Small entry-block allocas of constant size, packed into a single
+    /// per-frame memory object (\see -frame-local-allocas): byte offset
+    /// of each such alloca within the region. Entry-block allocas
+    /// execute exactly once per call, so the layout is fixed at build
+    /// time.
+    std::map<const llvm::Instruction*, std::uint64_t> frameAllocaOffsets;
+
+    /// Total size and alignment of the per-frame alloca region; zero
+    /// when the function has no packed allocas.
+    std::uint64_t frameAllocaSize = 0;
+    std::uint64_t frameAllocaAlign = 0;
+
     /// Whether instructions in this function should count as
     /// "coverable" for statistics and search heuristics.
     bool trackCoverage;
 
+    /// Whether the function is a side-effect-free leaf: value
+    /// computation over its arguments plus loads from constant globals,
+    /// with no calls, stores or allocas. Such functions are eligible
+    /// for call summary memoization (\see -use-function-summaries).
+    bool isPureLeaf;
+
+    /// -native-leaf-calls cost model: instructions retired by completed
+    /// interpreted calls of this function, the number of such calls,
+    /// and the cached verdict once enough calls have been measured
+    /// (0 = undecided, 1 = keep interpreting, 2 = call natively).
+    std::uint64_t interpretedInstructions = 0;
+    std::uint64_t interpretedCalls = 0;
+    unsigned char nativeCallDecision = 0;
+
+    /// Whether the debug information of the instructions has been
+    /// assigned (\see KModule::materializeDebugInfo()).
+    std::atomic<bool> debugInfoMaterialized{false};
+
   public:
     explicit KFunction(llvm::Function*, KModule *);
     KFunction(const KFunction &) = delete;
@@ -61,6 +129,13 @@ namespace klee {
     ~KFunction();
 
     unsigned getArgRegister(unsigned index) { return index; }
+
+    /// Return the inferred merge point for a block ending in a
+    /// conditional branch or switch, or null if there is none.
+    llvm::Instruction *getMergePoint(llvm::BasicBlock *bb) const {
+      auto it = mergePoints.find(bb);
+      return it == mergePoints.end() ? nullptr : it->second;
+    }
   };
 
 
@@ -108,6 +183,17 @@ namespace klee {
     // Mark function with functionName as part of the KLEE runtime
     void addInternalFunction(const char* functionName);
 
+    /// Path where the prepared module should be stored after
+    /// optimiseAndPrepare; empty if the prepared-module cache is
+    /// disabled or the module was itself loaded from the cache.
+    std::string preparedModuleCacheFile;
+
+    /// Cached result of getModuleHash().
+    std::string moduleHash;
+
+    /// Serializes materializeDebugInfo across threads.
+    std::mutex debugInfoMutex;
+
   public:
     KModule() = default;
 
@@ -141,6 +227,32 @@ namespace klee {
 
     void instrument(const Interpreter::ModuleOptions &opts);
 
+    /// Try to initialize the module from the prepared-module cache
+    /// (-prepared-module-cache-dir), keyed by a hash of the input
+    /// modules and preparation options. On a hit the inputs are
+    /// consumed and link/instrument/optimiseAndPrepare can be skipped.
+    ///
+    /// @return true if a cached prepared module was loaded
+    bool loadCachedModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
+                          const Interpreter::ModuleOptions &opts);
+
+    /// Store the prepared module into the cache for later runs. No-op
+    /// if the cache is disabled or loadCachedModule succeeded.
+    void cachePreparedModule();
+
+    /// Return a hash of the prepared module's bitcode, used to key
+    /// on-disk databases whose instruction ids are only meaningful for
+    /// an identical module. Computed on first use and cached; only
+    /// valid once the module is fully prepared.
+    const std::string &getModuleHash();
+
+    /// Assign the debug information of kf's instructions on first
+    /// entry. Debug information is extracted per function on demand
+    /// (\see InstructionInfoTable), so this must be called before any
+    /// KInstruction of kf has its info member read, i.e. before the
+    /// function is executed.
+    void materializeDebugInfo(KFunction *kf);
+
     /// Return an id for the given constant, creating a new one if necessary.
     unsigned getConstantID(llvm::Constant *c, KInstruction* ki);
 
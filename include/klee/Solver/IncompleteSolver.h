@@ -10,9 +10,13 @@
 #ifndef KLEE_INCOMPLETESOLVER_H
 #define KLEE_INCOMPLETESOLVER_H
 
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverImpl.h"
 
+#include <cstdint>
+#include <unordered_map>
+
 namespace klee {
 
 /// IncompleteSolver - Base class for incomplete solver
@@ -50,6 +54,13 @@ public:
 
   static PartialValidity negatePartialValidity(PartialValidity pv);
 
+  /// mergePartialValidity - Combine two sound partial results for the
+  /// same query (e.g. a cached one and a fresh one) into the strongest
+  /// result they imply together; in particular MayBeTrue and MayBeFalse
+  /// compose to TrueOrFalse.
+  static PartialValidity mergePartialValidity(PartialValidity a,
+                                              PartialValidity b);
+
 public:
   IncompleteSolver() {}
   virtual ~IncompleteSolver() {}
@@ -89,7 +100,27 @@ class StagedSolverImpl : public SolverImpl {
 private:
   IncompleteSolver *primary;
   Solver *secondary;
-  
+
+  /// Partial validities learned by either stage, keyed by constraint-set
+  /// version and query expression. Without this the partial information
+  /// the cheap pass computes (e.g. one direction proven) is thrown away
+  /// whenever it cannot decide the whole query; with it a later
+  /// mustBeTrue/mayBeFalse question about the same query is answered
+  /// from, or composed with, the earlier result. Version stamps change
+  /// on every constraint-set mutation, so entries can never be stale.
+  std::unordered_map<std::uint64_t,
+                     ExprHashMap<IncompleteSolver::PartialValidity>>
+      partialCache;
+
+  /// Constraint-set versions to remember results for; when exceeded the
+  /// cache is simply dropped (old versions are dead weight anyway, as
+  /// states rarely revisit an old constraint set).
+  static const size_t MaxPartialCacheVersions = 256;
+
+  IncompleteSolver::PartialValidity lookupPartial(const Query &query) const;
+  void rememberPartial(const Query &query,
+                       IncompleteSolver::PartialValidity pv);
+
 public:
   StagedSolverImpl(IncompleteSolver *_primary, Solver *_secondary);
   ~StagedSolverImpl();
@@ -14,6 +14,7 @@
 #include "klee/System/Time.h"
 #include "klee/Solver/SolverCmdLine.h"
 
+#include <memory>
 #include <vector>
 
 namespace klee {
@@ -250,6 +251,14 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createFastCexSolver(Solver *s);
 
+  /// createRangeSolver - Create a solver which answers mustBeTrue and
+  /// mustBeFalse queries purely by interval reasoning over the ranges
+  /// implied by the constraint set, caching the propagated ranges per
+  /// constraint set.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createRangeSolver(Solver *s);
+
   /// createIndependentSolver - Create a solver which will eliminate any
   /// unnecessary constraints before propogating the query to the underlying
   /// solver.
@@ -269,11 +278,52 @@ namespace klee {
                                     time::Span minQueryTimeToLog,
                                     bool logTimedOut);
 
+  /// createBinaryQueryLoggingSolver - Create a solver which will forward all
+  /// queries after writing them to the given path in the compact binary
+  /// query-log format (see ExprBinaryLog.h).
+  Solver *createBinaryQueryLoggingSolver(Solver *s, std::string path,
+                                         time::Span minQueryTimeToLog,
+                                         bool logTimedOut);
+
+
+  /// createMeteredSolver - Create a solver which forwards all queries to
+  /// \arg s and records their number and wall time in the process-wide
+  /// stage metrics registry under \arg name. Used by constructSolverChain()
+  /// to benchmark the individual stages of the chain.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param name - Stage name reported for this wrapper.
+  /// \param inner - Name of the metered stage directly beneath this one,
+  /// or the empty string for the innermost metered stage. Used to compute
+  /// per-stage hit rates in the report.
+  Solver *createMeteredSolver(Solver *s, const std::string &name,
+                              const std::string &inner);
+
+  /// reportSolverStageMetrics - Write the counters collected by the
+  /// metered solvers as JSON to \arg os. Counters of stages with the same
+  /// name (e.g. from parallel workers' chains) are aggregated. If \arg
+  /// baselinePath names the JSON output of a previous run, a per-stage
+  /// comparison against it is printed to stderr.
+  void reportSolverStageMetrics(llvm::raw_ostream &os,
+                                const std::string &baselinePath = "");
 
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
   Solver *createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which dispatches each query
+  /// to all of the given solvers on persistent worker threads and returns
+  /// the first answer.
+  Solver *createPortfolioSolver(std::vector<std::unique_ptr<Solver>> solvers);
+
+  /// createQueryRouterSolver - Create a solver which classifies each query
+  /// by cheap structural features (size, arrays read, update-list depth,
+  /// symbolic division) and routes predicted-hard queries to \arg
+  /// hardSolver with \arg hardTimeout instead of \arg solver. Takes
+  /// ownership of both solvers.
+  Solver *createQueryRouterSolver(Solver *solver, Solver *hardSolver,
+                                  time::Span hardTimeout);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   Solver *createCoreSolver(CoreSolverType cst);
 }
@@ -24,6 +24,12 @@ namespace klee {
 
 extern llvm::cl::opt<bool> UseFastCexSolver;
 
+extern llvm::cl::opt<bool> UseRangeSolver;
+
+extern llvm::cl::opt<bool> UseQueryRouter;
+
+extern llvm::cl::opt<std::string> QueryRouterHardTimeout;
+
 extern llvm::cl::opt<bool> UseCexCache;
 
 extern llvm::cl::opt<bool> UseBranchCache;
@@ -42,14 +48,18 @@ extern llvm::cl::opt<bool> UseForkedCoreSolver;
 
 extern llvm::cl::opt<bool> CoreSolverOptimizeDivides;
 
+extern llvm::cl::opt<bool> BenchmarkSolverStages;
+
 extern llvm::cl::opt<bool> UseAssignmentValidatingSolver;
 
 /// The different query logging solvers that can be switched on/off
 enum QueryLoggingSolverType {
   ALL_KQUERY,    ///< Log all queries in .kquery (KQuery) format
   ALL_SMTLIB,    ///< Log all queries .smt2 (SMT-LIBv2) format
+  ALL_BINARY,    ///< Log all queries in the binary query-log format
   SOLVER_KQUERY, ///< Log queries passed to solver in .kquery (KQuery) format
-  SOLVER_SMTLIB  ///< Log queries passed to solver in .smt2 (SMT-LIBv2) format
+  SOLVER_SMTLIB, ///< Log queries passed to solver in .smt2 (SMT-LIBv2) format
+  SOLVER_BINARY  ///< Log queries passed to solver in the binary format
 };
 
 extern llvm::cl::bits<QueryLoggingSolverType> QueryLoggingOptions;
@@ -59,6 +69,7 @@ enum CoreSolverType {
   METASMT_SOLVER,
   DUMMY_SOLVER,
   Z3_SOLVER,
+  PORTFOLIO_SOLVER,
   NO_SOLVER
 };
 
@@ -13,6 +13,8 @@
 #include "klee/System/Time.h"
 #include "Solver.h"
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 namespace klee {
@@ -109,6 +111,28 @@ namespace klee {
     virtual void setCoreSolverTimeout(time::Span timeout) {};
 };
 
+  /// SolverStageMetrics - Benchmark counters for one metered stage of a
+  /// solver chain (see createMeteredSolver()). Each chain gets its own
+  /// record per stage; records with the same name (e.g. from parallel
+  /// workers' chains) are aggregated when reported.
+  struct SolverStageMetrics {
+    /// Stage name, e.g. "branch-cache".
+    std::string name;
+    /// Name of the metered stage directly beneath this one, or the empty
+    /// string for the innermost metered stage.
+    std::string inner;
+    /// Number of queries that reached this stage.
+    std::uint64_t queries = 0;
+    /// Wall time spent in this stage and everything beneath it.
+    time::Span time;
+  };
+
+  /// registerSolverStageMetrics - Add a metrics record to the process-wide
+  /// registry and return it. Registration is thread-safe; the returned
+  /// record itself must only be updated by the thread driving its chain.
+  SolverStageMetrics *registerSolverStageMetrics(const std::string &name,
+                                                 const std::string &inner);
+
 }
 
 #endif /* KLEE_SOLVERIMPL_H */
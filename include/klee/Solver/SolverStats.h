@@ -15,18 +15,35 @@
 namespace klee {
 namespace stats {
 
+  extern Statistic arrayOptCacheHits;
+  extern Statistic arrayOptIndexApplied;
+  extern Statistic arrayOptIndexFailed;
+  extern Statistic arrayOptValueApplied;
+  extern Statistic arrayOptValueFailed;
   extern Statistic cexCacheTime;
   extern Statistic queries;
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
+  extern Statistic queryCacheEvictions;
   extern Statistic queryCacheHits;
   extern Statistic queryCacheMisses;
+  /// Estimated time the validity query cache's hits saved, each valued
+  /// at the average measured pass-through cost.
+  extern Statistic queryCacheSavedTime;
+  /// Time spent inside the validity query cache itself (lookups and
+  /// insertions), as opposed to the solvers below it.
+  extern Statistic queryCacheTime;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  /// As queryCacheSavedTime, for the counterexample cache.
+  extern Statistic queryCexCacheSavedTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
-  
+  /// Current estimated footprint of the solver backend in bytes; a
+  /// gauge, not a counter.
+  extern Statistic solverMemory;
+
 #ifdef KLEE_ARRAY_DEBUG
   extern Statistic arrayHashTime;
 #endif
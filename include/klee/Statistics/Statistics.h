@@ -12,9 +12,10 @@
 
 #include "Statistic.h"
 
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <string>
-#include <string.h>
 
 namespace klee {
   class Statistic;
@@ -22,29 +23,101 @@ namespace klee {
     friend class StatisticManager;
 
   private:
-    uint64_t *data;
+    std::atomic<uint64_t> *data;
 
-  public:    
+  public:
     StatisticRecord();
     StatisticRecord(const StatisticRecord &s);
     ~StatisticRecord() { delete[] data; }
-    
+
     void zero();
 
-    uint64_t getValue(const Statistic &s) const; 
+    uint64_t getValue(const Statistic &s) const;
     void incrementValue(const Statistic &s, uint64_t addend) const;
     StatisticRecord &operator =(const StatisticRecord &s);
     StatisticRecord &operator +=(const StatisticRecord &sr);
   };
 
+  /// StatisticManager - Manages the values of all statistics.
+  ///
+  /// The primary (global) statistics are sharded per thread: each
+  /// thread only ever increments its own shard, so the instruction hot
+  /// path never contends on a cache line, and readers sum the shards on
+  /// demand. Indexed and context statistics are kept in shared arrays
+  /// of relaxed atomics; concurrent increments of the same slot are
+  /// rare since threads work on different states.
   class StatisticManager {
   private:
     bool enabled;
     std::vector<Statistic*> stats;
-    uint64_t *globalStats;
-    uint64_t *indexedStats;
-    StatisticRecord *contextStats;
-    unsigned index;
+
+    /// Table of per-thread shards of the primary statistic counters,
+    /// each holding getNumStatistics() relaxed atomics. Append-only
+    /// while threads are running so that readers can sum it without
+    /// locking; slots are only reclaimed when the statistic set
+    /// changes, which happens during static initialization. Threads
+    /// beyond MaxThreadShards share the first shard (still correct,
+    /// just contended).
+    static const unsigned MaxThreadShards = 256;
+    std::atomic<std::atomic<uint64_t>*> shardTable[MaxThreadShards];
+    std::atomic<unsigned> numShards;
+    /// Serializes shard creation and reclamation.
+    mutable std::mutex shardsMutex;
+
+    /// Bumped whenever the set of statistics changes, invalidating the
+    /// thread-local shard caches.
+    std::atomic<unsigned> shardEpoch;
+
+    std::atomic<uint64_t> *indexedStats;
+
+    /// Number of indices the indexed statistics were sized for.
+    unsigned indexedStatsCount;
+
+    /// First-touch remap from index (instruction id) to physical row
+    /// in \ref indexedStats. Rows are handed out in touch order, so
+    /// the instructions that actually execute share a small dense
+    /// prefix of the array instead of scattering their counters across
+    /// it interleaved with never-executed instructions; untouched
+    /// indices keep the sentinel and occupy no row. Entries are
+    /// written exactly once, under \ref remapMutex.
+    std::atomic<unsigned> *indexRemap;
+
+    /// Sentinel for an index without an assigned row.
+    static const unsigned UnassignedRow = ~0u;
+
+    /// Number of physical rows assigned so far.
+    mutable std::atomic<unsigned> assignedRows;
+
+    /// Serializes row assignment.
+    mutable std::mutex remapMutex;
+
+    /// assignRow - Slow path of \ref physicalRow: assign the next
+    /// dense row to \p index unless another thread beat us to it.
+    unsigned assignRow(unsigned index) const;
+
+    /// physicalRow - Return the physical row holding the counters for
+    /// \p index, assigning the next dense row on first touch.
+    unsigned physicalRow(unsigned index) const {
+      unsigned row = indexRemap[index].load(std::memory_order_acquire);
+      if (row == UnassignedRow)
+        row = assignRow(index);
+      return row;
+    }
+
+    /// Thread-local: each thread tracks its own current context record
+    /// and instruction index.
+    static thread_local StatisticRecord *contextStats;
+    static thread_local unsigned index;
+
+    /// Thread-local cache of the calling thread's shard, with the
+    /// epoch it was created under.
+    static thread_local std::atomic<uint64_t> *localShard;
+    static thread_local unsigned localShardEpoch;
+
+    /// getThreadShard - Return the calling thread's shard, creating
+    /// and registering it on first use (or after the statistic set
+    /// changed).
+    std::atomic<uint64_t> *getThreadShard();
 
   public:
     StatisticManager();
@@ -52,6 +125,14 @@ namespace klee {
 
     void useIndexedStats(unsigned totalIndices);
 
+    /// copyIndexedStats - Copy the current indexed statistic values
+    /// into \p out, laid out as index*getNumStatistics() + statistic
+    /// id (the logical layout getIndexedValue() presents; the physical
+    /// first-touch row order is not visible). The copy is not
+    /// an atomic snapshot: increments racing with the copy may or may
+    /// not be included.
+    void copyIndexedStats(std::vector<uint64_t> &out) const;
+
     StatisticRecord *getContext();
     void setContext(StatisticRecord *sr); /* null to reset */
 
@@ -59,11 +140,16 @@ namespace klee {
     unsigned getIndex() { return index; }
     unsigned getNumStatistics() { return stats.size(); }
     Statistic &getStatistic(unsigned i) { return *stats[i]; }
-    
+
     void registerStatistic(Statistic &s);
     void incrementStatistic(Statistic &s, uint64_t addend);
+
+    /// getValue - Get the aggregate value of \p s over all thread
+    /// shards. The sum is not a snapshot: increments racing with the
+    /// read may or may not be included.
     uint64_t getValue(const Statistic &s) const;
-    void incrementIndexedValue(const Statistic &s, unsigned index, 
+
+    void incrementIndexedValue(const Statistic &s, unsigned index,
                                uint64_t addend) const;
     uint64_t getIndexedValue(const Statistic &s, unsigned index) const;
     void setIndexedValue(const Statistic &s, unsigned index, uint64_t value);
@@ -73,14 +159,21 @@ namespace klee {
 
   extern StatisticManager *theStatisticManager;
 
-  inline void StatisticManager::incrementStatistic(Statistic &s, 
+  inline void StatisticManager::incrementStatistic(Statistic &s,
                                                    uint64_t addend) {
     if (enabled) {
-      globalStats[s.id] += addend;
+      std::atomic<uint64_t> *shard =
+        (localShard &&
+         localShardEpoch == shardEpoch.load(std::memory_order_relaxed))
+          ? localShard
+          : getThreadShard();
+      shard[s.id].fetch_add(addend, std::memory_order_relaxed);
       if (indexedStats) {
-        indexedStats[index*stats.size() + s.id] += addend;
+        indexedStats[physicalRow(index)*stats.size() + s.id]
+          .fetch_add(addend, std::memory_order_relaxed);
         if (contextStats)
-          contextStats->data[s.id] += addend;
+          contextStats->data[s.id]
+            .fetch_add(addend, std::memory_order_relaxed);
       }
     }
   }
@@ -93,61 +186,71 @@ namespace klee {
   }
 
   inline void StatisticRecord::zero() {
-    ::memset(data, 0, sizeof(*data)*theStatisticManager->getNumStatistics());
+    unsigned nStats = theStatisticManager->getNumStatistics();
+    for (unsigned i=0; i<nStats; i++)
+      data[i].store(0, std::memory_order_relaxed);
   }
 
-  inline StatisticRecord::StatisticRecord() 
-    : data(new uint64_t[theStatisticManager->getNumStatistics()]) {
+  inline StatisticRecord::StatisticRecord()
+    : data(new std::atomic<uint64_t>[
+             theStatisticManager->getNumStatistics()]) {
     zero();
   }
 
-  inline StatisticRecord::StatisticRecord(const StatisticRecord &s) 
-    : data(new uint64_t[theStatisticManager->getNumStatistics()]) {
-    ::memcpy(data, s.data, 
-             sizeof(*data)*theStatisticManager->getNumStatistics());
+  inline StatisticRecord::StatisticRecord(const StatisticRecord &s)
+    : data(new std::atomic<uint64_t>[
+             theStatisticManager->getNumStatistics()]) {
+    *this = s;
   }
 
   inline StatisticRecord &StatisticRecord::operator=(const StatisticRecord &s) {
-    ::memcpy(data, s.data, 
-             sizeof(*data)*theStatisticManager->getNumStatistics());
+    unsigned nStats = theStatisticManager->getNumStatistics();
+    for (unsigned i=0; i<nStats; i++)
+      data[i].store(s.data[i].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
     return *this;
   }
 
-  inline void StatisticRecord::incrementValue(const Statistic &s, 
+  inline void StatisticRecord::incrementValue(const Statistic &s,
                                               uint64_t addend) const {
-    data[s.id] += addend;
+    data[s.id].fetch_add(addend, std::memory_order_relaxed);
   }
-  inline uint64_t StatisticRecord::getValue(const Statistic &s) const { 
-    return data[s.id]; 
+  inline uint64_t StatisticRecord::getValue(const Statistic &s) const {
+    return data[s.id].load(std::memory_order_relaxed);
   }
 
   inline StatisticRecord &
   StatisticRecord::operator +=(const StatisticRecord &sr) {
     unsigned nStats = theStatisticManager->getNumStatistics();
     for (unsigned i=0; i<nStats; i++)
-      data[i] += sr.data[i];
+      data[i].fetch_add(sr.data[i].load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
     return *this;
   }
 
-  inline uint64_t StatisticManager::getValue(const Statistic &s) const {
-    return globalStats[s.id];
-  }
-
-  inline void StatisticManager::incrementIndexedValue(const Statistic &s, 
+  inline void StatisticManager::incrementIndexedValue(const Statistic &s,
                                                       unsigned index,
                                                       uint64_t addend) const {
-    indexedStats[index*stats.size() + s.id] += addend;
+    indexedStats[physicalRow(index)*stats.size() + s.id]
+      .fetch_add(addend, std::memory_order_relaxed);
   }
 
-  inline uint64_t StatisticManager::getIndexedValue(const Statistic &s, 
+  inline uint64_t StatisticManager::getIndexedValue(const Statistic &s,
                                                     unsigned index) const {
-    return indexedStats[index*stats.size() + s.id];
+    // An index that was never touched has no row; all its counters
+    // are still zero.
+    unsigned row = indexRemap[index].load(std::memory_order_acquire);
+    if (row == UnassignedRow)
+      return 0;
+    return indexedStats[row*stats.size() + s.id]
+      .load(std::memory_order_relaxed);
   }
 
-  inline void StatisticManager::setIndexedValue(const Statistic &s, 
+  inline void StatisticManager::setIndexedValue(const Statistic &s,
                                                 unsigned index,
                                                 uint64_t value) {
-    indexedStats[index*stats.size() + s.id] = value;
+    indexedStats[physicalRow(index)*stats.size() + s.id]
+      .store(value, std::memory_order_relaxed);
   }
 }
 
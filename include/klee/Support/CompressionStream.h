@@ -13,6 +13,12 @@
 #include "llvm/Support/raw_ostream.h"
 #include "zlib.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
 namespace klee {
 const size_t BUFSIZE = 128 * 1024;
 
@@ -37,10 +43,48 @@ public:
   /// should be immediately destroyed; the string will be empty if no error
   /// occurred. This allows optional flags to control how the file will be
   /// opened.
-  compressed_fd_ostream(const std::string &Filename, std::string &ErrorInfo);
+  ///
+  /// \param Level zlib compression level: Z_BEST_COMPRESSION (default) for
+  /// final artifacts, Z_BEST_SPEED for logs written on the execution path.
+  compressed_fd_ostream(const std::string &Filename, std::string &ErrorInfo,
+                        int Level = Z_BEST_COMPRESSION);
 
   ~compressed_fd_ostream();
 };
+
+/// Compresses on a dedicated worker thread so the writing thread never
+/// blocks on the compressor itself. Submitted data is queued as chunks
+/// in a bounded ring; the writer only waits when compression has fallen
+/// more than the ring capacity behind. Intended for logs that are
+/// written while the engine is running (e.g. the query log).
+class async_compressed_fd_ostream : public llvm::raw_ostream {
+  compressed_fd_ostream stream;
+  std::deque<std::string> chunks;
+  size_t queuedBytes = 0;
+  bool done = false;
+  std::mutex mutex;
+  std::condition_variable chunkAvailable;
+  std::condition_variable spaceAvailable;
+  std::thread worker;
+  uint64_t pos = 0;
+
+  /// write_impl - See raw_ostream::write_impl.
+  virtual void write_impl(const char *Ptr, size_t Size);
+
+  virtual uint64_t current_pos() const { return pos; }
+
+  void compressLoop();
+
+public:
+  /// Open the specified file for writing; see compressed_fd_ostream. The
+  /// worker thread is only started when no error occurred.
+  async_compressed_fd_ostream(const std::string &Filename,
+                              std::string &ErrorInfo,
+                              int Level = Z_BEST_SPEED);
+
+  /// Drains all queued chunks before closing the file.
+  ~async_compressed_fd_ostream();
+};
 }
 
 #endif /* KLEE_COMPRESSIONSTREAM_H */
@@ -21,6 +21,13 @@ klee_open_output_file(const std::string &path, std::string &error);
 #ifdef HAVE_ZLIB_H
 std::unique_ptr<llvm::raw_ostream>
 klee_open_compressed_output_file(const std::string &path, std::string &error);
+
+/// Like klee_open_compressed_output_file but compresses at a fast level
+/// on a dedicated worker thread, keeping the compressor off the calling
+/// thread. Use for logs written while the engine is running.
+std::unique_ptr<llvm::raw_ostream>
+klee_open_async_compressed_output_file(const std::string &path,
+                                       std::string &error);
 #endif
 } // namespace klee
 
@@ -0,0 +1,32 @@
+//===-- Hashing.h -----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_HASHING_H
+#define KLEE_HASHING_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace klee {
+namespace hashing {
+
+/// Hash \p len bytes starting at \p data with a 64-bit xxHash-style
+/// mix. The main loop runs four independent accumulators over 8-byte
+/// lanes with no branches or cross-lane dependencies, so compilers
+/// vectorize it for the target's SIMD unit without per-ISA code here.
+/// Intended for bulk byte buffers (array names, concrete stores); small
+/// fixed-arity hashes are better served by the inline combines at the
+/// use sites.
+std::uint64_t hashBytes(const void *data, std::size_t len,
+                        std::uint64_t seed = 0);
+
+} // namespace hashing
+} // namespace klee
+
+#endif /* KLEE_HASHING_H */
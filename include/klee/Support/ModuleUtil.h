@@ -34,10 +34,15 @@ namespace klee {
 /// everything is linked against the first entry.
 /// @param entryFunction if set, missing functions of the module containing the
 /// entry function will be solved.
+/// @param linkedSomething if non-null, set to true if any definition was
+/// linked into the composite. With -link-only-needed, modules can provide
+/// definitions without being consumed, so this is the only reliable
+/// progress indicator.
 /// @return final module or null in this case errorMsg is set
 std::unique_ptr<llvm::Module>
 linkModules(std::vector<std::unique_ptr<llvm::Module>> &modules,
-            llvm::StringRef entryFunction, std::string &errorMsg);
+            llvm::StringRef entryFunction, std::string &errorMsg,
+            bool *linkedSomething = nullptr);
 
 /// Return the Function* target of a Call or Invoke instruction, or
 /// null if it cannot be determined (should be only for indirect
@@ -0,0 +1,70 @@
+//===-- PhaseProfiler.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PHASEPROFILER_H
+#define KLEE_PHASEPROFILER_H
+
+#include <csignal>
+#include <string>
+
+namespace klee {
+namespace profiler {
+
+/// Semantic phases samples are attributed to. Keep the name table in
+/// PhaseProfiler.cpp in sync.
+enum Phase {
+  Other = 0,
+  Dispatch,  ///< instruction interpretation
+  Fork,      ///< Executor::fork bookkeeping (state copies, seeds)
+  Solver,    ///< waiting on the solver chain
+  Searcher,  ///< state selection
+  Stats,     ///< statistics writing
+  NumPhases
+};
+
+/// Phase the next sample is attributed to. A single global rather than
+/// a thread-local: ITIMER_PROF delivers its signal to an arbitrary
+/// running thread, so with parallel execution workers the profile is an
+/// approximation of where the process' CPU time goes overall.
+extern volatile sig_atomic_t currentPhase;
+
+/// Marks a phase for the enclosing scope and restores the previous one
+/// on exit, so nested markers attribute samples to the innermost phase
+/// (e.g. solver time inside instruction dispatch counts as solver).
+class ScopedPhase {
+  sig_atomic_t saved;
+
+public:
+  explicit ScopedPhase(Phase phase) : saved(currentPhase) {
+    currentPhase = phase;
+  }
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+  ~ScopedPhase() { currentPhase = saved; }
+};
+
+/// Start sampling CPU time at \p frequency Hz via ITIMER_PROF/SIGPROF.
+/// No-op when \p frequency is zero.
+void start(unsigned frequency);
+
+/// Disarm the interval timer. Collected samples are kept so they can
+/// still be written out.
+void stop();
+
+/// Write the collected samples as a speedscope "sampled" profile with
+/// one frame per phase to \p path (load it at https://www.speedscope.app
+/// or with pprof's speedscope importer). The chronological timeline is
+/// capped at 2^20 samples; per-phase totals always cover the whole run.
+/// Returns false and sets \p error on failure.
+bool writeSpeedscope(const std::string &path, std::string &error);
+
+} // namespace profiler
+} // namespace klee
+
+#endif /* KLEE_PHASEPROFILER_H */
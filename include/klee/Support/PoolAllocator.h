@@ -0,0 +1,99 @@
+//===-- PoolAllocator.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_POOLALLOCATOR_H
+#define KLEE_POOLALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+namespace klee {
+
+/// PoolAllocator - A size-class slab allocator backing the allocation of
+/// small, frequently churned objects (Expr nodes and UpdateNodes).
+///
+/// Objects are carved out of large slabs and returned to per-size-class
+/// free lists on deallocation, so the hot allocate/free cycle is a couple
+/// of pointer operations and nodes of the same size stay densely packed.
+/// Free lists and slabs are thread-local, which keeps the fast path
+/// synchronization-free in the parallel execution mode; an object freed
+/// on a different thread than the one that allocated it simply lands on
+/// the freeing thread's list. Slabs are retained for the lifetime of the
+/// process.
+class PoolAllocator {
+  static const size_t Alignment = 16;
+  static const size_t MaxPooledSize = 256;
+  static const size_t NumClasses = MaxPooledSize / Alignment;
+  static const size_t SlabSize = 64 * 1024;
+
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  /// Per-thread pools. Deliberately trivially destructible: deallocations
+  /// can still arrive during static destruction, and slabs are never
+  /// returned to the operating system.
+  struct ThreadPools {
+    FreeNode *freeLists[NumClasses];
+    char *slabCursor;
+    size_t slabRemaining;
+  };
+
+  static ThreadPools &pools() {
+    static thread_local ThreadPools tp;
+    return tp;
+  }
+
+  static size_t sizeClass(size_t size) {
+    return (size + Alignment - 1) / Alignment - 1;
+  }
+
+public:
+  static void *allocate(size_t size) {
+    if (size == 0 || size > MaxPooledSize)
+      return ::operator new(size);
+
+    size_t cls = sizeClass(size);
+    ThreadPools &tp = pools();
+    if (FreeNode *node = tp.freeLists[cls]) {
+      tp.freeLists[cls] = node->next;
+      return node;
+    }
+
+    size_t bytes = (cls + 1) * Alignment;
+    if (tp.slabRemaining < bytes) {
+      // The remainder of the old slab (always less than one size class)
+      // is abandoned.
+      tp.slabCursor = static_cast<char *>(::operator new(SlabSize));
+      tp.slabRemaining = SlabSize;
+    }
+
+    void *result = tp.slabCursor;
+    tp.slabCursor += bytes;
+    tp.slabRemaining -= bytes;
+    return result;
+  }
+
+  static void deallocate(void *ptr, size_t size) {
+    if (size == 0 || size > MaxPooledSize) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    ThreadPools &tp = pools();
+    FreeNode *node = static_cast<FreeNode *>(ptr);
+    size_t cls = sizeClass(size);
+    node->next = tp.freeLists[cls];
+    tp.freeLists[cls] = node;
+  }
+};
+
+} // namespace klee
+
+#endif /* KLEE_POOLALLOCATOR_H */
@@ -12,6 +12,7 @@
 
 #include "klee/Expr/Expr.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <sstream>
@@ -82,17 +83,35 @@ public:
 
   /// write - Output a string to the stream and update the
   /// position. The stream should not have any newlines.
-  void write(const std::string &s) {
+  void write(llvm::StringRef s) {
     os << s;
-    pos += s.length();
+    pos += s.size();
+  }
+
+  /// Strings are written straight through; everything else is formatted
+  /// into a stack buffer first so the position can be updated without
+  /// heap-allocating per operand.
+  PrintContext &operator<<(const char *s) {
+    write(s);
+    return *this;
+  }
+
+  PrintContext &operator<<(llvm::StringRef s) {
+    write(s);
+    return *this;
+  }
+
+  PrintContext &operator<<(const std::string &s) {
+    write(s);
+    return *this;
   }
 
   template <typename T>
   PrintContext &operator<<(T elt) {
-    std::string str;
-    llvm::raw_string_ostream ss(str);
+    llvm::SmallString<32> str;
+    llvm::raw_svector_ostream ss(str);
     ss << elt;
-    write(ss.str());
+    write(str.str());
     return *this;
   }
 
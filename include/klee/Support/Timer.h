@@ -14,6 +14,7 @@
 
 #include "llvm/ADT/SmallVector.h"
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 
@@ -70,6 +71,13 @@ namespace klee {
    * All registered timer intervals should be larger than MI and also be multiples of MI.
    * Similar to Timer, a TimerGroup is _passive_ and needs to be `invoke`d by an external
    * caller.
+   *
+   * As `invoke` is called at instruction granularity, it does not consult the
+   * clock on every call: calls are counted and the clock is only checked every
+   * `callsPerClockCheck` calls. That distance is recalibrated from the observed
+   * call rate on every clock check such that the clock is still read several
+   * times per minimum interval, keeping timer accuracy while removing the
+   * per-instruction clock overhead.
    */
   class TimerGroup {
     /// Registered timers.
@@ -78,6 +86,13 @@ namespace klee {
     Timer invocationTimer;
     /// Time of last `invoke` call.
     time::Point currentTime;
+    /// Time of last clock check.
+    time::Point lastCheckTime;
+    /// Number of `invoke` calls between clock checks, recalibrated from the
+    /// observed call rate.
+    std::uint64_t callsPerClockCheck = 1;
+    /// Remaining `invoke` calls until the next clock check.
+    std::uint64_t callsUntilClockCheck = 1;
   public:
     /// \param minInterval The minimum interval between invocations of registered timers.
     explicit TimerGroup(const time::Span &minInterval);
@@ -0,0 +1,55 @@
+//===-- Tracepoints.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TRACEPOINTS_H
+#define KLEE_TRACEPOINTS_H
+
+#include "klee/Config/config.h"
+
+/// USDT static tracepoints under the "klee" provider, for bpftrace/perf
+/// observability of production runs. Compiled out unless the build was
+/// configured with -DENABLE_SDT_PROBES=ON; argument expressions are not
+/// evaluated when disabled. Probe names and argument layouts are a
+/// stable interface:
+///
+///   state_fork(parent_state_id, num_states)
+///   state_terminate_early(state_id)
+///   state_terminate_exit(state_id)
+///   state_terminate_error(state_id, terminate_reason)
+///   memory_pressure_kill(num_killed, total_usage_mb)
+///   solver_query_begin(query_kind, query_shape_hash)
+///   solver_query_end(query_kind, query_shape_hash, elapsed_us)
+///
+/// query_kind: 0=evaluate 1=mustBeTrue 2=getValue 3=getInitialValues.
+/// query_shape_hash is the structural class hash TimingSolver uses for
+/// its adaptive timeouts, letting scripts aggregate latency per query
+/// class.
+
+#ifdef ENABLE_SDT_PROBES
+#include <sys/sdt.h>
+#define KLEE_TRACE(name) DTRACE_PROBE(klee, name)
+#define KLEE_TRACE1(name, a) DTRACE_PROBE1(klee, name, a)
+#define KLEE_TRACE2(name, a, b) DTRACE_PROBE2(klee, name, a, b)
+#define KLEE_TRACE3(name, a, b, c) DTRACE_PROBE3(klee, name, a, b, c)
+#else
+#define KLEE_TRACE(name)                                                       \
+  do {                                                                         \
+  } while (0)
+#define KLEE_TRACE1(name, a)                                                   \
+  do {                                                                         \
+  } while (0)
+#define KLEE_TRACE2(name, a, b)                                                \
+  do {                                                                         \
+  } while (0)
+#define KLEE_TRACE3(name, a, b, c)                                             \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif /* KLEE_TRACEPOINTS_H */
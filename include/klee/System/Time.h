@@ -97,6 +97,7 @@ namespace klee {
     Span operator*(unsigned, const Span&);
     Span operator/(const Span&, unsigned);
     bool operator==(const Span&, const Span&);
+    bool operator!=(const Span&, const Span&);
     bool operator<=(const Span&, const Span&);
     bool operator>=(const Span&, const Span&);
     bool operator<(const Span&, const Span&);
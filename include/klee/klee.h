@@ -36,6 +36,21 @@ extern "C" {
    */
   void klee_make_symbolic(void *addr, size_t nbytes, const char *name);
 
+  /* A symbolic region for klee_make_symbolic_batch: equivalent to
+     klee_make_symbolic(address, nbytes, name). */
+  typedef struct {
+    void *address;
+    size_t nbytes;
+    const char *name;
+  } klee_sym_region;
+
+  /* klee_make_symbolic_batch - Make \arg count regions symbolic in one
+     call. Equivalent to calling klee_make_symbolic per region but with
+     a single executor round trip, which matters for harnesses that
+     declare hundreds of symbolic regions. All addresses, sizes and
+     names must be concrete. */
+  void klee_make_symbolic_batch(const klee_sym_region *regions, size_t count);
+
   /* klee_range - Construct a symbolic value in the signed interval
    * [begin,end).
    *
@@ -108,6 +123,22 @@ extern "C" {
    */
   unsigned klee_is_replay(void);
 
+  /* Rebind subsequent klee_make_symbolic() calls to the given .ktest
+   * file without restarting the process, releasing any previously
+   * loaded test. KTEST v2 files stay memory-mapped and are decoded
+   * lazily. Only available when replaying with libkleeRuntest; together
+   * with klee_replay_end_test() it lets one harness process iterate a
+   * whole corpus.
+   *
+   * Returns true on success.
+   */
+  int klee_replay_set_test(const char *path);
+
+  /* Release the currently loaded .ktest file and reset the replay
+   * position. Only available when replaying with libkleeRuntest.
+   */
+  void klee_replay_end_test(void);
+
 
   /* The following intrinsics are primarily intended for internal use
      and may have peculiar semantics. */
@@ -141,6 +172,14 @@ extern "C" {
      constants and that the range lie within a single object. */
   void klee_check_memory_access(const void *address, size_t size);
 
+  /* Copy nbytes from src to dst inside the executor instead of with an
+     interpreted byte loop; the bytes themselves may be symbolic.
+     Overlapping ranges behave like memmove.
+
+     The current implementation requires dst, src and nbytes to be
+     constants and each range to lie within a single object. */
+  void klee_memcpy(void *dst, const void *src, size_t nbytes);
+
   /* Enable/disable forking. */
   void klee_set_forking(unsigned enable);
 
@@ -9,10 +9,22 @@
 
 #include "klee/ADT/KTest.h"
 
+#include "klee/Config/config.h"
+
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
 #define KTEST_MAGIC "KTEST"
@@ -20,6 +32,19 @@
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
+/* KTEST v2: fixed little-endian header, object directory and 8-byte
+   aligned object data, suitable for mmap and zero-copy access. The
+   magic shares the "KTEST" prefix so kTest_isKTestFile() accepts v2
+   files as well. */
+#define KTEST2_MAGIC "KTESTv2"
+#define KTEST2_MAGIC_SIZE 8 /* includes the terminating NUL */
+#define KTEST2_VERSION 1
+#define KTEST2_HEADER_SIZE 64
+#define KTEST2_DIRENT_SIZE 32
+
+/* object directory flags */
+#define KTEST2_OBJECT_COMPRESSED 1u
+
 /***/
 
 static int read_uint32(FILE *f, unsigned *value_out) {
@@ -91,12 +116,20 @@ int kTest_isKTestFile(const char *path) {
   return res;
 }
 
+static KTest *kTest_fromFile2(const char *path);
+
 KTest *kTest_fromFile(const char *path) {
-  FILE *f = fopen(path, "rb");
+  FILE *f;
   KTest *res = 0;
   unsigned i, version;
 
-  if (!f) 
+  /* v2 files are materialized eagerly through the mmap reader so that
+     existing callers keep working unchanged. */
+  if (kTest_isKTest2File(path))
+    return kTest_fromFile2(path);
+
+  f = fopen(path, "rb");
+  if (!f)
     goto error;
   if (!kTest_checkHeader(f)) 
     goto error;
@@ -238,3 +271,455 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/*** KTEST v2 ***/
+
+/* File layout (all integers little-endian):
+
+     0  char     magic[8]        "KTESTv2\0"
+     8  uint32   format version  (KTEST2_VERSION)
+    12  uint32   numArgs
+    16  uint32   symArgvs
+    20  uint32   symArgvLen
+    24  uint32   numObjects
+    28  uint32   reserved
+    32  uint64   argsOffset      numArgs concatenated NUL-terminated strings
+    40  uint64   argsSize
+    48  uint64   dirOffset       numObjects directory entries, 8-aligned
+    56  uint64   reserved
+
+   directory entry (32 bytes):
+
+     0  uint64   nameOffset      NUL-terminated string
+     8  uint64   dataOffset      8-aligned
+    16  uint32   numBytes        uncompressed object size
+    20  uint32   storedBytes     bytes stored in the file
+    24  uint32   flags           KTEST2_OBJECT_*
+    28  uint32   reserved
+*/
+
+typedef struct KTest2Object {
+  uint64_t nameOffset;
+  uint64_t dataOffset;
+  unsigned numBytes;
+  unsigned storedBytes;
+  unsigned flags;
+  /* lazily decoded bytes of a compressed object */
+  unsigned char *decoded;
+} KTest2Object;
+
+struct KTest2 {
+  unsigned char *data;
+  size_t size;
+  /* non-zero iff data is an mmap mapping rather than a heap copy */
+  int mapped;
+
+  unsigned numArgs;
+  unsigned symArgvs;
+  unsigned symArgvLen;
+  unsigned numObjects;
+
+  /* pointers into data */
+  char **args;
+  KTest2Object *objects;
+};
+
+static uint32_t ktest2_getLE32(const unsigned char *p) {
+  return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint64_t ktest2_getLE64(const unsigned char *p) {
+  return ((uint64_t)ktest2_getLE32(p)) | ((uint64_t)ktest2_getLE32(p + 4) << 32);
+}
+
+static int ktest2_writeLE32(FILE *f, uint32_t value) {
+  unsigned char data[4];
+  data[0] = value;
+  data[1] = value >> 8;
+  data[2] = value >> 16;
+  data[3] = value >> 24;
+  return fwrite(data, 1, 4, f) == 4;
+}
+
+static int ktest2_writeLE64(FILE *f, uint64_t value) {
+  return ktest2_writeLE32(f, (uint32_t)value) &&
+         ktest2_writeLE32(f, (uint32_t)(value >> 32));
+}
+
+static uint64_t ktest2_align8(uint64_t offset) {
+  return (offset + 7) & ~(uint64_t)7;
+}
+
+/* write NUL padding up to the given file offset */
+static int ktest2_padTo(FILE *f, uint64_t current, uint64_t target) {
+  static const unsigned char zeros[8] = {0};
+  if (target < current)
+    return 0;
+  return target == current ||
+         fwrite(zeros, target - current, 1, f) == 1;
+}
+
+int kTest_isKTest2File(const char *path) {
+  char header[KTEST2_MAGIC_SIZE];
+  FILE *f = fopen(path, "rb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = fread(header, KTEST2_MAGIC_SIZE, 1, f) == 1 &&
+        memcmp(header, KTEST2_MAGIC, KTEST2_MAGIC_SIZE) == 0;
+  fclose(f);
+
+  return res;
+}
+
+int kTest_toFile2(KTest *bo, const char *path, int compress) {
+  FILE *f = 0;
+  unsigned char **stored = 0;
+  uint64_t *storedBytes = 0;
+  uint64_t argsSize = 0, namesSize = 0, dirOffset, dataOffset, offset;
+  unsigned i;
+
+  /* Compress the object data up front; the directory needs the stored
+     sizes before any data is written. Objects that do not shrink are
+     kept uncompressed. */
+  stored = (unsigned char**) calloc(bo->numObjects, sizeof(*stored));
+  storedBytes = (uint64_t*) calloc(bo->numObjects, sizeof(*storedBytes));
+  if (!stored || !storedBytes)
+    goto error;
+  for (i=0; i<bo->numObjects; i++)
+    storedBytes[i] = bo->objects[i].numBytes;
+#ifdef HAVE_ZLIB_H
+  if (compress) {
+    for (i=0; i<bo->numObjects; i++) {
+      KTestObject *o = &bo->objects[i];
+      uLongf destLen = compressBound(o->numBytes);
+      unsigned char *dest = (unsigned char*) malloc(destLen ? destLen : 1);
+      if (!dest)
+        goto error;
+      if (compress2(dest, &destLen, o->bytes, o->numBytes,
+                    Z_DEFAULT_COMPRESSION) == Z_OK &&
+          destLen < o->numBytes) {
+        stored[i] = dest;
+        storedBytes[i] = destLen;
+      } else {
+        free(dest);
+      }
+    }
+  }
+#else
+  (void) compress;
+#endif
+
+  for (i=0; i<bo->numArgs; i++)
+    argsSize += strlen(bo->args[i]) + 1;
+  for (i=0; i<bo->numObjects; i++)
+    namesSize += strlen(bo->objects[i].name) + 1;
+  dirOffset = ktest2_align8(KTEST2_HEADER_SIZE + argsSize + namesSize);
+  dataOffset = ktest2_align8(dirOffset +
+                             (uint64_t)bo->numObjects * KTEST2_DIRENT_SIZE);
+
+  f = fopen(path, "wb");
+  if (!f)
+    goto error;
+
+  /* header */
+  if (fwrite(KTEST2_MAGIC, KTEST2_MAGIC_SIZE, 1, f)!=1)
+    goto error;
+  if (!ktest2_writeLE32(f, KTEST2_VERSION) ||
+      !ktest2_writeLE32(f, bo->numArgs) ||
+      !ktest2_writeLE32(f, bo->symArgvs) ||
+      !ktest2_writeLE32(f, bo->symArgvLen) ||
+      !ktest2_writeLE32(f, bo->numObjects) ||
+      !ktest2_writeLE32(f, 0) ||
+      !ktest2_writeLE64(f, KTEST2_HEADER_SIZE) ||
+      !ktest2_writeLE64(f, argsSize) ||
+      !ktest2_writeLE64(f, dirOffset) ||
+      !ktest2_writeLE64(f, 0))
+    goto error;
+
+  /* argument and name strings */
+  for (i=0; i<bo->numArgs; i++)
+    if (fwrite(bo->args[i], strlen(bo->args[i]) + 1, 1, f)!=1)
+      goto error;
+  offset = KTEST2_HEADER_SIZE + argsSize;
+  for (i=0; i<bo->numObjects; i++) {
+    if (fwrite(bo->objects[i].name, strlen(bo->objects[i].name) + 1, 1, f)!=1)
+      goto error;
+    offset += strlen(bo->objects[i].name) + 1;
+  }
+  if (!ktest2_padTo(f, offset, dirOffset))
+    goto error;
+
+  /* object directory */
+  offset = KTEST2_HEADER_SIZE + argsSize;
+  for (i=0; i<bo->numObjects; i++) {
+    if (!ktest2_writeLE64(f, offset) ||
+        !ktest2_writeLE64(f, dataOffset) ||
+        !ktest2_writeLE32(f, bo->objects[i].numBytes) ||
+        !ktest2_writeLE32(f, (uint32_t)storedBytes[i]) ||
+        !ktest2_writeLE32(f, stored[i] ? KTEST2_OBJECT_COMPRESSED : 0) ||
+        !ktest2_writeLE32(f, 0))
+      goto error;
+    offset += strlen(bo->objects[i].name) + 1;
+    dataOffset = ktest2_align8(dataOffset + storedBytes[i]);
+  }
+
+  /* object data */
+  offset = ktest2_align8(dirOffset +
+                         (uint64_t)bo->numObjects * KTEST2_DIRENT_SIZE);
+  if (!ktest2_padTo(f, dirOffset +
+                    (uint64_t)bo->numObjects * KTEST2_DIRENT_SIZE, offset))
+    goto error;
+  for (i=0; i<bo->numObjects; i++) {
+    const unsigned char *data = stored[i] ? stored[i] : bo->objects[i].bytes;
+    if (storedBytes[i] &&
+        fwrite(data, storedBytes[i], 1, f)!=1)
+      goto error;
+    if (!ktest2_padTo(f, offset + storedBytes[i],
+                      ktest2_align8(offset + storedBytes[i])))
+      goto error;
+    offset = ktest2_align8(offset + storedBytes[i]);
+  }
+
+  fclose(f);
+  for (i=0; i<bo->numObjects; i++)
+    free(stored[i]);
+  free(stored);
+  free(storedBytes);
+
+  return 1;
+ error:
+  if (f) fclose(f);
+  if (stored) {
+    for (i=0; i<bo->numObjects; i++)
+      free(stored[i]);
+    free(stored);
+  }
+  free(storedBytes);
+
+  return 0;
+}
+
+/* return the string at the given offset iff it is NUL-terminated within
+   the file */
+static const char *ktest2_string(const KTest2 *kt, uint64_t offset) {
+  if (offset >= kt->size)
+    return 0;
+  if (!memchr(kt->data + offset, 0, kt->size - offset))
+    return 0;
+  return (const char*) kt->data + offset;
+}
+
+KTest2 *kTest2_open(const char *path) {
+  KTest2 *res = 0;
+  int fd = -1;
+  struct stat st;
+  uint64_t argsOffset, argsSize, dirOffset, offset;
+  unsigned i;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    goto error;
+  if (fstat(fd, &st) < 0 || st.st_size < KTEST2_HEADER_SIZE)
+    goto error;
+
+  res = (KTest2*) calloc(1, sizeof(*res));
+  if (!res)
+    goto error;
+  res->size = st.st_size;
+
+  res->data = (unsigned char*) mmap(0, res->size, PROT_READ, MAP_PRIVATE,
+                                    fd, 0);
+  if (res->data != MAP_FAILED) {
+    res->mapped = 1;
+  } else {
+    /* fall back to a heap copy, e.g. for file systems without mmap */
+    res->data = (unsigned char*) malloc(res->size);
+    if (!res->data)
+      goto error;
+    if (read(fd, res->data, res->size) != (ssize_t)res->size)
+      goto error;
+  }
+  close(fd);
+  fd = -1;
+
+  if (memcmp(res->data, KTEST2_MAGIC, KTEST2_MAGIC_SIZE))
+    goto error;
+  if (ktest2_getLE32(res->data + 8) > KTEST2_VERSION)
+    goto error;
+  res->numArgs = ktest2_getLE32(res->data + 12);
+  res->symArgvs = ktest2_getLE32(res->data + 16);
+  res->symArgvLen = ktest2_getLE32(res->data + 20);
+  res->numObjects = ktest2_getLE32(res->data + 24);
+  argsOffset = ktest2_getLE64(res->data + 32);
+  argsSize = ktest2_getLE64(res->data + 40);
+  dirOffset = ktest2_getLE64(res->data + 48);
+
+  if (argsOffset > res->size || argsSize > res->size - argsOffset ||
+      dirOffset > res->size ||
+      (uint64_t)res->numObjects * KTEST2_DIRENT_SIZE > res->size - dirOffset)
+    goto error;
+
+  res->args = (char**) calloc(res->numArgs, sizeof(*res->args));
+  if (!res->args)
+    goto error;
+  offset = argsOffset;
+  for (i=0; i<res->numArgs; i++) {
+    res->args[i] = (char*) ktest2_string(res, offset);
+    if (!res->args[i] || offset >= argsOffset + argsSize)
+      goto error;
+    offset += strlen(res->args[i]) + 1;
+  }
+
+  res->objects = (KTest2Object*) calloc(res->numObjects,
+                                        sizeof(*res->objects));
+  if (!res->objects)
+    goto error;
+  for (i=0; i<res->numObjects; i++) {
+    KTest2Object *o = &res->objects[i];
+    const unsigned char *dirent =
+        res->data + dirOffset + (uint64_t)i * KTEST2_DIRENT_SIZE;
+    o->nameOffset = ktest2_getLE64(dirent);
+    o->dataOffset = ktest2_getLE64(dirent + 8);
+    o->numBytes = ktest2_getLE32(dirent + 16);
+    o->storedBytes = ktest2_getLE32(dirent + 20);
+    o->flags = ktest2_getLE32(dirent + 24);
+    if (!ktest2_string(res, o->nameOffset) || o->dataOffset > res->size ||
+        o->storedBytes > res->size - o->dataOffset)
+      goto error;
+    if (!(o->flags & KTEST2_OBJECT_COMPRESSED) &&
+        o->storedBytes != o->numBytes)
+      goto error;
+  }
+
+  return res;
+ error:
+  if (fd >= 0)
+    close(fd);
+  if (res)
+    kTest2_close(res);
+
+  return 0;
+}
+
+unsigned kTest2_numArgs(const KTest2 *kt) { return kt->numArgs; }
+
+const char *kTest2_arg(const KTest2 *kt, unsigned index) {
+  return kt->args[index];
+}
+
+unsigned kTest2_symArgvs(const KTest2 *kt) { return kt->symArgvs; }
+
+unsigned kTest2_symArgvLen(const KTest2 *kt) { return kt->symArgvLen; }
+
+unsigned kTest2_numObjects(const KTest2 *kt) { return kt->numObjects; }
+
+const char *kTest2_objectName(const KTest2 *kt, unsigned index) {
+  return (const char*) kt->data + kt->objects[index].nameOffset;
+}
+
+unsigned kTest2_objectNumBytes(const KTest2 *kt, unsigned index) {
+  return kt->objects[index].numBytes;
+}
+
+const unsigned char *kTest2_objectBytes(KTest2 *kt, unsigned index) {
+  KTest2Object *o = &kt->objects[index];
+
+  if (!(o->flags & KTEST2_OBJECT_COMPRESSED))
+    return kt->data + o->dataOffset;
+
+  if (!o->decoded) {
+#ifdef HAVE_ZLIB_H
+    uLongf destLen = o->numBytes;
+    unsigned char *dest = (unsigned char*) malloc(o->numBytes ? o->numBytes : 1);
+    if (!dest)
+      return 0;
+    if (uncompress(dest, &destLen, kt->data + o->dataOffset,
+                   o->storedBytes) != Z_OK ||
+        destLen != o->numBytes) {
+      free(dest);
+      return 0;
+    }
+    o->decoded = dest;
+#else
+    return 0;
+#endif
+  }
+  return o->decoded;
+}
+
+void kTest2_close(KTest2 *kt) {
+  unsigned i;
+  if (kt->objects) {
+    for (i=0; i<kt->numObjects; i++)
+      free(kt->objects[i].decoded);
+    free(kt->objects);
+  }
+  free(kt->args);
+  if (kt->data && kt->mapped) {
+    munmap(kt->data, kt->size);
+  } else {
+    free(kt->data);
+  }
+  free(kt);
+}
+
+/* materialize a v2 file as a heap-allocated KTest for the legacy API */
+static KTest *kTest_fromFile2(const char *path) {
+  KTest2 *kt = kTest2_open(path);
+  KTest *res = 0;
+  unsigned i;
+
+  if (!kt)
+    goto error;
+
+  res = (KTest*) calloc(1, sizeof(*res));
+  if (!res)
+    goto error;
+  res->version = kTest_getCurrentVersion();
+  res->symArgvs = kt->symArgvs;
+  res->symArgvLen = kt->symArgvLen;
+
+  res->numArgs = kt->numArgs;
+  res->args = (char**) calloc(res->numArgs, sizeof(*res->args));
+  if (!res->args)
+    goto error;
+  for (i=0; i<res->numArgs; i++) {
+    res->args[i] = strdup(kTest2_arg(kt, i));
+    if (!res->args[i])
+      goto error;
+  }
+
+  res->numObjects = kt->numObjects;
+  res->objects = (KTestObject*) calloc(res->numObjects, sizeof(*res->objects));
+  if (!res->objects)
+    goto error;
+  for (i=0; i<res->numObjects; i++) {
+    KTestObject *o = &res->objects[i];
+    const unsigned char *bytes = kTest2_objectBytes(kt, i);
+    if (!bytes)
+      goto error;
+    o->name = strdup(kTest2_objectName(kt, i));
+    o->numBytes = kTest2_objectNumBytes(kt, i);
+    o->bytes = (unsigned char*) malloc(o->numBytes ? o->numBytes : 1);
+    if (!o->name || !o->bytes)
+      goto error;
+    memcpy(o->bytes, bytes, o->numBytes);
+  }
+
+  kTest2_close(kt);
+
+  return res;
+ error:
+  if (kt)
+    kTest2_close(kt);
+  if (res) {
+    res->numObjects = res->objects ? res->numObjects : 0;
+    res->numArgs = res->args ? res->numArgs : 0;
+    kTest_free(res);
+  }
+
+  return 0;
+}
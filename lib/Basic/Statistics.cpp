@@ -13,31 +13,116 @@
 
 using namespace klee;
 
+thread_local StatisticRecord *StatisticManager::contextStats = nullptr;
+thread_local unsigned StatisticManager::index = 0;
+thread_local std::atomic<uint64_t> *StatisticManager::localShard = nullptr;
+thread_local unsigned StatisticManager::localShardEpoch = 0;
+
 StatisticManager::StatisticManager()
   : enabled(true),
-    globalStats(0),
+    numShards(0),
+    shardEpoch(0),
     indexedStats(0),
-    contextStats(0),
-    index(0) {
+    indexedStatsCount(0),
+    indexRemap(0),
+    assignedRows(0) {
+  for (unsigned i = 0; i < MaxThreadShards; ++i)
+    shardTable[i].store(nullptr, std::memory_order_relaxed);
 }
 
 StatisticManager::~StatisticManager() {
-  delete[] globalStats;
+  for (unsigned i = 0, e = numShards.load(std::memory_order_relaxed); i != e;
+       ++i)
+    delete[] shardTable[i].load(std::memory_order_relaxed);
   delete[] indexedStats;
+  delete[] indexRemap;
+}
+
+std::atomic<uint64_t> *StatisticManager::getThreadShard() {
+  std::lock_guard<std::mutex> guard(shardsMutex);
+
+  unsigned idx = numShards.load(std::memory_order_relaxed);
+  std::atomic<uint64_t> *counters;
+  if (idx == MaxThreadShards) {
+    counters = shardTable[0].load(std::memory_order_relaxed);
+  } else {
+    counters = new std::atomic<uint64_t>[stats.size()];
+    for (unsigned i = 0, e = stats.size(); i != e; ++i)
+      counters[i].store(0, std::memory_order_relaxed);
+    shardTable[idx].store(counters, std::memory_order_release);
+    numShards.store(idx + 1, std::memory_order_release);
+  }
+
+  localShard = counters;
+  localShardEpoch = shardEpoch.load(std::memory_order_relaxed);
+  return counters;
 }
 
-void StatisticManager::useIndexedStats(unsigned totalIndices) {  
+void StatisticManager::useIndexedStats(unsigned totalIndices) {
   delete[] indexedStats;
-  indexedStats = new uint64_t[totalIndices * stats.size()];
-  memset(indexedStats, 0, sizeof(*indexedStats) * totalIndices * stats.size());
+  indexedStats = new std::atomic<uint64_t>[totalIndices * stats.size()];
+  indexedStatsCount = totalIndices;
+  for (unsigned i = 0, e = totalIndices * stats.size(); i != e; ++i)
+    indexedStats[i].store(0, std::memory_order_relaxed);
+
+  delete[] indexRemap;
+  indexRemap = new std::atomic<unsigned>[totalIndices];
+  for (unsigned i = 0; i != totalIndices; ++i)
+    indexRemap[i].store(UnassignedRow, std::memory_order_relaxed);
+  assignedRows.store(0, std::memory_order_relaxed);
+}
+
+unsigned StatisticManager::assignRow(unsigned index) const {
+  std::lock_guard<std::mutex> guard(remapMutex);
+  unsigned row = indexRemap[index].load(std::memory_order_relaxed);
+  if (row == UnassignedRow) {
+    // Every index gets at most one row, so the dense prefix can never
+    // outgrow the array.
+    row = assignedRows.fetch_add(1, std::memory_order_relaxed);
+    indexRemap[index].store(row, std::memory_order_release);
+  }
+  return row;
+}
+
+void StatisticManager::copyIndexedStats(std::vector<uint64_t> &out) const {
+  const unsigned nStats = stats.size();
+  out.assign(indexedStatsCount * nStats, 0);
+  for (unsigned i = 0; i != indexedStatsCount; ++i) {
+    unsigned row = indexRemap[i].load(std::memory_order_acquire);
+    if (row == UnassignedRow)
+      continue;
+    for (unsigned j = 0; j != nStats; ++j)
+      out[i * nStats + j] =
+          indexedStats[row * nStats + j].load(std::memory_order_relaxed);
+  }
 }
 
 void StatisticManager::registerStatistic(Statistic &s) {
-  delete[] globalStats;
+  std::lock_guard<std::mutex> guard(shardsMutex);
   s.id = stats.size();
   stats.push_back(&s);
-  globalStats = new uint64_t[stats.size()];
-  memset(globalStats, 0, sizeof(*globalStats)*stats.size());
+  // The shards were sized for the old statistic set; drop them (losing
+  // any counts accumulated before registration finished, as before)
+  // and invalidate the thread-local caches. Statistics are registered
+  // during static initialization, before any worker threads exist.
+  for (unsigned i = 0, e = numShards.load(std::memory_order_relaxed); i != e;
+       ++i) {
+    delete[] shardTable[i].load(std::memory_order_relaxed);
+    shardTable[i].store(nullptr, std::memory_order_relaxed);
+  }
+  numShards.store(0, std::memory_order_relaxed);
+  shardEpoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t StatisticManager::getValue(const Statistic &s) const {
+  uint64_t sum = 0;
+  for (unsigned i = 0, e = numShards.load(std::memory_order_acquire); i != e;
+       ++i) {
+    std::atomic<uint64_t> *shard = shardTable[i].load(std::memory_order_acquire);
+    if (shard)
+      sum += shard[s.id].load(std::memory_order_relaxed);
+  }
+  return sum;
 }
 
 int StatisticManager::getStatisticID(const std::string &name) const {
@@ -14,27 +14,132 @@
 #include "TimingSolver.h"
 
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprRangeEvaluator.h"
+#include "klee/Expr/ValueRange.h"
 #include "klee/Statistics/TimerStatIncrementer.h"
 
 #include "CoreStats.h"
 
 using namespace klee;
 
+namespace {
+
+/// Evaluates a conservative [min, max] range for an address expression
+/// while ignoring the path constraints; reads of symbolic bytes come back
+/// as [0, 255]. The result is a superset of the feasible values of the
+/// expression, so objects entirely outside of it can be discarded without
+/// consulting the solver.
+class AddressRangeEvaluator : public ExprRangeEvaluator<ValueRange> {
+public:
+  ValueRange getInitialReadRange(const Array &array, ValueRange index) {
+    // Check for a concrete read of a constant array.
+    if (array.isConstantArray() &&
+        index.isFixed() &&
+        index.min() < array.size)
+      return ValueRange(array.constantValues[index.min()]->getZExtValue(8));
+
+    return ValueRange(0, 255);
+  }
+};
+
+/// Returns true if no address in \p range can fall within \p mo, i.e. the
+/// bounds check against mo is infeasible for any pointer value in range.
+/// Zero-sized objects match only a pointer equal to their address.
+bool objectOutsideRange(const MemoryObject *mo, const ValueRange &range) {
+  if (mo->size == 0)
+    return mo->address < range.min() || mo->address > range.max();
+  return mo->address > range.max() || mo->address + mo->size <= range.min();
+}
+
+} // namespace
+
 ///
 
+MemoryMap AddressSpace::immortalObjects;
+
+void AddressSpace::bindImmortalObject(const MemoryObject *mo,
+                                      ObjectState *os) {
+  assert(os->copyOnWriteOwner == 0 && "object already has owner");
+  immortalObjects = immortalObjects.replace(std::make_pair(mo, os));
+}
+
+void AddressSpace::clearImmortalObjects() {
+  immortalObjects = MemoryMap();
+}
+
+/// splitmix64 finalizer: object ids are sequential, so they are
+/// scrambled before being XOR-combined into the binding-set digest.
+static std::uint64_t digestMix(std::uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(os->copyOnWriteOwner==0 && "object already has owner");
   os->copyOnWriteOwner = cowKey;
+  unsharedBytes += mo->size;
+  if (!objects.lookup(mo))
+    bindingsDigest ^= digestMix(mo->id);
   objects = objects.replace(std::make_pair(mo, os));
 }
 
 void AddressSpace::unbindObject(const MemoryObject *mo) {
+  if (const auto res = objects.lookup(mo)) {
+    // only objects we own were charged to this address space
+    if (res->second->copyOnWriteOwner == cowKey)
+      unsharedBytes -= mo->size;
+    bindingsDigest ^= digestMix(mo->id);
+  }
   objects = objects.remove(mo);
 }
 
 const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
-  const auto res = objects.lookup(mo);
-  return res ? res->second.get() : nullptr;
+  if (const auto res = objects.lookup(mo))
+    return res->second.get();
+  if (const auto res = immortalObjects.lookup(mo))
+    return res->second.get();
+  return nullptr;
+}
+
+AddressSpaceSnapshot *AddressSpace::takeSnapshot() const {
+  // Retiring the epoch makes every current binding foreign to the
+  // owning state, exactly as a fork does: the next write goes through
+  // the copy path of getWriteable and leaves the snapshot untouched.
+  ++cowKey;
+  unsharedBytes = 0;
+  return new AddressSpaceSnapshot(objects);
+}
+
+AddressSpaceSnapshot *AddressSpaceSnapshot::head = nullptr;
+
+AddressSpaceSnapshot::AddressSpaceSnapshot(const MemoryMap &objects)
+    : objects(objects), next(head) {
+  head = this;
+}
+
+const ObjectState *
+AddressSpaceSnapshot::findObject(const MemoryObject *mo) const {
+  if (const auto res = objects.lookup(mo))
+    return res->second.get();
+  if (const auto res = AddressSpace::immortalObjects.lookup(mo))
+    return res->second.get();
+  return nullptr;
+}
+
+void AddressSpaceSnapshot::reclaim() {
+  AddressSpaceSnapshot **link = &head;
+  while (AddressSpaceSnapshot *s = *link) {
+    if (s->released.load(std::memory_order_acquire)) {
+      *link = s->next;
+      delete s;
+    } else {
+      link = &s->next;
+    }
+  }
 }
 
 ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
@@ -48,6 +153,7 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
   // Add a copy of this object state that can be updated
   ref<ObjectState> newObjectState(new ObjectState(*os));
   newObjectState->copyOnWriteOwner = cowKey;
+  unsharedBytes += mo->size;
   objects = objects.replace(std::make_pair(mo, newObjectState));
   return newObjectState.get();
 }
@@ -71,6 +177,19 @@ bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr,
     }
   }
 
+  // Constant globals live in the shared immortal map. An object this
+  // state rebound would have matched in the lookup above, so a hit here
+  // cannot be shadowed.
+  if (const auto res = immortalObjects.lookup_previous(&hack)) {
+    const auto &mo = res->first;
+    if ((mo->size == 0 && address == mo->address) ||
+        (address - mo->address < mo->size)) {
+      result.first = res->first;
+      result.second = res->second.get();
+      return true;
+    }
+  }
+
   return false;
 }
 
@@ -85,35 +204,112 @@ bool AddressSpace::resolveOne(ExecutionState &state,
   } else {
     TimerStatIncrementer timer(stats::resolveTime);
 
-    // try cheap search, will succeed for any inbounds pointer
-
     ref<ConstantExpr> cex;
     if (!solver->getValue(state.constraints, address, cex, state.queryMetaData))
       return false;
     uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-    const auto res = objects.lookup_previous(&hack);
-
-    if (res) {
-      const MemoryObject *mo = res->first;
-      if (example - mo->address < mo->size) {
-        result.first = res->first;
-        result.second = res->second.get();
-        success = true;
-        return true;
-      }
+
+    // Bound the search with a constraint-free range analysis of the
+    // address; candidates outside the range are rejected in one pass
+    // instead of with a solver query each.
+    ValueRange range = AddressRangeEvaluator().evaluate(address);
+
+    if (!resolveOneInMap(state, solver, address, example, range, objects,
+                         /*checkShadowed=*/false, result, success))
+      return false;
+    if (!success && !immortalObjects.empty() &&
+        !resolveOneInMap(state, solver, address, example, range,
+                         immortalObjects, /*checkShadowed=*/true, result,
+                         success))
+      return false;
+    return true;
+  }
+}
+
+bool AddressSpace::resolveOneInMap(ExecutionState &state, TimingSolver *solver,
+                                   ref<Expr> address, uint64_t example,
+                                   const ValueRange &range,
+                                   const MemoryMap &map, bool checkShadowed,
+                                   ObjectPair &result, bool &success) const {
+  // try cheap search, will succeed for any inbounds pointer
+
+  MemoryObject hack(example);
+  const auto res = map.lookup_previous(&hack);
+
+  if (res) {
+    const MemoryObject *mo = res->first;
+    if (example - mo->address < mo->size &&
+        !(checkShadowed && objects.lookup(mo))) {
+      result.first = res->first;
+      result.second = res->second.get();
+      success = true;
+      return true;
     }
+  }
 
-    // didn't work, now we have to search
-       
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-    while (oi!=begin) {
-      --oi;
-      const auto &mo = oi->first;
+  // didn't work, now we have to search
+
+  MemoryMap::iterator oi = map.upper_bound(&hack);
+  MemoryMap::iterator begin = map.begin();
+  MemoryMap::iterator end = map.end();
+
+  MemoryMap::iterator start = oi;
+  while (oi!=begin) {
+    --oi;
+    const auto &mo = oi->first;
+
+    if (objectOutsideRange(mo, range)) {
+      // Objects are disjoint, so once one ends below the range nothing
+      // before it can reach back up into it; only zero-sized objects
+      // may be interleaved.
+      if (mo->size)
+        break;
+      continue;
+    }
+
+    if (checkShadowed && objects.lookup(mo))
+      continue;
+
+    bool mayBeTrue;
+    if (!solver->mayBeTrue(state.constraints,
+                           mo->getBoundsCheckPointer(address), mayBeTrue,
+                           state.queryMetaData))
+      return false;
+    if (mayBeTrue) {
+      result.first = oi->first;
+      result.second = oi->second.get();
+      success = true;
+      return true;
+    } else {
+      bool mustBeTrue;
+      if (!solver->mustBeTrue(state.constraints,
+                              UgeExpr::create(address, mo->getBaseExpr()),
+                              mustBeTrue, state.queryMetaData))
+        return false;
+      if (mustBeTrue)
+        break;
+    }
+  }
+
+  // search forwards
+  for (oi=start; oi!=end; ++oi) {
+    const auto &mo = oi->first;
+
+    // Objects past the upper end of the range cannot match, and
+    // neither can anything after them.
+    if (mo->address > range.max())
+      break;
+
+    bool mustBeTrue;
+    if (!solver->mustBeTrue(state.constraints,
+                            UltExpr::create(address, mo->getBaseExpr()),
+                            mustBeTrue, state.queryMetaData))
+      return false;
+    if (mustBeTrue) {
+      break;
+    } else {
+      if (checkShadowed && objects.lookup(mo))
+        continue;
 
       bool mayBeTrue;
       if (!solver->mayBeTrue(state.constraints,
@@ -125,47 +321,12 @@ bool AddressSpace::resolveOne(ExecutionState &state,
         result.second = oi->second.get();
         success = true;
         return true;
-      } else {
-        bool mustBeTrue;
-        if (!solver->mustBeTrue(state.constraints,
-                                UgeExpr::create(address, mo->getBaseExpr()),
-                                mustBeTrue, state.queryMetaData))
-          return false;
-        if (mustBeTrue)
-          break;
-      }
-    }
-
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const auto &mo = oi->first;
-
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(address, mo->getBaseExpr()),
-                              mustBeTrue, state.queryMetaData))
-        return false;
-      if (mustBeTrue) {
-        break;
-      } else {
-        bool mayBeTrue;
-
-        if (!solver->mayBeTrue(state.constraints,
-                               mo->getBoundsCheckPointer(address), mayBeTrue,
-                               state.queryMetaData))
-          return false;
-        if (mayBeTrue) {
-          result.first = oi->first;
-          result.second = oi->second.get();
-          success = true;
-          return true;
-        }
       }
     }
-
-    success = false;
-    return true;
   }
+
+  success = false;
+  return true;
 }
 
 int AddressSpace::checkPointerInObject(ExecutionState &state,
@@ -234,61 +395,107 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     if (!solver->getValue(state.constraints, p, cex, state.queryMetaData))
       return true;
     uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-
-    MemoryMap::iterator start = oi;
-    // search backwards, start with one minus because this
-    // is the object that p *should* be within, which means we
-    // get write off the end with 4 queries
-    while (oi != begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
 
-      auto op = std::make_pair<>(mo, oi->second.get());
+    // Bound the search with a constraint-free range analysis of the
+    // address; candidates outside the range are rejected in one pass
+    // instead of with a solver query each.
+    ValueRange range = AddressRangeEvaluator().evaluate(p);
+
+    int res = resolveInMap(state, solver, p, example, range, objects,
+                           /*checkShadowed=*/false, rl, maxResolutions, timer,
+                           timeout);
+    if (res == 2 && !immortalObjects.empty())
+      res = resolveInMap(state, solver, p, example, range, immortalObjects,
+                         /*checkShadowed=*/true, rl, maxResolutions, timer,
+                         timeout);
+    return res == 1;
+  }
 
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
+  return false;
+}
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UgeExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
-        return true;
-      if (mustBeTrue)
+int AddressSpace::resolveInMap(ExecutionState &state, TimingSolver *solver,
+                               ref<Expr> p, uint64_t example,
+                               const ValueRange &range, const MemoryMap &map,
+                               bool checkShadowed, ResolutionList &rl,
+                               unsigned maxResolutions,
+                               const TimerStatIncrementer &timer,
+                               time::Span timeout) const {
+  MemoryObject hack(example);
+
+  MemoryMap::iterator oi = map.upper_bound(&hack);
+  MemoryMap::iterator begin = map.begin();
+  MemoryMap::iterator end = map.end();
+
+  MemoryMap::iterator start = oi;
+  // search backwards, start with one minus because this
+  // is the object that p *should* be within, which means we
+  // get write off the end with 4 queries
+  while (oi != begin) {
+    --oi;
+    const MemoryObject *mo = oi->first;
+    if (timeout && timeout < timer.delta())
+      return 1;
+
+    if (objectOutsideRange(mo, range)) {
+      // Objects are disjoint, so once one ends below the range nothing
+      // before it can reach back up into it; only zero-sized objects
+      // may be interleaved.
+      if (mo->size)
         break;
+      continue;
     }
 
-    // search forwards
-    for (oi = start; oi != end; ++oi) {
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
+    if (checkShadowed && objects.lookup(mo))
+      continue;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
-        return true;
-      if (mustBeTrue)
-        break;
-      auto op = std::make_pair<>(mo, oi->second.get());
+    auto op = std::make_pair<>(mo, oi->second.get());
 
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
-    }
+    int incomplete =
+        checkPointerInObject(state, solver, p, op, rl, maxResolutions);
+    if (incomplete != 2)
+      return incomplete;
+
+    bool mustBeTrue;
+    if (!solver->mustBeTrue(state.constraints,
+                            UgeExpr::create(p, mo->getBaseExpr()), mustBeTrue,
+                            state.queryMetaData))
+      return 1;
+    if (mustBeTrue)
+      break;
   }
 
-  return false;
+  // search forwards
+  for (oi = start; oi != end; ++oi) {
+    const MemoryObject *mo = oi->first;
+    if (timeout && timeout < timer.delta())
+      return 1;
+
+    // Objects past the upper end of the range cannot match, and
+    // neither can anything after them.
+    if (mo->address > range.max())
+      break;
+
+    bool mustBeTrue;
+    if (!solver->mustBeTrue(state.constraints,
+                            UltExpr::create(p, mo->getBaseExpr()), mustBeTrue,
+                            state.queryMetaData))
+      return 1;
+    if (mustBeTrue)
+      break;
+
+    if (checkShadowed && objects.lookup(mo))
+      continue;
+
+    auto op = std::make_pair<>(mo, oi->second.get());
+
+    int incomplete =
+        checkPointerInObject(state, solver, p, op, rl, maxResolutions);
+    if (incomplete != 2)
+      return incomplete;
+  }
+
+  return 2;
 }
 
 // These two are pretty big hack so we can sort of pass memory back
@@ -298,7 +505,7 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
 // then its concrete cache byte isn't being used) but is just a hack.
 
 void AddressSpace::copyOutConcretes() {
-  for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end();
        it != ie; ++it) {
     const MemoryObject *mo = it->first;
 
@@ -307,12 +514,29 @@ void AddressSpace::copyOutConcretes() {
       auto address = reinterpret_cast<std::uint8_t*>(mo->address);
 
       if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+        os->copyConcretesTo(address, mo->syncedPageVersions());
     }
   }
+
+  // The shared bindings are copied out once while initializeGlobals
+  // still has them writeable and are skipped as read-only afterwards.
+  // An object this state rebound is covered by the loop above instead.
+  for (const auto &obj : immortalObjects) {
+    const MemoryObject *mo = obj.first;
+    const auto &os = obj.second;
+
+    if (!os->readOnly && !objects.lookup(mo))
+      os->copyConcretesTo(reinterpret_cast<std::uint8_t *>(mo->address),
+                          mo->syncedPageVersions());
+  }
 }
 
 bool AddressSpace::copyInConcretes() {
+  bool success = true;
+
+  // Keep walking after a read-only violation so the sync records of the
+  // remaining objects stay consistent with the actual memory; the
+  // records are shared by all states through the MemoryObjects.
   for (auto &obj : objects) {
     const MemoryObject *mo = obj.first;
 
@@ -320,27 +544,49 @@ bool AddressSpace::copyInConcretes() {
       const auto &os = obj.second;
 
       if (!copyInConcrete(mo, os.get(), mo->address))
-        return false;
+        success = false;
     }
   }
 
-  return true;
+  // Shared constant globals are read-only, so copyInConcrete never
+  // writes them; it still detects an external call that modified their
+  // actual memory and reports the read-only violation.
+  for (const auto &obj : immortalObjects) {
+    const MemoryObject *mo = obj.first;
+
+    if (!objects.lookup(mo) && !copyInConcrete(mo, obj.second.get(),
+                                               mo->address))
+      success = false;
+  }
+
+  return success;
 }
 
 bool AddressSpace::copyInConcrete(const MemoryObject *mo, const ObjectState *os,
                                   uint64_t src_address) {
   auto address = reinterpret_cast<std::uint8_t*>(src_address);
-  if (memcmp(address, os->concreteStore, mo->size) != 0) {
+  if (!os->concretesEqual(address)) {
     if (os->readOnly) {
       return false;
     } else {
       ObjectState *wos = getWriteable(mo, os);
-      memcpy(wos->concreteStore, address, mo->size);
+      wos->copyConcretesFrom(address);
+      if (src_address == mo->address)
+        wos->markConcretesSynced(mo->syncedPageVersions());
     }
+  } else if (src_address == mo->address) {
+    // The memory was not modified by the external call; remember that it
+    // still matches the concrete store so the next copy-out can skip it.
+    os->markConcretesSynced(mo->syncedPageVersions());
   }
   return true;
 }
 
+void AddressSpace::invalidateConcreteSyncRecords() {
+  for (const auto &obj : objects)
+    obj.first->clearSyncedPageVersions();
+}
+
 /***/
 
 bool MemoryObjectLT::operator()(const MemoryObject *a, const MemoryObject *b) const {
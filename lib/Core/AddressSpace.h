@@ -16,11 +16,17 @@
 #include "klee/ADT/ImmutableMap.h"
 #include "klee/System/Time.h"
 
+#include <atomic>
+#include <cstdint>
+
 namespace klee {
+  class AddressSpaceSnapshot;
   class ExecutionState;
   class MemoryObject;
   class ObjectState;
+  class TimerStatIncrementer;
   class TimingSolver;
+  class ValueRange;
 
   template<class T> class ref;
 
@@ -54,6 +60,34 @@ namespace klee {
                              ref<Expr> p, const ObjectPair &op,
                              ResolutionList &rl, unsigned maxResolutions) const;
 
+    /// Search \p map for an object a symbolic \p address may point to,
+    /// scanning outwards from \p example and rejecting candidates
+    /// outside \p range without a solver query. With \p checkShadowed,
+    /// entries rebound in this state's own \ref objects map are skipped.
+    ///
+    /// \return false iff a solver query failed; \p success reports
+    /// whether an object was found.
+    bool resolveOneInMap(ExecutionState &state, TimingSolver *solver,
+                         ref<Expr> address, uint64_t example,
+                         const ValueRange &range, const MemoryMap &map,
+                         bool checkShadowed, ObjectPair &result,
+                         bool &success) const;
+
+    /// Collect into \p rl the objects in \p map a symbolic pointer \p p
+    /// may point to, scanning outwards from \p example as in \ref
+    /// resolveOneInMap.
+    ///
+    /// \return 0 iff the resolution completed (`p` can only point to an
+    /// object already in \p rl), 1 iff it is incomplete
+    /// (`maxResolutions` reached, timed out, or a query failed), and 2
+    /// iff the map was exhausted and other maps still need searching.
+    int resolveInMap(ExecutionState &state, TimingSolver *solver, ref<Expr> p,
+                     uint64_t example, const ValueRange &range,
+                     const MemoryMap &map, bool checkShadowed,
+                     ResolutionList &rl, unsigned maxResolutions,
+                     const TimerStatIncrementer &timer,
+                     time::Span timeout) const;
+
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
     /// address space.
@@ -64,8 +98,35 @@ namespace klee {
     /// \invariant forall o in objects, o->copyOnWriteOwner <= cowKey
     MemoryMap objects;
 
-    AddressSpace() : cowKey(1) {}
-    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
+    /// Bindings shared by every state: constant globals are bound here
+    /// once per module (-shared-constant-globals) instead of into each
+    /// state's \ref objects map, so they take no part in copy-on-write
+    /// bookkeeping or address space copies. Populated by
+    /// Executor::initializeGlobals before execution starts and
+    /// read-only afterwards. A state that rebinds one of these objects
+    /// (e.g. through klee_make_symbolic) shadows the shared binding
+    /// with its own.
+    static MemoryMap immortalObjects;
+
+    /// Bytes of ObjectState data owned solely by this address space,
+    /// i.e. allocated or unshared by copy-on-write since the last
+    /// fork. Used for per-state memory attribution; a fork makes all
+    /// objects shared again, so the counter resets on both sides.
+    mutable std::uint64_t unsharedBytes;
+
+    /// XOR of a mixed hash of every bound object's id, maintained
+    /// incrementally by bindObject/unbindObject. Equal binding sets
+    /// always produce equal digests, so a digest mismatch rejects a
+    /// merge candidate in O(1) where ExecutionState::merge would walk
+    /// both object maps to discover the incompatibility.
+    std::uint64_t bindingsDigest;
+
+    AddressSpace() : cowKey(1), unsharedBytes(0), bindingsDigest(0) {}
+    AddressSpace(const AddressSpace &b)
+        : cowKey(++b.cowKey), objects(b.objects), unsharedBytes(0),
+          bindingsDigest(b.bindingsDigest) {
+      b.unsharedBytes = 0;
+    }
     ~AddressSpace() {}
 
     /// Resolve address to an ObjectPair in result.
@@ -106,6 +167,16 @@ namespace klee {
     /// Add a binding to the address space.
     void bindObject(const MemoryObject *mo, ObjectState *os);
 
+    /// Add a binding to the shared immortal region. The object is never
+    /// owned by any state; writes must be rejected before ever asking
+    /// for a writeable version, which for constant globals the
+    /// read-only check in Executor::executeMemoryOperation guarantees.
+    static void bindImmortalObject(const MemoryObject *mo, ObjectState *os);
+
+    /// Drop all shared immortal bindings; must precede destruction of
+    /// the MemoryObjects they refer to.
+    static void clearImmortalObjects();
+
     /// Remove a binding from the address space.
     void unbindObject(const MemoryObject *mo);
 
@@ -125,7 +196,9 @@ namespace klee {
     ObjectState *getWriteable(const MemoryObject *mo, const ObjectState *os);
 
     /// Copy the concrete values of all managed ObjectStates into the
-    /// actual system memory location they were allocated at.
+    /// actual system memory location they were allocated at. Pages whose
+    /// contents already sit at that location (tracked via
+    /// MemoryObject::syncedPageVersions) are skipped.
     void copyOutConcretes();
 
     /// Copy the concrete values of all managed ObjectStates back from
@@ -146,6 +219,69 @@ namespace klee {
     /// @return
     bool copyInConcrete(const MemoryObject *mo, const ObjectState *os,
                         uint64_t src_address);
+
+    /// Forget which pages are in sync with the actual memory, forcing
+    /// the next copyOutConcretes to copy every object again. Used when
+    /// an external call fails and may have left the actual memory in an
+    /// unknown state.
+    void invalidateConcreteSyncRecords();
+
+    /// Take an O(1) immutable snapshot of this address space (\see
+    /// AddressSpaceSnapshot). Bumps the copy-on-write epoch, so every
+    /// later write in the owning state copies the object first and can
+    /// never mutate anything the snapshot sees.
+    AddressSpaceSnapshot *takeSnapshot() const;
+  };
+
+  /// A read-only view of an AddressSpace at the moment \ref
+  /// AddressSpace::takeSnapshot was called, for consumers that inspect
+  /// a state's memory while the interpreter advances it (async test
+  /// serialization, merge checks, parallel workers).
+  ///
+  /// Lifetime follows a deferred-reclamation protocol because the
+  /// reference counts in the underlying map are not atomic: snapshots
+  /// are created and freed only on the interpreter thread, and a reader
+  /// hands one back with \ref release() -- an atomic flag store, so the
+  /// interpreter never blocks on readers. The interpreter reclaims
+  /// released snapshots at scheduling boundaries (\see
+  /// AddressSpaceSnapshot::reclaim). Between creation and release any
+  /// thread may read through the snapshot, but must not copy refs out
+  /// of it.
+  class AddressSpaceSnapshot {
+    /// The frozen bindings; structurally shared with the live state.
+    MemoryMap objects;
+
+    /// Set by the reader when it is done with the snapshot.
+    std::atomic<bool> released{false};
+
+    /// Intrusive list of all live snapshots; interpreter thread only.
+    AddressSpaceSnapshot *next;
+    static AddressSpaceSnapshot *head;
+
+    explicit AddressSpaceSnapshot(const MemoryMap &objects);
+    ~AddressSpaceSnapshot() = default;
+
+    friend class AddressSpace;
+
+  public:
+    AddressSpaceSnapshot(const AddressSpaceSnapshot &) = delete;
+    AddressSpaceSnapshot &operator=(const AddressSpaceSnapshot &) = delete;
+
+    /// Lookup a binding, consulting the shared immortal region like
+    /// AddressSpace::findObject.
+    const ObjectState *findObject(const MemoryObject *mo) const;
+
+    /// The frozen MemoryObject -> ObjectState bindings.
+    const MemoryMap &map() const { return objects; }
+
+    /// Hand the snapshot back for reclamation; may be called from any
+    /// thread, after which the snapshot must no longer be read.
+    void release() { released.store(true, std::memory_order_release); }
+
+    /// Free all released snapshots. Must be called from the
+    /// interpreter thread at points where no reader is being handed a
+    /// new snapshot, e.g. scheduling boundaries.
+    static void reclaim();
   };
 } // End klee namespace
 
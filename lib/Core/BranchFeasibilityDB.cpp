@@ -0,0 +1,92 @@
+//===-- BranchFeasibilityDB.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchFeasibilityDB.h"
+
+#include "klee/Support/ErrorHandling.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+using namespace klee;
+
+BranchFeasibilityDB::BranchFeasibilityDB(const std::string &_path)
+    : path(_path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) // first run for this module
+    return;
+
+  char magic[8];
+  std::uint32_t count = 0;
+  bool ok = is.read(magic, sizeof(magic)) &&
+            memcmp(magic, "KLEEBFD1", sizeof(magic)) == 0 &&
+            is.read(reinterpret_cast<char *>(&count), sizeof(count));
+  for (std::uint32_t i = 0; ok && i != count; ++i) {
+    std::uint64_t key;
+    Outcomes outcomes;
+    ok = is.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
+         is.read(reinterpret_cast<char *>(&outcomes), sizeof(outcomes));
+    if (ok)
+      table.emplace(key, outcomes);
+  }
+  if (!ok) {
+    klee_warning("ignoring malformed branch feasibility database %s",
+                 path.c_str());
+    table.clear();
+    return;
+  }
+
+  klee_message("KLEE: using branch feasibility database %s (%zu branches)",
+               path.c_str(), table.size());
+}
+
+Solver::Validity BranchFeasibilityDB::predict(std::uint64_t key) const {
+  auto it = table.find(key);
+  if (it == table.end() || it->second.bothCount)
+    return Solver::Unknown;
+  const Outcomes &outcomes = it->second;
+  if (outcomes.trueCount && !outcomes.falseCount)
+    return Solver::True;
+  if (outcomes.falseCount && !outcomes.trueCount)
+    return Solver::False;
+  return Solver::Unknown;
+}
+
+void BranchFeasibilityDB::record(std::uint64_t key, Solver::Validity outcome) {
+  Outcomes &outcomes = table[key];
+  std::uint32_t &count = outcome == Solver::True    ? outcomes.trueCount
+                         : outcome == Solver::False ? outcomes.falseCount
+                                                    : outcomes.bothCount;
+  if (count != UINT32_MAX)
+    ++count;
+}
+
+void BranchFeasibilityDB::save() const {
+  std::string tmp = path + ".tmp." + std::to_string(getpid());
+  std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+  const char magic[8] = {'K', 'L', 'E', 'E', 'B', 'F', 'D', '1'};
+  std::uint32_t count = static_cast<std::uint32_t>(table.size());
+  os.write(magic, sizeof(magic));
+  os.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  for (const auto &entry : table) {
+    os.write(reinterpret_cast<const char *>(&entry.first),
+             sizeof(entry.first));
+    os.write(reinterpret_cast<const char *>(&entry.second),
+             sizeof(entry.second));
+  }
+  os.close();
+
+  if (os.fail() || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    klee_warning("unable to write branch feasibility database %s",
+                 path.c_str());
+    std::remove(tmp.c_str());
+  }
+}
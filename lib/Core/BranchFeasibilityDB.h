@@ -0,0 +1,65 @@
+//===-- BranchFeasibilityDB.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BRANCHFEASIBILITYDB_H
+#define KLEE_BRANCHFEASIBILITYDB_H
+
+#include "klee/Solver/Solver.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace klee {
+
+/// Persistent record of how branches have resolved in previous runs
+/// (-branch-feasibility-db). Keyed by instruction id and the structural
+/// hash of the branch condition, it counts the fork outcomes seen at
+/// each branch; Executor::fork uses a historically one-sided entry as a
+/// prediction to order its solver work. Predictions are always
+/// confirmed by the solver before being acted on, so a stale or
+/// colliding entry can cost an extra query but never soundness.
+class BranchFeasibilityDB {
+  struct Outcomes {
+    std::uint32_t trueCount = 0;
+    std::uint32_t falseCount = 0;
+    std::uint32_t bothCount = 0;
+  };
+
+  std::string path;
+  std::unordered_map<std::uint64_t, Outcomes> table;
+
+public:
+  /// Load the database at \p path. A missing file is an empty database,
+  /// a malformed one is ignored with a warning.
+  explicit BranchFeasibilityDB(const std::string &path);
+
+  static std::uint64_t makeKey(unsigned instructionId, unsigned shapeHash) {
+    return static_cast<std::uint64_t>(instructionId) *
+               UINT64_C(0x9e3779b97f4a7c15) +
+           shapeHash;
+  }
+
+  /// The historically unique outcome for \p key, or Solver::Unknown
+  /// when the branch is unrecorded or has ever been two-sided.
+  Solver::Validity predict(std::uint64_t key) const;
+
+  /// Count a solver-confirmed fork outcome (Solver::Unknown meaning
+  /// both sides were feasible).
+  void record(std::uint64_t key, Solver::Validity outcome);
+
+  /// Write the updated history back; like the coverage database, writes
+  /// go through a temporary and rename so that concurrent runs sharing
+  /// the database never observe a partial file.
+  void save() const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_BRANCHFEASIBILITYDB_H */
@@ -21,10 +21,18 @@ using namespace klee;
 
 ///
 
+std::size_t
+CallPathNode::ChildKeyHash::operator()(const ChildKey &k) const {
+  std::size_t h = std::hash<const llvm::Instruction *>()(k.callSite);
+  return h * 0x9e3779b97f4a7c15ULL +
+         std::hash<const llvm::Function *>()(k.function);
+}
+
 CallPathNode::CallPathNode(CallPathNode *_parent,
                            const llvm::Instruction *_callSite,
                            const llvm::Function *_function)
-    : parent(_parent), callSite(_callSite), function(_function), count(0) {}
+    : parent(_parent), callSite(_callSite), function(_function), id(0),
+      count(0) {}
 
 void CallPathNode::print() {
   llvm::errs() << "  (Function: " << this->function->getName() << ", "
@@ -67,6 +75,7 @@ CallPathNode *CallPathManager::computeCallPath(CallPathNode *parent,
 
   auto cp = std::unique_ptr<CallPathNode>(new CallPathNode(parent, cs, f));
   auto newCP = cp.get();
+  newCP->id = paths.size() + 1;
   paths.emplace_back(std::move(cp));
   return newCP;
 }
@@ -74,17 +83,24 @@ CallPathNode *CallPathManager::computeCallPath(CallPathNode *parent,
 CallPathNode *CallPathManager::getCallPath(CallPathNode *parent,
                                            const llvm::Instruction *cs,
                                            const llvm::Function *f) {
-  std::pair<const llvm::Instruction *, const llvm::Function *> key(cs, f);
   if (!parent)
     parent = &root;
 
+  // Fast path for the previous child taken through this node.
+  CallPathNode *last = parent->lastChild;
+  if (last && last->callSite == cs && last->function == f)
+    return last;
+
+  CallPathNode::ChildKey key{cs, f};
   auto it = parent->children.find(key);
-  if (it==parent->children.end()) {
-    auto cp = computeCallPath(parent, cs, f);
+  CallPathNode *cp;
+  if (it == parent->children.end()) {
+    cp = computeCallPath(parent, cs, f);
     parent->children.insert(std::make_pair(key, cp));
-    return cp;
   } else {
-    return it->second;
+    cp = it->second;
   }
+  parent->lastChild = cp;
+  return cp;
 }
 
@@ -14,6 +14,7 @@
 
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -39,10 +40,21 @@ namespace klee {
   class CallPathNode {
     friend class CallPathManager;
 
+    struct ChildKey {
+      const llvm::Instruction *callSite;
+      const llvm::Function *function;
+
+      bool operator==(const ChildKey &b) const {
+        return callSite == b.callSite && function == b.function;
+      }
+    };
+
+    struct ChildKeyHash {
+      std::size_t operator()(const ChildKey &k) const;
+    };
+
   public:
-    typedef std::map<
-        std::pair<const llvm::Instruction *, const llvm::Function *>,
-        CallPathNode *>
+    typedef std::unordered_map<ChildKey, CallPathNode *, ChildKeyHash>
         children_ty;
 
     // form list of (callSite,function) path
@@ -51,6 +63,17 @@ namespace klee {
     const llvm::Function *function;
     children_ty children;
 
+    /// Index of this path in the manager's flat path table; the root
+    /// (empty) path is 0. Stable for the life of the manager, so it can
+    /// stand in for the node in maps and serialized output.
+    unsigned id;
+
+    /// One-entry child cache: the child returned by the most recent
+    /// getCallPath() through this node. A function called repeatedly
+    /// from the same call site (the common case, e.g. in a loop) hits
+    /// here without touching the children map.
+    CallPathNode *lastChild = nullptr;
+
     StatisticRecord statistics;
     StatisticRecord summaryStatistics;
     unsigned count;
@@ -64,6 +87,9 @@ namespace klee {
 
   class CallPathManager {
     CallPathNode root;
+    /// All interned paths except the root, indexed by id - 1. Nodes are
+    /// allocated individually so CallPathNode pointers (held by stack
+    /// frames and the statistic manager's context) stay stable.
     std::vector<std::unique_ptr<CallPathNode>> paths;
 
   private:
@@ -16,6 +16,13 @@ namespace klee {
 namespace stats {
 
   extern Statistic allocations;
+
+  /// Completed searcher batches and the instructions executed inside
+  /// them; their ratio is the realized batch slice
+  /// (\see -use-adaptive-batching).
+  extern Statistic batches;
+  extern Statistic batchInstructions;
+
   extern Statistic resolveTime;
   extern Statistic instructions;
   extern Statistic instructionTime;
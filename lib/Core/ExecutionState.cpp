@@ -23,12 +23,14 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
 #include <cassert>
 #include <iomanip>
 #include <map>
 #include <set>
 #include <sstream>
 #include <stdarg.h>
+#include <unordered_map>
 
 using namespace llvm;
 using namespace klee;
@@ -40,32 +42,174 @@ cl::opt<bool> DebugLogStateMerge(
     cl::cat(MergeCat));
 }
 
+namespace klee {
+cl::opt<bool> UseBranchFactIndex(
+    "branch-fact-index", cl::init(true),
+    cl::desc("Decide fork conditions from directly-indexed range facts of the "
+             "state's constraints before querying the solver (default=true)"),
+    cl::cat(SolvingCat));
+}
+
 /***/
 
 std::uint32_t ExecutionState::nextID = 1;
 
 /***/
 
+namespace {
+/// Recycled locals arrays for stack frames, bucketed by register count.
+/// Calls, returns and forks allocate and release these at a very high
+/// rate, so freed arrays go back to a pool instead of the allocator,
+/// and arrays not served from the pool are carved from bump slabs, so
+/// no function entry ever pays for an individual malloc.
+/// thread_local so the parallel workers need no lock; an array may be
+/// released on a different thread than it was acquired on, which only
+/// shifts it between pools. Because of that shifting a freelist may
+/// point into another thread's slabs, so slabs are never freed;
+/// abandoning them at thread exit matches the B-tree node pools.
+///
+/// Every array is preceded by a reference count: forked states share
+/// the parent's locals and only copy them when a frame is written
+/// (\see StackFrame::ensureWritableLocals), so states that die
+/// unscheduled never pay for their registers.
+struct CellArrayPool {
+  struct Header {
+    std::atomic<unsigned> refCount;
+  };
+
+  /// Slab granularity; frames larger than this (thousands of
+  /// registers) get a dedicated carve of exactly their size.
+  static const std::size_t SlabSize = 64 * 1024;
+
+  std::unordered_map<unsigned, std::vector<Cell *>> buckets;
+  char *bump = nullptr;
+  char *bumpEnd = nullptr;
+
+  static Header *headerOf(Cell *locals) {
+    return reinterpret_cast<Header *>(reinterpret_cast<char *>(locals) -
+                                      headerSize());
+  }
+
+  static constexpr std::size_t headerSize() {
+    return alignof(Cell) *
+           ((sizeof(Header) + alignof(Cell) - 1) / alignof(Cell));
+  }
+
+  Cell *acquire(unsigned numRegisters) {
+    std::vector<Cell *> &bucket = buckets[numRegisters];
+    if (!bucket.empty()) {
+      Cell *locals = bucket.back();
+      bucket.pop_back();
+      headerOf(locals)->refCount.store(1, std::memory_order_relaxed);
+      return locals;
+    }
+    // sizeof(Cell) and headerSize() are multiples of alignof(Cell), so
+    // carving whole allocations keeps every array aligned.
+    std::size_t bytes = headerSize() + numRegisters * sizeof(Cell);
+    char *raw;
+    if (bytes > SlabSize) {
+      raw = static_cast<char *>(::operator new(bytes));
+    } else {
+      if (static_cast<std::size_t>(bumpEnd - bump) < bytes) {
+        bump = static_cast<char *>(::operator new(SlabSize));
+        bumpEnd = bump + SlabSize;
+      }
+      raw = bump;
+      bump += bytes;
+    }
+    new (raw) Header{{1}};
+    Cell *locals = reinterpret_cast<Cell *>(raw + headerSize());
+    for (unsigned i = 0; i != numRegisters; ++i)
+      new (&locals[i]) Cell();
+    return locals;
+  }
+
+  void retain(Cell *locals) {
+    headerOf(locals)->refCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool isShared(Cell *locals) {
+    return headerOf(locals)->refCount.load(std::memory_order_relaxed) > 1;
+  }
+
+  void release(Cell *locals, unsigned numRegisters) {
+    if (headerOf(locals)->refCount.fetch_sub(1, std::memory_order_acq_rel) !=
+        1)
+      return;
+    // Drop the expression references now, as deletion would; the array
+    // returns to the pool with every cell null, indistinguishable from
+    // a freshly constructed one.
+    for (unsigned i = 0; i != numRegisters; ++i)
+      locals[i].value = nullptr;
+    buckets[numRegisters].push_back(locals);
+  }
+
+  // No destructor: pooled cells hold no expression references (release
+  // nulls them) and the slabs backing them may be reachable from other
+  // threads' freelists, so teardown would be both pointless and unsafe.
+};
+
+thread_local CellArrayPool cellPool;
+} // namespace
+
 StackFrame::StackFrame(KInstIterator _caller, KFunction *_kf)
-  : caller(_caller), kf(_kf), callPathNode(0), 
+  : caller(_caller), kf(_kf), callPathNode(0),
     minDistToUncoveredOnReturn(0), varargs(0) {
-  locals = new Cell[kf->numRegisters];
+  locals = cellPool.acquire(kf->numRegisters);
 }
 
-StackFrame::StackFrame(const StackFrame &s) 
+StackFrame::StackFrame(const StackFrame &s)
   : caller(s.caller),
     kf(s.kf),
     callPathNode(s.callPathNode),
     allocas(s.allocas),
     minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
-    varargs(s.varargs) {
-  locals = new Cell[s.kf->numRegisters];
-  for (unsigned i=0; i<s.kf->numRegisters; i++)
-    locals[i] = s.locals[i];
+    varargs(s.varargs),
+    frameAllocas(s.frameAllocas),
+    summaryArgs(s.summaryArgs),
+    summaryConstraints(s.summaryConstraints),
+    costMeterStart(s.costMeterStart),
+    localsShared(true) {
+  // Share the registers copy-on-write: most forked states die without
+  // ever being scheduled, and the ones that run only pay for the
+  // frames they actually write.
+  locals = s.locals;
+  cellPool.retain(locals);
+  s.localsShared = true;
+}
+
+StackFrame::StackFrame(StackFrame &&s) noexcept
+  : caller(s.caller),
+    kf(s.kf),
+    callPathNode(s.callPathNode),
+    allocas(std::move(s.allocas)),
+    locals(s.locals),
+    minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
+    varargs(s.varargs),
+    frameAllocas(s.frameAllocas),
+    summaryArgs(std::move(s.summaryArgs)),
+    summaryConstraints(s.summaryConstraints),
+    costMeterStart(s.costMeterStart),
+    localsShared(s.localsShared) {
+  s.locals = nullptr;
 }
 
-StackFrame::~StackFrame() { 
-  delete[] locals; 
+StackFrame::~StackFrame() {
+  if (locals)
+    cellPool.release(locals, kf->numRegisters);
+}
+
+void StackFrame::ensureWritableLocals() {
+  if (!localsShared)
+    return;
+  if (cellPool.isShared(locals)) {
+    Cell *copy = cellPool.acquire(kf->numRegisters);
+    for (unsigned i = 0; i < kf->numRegisters; i++)
+      copy[i] = locals[i];
+    cellPool.release(locals, kf->numRegisters);
+    locals = copy;
+  }
+  localsShared = false;
 }
 
 /***/
@@ -76,7 +220,9 @@ ExecutionState::ExecutionState(KFunction *kf) :
     depth(0),
     ptreeNode(nullptr),
     steppedInstructions(0),
+    lastScheduledInstructions(0),
     instsSinceCovNew(0),
+    covPrevLoc(0),
     coveredNew(false),
     forkDisabled(false) {
   pushFrame(nullptr, kf);
@@ -101,15 +247,29 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     constraints(state.constraints),
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
+    branchHistory(state.branchHistory),
+    symBranchHistory(state.symBranchHistory),
     coveredLines(state.coveredLines),
     symbolics(state.symbolics),
     arrayNames(state.arrayNames),
+    concretizationCache(state.concretizationCache),
+    constraintFacts(state.constraintFacts),
+    forkWitness(state.forkWitness),
+    forkWitnessVersion(state.forkWitnessVersion),
     openMergeStack(state.openMergeStack),
     steppedInstructions(state.steppedInstructions),
+    lastScheduledInstructions(state.lastScheduledInstructions),
     instsSinceCovNew(state.instsSinceCovNew),
+    covPrevLoc(state.covPrevLoc),
     unwindingInformation(state.unwindingInformation
                              ? state.unwindingInformation->clone()
                              : nullptr),
+    rng(state.rng),
+    resumePrefixes(state.resumePrefixes),
+    resumePosition(state.resumePosition),
+    exprNodeEstimate(state.exprNodeEstimate),
+    exprNodeMitigationMark(state.exprNodeMitigationMark),
+    exprThrottled(state.exprThrottled),
     coveredNew(state.coveredNew),
     forkDisabled(state.forkDisabled) {
   for (const auto &cur_mergehandler: openMergeStack)
@@ -119,16 +279,62 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 ExecutionState *ExecutionState::branch() {
   depth++;
 
+  // The branched state starts with empty coverage, so move our covered
+  // lines aside during the copy instead of duplicating them just to
+  // clear them again.
+  decltype(coveredLines) savedCoveredLines;
+  std::swap(savedCoveredLines, coveredLines);
+
   auto *falseState = new ExecutionState(*this);
+
+  std::swap(savedCoveredLines, coveredLines);
+
   falseState->setID();
   falseState->coveredNew = false;
-  falseState->coveredLines.clear();
+  // give the branched state its own deterministic random stream
+  falseState->rng = rng.split(depth);
 
   return falseState;
 }
 
+std::uint64_t ExecutionState::approximateMemoryUsage() const {
+  // unshared object data dominates; registers and constraints are
+  // included so deep or constraint-heavy states are still charged a
+  // cost while all their objects remain shared
+  std::uint64_t bytes = addressSpace.unsharedBytes;
+  for (const auto &sf : stack)
+    bytes += sizeof(StackFrame) + sf.kf->numRegisters * sizeof(Cell);
+  bytes += constraints.size() * sizeof(Expr);
+  return bytes;
+}
+
+std::uint64_t ExecutionState::mergeKey() const {
+  std::uint64_t hash =
+      reinterpret_cast<std::uintptr_t>(static_cast<KInstruction *>(pc));
+  for (const auto &sf : stack) {
+    hash = hash * 0x9e3779b97f4a7c15ULL +
+           reinterpret_cast<std::uintptr_t>(
+               static_cast<KInstruction *>(sf.caller));
+    hash = hash * 0x9e3779b97f4a7c15ULL +
+           reinterpret_cast<std::uintptr_t>(sf.kf);
+  }
+  for (const auto &sym : symbolics) {
+    hash = hash * 0x9e3779b97f4a7c15ULL +
+           reinterpret_cast<std::uintptr_t>(sym.first.get());
+    hash = hash * 0x9e3779b97f4a7c15ULL +
+           reinterpret_cast<std::uintptr_t>(sym.second);
+  }
+  // The set of bound objects must agree for merge() to succeed at all,
+  // so fold the incrementally maintained binding digest in and keep
+  // states with differing heap shapes out of each other's candidate
+  // buckets without walking the object map. Contents stay out of the
+  // key: merge() reconciles differing contents with selects.
+  hash = hash * 0x9e3779b97f4a7c15ULL + addressSpace.bindingsDigest;
+  return hash;
+}
+
 void ExecutionState::pushFrame(KInstIterator caller, KFunction *kf) {
-  stack.emplace_back(StackFrame(caller, kf));
+  stack.emplace_back(caller, kf);
 }
 
 void ExecutionState::popFrame() {
@@ -184,6 +390,15 @@ bool ExecutionState::merge(const ExecutionState &b) {
       return false;
   }
 
+  // Equal binding sets always have equal digests, so a mismatch proves
+  // the heap shapes differ and rejects the candidate before the
+  // constraint-set arithmetic and the object walk below are paid for.
+  if (addressSpace.bindingsDigest != b.addressSpace.bindingsDigest) {
+    if (DebugLogStateMerge)
+      llvm::errs() << "\t\tbinding digests differ\n";
+    return false;
+  }
+
   std::set< ref<Expr> > aConstraints(constraints.begin(), constraints.end());
   std::set< ref<Expr> > bConstraints(b.constraints.begin(), 
                                      b.constraints.end());
@@ -281,6 +496,7 @@ bool ExecutionState::merge(const ExecutionState &b) {
   for (; itA!=stack.end(); ++itA, ++itB) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
+    af.ensureWritableLocals();
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
       ref<Expr> &av = af.locals[i].value;
       const ref<Expr> &bv = bf.locals[i].value;
@@ -303,7 +519,16 @@ bool ExecutionState::merge(const ExecutionState &b) {
     assert(otherOS);
 
     ObjectState *wos = addressSpace.getWriteable(mo, os);
+    bool pagewise = wos->isFullyConcrete() && otherOS->isFullyConcrete();
     for (unsigned i=0; i<mo->size; i++) {
+      // Fully concrete objects usually differ in only a few pages; a
+      // page carrying the same version stamp in both states holds
+      // identical bytes, so every select built from it would fold away.
+      if (pagewise && (i % ConcreteStorePage::Size) == 0 &&
+          wos->pageContentsEqual(*otherOS, i)) {
+        i += ConcreteStorePage::Size - 1;
+        continue;
+      }
       ref<Expr> av = wos->read8(i);
       ref<Expr> bv = otherOS->read8(i);
       wos->write(i, SelectExpr::create(inA, av, bv));
@@ -357,4 +582,185 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 void ExecutionState::addConstraint(ref<Expr> e) {
   ConstraintManager c(constraints);
   c.addConstraint(e);
+  if (UseBranchFactIndex)
+    indexConstraintFacts(e);
+}
+
+namespace {
+/// One comparison of a non-constant value against a constant, the only
+/// shape the fact index understands.
+struct FactPattern {
+  ref<Expr> value;
+  std::uint64_t constant;
+  Expr::Kind kind; // Expr::Ult, Expr::Ule or Expr::Eq
+  bool constOnLeft;
+  bool negated;
+};
+} // namespace
+
+static std::uint64_t maxOfWidth(Expr::Width w) {
+  return w >= 64 ? UINT64_MAX : ((1ULL << w) - 1);
+}
+
+static bool matchFactPattern(const ref<Expr> &e, FactPattern &p) {
+  ref<Expr> cond = e;
+  p.negated = false;
+  if (const EqExpr *eq = dyn_cast<EqExpr>(cond)) {
+    if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(eq->left)) {
+      if (ce->getWidth() == Expr::Bool && ce->isFalse()) {
+        cond = eq->right;
+        p.negated = true;
+      }
+    }
+  }
+
+  Expr::Kind k = cond->getKind();
+  if (k != Expr::Ult && k != Expr::Ule && k != Expr::Eq)
+    return false;
+
+  const BinaryExpr *be = cast<BinaryExpr>(cond);
+  const ConstantExpr *ce;
+  if ((ce = dyn_cast<ConstantExpr>(be->left.get()))) {
+    p.value = be->right;
+    p.constOnLeft = true;
+  } else if ((ce = dyn_cast<ConstantExpr>(be->right.get()))) {
+    p.value = be->left;
+    p.constOnLeft = false;
+  } else {
+    return false;
+  }
+
+  if (ce->getWidth() > 64 || ce->getWidth() == Expr::Bool ||
+      isa<ConstantExpr>(p.value))
+    return false;
+
+  p.constant = ce->getZExtValue();
+  p.kind = k;
+  return true;
+}
+
+void ExecutionState::indexConstraintFacts(const ref<Expr> &e) {
+  if (const AndExpr *ae = dyn_cast<AndExpr>(e)) {
+    indexConstraintFacts(ae->left);
+    indexConstraintFacts(ae->right);
+    return;
+  }
+
+  FactPattern p;
+  if (!matchFactPattern(e, p))
+    return;
+
+  // Derive the bound the comparison asserts on p.value; disequalities
+  // (negated Eq) do not narrow an interval and are not indexed.
+  std::uint64_t widthMax = maxOfWidth(p.value->getWidth());
+  std::uint64_t lo = 0, hi = widthMax;
+  switch (p.kind) {
+  case Expr::Eq:
+    if (p.negated)
+      return;
+    lo = hi = p.constant;
+    break;
+  case Expr::Ult:
+    if (p.constOnLeft) { // C < v, negated: v <= C
+      if (p.negated)
+        hi = p.constant;
+      else if (p.constant == widthMax)
+        return; // contradiction, leave it to the solver
+      else
+        lo = p.constant + 1;
+    } else { // v < C, negated: v >= C
+      if (p.negated)
+        lo = p.constant;
+      else if (p.constant == 0)
+        return;
+      else
+        hi = p.constant - 1;
+    }
+    break;
+  case Expr::Ule:
+    if (p.constOnLeft) { // C <= v, negated: v < C
+      if (!p.negated)
+        lo = p.constant;
+      else if (p.constant == 0)
+        return;
+      else
+        hi = p.constant - 1;
+    } else { // v <= C, negated: v > C
+      if (!p.negated)
+        hi = p.constant;
+      else if (p.constant == widthMax)
+        return;
+      else
+        lo = p.constant + 1;
+    }
+    break;
+  default:
+    return;
+  }
+
+  auto it = constraintFacts.find(p.value);
+  if (it == constraintFacts.end()) {
+    it = constraintFacts.emplace(p.value, ConstraintFact{0, widthMax}).first;
+  }
+  it->second.min = std::max(it->second.min, lo);
+  it->second.max = std::min(it->second.max, hi);
+}
+
+bool ExecutionState::decideByConstraintFacts(const ref<Expr> &e,
+                                             bool &result) const {
+  if (constraintFacts.empty())
+    return false;
+
+  FactPattern p;
+  if (!matchFactPattern(e, p))
+    return false;
+
+  auto it = constraintFacts.find(p.value);
+  if (it == constraintFacts.end())
+    return false;
+  const ConstraintFact &f = it->second;
+  if (f.min > f.max) // contradictory facts; the solver reports this
+    return false;
+
+  int truth = -1;
+  switch (p.kind) {
+  case Expr::Eq:
+    if (f.min == f.max && f.min == p.constant)
+      truth = 1;
+    else if (p.constant < f.min || p.constant > f.max)
+      truth = 0;
+    break;
+  case Expr::Ult:
+    if (p.constOnLeft) { // C < v
+      if (p.constant < f.min)
+        truth = 1;
+      else if (f.max <= p.constant)
+        truth = 0;
+    } else { // v < C
+      if (f.max < p.constant)
+        truth = 1;
+      else if (f.min >= p.constant)
+        truth = 0;
+    }
+    break;
+  case Expr::Ule:
+    if (p.constOnLeft) { // C <= v
+      if (p.constant <= f.min)
+        truth = 1;
+      else if (f.max < p.constant)
+        truth = 0;
+    } else { // v <= C
+      if (f.max <= p.constant)
+        truth = 1;
+      else if (f.min > p.constant)
+        truth = 0;
+    }
+    break;
+  default:
+    break;
+  }
+  if (truth < 0)
+    return false;
+  result = p.negated ? !truth : truth != 0;
+  return true;
 }
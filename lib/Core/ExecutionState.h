@@ -13,9 +13,11 @@
 #include "AddressSpace.h"
 #include "MergeHandler.h"
 
+#include "klee/ADT/RNG.h"
 #include "klee/ADT/TreeStream.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Module/KInstIterator.h"
 #include "klee/Solver/Solver.h"
 #include "klee/System/Time.h"
@@ -27,6 +29,7 @@
 
 namespace klee {
 class Array;
+class Assignment;
 class CallPathNode;
 struct Cell;
 struct KFunction;
@@ -37,6 +40,48 @@ struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
 
+/// @brief One recorded branch decision ('0' or '1') on the path to a
+/// state, linked to the decisions before it (-lazy-path-recording).
+///
+/// States share their common prefix structurally, so recording a fork
+/// costs one allocation per child instead of writes through the tree
+/// stream writers, and states that never produce output never
+/// materialize their path at all.
+struct BranchHistoryNode {
+  /// @brief Required by klee::ref-managed objects
+  class ReferenceCounter _refCount;
+
+  const ref<BranchHistoryNode> parent;
+  const unsigned char branch;
+
+  BranchHistoryNode(ref<BranchHistoryNode> parent, unsigned char branch)
+      : parent(std::move(parent)), branch(branch) {}
+
+  ~BranchHistoryNode() {
+    // Unlink the chain iteratively: paths can be millions of branches
+    // deep and recursive destruction through `parent` would overflow
+    // the stack.
+    ref<BranchHistoryNode> p =
+        std::move(const_cast<ref<BranchHistoryNode> &>(parent));
+    while (p && p->_refCount.getCount() == 1) {
+      ref<BranchHistoryNode> next =
+          std::move(const_cast<ref<BranchHistoryNode> &>(p->parent));
+      p = std::move(next);
+    }
+  }
+};
+
+/// Shared with Executor.cpp, which consults the fact index at forks.
+extern llvm::cl::opt<bool> UseBranchFactIndex;
+
+/// @brief Unsigned range [min, max] known for one expression from a
+/// state's constraints (-branch-fact-index), keyed by the compared
+/// expression in ExecutionState::constraintFacts.
+struct ConstraintFact {
+  std::uint64_t min;
+  std::uint64_t max;
+};
+
 struct StackFrame {
   KInstIterator caller;
   KFunction *kf;
@@ -59,9 +104,44 @@ struct StackFrame {
   // of intrinsic lowering.
   MemoryObject *varargs;
 
+  /// The per-frame region small entry-block allocas are carved from
+  /// (\see -frame-local-allocas), lazily created when the first such
+  /// alloca executes. Also listed in \ref allocas, which handles the
+  /// unbinding on return.
+  const MemoryObject *frameAllocas = nullptr;
+
+  /// When non-empty this frame is a candidate for summary memoization
+  /// (-use-function-summaries): the argument expressions of the call.
+  /// Cleared as soon as the call does anything that makes its result
+  /// depend on more than the arguments.
+  std::vector<ref<Expr>> summaryArgs;
+
+  /// Constraint-set size at call entry; a change while the frame is
+  /// live disqualifies it from memoization.
+  std::uint64_t summaryConstraints = 0;
+
+  /// With -native-leaf-calls, state.steppedInstructions when this
+  /// frame was pushed; the call's interpretation cost is attributed to
+  /// the KFunction on return. Zero while the function's verdict is
+  /// already cached (no measuring needed).
+  std::uint64_t costMeterStart = 0;
+
+  /// Whether \ref locals may still be shared with other forked states;
+  /// set on copy, cleared by ensureWritableLocals(). May be stale
+  /// (true while actually the sole owner), which only costs a
+  /// reference-count check on the next write.
+  mutable bool localsShared = false;
+
   StackFrame(KInstIterator caller, KFunction *kf);
   StackFrame(const StackFrame &s);
+  /// Moves steal the locals array instead of copying it, so pushing
+  /// frames and growing the stack vector never duplicate the registers.
+  StackFrame(StackFrame &&s) noexcept;
   ~StackFrame();
+
+  /// Copy the locals array if it is still shared with forked siblings;
+  /// must precede any register write.
+  void ensureWritableLocals();
 };
 
 /// Contains information related to unwinding (Itanium ABI/2-Phase unwinding)
@@ -195,6 +275,14 @@ public:
   /// taken to reach/create this state
   TreeOStream symPathOS;
 
+  /// @brief With -lazy-path-recording, the branch decisions otherwise
+  /// written through pathOS, shared structurally with the parent state
+  ref<BranchHistoryNode> branchHistory;
+
+  /// @brief As branchHistory, restricted to the symbolic branches
+  /// otherwise written through symPathOS
+  ref<BranchHistoryNode> symBranchHistory;
+
   /// @brief Set containing which lines in which files are covered by this state
   std::map<const std::string *, std::set<std::uint32_t>> coveredLines;
 
@@ -210,16 +298,51 @@ public:
   /// @brief Set of used array names for this state.  Used to avoid collisions.
   std::set<std::string> arrayNames;
 
+  /// @brief Concrete witnesses previously derived for expressions in this
+  /// state, mainly for external call arguments which are re-concretized
+  /// on every call. Entries survive constraint additions that cannot
+  /// affect them: Executor::addConstraint only drops entries whose
+  /// expression reads one of the new constraint's arrays.
+  ExprHashMap<ref<ConstantExpr>> concretizationCache;
+
+  /// @brief Range/equality facts directly implied by this state's
+  /// constraints (-branch-fact-index), keyed by the compared
+  /// expression. A middle tier between ConstraintManager::simplifyExpr
+  /// and the solver: a later condition over an indexed expression, like
+  /// (Ult x 100) under the fact (Ule x 10), is decided at fork time by
+  /// one map lookup instead of a query.
+  std::map<ref<Expr>, ConstraintFact> constraintFacts;
+
+  /// @brief Model of the constraint set as of forkWitnessVersion,
+  /// materialized at a fork and inherited by whichever child it keeps
+  /// satisfying; shared between siblings, never mutated. A fork whose
+  /// condition the witness decides needs only a one-sided solver query.
+  std::shared_ptr<Assignment> forkWitness;
+
+  /// @brief Version stamp of the constraint set under which forkWitness
+  /// is known to hold; any other stamp means the witness is stale.
+  std::uint64_t forkWitnessVersion = 0;
+
   /// @brief The objects handling the klee_open_merge calls this state ran through
   std::vector<ref<MergeHandler>> openMergeStack;
 
   /// @brief The numbers of times this state has run through Executor::stepInstruction
   std::uint64_t steppedInstructions;
 
+  /// @brief Value of the global instruction counter when the searcher
+  /// last scheduled this state; used to find cold states under memory
+  /// pressure
+  std::uint64_t lastScheduledInstructions;
+
   /// @brief Counts how many instructions were executed since the last new
   /// instruction was covered.
   std::uint32_t instsSinceCovNew;
 
+  /// @brief Previous location for the shared coverage bitmap
+  /// (-coverage-shm-file); AFL-style, shifted so that the edges A->B
+  /// and B->A map to different bitmap entries
+  std::uint32_t covPrevLoc;
+
   /// @brief Keep track of unwinding state while unwinding, otherwise empty
   std::unique_ptr<UnwindingInformation> unwindingInformation;
 
@@ -229,6 +352,35 @@ public:
   /// @brief the state id
   std::uint32_t id {0};
 
+  /// @brief Per-state random stream, split deterministically from the
+  /// parent's stream on every branch; random decisions local to this
+  /// state depend only on its fork path
+  SplittableRNG rng;
+
+  /// @brief Indices into the executor's set of checkpointed branch
+  /// paths that run through this state; empty unless resuming from a
+  /// checkpoint, and cleared once the state reaches its frontier
+  std::vector<std::uint32_t> resumePrefixes;
+
+  /// @brief Position of the next branch decision within the
+  /// checkpointed paths listed in \ref resumePrefixes
+  std::uint32_t resumePosition = 0;
+
+  /// @brief Bounded estimate of the expression nodes reachable from
+  /// this state's constraints; maintained by Executor::addConstraint
+  /// when -expr-node-watermark is set
+  std::uint64_t exprNodeEstimate = 0;
+
+  /// @brief Estimate at which growth mitigation runs next; raised after
+  /// each run so it does not trigger on every constraint once the state
+  /// lives above the watermark
+  std::uint64_t exprNodeMitigationMark = 0;
+
+  /// @brief Set once the estimate stays above
+  /// -expr-node-hard-watermark despite mitigation; weighted searchers
+  /// schedule such states last
+  bool exprThrottled = false;
+
   /// @brief Whether a new instruction was covered in this state
   bool coveredNew;
 
@@ -260,9 +412,28 @@ public:
 
   void addConstraint(ref<Expr> e);
 
+  /// Record any simple range/equality facts of \p e in constraintFacts.
+  void indexConstraintFacts(const ref<Expr> &e);
+
+  /// Try to decide \p e from constraintFacts alone. Returns true and
+  /// sets \p result when the indexed facts imply the condition either
+  /// way; returns false when they do not settle it.
+  bool decideByConstraintFacts(const ref<Expr> &e, bool &result) const;
+
   bool merge(const ExecutionState &b);
   void dumpStack(llvm::raw_ostream &out) const;
 
+  /// @brief Approximate number of bytes attributable to this state
+  /// alone: object data unshared since the last fork, stack registers
+  /// and constraints
+  std::uint64_t approximateMemoryUsage() const;
+
+  /// @brief Structural fingerprint of the parts \ref merge requires to
+  /// be identical (program counter, stack shape, symbolics); states
+  /// with differing keys can never merge, equal keys still need the
+  /// full compatibility check
+  std::uint64_t mergeKey() const;
+
   std::uint32_t getID() const { return id; };
   void setID() { id = nextID++; };
 };
@@ -9,6 +9,7 @@
 
 #include "Executor.h"
 
+#include "BranchFeasibilityDB.h"
 #include "Context.h"
 #include "CoreStats.h"
 #include "ExecutionState.h"
@@ -18,15 +19,19 @@
 #include "Memory.h"
 #include "MemoryManager.h"
 #include "PTree.h"
+#include "SearchProfile.h"
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
 #include "StatsTracker.h"
+#include "SubsumptionChecker.h"
 #include "TimingSolver.h"
 #include "UserSearcher.h"
 
 #include "klee/ADT/KTest.h"
 #include "klee/ADT/RNG.h"
+#include "klee/ADT/Ref.h"
+#include "klee/ADT/WorkStealingQueue.h"
 #include "klee/Config/Version.h"
 #include "klee/Core/Interpreter.h"
 #include "klee/Expr/ArrayExprOptimizer.h"
@@ -49,6 +54,8 @@
 #include "klee/Support/FloatEvaluation.h"
 #include "klee/Support/ModuleUtil.h"
 #include "klee/Support/OptionCategories.h"
+#include "klee/Support/PhaseProfiler.h"
+#include "klee/Support/Tracepoints.h"
 #include "klee/System/MemoryUsage.h"
 #include "klee/System/Time.h"
 
@@ -56,6 +63,7 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/Attributes.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #if LLVM_VERSION_CODE < LLVM_VERSION(8, 0)
 #include "llvm/IR/CallSite.h"
 #endif
@@ -82,15 +90,26 @@ typedef unsigned TypeSize;
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <cxxabi.h>
+#include <fcntl.h>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iosfwd>
 #include <limits>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
 #include <sys/mman.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 using namespace llvm;
@@ -121,6 +140,48 @@ cl::opt<std::string> MaxTime(
              "Set to 0s to disable (default=0s)"),
     cl::init("0s"),
     cl::cat(TerminationCat));
+
+cl::opt<unsigned> ParallelWorkers(
+    "parallel-workers", cl::init(1),
+    cl::desc("Number of worker threads used to execute states. Each worker "
+             "owns a work-stealing deque of states and a private solver "
+             "chain. Interpretation is serialized by a global lock that is "
+             "released around solver queries, so speedups come from "
+             "overlapping solving across states (experimental, default=1)"),
+    cl::cat(ParallelCat));
+
+cl::opt<bool> ForkQueryPrefetch(
+    "fork-query-prefetch", cl::init(false),
+    cl::desc("When a state pauses before a symbolic conditional branch, "
+             "evaluate its feasibility query on a background solver thread "
+             "so the answer overlaps interpretation of other states "
+             "(experimental, default=false)"),
+    cl::cat(ParallelCat));
+
+cl::opt<unsigned> ForkQueryPrefetchLookahead(
+    "fork-query-prefetch-lookahead", cl::init(4),
+    cl::desc("With -fork-query-prefetch, also prefetch the fork queries of "
+             "up to this many states the searcher expects to schedule next, "
+             "so their answers are ready by the time they run (default=4)"),
+    cl::cat(ParallelCat));
+
+cl::opt<bool> NumaAwareWorkers(
+    "numa-aware-workers", cl::init(false),
+    cl::desc("Pin each worker thread to one NUMA node (read from sysfs) and "
+             "prefer same-node victims when stealing states. State memory "
+             "is served from thread-local pools, so pinned workers allocate "
+             "it node-locally by first touch and states only cross nodes "
+             "when a node's queues run dry (default=false)"),
+    cl::cat(ParallelCat));
+
+cl::opt<unsigned> ForkQueryPrefetchBlockLookahead(
+    "fork-query-prefetch-block-lookahead", cl::init(8),
+    cl::desc("With -fork-query-prefetch, walk up to this many upcoming basic "
+             "blocks of a paused state and speculatively solve the "
+             "feasibility of conditional branches whose condition is already "
+             "computed; the queries run only while the background solver is "
+             "otherwise idle (default=8)"),
+    cl::cat(ParallelCat));
 } // namespace klee
 
 namespace {
@@ -133,18 +194,51 @@ cl::opt<bool> DumpStatesOnHalt(
     cl::desc("Dump test cases for all active states on exit (default=true)"),
     cl::cat(TestGenCat));
 
+/*** Checkpointing options ***/
+
+cl::opt<std::string> CheckpointDir(
+    "checkpoint-dir",
+    cl::desc("Periodically write the branch paths of all live states into "
+             "this directory, replacing the previous checkpoint; a stopped "
+             "run can be continued with -resume (requires -write-paths)"),
+    cl::value_desc("directory"),
+    cl::cat(TerminationCat));
+
+cl::opt<std::string> CheckpointInterval(
+    "checkpoint-interval",
+    cl::desc("Time between checkpoints (default=5min)"),
+    cl::init("5min"),
+    cl::cat(TerminationCat));
+
 cl::opt<bool> OnlyOutputStatesCoveringNew(
     "only-output-states-covering-new",
     cl::init(false),
     cl::desc("Only output test cases covering new code (default=false)"),
     cl::cat(TestGenCat));
 
+cl::opt<bool> LazyPathRecording(
+    "lazy-path-recording", cl::init(false),
+    cl::desc("Record branch decisions in in-memory prefixes shared between "
+             "states and only write a linear path stream for states that "
+             "actually produce output, instead of writing through the path "
+             "writers on every fork. Mainly useful together with "
+             "-only-output-states-covering-new (default=false)"),
+    cl::cat(TestGenCat));
+
 cl::opt<bool> EmitAllErrors(
     "emit-all-errors", cl::init(false),
     cl::desc("Generate tests cases for all errors "
              "(default=false, i.e. one per (error,instruction) pair)"),
     cl::cat(TestGenCat));
 
+cl::opt<unsigned> MaxErrorReportsPerClass(
+    "max-error-reports-per-class", cl::init(1),
+    cl::desc("Materialize test cases and diagnostics for at most this many "
+             "errors of the same (location, error type, call stack) class; "
+             "further instances are only counted and summarized at exit. "
+             "Ignored with -emit-all-errors (default=1)"),
+    cl::cat(TestGenCat));
+
 
 /* Constraint solving options */
 
@@ -156,6 +250,59 @@ cl::opt<unsigned> MaxSymArraySize(
     cl::init(0),
     cl::cat(SolvingCat));
 
+cl::opt<unsigned> MaxForkingResolutions(
+    "max-forking-resolutions",
+    cl::desc(
+        "If a symbolic pointer resolves to more than this many objects, "
+        "merge the access into one expression guarded by the bounds checks "
+        "of the candidates instead of forking one state per object.  Set to "
+        "0 to always fork (default=0)"),
+    cl::init(0),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> ArrayGCInterval(
+    "array-gc-interval",
+    cl::desc("Reclaim array objects that no expression references anymore "
+             "every time this many states have terminated.  Set to 0 to "
+             "never reclaim arrays (default=4096)"),
+    cl::init(4096),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> ExprNodeWatermark(
+    "expr-node-watermark",
+    cl::desc("Estimated live expression nodes per state above which growth "
+             "mitigation runs: the registers of the top frame are "
+             "re-simplified against the constraints and large "
+             "constraint-determined values are folded to constants.  Set to "
+             "0 to disable (default=0)"),
+    cl::init(0),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> ExprNodeHardWatermark(
+    "expr-node-hard-watermark",
+    cl::desc("Estimated live expression nodes per state above which, when "
+             "mitigation does not get the state back under, it is marked "
+             "throttled and weighted searchers schedule it last.  Set to 0 "
+             "to disable (default=0)"),
+    cl::init(0),
+    cl::cat(SolvingCat));
+
+cl::opt<std::string> BranchFeasibilityDBDir(
+    "branch-feasibility-db", cl::init(""),
+    cl::desc("Directory of per-module branch feasibility databases keyed by "
+             "bitcode hash. Fork outcomes from earlier runs of the same "
+             "bitcode predict branches that have only ever gone one way; "
+             "those get a short speculative query before the full validity "
+             "check, and the updated history is written back on exit "
+             "(default=off)"),
+    cl::cat(SolvingCat));
+
+cl::opt<std::string> BranchFeasibilitySpeculativeTimeout(
+    "branch-feasibility-speculative-timeout", cl::init("1s"),
+    cl::desc("Timeout for the speculative one-sided query tried at branches "
+             "the feasibility database predicts (default=1s)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool>
     SimplifySymIndices("simplify-sym-indices",
                        cl::init(false),
@@ -169,6 +316,113 @@ cl::opt<bool>
                                   "querying the solver (default=true)"),
                          cl::cat(SolvingCat));
 
+cl::opt<bool> JITConcreteBlocks(
+    "jit-concrete-blocks", cl::init(false),
+    cl::desc("Execute basic blocks of pure integer computation natively "
+             "when all their inputs are concrete, instead of interpreting "
+             "them instruction by instruction (experimental, "
+             "default=false)"),
+    cl::cat(MiscCat));
+
+cl::opt<bool> ForkWitnessSharing(
+    "fork-witness-sharing", cl::init(true),
+    cl::desc("Attach the last model materialized for a state's constraint "
+             "set to the state and let forked children inherit it; a fork "
+             "whose condition the witness decides needs only a one-sided "
+             "query for the other branch (default=true)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> FastForwardStartup(
+    "fast-forward-startup", cl::init(true),
+    cl::desc("Interpret the deterministic single-state startup prefix "
+             "(argv/env layout, option parsing over concrete strings) in a "
+             "lean loop without searcher, timer and memory-pressure "
+             "bookkeeping, until the first fork or termination "
+             "(default=true)"),
+    cl::cat(MiscCat));
+
+cl::opt<std::string> UseSearchProfile(
+    "search-profile", cl::init(""),
+    cl::desc("Bias random-path searchers with the branch productivity "
+             "profile written by a previous run with -write-search-profile, "
+             "pointing early exploration at historically productive regions "
+             "(default=off)"),
+    cl::cat(MiscCat));
+
+cl::opt<bool> WriteSearchProfile(
+    "write-search-profile", cl::init(false),
+    cl::desc("Write per-branch subtree productivity statistics to "
+             "<output-dir>/search.profile at shutdown, for later warm starts "
+             "with -search-profile (default=false)"),
+    cl::cat(MiscCat));
+
+cl::opt<std::string> CoverageShmFile(
+    "coverage-shm-file", cl::init(""),
+    cl::desc("Map the given file (e.g. under /dev/shm) as an AFL-style "
+             "64KiB edge-coverage bitmap updated on every branch, so "
+             "external processes can observe coverage in real time "
+             "(default=off)"),
+    cl::cat(MiscCat));
+
+/// Size of the -coverage-shm-file bitmap; matches AFL's MAP_SIZE.
+const std::uint32_t CoverageBitmapSize = 1 << 16;
+
+cl::opt<unsigned> PhaseProfileFreq(
+    "phase-profile", cl::init(0),
+    cl::desc("Sample which semantic phase (dispatch, fork, solver, "
+             "searcher, stats) the process is in at the given frequency "
+             "in Hz and write profile.speedscope.json to the output "
+             "directory on exit (0=disabled)"),
+    cl::cat(MiscCat));
+
+cl::opt<bool> SummarizeLoops(
+    "summarize-loops", cl::init(false),
+    cl::desc("Replace recognized counting loops by closed-form updates "
+             "of their induction variable and accumulators instead of "
+             "unrolling them iteration by iteration (default=false)"),
+    cl::cat(MiscCat));
+
+cl::opt<bool> UseFunctionSummaries(
+    "use-function-summaries", cl::init(false),
+    cl::desc("Memoize (arguments -> return value) summaries of "
+             "side-effect-free leaf functions and substitute them on "
+             "repeated calls with the same argument expressions "
+             "(default=false)"),
+    cl::cat(MiscCat));
+
+/// Cap on the number of memoized function summaries.
+const size_t MaxFunctionSummaries = 1 << 18;
+
+cl::opt<unsigned> NativeLeafCalls(
+    "native-leaf-calls", cl::init(0),
+    cl::desc("Call side-effect-free leaf functions natively instead of "
+             "interpreting them once their measured interpretation cost "
+             "exceeds this many instructions per call, provided all "
+             "arguments are concrete and the symbol resolves in the host "
+             "process (0=never, default=0)"),
+    cl::cat(MiscCat));
+
+/// Interpreted calls of a leaf function to measure before deciding
+/// whether -native-leaf-calls should call it natively.
+const std::uint64_t NativeLeafWarmupCalls = 8;
+
+cl::opt<bool> FrameLocalAllocas(
+    "frame-local-allocas", cl::init(false),
+    cl::desc("Carve small fixed-size entry-block allocas out of a single "
+             "per-frame memory object with offsets precomputed at module "
+             "build time, instead of one address-space entry per alloca. "
+             "Out-of-bounds accesses are then only detected against the "
+             "frame region, not the individual alloca (default=false)"),
+    cl::cat(MiscCat));
+
+cl::opt<bool> SharedConstantGlobals(
+    "shared-constant-globals", cl::init(true),
+    cl::desc("Bind constant globals into one immortal region shared by "
+             "all states instead of into every state's address space; "
+             "writes to them still fault as read-only memory errors "
+             "(default=true)"),
+    cl::cat(MiscCat));
+
 
 /*** External call policy options ***/
 
@@ -331,6 +585,35 @@ cl::opt<bool> MaxMemoryInhibit(
     cl::init(true),
     cl::cat(TerminationCat));
 
+cl::opt<unsigned> CompressColdPages(
+    "compress-cold-pages",
+    cl::desc("Compress concrete object pages untouched for this many memory "
+             "check rounds (one round per 65536 instructions) and inflate "
+             "them again on access.  Trades CPU on cold data for heap room "
+             "before states have to be shed.  Set to 0 to disable "
+             "(default=0)"),
+    cl::init(0),
+    cl::cat(TerminationCat));
+
+cl::opt<unsigned> StateReclamationBatch(
+    "state-reclamation-batch",
+    cl::desc("Defer freeing terminated states and free at most this many per "
+             "scheduling step, bounding the pause of mass terminations "
+             "(memory-pressure kills, max-depth culls). The backlog is "
+             "drained completely before memory-cap decisions. Set to 0 to "
+             "free states immediately (default=0)"),
+    cl::init(0),
+    cl::cat(TerminationCat));
+
+cl::opt<bool> SwapColdStates(
+    "swap-cold-states",
+    cl::desc("When over the memory cap, write the branch paths of the least "
+             "recently scheduled states into <output-dir>/swapped before "
+             "terminating them, so the shed work can be continued with "
+             "-resume (requires -write-paths) (default=false)"),
+    cl::init(false),
+    cl::cat(TerminationCat));
+
 cl::opt<unsigned> RuntimeMaxStackFrames(
     "max-stack-frames",
     cl::desc("Terminate a state after this many stack frames.  Set to 0 to "
@@ -430,6 +713,21 @@ cl::opt<bool> DebugCheckForImpliedValues(
     cl::desc("Debug the implied value optimization"),
     cl::cat(DebugCat));
 
+cl::opt<bool> UseImpliedValueConcretization(
+    "use-implied-value-concretization", cl::init(false),
+    cl::desc("On each added constraint, write concrete bytes it implies "
+             "back into the objects they were read from, so subsequent "
+             "reads stay concrete (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> CanonicalizeConstraintsWatermark(
+    "canonicalize-constraints-watermark", cl::init(0),
+    cl::desc("Re-canonicalize a state's constraints each time this many have "
+             "accumulated, so equivalent constraints built in different fold "
+             "orders share structure and hit the solver caches (0=off, "
+             "default=0)"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
 // XXX hack
@@ -462,10 +760,18 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
     : Interpreter(opts), interpreterHandler(ih), searcher(0),
       externalDispatcher(new ExternalDispatcher(ctx)), statsTracker(0),
       pathWriter(0), symPathWriter(0), specialFunctionHandler(0), timers{time::Span(TimerInterval)},
-      replayKTest(0), replayPath(0), usingSeeds(0),
+      replayKTest(0), replayPath(0), replayPathIsPrefix(false),
+      swappedStates(0), usingSeeds(0),
       atMemoryLimit(false), inhibitForking(false), haltExecution(false),
-      ivcEnabled(false), debugLogBuffer(debugBufferString) {
+      ivcEnabled(UseImpliedValueConcretization),
+      debugLogBuffer(debugBufferString) {
 
+  // The parallel modes move ref graphs (stolen states, queued fork
+  // queries) to threads other than the one that created them, which
+  // the biased reference counting fast path cannot balance; fall back
+  // to plain atomic counts before any such object exists.
+  if (ParallelWorkers > 1 || ForkQueryPrefetch)
+    ReferenceCounter::disableBias();
 
   const time::Span maxTime{MaxTime};
   if (maxTime) timers.add(
@@ -474,6 +780,14 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
         setHaltExecution(true);
       }));
 
+  if (!CheckpointDir.empty()) {
+    const time::Span checkpointInterval{CheckpointInterval};
+    if (!checkpointInterval)
+      klee_error("-checkpoint-interval must be non-zero");
+    timers.add(std::make_unique<Timer>(checkpointInterval,
+                                       [&] { writeCheckpoint(); }));
+  }
+
   coreSolverTimeout = time::Span{MaxCoreSolverTime};
   if (coreSolverTimeout) UseForkedCoreSolver = true;
   Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
@@ -486,13 +800,39 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(SOLVER_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(ALL_QUERIES_KQUERY_FILE_NAME),
-      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME));
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(ALL_QUERIES_BINARY_FILE_NAME),
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_BINARY_FILE_NAME));
 
   this->solver = new TimingSolver(solver, EqualitySubstitution);
+  if (UseSubsumption)
+    subsumptionChecker = std::make_unique<SubsumptionChecker>(this->solver);
   memory = new MemoryManager(&arrayCache);
 
+  if (!CoverageShmFile.empty()) {
+    int fd = open(CoverageShmFile.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, CoverageBitmapSize) < 0)
+      klee_error("unable to open coverage bitmap file %s: %s",
+                 CoverageShmFile.c_str(), strerror(errno));
+    void *map = mmap(nullptr, CoverageBitmapSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      klee_error("unable to map coverage bitmap file %s: %s",
+                 CoverageShmFile.c_str(), strerror(errno));
+    coverageBitmap = static_cast<unsigned char *>(map);
+  }
+
+  if (PhaseProfileFreq)
+    profiler::start(PhaseProfileFreq);
+
   initializeSearchOptions();
 
+  if (!UseSearchProfile.empty())
+    priorSearchProfile = SearchProfile::fromFile(UseSearchProfile);
+  if (WriteSearchProfile)
+    searchProfile = std::make_unique<SearchProfile>();
+
   if (OnlyOutputStatesCoveringNew && !StatsTracker::useIStats())
     klee_error("To use --only-output-states-covering-new, you need to enable --output-istats.");
 
@@ -539,10 +879,16 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
     klee_error("Could not load KLEE intrinsic file %s", LibPath.c_str());
   }
 
-  // 1.) Link the modules together
-  while (kmodule->link(modules, opts.EntryPoint)) {
-    // 2.) Apply different instrumentation
-    kmodule->instrument(opts);
+  // A fully prepared module from a previous run over the same inputs
+  // can replace the link/instrument/optimise stages entirely.
+  bool usingCachedModule = kmodule->loadCachedModule(modules, opts);
+
+  if (!usingCachedModule) {
+    // 1.) Link the modules together
+    while (kmodule->link(modules, opts.EntryPoint)) {
+      // 2.) Apply different instrumentation
+      kmodule->instrument(opts);
+    }
   }
 
   // 3.) Optimise and prepare for KLEE
@@ -560,8 +906,11 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
   preservedFunctions.push_back("memcmp");
   preservedFunctions.push_back("memmove");
 
-  kmodule->optimiseAndPrepare(opts, preservedFunctions);
-  kmodule->checkModule();
+  if (!usingCachedModule) {
+    kmodule->optimiseAndPrepare(opts, preservedFunctions);
+    kmodule->checkModule();
+    kmodule->cachePreparedModule();
+  }
 
   // 4.) Manifest the module
   kmodule->manifest(interpreterHandler, StatsTracker::useStatistics());
@@ -569,12 +918,27 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
   specialFunctionHandler->bind();
 
   if (StatsTracker::useStatistics() || userSearcherRequiresMD2U()) {
-    statsTracker = 
+    statsTracker =
       new StatsTracker(*this,
                        interpreterHandler->getOutputFilename("assembly.ll"),
                        userSearcherRequiresMD2U());
   }
 
+  if (!BranchFeasibilityDBDir.empty()) {
+    if (std::error_code ec =
+            llvm::sys::fs::create_directories(BranchFeasibilityDBDir))
+      klee_error(
+          "unable to create branch feasibility database directory %s: %s",
+          BranchFeasibilityDBDir.c_str(), ec.message().c_str());
+    SmallString<128> path(BranchFeasibilityDBDir);
+    llvm::sys::path::append(path, kmodule->getModuleHash() + ".bfd");
+    branchFeasibilityDB.reset(new BranchFeasibilityDB(std::string(path.str())));
+    branchFeasibilitySpeculativeTimeout =
+        time::Span(BranchFeasibilitySpeculativeTimeout);
+    if (!branchFeasibilitySpeculativeTimeout)
+      klee_error("-branch-feasibility-speculative-timeout: invalid interval");
+  }
+
   // Initialize the context.
   DataLayout *TD = kmodule->targetData.get();
   Context::initialize(TD->isLittleEndian(),
@@ -584,6 +948,25 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
 }
 
 Executor::~Executor() {
+  for (const auto &errorClass : errorClassCounts)
+    if (errorClass.second.first > MaxErrorReportsPerClass)
+      klee_message("NOTE: suppressed %u further instances of error: %s",
+                   errorClass.second.first - MaxErrorReportsPerClass,
+                   errorClass.second.second.c_str());
+  if (branchFeasibilityDB)
+    branchFeasibilityDB->save();
+  if (PhaseProfileFreq) {
+    profiler::stop();
+    std::string error;
+    if (!profiler::writeSpeedscope(
+            interpreterHandler->getOutputFilename("profile.speedscope.json"),
+            error))
+      klee_warning("unable to write phase profile: %s", error.c_str());
+  }
+  stopForkQueryPrefetchThread();
+  if (coverageBitmap)
+    munmap(coverageBitmap, CoverageBitmapSize);
+  reclaimTerminatedStates(deferredReclamation.size());
   delete memory;
   delete externalDispatcher;
   delete specialFunctionHandler;
@@ -830,7 +1213,17 @@ void Executor::initializeGlobalObjects(ExecutionState &state) {
   std::vector<ObjectState *> constantObjects;
   for (const GlobalVariable &v : m->globals()) {
     MemoryObject *mo = globalObjects.find(&v)->second;
-    ObjectState *os = bindObjectInState(state, mo, false);
+
+    // Constant globals never change, so every state can read the same
+    // binding: keep them out of the per-state map (and its copy-on-write
+    // bookkeeping) and bind them once in the shared immortal region.
+    ObjectState *os;
+    if (SharedConstantGlobals && v.isConstant() && v.hasInitializer()) {
+      os = new ObjectState(mo);
+      AddressSpace::bindImmortalObject(mo, os);
+    } else {
+      os = bindObjectInState(state, mo, false);
+    }
 
     if (v.isDeclaration() && mo->size) {
       // Program already running -> object already initialized.
@@ -898,7 +1291,7 @@ void Executor::branch(ExecutionState &state,
   assert(N);
 
   if (!branchingPermitted(state)) {
-    unsigned next = theRNG.getInt32() % N;
+    unsigned next = state.rng.getInt32() % N;
     for (unsigned i=0; i<N; ++i) {
       if (i == next) {
         result.push_back(&state);
@@ -912,7 +1305,7 @@ void Executor::branch(ExecutionState &state,
     // XXX do proper balance or keep random?
     result.push_back(&state);
     for (unsigned i=1; i<N; ++i) {
-      ExecutionState *es = result[theRNG.getInt32() % i];
+      ExecutionState *es = result[state.rng.getInt32() % i];
       ExecutionState *ns = es->branch();
       addedStates.push_back(ns);
       result.push_back(ns);
@@ -924,10 +1317,13 @@ void Executor::branch(ExecutionState &state,
   // states if necessary due to OnlyReplaySeeds (inefficient but
   // simple).
   
-  std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it = 
+  std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it =
     seedMap.find(&state);
   if (it != seedMap.end()) {
-    std::vector<SeedInfo> seeds = it->second;
+    // Seeds are partitioned, never duplicated, across the successors,
+    // so move them: a SeedInfo carries a full Assignment and deep
+    // copies would make every fork scale with the corpus size.
+    std::vector<SeedInfo> seeds = std::move(it->second);
     seedMap.erase(it);
 
     // Assume each seed only satisfies one condition (necessarily true
@@ -950,11 +1346,11 @@ void Executor::branch(ExecutionState &state,
       // If we didn't find a satisfying condition randomly pick one
       // (the seed will be patched).
       if (i==N)
-        i = theRNG.getInt32() % N;
+        i = state.rng.getInt32() % N;
 
       // Extra check in case we're replaying seeds with a max-fork
       if (result[i])
-        seedMap[result[i]].push_back(*siit);
+        seedMap[result[i]].push_back(std::move(*siit));
     }
 
     if (OnlyReplaySeeds) {
@@ -1028,22 +1424,189 @@ ref<Expr> Executor::maxStaticPctChecks(ExecutionState &current,
   return condition;
 }
 
-Executor::StatePair 
+std::size_t Executor::FunctionSummaryKeyHash::operator()(
+    const FunctionSummaryKey &k) const {
+  std::size_t hash = reinterpret_cast<std::uintptr_t>(k.kf);
+  for (const auto &arg : k.args)
+    hash = hash * 0x9e3779b97f4a7c15ULL + arg->hash();
+  return hash;
+}
+
+void Executor::openAutoMergeRegion(ExecutionState &state) {
+  if (!UseAutoMerge || !mergingSearcher)
+    return;
+
+  llvm::Instruction *mp =
+      state.stack.back().kf->getMergePoint(state.prevPC->inst->getParent());
+  if (!mp)
+    return;
+
+  // states forked off this one inherit the region through the copy
+  // constructor, which registers them with the handler
+  state.openMergeStack.push_back(
+      ref<MergeHandler>(new MergeHandler(this, &state, mp)));
+}
+
+Executor::StatePair
 Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
+  profiler::ScopedPhase phase(profiler::Fork);
+
+  // a branch on anything symbolic makes the outcome of the enclosing
+  // call depend on the path condition, not just its arguments
+  if (UseFunctionSummaries && !isa<ConstantExpr>(condition))
+    current.stack.back().summaryArgs.clear();
+
   Solver::Validity res;
   std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it = 
     seedMap.find(&current);
   bool isSeeding = it != seedMap.end();
 
+  // Concolic scouting: evaluate the condition under the seeds before
+  // consulting the solver. Seeds satisfy the path constraints (they are
+  // patched on every addConstraint), so when they all decide the
+  // condition the same way that side is a known-feasible witness.
+  bool seedsAgree = false, seedsTrue = false;
+  if (isSeeding) {
+    bool allTrue = true, allFalse = true, allConstant = true;
+    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
+           siie = it->second.end(); siit != siie; ++siit) {
+      ref<Expr> res = siit->assignment.evaluate(condition);
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(res)) {
+        if (CE->isTrue())
+          allFalse = false;
+        else
+          allTrue = false;
+      } else {
+        allConstant = false;
+        break;
+      }
+      if (!allTrue && !allFalse)
+        break;
+    }
+    seedsAgree = allConstant && (allTrue || allFalse);
+    seedsTrue = allTrue;
+  }
+
+  // When we are just replaying seeds the witness already answers the only
+  // question we have: follow it without the solver. We fall through when
+  // a seed leaves the condition symbolic or the seeds disagree.
+  if (seedsAgree && (current.forkDisabled || OnlyReplaySeeds)) {
+    addConstraint(current,
+                  seedsTrue ? condition : Expr::createIsZero(condition));
+    if (!isInternal) {
+      if (LazyPathRecording || WriteLocationIndex)
+        current.branchHistory =
+            new BranchHistoryNode(current.branchHistory, seedsTrue ? '1' : '0');
+      if (pathWriter && !LazyPathRecording)
+        current.pathOS << (seedsTrue ? "1" : "0");
+    }
+    return seedsTrue ? StatePair(&current, 0) : StatePair(0, &current);
+  }
+
   if (!isSeeding)
     condition = maxStaticPctChecks(current, condition);
 
+  // Consult the persistent fork history (-branch-feasibility-db): a
+  // branch that has only ever gone one way is predicted to do so again,
+  // and the side history says is infeasible gets a cheap speculative
+  // query first below.
+  // A still-valid witness -- a model of the current constraint set kept
+  // from an earlier fork of this lineage -- decides its own side of the
+  // branch outright; unlike the feasibility DB below this is a proof,
+  // not a prediction.
+  int witnessSide = -1; // 1/0 when the witness decides the condition
+  if (ForkWitnessSharing && !isSeeding && current.forkWitness &&
+      current.forkWitnessVersion == current.constraints.version() &&
+      !isa<ConstantExpr>(condition)) {
+    ref<Expr> wv = current.forkWitness->evaluate(condition);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(wv))
+      witnessSide = CE->isTrue() ? 1 : 0;
+  }
+
+  std::uint64_t branchKey = 0;
+  Solver::Validity predicted = Solver::Unknown;
+  bool recordOutcome = false;
+  if (branchFeasibilityDB && !isSeeding && !isa<ConstantExpr>(condition)) {
+    branchKey = BranchFeasibilityDB::makeKey(current.prevPC->info->id,
+                                             queryShapeHash(condition.get()));
+    predicted = branchFeasibilityDB->predict(branchKey);
+    recordOutcome = true;
+  }
+
   time::Span timeout = coreSolverTimeout;
   if (isSeeding)
     timeout *= static_cast<unsigned>(it->second.size());
   solver->setTimeout(timeout);
-  bool success = solver->evaluate(current.constraints, condition, res,
-                                  current.queryMetaData);
+  bool success;
+  bool factTruth = false;
+  if (UseBranchFactIndex && !isSeeding && !isa<ConstantExpr>(condition) &&
+      current.decideByConstraintFacts(condition, factTruth)) {
+    // Directly-indexed range facts of the constraint set prove the
+    // condition's validity outright -- cheaper than the witness and
+    // feasibility-DB tiers below, which still issue one-sided queries.
+    res = factTruth ? Solver::True : Solver::False;
+    success = true;
+  } else if (!consumePrefetchedForkQuery(current, condition, res, success)) {
+    if (seedsAgree) {
+      // With forking enabled (the zesti-style seeded mode) the witness
+      // still halves the work: its side is feasible by construction, so
+      // only the other side needs a query to decide between following
+      // the seeds and forking off a flipped neighborhood.
+      bool mayBeOther = false;
+      success = seedsTrue
+                    ? solver->mayBeFalse(current.constraints, condition,
+                                         mayBeOther, current.queryMetaData)
+                    : solver->mayBeTrue(current.constraints, condition,
+                                        mayBeOther, current.queryMetaData);
+      if (success)
+        res = mayBeOther ? Solver::Unknown
+                         : (seedsTrue ? Solver::True : Solver::False);
+    } else {
+      bool speculated = false;
+      if (witnessSide != -1) {
+        // The witness proves its side satisfiable; only the other side
+        // needs a query.
+        bool mayBeOther = false;
+        success = witnessSide
+                      ? solver->mayBeFalse(current.constraints, condition,
+                                           mayBeOther, current.queryMetaData)
+                      : solver->mayBeTrue(current.constraints, condition,
+                                          mayBeOther, current.queryMetaData);
+        if (success) {
+          res = mayBeOther ? Solver::Unknown
+                           : (witnessSide ? Solver::True : Solver::False);
+          speculated = true;
+        }
+      }
+      if (!speculated && predicted != Solver::Unknown) {
+        // A confirmed prediction decides the branch with one short
+        // one-sided query instead of a full validity check; a miss
+        // (disconfirmed or timed out) falls back and has cost at most
+        // the speculative timeout.
+        time::Span specTimeout = branchFeasibilitySpeculativeTimeout;
+        if (timeout && timeout < specTimeout)
+          specTimeout = timeout;
+        solver->setTimeout(specTimeout);
+        bool mayBeOther = true;
+        bool confirmed =
+            (predicted == Solver::True
+                 ? solver->mayBeFalse(current.constraints, condition,
+                                      mayBeOther, current.queryMetaData)
+                 : solver->mayBeTrue(current.constraints, condition,
+                                     mayBeOther, current.queryMetaData)) &&
+            !mayBeOther;
+        solver->setTimeout(timeout);
+        if (confirmed) {
+          res = predicted;
+          success = true;
+          speculated = true;
+        }
+      }
+      if (!speculated)
+        success = solver->evaluate(current.constraints, condition, res,
+                                   current.queryMetaData);
+    }
+  }
   solver->setTimeout(time::Span());
   if (!success) {
     current.pc = current.prevPC;
@@ -1051,8 +1614,75 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     return StatePair(0, 0);
   }
 
+  if (recordOutcome)
+    branchFeasibilityDB->record(branchKey, res);
+
+  // When both sides are feasible and no valid witness was inherited,
+  // materialize a model of the parent set -- just shown satisfiable, so
+  // usually a counterexample-cache hit -- and let it follow whichever
+  // child it satisfies below.
+  if (ForkWitnessSharing && !isSeeding && res == Solver::Unknown &&
+      witnessSide == -1 && !current.symbolics.empty()) {
+    std::vector<const Array *> objects;
+    objects.reserve(current.symbolics.size());
+    for (const auto &sym : current.symbolics)
+      objects.push_back(sym.second);
+    std::vector<std::vector<unsigned char>> values;
+    solver->setTimeout(timeout);
+    if (solver->getInitialValues(current.constraints, objects, values,
+                                 current.queryMetaData)) {
+      current.forkWitness = std::make_shared<Assignment>(objects, values);
+      current.forkWitnessVersion = current.constraints.version();
+      ref<Expr> wv = current.forkWitness->evaluate(condition);
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(wv))
+        witnessSide = CE->isTrue() ? 1 : 0;
+    }
+    solver->setTimeout(time::Span());
+  }
+
+  // When resuming from a checkpoint, partition the checkpointed paths
+  // running through this state by their next branch decision.
+  bool forkForResume = false;
+  std::vector<std::uint32_t> resumeTrues, resumeFalses;
+  if (!isSeeding && !isInternal && !current.resumePrefixes.empty()) {
+    for (const auto idx : current.resumePrefixes) {
+      const auto &path = resumePaths[idx];
+      if (current.resumePosition < path.size())
+        (path[current.resumePosition] ? resumeTrues : resumeFalses)
+            .push_back(idx);
+    }
+    if (resumeTrues.empty() && resumeFalses.empty()) {
+      // all paths end here: this is a frontier state, explore freely
+      current.resumePrefixes.clear();
+    } else {
+      ++current.resumePosition;
+      if (!resumeTrues.empty() && !resumeFalses.empty() &&
+          res == Solver::Unknown) {
+        // the checkpointed states diverged here; recreate both children
+        forkForResume = true;
+      } else if (res == Solver::Unknown) {
+        // one-sided: follow the recorded decision
+        const bool branch = resumeFalses.empty();
+        addConstraint(current,
+                      branch ? condition : Expr::createIsZero(condition));
+        res = branch ? Solver::True : Solver::False;
+        current.resumePrefixes = std::move(branch ? resumeTrues : resumeFalses);
+      } else {
+        // the condition is already decided; paths recorded with the
+        // other outcome cannot be reconstructed (nondeterminism)
+        auto &taken = res == Solver::True ? resumeTrues : resumeFalses;
+        auto &diverged = res == Solver::True ? resumeFalses : resumeTrues;
+        if (!diverged.empty())
+          klee_warning("resume: dropping %u diverged checkpoint path(s)",
+                       static_cast<unsigned>(diverged.size()));
+        current.resumePrefixes = std::move(taken);
+      }
+    }
+  }
+
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
+    if (replayPath && !isInternal &&
+        (!replayPathIsPrefix || replayPosition < replayPath->size())) {
       assert(replayPosition<replayPath->size() &&
              "ran out of branches in replay path mode");
       bool branch = (*replayPath)[replayPosition++];
@@ -1073,10 +1703,10 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
     } else if (res==Solver::Unknown) {
       assert(!replayKTest && "in replay mode, only one branch can be true.");
-      
-      if (!branchingPermitted(current)) {
+
+      if (!forkForResume && !branchingPermitted(current)) {
         TimerStatIncrementer timer(stats::forkTime);
-        if (theRNG.getBool()) {
+        if (current.rng.getBool()) {
           addConstraint(current, condition);
           res = Solver::True;        
         } else {
@@ -1127,18 +1757,29 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   // hint to just use the single constraint instead of all the binary
   // search ones. If that makes sense.
   if (res==Solver::True) {
+    // Keep the witness live when this side was forced by an added
+    // constraint (replay, exhausted branching budget): it satisfies the
+    // constraint by construction.
+    if (witnessSide == 1)
+      current.forkWitnessVersion = current.constraints.version();
     if (!isInternal) {
-      if (pathWriter) {
+      if (LazyPathRecording || WriteLocationIndex)
+        current.branchHistory =
+            new BranchHistoryNode(current.branchHistory, '1');
+      if (pathWriter && !LazyPathRecording)
         current.pathOS << "1";
-      }
     }
 
     return StatePair(&current, 0);
   } else if (res==Solver::False) {
+    if (witnessSide == 0)
+      current.forkWitnessVersion = current.constraints.version();
     if (!isInternal) {
-      if (pathWriter) {
+      if (LazyPathRecording || WriteLocationIndex)
+        current.branchHistory =
+            new BranchHistoryNode(current.branchHistory, '0');
+      if (pathWriter && !LazyPathRecording)
         current.pathOS << "0";
-      }
     }
 
     return StatePair(0, &current);
@@ -1147,16 +1788,21 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     ExecutionState *falseState, *trueState = &current;
 
     ++stats::forks;
+    KLEE_TRACE2(state_fork, current.getID(), states.size());
 
+    if (!isInternal)
+      openAutoMergeRegion(current);
     falseState = trueState->branch();
     addedStates.push_back(falseState);
 
     if (it != seedMap.end()) {
-      std::vector<SeedInfo> seeds = it->second;
+      // As above: each seed lands on exactly one side, so move instead
+      // of deep-copying the assignments.
+      std::vector<SeedInfo> seeds = std::move(it->second);
       it->second.clear();
       std::vector<SeedInfo> &trueSeeds = seedMap[trueState];
       std::vector<SeedInfo> &falseSeeds = seedMap[falseState];
-      for (std::vector<SeedInfo>::iterator siit = seeds.begin(), 
+      for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
              siie = seeds.end(); siit != siie; ++siit) {
         ref<ConstantExpr> res;
         bool success = solver->getValue(current.constraints,
@@ -1165,9 +1811,9 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
         assert(success && "FIXME: Unhandled solver failure");
         (void) success;
         if (res->isTrue()) {
-          trueSeeds.push_back(*siit);
+          trueSeeds.push_back(std::move(*siit));
         } else {
-          falseSeeds.push_back(*siit);
+          falseSeeds.push_back(std::move(*siit));
         }
       }
       
@@ -1188,9 +1834,16 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
 
     processTree->attach(current.ptreeNode, falseState, trueState);
 
-    if (pathWriter) {
-      // Need to update the pathOS.id field of falseState, otherwise the same id
-      // is used for both falseState and trueState.
+    if (!isInternal && (LazyPathRecording || WriteLocationIndex)) {
+      // Both children extend the shared prefix; no writer bookkeeping.
+      falseState->branchHistory =
+          new BranchHistoryNode(trueState->branchHistory, '0');
+      trueState->branchHistory =
+          new BranchHistoryNode(trueState->branchHistory, '1');
+    }
+    if (pathWriter && !LazyPathRecording) {
+      // Need to update the pathOS.id field of falseState, otherwise the same
+      // id is used for both falseState and trueState.
       falseState->pathOS = pathWriter->open(current.pathOS);
       if (!isInternal) {
         trueState->pathOS << "1";
@@ -1198,16 +1851,38 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
     }
     if (symPathWriter) {
-      falseState->symPathOS = symPathWriter->open(current.symPathOS);
-      if (!isInternal) {
-        trueState->symPathOS << "1";
-        falseState->symPathOS << "0";
+      if (LazyPathRecording) {
+        if (!isInternal) {
+          falseState->symBranchHistory =
+              new BranchHistoryNode(trueState->symBranchHistory, '0');
+          trueState->symBranchHistory =
+              new BranchHistoryNode(trueState->symBranchHistory, '1');
+        }
+      } else {
+        falseState->symPathOS = symPathWriter->open(current.symPathOS);
+        if (!isInternal) {
+          trueState->symPathOS << "1";
+          falseState->symPathOS << "0";
+        }
       }
     }
 
+    if (forkForResume) {
+      // hand each child its side of the checkpointed paths
+      trueState->resumePrefixes = std::move(resumeTrues);
+      falseState->resumePrefixes = std::move(resumeFalses);
+    }
+
     addConstraint(*trueState, condition);
     addConstraint(*falseState, Expr::createIsZero(condition));
 
+    // The witness satisfies exactly one side's new constraint; restamp
+    // it so it stays live down that child.
+    if (witnessSide == 1)
+      trueState->forkWitnessVersion = trueState->constraints.version();
+    else if (witnessSide == 0)
+      falseState->forkWitnessVersion = falseState->constraints.version();
+
     // Kinda gross, do we even really still want this option?
     if (MaxDepth && MaxDepth<=trueState->depth) {
       terminateStateEarly(*trueState, "max-depth exceeded.");
@@ -1245,16 +1920,139 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
       }
     }
     if (warn)
-      klee_warning("seeds patched for violating constraint"); 
+      klee_warning("seeds patched for violating constraint");
+  }
+
+  // Cached concretization witnesses stay valid unless the new
+  // constraint talks about one of their arrays; prune only those.
+  if (!state.concretizationCache.empty()) {
+    std::vector<const Array *> arrays;
+    findSymbolicObjects(condition, arrays);
+    std::set<const Array *> constrained(arrays.begin(), arrays.end());
+    for (auto cit = state.concretizationCache.begin(),
+              cie = state.concretizationCache.end();
+         cit != cie;) {
+      std::vector<const Array *> entryArrays;
+      findSymbolicObjects(cit->first, entryArrays);
+      bool affected = false;
+      for (const Array *array : entryArrays)
+        if (constrained.count(array)) {
+          affected = true;
+          break;
+        }
+      cit = affected ? state.concretizationCache.erase(cit) : std::next(cit);
+    }
   }
 
   state.addConstraint(condition);
   if (ivcEnabled)
-    doImpliedValueConcretization(state, condition, 
+    doImpliedValueConcretization(state, condition,
                                  ConstantExpr::alloc(1, Expr::Bool));
+
+  if (ExprNodeWatermark)
+    accountExpressionGrowth(state, condition);
+
+  if (CanonicalizeConstraintsWatermark &&
+      state.constraints.size() % CanonicalizeConstraintsWatermark == 0) {
+    // Batch pass: rewrite the whole set into canonical form so states
+    // that accumulated equivalent constraints along different paths
+    // present identical queries to the caches.
+    ConstraintSet canonical;
+    ConstraintManager cm(canonical);
+    for (const ref<Expr> &constraint : state.constraints) {
+      ref<Expr> e = exprCanonicalizer.canonicalize(constraint);
+      // Folding to a constant means the constraint was vacuous or the
+      // set already inconsistent; keep the original rather than lose
+      // it (or assert adding false).
+      cm.addConstraint(isa<ConstantExpr>(e) ? constraint : e);
+    }
+    state.constraints = canonical;
+  }
+}
+
+// Bounded count of the distinct nodes in an expression DAG, stopping at
+// \p cap: past the watermark the exact number no longer matters, and a
+// pathological DAG is precisely where an exhaustive walk would hurt.
+// Update lists are not followed; growth is dominated by the expression
+// graph proper.
+static std::uint64_t countExprNodes(const ref<Expr> &e, ExprHashSet &visited,
+                                    std::uint64_t cap) {
+  std::vector<ref<Expr>> stack;
+  std::uint64_t count = 0;
+  if (visited.insert(e).second)
+    stack.push_back(e);
+  while (!stack.empty() && count < cap) {
+    ref<Expr> cur = stack.back();
+    stack.pop_back();
+    ++count;
+    for (unsigned i = 0, n = cur->getNumKids(); i != n; ++i) {
+      ref<Expr> kid = cur->getKid(i);
+      if (visited.insert(kid).second)
+        stack.push_back(kid);
+    }
+  }
+  return count;
+}
+
+void Executor::accountExpressionGrowth(ExecutionState &state,
+                                       const ref<Expr> &condition) {
+  ExprHashSet visited;
+  state.exprNodeEstimate +=
+      countExprNodes(condition, visited, ExprNodeWatermark);
+  if (state.exprNodeEstimate <
+      std::max<std::uint64_t>(ExprNodeWatermark, state.exprNodeMitigationMark))
+    return;
+  mitigateExpressionGrowth(state);
+}
+
+void Executor::mitigateExpressionGrowth(ExecutionState &state) {
+  // The registers of the top frame are the subtrees new constraints keep
+  // getting built from; re-simplify them against the accumulated
+  // constraints and fold the large constraint-determined ones to
+  // constants, stopping compounding growth at its source. Folding via
+  // toUnique never restricts the state.
+  static const std::uint64_t FoldThreshold = 256;
+  StackFrame &sf = state.stack.back();
+  for (unsigned i = 0; i < sf.kf->numRegisters; ++i) {
+    ref<Expr> &value = sf.locals[i].value;
+    if (value.isNull() || isa<ConstantExpr>(value))
+      continue;
+    ref<Expr> simplified =
+        ConstraintManager::simplifyExpr(state.constraints, value);
+    if (!isa<ConstantExpr>(simplified)) {
+      ExprHashSet regVisited;
+      if (countExprNodes(simplified, regVisited, FoldThreshold) >=
+          FoldThreshold)
+        simplified = toUnique(state, simplified);
+    }
+    if (simplified != value)
+      value = simplified;
+  }
+
+  // Re-measure against the constraints (the long-lived part of the
+  // state) and move the next trigger up so mitigation does not run for
+  // every constraint while a state lives above the watermark.
+  std::uint64_t cap = 2 * std::max<std::uint64_t>(ExprNodeWatermark,
+                                                  ExprNodeHardWatermark);
+  ExprHashSet visited;
+  std::uint64_t total = 0;
+  for (const auto &constraint : state.constraints) {
+    total += countExprNodes(constraint, visited, cap - total);
+    if (total >= cap)
+      break;
+  }
+  state.exprNodeEstimate = total;
+  state.exprNodeMitigationMark = total + ExprNodeWatermark / 2 + 1;
+
+  if (ExprNodeHardWatermark && !state.exprThrottled &&
+      state.exprNodeEstimate >= ExprNodeHardWatermark) {
+    state.exprThrottled = true;
+    klee_warning_once(&state, "expression growth passed the hard watermark; "
+                              "deprioritizing state");
+  }
 }
 
-const Cell& Executor::eval(KInstruction *ki, unsigned index, 
+const Cell& Executor::eval(KInstruction *ki, unsigned index,
                            ExecutionState &state) const {
   assert(index < ki->inst->getNumOperands());
   int vnumber = ki->operands[index];
@@ -1307,10 +2105,30 @@ ref<Expr> Executor::toUnique(const ExecutionState &state,
 }
 
 
-/* Concretize the given expression, and return a possible constant value. 
+bool Executor::getValueConcretization(ExecutionState &state, ref<Expr> e,
+                                      ref<ConstantExpr> &result) {
+  ExprHashMap<ref<ConstantExpr>>::iterator it =
+      state.concretizationCache.find(e);
+  if (it != state.concretizationCache.end()) {
+    result = it->second;
+    return true;
+  }
+
+  if (!solver->getValue(state.constraints, e, result, state.queryMetaData))
+    return false;
+
+  // Bound the cache; external-call-heavy states hit a small working set
+  // long before this.
+  if (state.concretizationCache.size() > 1024)
+    state.concretizationCache.clear();
+  state.concretizationCache.insert(std::make_pair(e, result));
+  return true;
+}
+
+/* Concretize the given expression, and return a possible constant value.
    'reason' is just a documentation string stating the reason for concretization. */
-ref<klee::ConstantExpr> 
-Executor::toConstant(ExecutionState &state, 
+ref<klee::ConstantExpr>
+Executor::toConstant(ExecutionState &state,
                      ref<Expr> e,
                      const char *reason) {
   e = ConstraintManager::simplifyExpr(state.constraints, e);
@@ -1318,8 +2136,7 @@ Executor::toConstant(ExecutionState &state,
     return CE;
 
   ref<ConstantExpr> value;
-  bool success =
-      solver->getValue(state.constraints, e, value, state.queryMetaData);
+  bool success = getValueConcretization(state, e, value);
   assert(success && "FIXME: Unhandled solver failure");
   (void) success;
 
@@ -1441,6 +2258,178 @@ void Executor::stepInstruction(ExecutionState &state) {
     haltExecution = true;
 }
 
+const Executor::ConcreteRegionInfo &
+Executor::analyzeConcreteRegion(const llvm::BasicBlock *bb) {
+  auto it = concreteRegions.find(bb);
+  if (it != concreteRegions.end())
+    return it->second;
+
+  ConcreteRegionInfo &info = concreteRegions[bb];
+
+  // Collect the eligible prefix of the block body: integer computation
+  // whose native semantics match the interpreter's, i.e. no memory
+  // access, no control flow, no division (the interpreter reports
+  // division by zero as an error rather than trapping) and no shifts
+  // whose amount could reach the bit width (total in the interpreter,
+  // poison in native code).
+  std::vector<const llvm::Instruction *> region;
+  std::set<const llvm::Value *> internal;
+  for (const llvm::Instruction *i = bb->getFirstNonPHI(); !i->isTerminator();
+       i = i->getNextNode()) {
+    const auto *ty = dyn_cast<llvm::IntegerType>(i->getType());
+    if (!ty || ty->getBitWidth() > 64)
+      break;
+
+    bool eligible;
+    switch (i->getOpcode()) {
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::Mul:
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor:
+    case Instruction::ICmp:
+    case Instruction::ZExt:
+    case Instruction::SExt:
+    case Instruction::Trunc:
+    case Instruction::Select:
+      eligible = true;
+      break;
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr: {
+      const auto *amount = dyn_cast<llvm::ConstantInt>(i->getOperand(1));
+      eligible = amount && amount->getValue().ult(ty->getBitWidth());
+      break;
+    }
+    default:
+      eligible = false;
+      break;
+    }
+    if (!eligible)
+      break;
+
+    // All operands must be integers as well (rules out icmp/select on
+    // pointers).
+    for (const llvm::Value *op : i->operands()) {
+      if (!isa<llvm::IntegerType>(op->getType()) ||
+          cast<llvm::IntegerType>(op->getType())->getBitWidth() > 64) {
+        eligible = false;
+        break;
+      }
+    }
+    if (!eligible)
+      break;
+
+    region.push_back(i);
+    internal.insert(i);
+  }
+
+  // Below this the dispatch overhead swamps any win over interpreting.
+  const unsigned MinRegionLength = 4;
+  if (region.size() < MinRegionLength)
+    return info;
+
+  // Assign input slots in first-use order over (instruction, operand)
+  // pairs; createRegionDispatcher performs the same walk, so both sides
+  // agree on the layout.
+  std::set<const llvm::Value *> seen;
+  for (unsigned k = 0; k != region.size(); ++k) {
+    for (unsigned j = 0, e = region[k]->getNumOperands(); j != e; ++j) {
+      const llvm::Value *op = region[k]->getOperand(j);
+      if (internal.count(op) || isa<llvm::ConstantInt>(op))
+        continue;
+      if (seen.insert(op).second)
+        info.inputs.emplace_back(k, j);
+    }
+  }
+
+  info.count = region.size();
+  info.numInputs = info.inputs.size();
+  return info;
+}
+
+bool Executor::trySummarizeLoop(ExecutionState &state, KInstruction *ki) {
+  KFunction *kf = state.stack.back().kf;
+  auto it = kf->loopSummaries.find(ki->inst->getParent());
+  if (it == kf->loopSummaries.end())
+    return false;
+  const KFunction::KLoopSummary &ls = it->second;
+
+  ref<Expr> iv = getDestCell(state, ls.indvar).value;
+  ref<Expr> bound = eval(ls.cmp, ls.boundOperand, state).value;
+  ref<Expr> inLoop = ls.isSigned ? SltExpr::create(iv, bound)
+                                 : UltExpr::create(iv, bound);
+
+  // Remaining trip count. Exact even in modular arithmetic: the
+  // induction variable advances by one towards the bound, so it never
+  // wraps before reaching it.
+  ref<Expr> trips =
+      SelectExpr::create(inLoop, SubExpr::create(bound, iv),
+                         ConstantExpr::create(0, iv->getWidth()));
+
+  bindLocal(ls.indvar, state, AddExpr::create(iv, trips));
+  for (const auto &acc : ls.accumulators) {
+    ref<Expr> cur = getDestCell(state, acc.phi).value;
+    ref<Expr> step = eval(acc.add, acc.stepOperand, state).value;
+    ref<Expr> n = ZExtExpr::create(trips, step->getWidth());
+    bindLocal(acc.phi, state, AddExpr::create(cur, MulExpr::create(n, step)));
+  }
+
+  transferToBasicBlock(ls.exit, ki->inst->getParent(), state);
+  return true;
+}
+
+bool Executor::tryJITConcreteBlock(ExecutionState &state) {
+  llvm::BasicBlock *bb = state.pc->inst->getParent();
+  if (state.pc->inst != bb->getFirstNonPHI())
+    return false;
+
+  const ConcreteRegionInfo &info = analyzeConcreteRegion(bb);
+  if (!info.count)
+    return false;
+
+  // Gather the region inputs; any symbolic value sends the whole block
+  // back to the interpreter. The result slots stay zeroed so narrow
+  // native stores leave them zero-extended.
+  std::vector<uint64_t> args(info.numInputs + info.count, 0);
+  {
+    KInstIterator walker = state.pc;
+    unsigned offset = 0;
+    for (unsigned i = 0; i != info.numInputs; ++i) {
+      for (; offset != info.inputs[i].first; ++offset)
+        ++walker;
+      ref<Expr> value = eval(walker, info.inputs[i].second, state).value;
+      ConstantExpr *ce = dyn_cast<ConstantExpr>(value);
+      if (!ce)
+        return false;
+      args[i] = ce->getZExtValue();
+    }
+  }
+
+  if (!externalDispatcher->executeConcreteRegion(state.pc->inst, info.count,
+                                                 info.numInputs, &args[0])) {
+    // The JIT'ed code faulted (it should not be able to); disable the
+    // block rather than retrying it forever.
+    klee_warning_once(bb, "failed to execute concrete region natively, "
+                          "disabling block");
+    concreteRegions[bb].count = 0;
+    return false;
+  }
+
+  // Commit the results, stepping each instruction so that coverage,
+  // statistics and debug printing are indistinguishable from
+  // interpretation.
+  for (unsigned k = 0; k != info.count; ++k) {
+    KInstruction *ki = state.pc;
+    stepInstruction(state);
+    bindLocal(ki, state,
+              ConstantExpr::create(args[info.numInputs + k],
+                                   getWidthForLLVMType(ki->inst->getType())));
+  }
+  return true;
+}
+
 static inline const llvm::fltSemantics *fpWidthToSemantics(unsigned width) {
   switch (width) {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
@@ -1635,6 +2624,7 @@ void Executor::unwindToNextLandingpad(ExecutionState &state) {
         llvm::Function *personality_fn =
             kmodule->module->getFunction("_klee_eh_cxx_personality");
         KFunction *kf = kmodule->functionMap[personality_fn];
+        kmodule->materializeDebugInfo(kf);
 
         state.pushFrame(state.prevPC, kf);
         state.pc = kf->instructions;
@@ -1699,6 +2689,14 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
   Instruction *i = ki->inst;
   if (isa_and_nonnull<DbgInfoIntrinsic>(i))
     return;
+
+  // memcpy/memmove/memset calls with concrete arguments can be executed
+  // directly on the destination object, skipping the interpreted byte-copy
+  // loop in the runtime definition.
+  if (f && specialFunctionHandler->tryMemoryOperationFastPath(state, ki, f,
+                                                              arguments))
+    return;
+
   if (f && f->isDeclaration()) {
     switch (f->getIntrinsicID()) {
     case Intrinsic::not_intrinsic:
@@ -1897,13 +2895,68 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
     // instead of the actual instruction, since we can't make a KInstIterator
     // from just an instruction (unlike LLVM).
     KFunction *kf = kmodule->functionMap[f];
+    kmodule->materializeDebugInfo(kf);
+
+    if (UseFunctionSummaries && kf->isPureLeaf) {
+      FunctionSummaryKey key{kf, arguments};
+      auto fsit = functionSummaries.find(key);
+      if (fsit != functionSummaries.end()) {
+        // substitute the memoized return value for the call
+        bindLocal(ki, state, fsit->second);
+        if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
+          transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+        return;
+      }
+    }
+
+    if (NativeLeafCalls && kf->isPureLeaf) {
+      if (!kf->nativeCallDecision &&
+          kf->interpretedCalls >= NativeLeafWarmupCalls)
+        kf->nativeCallDecision =
+            (kf->interpretedInstructions / kf->interpretedCalls >=
+                 NativeLeafCalls &&
+             ExternalCalls != ExternalCallPolicy::None &&
+             externalDispatcher->resolveSymbol(f->getName().str()))
+                ? 2
+                : 1;
+      if (kf->nativeCallDecision == 2) {
+        bool allConcrete = true;
+        for (const auto &arg : arguments) {
+          if (!isa<ConstantExpr>(arg)) {
+            allConcrete = false;
+            break;
+          }
+        }
+        if (allConcrete) {
+          // A pure leaf has no side effects and reads only constant
+          // globals, so the concrete call observes exactly what the
+          // interpreter would.
+          callExternalFunction(state, ki, f, arguments);
+          if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
+            transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+          return;
+        }
+      }
+    }
 
     state.pushFrame(state.prevPC, kf);
     state.pc = kf->instructions;
 
+    if (coverageBitmap)
+      recordCoverageEdge(state, &f->getEntryBlock());
+
     if (statsTracker)
       statsTracker->framePushed(state, &state.stack[state.stack.size() - 2]);
 
+    if (UseFunctionSummaries && kf->isPureLeaf) {
+      StackFrame &sf = state.stack.back();
+      sf.summaryArgs = arguments;
+      sf.summaryConstraints = state.constraints.size();
+    }
+
+    if (NativeLeafCalls && kf->isPureLeaf && !kf->nativeCallDecision)
+      state.stack.back().costMeterStart = state.steppedInstructions;
+
     // TODO: support zeroext, signext, sret attributes
 
     unsigned callingArgs = arguments.size();
@@ -2049,8 +3102,39 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
   }
 }
 
+std::uint32_t Executor::coverageLoc(llvm::BasicBlock *bb) {
+  auto it = coverageLocs.find(bb);
+  if (it != coverageLocs.end())
+    return it->second;
+
+  // Derived from the function name and the block's instruction index
+  // rather than pointer values, so that cooperating processes agree on
+  // the ids.
+  KFunction *kf = kmodule->functionMap[bb->getParent()];
+  std::uint64_t h = std::hash<std::string>()(bb->getParent()->getName().str());
+  h = h * 0x9e3779b97f4a7c15ULL + kf->basicBlockEntry[bb];
+  std::uint32_t loc =
+      static_cast<std::uint32_t>(h ^ (h >> 32)) & (CoverageBitmapSize - 1);
+  coverageLocs.emplace(bb, loc);
+  return loc;
+}
+
+void Executor::recordCoverageEdge(ExecutionState &state,
+                                  llvm::BasicBlock *dst) {
+  std::uint32_t cur = coverageLoc(dst);
+  unsigned char &counter =
+      coverageBitmap[(state.covPrevLoc ^ cur) & (CoverageBitmapSize - 1)];
+  // Saturate so hot edges never wrap back to "never seen".
+  if (!++counter)
+    --counter;
+  state.covPrevLoc = cur >> 1;
+}
+
 void Executor::transferToBasicBlock(BasicBlock *dst, BasicBlock *src, 
                                     ExecutionState &state) {
+  if (coverageBitmap)
+    recordCoverageEdge(state, dst);
+
   // Note that in general phi nodes can reuse phi values from the same
   // block but the incoming value is the eval() result *before* the
   // execution of any phi nodes. this is pathological and doesn't
@@ -2103,7 +3187,301 @@ Function* Executor::getTargetFunction(Value *calledVal, ExecutionState &state) {
   }
 }
 
+template <typename BE>
+void Executor::executeBinaryHandler(Executor &executor, ExecutionState &state,
+                                    KInstruction *ki) {
+  ref<Expr> left = executor.eval(ki, 0, state).value;
+  ref<Expr> right = executor.eval(ki, 1, state).value;
+  executor.bindLocal(ki, state, BE::create(left, right));
+}
+
+template <typename EE>
+void Executor::executeExtHandler(Executor &executor, ExecutionState &state,
+                                 KInstruction *ki) {
+  ref<Expr> result = EE::create(executor.eval(ki, 0, state).value,
+                                executor.getWidthForLLVMType(ki->inst->getType()));
+  executor.bindLocal(ki, state, result);
+}
+
+void Executor::executeTruncHandler(Executor &executor, ExecutionState &state,
+                                   KInstruction *ki) {
+  ref<Expr> result = ExtractExpr::create(
+      executor.eval(ki, 0, state).value, 0,
+      executor.getWidthForLLVMType(ki->inst->getType()));
+  executor.bindLocal(ki, state, result);
+}
+
+void Executor::executeBitCastHandler(Executor &executor, ExecutionState &state,
+                                     KInstruction *ki) {
+  executor.bindLocal(ki, state, executor.eval(ki, 0, state).value);
+}
+
+void Executor::executeSelectHandler(Executor &executor, ExecutionState &state,
+                                    KInstruction *ki) {
+  // NOTE: It is not required that operands 1 and 2 be of scalar type.
+  ref<Expr> cond = executor.eval(ki, 0, state).value;
+  ref<Expr> tExpr = executor.eval(ki, 1, state).value;
+  ref<Expr> fExpr = executor.eval(ki, 2, state).value;
+  executor.bindLocal(ki, state, SelectExpr::create(cond, tExpr, fExpr));
+}
+
+template <typename BE>
+void Executor::executeVectorBinaryHandler(Executor &executor,
+                                          ExecutionState &state,
+                                          KInstruction *ki) {
+#if LLVM_VERSION_MAJOR >= 11
+  const auto *vt =
+      cast<llvm::FixedVectorType>(ki->inst->getOperand(0)->getType());
+#else
+  const auto *vt = cast<llvm::VectorType>(ki->inst->getOperand(0)->getType());
+#endif
+  unsigned eltBits = executor.getWidthForLLVMType(vt->getElementType());
+  const unsigned elementCount = vt->getNumElements();
+
+  ref<Expr> left = executor.eval(ki, 0, state).value;
+  ref<Expr> right = executor.eval(ki, 1, state).value;
+
+  assert(Context::get().isLittleEndian() && "FIXME:Broken for big endian");
+  llvm::SmallVector<ref<Expr>, 8> elems;
+  elems.reserve(elementCount);
+  for (unsigned i = elementCount; i != 0; --i) {
+    unsigned bitOffset = eltBits * (i - 1);
+    elems.push_back(BE::create(ExtractExpr::create(left, bitOffset, eltBits),
+                               ExtractExpr::create(right, bitOffset, eltBits)));
+  }
+  executor.bindLocal(ki, state, ConcatExpr::createN(elementCount, elems.data()));
+}
+
+void Executor::executeVectorCastHandler(Executor &executor,
+                                        ExecutionState &state,
+                                        KInstruction *ki) {
+#if LLVM_VERSION_MAJOR >= 11
+  const auto *dvt = cast<llvm::FixedVectorType>(ki->inst->getType());
+  const auto *svt =
+      cast<llvm::FixedVectorType>(ki->inst->getOperand(0)->getType());
+#else
+  const auto *dvt = cast<llvm::VectorType>(ki->inst->getType());
+  const auto *svt = cast<llvm::VectorType>(ki->inst->getOperand(0)->getType());
+#endif
+  unsigned srcBits = executor.getWidthForLLVMType(svt->getElementType());
+  unsigned dstBits = executor.getWidthForLLVMType(dvt->getElementType());
+  const unsigned elementCount = dvt->getNumElements();
+
+  ref<Expr> src = executor.eval(ki, 0, state).value;
+
+  assert(Context::get().isLittleEndian() && "FIXME:Broken for big endian");
+  llvm::SmallVector<ref<Expr>, 8> elems;
+  elems.reserve(elementCount);
+  for (unsigned i = elementCount; i != 0; --i) {
+    ref<Expr> lane = ExtractExpr::create(src, srcBits * (i - 1), srcBits);
+    switch (ki->inst->getOpcode()) {
+    case Instruction::Trunc:
+      lane = ExtractExpr::create(lane, 0, dstBits);
+      break;
+    case Instruction::ZExt:
+      lane = ZExtExpr::create(lane, dstBits);
+      break;
+    case Instruction::SExt:
+      lane = SExtExpr::create(lane, dstBits);
+      break;
+    default:
+      assert(0 && "invalid vector cast opcode");
+    }
+    elems.push_back(lane);
+  }
+  executor.bindLocal(ki, state, ConcatExpr::createN(elementCount, elems.data()));
+}
+
+void Executor::executeVectorSelectHandler(Executor &executor,
+                                          ExecutionState &state,
+                                          KInstruction *ki) {
+#if LLVM_VERSION_MAJOR >= 11
+  const auto *vt =
+      cast<llvm::FixedVectorType>(ki->inst->getOperand(1)->getType());
+#else
+  const auto *vt = cast<llvm::VectorType>(ki->inst->getOperand(1)->getType());
+#endif
+  unsigned eltBits = executor.getWidthForLLVMType(vt->getElementType());
+  const unsigned elementCount = vt->getNumElements();
+
+  ref<Expr> cond = executor.eval(ki, 0, state).value;
+  ref<Expr> tExpr = executor.eval(ki, 1, state).value;
+  ref<Expr> fExpr = executor.eval(ki, 2, state).value;
+
+  assert(Context::get().isLittleEndian() && "FIXME:Broken for big endian");
+  llvm::SmallVector<ref<Expr>, 8> elems;
+  elems.reserve(elementCount);
+  for (unsigned i = elementCount; i != 0; --i) {
+    unsigned bitOffset = eltBits * (i - 1);
+    elems.push_back(
+        SelectExpr::create(ExtractExpr::create(cond, i - 1, Expr::Bool),
+                           ExtractExpr::create(tExpr, bitOffset, eltBits),
+                           ExtractExpr::create(fExpr, bitOffset, eltBits)));
+  }
+  executor.bindLocal(ki, state, ConcatExpr::createN(elementCount, elems.data()));
+}
+
+void Executor::installInstructionHandlers() {
+  for (auto &kfp : kmodule->functions) {
+    KFunction *kf = kfp.get();
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      // Only reachable with -scalarize-vectors=false; for Select this
+      // tests the condition operand.
+      bool vec0 = ki->inst->getNumOperands() != 0 &&
+                  ki->inst->getOperand(0)->getType()->isVectorTy();
+      switch (ki->inst->getOpcode()) {
+      case Instruction::Add:
+        ki->handler = vec0 ? executeVectorBinaryHandler<AddExpr>
+                           : executeBinaryHandler<AddExpr>;
+        break;
+      case Instruction::Sub:
+        ki->handler = vec0 ? executeVectorBinaryHandler<SubExpr>
+                           : executeBinaryHandler<SubExpr>;
+        break;
+      case Instruction::Mul:
+        ki->handler = vec0 ? executeVectorBinaryHandler<MulExpr>
+                           : executeBinaryHandler<MulExpr>;
+        break;
+      case Instruction::UDiv:
+        ki->handler = vec0 ? executeVectorBinaryHandler<UDivExpr>
+                           : executeBinaryHandler<UDivExpr>;
+        break;
+      case Instruction::SDiv:
+        ki->handler = vec0 ? executeVectorBinaryHandler<SDivExpr>
+                           : executeBinaryHandler<SDivExpr>;
+        break;
+      case Instruction::URem:
+        ki->handler = vec0 ? executeVectorBinaryHandler<URemExpr>
+                           : executeBinaryHandler<URemExpr>;
+        break;
+      case Instruction::SRem:
+        ki->handler = vec0 ? executeVectorBinaryHandler<SRemExpr>
+                           : executeBinaryHandler<SRemExpr>;
+        break;
+      case Instruction::And:
+        ki->handler = vec0 ? executeVectorBinaryHandler<AndExpr>
+                           : executeBinaryHandler<AndExpr>;
+        break;
+      case Instruction::Or:
+        ki->handler = vec0 ? executeVectorBinaryHandler<OrExpr>
+                           : executeBinaryHandler<OrExpr>;
+        break;
+      case Instruction::Xor:
+        ki->handler = vec0 ? executeVectorBinaryHandler<XorExpr>
+                           : executeBinaryHandler<XorExpr>;
+        break;
+      case Instruction::Shl:
+        ki->handler = vec0 ? executeVectorBinaryHandler<ShlExpr>
+                           : executeBinaryHandler<ShlExpr>;
+        break;
+      case Instruction::LShr:
+        ki->handler = vec0 ? executeVectorBinaryHandler<LShrExpr>
+                           : executeBinaryHandler<LShrExpr>;
+        break;
+      case Instruction::AShr:
+        ki->handler = vec0 ? executeVectorBinaryHandler<AShrExpr>
+                           : executeBinaryHandler<AShrExpr>;
+        break;
+
+      case Instruction::ICmp:
+        switch (cast<ICmpInst>(ki->inst)->getPredicate()) {
+        case ICmpInst::ICMP_EQ:
+          ki->handler = vec0 ? executeVectorBinaryHandler<EqExpr>
+                             : executeBinaryHandler<EqExpr>;
+          break;
+        case ICmpInst::ICMP_NE:
+          ki->handler = vec0 ? executeVectorBinaryHandler<NeExpr>
+                             : executeBinaryHandler<NeExpr>;
+          break;
+        case ICmpInst::ICMP_UGT:
+          ki->handler = vec0 ? executeVectorBinaryHandler<UgtExpr>
+                             : executeBinaryHandler<UgtExpr>;
+          break;
+        case ICmpInst::ICMP_UGE:
+          ki->handler = vec0 ? executeVectorBinaryHandler<UgeExpr>
+                             : executeBinaryHandler<UgeExpr>;
+          break;
+        case ICmpInst::ICMP_ULT:
+          ki->handler = vec0 ? executeVectorBinaryHandler<UltExpr>
+                             : executeBinaryHandler<UltExpr>;
+          break;
+        case ICmpInst::ICMP_ULE:
+          ki->handler = vec0 ? executeVectorBinaryHandler<UleExpr>
+                             : executeBinaryHandler<UleExpr>;
+          break;
+        case ICmpInst::ICMP_SGT:
+          ki->handler = vec0 ? executeVectorBinaryHandler<SgtExpr>
+                             : executeBinaryHandler<SgtExpr>;
+          break;
+        case ICmpInst::ICMP_SGE:
+          ki->handler = vec0 ? executeVectorBinaryHandler<SgeExpr>
+                             : executeBinaryHandler<SgeExpr>;
+          break;
+        case ICmpInst::ICMP_SLT:
+          ki->handler = vec0 ? executeVectorBinaryHandler<SltExpr>
+                             : executeBinaryHandler<SltExpr>;
+          break;
+        case ICmpInst::ICMP_SLE:
+          ki->handler = vec0 ? executeVectorBinaryHandler<SleExpr>
+                             : executeBinaryHandler<SleExpr>;
+          break;
+        default:
+          // Leave invalid predicates to the switch's error path.
+          break;
+        }
+        break;
+
+      case Instruction::Trunc:
+        ki->handler = vec0 ? executeVectorCastHandler : executeTruncHandler;
+        break;
+      case Instruction::ZExt:
+        ki->handler = vec0 ? executeVectorCastHandler
+                           : executeExtHandler<ZExtExpr>;
+        break;
+      case Instruction::SExt:
+        ki->handler = vec0 ? executeVectorCastHandler
+                           : executeExtHandler<SExtExpr>;
+        break;
+      case Instruction::IntToPtr:
+      case Instruction::PtrToInt:
+        ki->handler = executeExtHandler<ZExtExpr>; break;
+      case Instruction::BitCast:
+        ki->handler = executeBitCastHandler; break;
+      case Instruction::Select:
+        // A scalar condition selecting between whole vectors works
+        // directly on the packed representation.
+        ki->handler = vec0 ? executeVectorSelectHandler : executeSelectHandler;
+        break;
+
+      default:
+        // Everything else (control flow, memory, floating point,
+        // vectors, ...) dispatches through the opcode switch.
+        break;
+      }
+    }
+  }
+}
+
+void Executor::executeFusedSuccessor(ExecutionState &state) {
+  // The first half of a fused pair can neither fork nor terminate the
+  // state and never ends its block, so state.pc is the recognized
+  // successor. Stepping it here keeps all per-instruction accounting
+  // (coverage, stats, debug printing) while skipping one trip through
+  // the scheduling loop.
+  KInstruction *next = state.pc;
+  stepInstruction(state);
+  executeInstruction(state, next);
+}
+
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
+  if (ki->handler) {
+    ki->handler(*this, state, ki);
+    if (ki->fuseNext)
+      executeFusedSuccessor(state);
+    return;
+  }
+
   Instruction *i = ki->inst;
   switch (i->getOpcode()) {
     // Control flow
@@ -2122,6 +3500,23 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       assert(!caller && "caller set on initial stack frame");
       terminateStateOnExit(state);
     } else {
+      {
+        StackFrame &sf = state.stack.back();
+        if (!isVoidReturn && !sf.summaryArgs.empty() &&
+            state.constraints.size() == sf.summaryConstraints &&
+            functionSummaries.size() < MaxFunctionSummaries) {
+          // the call neither branched on anything symbolic nor
+          // concretized anything, so its result depends only on the
+          // argument expressions and can be reused
+          functionSummaries.emplace(
+              FunctionSummaryKey{sf.kf, std::move(sf.summaryArgs)}, result);
+        }
+        if (sf.costMeterStart) {
+          sf.kf->interpretedInstructions +=
+              state.steppedInstructions - sf.costMeterStart;
+          ++sf.kf->interpretedCalls;
+        }
+      }
       state.popFrame();
 
       if (statsTracker)
@@ -2217,6 +3612,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     if (bi->isUnconditional()) {
       transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), state);
     } else {
+      if (SummarizeLoops && trySummarizeLoop(state, ki))
+        break;
+
       // FIXME: Find a way that we don't have this hidden dependency.
       assert(bi->getCondition() == bi->getOperand(0) &&
              "Wrong operand index!");
@@ -2321,81 +3719,123 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     cond = toUnique(state, cond);
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(cond)) {
-      // Somewhat gross to create these all the time, but fine till we
-      // switch to an internal rep.
-      llvm::IntegerType *Ty = cast<IntegerType>(si->getCondition()->getType());
-      ConstantInt *ci = ConstantInt::get(Ty, CE->getZExtValue());
-#if LLVM_VERSION_CODE >= LLVM_VERSION(5, 0)
-      unsigned index = si->findCaseValue(ci)->getSuccessorIndex();
-#else
-      unsigned index = si->findCaseValue(ci).getSuccessorIndex();
-#endif
+      // Dispatch through a lazily built jump table instead of scanning
+      // the case list; protocol-style switches take this path with
+      // hundreds of cases and almost always concrete selectors.
+      auto ti = switchJumpTables.find(si);
+      if (ti == switchJumpTables.end()) {
+        ti = switchJumpTables
+                 .emplace(si, std::unordered_map<std::uint64_t, unsigned>())
+                 .first;
+        ti->second.reserve(si->getNumCases());
+        for (auto cit : si->cases())
+          ti->second.emplace(cit.getCaseValue()->getZExtValue(),
+                             cit.getSuccessorIndex());
+      }
+      auto vi = ti->second.find(CE->getZExtValue());
+      // successor 0 is the default destination
+      unsigned index = vi == ti->second.end() ? 0 : vi->second;
       transferToBasicBlock(si->getSuccessor(index), si->getParent(), state);
     } else {
       // Handle possible different branch targets
 
       // We have the following assumptions:
       // - each case value is mutual exclusive to all other values
-      // - order of case branches is based on the order of the expressions of
-      //   the case values, still default is handled last
+      // - cases are visited in ascending order of their values, still
+      //   default is handled last
       std::vector<BasicBlock *> bbOrder;
-      std::map<BasicBlock *, ref<Expr> > branchTargets;
-
-      std::map<ref<Expr>, BasicBlock *> expressionOrder;
-
-      // Iterate through all non-default cases and order them by expressions
-      for (auto i : si->cases()) {
-        ref<Expr> value = evalConstant(i.getCaseValue());
+      std::map<BasicBlock *, ref<Expr> > branchTargets;
 
-        BasicBlock *caseSuccessor = i.getCaseSuccessor();
-        expressionOrder.insert(std::make_pair(value, caseSuccessor));
-      }
+      // Order all non-default cases by case value so contiguous runs
+      // can be pruned with range queries.
+      std::vector<std::pair<ref<ConstantExpr>, BasicBlock *>> caseOrder;
+      caseOrder.reserve(si->getNumCases());
+      for (auto cit : si->cases())
+        caseOrder.emplace_back(evalConstant(cit.getCaseValue()),
+                               cit.getCaseSuccessor());
+      std::sort(caseOrder.begin(), caseOrder.end(),
+                [](const std::pair<ref<ConstantExpr>, BasicBlock *> &a,
+                   const std::pair<ref<ConstantExpr>, BasicBlock *> &b) {
+                  return a.first->getAPValue().ult(b.first->getAPValue());
+                });
 
       // Track default branch values
       ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
 
-      // iterate through all non-default cases but in order of the expressions
-      for (std::map<ref<Expr>, BasicBlock *>::iterator
-               it = expressionOrder.begin(),
-               itE = expressionOrder.end();
-           it != itE; ++it) {
-        ref<Expr> match = EqExpr::create(cond, it->first);
-
-        // skip if case has same successor basic block as default case
-        // (should work even with phi nodes as a switch is a single terminating instruction)
-        if (it->second == si->getDefaultDest()) continue;
-
-        // Make sure that the default value does not contain this target's value
-        defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
-
-        // Check if control flow could take this case
-        bool result;
-        match = optimizer.optimizeExpr(match, false);
-        bool success = solver->mayBeTrue(state.constraints, match, result,
-                                         state.queryMetaData);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (result) {
-          BasicBlock *caseSuccessor = it->second;
-
-          // Handle the case that a basic block might be the target of multiple
-          // switch cases.
-          // Currently we generate an expression containing all switch-case
-          // values for the same target basic block. We spare us forking too
-          // many times but we generate more complex condition expressions
-          // TODO Add option to allow to choose between those behaviors
-          std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> res =
-              branchTargets.insert(std::make_pair(
-                  caseSuccessor, ConstantExpr::alloc(0, Expr::Bool)));
-
-          res.first->second = OrExpr::create(match, res.first->second);
-
-          // Only add basic blocks which have not been target of a branch yet
-          if (res.second) {
-            bbOrder.push_back(caseSuccessor);
+      // Visit the run [lo, hi) of value-ordered cases. Runs above a
+      // handful of cases are first checked feasible as a whole with a
+      // single range query and then bisected, so a selector the
+      // constraints confine to a few values prunes a large switch with
+      // O(log cases) queries instead of one equality query per case.
+      // Cases a pruned run skips are infeasible, so their negations
+      // would not have narrowed the default condition anyway.
+      std::function<void(unsigned, unsigned)> visitCases = [&](unsigned lo,
+                                                               unsigned hi) {
+        if (hi - lo > 4) {
+          ref<Expr> inRange =
+              AndExpr::create(UgeExpr::create(cond, caseOrder[lo].first),
+                              UleExpr::create(cond, caseOrder[hi - 1].first));
+          inRange = optimizer.optimizeExpr(inRange, false);
+          bool result;
+          bool success = solver->mayBeTrue(state.constraints, inRange, result,
+                                           state.queryMetaData);
+          assert(success && "FIXME: Unhandled solver failure");
+          (void)success;
+          if (!result)
+            return;
+          unsigned mid = lo + (hi - lo) / 2;
+          visitCases(lo, mid);
+          visitCases(mid, hi);
+          return;
+        }
+
+        for (unsigned idx = lo; idx != hi; ++idx) {
+          ref<Expr> match = EqExpr::create(cond, caseOrder[idx].first);
+
+          // skip if case has same successor basic block as default case
+          // (should work even with phi nodes as a switch is a single
+          // terminating instruction)
+          if (caseOrder[idx].second == si->getDefaultDest())
+            continue;
+
+          // Make sure that the default value does not contain this
+          // target's value
+          defaultValue =
+              AndExpr::create(defaultValue, Expr::createIsZero(match));
+
+          // Check if control flow could take this case
+          bool result;
+          match = optimizer.optimizeExpr(match, false);
+          bool success = solver->mayBeTrue(state.constraints, match, result,
+                                           state.queryMetaData);
+          assert(success && "FIXME: Unhandled solver failure");
+          (void)success;
+          if (result) {
+            BasicBlock *caseSuccessor = caseOrder[idx].second;
+
+            // Handle the case that a basic block might be the target of
+            // multiple switch cases.
+            // Currently we generate an expression containing all
+            // switch-case values for the same target basic block. We
+            // spare us forking too many times but we generate more
+            // complex condition expressions
+            // TODO Add option to allow to choose between those behaviors
+            std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> res =
+                branchTargets.insert(std::make_pair(
+                    caseSuccessor, ConstantExpr::alloc(0, Expr::Bool)));
+
+            res.first->second = OrExpr::create(match, res.first->second);
+
+            // Only add basic blocks which have not been target of a
+            // branch yet
+            if (res.second) {
+              bbOrder.push_back(caseSuccessor);
+            }
           }
         }
-      }
+      };
+      if (!caseOrder.empty())
+        visitCases(0, caseOrder.size());
 
       // Check if control could take the default case
       defaultValue = optimizer.optimizeExpr(defaultValue, false);
@@ -2421,6 +3861,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
            it != ie; ++it) {
         conditions.push_back(branchTargets[*it]);
       }
+      if (conditions.size() > 1)
+        openAutoMergeRegion(state);
       std::vector<ExecutionState*> branches;
       branch(state, conditions, branches);
 
@@ -2778,7 +4220,32 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Memory instructions...
   case Instruction::Alloca: {
     AllocaInst *ai = cast<AllocaInst>(i);
-    unsigned elementSize = 
+
+    if (FrameLocalAllocas) {
+      StackFrame &sf = state.stack.back();
+      auto offset = sf.kf->frameAllocaOffsets.find(i);
+      if (offset != sf.kf->frameAllocaOffsets.end()) {
+        if (!sf.frameAllocas) {
+          MemoryObject *mo =
+              memory->allocate(sf.kf->frameAllocaSize, /*isLocal=*/true,
+                               /*isGlobal=*/false, i, sf.kf->frameAllocaAlign);
+          if (mo) {
+            ObjectState *os = bindObjectInState(state, mo, /*isLocal=*/true);
+            os->initializeToRandom();
+            sf.frameAllocas = mo;
+          }
+        }
+        if (sf.frameAllocas) {
+          bindLocal(ki, state,
+                    ConstantExpr::create(sf.frameAllocas->address +
+                                             offset->second,
+                                         Context::get().getPointerWidth()));
+          break;
+        }
+      }
+    }
+
+    unsigned elementSize =
       kmodule->targetData->getTypeStoreSize(ai->getAllocatedType());
     ref<Expr> size = Expr::createPointer(elementSize);
     if (ai->isArrayAllocation()) {
@@ -2804,6 +4271,13 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   case Instruction::GetElementPtr: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
+
+    // Constant base and indices were folded at bind time.
+    if (kgepi->constantResult) {
+      bindLocal(ki, state, kgepi->constantResult);
+      break;
+    }
+
     ref<Expr> base = eval(ki, 0, state).value;
 
     for (std::vector< std::pair<unsigned, uint64_t> >::iterator 
@@ -3265,11 +4739,49 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, Result);
     break;
   }
-  case Instruction::ShuffleVector:
-    // Should never happen due to Scalarizer pass removing ShuffleVector
-    // instructions.
-    terminateStateOnExecError(state, "Unexpected ShuffleVector instruction");
+  case Instruction::ShuffleVector: {
+    // Only reachable with -scalarize-vectors=false; otherwise the
+    // Scalarizer pass removes ShuffleVector instructions. The mask is
+    // always a constant.
+    ShuffleVectorInst *svi = cast<ShuffleVectorInst>(i);
+
+    ref<Expr> vec1 = eval(ki, 0, state).value;
+    ref<Expr> vec2 = eval(ki, 1, state).value;
+#if LLVM_VERSION_MAJOR >= 11
+    const auto *svt =
+        cast<llvm::FixedVectorType>(svi->getOperand(0)->getType());
+    const auto *dvt = cast<llvm::FixedVectorType>(svi->getType());
+#else
+    const llvm::VectorType *svt =
+        cast<llvm::VectorType>(svi->getOperand(0)->getType());
+    const llvm::VectorType *dvt = svi->getType();
+#endif
+    unsigned EltBits = getWidthForLLVMType(svt->getElementType());
+    const unsigned srcCount = svt->getNumElements();
+    const unsigned elementCount = dvt->getNumElements();
+
+    llvm::SmallVector<int, 16> mask;
+    svi->getShuffleMask(mask);
+
+    assert(Context::get().isLittleEndian() && "FIXME:Broken for big endian");
+    llvm::SmallVector<ref<Expr>, 8> elems;
+    elems.reserve(elementCount);
+    for (unsigned i = elementCount; i != 0; --i) {
+      int m = mask[i - 1];
+      if (m < 0) {
+        // Undef lane; any value will do.
+        elems.push_back(ConstantExpr::create(0, EltBits));
+      } else if ((unsigned)m < srcCount) {
+        elems.push_back(ExtractExpr::create(vec1, EltBits * m, EltBits));
+      } else {
+        elems.push_back(
+            ExtractExpr::create(vec2, EltBits * (m - srcCount), EltBits));
+      }
+    }
+    ref<Expr> Result = ConcatExpr::createN(elementCount, elems.data());
+    bindLocal(ki, state, Result);
     break;
+  }
 
 #ifdef SUPPORT_KLEE_EH_CXX
   case Instruction::Resume: {
@@ -3367,12 +4879,21 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     terminateStateOnExecError(state, "illegal instruction");
     break;
   }
+
+  if (ki->fuseNext)
+    executeFusedSuccessor(state);
 }
 
 void Executor::updateStates(ExecutionState *current) {
   if (searcher) {
     searcher->update(current, addedStates, removedStates);
   }
+
+  if (prefetchThread.joinable() && !removedStates.empty()) {
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    for (ExecutionState *es : removedStates)
+      prefetchedForkQueries.erase(es);
+  }
   
   states.insert(addedStates.begin(), addedStates.end());
   addedStates.clear();
@@ -3389,9 +4910,311 @@ void Executor::updateStates(ExecutionState *current) {
     if (it3 != seedMap.end())
       seedMap.erase(it3);
     processTree->remove(es->ptreeNode);
-    delete es;
+    if (StateReclamationBatch) {
+      // Freeing a state cascades through its address space, stack and
+      // constraint references; spread mass terminations over the
+      // following steps instead of pausing on all of them at once.
+      deferredReclamation.push_back(es);
+    } else {
+      delete es;
+      ++terminatedSinceArrayGC;
+    }
   }
   removedStates.clear();
+  reclaimTerminatedStates(StateReclamationBatch);
+  // Scheduling boundaries are the designated safe points for freeing
+  // address-space snapshots readers have handed back.
+  AddressSpaceSnapshot::reclaim();
+
+  if (ArrayGCInterval && terminatedSinceArrayGC >= ArrayGCInterval) {
+    terminatedSinceArrayGC = 0;
+    // The symbolics of running states are reachable outside the
+    // expression graph (they seed test generation), so they must survive
+    // even if no constraint mentions them yet.
+    std::unordered_set<const Array *> liveArrays;
+    for (const ExecutionState *es : states)
+      for (const auto &symbolic : es->symbolics)
+        liveArrays.insert(symbolic.second);
+    // States awaiting deferred reclamation still hold their references.
+    for (const ExecutionState *es : deferredReclamation)
+      for (const auto &symbolic : es->symbolics)
+        liveArrays.insert(symbolic.second);
+    arrayCache.collect(liveArrays);
+  }
+}
+
+void Executor::reclaimTerminatedStates(size_t max) {
+  for (; max && !deferredReclamation.empty(); --max) {
+    delete deferredReclamation.back();
+    deferredReclamation.pop_back();
+    ++terminatedSinceArrayGC;
+  }
+}
+
+void Executor::startForkQueryPrefetchThread() {
+  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
+  if (!coreSolver)
+    klee_error("Failed to create core solver\n");
+
+  // The background solver gets its own query logs so it does not clobber
+  // the main solver's files.
+  std::string prefix = "prefetch-";
+  Solver *chain = constructSolverChain(
+      coreSolver,
+      interpreterHandler->getOutputFilename(prefix + ALL_QUERIES_SMT2_FILE_NAME),
+      interpreterHandler->getOutputFilename(prefix +
+                                            SOLVER_QUERIES_SMT2_FILE_NAME),
+      interpreterHandler->getOutputFilename(prefix +
+                                            ALL_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(prefix +
+                                            SOLVER_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(prefix +
+                                            ALL_QUERIES_BINARY_FILE_NAME),
+      interpreterHandler->getOutputFilename(prefix +
+                                            SOLVER_QUERIES_BINARY_FILE_NAME));
+
+  prefetchSolver = std::make_unique<TimingSolver>(chain, EqualitySubstitution);
+  prefetchSolver->setTimeout(coreSolverTimeout);
+  prefetchShutdown = false;
+  prefetchThread = std::thread(&Executor::forkQueryPrefetchLoop, this);
+}
+
+void Executor::stopForkQueryPrefetchThread() {
+  if (!prefetchThread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    prefetchShutdown = true;
+    prefetchQueue.clear();
+    speculativeQueue.clear();
+    prefetchCond.notify_all();
+  }
+  prefetchThread.join();
+  prefetchSolver.reset();
+  prefetchedForkQueries.clear();
+  speculativeForkQueries.clear();
+}
+
+void Executor::forkQueryPrefetchLoop() {
+  std::unique_lock<std::mutex> lock(prefetchMutex);
+
+  while (true) {
+    while (!prefetchShutdown && prefetchQueue.empty() &&
+           speculativeQueue.empty())
+      prefetchCond.wait(lock);
+    if (prefetchShutdown)
+      break;
+
+    if (!prefetchQueue.empty()) {
+      const ExecutionState *key = prefetchQueue.front();
+      prefetchQueue.pop_front();
+      auto it = prefetchedForkQueries.find(key);
+      if (it == prefetchedForkQueries.end())
+        continue; // state was removed before we got to its query
+
+      ConstraintSet constraints = it->second.constraints;
+      ref<Expr> condition = it->second.condition;
+      lock.unlock();
+
+      Solver::Validity validity = Solver::Unknown;
+      SolverQueryMetaData metaData;
+      bool success =
+          prefetchSolver->evaluate(constraints, condition, validity, metaData);
+
+      lock.lock();
+      it = prefetchedForkQueries.find(key);
+      if (it != prefetchedForkQueries.end() &&
+          it->second.condition == condition) {
+        it->second.validity = validity;
+        it->second.success = success;
+        it->second.cost = metaData.queryCost;
+        it->second.ready = true;
+        prefetchCond.notify_all();
+      }
+      continue;
+    }
+
+    // No state is waiting on a query, so spend the idle time on a
+    // speculative lookahead query. Nobody blocks on these; a consumer
+    // finding the entry unfinished cancels it and queries directly.
+    auto key = speculativeQueue.front();
+    speculativeQueue.pop_front();
+    auto it = speculativeForkQueries.find(key);
+    if (it == speculativeForkQueries.end())
+      continue; // cancelled or evicted before we got to it
+
+    ConstraintSet constraints = it->second.constraints;
+    ref<Expr> condition = it->second.condition;
+    lock.unlock();
+
+    Solver::Validity validity = Solver::Unknown;
+    SolverQueryMetaData metaData;
+    bool success =
+        prefetchSolver->evaluate(constraints, condition, validity, metaData);
+
+    lock.lock();
+    it = speculativeForkQueries.find(key);
+    if (it != speculativeForkQueries.end() &&
+        it->second.condition == condition) {
+      it->second.validity = validity;
+      it->second.success = success;
+      it->second.cost = metaData.queryCost;
+      it->second.ready = true;
+    }
+  }
+}
+
+void Executor::prefetchForkQuery(ExecutionState &state) {
+  BranchInst *bi = dyn_cast<BranchInst>(state.pc->inst);
+  if (!bi || bi->isUnconditional())
+    return;
+  // Seeding states force branches from their seeds and use different
+  // timeout bookkeeping; leave them to the normal path.
+  if (seedMap.count(&state))
+    return;
+
+  ref<Expr> condition = eval(state.pc, 0, state).value;
+  if (isa<ConstantExpr>(condition))
+    return;
+  // Mirror the Br handler so the prefetched condition matches the one
+  // fork() will be called with.
+  condition = optimizer.optimizeExpr(condition, false);
+  if (isa<ConstantExpr>(condition))
+    return;
+
+  std::lock_guard<std::mutex> lock(prefetchMutex);
+  if (!prefetchedForkQueries.count(&state)) {
+    PrefetchedForkQuery &q = prefetchedForkQueries[&state];
+    q.constraints = state.constraints;
+    q.condition = condition;
+    prefetchQueue.push_back(&state);
+    prefetchCond.notify_all();
+  }
+}
+
+void Executor::prefetchLookaheadQueries(ExecutionState &state) {
+  if (seedMap.count(&state))
+    return;
+
+  const StackFrame &sf = state.stack.back();
+  KFunction *kf = sf.kf;
+  llvm::BasicBlock *start = state.pc->inst->getParent();
+
+  // Breadth-first over the blocks execution may reach next, bounded by
+  // the lookahead budget. A branch condition is worth solving early only
+  // if the register feeding it already holds a symbolic value; anything
+  // still unwritten (or that will be recomputed on the way) would just
+  // produce a query fork() never asks.
+  std::vector<llvm::BasicBlock *> worklist;
+  llvm::SmallPtrSet<llvm::BasicBlock *, 16> visited;
+  worklist.push_back(start);
+  visited.insert(start);
+  std::vector<ref<Expr>> conditions;
+
+  for (unsigned i = 0;
+       i < worklist.size() && visited.size() <= ForkQueryPrefetchBlockLookahead;
+       ++i) {
+    llvm::BasicBlock *bb = worklist[i];
+
+    llvm::Instruction *term = bb->getTerminator();
+    if (BranchInst *bi = dyn_cast<BranchInst>(term)) {
+      // The branch at the state's own pc is covered by the per-state
+      // prefetch above; only look past it.
+      if (bi->isConditional() && term != state.pc->inst) {
+        auto entry = kf->basicBlockEntry.find(bb);
+        if (entry != kf->basicBlockEntry.end()) {
+          KInstruction *ki =
+              kf->instructions[entry->second + (bb->size() - 1)];
+          int vnumber = ki->operands[0];
+          if (vnumber >= 0 &&
+              static_cast<unsigned>(vnumber) < kf->numRegisters) {
+            ref<Expr> condition = sf.locals[vnumber].value;
+            if (!condition.isNull() && !isa<ConstantExpr>(condition)) {
+              // Mirror the Br handler so the speculative condition
+              // matches the one fork() will be called with.
+              condition = optimizer.optimizeExpr(condition, false);
+              if (!isa<ConstantExpr>(condition))
+                conditions.push_back(condition);
+            }
+          }
+        }
+      }
+    }
+
+    for (llvm::BasicBlock *succ : successors(bb))
+      if (visited.insert(succ).second)
+        worklist.push_back(succ);
+  }
+
+  if (conditions.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(prefetchMutex);
+  for (ref<Expr> &condition : conditions) {
+    if (speculativeForkQueries.size() >= MaxSpeculativeForkQueries) {
+      // Old entries are keyed to constraint-set versions long mutated
+      // away; dropping everything is cheaper than tracking ages.
+      speculativeForkQueries.clear();
+      speculativeQueue.clear();
+    }
+    auto key = std::make_pair(state.constraints.version(), condition->hash());
+    auto res = speculativeForkQueries.insert(
+        std::make_pair(key, SpeculativeForkQuery()));
+    if (res.second) {
+      res.first->second.constraints = state.constraints;
+      res.first->second.condition = condition;
+      speculativeQueue.push_back(key);
+    }
+  }
+  prefetchCond.notify_all();
+}
+
+bool Executor::consumePrefetchedForkQuery(ExecutionState &state,
+                                          ref<Expr> condition,
+                                          Solver::Validity &res,
+                                          bool &success) {
+  if (!prefetchThread.joinable())
+    return false;
+
+  std::unique_lock<std::mutex> lock(prefetchMutex);
+  auto it = prefetchedForkQueries.find(&state);
+  if (it != prefetchedForkQueries.end()) {
+    if (it->second.condition != condition) {
+      // The condition was rewritten (e.g. by maxStaticPctChecks) after
+      // the query was submitted; drop the stale entry.
+      prefetchedForkQueries.erase(it);
+    } else {
+      while (!it->second.ready)
+        prefetchCond.wait(lock);
+
+      res = it->second.validity;
+      success = it->second.success;
+      state.queryMetaData.queryCost += it->second.cost;
+      prefetchedForkQueries.erase(it);
+      return true;
+    }
+  }
+
+  // No per-state prefetch; see whether the CFG lookahead solved this
+  // branch speculatively. Unlike the per-state entry a speculative one
+  // is not guaranteed to be prioritized, so an unfinished query is not
+  // worth blocking on: cancel it and let the caller query directly.
+  auto skey = std::make_pair(state.constraints.version(), condition->hash());
+  auto sit = speculativeForkQueries.find(skey);
+  if (sit == speculativeForkQueries.end() ||
+      sit->second.condition != condition)
+    return false;
+  if (!sit->second.ready) {
+    speculativeForkQueries.erase(sit);
+    return false;
+  }
+
+  res = sit->second.validity;
+  success = sit->second.success;
+  state.queryMetaData.queryCost += sit->second.cost;
+  speculativeForkQueries.erase(sit);
+  return true;
 }
 
 template <typename SqType, typename TypeIt>
@@ -3447,6 +5270,16 @@ void Executor::bindInstructionConstants(KInstruction *KI) {
   if (GetElementPtrInst *gepi = dyn_cast<GetElementPtrInst>(KI->inst)) {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction *>(KI);
     computeOffsets(kgepi, gep_type_begin(gepi), gep_type_end(gepi));
+
+    // If the base is constant as well, fold the whole instruction down
+    // to its result; globals have their addresses bound by now.
+    if (kgepi->indices.empty()) {
+      if (const Constant *base = dyn_cast<Constant>(gepi->getPointerOperand()))
+        kgepi->constantResult =
+            evalConstant(base, KI)
+                ->ZExt(Context::get().getPointerWidth())
+                ->Add(Expr::createPointer(kgepi->offset));
+    }
   } else if (InsertValueInst *ivi = dyn_cast<InsertValueInst>(KI->inst)) {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction *>(KI);
     computeOffsets(kgepi, iv_type_begin(ivi), iv_type_end(ivi));
@@ -3473,6 +5306,17 @@ void Executor::bindModuleConstants() {
   }
 }
 
+/// Linearize a lazily recorded branch history (-lazy-path-recording)
+/// into the root-to-leaf decision sequence readStream() would have
+/// produced for an eagerly written path stream.
+static void linearizeBranchHistory(const BranchHistoryNode *node,
+                                   std::vector<unsigned char> &out) {
+  out.clear();
+  for (; node; node = node->parent.get())
+    out.push_back(node->branch);
+  std::reverse(out.begin(), out.end());
+}
+
 bool Executor::checkMemoryUsage() {
   if (!MaxMemory) return true;
 
@@ -3482,6 +5326,27 @@ bool Executor::checkMemoryUsage() {
   if ((stats::instructions & 0xFFFFU) != 0) // every 65536 instructions
     return true;
 
+  // Age and compress cold concrete pages first; the room recovered here
+  // may keep us below the cap without shedding states. Shared pages are
+  // compressed at most once per sweep, the sweeps over the other
+  // sharers see them already compressed.
+  if (CompressColdPages) {
+    const uint64_t round = ConcreteStorePage::startCompressionRound();
+    if (round > CompressColdPages) {
+      uint64_t saved = 0;
+      for (const auto state : states)
+        for (const auto &binding : state->addressSpace.objects)
+          saved +=
+              binding.second->compressColdPages(round - CompressColdPages);
+      if (saved)
+        KLEE_TRACE2(cold_page_compression, saved >> 10, round);
+    }
+  }
+
+  // Free any reclamation backlog before measuring, so dead states
+  // neither count against the cap nor cause live ones to be shed.
+  reclaimTerminatedStates(deferredReclamation.size());
+
   // check memory limit
   const auto mallocUsage = util::GetTotalMallocUsage() >> 20U;
   const auto mmapUsage = memory->getUsedDeterministicSize() >> 20U;
@@ -3497,19 +5362,59 @@ bool Executor::checkMemoryUsage() {
   // just guess at how many to kill
   const auto numStates = states.size();
   auto toKill = std::max(1UL, numStates - numStates * MaxMemory / totalUsage);
-  klee_warning("killing %lu states (over memory cap: %luMB)", toKill, totalUsage);
-
-  // randomly select states for early termination
-  std::vector<ExecutionState *> arr(states.begin(), states.end()); // FIXME: expensive
-  for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
-    unsigned idx = theRNG.getInt32() % N;
-    // Make two pulls to try and not hit a state that
-    // covered new code.
-    if (arr[idx]->coveredNew)
-      idx = theRNG.getInt32() % N;
-
-    std::swap(arr[idx], arr[N - 1]);
-    terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
+  toKill = std::min(toKill, static_cast<unsigned long>(numStates));
+
+  // shed the least promising states first: those that covered no new
+  // code, then the ones charged the most unshared memory, breaking ties
+  // in favor of the states the searcher has scheduled least recently
+  std::vector<std::pair<std::uint64_t, ExecutionState *>> arr;
+  arr.reserve(numStates);
+  for (const auto state : states)
+    arr.emplace_back(state->approximateMemoryUsage(), state);
+  std::sort(arr.begin(), arr.end(),
+            [](const std::pair<std::uint64_t, ExecutionState *> &a,
+               const std::pair<std::uint64_t, ExecutionState *> &b) {
+              if (a.second->coveredNew != b.second->coveredNew)
+                return !a.second->coveredNew;
+              if (a.first != b.first)
+                return a.first > b.first;
+              return a.second->lastScheduledInstructions <
+                     b.second->lastScheduledInstructions;
+            });
+
+  const bool swap = SwapColdStates && pathWriter;
+  std::string swapDir;
+  if (swap) {
+    swapDir = interpreterHandler->getOutputFilename("swapped");
+    llvm::sys::fs::create_directories(swapDir);
+  }
+  klee_warning("%s %lu cold states (over memory cap: %luMB)",
+               swap ? "swapping out" : "killing", toKill, totalUsage);
+  KLEE_TRACE2(memory_pressure_kill, toKill, totalUsage);
+
+  for (unsigned long i = 0; i < toKill; ++i) {
+    if (swap) {
+      // spill the branch path first, so the shed work can be continued
+      // later with -resume instead of being lost
+      std::vector<unsigned char> decisions;
+      if (LazyPathRecording)
+        linearizeBranchHistory(arr[i].second->branchHistory.get(), decisions);
+      else
+        pathWriter->readStream(arr[i].second->pathOS.getID(), decisions);
+
+      std::string name =
+          swapDir + "/state" + std::to_string(swappedStates++) + ".path";
+      std::ofstream f(name, std::ios::out | std::ios::trunc);
+      if (f.good()) {
+        for (const auto decision : decisions)
+          f << decision << '\n';
+      } else {
+        klee_warning("swap: cannot write %s", name.c_str());
+      }
+    }
+    terminateStateEarly(*arr[i].second,
+                        swap ? "Memory limit exceeded, swapped to disk."
+                             : "Memory limit exceeded.");
   }
 
   return false;
@@ -3527,8 +5432,50 @@ void Executor::doDumpStates() {
   updateStates(nullptr);
 }
 
+void Executor::writeCheckpoint() {
+  assert(pathWriter && "-checkpoint-dir requires the path writer");
+
+  // write into a temporary directory first, so an interrupted
+  // checkpoint cannot corrupt the previous one
+  const std::string finalDir = CheckpointDir;
+  const std::string tmpDir = finalDir + ".tmp";
+  llvm::sys::fs::remove_directories(tmpDir);
+  if (auto ec = llvm::sys::fs::create_directories(tmpDir)) {
+    klee_warning("checkpoint: cannot create %s: %s", tmpDir.c_str(),
+                 ec.message().c_str());
+    return;
+  }
+
+  unsigned n = 0;
+  for (const auto &state : states) {
+    std::vector<unsigned char> decisions;
+    if (LazyPathRecording)
+      linearizeBranchHistory(state->branchHistory.get(), decisions);
+    else
+      pathWriter->readStream(state->pathOS.getID(), decisions);
+
+    std::string name = tmpDir + "/state" + std::to_string(n++) + ".path";
+    std::ofstream f(name, std::ios::out | std::ios::trunc);
+    if (!f.good()) {
+      klee_warning("checkpoint: cannot write %s", name.c_str());
+      return;
+    }
+    for (const auto decision : decisions)
+      f << decision << '\n';
+  }
+
+  llvm::sys::fs::remove_directories(finalDir);
+  if (auto ec = llvm::sys::fs::rename(tmpDir, finalDir)) {
+    klee_warning("checkpoint: cannot rename %s: %s", tmpDir.c_str(),
+                 ec.message().c_str());
+    return;
+  }
+  klee_message("checkpoint: wrote %u state paths", n);
+}
+
 void Executor::run(ExecutionState &initialState) {
   bindModuleConstants();
+  installInstructionHandlers();
 
   // Delay init till now so that ticks don't accrue during optimization and such.
   timers.reset();
@@ -3557,6 +5504,7 @@ void Executor::run(ExecutionState &initialState) {
         it = seedMap.begin();
       lastState = it->first;
       ExecutionState &state = *lastState;
+      profiler::ScopedPhase phase(profiler::Dispatch);
       KInstruction *ki = state.pc;
       stepInstruction(state);
 
@@ -3598,14 +5546,87 @@ void Executor::run(ExecutionState &initialState) {
     }
   }
 
+  // The startup prefix -- argv/env layout and the harness's option
+  // parsing over entirely concrete strings -- is deterministic
+  // single-state execution that can run millions of instructions before
+  // the first symbolic branch. Interpret it in a lean loop that skips
+  // the per-instruction scheduling overhead of the main loop (and, with
+  // -jit-concrete-blocks, runs concrete regions natively), so
+  // exploration effectively starts where the program first forks.
+  if (FastForwardStartup && !usingSeeds) {
+    std::uint64_t prefixInstructions = 0;
+    while (states.size() == 1 && !haltExecution) {
+      ExecutionState &state = **states.begin();
+      if (JITConcreteBlocks)
+        tryJITConcreteBlock(state);
+      KInstruction *ki = state.pc;
+      stepInstruction(state);
+      executeInstruction(state, ki);
+      updateStates(&state);
+
+      // Timer duties (MaxTime, stats writes) and the memory watchdog
+      // still need servicing, just not on every instruction.
+      if ((++prefixInstructions & 0xFFF) == 0) {
+        timers.invoke();
+        if (!checkMemoryUsage())
+          updateStates(nullptr);
+      }
+    }
+  }
+
+  if (ParallelWorkers > 1) {
+    runParallel();
+    doDumpStates();
+    return;
+  }
+
   searcher = constructUserSearcher(*this);
 
   std::vector<ExecutionState *> newStates(states.begin(), states.end());
   searcher->update(0, newStates, std::vector<ExecutionState *>());
 
+  if (ForkQueryPrefetch)
+    startForkQueryPrefetchThread();
+
   // main interpreter loop
   while (!states.empty() && !haltExecution) {
-    ExecutionState &state = searcher->selectState();
+    profiler::ScopedPhase phase(profiler::Dispatch);
+    ExecutionState *selected;
+    {
+      profiler::ScopedPhase selectPhase(profiler::Searcher);
+      selected = &searcher->selectState();
+    }
+    ExecutionState &state = *selected;
+    state.lastScheduledInstructions = stats::instructions;
+
+    if (UseAutoMerge && !state.openMergeStack.empty() &&
+        state.openMergeStack.back()->autoClosePoint == state.pc->inst &&
+        !mergingSearcher->inCloseMerge.count(&state)) {
+      // the state reached the inferred merge point of its innermost
+      // automatic region; close it as if it ran into klee_close_merge
+      ref<MergeHandler> mh = state.openMergeStack.back();
+      state.openMergeStack.pop_back();
+      mergingSearcher->inCloseMerge.insert(&state);
+      mh->addClosedState(&state, state.pc->inst);
+      updateStates(nullptr);
+      continue;
+    }
+
+    if (subsumptionChecker) {
+      // check at control-flow joins, where redundant siblings meet
+      llvm::Instruction *i = state.pc->inst;
+      if (i == &i->getParent()->front() &&
+          i->getParent()->hasNPredecessorsOrMore(2) &&
+          subsumptionChecker->isSubsumed(state)) {
+        terminateStateEarly(state, "Subsumed by previously explored state.");
+        updateStates(nullptr);
+        continue;
+      }
+    }
+    // A successful region execution leaves the state at its block's
+    // terminator, which is then interpreted as usual below.
+    if (JITConcreteBlocks)
+      tryJITConcreteBlock(state);
     KInstruction *ki = state.pc;
     stepInstruction(state);
 
@@ -3614,20 +5635,267 @@ void Executor::run(ExecutionState &initialState) {
     if (::dumpStates) dumpStates();
     if (::dumpPTree) dumpPTree();
 
+    bool stateRemoved = std::find(removedStates.begin(), removedStates.end(),
+                                  &state) != removedStates.end();
     updateStates(&state);
 
     if (!checkMemoryUsage()) {
       // update searchers when states were terminated early due to memory pressure
+      stateRemoved =
+          stateRemoved || std::find(removedStates.begin(), removedStates.end(),
+                                    &state) != removedStates.end();
       updateStates(nullptr);
     }
+
+    // With the state paused and its next instruction decided, its branch
+    // feasibility query can overlap interpretation of whatever states the
+    // searcher schedules before it runs again. The same holds for every
+    // state the searcher expects to schedule soon, so ask it to look
+    // ahead; paused states whose pc is not a symbolic conditional branch
+    // are skipped by prefetchForkQuery, and repeats are deduplicated.
+    if (prefetchThread.joinable()) {
+      if (!stateRemoved) {
+        prefetchForkQuery(state);
+        if (ForkQueryPrefetchBlockLookahead)
+          prefetchLookaheadQueries(state);
+      }
+      if (ForkQueryPrefetchLookahead) {
+        std::vector<ExecutionState *> upcoming;
+        searcher->peekStates(upcoming, ForkQueryPrefetchLookahead);
+        for (ExecutionState *es : upcoming)
+          if (es != &state)
+            prefetchForkQuery(*es);
+      }
+    }
   }
 
+  stopForkQueryPrefetchThread();
+
   delete searcher;
   searcher = nullptr;
 
+  if (searchProfile)
+    searchProfile->writeTo(
+        interpreterHandler->getOutputFilename("search.profile"));
+
   doDumpStates();
 }
 
+/// The CPUs of each NUMA node, parsed from the sysfs topology
+/// (-numa-aware-workers). Empty when the topology is unavailable, e.g.
+/// off Linux.
+static std::vector<std::vector<unsigned>> getNumaNodeCpus() {
+  std::vector<std::vector<unsigned>> nodes;
+#if defined(__linux__)
+  for (unsigned n = 0;; ++n) {
+    std::ifstream f("/sys/devices/system/node/node" + std::to_string(n) +
+                    "/cpulist");
+    if (!f.good())
+      break;
+    // "0-7,16-23" style ranges
+    std::vector<unsigned> cpus;
+    std::string list;
+    std::getline(f, list);
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+      std::size_t dash = range.find('-');
+      unsigned lo = std::stoul(range.substr(0, dash));
+      unsigned hi =
+          dash == std::string::npos ? lo : std::stoul(range.substr(dash + 1));
+      for (unsigned cpu = lo; cpu <= hi; ++cpu)
+        cpus.push_back(cpu);
+    }
+    if (!cpus.empty())
+      nodes.push_back(std::move(cpus));
+  }
+#endif
+  return nodes;
+}
+
+void Executor::runParallel() {
+  /// Per-worker context: a work-stealing deque of runnable states and a
+  /// private solver chain so that queries issued by different workers
+  /// can be in flight simultaneously.
+  struct Worker {
+    WorkStealingQueue<ExecutionState *> states;
+    std::unique_ptr<TimingSolver> solver;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (unsigned i = 0; i < ParallelWorkers; ++i) {
+    Solver *workerCoreSolver = klee::createCoreSolver(CoreSolverToUse);
+    if (!workerCoreSolver)
+      klee_error("Failed to create core solver\n");
+
+    // Query logs get a per-worker prefix so workers do not clobber each
+    // other's files.
+    std::string prefix = "w" + llvm::utostr(i) + "-";
+    Solver *chain = constructSolverChain(
+        workerCoreSolver,
+        interpreterHandler->getOutputFilename(prefix +
+                                              ALL_QUERIES_SMT2_FILE_NAME),
+        interpreterHandler->getOutputFilename(prefix +
+                                              SOLVER_QUERIES_SMT2_FILE_NAME),
+        interpreterHandler->getOutputFilename(prefix +
+                                              ALL_QUERIES_KQUERY_FILE_NAME),
+        interpreterHandler->getOutputFilename(prefix +
+                                              SOLVER_QUERIES_KQUERY_FILE_NAME),
+        interpreterHandler->getOutputFilename(prefix +
+                                              ALL_QUERIES_BINARY_FILE_NAME),
+        interpreterHandler->getOutputFilename(prefix +
+                                              SOLVER_QUERIES_BINARY_FILE_NAME));
+
+    auto w = std::make_unique<Worker>();
+    w->solver = std::make_unique<TimingSolver>(chain, EqualitySubstitution);
+    w->solver->setTimeout(coreSolverTimeout);
+    w->solver->setInterpreterLock(&interpreterMutex, &solver);
+    workers.push_back(std::move(w));
+  }
+
+  // Distribute the initial states round-robin; states forked later stay
+  // with the worker that created them until stolen.
+  {
+    unsigned i = 0;
+    for (ExecutionState *es : states)
+      workers[i++ % workers.size()]->states.push(es);
+  }
+
+  // NUMA placement: workers are assigned to nodes in contiguous blocks
+  // and steal from same-node siblings first, so a state's pooled memory
+  // (locals arrays, object pages, expression slabs - all served from
+  // thread-local pools, hence node-local by first touch) stays on its
+  // node unless a whole node runs out of work.
+  std::vector<std::vector<unsigned>> nodeCpus;
+  std::vector<unsigned> workerNode(workers.size(), 0);
+  if (NumaAwareWorkers) {
+    nodeCpus = getNumaNodeCpus();
+    if (nodeCpus.size() < 2)
+      klee_warning("-numa-aware-workers: no multi-node topology found");
+    else
+      for (unsigned i = 0; i < workers.size(); ++i)
+        workerNode[i] = i * nodeCpus.size() / workers.size();
+  }
+  std::vector<std::vector<unsigned>> stealOrder(workers.size());
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    for (unsigned off = 1; off < workers.size(); ++off) {
+      unsigned victim = (i + off) % workers.size();
+      if (workerNode[victim] == workerNode[i])
+        stealOrder[i].push_back(victim);
+    }
+    for (unsigned off = 1; off < workers.size(); ++off) {
+      unsigned victim = (i + off) % workers.size();
+      if (workerNode[victim] != workerNode[i])
+        stealOrder[i].push_back(victim);
+    }
+  }
+
+  std::condition_variable workAvailable;
+  TimingSolver *mainSolver = solver;
+
+  auto workerFn = [&](unsigned id) {
+    Worker &self = *workers[id];
+#if defined(__linux__)
+    if (NumaAwareWorkers && nodeCpus.size() >= 2) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (unsigned cpu : nodeCpus[workerNode[id]])
+        CPU_SET(cpu, &set);
+      if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        klee_warning("failed to pin worker %u to NUMA node %u: %s", id,
+                     workerNode[id], strerror(errno));
+    }
+#endif
+    std::unique_lock<std::mutex> lock(interpreterMutex);
+
+    while (!haltExecution && !states.empty()) {
+      // Timers (including the halt timer and stats writers) are only
+      // ever invoked by worker 0, under the interpreter lock.
+      if (id == 0)
+        timers.invoke();
+
+      ExecutionState *state = self.states.pop();
+      for (unsigned victim : stealOrder[id]) {
+        if (state)
+          break;
+        state = workers[victim]->states.steal();
+      }
+
+      if (!state) {
+        // All runnable states are currently owned by other workers; wait
+        // for one of them to fork or finish. The wait is bounded so that
+        // worker 0 keeps servicing timers.
+        workAvailable.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+
+      solver = self.solver.get();
+
+      // Execute a batch of instructions to amortize scheduling overhead,
+      // requeueing early when the state forks so new work becomes
+      // stealable promptly.
+      for (unsigned i = 0; i < 32 && !haltExecution; ++i) {
+        // Safe here despite the shared JIT: workers interpret under the
+        // interpreter lock.
+        if (JITConcreteBlocks)
+          tryJITConcreteBlock(*state);
+        KInstruction *ki = state->pc;
+        stepInstruction(*state);
+        executeInstruction(*state, ki);
+
+        if (addedStates.empty() && removedStates.empty())
+          continue;
+
+        bool died = std::find(removedStates.begin(), removedStates.end(),
+                              state) != removedStates.end();
+        // Terminated states may still sit in a deque (e.g. when killed
+        // by memory pressure); purge them before updateStates frees them.
+        for (ExecutionState *es : removedStates)
+          for (auto &w : workers)
+            w->states.remove(es);
+        std::vector<ExecutionState *> added(addedStates);
+        updateStates(nullptr);
+        for (ExecutionState *es : added)
+          self.states.push(es);
+        if (!added.empty())
+          workAvailable.notify_all();
+
+        if (died) {
+          state = nullptr;
+          break;
+        }
+        if (!added.empty())
+          break;
+      }
+
+      if (state)
+        self.states.push(state);
+
+      if (!checkMemoryUsage()) {
+        for (ExecutionState *es : removedStates)
+          for (auto &w : workers)
+            w->states.remove(es);
+        updateStates(nullptr);
+      }
+
+      if (states.empty() || haltExecution)
+        workAvailable.notify_all();
+    }
+
+    // Wake any sibling still waiting so it can observe termination.
+    workAvailable.notify_all();
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < ParallelWorkers; ++i)
+    threads.emplace_back(workerFn, i);
+  workerFn(0);
+  for (auto &t : threads)
+    t.join();
+
+  solver = mainSolver;
+}
+
 std::string Executor::getAddressInfo(ExecutionState &state, 
                                      ref<Expr> address) const{
   std::string Str;
@@ -3707,8 +5975,9 @@ void Executor::terminateState(ExecutionState &state) {
   }
 }
 
-void Executor::terminateStateEarly(ExecutionState &state, 
+void Executor::terminateStateEarly(ExecutionState &state,
                                    const Twine &message) {
+  KLEE_TRACE1(state_terminate_early, state.getID());
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -3717,10 +5986,13 @@ void Executor::terminateStateEarly(ExecutionState &state,
 }
 
 void Executor::terminateStateOnExit(ExecutionState &state) {
-  if (!OnlyOutputStatesCoveringNew || state.coveredNew || 
+  KLEE_TRACE1(state_terminate_exit, state.getID());
+  if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, 0, 0);
   interpreterHandler->incPathsCompleted();
+  if (searchProfile)
+    searchProfile->credit(state.ptreeNode, state.coveredNew ? 5 : 1);
   terminateState(state);
 }
 
@@ -3783,20 +6055,45 @@ void Executor::terminateStateOnError(ExecutionState &state,
                                      enum TerminateReason termReason,
                                      const char *suffix,
                                      const llvm::Twine &info) {
+  KLEE_TRACE2(state_terminate_error, state.getID(), termReason);
   std::string message = messaget.str();
-  static std::set< std::pair<Instruction*, std::string> > emittedErrors;
   Instruction * lastInst;
   const InstructionInfo &ii = getLastNonKleeInternalInstruction(state, &lastInst);
-  
-  if (EmitAllErrors ||
-      emittedErrors.insert(std::make_pair(lastInst, message)).second) {
+
+  // Errors are deduplicated by (location, error type, call stack):
+  // assert-dense targets hit thousands of instances of the same
+  // failure, and materializing the diagnostics for each would
+  // serialize error processing into exploration.
+  std::uint64_t stackHash = 0;
+  for (const StackFrame &sf : state.stack) {
+    stackHash = stackHash * UINT64_C(0x100000001b3) ^
+                reinterpret_cast<std::uintptr_t>(sf.kf);
+    stackHash = stackHash * UINT64_C(0x100000001b3) ^
+                reinterpret_cast<std::uintptr_t>(
+                    static_cast<const KInstruction *>(sf.caller));
+  }
+
+  unsigned seen = 0;
+  if (!EmitAllErrors) {
+    auto &errorClass =
+        errorClassCounts[std::make_tuple(lastInst, (int)termReason, stackHash)];
+    seen = errorClass.first++;
+    if (errorClass.second.empty()) {
+      llvm::raw_string_ostream desc(errorClass.second);
+      if (ii.file != "")
+        desc << ii.file << ":" << ii.line << ": ";
+      desc << message;
+    }
+  }
+
+  if (EmitAllErrors || seen < MaxErrorReportsPerClass) {
     if (ii.file != "") {
       klee_message("ERROR: %s:%d: %s", ii.file.c_str(), ii.line, message.c_str());
     } else {
       klee_message("ERROR: (location information missing) %s", message.c_str());
     }
-    if (!EmitAllErrors)
-      klee_message("NOTE: now ignoring this error at this location");
+    if (!EmitAllErrors && seen + 1 == MaxErrorReportsPerClass)
+      klee_message("NOTE: now ignoring further errors of this class");
 
     std::string MsgString;
     llvm::raw_string_ostream msg(MsgString);
@@ -3823,7 +6120,9 @@ void Executor::terminateStateOnError(ExecutionState &state,
 
     interpreterHandler->processTestCase(state, msg.str().c_str(), suffix);
   }
-    
+
+  if (searchProfile)
+    searchProfile->credit(state.ptreeNode, state.coveredNew ? 5 : 1);
   terminateState(state);
 
   if (shouldExitOn(termReason))
@@ -3867,8 +6166,7 @@ void Executor::callExternalFunction(ExecutionState &state,
     if (ExternalCalls == ExternalCallPolicy::All) { // don't bother checking uniqueness
       *ai = optimizer.optimizeExpr(*ai, true);
       ref<ConstantExpr> ce;
-      bool success =
-          solver->getValue(state.constraints, *ai, ce, state.queryMetaData);
+      bool success = getValueConcretization(state, *ai, ce);
       assert(success && "FIXME: Unhandled solver failure");
       (void) success;
       ce->toMemory(&args[wordIndex]);
@@ -3937,6 +6235,9 @@ void Executor::callExternalFunction(ExecutionState &state,
 
   bool success = externalDispatcher->executeCall(function, target->inst, args);
   if (!success) {
+    // The call may have modified memory before failing; make the next
+    // copy-out start from scratch.
+    state.addressSpace.invalidateConcreteSyncRecords();
     terminateStateOnError(state, "failed external call: " + function->getName(),
                           External);
     return;
@@ -4133,6 +6434,11 @@ void Executor::executeFree(ExecutionState &state,
                            ref<Expr> address,
                            KInstruction *target) {
   address = optimizer.optimizeExpr(address, true);
+
+  // a symbolic address makes the enclosing call's bounds checking (and
+  // thus error reporting) depend on the path condition
+  if (UseFunctionSummaries && !isa<ConstantExpr>(address))
+    state.stack.back().summaryArgs.clear();
   StatePair zeroPointer = fork(state, Expr::createIsZero(address), true);
   if (zeroPointer.first) {
     if (target)
@@ -4208,6 +6514,11 @@ void Executor::executeMemoryOperation(ExecutionState &state,
 
   address = optimizer.optimizeExpr(address, true);
 
+  // a symbolic address makes the enclosing call's bounds checking (and
+  // thus error reporting) depend on the path condition
+  if (UseFunctionSummaries && !isa<ConstantExpr>(address))
+    state.stack.back().summaryArgs.clear();
+
   // fast path: single in-bounds resolution
   ObjectPair op;
   bool success;
@@ -4267,15 +6578,89 @@ void Executor::executeMemoryOperation(ExecutionState &state,
   // resolution with out of bounds)
 
   address = optimizer.optimizeExpr(address, true);
+
+  // a symbolic address makes the enclosing call's bounds checking (and
+  // thus error reporting) depend on the path condition
+  if (UseFunctionSummaries && !isa<ConstantExpr>(address))
+    state.stack.back().summaryArgs.clear();
   ResolutionList rl;  
   solver->setTimeout(coreSolverTimeout);
   bool incomplete = state.addressSpace.resolve(state, solver, address, rl,
                                                0, coreSolverTimeout);
   solver->setTimeout(time::Span());
   
+  if (MaxForkingResolutions && rl.size() > MaxForkingResolutions) {
+    // Segmented mode for pointers that alias many objects: instead of one
+    // state per candidate, split only on in-bounds vs out-of-bounds and
+    // keep the alias choice inside the access itself, guarded by the
+    // bounds check of each candidate. The candidates are disjoint, so at
+    // most one guard is true.
+    ref<Expr> inAnyBounds = ConstantExpr::create(0, Expr::Bool);
+    for (const auto &res : rl)
+      inAnyBounds = OrExpr::create(
+          inAnyBounds, res.first->getBoundsCheckPointer(address, bytes));
+    inAnyBounds = optimizer.optimizeExpr(inAnyBounds, true);
+
+    StatePair branches = fork(state, inAnyBounds, true);
+
+    if (ExecutionState *bound = branches.first) {
+      if (isWrite) {
+        for (const auto &res : rl) {
+          const MemoryObject *mo = res.first;
+          const ObjectState *os = res.second;
+          ref<Expr> guard = mo->getBoundsCheckPointer(address, bytes);
+
+          if (os->readOnly) {
+            // Read-only candidates still need their own error state; the
+            // remainder of the access continues on the path where the
+            // pointer does not fall into this object.
+            StatePair roBranches = fork(*bound, guard, true);
+            if (roBranches.first)
+              terminateStateOnError(*roBranches.first,
+                                    "memory error: object read only",
+                                    ReadOnly);
+            bound = roBranches.second;
+            if (!bound)
+              break;
+          } else {
+            ObjectState *wos = bound->addressSpace.getWriteable(mo, os);
+            ref<Expr> offset = mo->getOffsetExpr(address);
+            wos->write(offset, SelectExpr::create(guard, value,
+                                                  wos->read(offset, type)));
+          }
+        }
+      } else {
+        // The seed of the select chain covers the case that no candidate
+        // matches, which is infeasible on this path, so the first read
+        // serves as well as anything.
+        ref<Expr> result;
+        for (const auto &res : rl) {
+          const MemoryObject *mo = res.first;
+          ref<Expr> read = res.second->read(mo->getOffsetExpr(address), type);
+          result = result.isNull()
+                       ? read
+                       : SelectExpr::create(
+                             mo->getBoundsCheckPointer(address, bytes), read,
+                             result);
+        }
+        bindLocal(target, *bound, result);
+      }
+    }
+
+    if (ExecutionState *unbound = branches.second) {
+      if (incomplete) {
+        terminateStateEarly(*unbound, "Query timed out (resolve).");
+      } else {
+        terminateStateOnError(*unbound, "memory error: out of bound pointer",
+                              Ptr, NULL, getAddressInfo(*unbound, address));
+      }
+    }
+    return;
+  }
+
   // XXX there is some query wasteage here. who cares?
   ExecutionState *unbound = &state;
-  
+
   for (ResolutionList::iterator i = rl.begin(), ie = rl.end(); i != ie; ++i) {
     const MemoryObject *mo = i->first;
     const ObjectState *os = i->second;
@@ -4357,7 +6742,7 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
                (!AllowSeedTruncation && obj->numBytes > mo->size))) {
 	    std::stringstream msg;
 	    msg << "replace size mismatch: "
-		<< mo->name << "[" << mo->size << "]"
+		<< mo->getName() << "[" << mo->size << "]"
 		<< " vs " << obj->name << "[" << obj->numBytes << "]"
 		<< " in test\n";
 
@@ -4416,6 +6801,7 @@ void Executor::runFunctionAsMain(Function *f,
   unsigned NumPtrBytes = Context::get().getPointerWidth() / 8;
   KFunction *kf = kmodule->functionMap[f];
   assert(kf);
+  kmodule->materializeDebugInfo(kf);
   Function::arg_iterator ai = f->arg_begin(), ae = f->arg_end();
   if (ai!=ae) {
     arguments.push_back(ConstantExpr::alloc(argc, Expr::Int32));
@@ -4443,11 +6829,23 @@ void Executor::runFunctionAsMain(Function *f,
 
   ExecutionState *state = new ExecutionState(kmodule->functionMap[f]);
 
-  if (pathWriter) 
+  if (pathWriter && !LazyPathRecording)
     state->pathOS = pathWriter->open();
-  if (symPathWriter) 
+  if (symPathWriter && !LazyPathRecording)
     state->symPathOS = symPathWriter->open();
 
+  if (!CheckpointDir.empty() && !pathWriter)
+    klee_error("-checkpoint-dir requires -write-paths");
+  if (SwapColdStates && !pathWriter)
+    klee_error("-swap-cold-states requires -write-paths");
+
+  if (!resumePaths.empty()) {
+    // the initial state carries every checkpointed path
+    state->resumePrefixes.resize(resumePaths.size());
+    for (std::uint32_t i = 0; i != state->resumePrefixes.size(); ++i)
+      state->resumePrefixes[i] = i;
+  }
+
 
   if (statsTracker)
     statsTracker->framePushed(*state, 0);
@@ -4488,24 +6886,57 @@ void Executor::runFunctionAsMain(Function *f,
   run(*state);
   processTree = nullptr;
 
-  // hack to clear memory objects
+  // hack to clear memory objects; the shared constant-global bindings
+  // must go first, before the objects they refer to
+  AddressSpace::clearImmortalObjects();
   delete memory;
   memory = new MemoryManager(NULL);
 
   globalObjects.clear();
   globalAddresses.clear();
 
+  // The remaining per-session tables refer to addresses handed out by the
+  // memory manager we just replaced; clear them so a subsequent session on
+  // this instance starts from a consistent slate. Everything keyed by the
+  // module itself (solver caches, jump tables, JITed blocks) is still
+  // valid and deliberately carried over.
+  legalFunctions.clear();
+  evalConstantMemo.clear();
+  if (subsumptionChecker)
+    subsumptionChecker->reset();
+  haltExecution = false;
+
   if (statsTracker)
     statsTracker->done();
 }
 
 unsigned Executor::getPathStreamID(const ExecutionState &state) {
   assert(pathWriter);
+  if (LazyPathRecording) {
+    // Materialize a linear stream on demand; only states that actually
+    // get written ever reach the writer.
+    std::vector<unsigned char> decisions;
+    linearizeBranchHistory(state.branchHistory.get(), decisions);
+    TreeOStream os = pathWriter->open();
+    if (!decisions.empty())
+      os.write(reinterpret_cast<const char *>(decisions.data()),
+               decisions.size());
+    return os.getID();
+  }
   return state.pathOS.getID();
 }
 
 unsigned Executor::getSymbolicPathStreamID(const ExecutionState &state) {
   assert(symPathWriter);
+  if (LazyPathRecording) {
+    std::vector<unsigned char> decisions;
+    linearizeBranchHistory(state.symBranchHistory.get(), decisions);
+    TreeOStream os = symPathWriter->open();
+    if (!decisions.empty())
+      os.write(reinterpret_cast<const char *>(decisions.data()),
+               decisions.size());
+    return os.getID();
+  }
   return state.symPathOS.getID();
 }
 
@@ -4562,8 +6993,9 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
   // also make understanding individual test cases much easier.
   for (unsigned i = 0; i != state.symbolics.size(); ++i) {
     const auto &mo = state.symbolics[i].first;
+    const auto &cexPreferences = mo->getCexPreferences();
     std::vector< ref<Expr> >::const_iterator pi = 
-      mo->cexPreferences.begin(), pie = mo->cexPreferences.end();
+      cexPreferences.begin(), pie = cexPreferences.end();
     for (; pi != pie; ++pi) {
       bool mustBeTrue;
       // Attempt to bound byte to constraints held in cexPreferences
@@ -4597,8 +7029,11 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
     return false;
   }
   
+  res.reserve(state.symbolics.size());
   for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    res.push_back(std::make_pair(state.symbolics[i].first->name, values[i]));
+    // Moved, not copied: the byte vectors go straight from the solver
+    // into the test case on their way to the ktest writer.
+    res.emplace_back(state.symbolics[i].first->getName(), std::move(values[i]));
   return true;
 }
 
@@ -4607,37 +7042,67 @@ void Executor::getCoveredLines(const ExecutionState &state,
   res = state.coveredLines;
 }
 
+std::size_t
+Executor::ImpliedValueKeyHash::operator()(const ImpliedValueKey &k) const {
+  return k.e->hash() * 0x9e3779b97f4a7c15ULL + k.value->hash();
+}
+
 void Executor::doImpliedValueConcretization(ExecutionState &state,
                                             ref<Expr> e,
                                             ref<ConstantExpr> value) {
-  abort(); // FIXME: Broken until we sort out how to do the write back.
-
   if (DebugCheckForImpliedValues)
     ImpliedValue::checkForImpliedValues(solver->solver.get(), e, value);
 
-  ImpliedValueList results;
-  ImpliedValue::getImpliedValues(e, value, results);
-  for (ImpliedValueList::iterator it = results.begin(), ie = results.end();
-       it != ie; ++it) {
-    ReadExpr *re = it->first.get();
-    
-    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
-      // FIXME: This is the sole remaining usage of the Array object
-      // variable. Kill me.
-      const MemoryObject *mo = 0; //re->updates.root->object;
-      const ObjectState *os = state.addressSpace.findObject(mo);
-
-      if (!os) {
-        // object has been free'd, no need to concretize (although as
-        // in other cases we would like to concretize the outstanding
-        // reads, but we have no facility for that yet)
-      } else {
-        assert(!os->readOnly && 
-               "not possible? read only object with static read?");
-        ObjectState *wos = state.addressSpace.getWriteable(mo, os);
-        wos->write(CE, it->second);
+  // Propagation only inspects the expression, so its results can be
+  // memoized across states.
+  ImpliedValueKey key{e, value};
+  auto cached = impliedValueCache.find(key);
+  if (cached == impliedValueCache.end()) {
+    ImpliedValueList results;
+    ImpliedValue::getImpliedValues(e, value, results);
+    cached =
+        impliedValueCache.emplace(std::move(key), std::move(results)).first;
+  }
+
+  for (const auto &implied : cached->second) {
+    ReadExpr *re = implied.first.get();
+
+    // Only direct reads of the symbolic array can be written back; a
+    // read through an update list constrains an older version of the
+    // object than the one the state sees now.
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index);
+    if (!CE || !re->updates.head.isNull())
+      continue;
+
+    // Map the array back to the object it was made symbolic from.
+    const MemoryObject *mo = nullptr;
+    for (const auto &symbolic : state.symbolics) {
+      if (symbolic.second == re->updates.root) {
+        mo = symbolic.first.get();
+        break;
       }
     }
+    if (!mo)
+      continue;
+
+    // The object may have been freed; no need to concretize (although
+    // as in other cases we would like to concretize the outstanding
+    // reads, but we have no facility for that yet).
+    const ObjectState *os = state.addressSpace.findObject(mo);
+    if (!os || os->readOnly)
+      continue;
+
+    // Write back only if the byte still holds the original symbolic
+    // read: the implied value constrains the array, not whatever the
+    // program may have stored over that byte since.
+    unsigned offset = CE->getZExtValue();
+    if (offset >= mo->size ||
+        os->read8(offset) !=
+            ReadExpr::create(UpdateList(re->updates.root, nullptr), re->index))
+      continue;
+
+    ObjectState *wos = state.addressSpace.getWriteable(mo, os);
+    wos->write(offset, implied.second);
   }
 }
 
@@ -16,24 +16,33 @@
 #define KLEE_EXECUTOR_H
 
 #include "ExecutionState.h"
+#include "ImpliedValue.h"
 #include "UserSearcher.h"
 
 #include "klee/ADT/RNG.h"
 #include "klee/Core/Interpreter.h"
 #include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/ArrayExprOptimizer.h"
+#include "klee/Expr/ExprCanonicalizer.h"
 #include "klee/Module/Cell.h"
 #include "klee/Module/KInstruction.h"
 #include "klee/Module/KModule.h"
+#include "klee/Solver/Solver.h"
 #include "klee/System/Time.h"
 
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -51,12 +60,14 @@ namespace llvm {
   class Instruction;
   class LLVMContext;
   class DataLayout;
+  class SwitchInst;
   class Twine;
   class Value;
 }
 
-namespace klee {  
+namespace klee {
   class Array;
+  class BranchFeasibilityDB;
   struct Cell;
   class ExecutionState;
   class ExternalDispatcher;
@@ -70,6 +81,7 @@ namespace klee {
   class MemoryObject;
   class ObjectState;
   class PTree;
+  class SearchProfile;
   class Searcher;
   class SeedInfo;
   class SpecialFunctionHandler;
@@ -79,6 +91,7 @@ namespace klee {
   class TreeStreamWriter;
   class MergeHandler;
   class MergingSearcher;
+  class SubsumptionChecker;
   template<class T> class ref;
 
 
@@ -130,6 +143,9 @@ private:
 
   ExternalDispatcher *externalDispatcher;
   TimingSolver *solver;
+  /// Serializes interpretation in the parallel execution mode; released
+  /// by the per-worker TimingSolvers around underlying solver calls.
+  std::mutex interpreterMutex;
   MemoryManager *memory;
   std::set<ExecutionState*, ExecutionStateIDCompare> states;
   StatsTracker *statsTracker;
@@ -138,6 +154,14 @@ private:
   TimerGroup timers;
   std::unique_ptr<PTree> processTree;
 
+  /// Prior-run branch productivity loaded with -search-profile, used to
+  /// warm-start random-path searchers. Null when starting cold.
+  std::unique_ptr<SearchProfile> priorSearchProfile;
+
+  /// Branch productivity being accumulated for -write-search-profile;
+  /// persisted to <output-dir>/search.profile when the run ends.
+  std::unique_ptr<SearchProfile> searchProfile;
+
   /// Used to track states that have been added during the current
   /// instructions step. 
   /// \invariant \ref addedStates is a subset of \ref states. 
@@ -165,10 +189,108 @@ private:
   /// globals that have no representative object (i.e. functions).
   std::map<const llvm::GlobalValue*, ref<ConstantExpr> > globalAddresses;
 
+  /// Memo table of lowered composite constants, populated on first use
+  /// (\see evalConstant()). Valid for the lifetime of the module since
+  /// global addresses do not change once bound.
+  std::unordered_map<const llvm::Constant *, ref<ConstantExpr>>
+      evalConstantMemo;
+
   /// Map of legal function addresses to the corresponding Function.
   /// Used to validate and dereference function pointers.
   std::unordered_map<std::uint64_t, llvm::Function*> legalFunctions;
 
+  /// Lazily built per-SwitchInst tables mapping case value to successor
+  /// index, so a concrete selector dispatches with one hash lookup
+  /// instead of a linear scan of the case list.
+  std::unordered_map<const llvm::SwitchInst *,
+                     std::unordered_map<std::uint64_t, unsigned>>
+      switchJumpTables;
+
+  /// Result of the static eligibility analysis for the concrete-region
+  /// JIT fast path (-jit-concrete-blocks): the prefix of a basic
+  /// block's non-PHI body that consists purely of integer computation.
+  /// A zero count marks a block that is ineligible (or was disabled
+  /// after a JIT failure).
+  struct ConcreteRegionInfo {
+    /// Number of instructions in the region, starting at the block's
+    /// first non-PHI instruction.
+    unsigned count = 0;
+    /// Number of distinct values flowing into the region.
+    unsigned numInputs = 0;
+    /// For each input, the (instruction offset, operand index) of its
+    /// first use within the region, in slot order.
+    std::vector<std::pair<unsigned, unsigned>> inputs;
+  };
+
+  /// Cache of per-block region analyses. \see tryJITConcreteBlock()
+  std::unordered_map<const llvm::BasicBlock *, ConcreteRegionInfo>
+      concreteRegions;
+
+  /// A memoized call to a pure leaf function: the callee plus the
+  /// argument expressions, compared structurally.
+  struct FunctionSummaryKey {
+    KFunction *kf;
+    std::vector<ref<Expr>> args;
+
+    bool operator==(const FunctionSummaryKey &b) const {
+      return kf == b.kf && args == b.args;
+    }
+  };
+
+  struct FunctionSummaryKeyHash {
+    std::size_t operator()(const FunctionSummaryKey &k) const;
+  };
+
+  /// Memoized (arguments -> return value) summaries of pure leaf
+  /// functions (-use-function-summaries). \see KFunction::isPureLeaf
+  std::unordered_map<FunctionSummaryKey, ref<Expr>, FunctionSummaryKeyHash>
+      functionSummaries;
+
+  /// Errors seen so far, keyed by (faulting instruction, error type,
+  /// call-stack hash): the instance count and the first instance's
+  /// "file:line: message" for the exit summary. Only the first
+  /// -max-error-reports-per-class instances of a class have their
+  /// diagnostics and test case materialized; the rest are counted.
+  std::map<std::tuple<const llvm::Instruction *, int, std::uint64_t>,
+           std::pair<unsigned, std::string>>
+      errorClassCounts;
+
+  struct ImpliedValueKey {
+    ref<Expr> e;
+    ref<ConstantExpr> value;
+
+    bool operator==(const ImpliedValueKey &b) const {
+      return e == b.e && value == b.value;
+    }
+  };
+
+  struct ImpliedValueKeyHash {
+    std::size_t operator()(const ImpliedValueKey &k) const;
+  };
+
+  /// Batch canonicalizer for constraint sets
+  /// (-canonicalize-constraints-watermark); memoizes across states.
+  ExprCanonicalizer exprCanonicalizer;
+
+  /// Memoized implied-value propagation results
+  /// (-use-implied-value-concretization), keyed by the constrained
+  /// (expression, value) pair. Propagation is purely syntactic, so
+  /// entries are shared across states.
+  std::unordered_map<ImpliedValueKey, ImpliedValueList, ImpliedValueKeyHash>
+      impliedValueCache;
+
+  /// AFL-style shared coverage bitmap mapped from -coverage-shm-file,
+  /// or null. Every CFG edge taken bumps a byte counter at
+  /// hash(prev, cur); external schedulers (and other KLEE or fuzzer
+  /// instances mapping the same file) observe coverage in real time.
+  /// Concurrent updates race benignly, as in AFL.
+  unsigned char *coverageBitmap = nullptr;
+
+  /// Cache of per-block location ids for the coverage bitmap, derived
+  /// from the function name and block position so that ids agree
+  /// across processes executing the same module.
+  std::unordered_map<const llvm::BasicBlock *, std::uint32_t> coverageLocs;
+
   /// When non-null the bindings that will be used for calls to
   /// klee_make_symbolic in order replay.
   const struct KTest *replayKTest;
@@ -176,6 +298,19 @@ private:
   /// When non-null a list of branch decisions to be used for replay.
   const std::vector<bool> *replayPath;
 
+  /// When true \ref replayPath only fixes a path prefix: once its
+  /// decisions are exhausted, exploration continues normally instead of
+  /// requiring the path to cover the whole run.
+  bool replayPathIsPrefix;
+
+  /// Branch paths of a checkpointed state set being reconstructed;
+  /// states carry indices into this vector (ExecutionState::resumePrefixes).
+  std::vector<std::vector<bool>> resumePaths;
+
+  /// Number of states swapped out to <output-dir>/swapped under memory
+  /// pressure; used to name their path files uniquely.
+  unsigned swappedStates;
+
   /// The index into the current \ref replayKTest or \ref replayPath
   /// object.
   unsigned replayPosition;
@@ -203,12 +338,31 @@ private:
   /// (e.g. for a single STP query)
   time::Span coreSolverTimeout;
 
+  /// Fork outcome history shared across runs (-branch-feasibility-db);
+  /// null when disabled.
+  std::unique_ptr<BranchFeasibilityDB> branchFeasibilityDB;
+
+  /// Timeout for the speculative query tried at branches the
+  /// feasibility database predicts one-sided.
+  time::Span branchFeasibilitySpeculativeTimeout;
+
   /// Maximum time to allow for a single instruction.
   time::Span maxInstructionTime;
 
   /// Assumes ownership of the created array objects
   ArrayCache arrayCache;
 
+  /// Number of states terminated since arrayCache was last asked to
+  /// reclaim unreferenced arrays.
+  unsigned terminatedSinceArrayGC = 0;
+
+  /// Terminated states whose destruction has been deferred
+  /// (-state-reclamation-batch): already removed from \ref states, the
+  /// searcher, the seed map and the process tree, awaiting only their
+  /// delete. Drained a bounded amount per scheduling step so mass
+  /// terminations do not stall a single step.
+  std::vector<ExecutionState *> deferredReclamation;
+
   /// File to print executed instructions to
   std::unique_ptr<llvm::raw_ostream> debugInstFile;
 
@@ -225,9 +379,78 @@ private:
   /// `nullptr` if merging is disabled
   MergingSearcher *mergingSearcher = nullptr;
 
+  /// Prunes states subsumed by already-explored siblings,
+  /// `nullptr` unless -use-subsumption is given
+  std::unique_ptr<SubsumptionChecker> subsumptionChecker;
+
   /// Typeids used during exception handling
   std::vector<ref<Expr>> eh_typeids;
 
+  /// A branch feasibility query submitted to the background solver
+  /// thread (-fork-query-prefetch) before its state was handed back to
+  /// the searcher. Consumed by fork() the next time the state runs.
+  struct PrefetchedForkQuery {
+    ConstraintSet constraints;
+    ref<Expr> condition;
+    Solver::Validity validity = Solver::Unknown;
+    bool success = false;
+    bool ready = false;
+    time::Span cost;
+  };
+
+  /// In-flight and completed prefetched queries, keyed by state.
+  /// Protected by \ref prefetchMutex; entries are purged when their
+  /// state is removed.
+  std::map<const ExecutionState *, PrefetchedForkQuery> prefetchedForkQueries;
+  std::deque<const ExecutionState *> prefetchQueue;
+
+  /// A feasibility query solved speculatively for a conditional branch
+  /// the CFG lookahead found in a paused state's upcoming basic blocks,
+  /// before execution reaches it. Keyed by constraint-set version and
+  /// condition hash rather than by state so the result stays usable as
+  /// long as the constraint set does not change.
+  struct SpeculativeForkQuery {
+    ConstraintSet constraints;
+    ref<Expr> condition;
+    Solver::Validity validity = Solver::Unknown;
+    bool success = false;
+    bool ready = false;
+    time::Span cost;
+  };
+
+  /// Speculative lookahead queries, protected by \ref prefetchMutex.
+  /// The background thread drains \ref speculativeQueue only while
+  /// \ref prefetchQueue is empty, so speculation consumes solver idle
+  /// time and never delays a query the interpreter is about to need.
+  std::map<std::pair<std::uint64_t, unsigned>, SpeculativeForkQuery>
+      speculativeForkQueries;
+  std::deque<std::pair<std::uint64_t, unsigned>> speculativeQueue;
+  static const size_t MaxSpeculativeForkQueries = 256;
+  std::mutex prefetchMutex;
+  std::condition_variable prefetchCond;
+  std::unique_ptr<TimingSolver> prefetchSolver;
+  std::thread prefetchThread;
+  bool prefetchShutdown = false;
+
+  void startForkQueryPrefetchThread();
+  void stopForkQueryPrefetchThread();
+  /// Body of the background solver thread.
+  void forkQueryPrefetchLoop();
+  /// If \p state is paused before a symbolic conditional branch, submit
+  /// the branch feasibility query to the background solver.
+  void prefetchForkQuery(ExecutionState &state);
+  /// Walk the CFG forward from \p state's pc over the next few basic
+  /// blocks and submit speculative feasibility queries for conditional
+  /// branches whose condition value is already computed, so the answers
+  /// are hot by the time execution reaches them.
+  void prefetchLookaheadQueries(ExecutionState &state);
+  /// Look up a prefetched result for (\p state, \p condition); waits for
+  /// an in-flight query rather than re-issuing it. Returns false when
+  /// nothing was prefetched (or the condition has since been rewritten)
+  /// and the caller must query the solver itself.
+  bool consumePrefetchedForkQuery(ExecutionState &state, ref<Expr> condition,
+                                  Solver::Validity &res, bool &success);
+
   /// Return the typeid corresponding to a certain `type_info`
   ref<ConstantExpr> getEhTypeidFor(ref<Expr> type_info);
 
@@ -238,6 +461,14 @@ private:
 
   void run(ExecutionState &initialState);
 
+  /// Main loop of the parallel execution mode: worker threads pull
+  /// states from per-worker work-stealing deques and execute them with
+  /// private solver chains. Interpretation is serialized by
+  /// \ref interpreterMutex, which TimingSolver releases around
+  /// underlying solver invocations, so queries from different workers
+  /// overlap with each other and with interpretation.
+  void runParallel();
+
   // Given a concrete object in our [klee's] address space, add it to 
   // objects checked code can reference.
   MemoryObject *addExternalObject(ExecutionState &state, void *addr, 
@@ -253,7 +484,76 @@ private:
   void initializeGlobalObjects(ExecutionState &state);
 
   void stepInstruction(ExecutionState &state);
+  /// Step and execute the second half of a superinstruction pair
+  /// (\see KInstruction::fuseNext) in the same dispatch step.
+  void executeFusedSuccessor(ExecutionState &state);
   void updateStates(ExecutionState *current);
+
+  /// Delete up to \p max states from \ref deferredReclamation.
+  void reclaimTerminatedStates(size_t max);
+
+  /// Analyze (and cache) the concrete-region eligibility of \p bb.
+  const ConcreteRegionInfo &analyzeConcreteRegion(const llvm::BasicBlock *bb);
+
+  /// If the state is at the head of a basic block whose body is an
+  /// eligible all-concrete integer region, execute the whole region
+  /// natively via the external dispatcher's JIT and bind the results,
+  /// leaving the state at the first uncovered instruction. Returns
+  /// false (having executed nothing) if the block is ineligible or any
+  /// region input is symbolic.
+  bool tryJITConcreteBlock(ExecutionState &state);
+
+  /// If \p ki is the conditional branch of a summarizable counting
+  /// loop (\see KFunction::loopSummaries), bind the closed-form exit
+  /// values of the loop phis and transfer the state to the exit block
+  /// instead of unrolling the loop. Returns false (having executed
+  /// nothing) if the branch closes no summarizable loop.
+  bool trySummarizeLoop(ExecutionState &state, KInstruction *ki);
+
+  /// Return the stable bitmap location id of \p bb, computing and
+  /// caching it on first use.
+  std::uint32_t coverageLoc(llvm::BasicBlock *bb);
+
+  /// Count the edge from the state's previous location to \p dst in
+  /// the shared coverage bitmap. Only called when it is mapped.
+  void recordCoverageEdge(ExecutionState &state, llvm::BasicBlock *dst);
+
+  /// Precompute the dispatch handler of every instruction in the
+  /// module. \see KInstruction::handler
+  void installInstructionHandlers();
+
+  // Precomputed dispatch handlers (\see KInstruction::handler). Each
+  // implements exactly the corresponding case of the opcode switch in
+  // executeInstruction(), which remains the fallback for opcodes
+  // without a handler.
+  template <typename BE>
+  static void executeBinaryHandler(Executor &executor, ExecutionState &state,
+                                   KInstruction *ki);
+  template <typename EE>
+  static void executeExtHandler(Executor &executor, ExecutionState &state,
+                                KInstruction *ki);
+  static void executeTruncHandler(Executor &executor, ExecutionState &state,
+                                  KInstruction *ki);
+  static void executeBitCastHandler(Executor &executor, ExecutionState &state,
+                                    KInstruction *ki);
+  static void executeSelectHandler(Executor &executor, ExecutionState &state,
+                                   KInstruction *ki);
+
+  // Vector variants, installed when the instruction operates on integer
+  // vectors (only reachable with -scalarize-vectors=false). Vectors are
+  // kept in their packed little-endian bitvector representation; the
+  // handlers apply the operation lane-wise, so fully concrete vectors
+  // fold straight back into a packed constant.
+  template <typename BE>
+  static void executeVectorBinaryHandler(Executor &executor,
+                                         ExecutionState &state,
+                                         KInstruction *ki);
+  static void executeVectorCastHandler(Executor &executor,
+                                       ExecutionState &state,
+                                       KInstruction *ki);
+  static void executeVectorSelectHandler(Executor &executor,
+                                         ExecutionState &state,
+                                         KInstruction *ki);
   void transferToBasicBlock(llvm::BasicBlock *dst, 
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
@@ -356,6 +656,14 @@ private:
   // current state, and one of the states may be null.
   StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal);
 
+  /// When -use-auto-merge is active and the branch the state is
+  /// executing has an inferred merge point (the post-dominator of its
+  /// block), open a merge region on the state, as if the region were
+  /// wrapped in klee_open_merge()/klee_close_merge(). States created by
+  /// the subsequent fork inherit the region and are merged back when
+  /// they reach the merge point.
+  void openAutoMergeRegion(ExecutionState &state);
+
   // If the MaxStatic*Pct limits have been reached, concretize the condition and
   // return it. Otherwise, return the unmodified condition.
   ref<Expr> maxStaticPctChecks(ExecutionState &current, ref<Expr> condition);
@@ -376,12 +684,16 @@ private:
   Cell& getArgumentCell(ExecutionState &state,
                         KFunction *kf,
                         unsigned index) {
-    return state.stack.back().locals[kf->getArgRegister(index)];
+    StackFrame &sf = state.stack.back();
+    sf.ensureWritableLocals();
+    return sf.locals[kf->getArgRegister(index)];
   }
 
   Cell& getDestCell(ExecutionState &state,
                     KInstruction *target) {
-    return state.stack.back().locals[target->dest];
+    StackFrame &sf = state.stack.back();
+    sf.ensureWritableLocals();
+    return sf.locals[target->dest];
   }
 
   void bindLocal(KInstruction *target, 
@@ -400,24 +712,47 @@ private:
 
   /// Evaluates an LLVM constant.  The optional argument ki is the
   /// instruction where this constant was encountered, or NULL if
-  /// not applicable/unavailable.
+  /// not applicable/unavailable. Results for composite constants are
+  /// memoized in evalConstantMemo.
   ref<klee::ConstantExpr> evalConstant(const llvm::Constant *c,
 				       const KInstruction *ki = NULL);
 
+  /// Does the actual lowering for evalConstant().
+  ref<klee::ConstantExpr> evalConstantImpl(const llvm::Constant *c,
+                                           const KInstruction *ki);
+
   /// Return a unique constant value for the given expression in the
   /// given state, if it has one (i.e. it provably only has a single
   /// value). Otherwise return the original expression.
   ref<Expr> toUnique(const ExecutionState &state, ref<Expr> &e);
 
+  /// Track the (bounded) expression node estimate of \p state as
+  /// \p condition is added, running mitigateExpressionGrowth() once the
+  /// -expr-node-watermark is crossed.
+  void accountExpressionGrowth(ExecutionState &state,
+                               const ref<Expr> &condition);
+  /// Shrink a state whose expression graph passed the watermark:
+  /// re-simplify and constant-fold the top frame's registers, then
+  /// re-measure and, past the hard watermark, mark the state throttled.
+  void mitigateExpressionGrowth(ExecutionState &state);
+
   /// Return a constant value for the given expression, forcing it to
   /// be constant in the given state by adding a constraint if
   /// necessary. Note that this function breaks completeness and
   /// should generally be avoided.
   ///
   /// \param purpose An identify string to printed in case of concretization.
-  ref<klee::ConstantExpr> toConstant(ExecutionState &state, ref<Expr> e, 
+  ref<klee::ConstantExpr> toConstant(ExecutionState &state, ref<Expr> e,
                                      const char *purpose);
 
+  /// getValue through the state's concretization cache: a witness
+  /// derived earlier is reused as long as no constraint mentioning one
+  /// of the expression's arrays has been added since (see
+  /// ExecutionState::concretizationCache). Returns false on solver
+  /// failure.
+  bool getValueConcretization(ExecutionState &state, ref<Expr> e,
+                              ref<ConstantExpr> &result);
+
   /// Bind a constant value for e to the given target. NOTE: This
   /// function may fork state if the state has multiple seeds.
   void executeGetValue(ExecutionState &state, ref<Expr> e, KInstruction *target);
@@ -482,6 +817,10 @@ private:
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
 
+  /// Write the branch paths of all live states into -checkpoint-dir,
+  /// replacing the previous checkpoint; requires the path writer.
+  void writeCheckpoint();
+
   /// Only for debug purposes; enable via debugger or klee-control
   void dumpStates();
   void dumpPTree();
@@ -507,12 +846,19 @@ public:
     replayPosition = 0;
   }
 
-  void setReplayPath(const std::vector<bool> *path) override {
+  void setReplayPath(const std::vector<bool> *path,
+                     bool isPrefix = false) override {
     assert(!replayKTest && "cannot replay both buffer and path");
     replayPath = path;
+    replayPathIsPrefix = isPrefix;
     replayPosition = 0;
   }
 
+  void setResumePaths(std::vector<std::vector<bool>> &&paths) override {
+    assert(!replayKTest && !replayPath && "cannot combine replay and resume");
+    resumePaths = std::move(paths);
+  }
+
   llvm::Module *setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
                           const ModuleOptions &opts) override;
 
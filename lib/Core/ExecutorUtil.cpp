@@ -34,6 +34,31 @@ namespace klee {
 
   ref<klee::ConstantExpr> Executor::evalConstant(const Constant *c,
                                                  const KInstruction *ki) {
+    // Lowering a composite constant recurses over its operands, and the
+    // same initializer or ConstantExpr chain is typically referenced
+    // many times (switch case values, global initializers), so memoize
+    // those. Leaves are cheap to rebuild, and the zero-size landingpad
+    // special case makes some leaf results depend on ki. Instructions
+    // only execute under the interpreter lock, so the table needs no
+    // further synchronization.
+    bool memoize = isa<llvm::ConstantExpr>(c) || isa<ConstantStruct>(c) ||
+                   isa<ConstantArray>(c) || isa<ConstantVector>(c) ||
+                   isa<ConstantDataSequential>(c);
+    if (memoize) {
+      auto it = evalConstantMemo.find(c);
+      if (it != evalConstantMemo.end())
+        return it->second;
+    }
+
+    ref<klee::ConstantExpr> result = evalConstantImpl(c, ki);
+
+    if (memoize)
+      evalConstantMemo.emplace(c, result);
+    return result;
+  }
+
+  ref<klee::ConstantExpr> Executor::evalConstantImpl(const Constant *c,
+                                                     const KInstruction *ki) {
     if (!ki) {
       KConstant* kc = kmodule->getKConstant(c);
       if (kc)
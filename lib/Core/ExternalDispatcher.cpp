@@ -48,8 +48,17 @@ class ExternalDispatcherImpl {
 private:
   typedef std::map<const llvm::Instruction *, llvm::Function *> dispatchers_ty;
   dispatchers_ty dispatchers;
+  dispatchers_ty regionDispatchers;
+  /// Dispatchers keyed by target symbol and passed argument types, so
+  /// that different callsites needing an identical trampoline share one
+  /// instead of paying the JIT cost again.
+  std::map<std::string, llvm::Function *> signatureDispatchers;
+  std::string getCallSignature(llvm::Function *f, llvm::Instruction *i);
   llvm::Function *createDispatcher(llvm::Function *f, llvm::Instruction *i,
                                    llvm::Module *module);
+  llvm::Function *createRegionDispatcher(llvm::Instruction *begin,
+                                         unsigned count, unsigned numInputs,
+                                         llvm::Module *module);
   llvm::ExecutionEngine *executionEngine;
   LLVMContext &ctx;
   std::map<std::string, void *> preboundFunctions;
@@ -64,6 +73,8 @@ public:
   ~ExternalDispatcherImpl();
   bool executeCall(llvm::Function *function, llvm::Instruction *i,
                    uint64_t *args);
+  bool executeConcreteRegion(llvm::Instruction *begin, unsigned count,
+                             unsigned numInputs, uint64_t *args);
   void *resolveSymbol(const std::string &name);
   int getLastErrno();
   void setLastErrno(int newErrno);
@@ -164,6 +175,16 @@ bool ExternalDispatcherImpl::executeCall(Function *f, Instruction *i,
     return runProtectedCall(it->second, args);
   }
 
+  // A trampoline only depends on the target symbol and the types the
+  // arguments are passed as, so a dispatcher JIT'ed for another callsite
+  // with the same signature can be reused directly.
+  std::string signature = getCallSignature(f, i);
+  auto sigIt = signatureDispatchers.find(signature);
+  if (sigIt != signatureDispatchers.end()) {
+    dispatchers.insert(std::make_pair(i, sigIt->second));
+    return runProtectedCall(sigIt->second, args);
+  }
+
   // Code for this not JIT'ed. Do this now.
   Function *dispatcher;
 #ifdef WINDOWS
@@ -202,6 +223,7 @@ bool ExternalDispatcherImpl::executeCall(Function *f, Instruction *i,
     executionEngine->finalizeObject();
     assert(fnAddr && "failed to get function address");
     (void)fnAddr;
+    signatureDispatchers.insert(std::make_pair(signature, dispatcher));
   } else {
     // MCJIT didn't take ownership of the module so delete it.
     delete dispatchModule;
@@ -209,6 +231,35 @@ bool ExternalDispatcherImpl::executeCall(Function *f, Instruction *i,
   return runProtectedCall(dispatcher, args);
 }
 
+bool ExternalDispatcherImpl::executeConcreteRegion(Instruction *begin,
+                                                   unsigned count,
+                                                   unsigned numInputs,
+                                                   uint64_t *args) {
+  dispatchers_ty::iterator it = regionDispatchers.find(begin);
+  if (it != regionDispatchers.end()) {
+    // Code already JIT'ed for this region.
+    return runProtectedCall(it->second, args);
+  }
+
+  // As with call dispatchers, the MCJIT generates whole modules at a
+  // time so every region gets a module of its own.
+  Module *dispatchModule = new Module(getFreshModuleID(), ctx);
+  Function *dispatcher =
+      createRegionDispatcher(begin, count, numInputs, dispatchModule);
+  regionDispatchers.insert(std::make_pair(begin, dispatcher));
+
+  auto dispatchModuleUniq = std::unique_ptr<Module>(dispatchModule);
+  executionEngine->addModule(std::move(dispatchModuleUniq)); // MCJIT takes ownership
+  // Force code generation
+  uint64_t fnAddr =
+      executionEngine->getFunctionAddress(dispatcher->getName().str());
+  executionEngine->finalizeObject();
+  assert(fnAddr && "failed to get region function address");
+  (void)fnAddr;
+
+  return runProtectedCall(dispatcher, args);
+}
+
 // FIXME: This is not reentrant.
 static uint64_t *gTheArgsP;
 bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
@@ -242,6 +293,35 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
   return res;
 }
 
+// Build a key identifying the trampoline a callsite needs: the target
+// symbol plus the types its arguments are passed as (mirroring the
+// argument handling in createDispatcher, including calls to bitcasted
+// functions). Callsites with equal keys get identical dispatchers.
+std::string ExternalDispatcherImpl::getCallSignature(Function *target,
+                                                     Instruction *inst) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(8, 0)
+  const CallBase &cs = cast<CallBase>(*inst);
+#else
+  const CallSite cs(inst->getOpcode() == Instruction::Call
+                        ? CallSite(cast<CallInst>(inst))
+                        : CallSite(cast<InvokeInst>(inst)));
+#endif
+
+  FunctionType *FTy = cast<FunctionType>(
+      cast<PointerType>(target->getType())->getElementType());
+
+  std::string signature;
+  llvm::raw_string_ostream ss(signature);
+  ss << target->getName();
+  unsigned i = 0;
+  for (auto ai = cs.arg_begin(), ae = cs.arg_end(); ai != ae; ++ai, ++i) {
+    auto argTy =
+        (i < FTy->getNumParams() ? FTy->getParamType(i) : (*ai)->getType());
+    ss << '|' << *argTy;
+  }
+  return ss.str();
+}
+
 // FIXME: This might have been relevant for the old JIT but the MCJIT
 // has a completly different implementation so this comment below is
 // likely irrelevant and misleading.
@@ -329,6 +409,89 @@ Function *ExternalDispatcherImpl::createDispatcher(Function *target,
   return dispatcher;
 }
 
+// Build a nullary function computing a straight-line region of integer
+// instructions: each region instruction is cloned with its operands
+// remapped to either an earlier clone, an inlined integer constant, or
+// a value loaded from gTheArgsP, and its result is stored back through
+// gTheArgsP so the Executor can bind it to the corresponding register.
+// Input slots are assigned in first-use order over (instruction,
+// operand) pairs; the Executor's region analysis walks operands in the
+// same order, so both sides agree on the layout without exchanging it.
+Function *ExternalDispatcherImpl::createRegionDispatcher(Instruction *begin,
+                                                         unsigned count,
+                                                         unsigned numInputs,
+                                                         Module *module) {
+  // MCJIT functions need unique names, or wrong function can be called.
+  std::string fnName = "region_dispatcher_" + module->getModuleIdentifier();
+  std::vector<Type *> nullary;
+  Function *dispatcher =
+      Function::Create(FunctionType::get(Type::getVoidTy(ctx), nullary, false),
+                       GlobalVariable::ExternalLinkage, fnName, module);
+
+  BasicBlock *dBB = BasicBlock::Create(ctx, "entry", dispatcher);
+
+  llvm::IRBuilder<> Builder(dBB);
+  // Get a Value* for &gTheArgsP, as an i64**.
+  auto argI64sp = Builder.CreateIntToPtr(
+      ConstantInt::get(Type::getInt64Ty(ctx), (uintptr_t)(void *)&gTheArgsP),
+      PointerType::getUnqual(PointerType::getUnqual(Type::getInt64Ty(ctx))),
+      "argsp");
+  auto argI64s = Builder.CreateLoad(argI64sp, "args");
+
+  // Maps region-internal results and already-loaded inputs from the
+  // original values to their counterparts in this module.
+  std::map<const Value *, Value *> materialized;
+  unsigned nextInput = 0;
+
+  Instruction *inst = begin;
+  for (unsigned k = 0; k != count; ++k, inst = inst->getNextNode()) {
+    Instruction *clone = inst->clone();
+    // The interpreter's integer semantics are total, so keep the native
+    // code total as well (e.g. an nsw add must still wrap).
+    clone->dropPoisonGeneratingFlags();
+
+    for (unsigned j = 0, e = clone->getNumOperands(); j != e; ++j) {
+      Value *op = inst->getOperand(j);
+      std::map<const Value *, Value *>::iterator mi = materialized.find(op);
+      if (mi != materialized.end()) {
+        clone->setOperand(j, mi->second);
+        continue;
+      }
+      if (isa<ConstantInt>(op))
+        continue;
+
+      // First use of a region input; load it from its args slot.
+      assert(nextInput < numInputs && "region input layout mismatch");
+      auto opI64p = Builder.CreateGEP(
+          nullptr, argI64s, ConstantInt::get(Type::getInt32Ty(ctx), nextInput));
+      auto opp = Builder.CreateBitCast(opI64p,
+                                       PointerType::getUnqual(op->getType()));
+      Value *loaded = Builder.CreateLoad(opp);
+      materialized.insert(std::make_pair(op, loaded));
+      clone->setOperand(j, loaded);
+      ++nextInput;
+    }
+
+    Builder.Insert(clone);
+    materialized.insert(std::make_pair(inst, clone));
+
+    // Write the result into its output slot. The Executor zeroes the
+    // args array, so a narrow store leaves the value zero-extended.
+    auto resI64p = Builder.CreateGEP(
+        nullptr, argI64s,
+        ConstantInt::get(Type::getInt32Ty(ctx), numInputs + k));
+    auto resp =
+        Builder.CreateBitCast(resI64p, PointerType::getUnqual(clone->getType()));
+    Builder.CreateStore(clone, resp);
+  }
+
+  assert(nextInput == numInputs && "region input layout mismatch");
+
+  Builder.CreateRetVoid();
+
+  return dispatcher;
+}
+
 int ExternalDispatcherImpl::getLastErrno() { return lastErrno; }
 void ExternalDispatcherImpl::setLastErrno(int newErrno) {
   lastErrno = newErrno;
@@ -344,6 +507,13 @@ bool ExternalDispatcher::executeCall(llvm::Function *function,
   return impl->executeCall(function, i, args);
 }
 
+bool ExternalDispatcher::executeConcreteRegion(llvm::Instruction *begin,
+                                               unsigned count,
+                                               unsigned numInputs,
+                                               uint64_t *args) {
+  return impl->executeConcreteRegion(begin, count, numInputs, args);
+}
+
 void *ExternalDispatcher::resolveSymbol(const std::string &name) {
   return impl->resolveSymbol(name);
 }
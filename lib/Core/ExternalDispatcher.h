@@ -39,6 +39,18 @@ public:
    */
   bool executeCall(llvm::Function *function, llvm::Instruction *i,
                    uint64_t *args);
+
+  /* Execute a straight-line region of integer instructions natively,
+   * starting at begin and covering count instructions. The caller
+   * guarantees the region passed the Executor's eligibility analysis
+   * and supplies the concrete values flowing into the region in
+   * args[0..numInputs-1], zero-extended to 64 bits and ordered by first
+   * use; the result of the k'th instruction is written back into
+   * args[numInputs+k].
+   */
+  bool executeConcreteRegion(llvm::Instruction *begin, unsigned count,
+                             unsigned numInputs, uint64_t *args);
+
   void *resolveSymbol(const std::string &name);
 
   int getLastErrno();
@@ -26,9 +26,15 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <sstream>
 
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
 using namespace llvm;
 using namespace klee;
 
@@ -38,11 +44,62 @@ namespace {
                     cl::desc("Use constant arrays instead of updates when possible (default=true)\n"),
                     cl::init(true),
                     cl::cat(SolvingCat));
+
+  cl::opt<unsigned>
+  UpdateListCompactionThreshold(
+      "update-list-compaction-threshold",
+      cl::desc("Compact the update list of an object once it reaches this "
+               "many nodes and has doubled since the last compaction, "
+               "dropping constant-index writes shadowed by later writes.  "
+               "Set to 0 to disable (default=128)"),
+      cl::init(128),
+      cl::cat(SolvingCat));
 }
 
 /***/
 
 int MemoryObject::counter = 0;
+uint64_t ConcreteStorePage::nextVersion = 0;
+uint64_t ConcreteStorePage::currentRound = 0;
+
+uint64_t ConcreteStorePage::tryCompress() const {
+#ifdef HAVE_ZLIB_H
+  if (!compressed.empty())
+    return 0;
+  uLongf destLen = compressBound(data.size());
+  std::vector<uint8_t> out(destLen);
+  // Fastest level: the page may be inflated again soon, and even level
+  // 1 collapses the zeroed and repetitive pages we are after.
+  if (compress2(out.data(), &destLen, data.data(), data.size(),
+                Z_BEST_SPEED) != Z_OK)
+    return 0;
+  // Keep the page plain unless deflate pays clearly; a page that only
+  // shrinks a little is not worth the inflation on the next access.
+  if (destLen * 4 >= uLongf(rawSize) * 3)
+    return 0;
+  out.resize(destLen);
+  out.shrink_to_fit();
+  compressed = std::move(out);
+  data.clear();
+  data.shrink_to_fit();
+  return rawSize - destLen;
+#else
+  return 0;
+#endif
+}
+
+void ConcreteStorePage::decompress() const {
+#ifdef HAVE_ZLIB_H
+  data.resize(rawSize);
+  uLongf destLen = rawSize;
+  int res = uncompress(data.data(), &destLen, compressed.data(),
+                       compressed.size());
+  assert(res == Z_OK && destLen == rawSize && "corrupt compressed page");
+  (void)res;
+  compressed.clear();
+  compressed.shrink_to_fit();
+#endif
+}
 
 MemoryObject::~MemoryObject() {
   if (parent)
@@ -76,11 +133,10 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
     concreteMask(0),
     flushMask(0),
-    knownSymbolics(0),
     updates(0, 0),
+    updatesAtLastCompaction(0),
     size(mo->size),
     readOnly(false) {
   if (!UseConstantArrays) {
@@ -89,49 +145,97 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
+  allocateConcretePages();
 }
 
 
 ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
     concreteMask(0),
     flushMask(0),
-    knownSymbolics(0),
     updates(array, 0),
+    updatesAtLastCompaction(0),
     size(mo->size),
     readOnly(false) {
   makeSymbolic();
-  memset(concreteStore, 0, size);
+  allocateConcretePages();
 }
 
-ObjectState::ObjectState(const ObjectState &os) 
+ObjectState::ObjectState(const ObjectState &os)
   : copyOnWriteOwner(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    concretePages(os.concretePages),
+    concreteMask(os.concreteMask),
+    flushMask(os.flushMask),
+    knownSymbolics(os.knownSymbolics),
     updates(os.updates),
+    updatesAtLastCompaction(os.updatesAtLastCompaction),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
+}
+
+ObjectState::~ObjectState() {}
+
+void ObjectState::allocateConcretePages() {
+  concretePages.reserve((size + ConcreteStorePage::Size - 1) /
+                        ConcreteStorePage::Size);
+  for (unsigned remaining = size; remaining; ) {
+    unsigned pageSize = std::min(remaining, ConcreteStorePage::Size);
+    concretePages.push_back(new ConcreteStorePage(pageSize));
+    remaining -= pageSize;
+  }
+}
+
+void ObjectState::copyConcretesTo(uint8_t *dst,
+                                  std::vector<uint64_t> &syncedVersions) const {
+  // Version 0 is never taken by a page, so freshly allocated entries
+  // force a copy.
+  syncedVersions.resize(concretePages.size(), 0);
+  for (unsigned i = 0, e = concretePages.size(); i != e; ++i) {
+    const ConcreteStorePage *page = concretePages[i].get();
+    if (syncedVersions[i] != page->version) {
+      memcpy(dst, page->bytes().data(), page->size());
+      syncedVersions[i] = page->version;
+    }
+    dst += page->size();
   }
+}
 
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
+void ObjectState::markConcretesSynced(
+    std::vector<uint64_t> &syncedVersions) const {
+  syncedVersions.resize(concretePages.size(), 0);
+  for (unsigned i = 0, e = concretePages.size(); i != e; ++i)
+    syncedVersions[i] = concretePages[i]->version;
 }
 
-ObjectState::~ObjectState() {
-  delete concreteMask;
-  delete flushMask;
-  delete[] knownSymbolics;
-  delete[] concreteStore;
+bool ObjectState::concretesEqual(const uint8_t *src) const {
+  for (const auto &page : concretePages) {
+    if (memcmp(src, page->bytes().data(), page->size()) != 0)
+      return false;
+    src += page->size();
+  }
+  return true;
+}
+
+void ObjectState::copyConcretesFrom(const uint8_t *src) {
+  for (unsigned i = 0, e = concretePages.size(); i != e; ++i) {
+    const std::vector<uint8_t> &data = concretePages[i]->bytes();
+    // Only touched pages are copied; the rest stay shared with the
+    // states we forked from.
+    if (memcmp(src, data.data(), data.size()) != 0)
+      memcpy(getWritablePage(i)->bytes().data(), src, data.size());
+    src += concretePages[i]->size();
+  }
+}
+
+uint64_t ObjectState::compressColdPages(uint64_t before) const {
+  uint64_t saved = 0;
+  for (const auto &page : concretePages)
+    if (page->lastUse < before)
+      saved += page->tryCompress();
+  return saved;
 }
 
 ArrayCache *ObjectState::getArrayCache() const {
@@ -192,6 +296,54 @@ const UpdateList &ObjectState::getUpdates() const {
   return updates;
 }
 
+void ObjectState::compactUpdates() const {
+  if (!UpdateListCompactionThreshold || !updates.head)
+    return;
+
+  // Compact only once the list has doubled since the last compaction so
+  // the cost stays amortized constant per extend.
+  unsigned numUpdates = updates.head->getSize();
+  if (numUpdates < UpdateListCompactionThreshold ||
+      numUpdates < 2 * updatesAtLastCompaction)
+    return;
+
+  updates.compact();
+
+  // With a constant root, the oldest run of constant writes is just a
+  // different initial array; bake it into a fresh one so the nodes (and
+  // the solver work they cause) disappear entirely.
+  if (UseConstantArrays && updates.root && updates.root->isConstantArray() &&
+      updates.head) {
+    std::vector<const UpdateNode *> nodes;
+    nodes.reserve(updates.head->getSize());
+    for (const UpdateNode *un = updates.head.get(); un; un = un->next.get())
+      nodes.push_back(un);
+
+    unsigned tail = nodes.size();
+    while (tail > 0 && isa<ConstantExpr>(nodes[tail - 1]->index) &&
+           isa<ConstantExpr>(nodes[tail - 1]->value))
+      --tail;
+
+    if (tail < nodes.size()) {
+      std::vector<ref<ConstantExpr>> Contents(updates.root->constantValues);
+      for (unsigned i = nodes.size(); i-- > tail;)
+        Contents[cast<ConstantExpr>(nodes[i]->index)->getZExtValue()] =
+            cast<ConstantExpr>(nodes[i]->value);
+
+      static unsigned id = 0;
+      const Array *array = getArrayCache()->CreateArray(
+          "compact_arr" + llvm::utostr(++id), size, &Contents[0],
+          &Contents[0] + Contents.size());
+      UpdateList newUpdates(array, 0);
+      for (unsigned i = tail; i-- > 0;)
+        newUpdates.extend(nodes[i]->index, nodes[i]->value);
+      updates = newUpdates;
+    }
+  }
+
+  updatesAtLastCompaction = updates.head ? updates.head->getSize() : 0;
+}
+
 void ObjectState::flushToConcreteStore(TimingSolver *solver,
                                        const ExecutionState &state) const {
   for (unsigned i = 0; i < size; i++) {
@@ -203,43 +355,42 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
         klee_warning("Solver timed out when getting a value for external call, "
                      "byte %p+%u will have random value",
                      (void *)object->address, i);
-      else
-        ce->toMemory(concreteStore + i);
+      else {
+        uint8_t val;
+        ce->toMemory(&val);
+        writeConcrete(i, val);
+      }
     }
   }
 }
 
 void ObjectState::makeConcrete() {
-  delete concreteMask;
-  delete flushMask;
-  delete[] knownSymbolics;
-  concreteMask = 0;
-  flushMask = 0;
-  knownSymbolics = 0;
+  concreteMask = nullptr;
+  flushMask = nullptr;
+  knownSymbolics.clear();
 }
 
 void ObjectState::makeSymbolic() {
   assert(!updates.head &&
          "XXX makeSymbolic of objects with symbolic values is unsupported");
 
-  // XXX simplify this, can just delete various arrays I guess
-  for (unsigned i=0; i<size; i++) {
-    markByteSymbolic(i);
-    setKnownSymbolic(i, 0);
-    markByteFlushed(i);
-  }
+  // every byte is symbolic and flushed (both masks all-zero)
+  concreteMask = new SharedBitArray(size, false);
+  flushMask = new SharedBitArray(size, false);
+  knownSymbolics.clear();
 }
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  concretePages.clear();
+  allocateConcretePages();
 }
 
-void ObjectState::initializeToRandom() {  
+void ObjectState::initializeToRandom() {
   makeConcrete();
   for (unsigned i=0; i<size; i++) {
     // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
+    writeConcrete(i, 0xAB);
   }
 }
 
@@ -258,54 +409,75 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
   *size_r = size;
 }
 
-void ObjectState::flushRangeForRead(unsigned rangeBase, 
+void ObjectState::flushRangeForRead(unsigned rangeBase,
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
- 
-  for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
-    if (!isByteFlushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
-      } else {
-        assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
-      }
-
-      flushMask->unset(offset);
+  if (!flushMask) flushMask = new SharedBitArray(size, true);
+
+  // Only the unflushed bytes need their cached contents pushed into the
+  // update list; the flush mask finds them a word at a time, so ranges
+  // that are already flushed cost no per-byte work.
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset = flushMask->findNextSet(rangeBase, rangeEnd);
+       offset != rangeEnd;
+       offset = flushMask->findNextSet(offset + 1, rangeEnd)) {
+    if (isByteConcrete(offset)) {
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     ConstantExpr::create(readConcrete(offset), Expr::Int8));
+    } else {
+      assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     knownSymbolics.find(offset)->second);
     }
-  } 
+
+    getWritableMask(flushMask)->unset(offset);
+  }
+
+  compactUpdates();
 }
 
-void ObjectState::flushRangeForWrite(unsigned rangeBase, 
+void ObjectState::flushRangeForWrite(unsigned rangeBase,
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
-
-  for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
-    if (!isByteFlushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
-        markByteSymbolic(offset);
-      } else {
-        assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
-        setKnownSymbolic(offset, 0);
-      }
-
-      flushMask->unset(offset);
+  if (!flushMask) flushMask = new SharedBitArray(size, true);
+
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset = flushMask->findNextSet(rangeBase, rangeEnd);
+       offset != rangeEnd;
+       offset = flushMask->findNextSet(offset + 1, rangeEnd)) {
+    if (isByteConcrete(offset)) {
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     ConstantExpr::create(readConcrete(offset), Expr::Int8));
     } else {
-      // flushed bytes that are written over still need
-      // to be marked out
-      if (isByteConcrete(offset)) {
-        markByteSymbolic(offset);
-      } else if (isByteKnownSymbolic(offset)) {
-        setKnownSymbolic(offset, 0);
+      assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     knownSymbolics.find(offset)->second);
+    }
+
+    getWritableMask(flushMask)->unset(offset);
+  }
+
+  // After a symbolic-offset write every byte of the range is only known
+  // through the update list, so the byte-level caches are invalidated
+  // wholesale: the concrete mask a word at a time, the known-symbolic
+  // bytes through whichever of map and range is smaller.
+  if (!concreteMask)
+    concreteMask = new SharedBitArray(size, true);
+  getWritableMask(concreteMask)->unsetRange(rangeBase, rangeEnd);
+
+  if (!knownSymbolics.empty()) {
+    if (knownSymbolics.size() < rangeSize) {
+      for (auto it = knownSymbolics.begin(); it != knownSymbolics.end();) {
+        if (it->first >= rangeBase && it->first < rangeEnd)
+          it = knownSymbolics.erase(it);
+        else
+          ++it;
       }
+    } else {
+      for (unsigned offset = rangeBase; offset < rangeEnd; offset++)
+        knownSymbolics.erase(offset);
     }
-  } 
+  }
+
+  compactUpdates();
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
@@ -317,42 +489,39 @@ bool ObjectState::isByteFlushed(unsigned offset) const {
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  return knownSymbolics.count(offset) != 0;
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
   if (concreteMask)
-    concreteMask->set(offset);
+    getWritableMask(concreteMask)->set(offset);
 }
 
 void ObjectState::markByteSymbolic(unsigned offset) {
   if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
+    concreteMask = new SharedBitArray(size, true);
+  getWritableMask(concreteMask)->unset(offset);
 }
 
 void ObjectState::markByteUnflushed(unsigned offset) {
   if (flushMask)
-    flushMask->set(offset);
+    getWritableMask(flushMask)->set(offset);
 }
 
 void ObjectState::markByteFlushed(unsigned offset) {
   if (!flushMask) {
-    flushMask = new BitArray(size, false);
+    flushMask = new SharedBitArray(size, false);
   } else {
-    flushMask->unset(offset);
+    getWritableMask(flushMask)->unset(offset);
   }
 }
 
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
-  if (knownSymbolics) {
+  if (value) {
     knownSymbolics[offset] = value;
   } else {
-    if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
-    }
+    knownSymbolics.erase(offset);
   }
 }
 
@@ -360,9 +529,9 @@ void ObjectState::setKnownSymbolic(unsigned offset,
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
   if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
+    return ConstantExpr::create(readConcrete(offset), Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return knownSymbolics.find(offset)->second;
   } else {
     assert(isByteFlushed(offset) && "unflushed byte without cache value");
     
@@ -390,7 +559,7 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  writeConcrete(offset, value);
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
@@ -460,9 +629,18 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid width for read size!");
+
+  // Fast path: a load whose bytes are all concrete is served with one
+  // word-at-once mask test and one load from the concrete page instead
+  // of NumBytes read8 calls chained by Concats.
+  if (width <= 64 && offset + NumBytes <= size &&
+      Context::get().isLittleEndian() &&
+      (!concreteMask || concreteMask->allSetRange(offset, offset + NumBytes)))
+    return ConstantExpr::create(readConcreteWord(offset, NumBytes), width);
+
+  // Otherwise, follow the slow general case.
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -534,6 +712,8 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
 } 
 
 void ObjectState::write16(unsigned offset, uint16_t value) {
+  if (tryWriteWordFast(offset, 2, value))
+    return;
   unsigned NumBytes = 2;
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -542,6 +722,8 @@ void ObjectState::write16(unsigned offset, uint16_t value) {
 }
 
 void ObjectState::write32(unsigned offset, uint32_t value) {
+  if (tryWriteWordFast(offset, 4, value))
+    return;
   unsigned NumBytes = 4;
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -550,6 +732,8 @@ void ObjectState::write32(unsigned offset, uint32_t value) {
 }
 
 void ObjectState::write64(unsigned offset, uint64_t value) {
+  if (tryWriteWordFast(offset, 8, value))
+    return;
   unsigned NumBytes = 8;
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
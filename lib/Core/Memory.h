@@ -13,11 +13,15 @@
 #include "Context.h"
 #include "TimingSolver.h"
 
+#include "klee/ADT/BitArray.h"
 #include "klee/Expr/Expr.h"
 
 #include "llvm/ADT/StringExtras.h"
 
+#include <cstring>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -27,7 +31,6 @@ namespace llvm {
 namespace klee {
 
 class ArrayCache;
-class BitArray;
 class ExecutionState;
 class MemoryManager;
 class Solver;
@@ -44,13 +47,44 @@ private:
   /// @brief Required by klee::ref-managed objects
   mutable class ReferenceCounter _refCount;
 
+  /// Rarely used metadata, kept behind one pointer so the fields the
+  /// hot AddressSpace lookups compare against stay within a single
+  /// cache line. Most allocations are never named and carry no
+  /// counterexample preferences or sync records, so the block is only
+  /// allocated on first use.
+  struct ColdMetadata {
+    std::string name{"unnamed"};
+
+    /// A list of boolean expressions the user has requested be true of
+    /// a counterexample. Mutable since we play a little fast and loose
+    /// with allowing it to be added to during execution (although
+    /// should sensibly be only at creation time).
+    std::vector<ref<Expr>> cexPreferences;
+
+    /// Versions (\ref ConcreteStorePage::version) of the pages whose
+    /// bytes currently sit in the actual memory location at \ref
+    /// address. Maintained by AddressSpace when passing memory to and
+    /// from external calls so that unmodified pages are not copied
+    /// again. Shared by all states, not per-state, like the actual
+    /// memory itself.
+    std::vector<uint64_t> syncedPageVersions;
+  };
+  mutable std::unique_ptr<ColdMetadata> cold;
+
+  ColdMetadata &coldMetadata() const {
+    if (!cold)
+      cold.reset(new ColdMetadata());
+    return *cold;
+  }
+
 public:
-  unsigned id;
+  /// Hot fields, read by every AddressSpace lookup and resolveOne
+  /// comparison; keep them packed together at the front of the object.
   uint64_t address;
 
   /// size in bytes
   unsigned size;
-  mutable std::string name;
+  unsigned id;
 
   bool isLocal;
   mutable bool isGlobal;
@@ -64,12 +98,6 @@ public:
   /// should be either the allocating instruction or the global object
   /// it was allocated for (or whatever else makes sense).
   const llvm::Value *allocSite;
-  
-  /// A list of boolean expressions the user has requested be true of
-  /// a counterexample. Mutable since we play a little fast and loose
-  /// with allowing it to be added to during execution (although
-  /// should sensibly be only at creation time).
-  mutable std::vector< ref<Expr> > cexPreferences;
 
   // DO NOT IMPLEMENT
   MemoryObject(const MemoryObject &b);
@@ -78,28 +106,27 @@ public:
 public:
   // XXX this is just a temp hack, should be removed
   explicit
-  MemoryObject(uint64_t _address) 
-    : id(counter++),
-      address(_address),
+  MemoryObject(uint64_t _address)
+    : address(_address),
       size(0),
+      id(counter++),
       isFixed(true),
       parent(NULL),
       allocSite(0) {
   }
 
-  MemoryObject(uint64_t _address, unsigned _size, 
+  MemoryObject(uint64_t _address, unsigned _size,
                bool _isLocal, bool _isGlobal, bool _isFixed,
                const llvm::Value *_allocSite,
                MemoryManager *_parent)
-    : id(counter++),
-      address(_address),
+    : address(_address),
       size(_size),
-      name("unnamed"),
+      id(counter++),
       isLocal(_isLocal),
       isGlobal(_isGlobal),
       isFixed(_isFixed),
       isUserSpecified(false),
-      parent(_parent), 
+      parent(_parent),
       allocSite(_allocSite) {
   }
 
@@ -109,7 +136,34 @@ public:
   void getAllocInfo(std::string &result) const;
 
   void setName(std::string name) const {
-    this->name = name;
+    coldMetadata().name = std::move(name);
+  }
+
+  const std::string &getName() const {
+    static const std::string unnamed("unnamed");
+    return cold ? cold->name : unnamed;
+  }
+
+  void addCexPreference(const ref<Expr> &cond) const {
+    coldMetadata().cexPreferences.push_back(cond);
+  }
+
+  const std::vector<ref<Expr>> &getCexPreferences() const {
+    static const std::vector<ref<Expr>> none;
+    return cold ? cold->cexPreferences : none;
+  }
+
+  /// The sync records for the actual memory of this object (see \ref
+  /// ColdMetadata::syncedPageVersions); allocates the cold block, so
+  /// use \ref clearSyncedPageVersions to discard possibly absent
+  /// records.
+  std::vector<uint64_t> &syncedPageVersions() const {
+    return coldMetadata().syncedPageVersions;
+  }
+
+  void clearSyncedPageVersions() const {
+    if (cold)
+      cold->syncedPageVersions.clear();
   }
 
   ref<ConstantExpr> getBaseExpr() const { 
@@ -166,6 +220,105 @@ public:
   }
 };
 
+/// A refcounted run of concrete bytes. The ObjectStates of forked
+/// states share pages until one of them writes to a page, at which
+/// point only the touched page is copied; a fork that modifies one byte
+/// of a multi-megabyte buffer therefore copies one page instead of the
+/// whole store.
+class ConcreteStorePage {
+  friend class ref<ConcreteStorePage>;
+
+public:
+  /// @brief Required by klee::ref-managed objects
+  mutable class ReferenceCounter _refCount;
+
+  /// Page capacity in bytes; the last page of an object may be shorter.
+  static const unsigned Size = 4096;
+
+  /// Stamp identifying the current contents of \ref data, taken from a
+  /// global counter whenever a page is created or about to be modified.
+  /// Two pages hold the same stamp only if they are the same page with
+  /// the same bytes, which lets AddressSpace skip copying pages whose
+  /// contents already sit in the actual memory location of the object.
+  /// Stable across compression: the contents do not change.
+  uint64_t version;
+
+  explicit ConcreteStorePage(unsigned size)
+      : version(++nextVersion), lastUse(currentRound), data(size, 0),
+        rawSize(size) {}
+  ConcreteStorePage(const ConcreteStorePage &other)
+      : version(++nextVersion), lastUse(currentRound), data(other.data),
+        compressed(other.compressed), rawSize(other.rawSize) {}
+
+  /// Take a fresh version stamp; called before the page contents are
+  /// modified in place.
+  void bumpVersion() { version = ++nextVersion; }
+
+  /// Size of the page contents in bytes, whether or not they are
+  /// currently compressed.
+  unsigned size() const { return rawSize; }
+
+  /// The page contents, inflating them first if the page is compressed.
+  /// Marks the page as used in the current compression round. Mutable
+  /// access through a const page mirrors the concrete store itself:
+  /// compression is a representation change, not a contents change.
+  std::vector<uint8_t> &bytes() const {
+    if (!compressed.empty())
+      decompress();
+    lastUse = currentRound;
+    return data;
+  }
+
+  /// Deflate the page contents into the sidecar and drop the plain
+  /// bytes, if compression actually pays. \return the bytes saved, 0 if
+  /// the page stayed uncompressed (already compressed, incompressible,
+  /// or klee was built without zlib).
+  uint64_t tryCompress() const;
+
+  /// Round the page contents were last accessed in, for cold-page
+  /// detection (\see ObjectState::compressColdPages).
+  mutable uint64_t lastUse;
+
+  /// Advance the compression round counter; called by the executor on
+  /// its memory-check cadence. \return the new round.
+  static uint64_t startCompressionRound() { return ++currentRound; }
+
+private:
+  /// Plain byte contents; empty while the page is compressed.
+  mutable std::vector<uint8_t> data;
+
+  /// Compressed sidecar (zlib); empty while the page is plain. Exactly
+  /// one of \ref data and \ref compressed is non-empty.
+  mutable std::vector<uint8_t> compressed;
+
+  /// Byte count of the uncompressed contents, fixed at construction.
+  unsigned rawSize;
+
+  void decompress() const;
+
+  static uint64_t nextVersion;
+  static uint64_t currentRound;
+};
+
+/// A reference counted BitArray shared copy-on-write between the
+/// ObjectStates of forked states. For a large mostly-concrete object --
+/// a symbolic input file, say -- the masks are the dominant per-state
+/// copying cost once the concrete pages themselves are shared, and
+/// states that only read the object never need their own. Note that
+/// findNextSet()'s lazy summary maintenance is safe on a shared mask:
+/// sharers hold identical bits, so a summary bit stale for one is stale
+/// for all of them.
+class SharedBitArray : public BitArray {
+  friend class ref<SharedBitArray>;
+
+public:
+  /// @brief Required by klee::ref-managed objects
+  mutable class ReferenceCounter _refCount;
+
+  SharedBitArray(unsigned size, bool value = false) : BitArray(size, value) {}
+  SharedBitArray(const BitArray &b, unsigned size) : BitArray(b, size) {}
+};
+
 class ObjectState {
 private:
   friend class AddressSpace;
@@ -178,19 +331,30 @@ private:
 
   ref<const MemoryObject> object;
 
-  uint8_t *concreteStore;
+  /// Concrete byte contents, split into copy-on-write pages shared with
+  /// the ObjectStates of other states. Mutable because
+  /// flushToConcreteStore() patches bytes of a const object, as the
+  /// plain array did before it.
+  mutable std::vector<ref<ConcreteStorePage>> concretePages;
 
   // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
+  ref<SharedBitArray> concreteMask;
 
   // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
+  mutable ref<SharedBitArray> flushMask;
 
-  ref<Expr> *knownSymbolics;
+  /// Known symbolic bytes, keyed by offset. Objects are typically almost
+  /// entirely concrete with a handful of symbolic bytes, so a sparse map
+  /// keeps mostly-concrete objects cheap to copy.
+  std::unordered_map<unsigned, ref<Expr>> knownSymbolics;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
+  /// Update list size after the last compaction, used to trigger the
+  /// next one once the list has doubled (\see compactUpdates()).
+  mutable unsigned updatesAtLastCompaction;
+
 public:
   unsigned size;
 
@@ -234,12 +398,127 @@ public:
 
   /*
     Looks at all the symbolic bytes of this object, gets a value for them
-    from the solver and puts them in the concreteStore.
+    from the solver and puts them in the concrete store.
   */
   void flushToConcreteStore(TimingSolver *solver,
                             const ExecutionState &state) const;
 
+  /// Copy the concrete contents out to \p dst (used to pass memory to
+  /// external calls), skipping pages whose version is already recorded
+  /// in \p syncedVersions, and recording the versions of the pages
+  /// copied.
+  void copyConcretesTo(uint8_t *dst,
+                       std::vector<uint64_t> &syncedVersions) const;
+
+  /// Record the current page versions in \p syncedVersions, marking the
+  /// concrete contents as identical to the memory they were copied to or
+  /// compared against.
+  void markConcretesSynced(std::vector<uint64_t> &syncedVersions) const;
+
+  /// Compare the concrete contents with the \ref size bytes at \p src.
+  bool concretesEqual(const uint8_t *src) const;
+
+  /// True when every byte is concrete, i.e. reads are served straight
+  /// from the pages with no known-symbolic or flushed bytes to consult.
+  bool isFullyConcrete() const { return !concreteMask && knownSymbolics.empty(); }
+
+  /// True when the page covering byte \p offset holds the same contents
+  /// in both objects, judged by the page version stamps (\see
+  /// ConcreteStorePage::version).
+  bool pageContentsEqual(const ObjectState &other, unsigned offset) const {
+    return concretePages[offset / ConcreteStorePage::Size]->version ==
+           other.concretePages[offset / ConcreteStorePage::Size]->version;
+  }
+
+  /// Replace the concrete contents with the bytes at \p src, copying
+  /// only pages that actually changed so untouched pages stay shared.
+  void copyConcretesFrom(const uint8_t *src);
+
+  /// Compress every page whose contents were last accessed before
+  /// compression round \p before (\see -compress-cold-pages). Shared
+  /// pages are compressed once; the sweeps over the other sharers see
+  /// them already compressed and pay nothing. \return the bytes saved.
+  uint64_t compressColdPages(uint64_t before) const;
+
 private:
+  /// Populate \ref concretePages with fresh zeroed pages.
+  void allocateConcretePages();
+
+  uint8_t readConcrete(unsigned offset) const {
+    return concretePages[offset / ConcreteStorePage::Size]
+        ->bytes()[offset % ConcreteStorePage::Size];
+  }
+
+  /// Read \p n <= 8 bytes at \p offset as a little-endian value, with a
+  /// single unaligned load when the bytes sit in one page; accesses
+  /// straddling a page boundary are assembled by bytes.
+  uint64_t readConcreteWord(unsigned offset, unsigned n) const {
+    uint64_t value = 0;
+    unsigned pageOffset = offset % ConcreteStorePage::Size;
+    if (pageOffset + n <= ConcreteStorePage::Size) {
+      memcpy(&value,
+             &concretePages[offset / ConcreteStorePage::Size]
+                  ->bytes()[pageOffset],
+             n);
+    } else {
+      for (unsigned i = 0; i != n; ++i)
+        value |= uint64_t(readConcrete(offset + i)) << (8 * i);
+    }
+    return value;
+  }
+
+  /// Return the page holding \p pageIndex for writing, copying it first
+  /// if it is shared with another state.
+  ConcreteStorePage *getWritablePage(unsigned pageIndex) const {
+    ref<ConcreteStorePage> &page = concretePages[pageIndex];
+    if (page->_refCount.getCount() > 1)
+      page = new ConcreteStorePage(*page);
+    else
+      page->bumpVersion();
+    return page.get();
+  }
+
+  void writeConcrete(unsigned offset, uint8_t value) const {
+    getWritablePage(offset / ConcreteStorePage::Size)
+        ->bytes()[offset % ConcreteStorePage::Size] = value;
+  }
+
+  /// Store the \p n <= 8 low-order bytes of the little-endian \p value
+  /// at \p offset, with a single unaligned store when the bytes sit in
+  /// one page.
+  void writeConcreteWord(unsigned offset, unsigned n, uint64_t value) {
+    unsigned pageOffset = offset % ConcreteStorePage::Size;
+    if (pageOffset + n <= ConcreteStorePage::Size) {
+      memcpy(&getWritablePage(offset / ConcreteStorePage::Size)
+                  ->bytes()[pageOffset],
+             &value, n);
+    } else {
+      for (unsigned i = 0; i != n; ++i)
+        writeConcrete(offset + i, (uint8_t)(value >> (8 * i)));
+    }
+  }
+
+  /// Serve a \p n <= 8 byte concrete store in one step when every byte
+  /// in range is already concrete and no flush mask exists, so the
+  /// per-byte mask and known-symbolic updates of write8 would all be
+  /// no-ops. \return true iff the store was performed.
+  bool tryWriteWordFast(unsigned offset, unsigned n, uint64_t value) {
+    if (offset + n <= size && Context::get().isLittleEndian() && !flushMask &&
+        (!concreteMask || concreteMask->allSetRange(offset, offset + n))) {
+      writeConcreteWord(offset, n, value);
+      return true;
+    }
+    return false;
+  }
+
+  /// Return \p mask for writing, copying it first if it is shared with
+  /// the ObjectState of another state.
+  SharedBitArray *getWritableMask(ref<SharedBitArray> &mask) const {
+    if (mask->_refCount.getCount() > 1)
+      mask = new SharedBitArray(*mask, size);
+    return mask.get();
+  }
+
   const UpdateList &getUpdates() const;
 
   void makeConcrete();
@@ -250,11 +529,16 @@ private:
   void write8(unsigned offset, ref<Expr> value);
   void write8(ref<Expr> offset, ref<Expr> value);
 
-  void fastRangeCheckOffset(ref<Expr> offset, unsigned *base_r, 
+  void fastRangeCheckOffset(ref<Expr> offset, unsigned *base_r,
                             unsigned *size_r) const;
   void flushRangeForRead(unsigned rangeBase, unsigned rangeSize) const;
   void flushRangeForWrite(unsigned rangeBase, unsigned rangeSize);
 
+  /// Keep the update list from growing without bound: once it has
+  /// doubled since the last compaction, drop shadowed constant-index
+  /// writes and bake a constant tail into a fresh constant array.
+  void compactUpdates() const;
+
   bool isByteConcrete(unsigned offset) const;
   bool isByteFlushed(unsigned offset) const;
   bool isByteKnownSymbolic(unsigned offset) const;
@@ -44,6 +44,14 @@ llvm::cl::opt<bool> NullOnZeroMalloc(
     llvm::cl::desc("Returns NULL if malloc(0) is called (default=false)"),
     llvm::cl::init(false), llvm::cl::cat(MemoryCat));
 
+llvm::cl::opt<unsigned> AllocationPoolSize(
+    "allocation-pool-size",
+    llvm::cl::desc("Maximum number of freed allocations of each size retained "
+                   "for reuse once no state references them. Recycling keeps "
+                   "allocate/free loops from exhausting the deterministic "
+                   "space (0=disabled, default=32)"),
+    llvm::cl::init(32), llvm::cl::cat(MemoryCat));
+
 llvm::cl::opt<unsigned> RedzoneSize(
     "redzone-size",
     llvm::cl::desc("Set the size of the redzones to be added after each "
@@ -92,6 +100,11 @@ MemoryManager::~MemoryManager() {
     delete mo;
   }
 
+  if (!DeterministicAllocation)
+    for (pool_ty::iterator it = pool.begin(), ie = pool.end(); it != ie; ++it)
+      for (uint64_t address : it->second)
+        free((void *)address);
+
   if (DeterministicAllocation)
     munmap(deterministicSpace, spaceSize);
 }
@@ -115,7 +128,27 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
   }
 
   uint64_t address = 0;
-  if (DeterministicAllocation) {
+
+  // Recycle a freed allocation of the same size when one satisfies the
+  // requested alignment. Addresses only enter the pool once no state
+  // references their MemoryObject anymore (see markFreed).
+  if (AllocationPoolSize) {
+    pool_ty::iterator it = pool.find(size);
+    if (it != pool.end()) {
+      std::vector<uint64_t> &bin = it->second;
+      for (std::vector<uint64_t>::iterator ait = bin.begin(), aie = bin.end();
+           ait != aie; ++ait) {
+        if (*ait % alignment == 0) {
+          address = *ait;
+          *ait = bin.back();
+          bin.pop_back();
+          break;
+        }
+      }
+    }
+  }
+
+  if (!address && DeterministicAllocation) {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
     address = llvm::alignTo((uint64_t)nextFreeSlot + alignment - 1, alignment);
 #else
@@ -179,8 +212,14 @@ void MemoryManager::deallocate(const MemoryObject *mo) { assert(0); }
 
 void MemoryManager::markFreed(MemoryObject *mo) {
   if (objects.find(mo) != objects.end()) {
-    if (!mo->isFixed && !DeterministicAllocation)
-      free((void *)mo->address);
+    if (!mo->isFixed) {
+      std::vector<uint64_t> *bin =
+          AllocationPoolSize ? &pool[mo->size] : nullptr;
+      if (bin && bin->size() < AllocationPoolSize)
+        bin->push_back(mo->address);
+      else if (!DeterministicAllocation)
+        free((void *)mo->address);
+    }
     objects.erase(mo);
   }
 }
@@ -13,6 +13,8 @@
 #include <cstddef>
 #include <set>
 #include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 namespace llvm {
 class Value;
@@ -28,6 +30,12 @@ private:
   objects_ty objects;
   ArrayCache *const arrayCache;
 
+  /// Freed allocations retained for reuse, keyed by allocation size.
+  /// Addresses are only pooled once no state references their
+  /// MemoryObject anymore, so handing one out again is safe.
+  typedef std::unordered_map<uint64_t, std::vector<uint64_t>> pool_ty;
+  pool_ty pool;
+
   char *deterministicSpace;
   char *nextFreeSlot;
   size_t spaceSize;
@@ -27,6 +27,13 @@ llvm::cl::opt<bool> UseMerge(
                    "klee_close_merge() (default=false)"),
     llvm::cl::cat(klee::MergeCat));
 
+llvm::cl::opt<bool> UseAutoMerge(
+    "use-auto-merge", llvm::cl::init(false),
+    llvm::cl::desc("Automatically merge paths at the post-dominator of every "
+                   "symbolic branch, as if the region were wrapped in "
+                   "klee_open_merge()/klee_close_merge() (default=false)"),
+    llvm::cl::cat(klee::MergeCat));
+
 llvm::cl::opt<bool> DebugLogMerge(
     "debug-log-merge", llvm::cl::init(false),
     llvm::cl::desc("Debug information for path merging (default=false)"),
@@ -91,21 +98,25 @@ void MergeHandler::addClosedState(ExecutionState *es,
   // Remove from openStates
   removeOpenState(es);
 
+  const uint64_t key = es->mergeKey();
   auto closePoint = reachedCloseMerge.find(mp);
 
   // If no other state has yet encountered this klee_close_merge instruction,
   // add a new element to the map
   if (closePoint == reachedCloseMerge.end()) {
-    reachedCloseMerge[mp].push_back(es);
+    reachedCloseMerge[mp].emplace_back(key, es);
     executor->mergingSearcher->pauseState(*es);
   } else {
     // Otherwise try to merge with any state in the map element for this
-    // instruction
+    // instruction; states whose structural key differs can never merge,
+    // so they are skipped without a full attempt
     auto &cpv = closePoint->second;
     bool mergedSuccessful = false;
 
     for (auto& mState: cpv) {
-      if (mState->merge(*es)) {
+      if (mState.first != key)
+        continue;
+      if (mState.second->merge(*es)) {
         executor->terminateState(*es);
         executor->mergingSearcher->inCloseMerge.erase(es);
         mergedSuccessful = true;
@@ -113,7 +124,7 @@ void MergeHandler::addClosedState(ExecutionState *es,
       }
     }
     if (!mergedSuccessful) {
-      cpv.push_back(es);
+      cpv.emplace_back(key, es);
       executor->mergingSearcher->pauseState(*es);
     }
   }
@@ -121,9 +132,9 @@ void MergeHandler::addClosedState(ExecutionState *es,
 
 void MergeHandler::releaseStates() {
   for (auto& curMergeGroup: reachedCloseMerge) {
-    for (auto curState: curMergeGroup.second) {
-      executor->mergingSearcher->continueState(*curState);
-      executor->mergingSearcher->inCloseMerge.erase(curState);
+    for (auto& curState: curMergeGroup.second) {
+      executor->mergingSearcher->continueState(*curState.second);
+      executor->mergingSearcher->inCloseMerge.erase(curState.second);
     }
   }
   reachedCloseMerge.clear();
@@ -133,9 +144,10 @@ bool MergeHandler::hasMergedStates() {
   return (!reachedCloseMerge.empty());
 }
 
-MergeHandler::MergeHandler(Executor *_executor, ExecutionState *es)
+MergeHandler::MergeHandler(Executor *_executor, ExecutionState *es,
+                           llvm::Instruction *closePoint)
     : executor(_executor), openInstruction(es->steppedInstructions),
-      closedMean(0), closedStateCount(0) {
+      closedMean(0), closedStateCount(0), autoClosePoint(closePoint) {
     executor->mergingSearcher->mergeGroups.push_back(this);
   addOpenState(es);
 }
@@ -84,6 +84,8 @@ class Instruction;
 namespace klee {
 extern llvm::cl::opt<bool> UseMerge;
 
+extern llvm::cl::opt<bool> UseAutoMerge;
+
 extern llvm::cl::opt<bool> DebugLogMerge;
 
 extern llvm::cl::opt<bool> DebugLogIncompleteMerge;
@@ -115,12 +117,20 @@ private:
   /// corresponding klee_close_merge
   std::vector<ExecutionState *> openStates;
 
-  /// @brief Mapping the different 'klee_close_merge' calls to the states that ran into
-  /// them
-  std::map<llvm::Instruction *, std::vector<ExecutionState *> >
+  /// @brief Mapping the different 'klee_close_merge' calls to the states that
+  /// ran into them, each paired with its structural merge key
+  /// (ExecutionState::mergeKey) so incompatible candidates are rejected
+  /// without a full merge attempt
+  std::map<llvm::Instruction *,
+           std::vector<std::pair<uint64_t, ExecutionState *> > >
       reachedCloseMerge;
 
 public:
+  /// @brief For automatically inferred merge regions, the instruction at
+  /// which the region closes (the post-dominator of the forking branch);
+  /// null for annotation-driven regions
+  llvm::Instruction *autoClosePoint;
+
 
   /// @brief Called when a state runs into a 'klee_close_merge()' call
   void addClosedState(ExecutionState *es, llvm::Instruction *mp);
@@ -149,7 +159,8 @@ public:
   /// @brief Required by klee::ref-managed objects
   class ReferenceCounter _refCount;
 
-  MergeHandler(Executor *_executor, ExecutionState *es);
+  MergeHandler(Executor *_executor, ExecutionState *es,
+               llvm::Instruction *closePoint = nullptr);
   ~MergeHandler();
 };
 }
@@ -12,10 +12,14 @@
 #include "ExecutionState.h"
 
 #include "klee/Expr/Expr.h"
+#include "klee/Module/InstructionInfoTable.h"
+#include "klee/Module/KInstruction.h"
 #include "klee/Expr/ExprPPrinter.h"
 #include "klee/Support/OptionCategories.h"
 
 #include <bitset>
+#include <cassert>
+#include <memory>
 #include <vector>
 
 using namespace klee;
@@ -29,8 +33,59 @@ cl::opt<bool>
                                  "tree whenever possible (default=false)"),
                         cl::init(false), cl::cat(MiscCat));
 
+/// Arena backing PTreeNode allocation. With tens of millions of forks
+/// the process tree dominates small-object allocation and individually
+/// heap-allocated nodes scatter the RandomPathSearcher traversals across
+/// the heap; nodes are instead carved out of contiguous chunks, and
+/// removed nodes are recycled through a free list. Chunks are returned
+/// to the system only at exit.
+class PTreeNodePool {
+  static const size_t NodesPerChunk = 4096;
+
+  /// A free slot stores the link to the next free slot; a live slot
+  /// stores the node itself.
+  union Slot {
+    Slot *nextFree;
+    alignas(alignof(PTreeNode)) unsigned char storage[sizeof(PTreeNode)];
+  };
+
+  std::vector<std::unique_ptr<Slot[]>> chunks;
+  Slot *freeList = nullptr;
+  /// Slots handed out from the newest chunk.
+  size_t used = NodesPerChunk;
+
+public:
+  void *allocate() {
+    if (freeList) {
+      Slot *slot = freeList;
+      freeList = slot->nextFree;
+      return slot;
+    }
+    if (used == NodesPerChunk) {
+      chunks.emplace_back(new Slot[NodesPerChunk]);
+      used = 0;
+    }
+    return &chunks.back()[used++];
+  }
+
+  void deallocate(void *ptr) {
+    Slot *slot = static_cast<Slot *>(ptr);
+    slot->nextFree = freeList;
+    freeList = slot;
+  }
+};
+
+PTreeNodePool nodePool;
+
 } // namespace
 
+void *PTreeNode::operator new(size_t size) {
+  assert(size == sizeof(PTreeNode) && "pool slots fit exactly one node");
+  return nodePool.allocate();
+}
+
+void PTreeNode::operator delete(void *ptr) { nodePool.deallocate(ptr); }
+
 PTree::PTree(ExecutionState *initialState)
     : root(PTreeNodePtr(new PTreeNode(nullptr, initialState))) {
   initialState->ptreeNode = root.getPointer();
@@ -41,6 +96,7 @@ void PTree::attach(PTreeNode *node, ExecutionState *leftState, ExecutionState *r
   assert(node == rightState->ptreeNode &&
          "Attach assumes the right state is the current state");
   node->state = nullptr;
+  node->forkInstId = leftState->prevPC->info->id;
   node->left = PTreeNodePtr(new PTreeNode(node, leftState));
   // The current node inherits the tag
   uint8_t currentNodeTag = root.getInt();
@@ -14,6 +14,8 @@
 #include "klee/Support/ErrorHandling.h"
 #include "llvm/ADT/PointerIntPair.h"
 
+#include <cstdint>
+
 namespace klee {
   class ExecutionState;
   class PTreeNode;
@@ -29,13 +31,24 @@ namespace klee {
   public:
     PTreeNode *parent = nullptr;
 
-    PTreeNodePtr left; 
+    PTreeNodePtr left;
     PTreeNodePtr right;
     ExecutionState *state = nullptr;
 
+    /// Id of the instruction whose fork split this node (0 on leaves),
+    /// the stable-across-runs key under which SearchProfile records the
+    /// productivity of the two subtrees.
+    std::uint32_t forkInstId = 0;
+
     PTreeNode(const PTreeNode&) = delete;
     PTreeNode(PTreeNode *parent, ExecutionState *state);
     ~PTreeNode() = default;
+
+    /// Nodes are allocated at a rate of one per fork, so they are
+    /// carved out of a pooled arena with recycled free slots instead of
+    /// coming from the general heap.
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
   };
 
   class PTree {
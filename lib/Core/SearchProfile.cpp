@@ -0,0 +1,63 @@
+//===-- SearchProfile.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SearchProfile.h"
+
+#include "PTree.h"
+
+#include "klee/Support/ErrorHandling.h"
+
+#include <fstream>
+
+using namespace klee;
+
+std::unique_ptr<SearchProfile> SearchProfile::fromFile(const std::string &path) {
+  std::ifstream f(path);
+  if (!f.good()) {
+    klee_warning("unable to read search profile %s, starting cold",
+                 path.c_str());
+    return nullptr;
+  }
+  auto profile = std::make_unique<SearchProfile>();
+  std::uint32_t instId;
+  BranchStats stats;
+  while (f >> instId >> stats.left >> stats.right)
+    profile->branches[instId] = stats;
+  return profile;
+}
+
+void SearchProfile::credit(const PTreeNode *leaf, std::uint64_t amount) {
+  for (const PTreeNode *n = leaf; n->parent; n = n->parent) {
+    BranchStats &stats = branches[n->parent->forkInstId];
+    if (n->parent->left.getPointer() == n)
+      stats.left += amount;
+    else
+      stats.right += amount;
+  }
+}
+
+double SearchProfile::leftBias(std::uint32_t instId) const {
+  auto it = branches.find(instId);
+  if (it == branches.end())
+    return 0.5;
+  return double(it->second.left + 1) /
+         double(it->second.left + it->second.right + 2);
+}
+
+bool SearchProfile::writeTo(const std::string &path) const {
+  std::ofstream f(path, std::ios::out | std::ios::trunc);
+  if (!f.good()) {
+    klee_warning("unable to write search profile %s", path.c_str());
+    return false;
+  }
+  for (const auto &branch : branches)
+    f << branch.first << ' ' << branch.second.left << ' '
+      << branch.second.right << '\n';
+  return f.good();
+}
@@ -0,0 +1,59 @@
+//===-- SearchProfile.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SEARCHPROFILE_H
+#define KLEE_SEARCHPROFILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace klee {
+class PTreeNode;
+
+/// Per-branch subtree productivity statistics, keyed by the id of the
+/// forking instruction so they stay valid across runs of the same
+/// bitcode (the process tree itself does not survive state
+/// termination). A run with -write-search-profile credits every test a
+/// state yields to both sides of each fork on the state's path and
+/// persists the counts at shutdown; a later run started with
+/// -search-profile biases the random-path walk toward the historically
+/// productive side, pointing early exploration at the frontier without
+/// replaying any constraints.
+class SearchProfile {
+  struct BranchStats {
+    std::uint64_t left = 0;
+    std::uint64_t right = 0;
+  };
+
+  std::unordered_map<std::uint32_t, BranchStats> branches;
+
+public:
+  /// Load a profile written by a previous run. \return null (with a
+  /// warning) when the file cannot be read.
+  static std::unique_ptr<SearchProfile> fromFile(const std::string &path);
+
+  /// Credit \p amount to the taken side of every fork on the path from
+  /// \p leaf to the root. Must run before the leaf's state is removed
+  /// from the process tree.
+  void credit(const PTreeNode *leaf, std::uint64_t amount);
+
+  /// Probability with which the walk should descend left at the fork
+  /// instruction \p instId; 0.5 for forks the profile never saw.
+  /// Laplace-smoothed, so no side ever becomes unreachable.
+  double leftBias(std::uint32_t instId) const;
+
+  /// Persist the counts for later runs. \return false on I/O failure.
+  bool writeTo(const std::string &path) const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_SEARCHPROFILE_H */
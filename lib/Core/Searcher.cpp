@@ -14,9 +14,10 @@
 #include "Executor.h"
 #include "MergeHandler.h"
 #include "PTree.h"
+#include "SearchProfile.h"
 #include "StatsTracker.h"
 
-#include "klee/ADT/DiscretePDF.h"
+#include "klee/ADT/FlatDiscretePDF.h"
 #include "klee/ADT/RNG.h"
 #include "klee/Statistics/Statistics.h"
 #include "klee/Module/InstructionInfoTable.h"
@@ -40,6 +41,10 @@ using namespace llvm;
 ///
 
 ExecutionState &DFSSearcher::selectState() {
+  while (!states.back()) {
+    states.pop_back();
+    --tombstones;
+  }
   return *states.back();
 }
 
@@ -47,22 +52,44 @@ void DFSSearcher::update(ExecutionState *current,
                          const std::vector<ExecutionState *> &addedStates,
                          const std::vector<ExecutionState *> &removedStates) {
   // insert states
-  states.insert(states.end(), addedStates.begin(), addedStates.end());
+  for (const auto state : addedStates) {
+    slots.emplace(state, states.size());
+    states.push_back(state);
+  }
 
-  // remove states
+  // remove states: leave tombstones so bulk terminations stay linear
   for (const auto state : removedStates) {
-    if (state == states.back()) {
-      states.pop_back();
-    } else {
-      auto it = std::find(states.begin(), states.end(), state);
-      assert(it != states.end() && "invalid state removed");
-      states.erase(it);
-    }
+    auto it = slots.find(state);
+    assert(it != slots.end() && "invalid state removed");
+    states[it->second] = nullptr;
+    ++tombstones;
+    slots.erase(it);
   }
+
+  // compact (preserving order) once mostly dead
+  if (tombstones > states.size() / 2) {
+    std::size_t live = 0;
+    for (auto *state : states)
+      if (state) {
+        slots[state] = live;
+        states[live++] = state;
+      }
+    states.resize(live);
+    tombstones = 0;
+  }
+}
+
+void DFSSearcher::peekStates(std::vector<ExecutionState *> &candidates,
+                             unsigned count) {
+  for (auto it = states.rbegin(); it != states.rend() && count; ++it)
+    if (*it) {
+      candidates.push_back(*it);
+      --count;
+    }
 }
 
 bool DFSSearcher::empty() {
-  return states.empty();
+  return slots.empty();
 }
 
 void DFSSearcher::printName(llvm::raw_ostream &os) {
@@ -73,6 +100,11 @@ void DFSSearcher::printName(llvm::raw_ostream &os) {
 ///
 
 ExecutionState &BFSSearcher::selectState() {
+  while (!states.front()) {
+    states.pop_front();
+    ++frontIndex;
+    --tombstones;
+  }
   return *states.front();
 }
 
@@ -84,29 +116,54 @@ void BFSSearcher::update(ExecutionState *current,
   // constraints were added to the current state, it evolved.
   if (!addedStates.empty() && current &&
       std::find(removedStates.begin(), removedStates.end(), current) == removedStates.end()) {
-    auto pos = std::find(states.begin(), states.end(), current);
-    assert(pos != states.end());
-    states.erase(pos);
+    auto pos = slots.find(current);
+    assert(pos != slots.end());
+    states[pos->second - frontIndex] = nullptr;
+    ++tombstones;
+    pos->second = frontIndex + states.size();
     states.push_back(current);
   }
 
   // insert states
-  states.insert(states.end(), addedStates.begin(), addedStates.end());
+  for (const auto state : addedStates) {
+    slots.emplace(state, frontIndex + states.size());
+    states.push_back(state);
+  }
 
-  // remove states
+  // remove states: leave tombstones so bulk terminations stay linear
   for (const auto state : removedStates) {
-    if (state == states.front()) {
-      states.pop_front();
-    } else {
-      auto it = std::find(states.begin(), states.end(), state);
-      assert(it != states.end() && "invalid state removed");
-      states.erase(it);
-    }
+    auto it = slots.find(state);
+    assert(it != slots.end() && "invalid state removed");
+    states[it->second - frontIndex] = nullptr;
+    ++tombstones;
+    slots.erase(it);
   }
+
+  // compact (preserving order) once mostly dead
+  if (tombstones > states.size() / 2) {
+    std::size_t live = 0;
+    for (auto *state : states)
+      if (state) {
+        slots[state] = live;
+        states[live++] = state;
+      }
+    states.resize(live);
+    frontIndex = 0;
+    tombstones = 0;
+  }
+}
+
+void BFSSearcher::peekStates(std::vector<ExecutionState *> &candidates,
+                             unsigned count) {
+  for (auto it = states.begin(); it != states.end() && count; ++it)
+    if (*it) {
+      candidates.push_back(*it);
+      --count;
+    }
 }
 
 bool BFSSearcher::empty() {
-  return states.empty();
+  return slots.empty();
 }
 
 void BFSSearcher::printName(llvm::raw_ostream &os) {
@@ -126,13 +183,23 @@ void RandomSearcher::update(ExecutionState *current,
                             const std::vector<ExecutionState *> &addedStates,
                             const std::vector<ExecutionState *> &removedStates) {
   // insert states
-  states.insert(states.end(), addedStates.begin(), addedStates.end());
+  for (const auto state : addedStates) {
+    slots.emplace(state, states.size());
+    states.push_back(state);
+  }
 
-  // remove states
+  // remove states: swap the last state into the vacated slot
   for (const auto state : removedStates) {
-    auto it = std::find(states.begin(), states.end(), state);
-    assert(it != states.end() && "invalid state removed");
-    states.erase(it);
+    auto it = slots.find(state);
+    assert(it != slots.end() && "invalid state removed");
+    std::size_t slot = it->second;
+    ExecutionState *last = states.back();
+    states.pop_back();
+    slots.erase(it);
+    if (last != state) {
+      states[slot] = last;
+      slots[last] = slot;
+    }
   }
 }
 
@@ -148,7 +215,7 @@ void RandomSearcher::printName(llvm::raw_ostream &os) {
 ///
 
 WeightedRandomSearcher::WeightedRandomSearcher(WeightType type, RNG &rng)
-  : states(std::make_unique<DiscretePDF<ExecutionState*, ExecutionStateIDCompare>>()),
+  : states(std::make_unique<FlatDiscretePDF<ExecutionState*, ExecutionStateIDCompare>>()),
     theRNG{rng},
     type(type) {
 
@@ -174,6 +241,10 @@ ExecutionState &WeightedRandomSearcher::selectState() {
 }
 
 double WeightedRandomSearcher::getWeight(ExecutionState *es) {
+  // States throttled for runaway expression growth
+  // (-expr-node-hard-watermark) go to the back of every weighted queue.
+  if (es->exprThrottled)
+    return 1e-9;
   switch(type) {
     default:
     case Depth:
@@ -250,6 +321,77 @@ void WeightedRandomSearcher::printName(llvm::raw_ostream &os) {
   }
 }
 
+///
+
+/// Fill \p f from \p es. All fields come from state counters the
+/// executor already maintains; nothing here issues solver queries or
+/// walks the module.
+static void extractStateFeatures(ExecutionState *es, KleeStateFeatures &f) {
+  f.version = 1;
+  f.depth = es->depth;
+  f.instructions = es->steppedInstructions;
+  f.queryCostUSec = es->queryMetaData.queryCost.toMicroseconds();
+  f.locationInstructions =
+      theStatisticManager->getIndexedValue(stats::instructions,
+                                           es->pc->info->id);
+  const StackFrame &sf = es->stack.back();
+  f.callPathInstructions =
+      sf.callPathNode ? sf.callPathNode->statistics.getValue(stats::instructions)
+                      : 0;
+  f.instsSinceCovNew = es->instsSinceCovNew;
+  f.minDistToUncovered =
+      computeMinDistToUncovered(es->pc, sf.minDistToUncoveredOnReturn);
+  f.numConstraints = es->constraints.size();
+  f.throttled = es->exprThrottled;
+}
+
+PluginSearcher::PluginSearcher(KleeStateScoreFn score, RNG &rng)
+  : states(std::make_unique<FlatDiscretePDF<ExecutionState*, ExecutionStateIDCompare>>()),
+    theRNG{rng},
+    score(score) {}
+
+ExecutionState &PluginSearcher::selectState() {
+  return *states->choose(theRNG.getDoubleL());
+}
+
+double PluginSearcher::getWeight(ExecutionState *es) {
+  KleeStateFeatures f;
+  extractStateFeatures(es, f);
+  double w = score(&f);
+  // The PDF needs strictly positive finite weights; clamp misbehaving
+  // plugins to the same floor throttled states get elsewhere rather
+  // than aborting the whole run.
+  if (!std::isfinite(w) || w <= 0.)
+    return 1e-9;
+  return w;
+}
+
+void PluginSearcher::update(ExecutionState *current,
+                            const std::vector<ExecutionState *> &addedStates,
+                            const std::vector<ExecutionState *> &removedStates) {
+
+  // update current
+  if (current &&
+      std::find(removedStates.begin(), removedStates.end(), current) == removedStates.end())
+    states->update(current, getWeight(current));
+
+  // insert states
+  for (const auto state : addedStates)
+    states->insert(state, getWeight(state));
+
+  // remove states
+  for (const auto state : removedStates)
+    states->remove(state);
+}
+
+bool PluginSearcher::empty() {
+  return states->empty();
+}
+
+void PluginSearcher::printName(llvm::raw_ostream &os) {
+  os << "PluginSearcher\n";
+}
+
 
 ///
 
@@ -257,9 +399,11 @@ void WeightedRandomSearcher::printName(llvm::raw_ostream &os) {
 #define IS_OUR_NODE_VALID(n)                                                   \
   (((n).getPointer() != nullptr) && (((n).getInt() & idBitMask) != 0))
 
-RandomPathSearcher::RandomPathSearcher(PTree &processTree, RNG &rng)
+RandomPathSearcher::RandomPathSearcher(PTree &processTree, RNG &rng,
+                                       const SearchProfile *profile)
   : processTree{processTree},
     theRNG{rng},
+    profile{profile},
     idBitMask{processTree.getNextId()} {};
 
 ExecutionState &RandomPathSearcher::selectState() {
@@ -275,6 +419,13 @@ ExecutionState &RandomPathSearcher::selectState() {
       assert(IS_OUR_NODE_VALID(n->left) && "Both right and left nodes invalid");
       assert(n != n->left.getPointer());
       n = n->left.getPointer();
+    } else if (profile) {
+      // Warm start: descend toward the side that yielded more tests in
+      // the profiled run. Smoothing in leftBias keeps the other side
+      // reachable.
+      n = (theRNG.getDoubleL() < profile->leftBias(n->forkInstId) ? n->left
+                                                                  : n->right)
+              .getPointer();
     } else {
       if (bits==0) {
         flips = theRNG.getInt32();
@@ -397,6 +548,11 @@ void MergingSearcher::update(ExecutionState *current,
   }
 }
 
+void MergingSearcher::peekStates(std::vector<ExecutionState *> &candidates,
+                                 unsigned count) {
+  baseSearcher->peekStates(candidates, count);
+}
+
 bool MergingSearcher::empty() {
   return baseSearcher->empty();
 }
@@ -447,6 +603,17 @@ void BatchingSearcher::update(ExecutionState *current,
   baseSearcher->update(current, addedStates, removedStates);
 }
 
+void BatchingSearcher::peekStates(std::vector<ExecutionState *> &candidates,
+                                  unsigned count) {
+  // The batch state is reselected until its budget runs out, then the
+  // underlying searcher decides.
+  if (lastState && count) {
+    candidates.push_back(lastState);
+    --count;
+  }
+  baseSearcher->peekStates(candidates, count);
+}
+
 bool BatchingSearcher::empty() {
   return baseSearcher->empty();
 }
@@ -460,6 +627,155 @@ void BatchingSearcher::printName(llvm::raw_ostream &os) {
 }
 
 
+///
+
+namespace {
+/// Bounds and starting point of the per-state instruction slice used
+/// by AdaptiveBatchingSearcher.
+const unsigned MinBatchSlice = 256;
+const unsigned InitialBatchSlice = 4096;
+const unsigned MaxBatchSlice = 1u << 20;
+} // namespace
+
+AdaptiveBatchingSearcher::AdaptiveBatchingSearcher(Searcher *baseSearcher)
+  : baseSearcher{baseSearcher} {}
+
+ExecutionState &AdaptiveBatchingSearcher::selectState() {
+  // A slow state must not hog the schedule no matter how large its
+  // instruction slice has grown.
+  static const time::Span maxSliceTime(time::milliseconds(100));
+
+  if (lastState) {
+    std::uint64_t executed = stats::instructions - lastStartInstructions;
+    auto it = slices.find(lastState);
+    unsigned slice = it != slices.end() ? it->second : InitialBatchSlice;
+    time::Span wall = time::getWallTime() - lastStartTime;
+    if (executed < slice && wall < maxSliceTime)
+      return *lastState;
+
+    if (it != slices.end()) {
+      std::uint64_t solverWait = stats::solverTime - lastStartSolverTime;
+      if (2 * solverWait > (std::uint64_t)wall.toMicroseconds()) {
+        // The slice was dominated by solver waits; hand the slot over
+        // sooner next time.
+        it->second = std::max(slice / 2, MinBatchSlice);
+      } else if (executed >= slice) {
+        // Ran the full slice at interpretation speed; select less
+        // often.
+        it->second = std::min(slice * 2, MaxBatchSlice);
+      }
+    }
+    ++stats::batches;
+    stats::batchInstructions += executed;
+  }
+
+  lastState = &baseSearcher->selectState();
+  lastStartTime = time::getWallTime();
+  lastStartInstructions = stats::instructions;
+  lastStartSolverTime = stats::solverTime;
+  return *lastState;
+}
+
+void AdaptiveBatchingSearcher::update(ExecutionState *current,
+                                      const std::vector<ExecutionState *> &addedStates,
+                                      const std::vector<ExecutionState *> &removedStates) {
+  for (const auto state : addedStates)
+    slices.emplace(state, InitialBatchSlice);
+  for (const auto state : removedStates)
+    slices.erase(state);
+
+  // drop memoized state if it is marked for deletion
+  if (std::find(removedStates.begin(), removedStates.end(), lastState) != removedStates.end())
+    lastState = nullptr;
+
+  baseSearcher->update(current, addedStates, removedStates);
+}
+
+void AdaptiveBatchingSearcher::peekStates(
+    std::vector<ExecutionState *> &candidates, unsigned count) {
+  // The batch state is reselected until its slice runs out, then the
+  // underlying searcher decides.
+  if (lastState && count) {
+    candidates.push_back(lastState);
+    --count;
+  }
+  baseSearcher->peekStates(candidates, count);
+}
+
+bool AdaptiveBatchingSearcher::empty() {
+  return baseSearcher->empty();
+}
+
+void AdaptiveBatchingSearcher::printName(llvm::raw_ostream &os) {
+  os << "<AdaptiveBatchingSearcher>\n";
+  baseSearcher->printName(os);
+  os << "</AdaptiveBatchingSearcher>\n";
+}
+
+
+///
+
+StallParkingSearcher::StallParkingSearcher(Searcher *baseSearcher,
+                                           unsigned threshold)
+  : baseSearcher{baseSearcher}, threshold{threshold} {}
+
+ExecutionState &StallParkingSearcher::selectState() {
+  return baseSearcher->selectState();
+}
+
+void StallParkingSearcher::update(ExecutionState *current,
+                                  const std::vector<ExecutionState *> &addedStates,
+                                  const std::vector<ExecutionState *> &removedStates) {
+
+  // update underlying searcher (filter parked states unknown to underlying searcher)
+  if (!removedStates.empty()) {
+    std::vector<ExecutionState *> alt = removedStates;
+    for (const auto state : removedStates) {
+      auto it = parkedStates.find(state);
+      if (it != parkedStates.end()) {
+        parkedStates.erase(it);
+        alt.erase(std::remove(alt.begin(), alt.end(), state), alt.end());
+      }
+    }
+    baseSearcher->update(current, addedStates, alt);
+  } else {
+    baseSearcher->update(current, addedStates, removedStates);
+  }
+
+  // update current: park once it has gone threshold instructions
+  // without covering anything new
+  if (current && current->instsSinceCovNew > threshold &&
+      std::find(removedStates.begin(), removedStates.end(), current) == removedStates.end()) {
+    parkedStates.insert(current);
+    baseSearcher->update(nullptr, {}, {current});
+  }
+
+  // every progressing state is parked or gone: readmit the parked ones
+  // for another slice each
+  if (baseSearcher->empty() && !parkedStates.empty()) {
+    std::vector<ExecutionState *> ps(parkedStates.begin(), parkedStates.end());
+    baseSearcher->update(nullptr, ps, std::vector<ExecutionState *>());
+    parkedStates.clear();
+  }
+}
+
+void StallParkingSearcher::peekStates(std::vector<ExecutionState *> &candidates,
+                                      unsigned count) {
+  baseSearcher->peekStates(candidates, count);
+}
+
+bool StallParkingSearcher::empty() {
+  return baseSearcher->empty() && parkedStates.empty();
+}
+
+void StallParkingSearcher::printName(llvm::raw_ostream &os) {
+  os << "<StallParkingSearcher> threshold: " << threshold
+     << ", baseSearcher:\n";
+  baseSearcher->printName(os);
+  os << "</StallParkingSearcher>\n";
+}
+
+
 ///
 
 IterativeDeepeningTimeSearcher::IterativeDeepeningTimeSearcher(Searcher *baseSearcher)
@@ -510,6 +826,11 @@ void IterativeDeepeningTimeSearcher::update(ExecutionState *current,
   }
 }
 
+void IterativeDeepeningTimeSearcher::peekStates(
+    std::vector<ExecutionState *> &candidates, unsigned count) {
+  baseSearcher->peekStates(candidates, count);
+}
+
 bool IterativeDeepeningTimeSearcher::empty() {
   return baseSearcher->empty() && pausedStates.empty();
 }
@@ -519,6 +840,104 @@ void IterativeDeepeningTimeSearcher::printName(llvm::raw_ostream &os) {
 }
 
 
+///
+
+ScheduleRecordingSearcher::ScheduleRecordingSearcher(Searcher *baseSearcher,
+                                                     const std::string &path)
+  : baseSearcher{baseSearcher}, log{path} {
+  if (!log.is_open())
+    klee_error("cannot open schedule log for writing: %s", path.c_str());
+}
+
+ScheduleRecordingSearcher::~ScheduleRecordingSearcher() {
+  if (runLength)
+    log << lastID << ' ' << runLength << '\n';
+}
+
+ExecutionState &ScheduleRecordingSearcher::selectState() {
+  ExecutionState &state = baseSearcher->selectState();
+  if (state.getID() != lastID) {
+    if (runLength)
+      log << lastID << ' ' << runLength << '\n';
+    lastID = state.getID();
+    runLength = 0;
+  }
+  ++runLength;
+  return state;
+}
+
+void ScheduleRecordingSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  baseSearcher->update(current, addedStates, removedStates);
+}
+
+void ScheduleRecordingSearcher::peekStates(
+    std::vector<ExecutionState *> &candidates, unsigned count) {
+  baseSearcher->peekStates(candidates, count);
+}
+
+bool ScheduleRecordingSearcher::empty() {
+  return baseSearcher->empty();
+}
+
+void ScheduleRecordingSearcher::printName(llvm::raw_ostream &os) {
+  os << "<ScheduleRecordingSearcher>\n";
+  baseSearcher->printName(os);
+  os << "</ScheduleRecordingSearcher>\n";
+}
+
+
+///
+
+ScheduleReplaySearcher::ScheduleReplaySearcher(Searcher *baseSearcher,
+                                               const std::string &path)
+  : baseSearcher{baseSearcher}, log{path} {
+  if (!log.is_open())
+    klee_error("cannot open schedule log for reading: %s", path.c_str());
+}
+
+ExecutionState &ScheduleReplaySearcher::selectState() {
+  if (!exhausted && !remaining) {
+    if (!(log >> currentID >> remaining)) {
+      exhausted = true;
+      klee_warning("schedule log exhausted with states remaining, "
+                   "continuing with the wrapped searcher");
+    }
+  }
+
+  if (exhausted)
+    return baseSearcher->selectState();
+
+  --remaining;
+  auto it = liveStates.find(currentID);
+  if (it == liveStates.end())
+    klee_error("schedule replay diverged: recorded state %u is not live",
+               currentID);
+  return *it->second;
+}
+
+void ScheduleReplaySearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  for (const auto state : addedStates)
+    liveStates.emplace(state->getID(), state);
+  for (const auto state : removedStates)
+    liveStates.erase(state->getID());
+  baseSearcher->update(current, addedStates, removedStates);
+}
+
+bool ScheduleReplaySearcher::empty() {
+  return exhausted ? baseSearcher->empty() : liveStates.empty();
+}
+
+void ScheduleReplaySearcher::printName(llvm::raw_ostream &os) {
+  os << "<ScheduleReplaySearcher>\n";
+  baseSearcher->printName(os);
+  os << "</ScheduleReplaySearcher>\n";
+}
+
+
 ///
 
 InterleavedSearcher::InterleavedSearcher(const std::vector<Searcher*> &_searchers) {
@@ -542,6 +961,12 @@ void InterleavedSearcher::update(ExecutionState *current,
     searcher->update(current, addedStates, removedStates);
 }
 
+void InterleavedSearcher::peekStates(
+    std::vector<ExecutionState *> &candidates, unsigned count) {
+  // Ask the searcher whose turn is next.
+  searchers[index - 1]->peekStates(candidates, count);
+}
+
 bool InterleavedSearcher::empty() {
   return searchers[0]->empty();
 }
@@ -13,13 +13,16 @@
 #include "ExecutionState.h"
 #include "PTree.h"
 #include "klee/ADT/RNG.h"
+#include "klee/Core/SearcherPlugin.h"
 #include "klee/System/Time.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <fstream>
 #include <map>
 #include <queue>
+#include <unordered_map>
 #include <set>
 #include <vector>
 
@@ -31,9 +34,10 @@ namespace llvm {
 }
 
 namespace klee {
-  template<class T, class Comparator> class DiscretePDF;
+  template<class T, class Comparator> class FlatDiscretePDF;
   class ExecutionState;
   class Executor;
+  class SearchProfile;
 
   /// A Searcher implements an exploration strategy for the Executor by selecting
   /// states for further exploration using different strategies or heuristics.
@@ -53,6 +57,16 @@ namespace klee {
                         const std::vector<ExecutionState *> &addedStates,
                         const std::vector<ExecutionState *> &removedStates) = 0;
 
+    /// Append up to \p count states the searcher expects to schedule
+    /// soon (best effort: possibly fewer, possibly none) to
+    /// \p candidates without selecting them. Lets the executor warm up
+    /// work for upcoming states -- e.g. prefetching their fork queries
+    /// -- while the current one runs. The default reports nothing,
+    /// which is always correct; randomized searchers cannot predict
+    /// their next pick.
+    virtual void peekStates(std::vector<ExecutionState *> &candidates,
+                            unsigned count) {}
+
     /// \return True if no state left for exploration, False otherwise
     virtual bool empty() = 0;
 
@@ -78,13 +92,21 @@ namespace klee {
   /// DFSSearcher implements depth-first exploration. All states are kept in
   /// insertion order. The last state is selected for further exploration.
   class DFSSearcher final : public Searcher {
+    /// LIFO of states; removal leaves a null tombstone so it is O(1),
+    /// trailing tombstones are popped on selection and the vector is
+    /// compacted once mostly dead.
     std::vector<ExecutionState*> states;
+    /// Slot of every live state in \ref states.
+    std::unordered_map<ExecutionState*, std::size_t> slots;
+    std::size_t tombstones = 0;
 
   public:
     ExecutionState &selectState() override;
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
     bool empty() override;
     void printName(llvm::raw_ostream &os) override;
   };
@@ -94,20 +116,36 @@ namespace klee {
   /// mind that the process tree (PTree) is a binary tree and hence the depth of
   /// a state in that tree and its branch depth during BFS are different.
   class BFSSearcher final : public Searcher {
+    /// FIFO of states; removal leaves a null tombstone so it is O(1),
+    /// leading tombstones are popped on selection and the deque is
+    /// compacted once mostly dead.
     std::deque<ExecutionState*> states;
+    /// Global slot of every live state: its position in \ref states
+    /// is the slot minus \ref frontIndex, so slots survive pops at
+    /// the front.
+    std::unordered_map<ExecutionState*, std::uint64_t> slots;
+    /// Global index of states.front().
+    std::uint64_t frontIndex = 0;
+    std::uint64_t tombstones = 0;
 
   public:
     ExecutionState &selectState() override;
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
     bool empty() override;
     void printName(llvm::raw_ostream &os) override;
   };
 
   /// RandomSearcher picks a state randomly.
   class RandomSearcher final : public Searcher {
+    /// States in arbitrary order; removal swaps the last state into
+    /// the vacated slot, so no tombstones are needed.
     std::vector<ExecutionState*> states;
+    /// Slot of every state in \ref states.
+    std::unordered_map<ExecutionState*, std::size_t> slots;
     RNG &theRNG;
 
   public:
@@ -120,8 +158,8 @@ namespace klee {
     void printName(llvm::raw_ostream &os) override;
   };
 
-  /// The base class for all weighted searchers. Uses DiscretePDF as underlying
-  /// data structure.
+  /// The base class for all weighted searchers. Uses FlatDiscretePDF as
+  /// underlying data structure.
   class WeightedRandomSearcher final : public Searcher {
   public:
     enum WeightType : std::uint8_t {
@@ -135,7 +173,7 @@ namespace klee {
     };
 
   private:
-    std::unique_ptr<DiscretePDF<ExecutionState*, ExecutionStateIDCompare>> states;
+    std::unique_ptr<FlatDiscretePDF<ExecutionState*, ExecutionStateIDCompare>> states;
     RNG &theRNG;
     WeightType type;
     bool updateWeights;
@@ -156,6 +194,33 @@ namespace klee {
     void printName(llvm::raw_ostream &os) override;
   };
 
+  /// PluginSearcher draws states with probability proportional to the
+  /// weight an out-of-tree scoring function assigns them. The function
+  /// is loaded from a shared object (-searcher-plugin) and sees only
+  /// the packed per-state feature vector defined in
+  /// include/klee/Core/SearcherPlugin.h, so heuristics and learned
+  /// models can be swapped without forking klee.
+  class PluginSearcher final : public Searcher {
+    std::unique_ptr<FlatDiscretePDF<ExecutionState*, ExecutionStateIDCompare>> states;
+    RNG &theRNG;
+    KleeStateScoreFn score;
+
+    double getWeight(ExecutionState*);
+
+  public:
+    /// \param score The scoring function resolved from the plugin.
+    /// \param rng A random number generator.
+    PluginSearcher(KleeStateScoreFn score, RNG &rng);
+    ~PluginSearcher() override = default;
+
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
   /// RandomPathSearcher performs a random walk of the PTree to select a state.
   /// PTree is a global data structure, however, a searcher can sometimes only
   /// select from a subset of all states (depending on the update calls).
@@ -175,13 +240,19 @@ namespace klee {
     PTree &processTree;
     RNG &theRNG;
 
+    /// Prior-run branch productivity used to bias the walk (warm
+    /// start); null for the usual unbiased coin flips.
+    const SearchProfile *profile;
+
     // Unique bitmask of this searcher
     const uint8_t idBitMask;
 
   public:
     /// \param processTree The process tree.
     /// \param RNG A random number generator.
-    RandomPathSearcher(PTree &processTree, RNG &rng);
+    /// \param profile Prior-run productivity profile, may be null.
+    RandomPathSearcher(PTree &processTree, RNG &rng,
+                       const SearchProfile *profile = nullptr);
     ~RandomPathSearcher() override = default;
 
     ExecutionState &selectState() override;
@@ -233,6 +304,8 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
 
     bool empty() override;
     void printName(llvm::raw_ostream &os) override;
@@ -261,6 +334,71 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
+  /// AdaptiveBatchingSearcher wraps another searcher like
+  /// BatchingSearcher, but sizes each state's slice from observed
+  /// behaviour instead of fixed budgets: a state executing
+  /// instructions at interpretation speed has its slice doubled
+  /// (amortizing selection overhead), a state that spends its slice
+  /// waiting on the solver has it halved, and a wall-clock cap bounds
+  /// any single slice. Realized slices are published through
+  /// stats::batches and stats::batchInstructions.
+  class AdaptiveBatchingSearcher final : public Searcher {
+    std::unique_ptr<Searcher> baseSearcher;
+
+    /// Instruction slice of each known state; adapted after every
+    /// completed batch, dropped when the state is removed.
+    std::unordered_map<ExecutionState *, unsigned> slices;
+
+    ExecutionState *lastState {nullptr};
+    time::Point lastStartTime;
+    std::uint64_t lastStartInstructions {0};
+    std::uint64_t lastStartSolverTime {0};
+
+  public:
+    /// \param baseSearcher The underlying searcher (takes ownership).
+    explicit AdaptiveBatchingSearcher(Searcher *baseSearcher);
+    ~AdaptiveBatchingSearcher() override = default;
+
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
+  /// StallParkingSearcher parks states that have executed many
+  /// instructions without covering new code: they are removed from the
+  /// underlying searcher until it runs out of progressing states, then
+  /// readmitted for one slice each rather than starved forever. A
+  /// readmitted state that covers something new resets its stall
+  /// counter and simply stays active.
+  class StallParkingSearcher final : public Searcher {
+    std::unique_ptr<Searcher> baseSearcher;
+    unsigned threshold;
+    std::set<ExecutionState*> parkedStates;
+
+  public:
+    /// \param baseSearcher The underlying searcher (takes ownership).
+    /// \param threshold Instructions without new coverage after which a
+    /// state is parked.
+    StallParkingSearcher(Searcher *baseSearcher, unsigned threshold);
+    ~StallParkingSearcher() override = default;
+
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
     bool empty() override;
     void printName(llvm::raw_ostream &os) override;
   };
@@ -281,6 +419,72 @@ namespace klee {
     explicit IterativeDeepeningTimeSearcher(Searcher *baseSearcher);
     ~IterativeDeepeningTimeSearcher() override = default;
 
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
+  /// ScheduleRecordingSearcher logs every selection of the searcher it
+  /// wraps as run-length encoded (state id, selection count) pairs, one
+  /// pair per line. Together with the per-path RNG streams this captures
+  /// all scheduling nondeterminism -- including timer-driven batch
+  /// boundaries, which appear in the log simply as a change of state id
+  /// -- so a run can be reproduced with ScheduleReplaySearcher without
+  /// re-rolling searcher randomness or re-hitting wall-clock budgets.
+  class ScheduleRecordingSearcher final : public Searcher {
+    std::unique_ptr<Searcher> baseSearcher;
+    std::ofstream log;
+
+    /// Current run being accumulated; flushed when the selection moves
+    /// to another state and on destruction.
+    std::uint32_t lastID {0};
+    std::uint64_t runLength {0};
+
+  public:
+    /// \param baseSearcher The underlying searcher (takes ownership).
+    /// \param path File the decision log is written to.
+    ScheduleRecordingSearcher(Searcher *baseSearcher, const std::string &path);
+    ~ScheduleRecordingSearcher() override;
+
+    ExecutionState &selectState() override;
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
+    bool empty() override;
+    void printName(llvm::raw_ostream &os) override;
+  };
+
+  /// ScheduleReplaySearcher forces the selection sequence recorded by
+  /// ScheduleRecordingSearcher. State ids are deterministic under a
+  /// fixed schedule, so each logged id resolves to the same state as in
+  /// the recorded run; a logged id with no live state means the
+  /// executions diverged and is a hard error. Once the log is
+  /// exhausted, exploration continues with the wrapped searcher (the
+  /// recorded run may have been halted before its state set emptied).
+  class ScheduleReplaySearcher final : public Searcher {
+    std::unique_ptr<Searcher> baseSearcher;
+    std::ifstream log;
+
+    /// Remaining selections of the current log record.
+    std::uint32_t currentID {0};
+    std::uint64_t remaining {0};
+    bool exhausted {false};
+
+    std::unordered_map<std::uint32_t, ExecutionState *> liveStates;
+
+  public:
+    /// \param baseSearcher Searcher continuing past the log (takes ownership).
+    /// \param path File the decision log is read from.
+    ScheduleReplaySearcher(Searcher *baseSearcher, const std::string &path);
+    ~ScheduleReplaySearcher() override = default;
+
     ExecutionState &selectState() override;
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
@@ -305,6 +509,8 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates) override;
+    void peekStates(std::vector<ExecutionState *> &candidates,
+                    unsigned count) override;
     bool empty() override;
     void printName(llvm::raw_ostream &os) override;
   };
@@ -19,6 +19,8 @@
 #include "klee/ADT/KTest.h"
 #include "klee/Support/ErrorHandling.h"
 
+#include <map>
+
 using namespace klee;
 
 KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
@@ -28,7 +30,7 @@ KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
     
     for (i=0; i<input->numObjects; ++i) {
       KTestObject *obj = &input->objects[i];
-      if (std::string(obj->name) == mo->name)
+      if (std::string(obj->name) == mo->getName())
         if (used.insert(obj).second)
           return obj;
     }
@@ -43,12 +45,12 @@ KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
       if (obj->numBytes == mo->size) {
         used.insert(obj);
         klee_warning_once(mo, "using seed input %s[%d] for: %s (no name match)",
-                          obj->name, obj->numBytes, mo->name.c_str());
+                          obj->name, obj->numBytes, mo->getName().c_str());
         return obj;
       }
     }
     
-    klee_warning_once(mo, "no seed input for: %s", mo->name.c_str());
+    klee_warning_once(mo, "no seed input for: %s", mo->getName().c_str());
     return 0;
   } else {
     if (inputPosition >= input->numObjects) {
@@ -125,35 +127,71 @@ void SeedInfo::patchSeed(const ExecutionState &state,
   if (res)
     return;
   
-  // We could still do a lot better than this, for example by looking at
-  // independence. But really, this shouldn't be happening often.
-  for (Assignment::bindings_ty::iterator it = assignment.bindings.begin(), 
-         ie = assignment.bindings.end(); it != ie; ++it) {
-    const Array *array = it->first;
-    for (unsigned i=0; i<array->size; ++i) {
-      ref<Expr> read = ReadExpr::create(UpdateList(array, 0),
-                                        ConstantExpr::alloc(i, Expr::Int32));
-      ref<Expr> isSeed = EqExpr::create(read, 
-                                        ConstantExpr::alloc(it->second[i], 
-                                                            Expr::Int8));
-      bool res;
-      bool success =
-          solver->mustBeFalse(required, isSeed, res, state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      if (res) {
-        ref<ConstantExpr> value;
-        bool success =
-            solver->getValue(required, read, value, state.queryMetaData);
-        assert(success && "FIXME: Unhandled solver failure");            
-        (void) success;
-        it->second[i] = value->getZExtValue(8);
-        cm.addConstraint(EqExpr::create(
-            read, ConstantExpr::alloc(it->second[i], Expr::Int8)));
-      } else {
-        cm.addConstraint(isSeed);
+  // One batched query instead of two queries per seed byte: ask for a
+  // single model of the violated constraints over every seeded array.
+  // The independent-solver chain decomposes the query per independent
+  // object on the way down (and a parallel solver pool, when
+  // configured, solves the pieces concurrently), so this also scales
+  // with the number of objects rather than the number of bytes.
+  std::vector<const Array *> objects;
+  objects.reserve(assignment.bindings.size());
+  for (Assignment::bindings_ty::iterator it = assignment.bindings.begin(),
+         ie = assignment.bindings.end(); it != ie; ++it)
+    objects.push_back(it->first);
+  std::vector< std::vector<unsigned char> > values;
+  success = solver->getInitialValues(required, objects, values,
+                                     state.queryMetaData);
+  assert(success && "FIXME: Unhandled solver failure");
+  (void) success;
+
+  std::map<const Array *, const std::vector<unsigned char> *> model;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    model[objects[i]] = &values[i];
+
+  // Derive the per-byte fixes from that one model, preferring the
+  // seed: model bytes are adopted only at positions read by a
+  // constraint the patched seed still violates, so unconstrained seed
+  // bytes survive untouched. Everything below is concrete evaluation,
+  // not solving, and every pass permanently adopts at least one byte,
+  // so there are at most as many passes as mismatched bytes.
+  for (;;) {
+    ref<Expr> violated;
+    for (const auto &constraint : required) {
+      if (!assignment.evaluatesToTrue(constraint)) {
+        violated = constraint;
+        break;
+      }
+    }
+    if (violated.isNull())
+      break;
+
+    bool progress = false;
+    std::vector< ref<ReadExpr> > violatedReads;
+    findReads(violated, true, violatedReads);
+    for (const auto &re : violatedReads) {
+      Assignment::bindings_ty::iterator bit =
+          assignment.bindings.find(re->updates.root);
+      if (bit == assignment.bindings.end())
+        continue;
+      const std::vector<unsigned char> &fix = *model[bit->first];
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
+        unsigned i = CE->getZExtValue(32);
+        if (i < bit->second.size() && i < fix.size() &&
+            bit->second[i] != fix[i]) {
+          bit->second[i] = fix[i];
+          progress = true;
+        }
+      } else if (bit->second != fix) {
+        // Symbolically indexed read; any byte may matter, take the
+        // whole object from the model.
+        bit->second = fix;
+        progress = true;
       }
     }
+    // A constraint over arrays the seed does not bind; nothing left to
+    // patch (the debug check below will complain).
+    if (!progress)
+      break;
   }
 
 #ifndef NDEBUG
@@ -32,6 +32,7 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <sstream>
 
@@ -47,6 +48,15 @@ cl::opt<bool>
                            "tests (default=false)"),
                   cl::cat(TestGenCat));
 
+cl::opt<bool> InterceptMemoryOps(
+    "intercept-memory-ops", cl::init(true),
+    cl::desc("Execute memcpy/memmove/memset with concrete arguments directly "
+             "on the destination memory object, and strlen/strcmp/strncmp/"
+             "memchr over concrete bytes directly on the byte store, instead "
+             "of interpreting the loops in the runtime definitions "
+             "(default=true)"),
+    cl::cat(MiscCat));
+
 cl::opt<bool>
     SilentKleeAssume("silent-klee-assume", cl::init(false),
                      cl::desc("Silently terminate paths with an infeasible "
@@ -82,6 +92,10 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
   addDNR("klee_abort", handleAbort),
   addDNR("klee_silent_exit", handleSilentExit),
   addDNR("klee_report_error", handleReportError),
+  // native string models dispatched to by klee-libc
+  add("__klee_memchr", handleMemchr, true),
+  add("__klee_strcmp", handleStrcmp, true),
+  add("__klee_strlen", handleStrlen, true),
   add("calloc", handleCalloc, true),
   add("free", handleFree, false),
   add("klee_assume", handleAssume, false),
@@ -102,7 +116,9 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
 #endif
   add("klee_is_symbolic", handleIsSymbolic, true),
   add("klee_make_symbolic", handleMakeSymbolic, false),
+  add("klee_make_symbolic_batch", handleMakeSymbolicBatch, false),
   add("klee_mark_global", handleMarkGlobal, false),
+  add("klee_memcpy", handleMemcpy, false),
   add("klee_open_merge", handleOpenMerge, false),
   add("klee_close_merge", handleCloseMerge, false),
   add("klee_prefer_cex", handlePreferCex, false),
@@ -211,8 +227,16 @@ void SpecialFunctionHandler::bind() {
     Function *f = executor.kmodule->module->getFunction(hi.name);
     
     if (f && (!hi.doNotOverride || f->isDeclaration()))
-      handlers[f] = std::make_pair(hi.handler, hi.hasReturnValue);
+      handlers[f] = SpecialFunctionBinding{hi.handler, hi.hasReturnValue};
   }
+
+  memcpyFn = executor.kmodule->module->getFunction("memcpy");
+  memmoveFn = executor.kmodule->module->getFunction("memmove");
+  memsetFn = executor.kmodule->module->getFunction("memset");
+  strlenFn = executor.kmodule->module->getFunction("strlen");
+  strcmpFn = executor.kmodule->module->getFunction("strcmp");
+  strncmpFn = executor.kmodule->module->getFunction("strncmp");
+  memchrFn = executor.kmodule->module->getFunction("memchr");
 }
 
 
@@ -220,16 +244,24 @@ bool SpecialFunctionHandler::handle(ExecutionState &state,
                                     Function *f,
                                     KInstruction *target,
                                     std::vector< ref<Expr> > &arguments) {
-  handlers_ty::iterator it = handlers.find(f);
-  if (it != handlers.end()) {    
-    Handler h = it->second.first;
-    bool hasReturnValue = it->second.second;
+  // The callee of a call site only ever changes through an indirect
+  // call, so the map lookup is resolved once per (call site, callee)
+  // and cached on the KInstruction; repeated calls are a pointer
+  // compare and a null test.
+  if (target->sfhCallee != f) {
+    handlers_ty::iterator it = handlers.find(f);
+    target->sfhBinding = (it != handlers.end()) ? &it->second : nullptr;
+    target->sfhCallee = f;
+  }
+
+  const SpecialFunctionBinding *binding = target->sfhBinding;
+  if (binding) {
      // FIXME: Check this... add test?
-    if (!hasReturnValue && !target->inst->use_empty()) {
-      executor.terminateStateOnExecError(state, 
+    if (!binding->hasReturnValue && !target->inst->use_empty()) {
+      executor.terminateStateOnExecError(state,
                                          "expected return value from void special function");
     } else {
-      (this->*h)(state, target, arguments);
+      (this->*(binding->handler))(state, target, arguments);
     }
     return true;
   } else {
@@ -289,6 +321,199 @@ SpecialFunctionHandler::readStringAtAddress(ExecutionState &state,
   return buf.str();
 }
 
+bool SpecialFunctionHandler::tryMemoryOperationFastPath(
+    ExecutionState &state, KInstruction *target, Function *f,
+    std::vector<ref<Expr> > &arguments) {
+  if (!InterceptMemoryOps)
+    return false;
+
+  bool isMemset = (f == memsetFn);
+  if (f != memcpyFn && f != memmoveFn && !isMemset)
+    return tryStringScanFastPath(state, target, f, arguments);
+
+  if (arguments.size() != 3)
+    return false;
+
+  // Only fully concrete calls are handled here. Anything with a symbolic
+  // pointer or size falls back to the interpreted definition, which forks
+  // and reports memory errors as usual.
+  if (!isa<ConstantExpr>(arguments[0]) || !isa<ConstantExpr>(arguments[2]))
+    return false;
+  if (!isMemset && !isa<ConstantExpr>(arguments[1]))
+    return false;
+
+  ObjectPair destOp;
+  ref<ConstantExpr> destAddress = cast<ConstantExpr>(arguments[0]);
+  if (!state.addressSpace.resolveOne(destAddress, destOp))
+    return false;
+  const MemoryObject *destMO = destOp.first;
+
+  // the offset must be concrete as the address is concrete
+  uint64_t destOffset =
+      cast<ConstantExpr>(destMO->getOffsetExpr(destAddress))->getZExtValue();
+  uint64_t n = cast<ConstantExpr>(arguments[2])->getZExtValue();
+  if (destOffset > destMO->size || n > destMO->size - destOffset)
+    return false;
+  // Leave read-only violations to the interpreted store, which reports
+  // them with the usual diagnostics.
+  if (destOp.second->readOnly)
+    return false;
+
+  if (isMemset) {
+    ObjectState *wos = state.addressSpace.getWriteable(destMO, destOp.second);
+    ref<Expr> value = ExtractExpr::create(arguments[1], 0, Expr::Int8);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
+      uint8_t byte = CE->getZExtValue(8);
+      for (uint64_t i = 0; i != n; ++i)
+        wos->write8(destOffset + i, byte);
+    } else {
+      for (uint64_t i = 0; i != n; ++i)
+        wos->write(destOffset + i, value);
+    }
+  } else {
+    ObjectPair srcOp;
+    ref<ConstantExpr> srcAddress = cast<ConstantExpr>(arguments[1]);
+    if (!state.addressSpace.resolveOne(srcAddress, srcOp))
+      return false;
+    const MemoryObject *srcMO = srcOp.first;
+    uint64_t srcOffset =
+        cast<ConstantExpr>(srcMO->getOffsetExpr(srcAddress))->getZExtValue();
+    if (srcOffset > srcMO->size || n > srcMO->size - srcOffset)
+      return false;
+
+    // Buffer the source bytes before writing so that overlapping ranges
+    // behave like memmove. memcpy with overlapping ranges is undefined,
+    // so giving it memmove semantics is also fine.
+    const ObjectState *srcOS = srcOp.second;
+    std::vector<ref<Expr> > bytes;
+    bytes.reserve(n);
+    for (uint64_t i = 0; i != n; ++i)
+      bytes.push_back(srcOS->read8(srcOffset + i));
+
+    ObjectState *wos = state.addressSpace.getWriteable(destMO, destOp.second);
+    for (uint64_t i = 0; i != n; ++i) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(bytes[i]))
+        wos->write8(destOffset + i, CE->getZExtValue(8));
+      else
+        wos->write(destOffset + i, bytes[i]);
+    }
+  }
+
+  // All three functions return the destination pointer.
+  if (!target->inst->getType()->isVoidTy())
+    executor.bindLocal(target, state, arguments[0]);
+  return true;
+}
+
+bool SpecialFunctionHandler::tryStringScanFastPath(
+    ExecutionState &state, KInstruction *target, Function *f,
+    std::vector<ref<Expr> > &arguments) {
+  bool isStrlen = (f == strlenFn);
+  bool isStrcmp = (f == strcmpFn);
+  bool isStrncmp = (f == strncmpFn);
+  bool isMemchr = (f == memchrFn);
+  if (!isStrlen && !isStrcmp && !isStrncmp && !isMemchr)
+    return false;
+
+  if (arguments.size() != (isStrlen ? 1u : isStrcmp ? 2u : 3u))
+    return false;
+  for (const auto &argument : arguments)
+    if (!isa<ConstantExpr>(argument))
+      return false;
+
+  struct ConcreteBuffer {
+    const ObjectState *os;
+    uint64_t offset;
+    /// Bytes available in the object from \ref offset.
+    uint64_t limit;
+  };
+  auto resolveBuffer = [&state](const ref<Expr> &address,
+                                ConcreteBuffer &buf) {
+    ObjectPair op;
+    ref<ConstantExpr> addr = cast<ConstantExpr>(address);
+    if (!state.addressSpace.resolveOne(addr, op))
+      return false;
+    uint64_t offset =
+        cast<ConstantExpr>(op.first->getOffsetExpr(addr))->getZExtValue();
+    if (offset > op.first->size)
+      return false;
+    buf.os = op.second;
+    buf.offset = offset;
+    buf.limit = op.first->size - offset;
+    return true;
+  };
+  // Fails on an out-of-bounds or symbolic byte; the interpreted loop
+  // then runs as usual and reports errors or forks on the byte.
+  auto byteAt = [](const ConcreteBuffer &buf, uint64_t i, uint8_t &out) {
+    if (i >= buf.limit)
+      return false;
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(buf.os->read8(buf.offset + i));
+    if (!ce)
+      return false;
+    out = ce->getZExtValue(8);
+    return true;
+  };
+
+  ref<Expr> result;
+  if (isStrlen) {
+    ConcreteBuffer s;
+    if (!resolveBuffer(arguments[0], s))
+      return false;
+    for (uint64_t i = 0;; ++i) {
+      uint8_t c;
+      if (!byteAt(s, i, c))
+        return false;
+      if (!c) {
+        result = ConstantExpr::create(
+            i, executor.getWidthForLLVMType(f->getReturnType()));
+        break;
+      }
+    }
+  } else if (isStrcmp || isStrncmp) {
+    ConcreteBuffer a, b;
+    if (!resolveBuffer(arguments[0], a) || !resolveBuffer(arguments[1], b))
+      return false;
+    uint64_t n = isStrncmp ? cast<ConstantExpr>(arguments[2])->getZExtValue()
+                           : ~UINT64_C(0);
+    int diff = 0;
+    for (uint64_t i = 0; i != n; ++i) {
+      uint8_t ca, cb;
+      if (!byteAt(a, i, ca) || !byteAt(b, i, cb))
+        return false;
+      if (ca != cb) {
+        diff = (int)ca - (int)cb;
+        break;
+      }
+      if (!ca)
+        break;
+    }
+    result = ConstantExpr::create((uint32_t)diff, Expr::Int32);
+  } else { // memchr
+    ConcreteBuffer s;
+    if (!resolveBuffer(arguments[0], s))
+      return false;
+    uint8_t needle = cast<ConstantExpr>(arguments[1])->getZExtValue(8);
+    uint64_t n = cast<ConstantExpr>(arguments[2])->getZExtValue();
+    result = ConstantExpr::create(
+        0, executor.getWidthForLLVMType(f->getReturnType()));
+    for (uint64_t i = 0; i != n; ++i) {
+      uint8_t c;
+      if (!byteAt(s, i, c))
+        return false;
+      if (c == needle) {
+        result = cast<ConstantExpr>(arguments[0])
+                     ->Add(ConstantExpr::create(
+                         i, cast<ConstantExpr>(arguments[0])->getWidth()));
+        break;
+      }
+    }
+  }
+
+  if (!target->inst->getType()->isVoidTy())
+    executor.bindLocal(target, state, result);
+  return true;
+}
+
 /****/
 
 void SpecialFunctionHandler::handleAbort(ExecutionState &state,
@@ -555,7 +780,7 @@ void SpecialFunctionHandler::handlePreferCex(ExecutionState &state,
   assert(rl.size() == 1 &&
          "prefer_cex target must resolve to precisely one object");
 
-  rl[0].first.first->cexPreferences.push_back(cond);
+  rl[0].first.first->addCexPreference(cond);
 }
 
 void SpecialFunctionHandler::handlePosixPreferCex(ExecutionState &state,
@@ -801,6 +1026,289 @@ void SpecialFunctionHandler::handleCheckMemoryAccess(ExecutionState &state,
   }
 }
 
+void SpecialFunctionHandler::handleMemcpy(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size()==3 &&
+         "invalid number of arguments to klee_memcpy");
+
+  ref<Expr> dstAddress = executor.toUnique(state, arguments[0]);
+  ref<Expr> srcAddress = executor.toUnique(state, arguments[1]);
+  ref<Expr> size = executor.toUnique(state, arguments[2]);
+  if (!isa<ConstantExpr>(dstAddress) || !isa<ConstantExpr>(srcAddress) ||
+      !isa<ConstantExpr>(size)) {
+    executor.terminateStateOnError(state, "klee_memcpy requires constant args",
+                                   Executor::User);
+    return;
+  }
+
+  uint64_t count = cast<ConstantExpr>(size)->getZExtValue();
+  if (!count)
+    return;
+
+  ObjectPair dstOp, srcOp;
+  if (!state.addressSpace.resolveOne(cast<ConstantExpr>(dstAddress), dstOp) ||
+      !dstOp.first->getBoundsCheckPointer(dstAddress, count)->isTrue()) {
+    executor.terminateStateOnError(state, "klee_memcpy: memory error",
+                                   Executor::Ptr, NULL,
+                                   executor.getAddressInfo(state, dstAddress));
+    return;
+  }
+  if (!state.addressSpace.resolveOne(cast<ConstantExpr>(srcAddress), srcOp) ||
+      !srcOp.first->getBoundsCheckPointer(srcAddress, count)->isTrue()) {
+    executor.terminateStateOnError(state, "klee_memcpy: memory error",
+                                   Executor::Ptr, NULL,
+                                   executor.getAddressInfo(state, srcAddress));
+    return;
+  }
+  if (dstOp.second->readOnly) {
+    executor.terminateStateOnError(state, "memory error: object read only",
+                                   Executor::ReadOnly);
+    return;
+  }
+
+  uint64_t dstOffset =
+      cast<ConstantExpr>(dstAddress)->getZExtValue() - dstOp.first->address;
+  uint64_t srcOffset =
+      cast<ConstantExpr>(srcAddress)->getZExtValue() - srcOp.first->address;
+
+  // Copying through a snapshot gives memmove semantics for overlapping
+  // ranges. When the source object is unshared getWriteable() hands back
+  // the source itself, so the reads have to be buffered up front.
+  const ObjectState *src = srcOp.second;
+  ObjectState *dst = state.addressSpace.getWriteable(dstOp.first, dstOp.second);
+  if (src == dst) {
+    std::vector<ref<Expr> > bytes;
+    bytes.reserve(count);
+    for (uint64_t i = 0; i != count; ++i)
+      bytes.push_back(src->read8(srcOffset + i));
+    for (uint64_t i = 0; i != count; ++i)
+      dst->write(dstOffset + i, bytes[i]);
+  } else {
+    for (uint64_t i = 0; i != count; ++i)
+      dst->write(dstOffset + i, src->read8(srcOffset + i));
+  }
+}
+
+// Resolve a unique pointer for the native string models and report any
+// failure the way a dereference would. Returns false when the state was
+// terminated.
+bool SpecialFunctionHandler::resolveStringArgument(ExecutionState &state,
+                                                   const char *function,
+                                                   ref<Expr> address,
+                                                   const MemoryObject *&mo,
+                                                   const ObjectState *&os,
+                                                   uint64_t &offset) {
+  if (!isa<ConstantExpr>(address)) {
+    executor.terminateStateOnError(
+        state, llvm::Twine(function) + " requires a constant pointer",
+        Executor::User);
+    return false;
+  }
+  ObjectPair op;
+  if (!state.addressSpace.resolveOne(cast<ConstantExpr>(address), op)) {
+    executor.terminateStateOnError(state, "memory error: out of bound pointer",
+                                   Executor::Ptr, NULL,
+                                   executor.getAddressInfo(state, address));
+    return false;
+  }
+  mo = op.first;
+  os = op.second;
+  offset = cast<ConstantExpr>(address)->getZExtValue() - mo->address;
+  if (offset >= mo->size) {
+    executor.terminateStateOnError(state, "memory error: out of bound pointer",
+                                   Executor::Ptr, NULL,
+                                   executor.getAddressInfo(state, address));
+    return false;
+  }
+  return true;
+}
+
+void SpecialFunctionHandler::handleStrlen(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size()==1 &&
+         "invalid number of arguments to __klee_strlen");
+
+  ref<Expr> address = executor.toUnique(state, arguments[0]);
+  const MemoryObject *mo;
+  const ObjectState *os;
+  uint64_t offset;
+  if (!resolveStringArgument(state, "__klee_strlen", address, mo, os, offset))
+    return;
+  Expr::Width w = executor.kmodule->targetData->getTypeSizeInBits(
+      target->inst->getType());
+
+  // The concrete prefix costs one native byte test per character.
+  uint64_t i = offset;
+  for (; i != mo->size; ++i) {
+    ref<Expr> byte = os->read8(i);
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(byte);
+    if (!CE)
+      break;
+    if (CE->isZero()) {
+      executor.bindLocal(target, state, ConstantExpr::create(i - offset, w));
+      return;
+    }
+  }
+
+  // One combined expression covers the symbolic tail instead of a fork
+  // per byte; the innermost value is only reachable when no byte up to
+  // the end of the object is zero, which the fork below turns into the
+  // out-of-bounds error the interpreted loop would have hit.
+  ref<Expr> result = ConstantExpr::create(mo->size - offset, w);
+  ref<Expr> anyNul = ConstantExpr::create(0, Expr::Bool);
+  for (uint64_t j = mo->size; j-- != i;) {
+    ref<Expr> isNul = Expr::createIsZero(os->read8(j));
+    result = SelectExpr::create(isNul, ConstantExpr::create(j - offset, w),
+                                result);
+    anyNul = OrExpr::create(anyNul, isNul);
+  }
+
+  Executor::StatePair branches = executor.fork(state, anyNul, true);
+  if (branches.second)
+    executor.terminateStateOnError(
+        *branches.second, "memory error: out of bound pointer", Executor::Ptr,
+        NULL, executor.getAddressInfo(*branches.second, address));
+  if (branches.first)
+    executor.bindLocal(target, *branches.first, result);
+}
+
+void SpecialFunctionHandler::handleStrcmp(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size()==2 &&
+         "invalid number of arguments to __klee_strcmp");
+
+  ref<Expr> addressA = executor.toUnique(state, arguments[0]);
+  ref<Expr> addressB = executor.toUnique(state, arguments[1]);
+  const MemoryObject *moA, *moB;
+  const ObjectState *osA, *osB;
+  uint64_t ka, kb;
+  if (!resolveStringArgument(state, "__klee_strcmp", addressA, moA, osA, ka) ||
+      !resolveStringArgument(state, "__klee_strcmp", addressB, moB, osB, kb))
+    return;
+
+  // Concrete prefix: stop at the first difference or terminator, as the
+  // interpreted loop would, returning *a - *b with both chars signed.
+  while (ka != moA->size && kb != moB->size) {
+    ConstantExpr *ac = dyn_cast<ConstantExpr>(osA->read8(ka));
+    ConstantExpr *bc = dyn_cast<ConstantExpr>(osB->read8(kb));
+    if (!ac || !bc)
+      break;
+    uint8_t a8 = ac->getZExtValue(8), b8 = bc->getZExtValue(8);
+    if (a8 != b8 || a8 == 0) {
+      int res = (int)(int8_t)a8 - (int)(int8_t)b8;
+      executor.bindLocal(target, state,
+                         ConstantExpr::create((uint32_t)res, Expr::Int32));
+      return;
+    }
+    ++ka, ++kb;
+  }
+
+  // Combined expression for the symbolic tail, built from the last
+  // comparable pair backwards. The loop keeps going only while the
+  // bytes are equal and non-zero; if it could still be going when one
+  // object runs out, the next read would be out of bounds.
+  uint64_t n = std::min(moA->size - ka, moB->size - kb);
+  ref<Expr> result = ConstantExpr::create(0, Expr::Int32);
+  ref<Expr> contAll = ConstantExpr::create(1, Expr::Bool);
+  for (uint64_t t = n; t-- != 0;) {
+    ref<Expr> av = osA->read8(ka + t), bv = osB->read8(kb + t);
+    ref<Expr> cont = AndExpr::create(EqExpr::create(av, bv),
+                                     Expr::createIsZero(Expr::createIsZero(av)));
+    ref<Expr> diff = SubExpr::create(SExtExpr::create(av, Expr::Int32),
+                                     SExtExpr::create(bv, Expr::Int32));
+    result = SelectExpr::create(cont, result, diff);
+    contAll = AndExpr::create(cont, contAll);
+  }
+
+  ref<Expr> overrunAddress =
+      moA->size - ka <= moB->size - kb ? addressA : addressB;
+  Executor::StatePair branches = executor.fork(state, contAll, true);
+  if (branches.first)
+    executor.terminateStateOnError(
+        *branches.first, "memory error: out of bound pointer", Executor::Ptr,
+        NULL, executor.getAddressInfo(*branches.first, overrunAddress));
+  if (branches.second)
+    executor.bindLocal(target, *branches.second, result);
+}
+
+void SpecialFunctionHandler::handleMemchr(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size()==3 &&
+         "invalid number of arguments to __klee_memchr");
+
+  ref<Expr> address = executor.toUnique(state, arguments[0]);
+  ref<Expr> wanted = executor.toUnique(state, arguments[1]);
+  ref<Expr> size = executor.toUnique(state, arguments[2]);
+  if (!isa<ConstantExpr>(size)) {
+    executor.terminateStateOnError(state, "__klee_memchr requires a constant count",
+                                   Executor::User);
+    return;
+  }
+  uint64_t count = cast<ConstantExpr>(size)->getZExtValue();
+  Expr::Width pw = Context::get().getPointerWidth();
+  if (!count) {
+    executor.bindLocal(target, state, ConstantExpr::create(0, pw));
+    return;
+  }
+
+  const MemoryObject *mo;
+  const ObjectState *os;
+  uint64_t offset;
+  if (!resolveStringArgument(state, "__klee_memchr", address, mo, os, offset))
+    return;
+
+  // The comparison promotes both sides to int, so a wanted value
+  // outside [0, 255] never matches any byte.
+  ref<Expr> wanted32 = ZExtExpr::create(wanted, Expr::Int32);
+  ConstantExpr *wc = dyn_cast<ConstantExpr>(wanted);
+  uint64_t limit = std::min(count, (uint64_t)mo->size - offset);
+
+  uint64_t i = offset;
+  if (wc) {
+    uint64_t cval = wc->getZExtValue(32);
+    for (; i != offset + limit; ++i) {
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(os->read8(i));
+      if (!CE)
+        break;
+      if (CE->getZExtValue(8) == cval) {
+        executor.bindLocal(target, state,
+                           ConstantExpr::create(mo->address + i, pw));
+        return;
+      }
+    }
+  }
+
+  ref<Expr> result = ConstantExpr::create(0, pw);
+  ref<Expr> anyMatch = ConstantExpr::create(0, Expr::Bool);
+  for (uint64_t j = offset + limit; j-- != i;) {
+    ref<Expr> match = EqExpr::create(
+        ZExtExpr::create(os->read8(j), Expr::Int32), wanted32);
+    result = SelectExpr::create(match, ConstantExpr::create(mo->address + j, pw),
+                                result);
+    anyMatch = OrExpr::create(anyMatch, match);
+  }
+
+  if (limit == count) {
+    // The scan never leaves the object; a miss just returns NULL.
+    executor.bindLocal(target, state, result);
+    return;
+  }
+
+  // The count runs past the object, so a miss within it means the
+  // interpreted loop would have read out of bounds.
+  Executor::StatePair branches = executor.fork(state, anyMatch, true);
+  if (branches.second)
+    executor.terminateStateOnError(
+        *branches.second, "memory error: out of bound pointer", Executor::Ptr,
+        NULL, executor.getAddressInfo(*branches.second, address));
+  if (branches.first)
+    executor.bindLocal(target, *branches.first, result);
+}
+
 void SpecialFunctionHandler::handleGetValue(ExecutionState &state,
                                             KInstruction *target,
                                             std::vector<ref<Expr> > &arguments) {
@@ -873,11 +1381,98 @@ void SpecialFunctionHandler::handleMakeSymbolic(ExecutionState &state,
     
     if (res) {
       executor.executeMakeSymbolic(*s, mo, name);
-    } else {      
-      executor.terminateStateOnError(*s, 
-                                     "wrong size given to klee_make_symbolic[_name]", 
+    } else {
+      executor.terminateStateOnError(*s,
+                                     "wrong size given to klee_make_symbolic[_name]",
+                                     Executor::User);
+    }
+  }
+}
+
+void SpecialFunctionHandler::handleMakeSymbolicBatch(ExecutionState &state,
+                                                     KInstruction *target,
+                                                     std::vector<ref<Expr> > &arguments) {
+  if (arguments.size() != 2) {
+    executor.terminateStateOnError(state,
+                                   "Incorrect number of arguments to "
+                                   "klee_make_symbolic_batch(klee_sym_region*, size_t)",
+                                   Executor::User);
+    return;
+  }
+
+  ref<Expr> base = executor.toUnique(state, arguments[0]);
+  ref<Expr> countExpr = executor.toUnique(state, arguments[1]);
+  if (!isa<ConstantExpr>(base) || !isa<ConstantExpr>(countExpr)) {
+    executor.terminateStateOnError(
+        state, "klee_make_symbolic_batch requires constant args",
+        Executor::User);
+    return;
+  }
+  uint64_t count = cast<ConstantExpr>(countExpr)->getZExtValue();
+  if (!count)
+    return;
+
+  // One resolution for the whole region table; the layout matches
+  // klee_sym_region, three pointer-width fields per entry.
+  Expr::Width pw = Context::get().getPointerWidth();
+  uint64_t fieldSize = pw / 8;
+  uint64_t stride = 3 * fieldSize;
+
+  ObjectPair tableOp;
+  if (!state.addressSpace.resolveOne(cast<ConstantExpr>(base), tableOp) ||
+      !tableOp.first->getBoundsCheckPointer(base, count * stride)->isTrue()) {
+    executor.terminateStateOnError(state, "memory error: out of bound pointer",
+                                   Executor::Ptr, NULL,
+                                   executor.getAddressInfo(state, base));
+    return;
+  }
+  uint64_t tableOffset =
+      cast<ConstantExpr>(base)->getZExtValue() - tableOp.first->address;
+
+  for (uint64_t i = 0; i != count; ++i) {
+    uint64_t entry = tableOffset + i * stride;
+    ref<Expr> address = tableOp.second->read(entry, pw);
+    ref<Expr> size = tableOp.second->read(entry + fieldSize, pw);
+    ref<Expr> namep = tableOp.second->read(entry + 2 * fieldSize, pw);
+    if (!isa<ConstantExpr>(address) || !isa<ConstantExpr>(size) ||
+        !isa<ConstantExpr>(namep)) {
+      executor.terminateStateOnError(
+          state, "klee_make_symbolic_batch requires concrete region entries",
+          Executor::User);
+      return;
+    }
+
+    std::string name =
+        namep->isZero() ? "" : readStringAtAddress(state, namep);
+    if (name.length() == 0) {
+      name = "unnamed";
+      klee_warning("klee_make_symbolic_batch: renamed empty name to \"unnamed\"");
+    }
+
+    ObjectPair op;
+    if (!state.addressSpace.resolveOne(cast<ConstantExpr>(address), op)) {
+      executor.terminateStateOnError(
+          state, "memory error: out of bound pointer", Executor::Ptr, NULL,
+          executor.getAddressInfo(state, address));
+      return;
+    }
+    const MemoryObject *mo = op.first;
+    if (op.second->readOnly) {
+      executor.terminateStateOnError(state,
+                                     "cannot make readonly object symbolic",
                                      Executor::User);
+      return;
+    }
+    if (cast<ConstantExpr>(address)->getZExtValue() != mo->address ||
+        cast<ConstantExpr>(size)->getZExtValue() != mo->size) {
+      executor.terminateStateOnError(
+          state, "wrong size given to klee_make_symbolic_batch",
+          Executor::User);
+      return;
     }
+
+    mo->setName(name);
+    executor.executeMakeSymbolic(state, mo, name);
   }
 }
 
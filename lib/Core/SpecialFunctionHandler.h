@@ -12,6 +12,7 @@
 
 #include "klee/Config/config.h"
 
+#include <cstdint>
 #include <iterator>
 #include <map>
 #include <vector>
@@ -26,20 +27,44 @@ namespace klee {
   class Expr;
   class ExecutionState;
   struct KInstruction;
+  class MemoryObject;
+  class ObjectState;
+  class SpecialFunctionHandler;
   template<typename T> class ref;
-  
+
+  /// A resolved special function binding: the handler implementing the
+  /// function plus whether it produces a return value. Entries live in
+  /// SpecialFunctionHandler::handlers, which is node-based, so call
+  /// sites may cache pointers to them (see KInstruction::sfhBinding).
+  struct SpecialFunctionBinding {
+    void (SpecialFunctionHandler::*handler)(ExecutionState &state,
+                                            KInstruction *target,
+                                            std::vector<ref<Expr> >
+                                              &arguments);
+    bool hasReturnValue;
+  };
+
   class SpecialFunctionHandler {
   public:
     typedef void (SpecialFunctionHandler::*Handler)(ExecutionState &state,
-                                                    KInstruction *target, 
-                                                    std::vector<ref<Expr> > 
+                                                    KInstruction *target,
+                                                    std::vector<ref<Expr> >
                                                       &arguments);
-    typedef std::map<const llvm::Function*, 
-                     std::pair<Handler,bool> > handlers_ty;
+    typedef std::map<const llvm::Function*, SpecialFunctionBinding> handlers_ty;
 
     handlers_ty handlers;
     class Executor &executor;
 
+    /// Functions eligible for tryMemoryOperationFastPath, looked up once
+    /// in bind().
+    llvm::Function *memcpyFn = nullptr;
+    llvm::Function *memmoveFn = nullptr;
+    llvm::Function *memsetFn = nullptr;
+    llvm::Function *strlenFn = nullptr;
+    llvm::Function *strcmpFn = nullptr;
+    llvm::Function *strncmpFn = nullptr;
+    llvm::Function *memchrFn = nullptr;
+
     struct HandlerInfo {
       const char *name;
       SpecialFunctionHandler::Handler handler;
@@ -96,7 +121,34 @@ namespace klee {
     /* Convenience routines */
 
     std::string readStringAtAddress(ExecutionState &state, ref<Expr> address);
-    
+
+    /// Try to execute a call to memcpy, memmove or memset directly on
+    /// the ObjectState backing the destination, instead of interpreting
+    /// the byte-copy loop in the runtime definition. Only applicable
+    /// when all arguments are concrete and both ranges lie within a
+    /// single memory object; returns false otherwise, in which case the
+    /// caller should execute the call as usual.
+    bool tryMemoryOperationFastPath(ExecutionState &state,
+                                    KInstruction *target, llvm::Function *f,
+                                    std::vector<ref<Expr> > &arguments);
+
+    /// Scanning counterpart of tryMemoryOperationFastPath for strlen,
+    /// strcmp, strncmp and memchr: computes the result directly from
+    /// the concrete byte store. Applicable only while every byte the
+    /// libc loop would inspect is concrete; the first symbolic or
+    /// out-of-bounds byte aborts the scan so forks and memory errors
+    /// still come from the interpreted definition.
+    bool tryStringScanFastPath(ExecutionState &state, KInstruction *target,
+                               llvm::Function *f,
+                               std::vector<ref<Expr> > &arguments);
+
+    /// Resolve a unique pointer argument of one of the native string
+    /// models to its object and offset, reporting failures the way a
+    /// dereference would. Returns false when the state was terminated.
+    bool resolveStringArgument(ExecutionState &state, const char *function,
+                               ref<Expr> address, const MemoryObject *&mo,
+                               const ObjectState *&os, uint64_t &offset);
+
     /* Handlers */
 
 #define HANDLER(name) void name(ExecutionState &state, \
@@ -123,8 +175,11 @@ namespace klee {
     HANDLER(handleGetValue);
     HANDLER(handleIsSymbolic);
     HANDLER(handleMakeSymbolic);
+    HANDLER(handleMakeSymbolicBatch);
     HANDLER(handleMalloc);
     HANDLER(handleMemalign);
+    HANDLER(handleMemchr);
+    HANDLER(handleMemcpy);
     HANDLER(handleMarkGlobal);
     HANDLER(handleOpenMerge);
     HANDLER(handleCloseMerge);
@@ -141,6 +196,8 @@ namespace klee {
     HANDLER(handleSetForking);
     HANDLER(handleSilentExit);
     HANDLER(handleStackTrace);
+    HANDLER(handleStrcmp);
+    HANDLER(handleStrlen);
     HANDLER(handleUnderConstrained);
     HANDLER(handleWarning);
     HANDLER(handleWarningOnce);
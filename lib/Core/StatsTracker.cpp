@@ -19,6 +19,8 @@
 #include "klee/Statistics/Statistics.h"
 #include "klee/Support/ErrorHandling.h"
 #include "klee/Support/ModuleUtil.h"
+#include "klee/Support/OptionCategories.h"
+#include "klee/Support/PhaseProfiler.h"
 #include "klee/System/MemoryUsage.h"
 
 #include "CallPathManager.h"
@@ -44,6 +46,9 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <unistd.h>
 
@@ -73,6 +78,13 @@ cl::opt<bool> OutputIStats("output-istats", cl::init(true),
                                     "callgrind format (default=true)"),
                            cl::cat(StatsCat));
 
+cl::opt<bool> OutputIStatsColumns(
+    "output-istats-columns", cl::init(false),
+    cl::desc("Also write instruction level statistics in a columnar binary "
+             "format (run.columns), one contiguous array per statistic, for "
+             "selective reads (default=false)"),
+    cl::cat(StatsCat));
+
 cl::opt<std::string> StatsWriteInterval(
     "stats-write-interval", cl::init("1s"),
     cl::desc("Approximate time between stats writes (default=1s)"),
@@ -103,12 +115,34 @@ cl::opt<unsigned> IStatsWriteAfterInstructions(
         "Write istats after each n instructions, 0 to disable (default=0)"),
     cl::cat(StatsCat));
 
+cl::opt<std::string> TelemetryFile(
+    "telemetry-file", cl::init(""),
+    cl::desc("Append one JSON object per -telemetry-interval to the given "
+             "file, with state counts, fork/query totals, cache hit rates "
+             "and memory by subsystem, so an external scheduler can follow "
+             "the run without scraping text output (default=off)"),
+    cl::cat(StatsCat));
+
+cl::opt<std::string> TelemetryInterval(
+    "telemetry-interval", cl::init("5s"),
+    cl::desc("Approximate time between telemetry events (default=5s)"),
+    cl::cat(StatsCat));
+
 // XXX I really would like to have dynamic rate control for something like this.
 cl::opt<std::string> UncoveredUpdateInterval(
     "uncovered-update-interval", cl::init("30s"),
     cl::desc("Update interval for uncovered instructions (default=30s)"),
     cl::cat(StatsCat));
 
+cl::opt<std::string> CoverageDB(
+    "coverage-db", cl::init(""),
+    cl::desc("Directory of per-module coverage databases keyed by bitcode "
+             "hash. Coverage from earlier runs of the same bitcode is "
+             "preloaded so that only never-covered code counts as new (and "
+             "coverage-guided searchers steer towards it), and the combined "
+             "coverage is written back on exit (default=off)"),
+    cl::cat(StatsCat));
+
 cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
                            cl::desc("Enable calltree tracking for instruction "
                                     "level statistics (default=true)"),
@@ -116,6 +150,17 @@ cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
 
 } // namespace
 
+namespace klee {
+llvm::cl::opt<bool> WriteLocationIndex(
+    "write-location-index", llvm::cl::init(false),
+    llvm::cl::desc("Write location.index mapping each covered source "
+                   "location to the branch-path prefix that first reached "
+                   "it; a later run can reproduce coverage of one location "
+                   "with -replay-to-location instead of a full exploration "
+                   "(default=false)"),
+    llvm::cl::cat(TestGenCat));
+} // namespace klee
+
 ///
 
 bool StatsTracker::useStatistics() {
@@ -205,24 +250,60 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   if (useStatistics() || userSearcherRequiresMD2U())
     theStatisticManager->useIndexedStats(km->infos->getMaxID());
 
+  if (!CoverageDB.empty()) {
+    if (!OutputIStats)
+      klee_error("-coverage-db requires instruction statistics "
+                 "(-output-istats)");
+    loadCoverageDB();
+  }
+
   for (auto &kfp : km->functions) {
     KFunction *kf = kfp.get();
     kf->trackCoverage = 1;
 
+    // Coverage accounting needs the instruction ids of every function,
+    // not just the ones that end up being executed.
+    if (OutputIStats)
+      km->materializeDebugInfo(kf);
+
     for (unsigned i=0; i<kf->numInstructions; ++i) {
       KInstruction *ki = kf->instructions[i];
 
       if (OutputIStats) {
         unsigned id = ki->info->id;
         theStatisticManager->setIndex(id);
-        if (kf->trackCoverage && instructionIsCoverable(ki->inst))
-          ++stats::uncoveredInstructions;
+        if (kf->trackCoverage && instructionIsCoverable(ki->inst)) {
+          if (priorCoveredInstructions.count(id))
+            // Covered by an earlier run: pre-mark it so that neither
+            // coverage accounting nor the coverage-guided searchers
+            // treat reaching it as progress.
+            theStatisticManager->setIndexedValue(stats::coveredInstructions,
+                                                 id, 1);
+          else
+            ++stats::uncoveredInstructions;
+        }
       }
       
       if (kf->trackCoverage) {
         if (BranchInst *bi = dyn_cast<BranchInst>(ki->inst))
-          if (!bi->isUnconditional())
+          if (!bi->isUnconditional()) {
             numBranches++;
+            if (OutputIStats) {
+              unsigned id = ki->info->id;
+              bool hasTrue = priorTrueBranches.count(id);
+              bool hasFalse = priorFalseBranches.count(id);
+              if (hasTrue)
+                theStatisticManager->setIndexedValue(stats::trueBranches, id,
+                                                     1);
+              if (hasFalse)
+                theStatisticManager->setIndexedValue(stats::falseBranches, id,
+                                                     1);
+              if (hasTrue && hasFalse)
+                ++fullBranches;
+              else if (hasTrue || hasFalse)
+                ++partialBranches;
+            }
+          }
       }
     }
   }
@@ -286,6 +367,29 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     }));
   }
 
+  if (TelemetryFile != "") {
+    // Open in append mode: schedulers tail the file across runs, and a
+    // restarted run must not truncate history a consumer is following.
+    std::error_code ec;
+    telemetryFile = std::unique_ptr<llvm::raw_fd_ostream>(
+        new llvm::raw_fd_ostream(TelemetryFile, ec, llvm::sys::fs::OF_Append));
+    if (ec)
+      klee_error("Unable to open telemetry file (%s): %s",
+                 TelemetryFile.c_str(), ec.message().c_str());
+
+    const time::Span telemetryInterval(TelemetryInterval);
+    if (!telemetryInterval)
+      klee_error("--telemetry-interval must be a non-zero duration");
+    writeTelemetryLine();
+    executor.timers.add(std::make_unique<Timer>(telemetryInterval, [&]{
+      writeTelemetryLine();
+    }));
+  }
+
+  if (OutputIStatsColumns && !OutputIStats)
+    klee_error("-output-istats-columns requires instruction statistics "
+               "(-output-istats)");
+
   if (OutputIStats) {
     istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
     if (istatsFile) {
@@ -296,10 +400,19 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     } else {
       klee_error("Unable to open instruction level stats file (run.istats).");
     }
+
+    if (OutputIStatsColumns) {
+      istatsColumnsFile =
+          executor.interpreterHandler->openOutputFile("run.columns");
+      if (!istatsColumnsFile)
+        klee_error("Unable to open columnar stats file (run.columns).");
+    }
   }
 }
 
-StatsTracker::~StatsTracker() {  
+StatsTracker::~StatsTracker() {
+  stopIStatsWriter();
+
   if (statsFile) {
     auto rc = sqlite3_step(transactionEndStmt);
     if (rc != SQLITE_DONE) {
@@ -317,11 +430,123 @@ void StatsTracker::done() {
   if (statsFile)
     writeStatsLine();
 
+  if (telemetryFile)
+    writeTelemetryLine();
+
   if (OutputIStats) {
     if (updateMinDistToUncovered)
       computeReachableUncovered();
-    if (istatsFile)
+    if (istatsFile) {
+      // Queue a final snapshot and wait for the writer to drain it so
+      // the file is complete when we return.
       writeIStats();
+      stopIStatsWriter();
+    }
+  }
+
+  if (!coverageDBFile.empty())
+    writeCoverageDB();
+
+  if (WriteLocationIndex)
+    writeLocationIndex();
+}
+
+void StatsTracker::writeLocationIndex() {
+  auto f = executor.interpreterHandler->openOutputFile("location.index");
+  if (!f) {
+    klee_warning("unable to write location.index");
+    return;
+  }
+  for (const auto &entry : locationIndex) {
+    std::vector<unsigned char> decisions;
+    for (const BranchHistoryNode *n = entry.second.get(); n;
+         n = n->parent.get())
+      decisions.push_back(n->branch);
+    std::reverse(decisions.begin(), decisions.end());
+    *f << entry.first << ' ';
+    if (!decisions.empty())
+      f->write(reinterpret_cast<const char *>(decisions.data()),
+               decisions.size());
+    *f << '\n';
+  }
+}
+
+void StatsTracker::loadCoverageDB() {
+  if (std::error_code ec = sys::fs::create_directories(CoverageDB))
+    klee_error("unable to create coverage database directory %s: %s",
+               CoverageDB.c_str(), ec.message().c_str());
+
+  SmallString<128> path(CoverageDB);
+  sys::path::append(path, executor.kmodule->getModuleHash() + ".cov");
+  coverageDBFile = std::string(path.str());
+
+  std::ifstream is(coverageDBFile, std::ios::binary);
+  if (!is) // first run for this module
+    return;
+
+  char magic[8];
+  std::uint32_t counts[3];
+  auto readSet = [&is](std::set<unsigned> &set, std::uint32_t n) {
+    std::vector<std::uint32_t> ids(n);
+    if (n && !is.read(reinterpret_cast<char *>(ids.data()),
+                      n * sizeof(std::uint32_t)))
+      return false;
+    set.insert(ids.begin(), ids.end());
+    return true;
+  };
+  if (!is.read(magic, sizeof(magic)) ||
+      memcmp(magic, "KLEECOV1", sizeof(magic)) != 0 ||
+      !is.read(reinterpret_cast<char *>(counts), sizeof(counts)) ||
+      !readSet(priorCoveredInstructions, counts[0]) ||
+      !readSet(priorTrueBranches, counts[1]) ||
+      !readSet(priorFalseBranches, counts[2])) {
+    klee_warning("ignoring malformed coverage database %s",
+                 coverageDBFile.c_str());
+    priorCoveredInstructions.clear();
+    priorTrueBranches.clear();
+    priorFalseBranches.clear();
+    return;
+  }
+
+  klee_message("KLEE: using coverage database %s (%zu covered instructions)",
+               coverageDBFile.c_str(), priorCoveredInstructions.size());
+}
+
+void StatsTracker::writeCoverageDB() {
+  KModule *km = executor.kmodule.get();
+  std::vector<std::uint32_t> covered, trueBrs, falseBrs;
+  for (auto &kfp : km->functions) {
+    KFunction *kf = kfp.get();
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      unsigned id = kf->instructions[i]->info->id;
+      if (theStatisticManager->getIndexedValue(stats::coveredInstructions, id))
+        covered.push_back(id);
+      if (theStatisticManager->getIndexedValue(stats::trueBranches, id))
+        trueBrs.push_back(id);
+      if (theStatisticManager->getIndexedValue(stats::falseBranches, id))
+        falseBrs.push_back(id);
+    }
+  }
+
+  // Write to a temporary and rename so that concurrent runs sharing
+  // the database never observe a partial file.
+  std::string tmp = coverageDBFile + ".tmp." + std::to_string(getpid());
+  std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+  const char magic[8] = {'K', 'L', 'E', 'E', 'C', 'O', 'V', '1'};
+  std::uint32_t counts[3] = {static_cast<std::uint32_t>(covered.size()),
+                             static_cast<std::uint32_t>(trueBrs.size()),
+                             static_cast<std::uint32_t>(falseBrs.size())};
+  os.write(magic, sizeof(magic));
+  os.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+  for (const auto *ids : {&covered, &trueBrs, &falseBrs})
+    os.write(reinterpret_cast<const char *>(ids->data()),
+             ids->size() * sizeof(std::uint32_t));
+  os.close();
+
+  if (os.fail() || std::rename(tmp.c_str(), coverageDBFile.c_str()) != 0) {
+    klee_warning("unable to write coverage database %s",
+                 coverageDBFile.c_str());
+    std::remove(tmp.c_str());
   }
 }
 
@@ -367,6 +592,12 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
+        if (updateMinDistToUncovered)
+          newlyCoveredInstructions.push_back(inst);
+        if (WriteLocationIndex && !ii.file.empty())
+          // first reach wins: emplace never overwrites
+          locationIndex.emplace(ii.file + ":" + std::to_string(ii.line),
+                                es.branchHistory);
       }
     }
   }
@@ -460,7 +691,16 @@ void StatsTracker::writeStatsHeader() {
              << "ResolveTime INTEGER,"
              << "QueryCexCacheMisses INTEGER,"
              << "QueryCexCacheHits INTEGER,"
-             << "ArrayHashTime INTEGER"
+             << "ArrayHashTime INTEGER,"
+             << "StateMemory INTEGER,"
+             << "Batches INTEGER,"
+             << "BatchedInstructions INTEGER,"
+             << "SolverMemory INTEGER,"
+             << "QueryCacheHits INTEGER,"
+             << "QueryCacheMisses INTEGER,"
+             << "QueryCacheTime INTEGER,"
+             << "QueryCacheSavedTime INTEGER,"
+             << "QueryCexCacheSavedTime INTEGER"
          << ')';
   char *zErrMsg = nullptr;
   if(sqlite3_exec(statsFile, create.str().c_str(), nullptr, nullptr, &zErrMsg)) {
@@ -493,7 +733,16 @@ void StatsTracker::writeStatsHeader() {
              << "ResolveTime,"
              << "QueryCexCacheMisses,"
              << "QueryCexCacheHits,"
-             << "ArrayHashTime"
+             << "ArrayHashTime,"
+             << "StateMemory,"
+             << "Batches,"
+             << "BatchedInstructions,"
+             << "SolverMemory,"
+             << "QueryCacheHits,"
+             << "QueryCacheMisses,"
+             << "QueryCacheTime,"
+             << "QueryCacheSavedTime,"
+             << "QueryCexCacheSavedTime"
          << ") VALUES ("
              << "?,"
              << "?,"
@@ -514,6 +763,15 @@ void StatsTracker::writeStatsHeader() {
              << "?,"
              << "?,"
              << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
              << "? "
          << ')';
 
@@ -527,6 +785,7 @@ time::Span StatsTracker::elapsed() {
 }
 
 void StatsTracker::writeStatsLine() {
+  profiler::ScopedPhase phase(profiler::Stats);
   sqlite3_bind_int64(insertStmt, 1, stats::instructions);
   sqlite3_bind_int64(insertStmt, 2, fullBranches);
   sqlite3_bind_int64(insertStmt, 3, partialBranches);
@@ -551,6 +810,18 @@ void StatsTracker::writeStatsLine() {
 #else
   sqlite3_bind_int64(insertStmt, 20, -1LL);
 #endif
+  std::uint64_t stateMemory = 0;
+  for (const auto state : executor.states)
+    stateMemory += state->approximateMemoryUsage();
+  sqlite3_bind_int64(insertStmt, 21, stateMemory);
+  sqlite3_bind_int64(insertStmt, 22, stats::batches);
+  sqlite3_bind_int64(insertStmt, 23, stats::batchInstructions);
+  sqlite3_bind_int64(insertStmt, 24, stats::solverMemory);
+  sqlite3_bind_int64(insertStmt, 25, stats::queryCacheHits);
+  sqlite3_bind_int64(insertStmt, 26, stats::queryCacheMisses);
+  sqlite3_bind_int64(insertStmt, 27, stats::queryCacheTime);
+  sqlite3_bind_int64(insertStmt, 28, stats::queryCacheSavedTime);
+  sqlite3_bind_int64(insertStmt, 29, stats::queryCexCacheSavedTime);
   int errCode = sqlite3_step(insertStmt);
   if(errCode != SQLITE_DONE) klee_error("Error writing stats data: %s", sqlite3_errmsg(statsFile));
   sqlite3_reset(insertStmt);
@@ -568,6 +839,37 @@ void StatsTracker::writeStatsLine() {
   }
 }
 
+void StatsTracker::writeTelemetryLine() {
+  profiler::ScopedPhase phase(profiler::Stats);
+  std::uint64_t stateMemory = 0;
+  for (const auto state : executor.states)
+    stateMemory += state->approximateMemoryUsage();
+
+  // One flat JSON object per line; keys are a stable interface for
+  // external schedulers. Counters are cumulative, times in
+  // microseconds, memory in bytes; consumers derive rates themselves.
+  llvm::raw_fd_ostream &os = *telemetryFile;
+  os << "{\"elapsed_us\":" << elapsed().toMicroseconds()
+     << ",\"instructions\":" << stats::instructions
+     << ",\"states\":" << executor.states.size()
+     << ",\"forks\":" << stats::forks
+     << ",\"queries\":" << stats::queries
+     << ",\"query_cache_hits\":" << stats::queryCacheHits
+     << ",\"query_cache_misses\":" << stats::queryCacheMisses
+     << ",\"cex_cache_hits\":" << stats::queryCexCacheHits
+     << ",\"cex_cache_misses\":" << stats::queryCexCacheMisses
+     << ",\"solver_time_us\":" << stats::solverTime
+     << ",\"fork_time_us\":" << stats::forkTime
+     << ",\"resolve_time_us\":" << stats::resolveTime
+     << ",\"covered_instructions\":" << stats::coveredInstructions
+     << ",\"uncovered_instructions\":" << stats::uncoveredInstructions
+     << ",\"malloc_usage\":" << util::GetTotalMallocUsage()
+     << ",\"deterministic_usage\":"
+     << executor.memory->getUsedDeterministicSize()
+     << ",\"state_memory\":" << stateMemory << "}\n";
+  os.flush();
+}
+
 void StatsTracker::updateStateStatistics(uint64_t addend) {
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
@@ -580,9 +882,90 @@ void StatsTracker::updateStateStatistics(uint64_t addend) {
 }
 
 void StatsTracker::writeIStats() {
+  profiler::ScopedPhase phase(profiler::Stats);
+  // Snapshot the statistics here, where no instruction is being
+  // interpreted, and leave the expensive serialization of the
+  // callgrind file to the background writer so that it never blocks
+  // the executor.
+
+  // set state counts, decremented after we snapshot so that we don't
+  // have to zero all records each time.
+  updateStateStatistics(1);
+  std::vector<uint64_t> snapshot;
+  theStatisticManager->copyIndexedStats(snapshot);
+  updateStateStatistics((uint64_t)-1);
+
+  CallSiteSummaryTable callSiteStats;
+  if (UseCallPaths)
+    callPathManager.getSummaryStatistics(callSiteStats);
+
+  std::lock_guard<std::mutex> guard(istatsWriterMutex);
+  // If the writer has not picked up the previous snapshot yet, this
+  // simply replaces it; only the most recent one matters.
+  istatsPendingSnapshot = std::move(snapshot);
+  istatsPendingCallSiteStats = std::move(callSiteStats);
+  istatsPending = true;
+  if (!istatsWriterThread.joinable()) {
+    // The writer may have been stopped at the end of an earlier session;
+    // clear the exit flag so the respawned thread keeps serving.
+    istatsWriterExit = false;
+    istatsWriterThread = std::thread(&StatsTracker::istatsWriterLoop, this);
+  }
+  istatsWriterCond.notify_one();
+}
+
+void StatsTracker::istatsWriterLoop() {
+  for (;;) {
+    std::vector<uint64_t> snapshot;
+    CallSiteSummaryTable callSiteStats;
+    {
+      std::unique_lock<std::mutex> lock(istatsWriterMutex);
+      istatsWriterCond.wait(
+          lock, [this] { return istatsPending || istatsWriterExit; });
+      if (!istatsPending)
+        return;
+      snapshot = std::move(istatsPendingSnapshot);
+      callSiteStats = std::move(istatsPendingCallSiteStats);
+      istatsPending = false;
+    }
+    writeIStatsFile(snapshot, callSiteStats);
+    if (istatsColumnsFile)
+      writeIStatsColumnsFile(snapshot);
+  }
+}
+
+void StatsTracker::stopIStatsWriter() {
+  {
+    std::lock_guard<std::mutex> guard(istatsWriterMutex);
+    istatsWriterExit = true;
+  }
+  istatsWriterCond.notify_one();
+  if (istatsWriterThread.joinable())
+    istatsWriterThread.join();
+}
+
+/// The statistics recorded per instruction in run.istats and
+/// run.columns, in column order.
+static const char *const IStatsRecordedStats[] = {
+    "Queries",
+    "QueriesValid",
+    "QueriesInvalid",
+    "QueryTime",
+    "ResolveTime",
+    "Instructions",
+    "InstructionTimes",
+    "InstructionRealTimes",
+    "Forks",
+    "CoveredInstructions",
+    "UncoveredInstructions",
+    "States",
+    "MinDistToUncovered"};
+
+void StatsTracker::writeIStatsFile(const std::vector<uint64_t> &indexedStats,
+                                   const CallSiteSummaryTable &callSiteStats) {
   const auto m = executor.kmodule->module.get();
   llvm::raw_fd_ostream &of = *istatsFile;
-  
+
   // We assume that we didn't move the file pointer
   unsigned istatsSize = of.tell();
 
@@ -598,19 +981,8 @@ void StatsTracker::writeIStats() {
   unsigned nStats = sm.getNumStatistics();
   llvm::SmallBitVector istatsMask(nStats);
 
-  istatsMask.set(sm.getStatisticID("Queries"));
-  istatsMask.set(sm.getStatisticID("QueriesValid"));
-  istatsMask.set(sm.getStatisticID("QueriesInvalid"));
-  istatsMask.set(sm.getStatisticID("QueryTime"));
-  istatsMask.set(sm.getStatisticID("ResolveTime"));
-  istatsMask.set(sm.getStatisticID("Instructions"));
-  istatsMask.set(sm.getStatisticID("InstructionTimes"));
-  istatsMask.set(sm.getStatisticID("InstructionRealTimes"));
-  istatsMask.set(sm.getStatisticID("Forks"));
-  istatsMask.set(sm.getStatisticID("CoveredInstructions"));
-  istatsMask.set(sm.getStatisticID("UncoveredInstructions"));
-  istatsMask.set(sm.getStatisticID("States"));
-  istatsMask.set(sm.getStatisticID("MinDistToUncovered"));
+  for (const char *name : IStatsRecordedStats)
+    istatsMask.set(sm.getStatisticID(name));
 
   of << "positions: instr line\n";
 
@@ -628,18 +1000,9 @@ void StatsTracker::writeIStats() {
       of << sm.getStatistic(i).getShortName() << " ";
   }
   of << "\n";
-  
-  // set state counts, decremented after we process so that we don't
-  // have to zero all records each time.
-  if (istatsMask.test(stats::states.getID()))
-    updateStateStatistics(1);
 
   std::string sourceFile = "";
 
-  CallSiteSummaryTable callSiteStats;
-  if (UseCallPaths)
-    callPathManager.getSummaryStatistics(callSiteStats);
-
   of << "ob=" << llvm::sys::path::filename(objectFilename).str() << "\n";
 
   for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
@@ -671,17 +1034,17 @@ void StatsTracker::writeIStats() {
           of << ii.line << " ";
           for (unsigned i=0; i<nStats; i++)
             if (istatsMask.test(i))
-              of << sm.getIndexedValue(sm.getStatistic(i), index) << " ";
+              of << indexedStats[index*nStats + i] << " ";
           of << "\n";
 
-          if (UseCallPaths && 
+          if (UseCallPaths &&
               (isa<CallInst>(instr) || isa<InvokeInst>(instr))) {
-            CallSiteSummaryTable::iterator it = callSiteStats.find(instr);
+            CallSiteSummaryTable::const_iterator it = callSiteStats.find(instr);
             if (it!=callSiteStats.end()) {
               for (auto fit = it->second.begin(), fie = it->second.end();
                    fit != fie; ++fit) {
                 const Function *f = fit->first;
-                CallSiteInfo &csi = fit->second;
+                const CallSiteInfo &csi = fit->second;
                 const FunctionInfo &fii =
                     executor.kmodule->infos->getFunctionInfo(*f);
 
@@ -719,14 +1082,95 @@ void StatsTracker::writeIStats() {
     }
   }
 
-  if (istatsMask.test(stats::states.getID()))
-    updateStateStatistics((uint64_t)-1);
-  
   // Clear then end of the file if necessary (no truncate op?).
   unsigned pos = of.tell();
   for (unsigned i=pos; i<istatsSize; ++i)
     of << '\n';
-  
+
+  of.flush();
+}
+
+void StatsTracker::writeIStatsColumnsFile(
+    const std::vector<uint64_t> &indexedStats) {
+  StatisticManager &sm = *theStatisticManager;
+  unsigned nStats = sm.getNumStatistics();
+
+  // The preamble -- magic, column names and the instruction id ->
+  // source location table -- only depends on the module, so it is
+  // built once; every write afterwards just rewrites the fixed-size
+  // statistic arrays behind it. All fields are host-endian; the file
+  // is meant to be mmapped on the machine that produced it.
+  if (istatsColumnsPreamble.empty()) {
+    for (const char *name : IStatsRecordedStats)
+      istatsColumnIds.push_back(sm.getStatisticID(name));
+    istatsColumnsIndexCount = indexedStats.size() / nStats;
+
+    std::string &pre = istatsColumnsPreamble;
+    auto emit32 = [&pre](uint32_t v) {
+      pre.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    };
+    auto emit64 = [&pre](uint64_t v) {
+      pre.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    };
+    auto emitString = [&](const std::string &s) {
+      emit32(s.size());
+      pre.append(s.data(), s.size());
+    };
+
+    pre.assign("KLEECOLS", 8);
+    emit32(1);                        // version
+    emit32(istatsColumnIds.size());   // number of columns
+    emit64(istatsColumnsIndexCount);  // entries per column
+    emit64(0);                        // offset of the columns, patched below
+
+    for (unsigned id : istatsColumnIds)
+      emitString(sm.getStatistic(id).getShortName());
+
+    // Dense instruction id -> (file, line, assembly line); files are
+    // interned into a string table to keep the mapping compact.
+    std::vector<std::string> files;
+    std::map<std::string, uint32_t> fileIds;
+    std::vector<uint32_t> locations(istatsColumnsIndexCount * 3, 0);
+    const Module *m = executor.kmodule->module.get();
+    for (const Function &fn : *m) {
+      if (fn.isDeclaration())
+        continue;
+      for (const BasicBlock &bb : fn) {
+        for (const Instruction &instr : bb) {
+          const InstructionInfo &ii = executor.kmodule->infos->getInfo(instr);
+          if (ii.id >= istatsColumnsIndexCount)
+            continue;
+          auto fit = fileIds.emplace(ii.file, files.size());
+          if (fit.second)
+            files.push_back(ii.file);
+          locations[ii.id * 3] = fit.first->second;
+          locations[ii.id * 3 + 1] = ii.line;
+          locations[ii.id * 3 + 2] = ii.assemblyLine;
+        }
+      }
+    }
+    emit32(files.size());
+    for (const std::string &f : files)
+      emitString(f);
+    for (uint32_t v : locations)
+      emit32(v);
+
+    // Align the columns so a single statistic can be mmapped as an
+    // array of uint64_t.
+    pre.resize((pre.size() + 7) & ~(size_t)7, '\0');
+    uint64_t columnsOffset = pre.size();
+    std::memcpy(&pre[24], &columnsOffset, sizeof(columnsOffset));
+  }
+
+  llvm::raw_fd_ostream &of = *istatsColumnsFile;
+  of.seek(0);
+  of << istatsColumnsPreamble;
+  for (unsigned id : istatsColumnIds) {
+    for (uint64_t i = 0; i < istatsColumnsIndexCount; ++i) {
+      uint64_t v = indexedStats[i * nStats + id];
+      of.write(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+  }
   of.flush();
 }
 
@@ -752,6 +1196,91 @@ static std::vector<Instruction*> getSuccs(Instruction *i) {
   return res;
 }
 
+static std::vector<Instruction*> getPreds(Instruction *i) {
+  BasicBlock *bb = i->getParent();
+  std::vector<Instruction*> res;
+
+  if (i==&*(bb->begin())) {
+    for (pred_iterator it = pred_begin(bb), ie = pred_end(bb); it != ie; ++it)
+      res.push_back((*it)->getTerminator());
+  } else {
+    res.push_back(&*(--(i->getIterator())));
+  }
+
+  return res;
+}
+
+/// Shortest distance from \p inst to the instruction following it, or 0
+/// if the following instruction is unreachable. This is 1 except for
+/// calls, which must also pass through a callee.
+static unsigned shortestDistThrough(Instruction *inst) {
+  unsigned bestThrough = 0;
+
+  if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
+    std::vector<Function*> &targets = callTargets[inst];
+    for (std::vector<Function*>::iterator fnIt = targets.begin(),
+           ie = targets.end(); fnIt != ie; ++fnIt) {
+      uint64_t dist = functionShortestPath[*fnIt];
+      if (dist) {
+        dist = 1+dist; // count instruction itself
+        if (bestThrough==0 || dist<bestThrough)
+          bestThrough = dist;
+      }
+    }
+  } else {
+    bestThrough = 1;
+  }
+
+  return bestThrough;
+}
+
+/// Recompute the minDistToUncovered value of \p inst from its callees
+/// and successors, treating the current value as an upper bound.
+/// Returns true if the stored value changed.
+static bool relaxMinDistToUncovered(Instruction *inst,
+                                    const InstructionInfoTable &infos,
+                                    StatisticManager &sm) {
+  unsigned id = infos.getInfo(*inst).id;
+  uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered, id);
+
+  if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
+    std::vector<Function*> &targets = callTargets[inst];
+    for (std::vector<Function*>::iterator fnIt = targets.begin(),
+           ie = targets.end(); fnIt != ie; ++fnIt) {
+      if (!(*fnIt)->isDeclaration()) {
+        uint64_t calleeDist = sm.getIndexedValue(
+            stats::minDistToUncovered, infos.getFunctionInfo(*(*fnIt)).id);
+        if (calleeDist) {
+          calleeDist = 1+calleeDist; // count instruction itself
+          if (best==0 || calleeDist<best)
+            best = calleeDist;
+        }
+      }
+    }
+  }
+
+  unsigned bestThrough = shortestDistThrough(inst);
+  if (bestThrough) {
+    std::vector<Instruction*> succs = getSuccs(inst);
+    for (std::vector<Instruction*>::iterator it = succs.begin(),
+           ie = succs.end(); it != ie; ++it) {
+      uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
+                                         infos.getInfo(*(*it)).id);
+      if (dist) {
+        uint64_t val = bestThrough + dist;
+        if (best==0 || val<best)
+          best = val;
+      }
+    }
+  }
+
+  if (best != cur) {
+    sm.setIndexedValue(stats::minDistToUncovered, id, best);
+    return true;
+  }
+  return false;
+}
+
 uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
                                          uint64_t minDistAtRA) {
   StatisticManager &sm = *theStatisticManager;
@@ -918,83 +1447,117 @@ void StatsTracker::computeReachableUncovered() {
   }
 
   // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        Instruction *inst = &*it;
-        unsigned id = infos.getInfo(*inst).id;
-        instructions.push_back(inst);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
-      }
+  static bool fullComputationDone = false;
+  if (fullComputationDone) {
+    // Covering an instruction only removes it as a distance source, so
+    // the only values that can change are the ones that were derived
+    // from a newly covered source. Collect that region by walking
+    // dependence edges backwards from the newly covered instructions,
+    // reset it to the per-instruction source values, and relax it back
+    // to a fixed point; everything outside the region keeps its correct
+    // value and acts as the frontier. Relaxing without the reset would
+    // be unsound: when the last uncovered instruction reachable from a
+    // cycle is covered, the stale values in the cycle justify each
+    // other and never rise.
+    if (newlyCoveredInstructions.empty())
+      return; // no distances changed, frame values are still consistent
+
+    std::set<Instruction*> affected;
+    std::vector<Instruction*> worklist;
+    for (std::vector<Instruction*>::iterator it =
+           newlyCoveredInstructions.begin(),
+           ie = newlyCoveredInstructions.end(); it != ie; ++it) {
+      // An uncovered instruction is always its own nearest source, so
+      // its value is 1 and changes now that the source is gone.
+      if (affected.insert(*it).second)
+        worklist.push_back(*it);
     }
-  }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
-    for (std::vector<Instruction*>::iterator it = instructions.begin(),
-           ie = instructions.end(); it != ie; ++it) {
-      Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getInfo(*inst).id);
-      unsigned bestThrough = 0;
-      
-      if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-        std::vector<Function*> &targets = callTargets[inst];
-        for (std::vector<Function*>::iterator fnIt = targets.begin(),
-               ie = targets.end(); fnIt != ie; ++fnIt) {
-          uint64_t dist = functionShortestPath[*fnIt];
-          if (dist) {
-            dist = 1+dist; // count instruction itself
-            if (bestThrough==0 || dist<bestThrough)
-              bestThrough = dist;
-          }
 
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(
-                stats::minDistToUncovered, infos.getFunctionInfo(*(*fnIt)).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
-            }
-          }
-        }
-      } else {
-        bestThrough = 1;
+    while (!worklist.empty()) {
+      Instruction *inst = worklist.back();
+      worklist.pop_back();
+      // Still the pre-update value; the reset happens below, once the
+      // whole region is known.
+      uint64_t value = sm.getIndexedValue(stats::minDistToUncovered,
+                                          infos.getInfo(*inst).id);
+
+      // Predecessors whose value was derived through this instruction.
+      std::vector<Instruction*> preds = getPreds(inst);
+      for (std::vector<Instruction*>::iterator it = preds.begin(),
+             ie = preds.end(); it != ie; ++it) {
+        Instruction *pred = *it;
+        unsigned bestThrough = shortestDistThrough(pred);
+        if (bestThrough &&
+            sm.getIndexedValue(stats::minDistToUncovered,
+                               infos.getInfo(*pred).id) ==
+              bestThrough + value &&
+            affected.insert(pred).second)
+          worklist.push_back(pred);
       }
-      
-      if (bestThrough) {
-        std::vector<Instruction*> succs = getSuccs(inst);
-        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*(*it2)).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
+
+      // Call sites whose value was derived from this function's entry.
+      Function *f = inst->getParent()->getParent();
+      if (inst == &*(f->begin()->begin())) {
+        std::vector<Instruction*> &callers = functionCallers[f];
+        for (std::vector<Instruction*>::iterator it = callers.begin(),
+               ie = callers.end(); it != ie; ++it) {
+          if (sm.getIndexedValue(stats::minDistToUncovered,
+                                 infos.getInfo(*(*it)).id) == value + 1 &&
+              affected.insert(*it).second)
+            worklist.push_back(*it);
         }
       }
+    }
 
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, infos.getInfo(*inst).id,
-                           best);
-        changed = true;
+    for (std::set<Instruction*>::iterator it = affected.begin(),
+           ie = affected.end(); it != ie; ++it) {
+      unsigned id = infos.getInfo(*(*it)).id;
+      sm.setIndexedValue(stats::minDistToUncovered, id,
+                         sm.getIndexedValue(stats::uncoveredInstructions, id));
+    }
+
+    bool changed;
+    do {
+      changed = false;
+      for (std::set<Instruction*>::iterator it = affected.begin(),
+             ie = affected.end(); it != ie; ++it)
+        if (relaxMinDistToUncovered(*it, infos, sm))
+          changed = true;
+    } while (changed);
+  } else {
+    fullComputationDone = true;
+
+    std::vector<Instruction *> instructions;
+    for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+         fnIt != fn_ie; ++fnIt) {
+      // Not sure if I should bother to preorder here.
+      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+           bbIt != bb_ie; ++bbIt) {
+        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+             it != ie; ++it) {
+          Instruction *inst = &*it;
+          unsigned id = infos.getInfo(*inst).id;
+          instructions.push_back(inst);
+          sm.setIndexedValue(stats::minDistToUncovered,
+                             id,
+                             sm.getIndexedValue(stats::uncoveredInstructions, id));
+        }
       }
     }
-  } while (changed);
+
+    std::reverse(instructions.begin(), instructions.end());
+
+    // I'm so lazy it's not even worklisted.
+    bool changed;
+    do {
+      changed = false;
+      for (std::vector<Instruction*>::iterator it = instructions.begin(),
+             ie = instructions.end(); it != ie; ++it)
+        if (relaxMinDistToUncovered(*it, infos, sm))
+          changed = true;
+    } while (changed);
+  }
+  newlyCoveredInstructions.clear();
 
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
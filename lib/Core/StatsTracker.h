@@ -11,11 +11,19 @@
 #define KLEE_STATSTRACKER_H
 
 #include "CallPathManager.h"
+#include "klee/ADT/Ref.h"
 #include "klee/System/Time.h"
 
+#include "llvm/Support/CommandLine.h"
+
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sqlite3.h>
+#include <thread>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -25,8 +33,13 @@ namespace llvm {
 }
 
 namespace klee {
+  struct BranchHistoryNode;
   class ExecutionState;
   class Executor;
+
+  /// Shared with Executor.cpp, which must record branch histories for
+  /// the location index even when -lazy-path-recording is off.
+  extern llvm::cl::opt<bool> WriteLocationIndex;
   class InstructionInfoTable;
   class InterpreterHandler;
   struct KInstruction;
@@ -40,6 +53,8 @@ namespace klee {
     std::string objectFilename;
 
     std::unique_ptr<llvm::raw_fd_ostream> istatsFile;
+    /// JSON-lines telemetry stream (-telemetry-file); null when disabled.
+    std::unique_ptr<llvm::raw_fd_ostream> telemetryFile;
     ::sqlite3 *statsFile = nullptr;
     ::sqlite3_stmt *transactionBeginStmt = nullptr;
     ::sqlite3_stmt *transactionEndStmt = nullptr;
@@ -55,6 +70,54 @@ namespace klee {
 
     bool updateMinDistToUncovered;
 
+    /// Instructions that transitioned to covered since the last
+    /// minDistToUncovered computation. computeReachableUncovered()
+    /// propagates distance changes outward from these instead of
+    /// recomputing over the whole module.
+    std::vector<llvm::Instruction *> newlyCoveredInstructions;
+
+    /// Background run.istats writer. writeIStats() snapshots the
+    /// indexed statistics and call-site summaries on the executor
+    /// thread and hands them to this thread, which serializes the
+    /// (potentially huge) callgrind file without blocking
+    /// interpretation. Only the most recent snapshot is kept; if the
+    /// writer is still busy when the next interval fires, the older
+    /// snapshot is dropped.
+    std::thread istatsWriterThread;
+    std::mutex istatsWriterMutex;
+    std::condition_variable istatsWriterCond;
+    std::vector<uint64_t> istatsPendingSnapshot;
+    CallSiteSummaryTable istatsPendingCallSiteStats;
+    bool istatsPending = false;
+    bool istatsWriterExit = false;
+
+    /// Columnar run.istats companion (-output-istats-columns); null
+    /// when disabled. The preamble -- header, column names and the
+    /// instruction id to source location table -- only depends on the
+    /// module and is built once on the first write; later writes just
+    /// rewrite the per-statistic arrays behind it.
+    std::unique_ptr<llvm::raw_fd_ostream> istatsColumnsFile;
+    std::string istatsColumnsPreamble;
+    std::vector<unsigned> istatsColumnIds;
+    std::uint64_t istatsColumnsIndexCount = 0;
+
+    /// Path of this module's entry in the cross-run coverage database
+    /// (-coverage-db), keyed by the hash of the prepared bitcode;
+    /// empty when the database is disabled.
+    std::string coverageDBFile;
+
+    /// Instruction and branch-direction ids covered by earlier runs of
+    /// the same bitcode, loaded from \ref coverageDBFile.
+    std::set<unsigned> priorCoveredInstructions;
+    std::set<unsigned> priorTrueBranches;
+    std::set<unsigned> priorFalseBranches;
+
+    /// First-reach index (-write-location-index): for every source
+    /// location, the branch history of the state that first covered
+    /// it. Written as location.index at shutdown; a later run can
+    /// replay an entry with -replay-to-location.
+    std::map<std::string, ref<BranchHistoryNode>> locationIndex;
+
   public:
     static bool useStatistics();
     static bool useIStats();
@@ -63,7 +126,16 @@ namespace klee {
     void updateStateStatistics(uint64_t addend);
     void writeStatsHeader();
     void writeStatsLine();
+    void writeTelemetryLine();
     void writeIStats();
+    void writeIStatsFile(const std::vector<uint64_t> &indexedStats,
+                         const CallSiteSummaryTable &callSiteStats);
+    void writeIStatsColumnsFile(const std::vector<uint64_t> &indexedStats);
+    void istatsWriterLoop();
+    void stopIStatsWriter();
+    void loadCoverageDB();
+    void writeCoverageDB();
+    void writeLocationIndex();
 
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
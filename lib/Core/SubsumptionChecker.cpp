@@ -0,0 +1,130 @@
+//===-- SubsumptionChecker.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SubsumptionChecker.h"
+
+#include "ExecutionState.h"
+#include "TimingSolver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Support/OptionCategories.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+
+namespace klee {
+
+llvm::cl::opt<bool> UseSubsumption(
+    "use-subsumption", llvm::cl::init(false),
+    llvm::cl::desc("Terminate states at control-flow joins when an "
+                   "already-explored state with the same stores and weaker "
+                   "constraints covers them (default=false)"),
+    llvm::cl::cat(TerminationCat));
+
+namespace {
+
+/// Cap on the number of recorded states per instruction, so hot loop
+/// heads do not accumulate unbounded candidate lists.
+const unsigned MaxRecordsPerLocation = 8;
+
+std::uint64_t hashCombine(std::uint64_t h, std::uint64_t v) {
+  return h * 0x9e3779b97f4a7c15ULL + v;
+}
+
+} // namespace
+
+bool SubsumptionChecker::implies(ExecutionState &state,
+                                 const ref<Expr> &target) {
+  // trivially implied when present verbatim
+  if (std::find(state.constraints.begin(), state.constraints.end(), target) !=
+      state.constraints.end())
+    return true;
+
+  // Restrict the antecedent to the constraints transitively sharing
+  // arrays with the target, as IndependentSolver does for queries; the
+  // rest cannot influence the implication.
+  std::vector<const Array *> arrays;
+  findSymbolicObjects(target, arrays);
+  std::set<const Array *> closure(arrays.begin(), arrays.end());
+
+  std::vector<std::pair<ref<Expr>, std::vector<const Array *>>> candidates;
+  for (const auto &c : state.constraints) {
+    std::vector<const Array *> a;
+    findSymbolicObjects(c, a);
+    candidates.emplace_back(c, std::move(a));
+  }
+
+  std::vector<ref<Expr>> fragment;
+  std::vector<bool> used(candidates.size(), false);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (unsigned i = 0; i != candidates.size(); ++i) {
+      if (used[i])
+        continue;
+      bool overlaps =
+          std::any_of(candidates[i].second.begin(), candidates[i].second.end(),
+                      [&](const Array *a) { return closure.count(a); });
+      if (!overlaps)
+        continue;
+
+      used[i] = true;
+      changed = true;
+      fragment.push_back(candidates[i].first);
+      closure.insert(candidates[i].second.begin(), candidates[i].second.end());
+    }
+  }
+
+  std::uint64_t key = target->hash();
+  for (const auto &e : fragment)
+    key = hashCombine(key, e->hash());
+
+  auto cached = implicationCache.find(key);
+  if (cached != implicationCache.end())
+    return cached->second;
+
+  bool result = false;
+  if (!solver->mustBeTrue(ConstraintSet(std::move(fragment)), target, result,
+                          state.queryMetaData))
+    result = false;
+  implicationCache[key] = result;
+  return result;
+}
+
+bool SubsumptionChecker::isSubsumed(ExecutionState &state) {
+  const std::uint64_t key = state.mergeKey();
+  auto &records = index[state.pc];
+
+  for (const auto &record : records) {
+    if (record.key != key ||
+        !record.objects.isIdenticalTo(state.addressSpace.objects))
+      continue;
+
+    bool subsumed = true;
+    for (const auto &c : record.constraints) {
+      if (!implies(state, c)) {
+        subsumed = false;
+        break;
+      }
+    }
+    if (subsumed)
+      return true;
+  }
+
+  if (records.size() >= MaxRecordsPerLocation)
+    records.erase(records.begin());
+  records.push_back(Record{key, state.addressSpace.objects,
+                           std::vector<ref<Expr>>(state.constraints.begin(),
+                                                  state.constraints.end())});
+  return false;
+}
+
+} // End klee namespace
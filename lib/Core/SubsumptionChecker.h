@@ -0,0 +1,89 @@
+//===-- SubsumptionChecker.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SUBSUMPTIONCHECKER_H
+#define KLEE_SUBSUMPTIONCHECKER_H
+
+#include "AddressSpace.h"
+
+#include "klee/Expr/Expr.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+extern llvm::cl::opt<bool> UseSubsumption;
+
+class ExecutionState;
+struct KInstruction;
+class TimingSolver;
+
+/// @brief Prunes states that are subsumed by an already-explored sibling.
+///
+/// A state is subsumed when an earlier state was recorded at the same
+/// KInstruction with an identical stack and address space and a weaker
+/// constraint set: everything reachable from the new state is then also
+/// reachable from the recorded one. Candidates are indexed by
+/// KInstruction; structurally incompatible records are rejected with a
+/// single integer compare, and each implication query is restricted to
+/// the constraints transitively sharing arrays with its target (the
+/// decomposition IndependentSolver applies to queries) and memoized
+/// across states.
+///
+/// The check is a heuristic: it assumes recorded states go on to
+/// explore their subtree, which a later early termination (memory
+/// pressure, timeouts) can violate.
+class SubsumptionChecker {
+  struct Record {
+    /// Structural fingerprint (ExecutionState::mergeKey) of the
+    /// recorded state.
+    std::uint64_t key;
+    /// The recorded state's object map; holding it keeps the shared
+    /// tree alive so identity comparisons stay valid after the state
+    /// is gone.
+    MemoryMap objects;
+    /// The recorded state's constraints.
+    std::vector<ref<Expr>> constraints;
+  };
+
+  TimingSolver *solver;
+
+  /// Recorded states, indexed by the instruction they were checked at.
+  std::unordered_map<const KInstruction *, std::vector<Record>> index;
+
+  /// Memoized implication results, keyed by a hash of the target
+  /// constraint and the relevant fragment of the querying state's
+  /// constraints.
+  std::unordered_map<std::uint64_t, bool> implicationCache;
+
+  /// Whether the state's constraints imply \p target.
+  bool implies(ExecutionState &state, const ref<Expr> &target);
+
+public:
+  explicit SubsumptionChecker(TimingSolver *solver) : solver(solver) {}
+
+  /// Check the state against the records for its current instruction.
+  /// Returns true when it is subsumed by one of them; otherwise the
+  /// state is recorded as a future subsumption candidate.
+  bool isSubsumed(ExecutionState &state);
+
+  /// Drop all records and memoized implications. Must run before the
+  /// MemoryObjects the recorded object maps refer to are destroyed,
+  /// i.e. at the end of each session.
+  void reset() {
+    index.clear();
+    implicationCache.clear();
+  }
+};
+} // End klee namespace
+
+#endif /* KLEE_SUBSUMPTIONCHECKER_H */
@@ -13,16 +13,206 @@
 
 #include "klee/Config/Version.h"
 #include "klee/Statistics/Statistics.h"
-#include "klee/Statistics/TimerStatIncrementer.h"
 #include "klee/Solver/Solver.h"
 
 #include "CoreStats.h"
 
+#include "klee/Support/OptionCategories.h"
+#include "klee/Support/PhaseProfiler.h"
+#include "klee/Support/Tracepoints.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+
 using namespace klee;
 using namespace llvm;
 
 /***/
 
+namespace {
+cl::opt<bool> RecentQueryWindow(
+    "recent-query-window", cl::init(true),
+    cl::desc("Remember the last few solver verdicts and reuse them for "
+             "identical queries against unchanged constraints (default=true)"),
+    cl::cat(klee::SolvingCat));
+
+cl::opt<bool> AdaptiveSolverTimeouts(
+    "adaptive-solver-timeouts", cl::init(false),
+    cl::desc("Give historically cheap classes of queries a tight timeout, "
+             "retrying with the full -max-solver-time when it is exceeded "
+             "(default=false)"),
+    cl::cat(klee::SolvingCat));
+
+cl::opt<unsigned> SampledQueryTiming(
+    "sampled-query-timing", cl::init(0),
+    cl::desc("Time only one in N solver queries (0=time every query), "
+             "charging each sampled measurement N-fold so solver-time "
+             "attribution stays unbiased in expectation; a slow sample "
+             "re-enables precise timing for the next N queries "
+             "(default=0)"),
+    cl::cat(klee::SolvingCat));
+
+/// Releases the owning TimingSolver's interpreter lock (if one was
+/// configured) around an underlying solver invocation and restores the
+/// Executor's active-solver slot once the lock is held again.
+class SolverCallGuard {
+  TimingSolver &owner;
+  profiler::ScopedPhase phase;
+
+public:
+  SolverCallGuard(TimingSolver &owner)
+      : owner(owner), phase(profiler::Solver) {
+    if (owner.interpreterLock)
+      owner.interpreterLock->unlock();
+  }
+  ~SolverCallGuard() {
+    if (owner.interpreterLock) {
+      owner.interpreterLock->lock();
+      *owner.activeSolverSlot = &owner;
+    }
+  }
+};
+
+/// Replacement for TimerStatIncrementer on the query paths: with
+/// -sampled-query-timing only one in N queries pays the clock reads,
+/// and its measurement is charged N-fold to stats::solverTime and the
+/// state's queryCost, keeping both unbiased in expectation at a
+/// fraction of the timing overhead. Untimed queries report zero cost.
+class QueryTimer {
+  TimingSolver &owner;
+  unsigned weight = 1; // attribution multiplier of this measurement
+  bool active = true;  // whether this query is being timed
+  time::Point start;
+
+public:
+  explicit QueryTimer(TimingSolver &owner) : owner(owner) {
+    if (SampledQueryTiming > 1) {
+      if (owner.preciseQueryBurst) {
+        --owner.preciseQueryBurst;
+      } else if (owner.queriesUntilSample) {
+        --owner.queriesUntilSample;
+        active = false;
+      } else {
+        owner.queriesUntilSample = SampledQueryTiming - 1;
+        weight = SampledQueryTiming;
+      }
+    }
+    if (active)
+      start = time::getWallTime();
+  }
+
+  ~QueryTimer() {
+    if (!active)
+      return;
+    const time::Span d = delta();
+    stats::solverTime += (d * weight).toMicroseconds();
+    // A slow sample suggests the steady state changed; time the next
+    // queries precisely so a burst of hard queries is not attributed
+    // through a single inflated measurement.
+    if (weight > 1 && d > time::milliseconds(1))
+      owner.preciseQueryBurst = SampledQueryTiming;
+  }
+
+  bool timed() const { return active; }
+
+  /// Unweighted elapsed time; zero for untimed queries.
+  time::Span delta() const {
+    return active ? time::getWallTime() - start : time::Span();
+  }
+
+  /// Weighted elapsed time for cost attribution.
+  time::Span cost() const { return delta() * weight; }
+};
+} // namespace
+
+unsigned klee::queryShapeHash(const Expr *e, unsigned depth) {
+  const unsigned MaxShapeDepth = 4;
+  unsigned res = e->getKind() ^ (e->getWidth() << 8);
+  if (depth >= MaxShapeDepth)
+    return res;
+  for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+    res = res * Expr::MAGIC_HASH_CONSTANT +
+          queryShapeHash(e->getKid(i).get(), depth + 1);
+  return res;
+}
+
+time::Span TimingSolver::timeoutFor(const ref<Expr> &expr) {
+  if (!AdaptiveSolverTimeouts || !baseTimeout)
+    return baseTimeout;
+
+  auto it = queryProfiles.find(queryShapeHash(expr.get()));
+  if (it == queryProfiles.end() || it->second.samples < 8)
+    return baseTimeout;
+
+  // Leave generous headroom over the worst time observed for this
+  // class, with a floor so a run of trivial queries never starves a
+  // slightly harder sibling outright.
+  time::Span budget =
+      std::max(it->second.maxTime * 4u, time::milliseconds(100));
+  if (budget >= baseTimeout)
+    return baseTimeout;
+
+  solver->setCoreSolverTimeout(budget);
+  return budget;
+}
+
+void TimingSolver::recordQueryTime(const ref<Expr> &expr, time::Span elapsed) {
+  if (!AdaptiveSolverTimeouts)
+    return;
+
+  // The profile map only ever grows; drop it wholesale in the unlikely
+  // case a run produces this many distinct query shapes.
+  if (queryProfiles.size() > 1 << 20)
+    queryProfiles.clear();
+
+  QueryClassProfile &profile = queryProfiles[queryShapeHash(expr.get())];
+  profile.maxTime = std::max(profile.maxTime, elapsed);
+  ++profile.samples;
+}
+
+bool TimingSolver::restoreTimeoutForRetry(time::Span used) {
+  if (used == baseTimeout)
+    return false;
+  solver->setCoreSolverTimeout(baseTimeout);
+  return true;
+}
+
+TimingSolver::RecentQuery *
+TimingSolver::lookupRecentQuery(const ConstraintSet &constraints,
+                                const ref<Expr> &expr) {
+  if (!RecentQueryWindow)
+    return nullptr;
+  for (RecentQuery &q : recentQueries)
+    if (q.constraintsVersion == constraints.version() && !q.expr.isNull() &&
+        q.expr->hash() == expr->hash() && q.expr == expr)
+      return &q;
+  return nullptr;
+}
+
+void TimingSolver::recordRecentQuery(const ConstraintSet &constraints,
+                                     const ref<Expr> &expr, int mustBeTrue,
+                                     int mustBeFalse,
+                                     const ref<ConstantExpr> &value) {
+  if (!RecentQueryWindow)
+    return;
+  RecentQuery *q = lookupRecentQuery(constraints, expr);
+  if (!q) {
+    q = &recentQueries[recentQueryNext];
+    recentQueryNext = (recentQueryNext + 1) % RecentQueryWindowSize;
+    q->constraintsVersion = constraints.version();
+    q->expr = expr;
+    q->mustBeTrue = q->mustBeFalse = -1;
+    q->value = nullptr;
+  }
+  if (mustBeTrue >= 0)
+    q->mustBeTrue = mustBeTrue;
+  if (mustBeFalse >= 0)
+    q->mustBeFalse = mustBeFalse;
+  if (!value.isNull())
+    q->value = value;
+}
+
 bool TimingSolver::evaluate(const ConstraintSet &constraints, ref<Expr> expr,
                             Solver::Validity &result,
                             SolverQueryMetaData &metaData) {
@@ -32,14 +222,42 @@ bool TimingSolver::evaluate(const ConstraintSet &constraints, ref<Expr> expr,
     return true;
   }
 
-  TimerStatIncrementer timer(stats::solverTime);
+  QueryTimer timer(*this);
 
   if (simplifyExprs)
     expr = ConstraintManager::simplifyExpr(constraints, expr);
 
-  bool success = solver->evaluate(Query(constraints, expr), result);
+  if (RecentQuery *q = lookupRecentQuery(constraints, expr)) {
+    if (q->mustBeTrue >= 0 && q->mustBeFalse >= 0) {
+      result = q->mustBeTrue   ? Solver::True
+               : q->mustBeFalse ? Solver::False
+                                : Solver::Unknown;
+      metaData.queryCost += timer.cost();
+      return true;
+    }
+  }
 
-  metaData.queryCost += timer.delta();
+  KLEE_TRACE2(solver_query_begin, 0, queryShapeHash(expr.get()));
+  bool success;
+  {
+    SolverCallGuard guard(*this);
+    time::Span timeout = timeoutFor(expr);
+    success = solver->evaluate(Query(constraints, expr), result);
+    if (!success && restoreTimeoutForRetry(timeout))
+      success = solver->evaluate(Query(constraints, expr), result);
+    else if (timeout != baseTimeout)
+      solver->setCoreSolverTimeout(baseTimeout);
+  }
+  KLEE_TRACE3(solver_query_end, 0, queryShapeHash(expr.get()),
+              timer.delta().toMicroseconds());
+
+  metaData.queryCost += timer.cost();
+  if (success) {
+    if (timer.timed())
+      recordQueryTime(expr, timer.delta());
+    recordRecentQuery(constraints, expr, result == Solver::True,
+                      result == Solver::False);
+  }
 
   return success;
 }
@@ -52,21 +270,63 @@ bool TimingSolver::mustBeTrue(const ConstraintSet &constraints, ref<Expr> expr,
     return true;
   }
 
-  TimerStatIncrementer timer(stats::solverTime);
+  QueryTimer timer(*this);
 
   if (simplifyExprs)
     expr = ConstraintManager::simplifyExpr(constraints, expr);
 
-  bool success = solver->mustBeTrue(Query(constraints, expr), result);
+  if (RecentQuery *q = lookupRecentQuery(constraints, expr)) {
+    if (q->mustBeTrue >= 0) {
+      result = q->mustBeTrue;
+      metaData.queryCost += timer.cost();
+      return true;
+    }
+  }
 
-  metaData.queryCost += timer.delta();
+  KLEE_TRACE2(solver_query_begin, 1, queryShapeHash(expr.get()));
+  bool success;
+  {
+    SolverCallGuard guard(*this);
+    time::Span timeout = timeoutFor(expr);
+    success = solver->mustBeTrue(Query(constraints, expr), result);
+    if (!success && restoreTimeoutForRetry(timeout))
+      success = solver->mustBeTrue(Query(constraints, expr), result);
+    else if (timeout != baseTimeout)
+      solver->setCoreSolverTimeout(baseTimeout);
+  }
+  KLEE_TRACE3(solver_query_end, 1, queryShapeHash(expr.get()),
+              timer.delta().toMicroseconds());
+
+  metaData.queryCost += timer.cost();
+  if (success) {
+    if (timer.timed())
+      recordQueryTime(expr, timer.delta());
+    // mustBeTrue(e) == true also rules out mustBeFalse(e).
+    recordRecentQuery(constraints, expr, result, result ? 0 : -1);
+  }
 
   return success;
 }
 
 bool TimingSolver::mustBeFalse(const ConstraintSet &constraints, ref<Expr> expr,
                                bool &result, SolverQueryMetaData &metaData) {
-  return mustBeTrue(constraints, Expr::createIsZero(expr), result, metaData);
+  // The negated form below is a fresh node, so look up the original
+  // expression first: this is what catches a mayBeFalse() issued right
+  // after an evaluate() on the same condition.
+  if (!isa<ConstantExpr>(expr)) {
+    if (RecentQuery *q = lookupRecentQuery(constraints, expr)) {
+      if (q->mustBeFalse >= 0) {
+        result = q->mustBeFalse;
+        return true;
+      }
+    }
+  }
+
+  bool success =
+      mustBeTrue(constraints, Expr::createIsZero(expr), result, metaData);
+  if (success && !isa<ConstantExpr>(expr))
+    recordRecentQuery(constraints, expr, result ? 0 : -1, result);
+  return success;
 }
 
 bool TimingSolver::mayBeTrue(const ConstraintSet &constraints, ref<Expr> expr,
@@ -96,14 +356,39 @@ bool TimingSolver::getValue(const ConstraintSet &constraints, ref<Expr> expr,
     return true;
   }
   
-  TimerStatIncrementer timer(stats::solverTime);
+  QueryTimer timer(*this);
 
   if (simplifyExprs)
     expr = ConstraintManager::simplifyExpr(constraints, expr);
 
-  bool success = solver->getValue(Query(constraints, expr), result);
+  if (RecentQuery *q = lookupRecentQuery(constraints, expr)) {
+    if (!q->value.isNull()) {
+      result = q->value;
+      metaData.queryCost += timer.cost();
+      return true;
+    }
+  }
 
-  metaData.queryCost += timer.delta();
+  KLEE_TRACE2(solver_query_begin, 2, queryShapeHash(expr.get()));
+  bool success;
+  {
+    SolverCallGuard guard(*this);
+    time::Span timeout = timeoutFor(expr);
+    success = solver->getValue(Query(constraints, expr), result);
+    if (!success && restoreTimeoutForRetry(timeout))
+      success = solver->getValue(Query(constraints, expr), result);
+    else if (timeout != baseTimeout)
+      solver->setCoreSolverTimeout(baseTimeout);
+  }
+  KLEE_TRACE3(solver_query_end, 2, queryShapeHash(expr.get()),
+              timer.delta().toMicroseconds());
+
+  metaData.queryCost += timer.cost();
+  if (success) {
+    if (timer.timed())
+      recordQueryTime(expr, timer.delta());
+    recordRecentQuery(constraints, expr, -1, -1, result);
+  }
 
   return success;
 }
@@ -115,12 +400,20 @@ bool TimingSolver::getInitialValues(
   if (objects.empty())
     return true;
 
-  TimerStatIncrementer timer(stats::solverTime);
+  QueryTimer timer(*this);
 
-  bool success = solver->getInitialValues(
-      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects, result);
+  // getInitialValues queries have no distinguished expression; class 0.
+  KLEE_TRACE2(solver_query_begin, 3, 0);
+  bool success;
+  {
+    SolverCallGuard guard(*this);
+    success = solver->getInitialValues(
+        Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+        result);
+  }
+  KLEE_TRACE3(solver_query_end, 3, 0, timer.delta().toMicroseconds());
 
-  metaData.queryCost += timer.delta();
+  metaData.queryCost += timer.cost();
 
   return success;
 }
@@ -128,8 +421,12 @@ bool TimingSolver::getInitialValues(
 std::pair<ref<Expr>, ref<Expr>>
 TimingSolver::getRange(const ConstraintSet &constraints, ref<Expr> expr,
                        SolverQueryMetaData &metaData) {
-  TimerStatIncrementer timer(stats::solverTime);
-  auto result = solver->getRange(Query(constraints, expr));
-  metaData.queryCost += timer.delta();
+  QueryTimer timer(*this);
+  std::pair<ref<Expr>, ref<Expr>> result;
+  {
+    SolverCallGuard guard(*this);
+    result = solver->getRange(Query(constraints, expr));
+  }
+  metaData.queryCost += timer.cost();
   return result;
 }
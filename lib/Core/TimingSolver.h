@@ -16,12 +16,21 @@
 #include "klee/System/Time.h"
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace klee {
 class ConstraintSet;
 class Solver;
 
+/// Structural hash identifying a class of query expressions: the
+/// operator and width skeleton of the top few levels of the expression,
+/// ignoring constants and array contents. Queries issued by the same
+/// code pattern (e.g. the same bounds check re-instantiated along many
+/// paths) land in the same class.
+unsigned queryShapeHash(const Expr *e, unsigned depth = 0);
+
 /// TimingSolver - A simple class which wraps a solver and handles
 /// tracking the statistics that we care about.
 class TimingSolver {
@@ -29,6 +38,84 @@ public:
   std::unique_ptr<Solver> solver;
   bool simplifyExprs;
 
+  /// When non-null, released for the duration of each underlying solver
+  /// invocation so that other execution workers can run while this
+  /// solver is busy. See setInterpreterLock().
+  std::mutex *interpreterLock = nullptr;
+
+  /// Slot holding the owning Executor's current solver; restored to
+  /// this solver whenever \ref interpreterLock is reacquired.
+  TimingSolver **activeSolverSlot = nullptr;
+
+  /// -sampled-query-timing bookkeeping, maintained by the query timer
+  /// in TimingSolver.cpp: queries left until the next timed sample,
+  /// and queries left in a precise-timing burst after a slow sample.
+  unsigned queriesUntilSample = 0;
+  unsigned preciseQueryBurst = 0;
+
+private:
+  /// The timeout passed to setTimeout(); the upper bound for any
+  /// adaptively chosen per-query timeout.
+  time::Span baseTimeout;
+
+  /// Observed cost profile for one class of structurally similar query
+  /// expressions.
+  struct QueryClassProfile {
+    time::Span maxTime;
+    unsigned samples = 0;
+  };
+
+  /// Query time profiles keyed by a shallow structural hash of the
+  /// query expression. Not shared between solvers; each TimingSolver
+  /// (e.g. per execution worker) learns its own profile.
+  std::unordered_map<unsigned, QueryClassProfile> queryProfiles;
+
+  /// Returns the timeout to use for a query on \p expr: tight for query
+  /// classes that have always been cheap, \ref baseTimeout otherwise.
+  time::Span timeoutFor(const ref<Expr> &expr);
+
+  /// Record that a query on \p expr completed in \p elapsed.
+  void recordQueryTime(const ref<Expr> &expr, time::Span elapsed);
+
+  /// If the last query ran under the tightened timeout \p used and
+  /// failed, restore the full timeout and return true so the caller can
+  /// retry the query once before giving up.
+  bool restoreTimeoutForRetry(time::Span used);
+
+  /// One remembered solver verdict, keyed by the query expression and
+  /// the version stamp of the constraint set it was answered under.
+  /// The tri-state fields are 1/0 when known and -1 when this entry
+  /// does not answer that question.
+  struct RecentQuery {
+    std::uint64_t constraintsVersion = 0;
+    ref<Expr> expr;
+    signed char mustBeTrue = -1;
+    signed char mustBeFalse = -1;
+    ref<ConstantExpr> value;
+  };
+
+  /// Ring of the most recent query results, consulted before descending
+  /// into the solver chain. Catches the back-to-back duplicates
+  /// different code paths issue for the same condition (fork
+  /// feasibility, then getValue, then toConstant) without the
+  /// canonicalization cost of the CachingSolver further down the chain.
+  static const unsigned RecentQueryWindowSize = 64;
+  RecentQuery recentQueries[RecentQueryWindowSize];
+  unsigned recentQueryNext = 0;
+
+  /// Returns the remembered entry for \p expr under \p constraints, or
+  /// null when there is none (or the window is disabled).
+  RecentQuery *lookupRecentQuery(const ConstraintSet &constraints,
+                                 const ref<Expr> &expr);
+
+  /// Merge a verdict into the window, evicting the oldest entry if \p
+  /// expr has none yet. Pass -1 (or a null \p value) for facts the
+  /// caller did not learn.
+  void recordRecentQuery(const ConstraintSet &constraints,
+                         const ref<Expr> &expr, int mustBeTrue,
+                         int mustBeFalse,
+                         const ref<ConstantExpr> &value = nullptr);
+
 public:
   /// TimingSolver - Construct a new timing solver.
   ///
@@ -38,7 +125,22 @@ public:
   TimingSolver(Solver *_solver, bool _simplifyExprs = true)
       : solver(_solver), simplifyExprs(_simplifyExprs) {}
 
-  void setTimeout(time::Span t) { solver->setCoreSolverTimeout(t); }
+  void setTimeout(time::Span t) {
+    baseTimeout = t;
+    solver->setCoreSolverTimeout(t);
+  }
+
+  /// setInterpreterLock - Release \p lock while the underlying solver is
+  /// running so that other execution workers may interpret (and issue
+  /// their own queries) concurrently. Once the lock has been reacquired,
+  /// \p activeSlot is pointed back at this solver, keeping the owning
+  /// Executor's notion of the current solver consistent even if another
+  /// worker ran in the meantime. Used only by the parallel execution
+  /// mode; by default queries run with whatever locks the caller holds.
+  void setInterpreterLock(std::mutex *lock, TimingSolver **activeSlot) {
+    interpreterLock = lock;
+    activeSolverSlot = activeSlot;
+  }
 
   char *getConstraintLog(const Query &query) {
     return solver->getConstraintLog(query);
@@ -16,6 +16,7 @@
 #include "klee/Support/ErrorHandling.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/DynamicLibrary.h"
 
 using namespace llvm;
 using namespace klee;
@@ -80,12 +81,50 @@ cl::opt<std::string> BatchTime(
     cl::init("5s"),
     cl::cat(SearchCat));
 
+cl::opt<bool> UseAdaptiveBatching(
+    "use-adaptive-batching",
+    cl::desc("Use adaptive batching searcher (per-state slices sized from "
+             "observed instruction throughput and solver-wait ratios, see "
+             "Batches/BatchedInstructions in run.stats) (default=false)"),
+    cl::init(false),
+    cl::cat(SearchCat));
+
+cl::opt<unsigned> ParkStalledStates(
+    "park-stalled-states",
+    cl::desc("Park states that executed the given number of instructions "
+             "without covering new code, readmitting them only when no "
+             "progressing states remain. Set to 0 to disable (default=0)"),
+    cl::init(0),
+    cl::cat(SearchCat));
+
+cl::opt<std::string> RecordSchedule(
+    "record-schedule",
+    cl::desc("Record every scheduling decision (including timer-driven batch "
+             "boundaries) into the given file, so the run can be reproduced "
+             "with --replay-schedule (default=off)"),
+    cl::cat(SearchCat));
+
+cl::opt<std::string> ReplaySchedule(
+    "replay-schedule",
+    cl::desc("Replay the scheduling decisions recorded in the given file "
+             "instead of consulting the search heuristic, reproducing the "
+             "recorded run without its wall-clock dependences (default=off)"),
+    cl::cat(SearchCat));
+
+cl::opt<std::string> SearcherPlugin(
+    "searcher-plugin",
+    cl::desc("Load the given shared object and use the klee_score_state "
+             "function it exports as the search heuristic, overriding "
+             "--search (see include/klee/Core/SearcherPlugin.h) "
+             "(default=off)"),
+    cl::cat(SearchCat));
+
 } // namespace
 
 void klee::initializeSearchOptions() {
   // default values
   if (CoreSearch.empty()) {
-    if (UseMerge){
+    if (UseMerge || UseAutoMerge){
       CoreSearch.push_back(Searcher::NURS_CovNew);
       klee_warning("--use-merge enabled. Using NURS_CovNew as default searcher.");
     } else {
@@ -96,7 +135,10 @@ void klee::initializeSearchOptions() {
 }
 
 bool klee::userSearcherRequiresMD2U() {
-  return (std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_MD2U) != CoreSearch.end() ||
+  // A plugin receives the min-dist-to-uncovered feature, so keep the
+  // underlying computation enabled for it.
+  return (!SearcherPlugin.empty() ||
+          std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_MD2U) != CoreSearch.end() ||
           std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CovNew) != CoreSearch.end() ||
           std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_ICnt) != CoreSearch.end() ||
           std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CPICnt) != CoreSearch.end() ||
@@ -104,13 +146,14 @@ bool klee::userSearcherRequiresMD2U() {
 }
 
 
-Searcher *getNewSearcher(Searcher::CoreSearchType type, RNG &rng, PTree &processTree) {
+Searcher *getNewSearcher(Searcher::CoreSearchType type, RNG &rng, PTree &processTree,
+                         const SearchProfile *profile) {
   Searcher *searcher = nullptr;
   switch (type) {
     case Searcher::DFS: searcher = new DFSSearcher(); break;
     case Searcher::BFS: searcher = new BFSSearcher(); break;
     case Searcher::RandomState: searcher = new RandomSearcher(rng); break;
-    case Searcher::RandomPath: searcher = new RandomPathSearcher(processTree, rng); break;
+    case Searcher::RandomPath: searcher = new RandomPathSearcher(processTree, rng, profile); break;
     case Searcher::NURS_CovNew: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CoveringNew, rng); break;
     case Searcher::NURS_MD2U: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::MinDistToUncovered, rng); break;
     case Searcher::NURS_Depth: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::Depth, rng); break;
@@ -125,34 +168,72 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, RNG &rng, PTree &process
 
 Searcher *klee::constructUserSearcher(Executor &executor) {
 
-  Searcher *searcher = getNewSearcher(CoreSearch[0], executor.theRNG, *executor.processTree);
+  Searcher *searcher = nullptr;
 
-  if (CoreSearch.size() > 1) {
-    std::vector<Searcher *> s;
-    s.push_back(searcher);
+  if (!SearcherPlugin.empty()) {
+    std::string error;
+    if (sys::DynamicLibrary::LoadLibraryPermanently(SearcherPlugin.c_str(),
+                                                    &error))
+      klee_error("unable to load searcher plugin %s: %s",
+                 SearcherPlugin.c_str(), error.c_str());
+    void *fn =
+        sys::DynamicLibrary::SearchForAddressOfSymbol("klee_score_state");
+    if (!fn)
+      klee_error("searcher plugin %s does not export klee_score_state",
+                 SearcherPlugin.c_str());
+    searcher = new PluginSearcher(reinterpret_cast<KleeStateScoreFn>(fn),
+                                  executor.theRNG);
+  } else {
+    searcher = getNewSearcher(CoreSearch[0], executor.theRNG, *executor.processTree,
+                              executor.priorSearchProfile.get());
+
+    if (CoreSearch.size() > 1) {
+      std::vector<Searcher *> s;
+      s.push_back(searcher);
+
+      for (unsigned i = 1; i < CoreSearch.size(); i++)
+        s.push_back(getNewSearcher(CoreSearch[i], executor.theRNG, *executor.processTree,
+                                   executor.priorSearchProfile.get()));
+
+      searcher = new InterleavedSearcher(s);
+    }
+  }
 
-    for (unsigned i = 1; i < CoreSearch.size(); i++)
-      s.push_back(getNewSearcher(CoreSearch[i], executor.theRNG, *executor.processTree));
+  if (ParkStalledStates)
+    searcher = new StallParkingSearcher(searcher, ParkStalledStates);
 
-    searcher = new InterleavedSearcher(s);
-  }
+  if (UseBatchingSearch && UseAdaptiveBatching)
+    klee_error("cannot use both -use-batching-search and "
+               "-use-adaptive-batching");
 
   if (UseBatchingSearch) {
     searcher = new BatchingSearcher(searcher, time::Span(BatchTime),
                                     BatchInstructions);
+  } else if (UseAdaptiveBatching) {
+    searcher = new AdaptiveBatchingSearcher(searcher);
   }
 
   if (UseIterativeDeepeningTimeSearch) {
     searcher = new IterativeDeepeningTimeSearcher(searcher);
   }
 
-  if (UseMerge) {
+  if (UseMerge || UseAutoMerge) {
     auto *ms = new MergingSearcher(searcher);
     executor.setMergingSearcher(ms);
 
     searcher = ms;
   }
 
+  // Outermost, so the log reflects the selections the executor actually
+  // sees. Only meaningful with a single worker; parallel interleavings
+  // are not captured.
+  if (!RecordSchedule.empty() && !ReplaySchedule.empty())
+    klee_error("cannot use both -record-schedule and -replay-schedule");
+  if (!RecordSchedule.empty())
+    searcher = new ScheduleRecordingSearcher(searcher, RecordSchedule);
+  else if (!ReplaySchedule.empty())
+    searcher = new ScheduleReplaySearcher(searcher, ReplaySchedule);
+
   llvm::raw_ostream &os = executor.getHandler().getInfoStream();
 
   os << "BEGIN searcher description\n";
@@ -1,13 +1,57 @@
 #include "klee/Expr/ArrayCache.h"
 
+#include <algorithm>
+#include <mutex>
+
 namespace klee {
 
+std::atomic<std::uint64_t> arrayCacheGeneration(0);
+
+namespace {
+/// Ring of the dead-array sets of the most recent generations, so
+/// ArrayExprHash instances that are only a few collections behind can
+/// evict per entry rather than clearing wholesale.
+const unsigned ReclamationLogSize = 16;
+
+struct ReclamationEntry {
+  std::uint64_t generation = 0;
+  std::vector<const Array *> dead;
+};
+
+std::mutex reclamationLogMutex;
+ReclamationEntry reclamationLog[ReclamationLogSize];
+} // namespace
+
+void publishReclaimedArrays(std::uint64_t generation,
+                            std::vector<const Array *> &&dead) {
+  std::lock_guard<std::mutex> guard(reclamationLogMutex);
+  ReclamationEntry &entry = reclamationLog[generation % ReclamationLogSize];
+  entry.generation = generation;
+  entry.dead = std::move(dead);
+}
+
+bool getReclaimedArrays(std::uint64_t from, std::uint64_t to,
+                        std::vector<const Array *> &dead) {
+  if (to - from > ReclamationLogSize)
+    return false;
+  std::lock_guard<std::mutex> guard(reclamationLogMutex);
+  for (std::uint64_t gen = from + 1; gen <= to; ++gen) {
+    const ReclamationEntry &entry = reclamationLog[gen % ReclamationLogSize];
+    if (entry.generation != gen)
+      return false;
+    dead.insert(dead.end(), entry.dead.begin(), entry.dead.end());
+  }
+  return true;
+}
+
 ArrayCache::~ArrayCache() {
   // Free Allocated Array objects
-  for (ArrayHashMap::iterator ai = cachedSymbolicArrays.begin(),
-                              e = cachedSymbolicArrays.end();
-       ai != e; ++ai) {
-    delete *ai;
+  for (unsigned i = 0; i < NumShards; ++i) {
+    for (ArrayHashMap::iterator ai = cachedSymbolicArrays[i].begin(),
+                                e = cachedSymbolicArrays[i].end();
+         ai != e; ++ai) {
+      delete *ai;
+    }
   }
   for (ArrayPtrVec::iterator ai = concreteArrays.begin(),
                              e = concreteArrays.end();
@@ -26,7 +70,7 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
                                  constantValuesEnd, _domain, _range);
   if (array->isSymbolicArray()) {
     std::pair<ArrayHashMap::const_iterator, bool> success =
-        cachedSymbolicArrays.insert(array);
+        shardFor(array).insert(array);
     if (success.second) {
       // Cache miss
       return array;
@@ -44,4 +88,46 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
     return array;
   }
 }
+
+unsigned ArrayCache::collect(const std::unordered_set<const Array *> &live) {
+  std::vector<const Array *> reclaimed;
+
+  for (unsigned i = 0; i < NumShards; ++i) {
+    for (ArrayHashMap::iterator ai = cachedSymbolicArrays[i].begin(),
+                                e = cachedSymbolicArrays[i].end();
+         ai != e;) {
+      const Array *array = *ai;
+      if (!array->refCount && !live.count(array)) {
+        ai = cachedSymbolicArrays[i].erase(ai);
+        reclaimed.push_back(array);
+        delete array;
+      } else {
+        ++ai;
+      }
+    }
+  }
+
+  ArrayPtrVec::iterator dead =
+      std::partition(concreteArrays.begin(), concreteArrays.end(),
+                     [&live](const Array *array) {
+                       return array->refCount || live.count(array);
+                     });
+  for (ArrayPtrVec::iterator ai = dead, e = concreteArrays.end(); ai != e;
+       ++ai) {
+    reclaimed.push_back(*ai);
+    delete *ai;
+  }
+  concreteArrays.erase(dead, concreteArrays.end());
+
+  unsigned numReclaimed = reclaimed.size();
+  if (numReclaimed) {
+    // Reclaimed addresses may be handed out again; publish the set so
+    // the solver builders can evict exactly these entries from their
+    // per-array caches.
+    std::uint64_t generation =
+        arrayCacheGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+    publishReclaimedArrays(generation, std::move(reclaimed));
+  }
+  return numReclaimed;
+}
 }
@@ -16,6 +16,7 @@
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/AssignmentGenerator.h"
 #include "klee/Expr/ExprBuilder.h"
+#include "klee/Solver/SolverStats.h"
 #include "klee/Support/Casting.h"
 #include "klee/Support/ErrorHandling.h"
 #include "klee/Support/OptionCategories.h"
@@ -110,13 +111,17 @@ ref<Expr> ExprOptimizer::optimizeExpr(const ref<Expr> &e, bool valueOnly) {
   if (OptimizeArray == NONE)
     return e;
 
-  if (cacheExprUnapplicable.count(e) > 0)
+  if (cacheExprUnapplicable[valueOnly].count(e) > 0) {
+    ++stats::arrayOptCacheHits;
     return e;
+  }
 
   // Find cached expressions
-  auto cached = cacheExprOptimized.find(e);
-  if (cached != cacheExprOptimized.end())
+  auto cached = cacheExprOptimized[valueOnly].find(e);
+  if (cached != cacheExprOptimized[valueOnly].end()) {
+    ++stats::arrayOptCacheHits;
     return cached->second;
+  }
 
   ref<Expr> result;
   // ----------------------- INDEX-BASED OPTIMIZATION -------------------------
@@ -131,7 +136,7 @@ ref<Expr> ExprOptimizer::optimizeExpr(const ref<Expr> &e, bool valueOnly) {
       // If we cannot optimize the expression, we return a failure only
       // when we are not combining the optimizations
       if (OptimizeArray == INDEX) {
-        cacheExprUnapplicable.insert(e);
+        cacheExprUnapplicable[valueOnly].insert(e);
         return e;
       }
     } else {
@@ -148,14 +153,14 @@ ref<Expr> ExprOptimizer::optimizeExpr(const ref<Expr> &e, bool valueOnly) {
         }
         // Add new expression to cache
         if (result) {
-          klee_warning("OPT_I: successful");
-          cacheExprOptimized[e] = result;
+          ++stats::arrayOptIndexApplied;
+          cacheExprOptimized[valueOnly][e] = result;
         } else {
-          klee_warning("OPT_I: unsuccessful");
+          ++stats::arrayOptIndexFailed;
         }
       } else {
-        klee_warning("OPT_I: unsuccessful");
-        cacheExprUnapplicable.insert(e);
+        ++stats::arrayOptIndexFailed;
+        cacheExprUnapplicable[valueOnly].insert(e);
       }
     }
   }
@@ -169,19 +174,19 @@ ref<Expr> ExprOptimizer::optimizeExpr(const ref<Expr> &e, bool valueOnly) {
     std::reverse(reads.begin(), reads.end());
 
     if (reads.empty() || are.isIncompatible()) {
-      cacheExprUnapplicable.insert(e);
+      cacheExprUnapplicable[valueOnly].insert(e);
       return e;
     }
 
     ref<Expr> selectOpt =
         getSelectOptExpr(e, reads, readInfo, are.containsSymbolic());
     if (selectOpt) {
-      klee_warning("OPT_V: successful");
+      ++stats::arrayOptValueApplied;
       result = selectOpt;
-      cacheExprOptimized[e] = result;
+      cacheExprOptimized[valueOnly][e] = result;
     } else {
-      klee_warning("OPT_V: unsuccessful");
-      cacheExprUnapplicable.insert(e);
+      ++stats::arrayOptValueFailed;
+      cacheExprUnapplicable[valueOnly].insert(e);
     }
   }
   if (!result)
@@ -263,6 +268,7 @@ ref<Expr> ExprOptimizer::getSelectOptExpr(
       auto info = readInfo[read];
       auto cached = cacheReadExprOptimized.find(const_cast<ReadExpr *>(read));
       if (cached != cacheReadExprOptimized.end()) {
+        ++stats::arrayOptCacheHits;
         optimized.insert(std::make_pair(info.first, (*cached).second));
         continue;
       }
@@ -338,6 +344,7 @@ ref<Expr> ExprOptimizer::getSelectOptExpr(
       auto info = readInfo[read];
       auto cached = cacheReadExprOptimized.find(const_cast<ReadExpr *>(read));
       if (cached != cacheReadExprOptimized.end()) {
+        ++stats::arrayOptCacheHits;
         optimized.insert(std::make_pair(info.first, (*cached).second));
         continue;
       }
@@ -9,8 +9,41 @@
 
 #include "klee/Expr/Assignment.h"
 
+#include "klee/Expr/CompiledExpr.h"
+#include "klee/Expr/ExprHashMap.h"
+
 namespace klee {
 
+namespace {
+// Compiled form of each probed expression, shared by every assignment it
+// is evaluated against; a null entry records that compilation failed so
+// it is not retried. Cleared wholesale once it grows past the bound.
+ExprHashMap<std::shared_ptr<const CompiledExpr>> compiledExprCache;
+const size_t MaxCompiledExprCacheSize = 1 << 16;
+} // namespace
+
+bool Assignment::evaluatesToTrue(const ref<Expr> &e) {
+  if (compiledExprCache.size() > MaxCompiledExprCacheSize)
+    compiledExprCache.clear();
+
+  std::shared_ptr<const CompiledExpr> prog;
+  auto it = compiledExprCache.find(e);
+  if (it != compiledExprCache.end()) {
+    prog = it->second;
+  } else {
+    prog = CompiledExpr::compile(e);
+    compiledExprCache.insert(std::make_pair(e, prog));
+  }
+
+  if (prog) {
+    uint64_t result;
+    if (prog->evaluate(*this, result))
+      return e->getWidth() == Expr::Bool && result != 0;
+  }
+
+  return evaluate(e)->isTrue();
+}
+
 void Assignment::dump() {
   if (bindings.size() == 0) {
     llvm::errs() << "No bindings\n";
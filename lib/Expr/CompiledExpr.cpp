@@ -0,0 +1,306 @@
+//===-- CompiledExpr.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/CompiledExpr.h"
+
+#include "klee/Expr/Assignment.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+using namespace klee;
+
+namespace {
+
+inline uint64_t maskBits(uint64_t value, unsigned width) {
+  return width == 64 ? value : value & ((UINT64_C(1) << width) - 1);
+}
+
+inline int64_t signExtend(uint64_t value, unsigned width) {
+  return static_cast<int64_t>(value << (64 - width)) >> (64 - width);
+}
+
+} // namespace
+
+std::unique_ptr<CompiledExpr> CompiledExpr::compile(const ref<Expr> &e) {
+  std::unique_ptr<CompiledExpr> result(new CompiledExpr());
+  if (!result->compileInto(e))
+    return nullptr;
+  return result;
+}
+
+bool CompiledExpr::compileInto(const ref<Expr> &e) {
+  if (e->getWidth() > 64)
+    return false;
+
+  Instruction i;
+  i.op = Const;
+  i.width = e->getWidth();
+  i.aux = 0;
+  i.imm = 0;
+  i.array = nullptr;
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    i.imm = cast<ConstantExpr>(e)->getZExtValue(64);
+    break;
+
+  case Expr::NotOptimized:
+    // AssignmentEvaluator folds these away so evaluation can proceed.
+    return compileInto(cast<NotOptimizedExpr>(e)->src);
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    // Reads through update lists would need the updates' indices and
+    // values evaluated and compared at runtime; leave those to the
+    // interpretive evaluator.
+    if (re->updates.head)
+      return false;
+    if (re->index->getWidth() > 64)
+      return false;
+    if (!compileInto(re->index))
+      return false;
+    i.op = re->updates.root->isConstantArray() ? ReadConstant : ReadSymbolic;
+    i.array = re->updates.root;
+    break;
+  }
+
+  case Expr::Select: {
+    const SelectExpr *se = cast<SelectExpr>(e);
+    if (!compileInto(se->cond) || !compileInto(se->trueExpr) ||
+        !compileInto(se->falseExpr))
+      return false;
+    i.op = Select;
+    break;
+  }
+
+  case Expr::Concat: {
+    const ConcatExpr *ce = cast<ConcatExpr>(e);
+    if (!compileInto(ce->getLeft()) || !compileInto(ce->getRight()))
+      return false;
+    i.op = Concat;
+    i.aux = ce->getRight()->getWidth();
+    break;
+  }
+
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    if (!compileInto(ee->expr))
+      return false;
+    i.op = Extract;
+    i.aux = ee->offset;
+    break;
+  }
+
+  case Expr::ZExt:
+    if (!compileInto(e->getKid(0)))
+      return false;
+    i.op = ZExt;
+    break;
+
+  case Expr::SExt:
+    if (e->getKid(0)->getWidth() > 64 || !compileInto(e->getKid(0)))
+      return false;
+    i.op = SExt;
+    i.aux = e->getKid(0)->getWidth();
+    break;
+
+  case Expr::Add:
+  case Expr::Sub:
+  case Expr::Mul:
+  case Expr::UDiv:
+  case Expr::SDiv:
+  case Expr::URem:
+  case Expr::SRem:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr:
+  case Expr::Eq:
+  case Expr::Ne:
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Slt:
+  case Expr::Sle: {
+    if (!compileInto(e->getKid(0)) || !compileInto(e->getKid(1)))
+      return false;
+    static const Opcode binaryOps[] = {Add,  Sub,  Mul, UDiv, SDiv, URem, SRem,
+                                       And,  Or,   Xor, Shl,  LShr, AShr, Eq,
+                                       Ne,   Ult,  Ule, Slt,  Sle};
+    static const Expr::Kind binaryKinds[] = {
+        Expr::Add,  Expr::Sub,  Expr::Mul, Expr::UDiv, Expr::SDiv,
+        Expr::URem, Expr::SRem, Expr::And, Expr::Or,   Expr::Xor,
+        Expr::Shl,  Expr::LShr, Expr::AShr, Expr::Eq,  Expr::Ne,
+        Expr::Ult,  Expr::Ule,  Expr::Slt, Expr::Sle};
+    for (unsigned k = 0; k != sizeof(binaryKinds) / sizeof(binaryKinds[0]);
+         ++k) {
+      if (binaryKinds[k] == e->getKind()) {
+        i.op = binaryOps[k];
+        break;
+      }
+    }
+    i.aux = e->getKid(0)->getWidth();
+    break;
+  }
+
+  // Non-canonical comparisons: compile with the operands swapped.
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Sgt:
+  case Expr::Sge: {
+    if (!compileInto(e->getKid(1)) || !compileInto(e->getKid(0)))
+      return false;
+    switch (e->getKind()) {
+    case Expr::Ugt: i.op = Ult; break;
+    case Expr::Uge: i.op = Ule; break;
+    case Expr::Sgt: i.op = Slt; break;
+    default:        i.op = Sle; break;
+    }
+    i.aux = e->getKid(0)->getWidth();
+    break;
+  }
+
+  case Expr::Not:
+    if (!compileInto(e->getKid(0)))
+      return false;
+    i.op = Not;
+    break;
+
+  default:
+    return false;
+  }
+
+  code.push_back(i);
+  return true;
+}
+
+bool CompiledExpr::evaluate(const Assignment &a, uint64_t &result) const {
+  llvm::SmallVector<uint64_t, 32> stack;
+
+  for (const Instruction &i : code) {
+    switch (i.op) {
+    case Const:
+      stack.push_back(i.imm);
+      break;
+
+    case ReadSymbolic:
+    case ReadConstant: {
+      uint64_t index = stack.back();
+      if (i.op == ReadConstant && index < i.array->size) {
+        stack.back() = i.array->constantValues[index]->getZExtValue(8);
+        break;
+      }
+      Assignment::bindings_ty::const_iterator it = a.bindings.find(i.array);
+      if (it != a.bindings.end() && index < it->second.size()) {
+        stack.back() = it->second[index];
+      } else if (a.allowFreeValues) {
+        // The value stays symbolic under this assignment.
+        return false;
+      } else {
+        stack.back() = 0;
+      }
+      break;
+    }
+
+    case Select: {
+      uint64_t f = stack.pop_back_val();
+      uint64_t t = stack.pop_back_val();
+      stack.back() = stack.back() ? t : f;
+      break;
+    }
+
+    case Concat: {
+      uint64_t r = stack.pop_back_val();
+      stack.back() = maskBits((stack.back() << i.aux) | r, i.width);
+      break;
+    }
+
+    case Extract:
+      stack.back() = maskBits(stack.back() >> i.aux, i.width);
+      break;
+
+    case ZExt:
+      // Also covers the truncating form.
+      stack.back() = maskBits(stack.back(), i.width);
+      break;
+
+    case SExt:
+      stack.back() = maskBits(signExtend(stack.back(), i.aux), i.width);
+      break;
+
+    case Not:
+      stack.back() = maskBits(~stack.back(), i.width);
+      break;
+
+    default: {
+      uint64_t r = stack.pop_back_val();
+      uint64_t l = stack.back();
+      uint64_t v;
+      switch (i.op) {
+      case Add: v = maskBits(l + r, i.width); break;
+      case Sub: v = maskBits(l - r, i.width); break;
+      case Mul: v = maskBits(l * r, i.width); break;
+      case And: v = l & r; break;
+      case Or:  v = l | r; break;
+      case Xor: v = l ^ r; break;
+
+      case UDiv:
+      case URem:
+        // Division by zero stays symbolic in the evaluator; bail out.
+        if (!r)
+          return false;
+        v = (i.op == UDiv) ? l / r : l % r;
+        break;
+
+      case SDiv:
+      case SRem: {
+        if (!r)
+          return false;
+        int64_t sl = signExtend(l, i.width), sr = signExtend(r, i.width);
+        if (sl == INT64_MIN && sr == -1) {
+          // Wraps like APInt; avoids host UB.
+          v = maskBits(i.op == SDiv ? static_cast<uint64_t>(sl) : 0, i.width);
+        } else {
+          v = maskBits(static_cast<uint64_t>(i.op == SDiv ? sl / sr : sl % sr),
+                       i.width);
+        }
+        break;
+      }
+
+      case Shl:  v = r >= i.width ? 0 : maskBits(l << r, i.width); break;
+      case LShr: v = r >= i.width ? 0 : l >> r; break;
+      case AShr: {
+        uint64_t amount = r >= i.width ? i.width - 1 : r;
+        v = maskBits(static_cast<uint64_t>(signExtend(l, i.width) >>
+                                           amount),
+                     i.width);
+        break;
+      }
+
+      case Eq:  v = l == r; break;
+      case Ne:  v = l != r; break;
+      case Ult: v = l < r; break;
+      case Ule: v = l <= r; break;
+      case Slt: v = signExtend(l, i.aux) < signExtend(r, i.aux); break;
+      case Sle: v = signExtend(l, i.aux) <= signExtend(r, i.aux); break;
+      default:
+        assert(0 && "invalid opcode");
+        return false;
+      }
+      stack.back() = v;
+      break;
+    }
+    }
+  }
+
+  assert(stack.size() == 1 && "malformed bytecode");
+  result = stack.back();
+  return true;
+}
@@ -7,12 +7,13 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include "ConstantDivision.h"
+#include "klee/Expr/ConstantDivision.h"
 
 #include "klee/ADT/Bits.h"
 
 #include <algorithm>
 #include <cassert>
+#include <unordered_map>
 
 namespace klee {
 
@@ -143,4 +144,69 @@ void ComputeSDivConstants32(int32_t d, int32_t &mprime, int32_t &dsign,
   shpost = l - 1;
 }
 
+const UDivMagic &getUDivMagic(uint32_t d) {
+  assert(d && "division by zero has no magic constants");
+  static thread_local std::unordered_map<uint32_t, UDivMagic> cache;
+  auto it = cache.find(d);
+  if (it == cache.end()) {
+    UDivMagic m;
+    ComputeUDivConstants32(d, m.mprime, m.sh1, m.sh2);
+    it = cache.emplace(d, m).first;
+  }
+  return it->second;
+}
+
+const SDivMagic &getSDivMagic(int32_t d) {
+  assert(d && "division by zero has no magic constants");
+  static thread_local std::unordered_map<int32_t, SDivMagic> cache;
+  auto it = cache.find(d);
+  if (it == cache.end()) {
+    SDivMagic m;
+    ComputeSDivConstants32(d, m.mprime, m.dsign, m.shpost);
+    it = cache.emplace(d, m).first;
+  }
+  return it->second;
+}
+
+ref<Expr> getUDivByConstantExpr(const ref<Expr> &n, uint32_t d) {
+  assert(n->getWidth() == Expr::Int32 && "lowering only covers 32-bit division");
+  const UDivMagic &m = getUDivMagic(d);
+
+  // t1 = MULUH(mprime, n) = ((uint64_t)mprime * (uint64_t)n) >> 32
+  ref<Expr> t1 = ExtractExpr::create(
+      MulExpr::create(ZExtExpr::create(n, Expr::Int64),
+                      ConstantExpr::create(m.mprime, Expr::Int64)),
+      32, Expr::Int32);
+
+  // n/d = (((n - t1) >> sh1) + t1) >> sh2
+  ref<Expr> q = LShrExpr::create(SubExpr::create(n, t1),
+                                 ConstantExpr::create(m.sh1, Expr::Int32));
+  return LShrExpr::create(AddExpr::create(q, t1),
+                          ConstantExpr::create(m.sh2, Expr::Int32));
+}
+
+ref<Expr> getSDivByConstantExpr(const ref<Expr> &n, int32_t d) {
+  assert(n->getWidth() == Expr::Int32 && "lowering only covers 32-bit division");
+  const SDivMagic &m = getSDivMagic(d);
+
+  // mulsh = MULSH(mprime, n) = (((int64_t)mprime * (int64_t)n) >> 32)
+  ref<Expr> mulsh = ExtractExpr::create(
+      MulExpr::create(SExtExpr::create(n, Expr::Int64),
+                      ConstantExpr::create((uint64_t)(int64_t)m.mprime,
+                                           Expr::Int64)),
+      32, Expr::Int32);
+
+  // q0 = ((n + mulsh) >> shpost) - XSIGN(n)
+  ref<Expr> shifted =
+      AShrExpr::create(AddExpr::create(n, mulsh),
+                       ConstantExpr::create(m.shpost, Expr::Int32));
+  ref<Expr> xsign =
+      AShrExpr::create(n, ConstantExpr::create(31, Expr::Int32));
+  ref<Expr> q0 = SubExpr::create(shifted, xsign);
+
+  // n/d = (q0 ^ dsign) - dsign
+  ref<Expr> dsign = ConstantExpr::create((uint32_t)m.dsign, Expr::Int32);
+  return SubExpr::create(XorExpr::create(q0, dsign), dsign);
+}
+
 }
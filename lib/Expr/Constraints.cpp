@@ -16,7 +16,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
 
-#include <map>
+#include <atomic>
 
 using namespace klee;
 
@@ -54,16 +54,19 @@ public:
 
 class ExprReplaceVisitor2 : public ExprVisitor {
 private:
-  const std::map< ref<Expr>, ref<Expr> > &replacements;
+  const ConstraintSet::EqualityIndex &replacements;
 
 public:
-  explicit ExprReplaceVisitor2(
-      const std::map<ref<Expr>, ref<Expr>> &_replacements)
-      : ExprVisitor(true), replacements(_replacements) {}
+  ExprReplaceVisitor2(const ConstraintSet::EqualityIndex &_replacements,
+                      visited_ty *_sharedVisited)
+      : ExprVisitor(true, _sharedVisited), replacements(_replacements) {}
 
   Action visitExprPost(const Expr &e) override {
-    auto it = replacements.find(ref<Expr>(const_cast<Expr *>(&e)));
-    if (it!=replacements.end()) {
+    // No substitution source has this kind, so e cannot match one.
+    if (!(replacements.kindMask & (UINT64_C(1) << e.getKind())))
+      return Action::doChildren();
+    auto it = replacements.map.find(ref<Expr>(const_cast<Expr *>(&e)));
+    if (it != replacements.map.end()) {
       return Action::changeTo(it->second);
     }
     return Action::doChildren();
@@ -95,24 +98,19 @@ ref<Expr> ConstraintManager::simplifyExpr(const ConstraintSet &constraints,
   if (isa<ConstantExpr>(e))
     return e;
 
-  std::map< ref<Expr>, ref<Expr> > equalities;
-
-  for (auto &constraint : constraints) {
-    if (const EqExpr *ee = dyn_cast<EqExpr>(constraint)) {
-      if (isa<ConstantExpr>(ee->left)) {
-        equalities.insert(std::make_pair(ee->right,
-                                         ee->left));
-      } else {
-        equalities.insert(
-            std::make_pair(constraint, ConstantExpr::alloc(1, Expr::Bool)));
-      }
-    } else {
-      equalities.insert(
-          std::make_pair(constraint, ConstantExpr::alloc(1, Expr::Bool)));
-    }
+  if (!constraints.equalities) {
+    auto index = std::make_shared<ConstraintSet::EqualityIndex>();
+    for (auto &constraint : constraints)
+      index->insert(constraint);
+    constraints.equalities = std::move(index);
   }
+  if (!constraints.simplifyCache)
+    constraints.simplifyCache =
+        std::make_shared<ConstraintSet::SimplifyCache>();
 
-  return ExprReplaceVisitor2(equalities).visit(e);
+  ConstraintSet::SimplifyCache &cache = *constraints.simplifyCache;
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  return ExprReplaceVisitor2(*constraints.equalities, &cache.visited).visit(e);
 }
 
 void ConstraintManager::addConstraintInternal(const ref<Expr> &e) {
@@ -163,16 +161,89 @@ void ConstraintManager::addConstraint(const ref<Expr> &e) {
 ConstraintManager::ConstraintManager(ConstraintSet &_constraints)
     : constraints(_constraints) {}
 
-bool ConstraintSet::empty() const { return constraints.empty(); }
+ConstraintSet::ConstraintSet(constraints_ty cs) {
+  for (const auto &e : cs) {
+    tail = new ConstraintNode(tail, e);
+    contentHash = combineHash(contentHash, e);
+  }
+  count = cs.size();
+  if (count) {
+    versionStamp = nextVersion();
+    flat = std::make_shared<constraints_ty>(std::move(cs));
+  }
+}
+
+void ConstraintSet::materialize() const {
+  if (flat)
+    return;
+  auto v = std::make_shared<constraints_ty>(count);
+  size_t i = count;
+  for (const ConstraintNode *n = tail.get(); n; n = n->parent.get())
+    (*v)[--i] = n->constraint;
+  flat = std::move(v);
+}
+
+bool ConstraintSet::empty() const { return count == 0; }
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::begin() const {
-  return constraints.begin();
+  materialize();
+  return flat->begin();
 }
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::end() const {
-  return constraints.end();
+  materialize();
+  return flat->end();
 }
 
-size_t ConstraintSet::size() const noexcept { return constraints.size(); }
+size_t ConstraintSet::size() const noexcept { return count; }
+
+bool ConstraintSet::operator==(const ConstraintSet &b) const {
+  if (contentHash != b.contentHash || count != b.count)
+    return false;
+  // Sets copied from a common ancestor share chain structure, so the
+  // element walk stops at the first node both sides hold.
+  const ConstraintNode *n = tail.get(), *m = b.tail.get();
+  while (n != m) {
+    if (!n || !m || n->constraint != m->constraint)
+      return false;
+    n = n->parent.get();
+    m = m->parent.get();
+  }
+  return true;
+}
+
+void ConstraintSet::EqualityIndex::insert(const ref<Expr> &constraint) {
+  ref<Expr> src = constraint;
+  ref<Expr> dst = ConstantExpr::alloc(1, Expr::Bool);
+  if (const EqExpr *ee = dyn_cast<EqExpr>(constraint)) {
+    if (isa<ConstantExpr>(ee->left)) {
+      src = ee->right;
+      dst = ee->left;
+    }
+  }
+  map.insert(std::make_pair(src, dst));
+  kindMask |= UINT64_C(1) << src->getKind();
+}
+
+std::uint64_t ConstraintSet::nextVersion() {
+  static std::atomic<std::uint64_t> counter{0};
+  return ++counter;
+}
 
-void ConstraintSet::push_back(const ref<Expr> &e) { constraints.push_back(e); }
+void ConstraintSet::push_back(const ref<Expr> &e) {
+  tail = new ConstraintNode(tail, e);
+  ++count;
+  // Copies sharing the old view keep it; this set rebuilds its own on
+  // the next iteration.
+  flat = nullptr;
+  versionStamp = nextVersion();
+  contentHash = combineHash(contentHash, e);
+  if (equalities) {
+    auto extended = std::make_shared<EqualityIndex>(*equalities);
+    extended->insert(e);
+    equalities = std::move(extended);
+  }
+  // New constraints can enable further rewrites, so cached results for
+  // the old set no longer apply.
+  simplifyCache = nullptr;
+}
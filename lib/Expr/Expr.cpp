@@ -11,6 +11,7 @@
 
 #include "klee/Config/Version.h"
 #include "klee/Expr/ExprPPrinter.h"
+#include "klee/Support/Hashing.h"
 #include "klee/Support/OptionCategories.h"
 // FIXME: We shouldn't need this once fast constant support moves into
 // Core. If we need to do arithmetic, we probably want to use APInt.
@@ -42,6 +43,7 @@ cl::opt<bool> ConstArrayOpt(
 /***/
 
 unsigned Expr::count = 0;
+std::atomic<std::uint64_t> Expr::nextID{1};
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -331,6 +333,46 @@ void Expr::dump() const {
 
 /***/
 
+ref<ConstantExpr> ConstantExpr::tryIntern(const llvm::APInt &v) {
+  unsigned row;
+  switch (v.getBitWidth()) {
+  case Expr::Bool: row = 0; break;
+  case Expr::Int8: row = 1; break;
+  case Expr::Int16: row = 2; break;
+  case Expr::Int32: row = 3; break;
+  case Expr::Int64: row = 4; break;
+  default:
+    return nullptr;
+  }
+
+  const uint64_t value = v.getZExtValue();
+  if (value >= 256)
+    return nullptr;
+
+  /// The interned nodes, built on first use. Each row holds one
+  /// permanent reference per node, so the hot leaves are allocated
+  /// once per process and their count never reaches zero.
+  struct Table {
+    ref<ConstantExpr> entries[5][256];
+    Table() {
+      static const Expr::Width widths[5] = {Expr::Bool, Expr::Int8,
+                                            Expr::Int16, Expr::Int32,
+                                            Expr::Int64};
+      for (unsigned i = 0; i < 5; ++i) {
+        const unsigned count = widths[i] == Expr::Bool ? 2 : 256;
+        for (unsigned val = 0; val < count; ++val) {
+          ref<ConstantExpr> r(new ConstantExpr(llvm::APInt(widths[i], val)));
+          r->computeHash();
+          entries[i][val] = r;
+        }
+      }
+    }
+  };
+  static Table table;
+
+  return table.entries[row][value];
+}
+
 ref<Expr> ConstantExpr::fromMemory(void *address, Width width) {
   switch (width) {
   case  Expr::Bool: return ConstantExpr::create(*(( uint8_t*) address), width);
@@ -369,8 +411,18 @@ void ConstantExpr::toString(std::string &Res, unsigned radix) const {
   Res = value.toString(radix, false);
 }
 
+// The operations below take a fast path through the klee::ints helpers
+// for values at most 64 bits wide (the overwhelmingly common case),
+// reserving APInt's general-purpose routines for wide integers. APInt
+// stores small values inline, so getZExtValue() is a plain load.
+
 ref<ConstantExpr> ConstantExpr::Concat(const ref<ConstantExpr> &RHS) {
   Expr::Width W = getWidth() + RHS->getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        (value.getZExtValue() << RHS->getWidth()) | RHS->value.getZExtValue(),
+        W);
+
   APInt Tmp(value);
   Tmp=Tmp.zext(W);
   Tmp <<= RHS->getWidth();
@@ -380,114 +432,240 @@ ref<ConstantExpr> ConstantExpr::Concat(const ref<ConstantExpr> &RHS) {
 }
 
 ref<ConstantExpr> ConstantExpr::Extract(unsigned Offset, Width W) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        bits64::truncateToNBits(value.getZExtValue() >> Offset, W), W);
   return ConstantExpr::alloc(APInt(value.ashr(Offset)).zextOrTrunc(W));
 }
 
 ref<ConstantExpr> ConstantExpr::ZExt(Width W) {
+  // Note this also truncates when W is smaller than the current width.
+  if (getWidth() <= 64 && W <= 64)
+    return ConstantExpr::alloc(bits64::truncateToNBits(value.getZExtValue(), W),
+                               W);
   return ConstantExpr::alloc(APInt(value).zextOrTrunc(W));
 }
 
 ref<ConstantExpr> ConstantExpr::SExt(Width W) {
+  if (getWidth() <= 64 && W <= 64)
+    return ConstantExpr::alloc(ints::sext(value.getZExtValue(), W, getWidth()),
+                               W);
   return ConstantExpr::alloc(APInt(value).sextOrTrunc(W));
 }
 
 ref<ConstantExpr> ConstantExpr::Add(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::add(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value + RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Neg() {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(ints::sub(0, value.getZExtValue(), W), W);
   return ConstantExpr::alloc(-value);
 }
 
 ref<ConstantExpr> ConstantExpr::Sub(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::sub(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value - RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Mul(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::mul(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value * RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::UDiv(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  // Division by zero is left to APInt so that whatever it does remains
+  // the single source of that (erroneous) behavior.
+  if (W <= 64 && RHS->value.getZExtValue())
+    return ConstantExpr::alloc(
+        ints::udiv(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value.udiv(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::SDiv(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    int64_t l = ints::sext(value.getZExtValue(), 64, W);
+    int64_t r = ints::sext(RHS->value.getZExtValue(), 64, W);
+    // Division by zero and INT64_MIN / -1 are left to APInt.
+    if (r != 0 && !(l == INT64_MIN && r == -1))
+      return ConstantExpr::alloc(bits64::truncateToNBits(l / r, W), W);
+  }
   return ConstantExpr::alloc(value.sdiv(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::URem(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64 && RHS->value.getZExtValue())
+    return ConstantExpr::alloc(
+        ints::urem(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value.urem(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::SRem(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    int64_t l = ints::sext(value.getZExtValue(), 64, W);
+    int64_t r = ints::sext(RHS->value.getZExtValue(), 64, W);
+    if (r != 0 && !(l == INT64_MIN && r == -1))
+      return ConstantExpr::alloc(bits64::truncateToNBits(l % r, W), W);
+  }
   return ConstantExpr::alloc(value.srem(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::And(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::land(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value & RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Or(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::lor(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value | RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Xor(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::lxor(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value ^ RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Shl(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    uint64_t shift = RHS->value.getZExtValue();
+    if (shift >= W) // overshift yields zero, as with APInt
+      return ConstantExpr::alloc(0, W);
+    return ConstantExpr::alloc(ints::shl(value.getZExtValue(), shift, W), W);
+  }
   return ConstantExpr::alloc(value.shl(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::LShr(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    uint64_t shift = RHS->value.getZExtValue();
+    if (shift >= W) // overshift yields zero, as with APInt
+      return ConstantExpr::alloc(0, W);
+    return ConstantExpr::alloc(ints::lshr(value.getZExtValue(), shift, W), W);
+  }
   return ConstantExpr::alloc(value.lshr(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::AShr(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    uint64_t shift = RHS->value.getZExtValue();
+    if (shift >= W) // overshift fills with the sign bit, as with APInt
+      return ConstantExpr::alloc(
+          value.isNegative() ? bits64::maxValueOfNBits(W) : 0, W);
+    return ConstantExpr::alloc(ints::ashr(value.getZExtValue(), shift, W), W);
+  }
   return ConstantExpr::alloc(value.ashr(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::Not() {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        bits64::truncateToNBits(~value.getZExtValue(), W), W);
   return ConstantExpr::alloc(~value);
 }
 
 ref<ConstantExpr> ConstantExpr::Eq(const ref<ConstantExpr> &RHS) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() == RHS->value.getZExtValue(), Expr::Bool);
   return ConstantExpr::alloc(value == RHS->value, Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Ne(const ref<ConstantExpr> &RHS) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() != RHS->value.getZExtValue(), Expr::Bool);
   return ConstantExpr::alloc(value != RHS->value, Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Ult(const ref<ConstantExpr> &RHS) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() < RHS->value.getZExtValue(), Expr::Bool);
   return ConstantExpr::alloc(value.ult(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Ule(const ref<ConstantExpr> &RHS) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() <= RHS->value.getZExtValue(), Expr::Bool);
   return ConstantExpr::alloc(value.ule(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Ugt(const ref<ConstantExpr> &RHS) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() > RHS->value.getZExtValue(), Expr::Bool);
   return ConstantExpr::alloc(value.ugt(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Uge(const ref<ConstantExpr> &RHS) {
+  if (getWidth() <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() >= RHS->value.getZExtValue(), Expr::Bool);
   return ConstantExpr::alloc(value.uge(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Slt(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::slt(value.getZExtValue(), RHS->value.getZExtValue(), W),
+        Expr::Bool);
   return ConstantExpr::alloc(value.slt(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Sle(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::sle(value.getZExtValue(), RHS->value.getZExtValue(), W),
+        Expr::Bool);
   return ConstantExpr::alloc(value.sle(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Sgt(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::sgt(value.getZExtValue(), RHS->value.getZExtValue(), W),
+        Expr::Bool);
   return ConstantExpr::alloc(value.sgt(RHS->value), Expr::Bool);
 }
 
 ref<ConstantExpr> ConstantExpr::Sge(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::sge(value.getZExtValue(), RHS->value.getZExtValue(), W),
+        Expr::Bool);
   return ConstantExpr::alloc(value.sge(RHS->value), Expr::Bool);
 }
 
@@ -499,12 +677,15 @@ ref<Expr>  NotOptimizedExpr::create(ref<Expr> src) {
 
 /***/
 
+static unsigned NextArrayId = 0;
+
 Array::Array(const std::string &_name, uint64_t _size,
              const ref<ConstantExpr> *constantValuesBegin,
              const ref<ConstantExpr> *constantValuesEnd, Expr::Width _domain,
              Expr::Width _range)
     : name(_name), size(_size), domain(_domain), range(_range),
-      constantValues(constantValuesBegin, constantValuesEnd) {
+      constantValues(constantValuesBegin, constantValuesEnd),
+      id(NextArrayId++), refCount(0) {
 
   assert((isSymbolicArray() || constantValues.size() == size) &&
          "Invalid size for constant array!");
@@ -521,12 +702,9 @@ Array::~Array() {
 }
 
 unsigned Array::computeHash() {
-  unsigned res = 0;
-  for (unsigned i = 0, e = name.size(); i != e; ++i)
-    res = (res * Expr::MAGIC_HASH_CONSTANT) + name[i];
-  res = (res * Expr::MAGIC_HASH_CONSTANT) + size;
-  hashValue = res;
-  return hashValue; 
+  std::uint64_t res = hashing::hashBytes(name.data(), name.size(), size);
+  hashValue = static_cast<unsigned>(res ^ (res >> 32));
+  return hashValue;
 }
 /***/
 
@@ -615,6 +793,51 @@ ref<Expr> SelectExpr::create(ref<Expr> c, ref<Expr> t, ref<Expr> f) {
 
 /***/
 
+/// Is \p hi a byte read of the location directly above the one \p lo
+/// reads, over the same array state?
+static bool isAdjacentByteRead(const ReadExpr *hi, const ReadExpr *lo) {
+  if (hi->updates.root != lo->updates.root ||
+      hi->updates.head.get() != lo->updates.head.get())
+    return false;
+  const ConstantExpr *hiIdx = dyn_cast<ConstantExpr>(hi->index);
+  const ConstantExpr *loIdx = dyn_cast<ConstantExpr>(lo->index);
+  return hiIdx && loIdx && hiIdx->getWidth() == loIdx->getWidth() &&
+         (hiIdx->getAPValue() - loIdx->getAPValue()) == 1;
+}
+
+/// Is \p e a right-leaning concatenation of byte reads of consecutive,
+/// descending locations over one array state (possibly a single read)?
+static bool isByteReadRun(const Expr *e) {
+  while (const ConcatExpr *ce = dyn_cast<ConcatExpr>(e)) {
+    const ReadExpr *head = dyn_cast<ReadExpr>(ce->getLeft());
+    if (!head)
+      return false;
+    const Expr *rest = ce->getRight().get();
+    const ReadExpr *next =
+        isa<ConcatExpr>(rest)
+            ? dyn_cast<ReadExpr>(cast<ConcatExpr>(rest)->getLeft())
+            : dyn_cast<ReadExpr>(rest);
+    if (!next || !isAdjacentByteRead(head, next))
+      return false;
+    e = rest;
+  }
+  return isa<ReadExpr>(e);
+}
+
+/// Leftmost (most significant) leaf of a concatenation chain.
+static const Expr *leftmostLeaf(const Expr *e) {
+  while (const ConcatExpr *ce = dyn_cast<ConcatExpr>(e))
+    e = ce->getLeft().get();
+  return e;
+}
+
+/// Rightmost (least significant) leaf of a concatenation chain.
+static const Expr *rightmostLeaf(const Expr *e) {
+  while (const ConcatExpr *ce = dyn_cast<ConcatExpr>(e))
+    e = ce->getRight().get();
+  return e;
+}
+
 ref<Expr> ConcatExpr::create(const ref<Expr> &l, const ref<Expr> &r) {
   Expr::Width w = l->getWidth() + r->getWidth();
   
@@ -635,6 +858,52 @@ ref<Expr> ConcatExpr::create(const ref<Expr> &l, const ref<Expr> &r) {
     }
   }
 
+  // The byte-assembly loops in ObjectState build right-leaning chains
+  // one byte at a time, so the contiguous piece usually heads a chain
+  // rather than standing alone; merge through the chain head as well so
+  // load-store round trips collapse back to the stored expression.
+  if (ConcatExpr *ce_right = dyn_cast<ConcatExpr>(r)) {
+    if (ExtractExpr *ee_left = dyn_cast<ExtractExpr>(l)) {
+      if (ExtractExpr *ee_head = dyn_cast<ExtractExpr>(ce_right->getLeft())) {
+        if (ee_left->expr == ee_head->expr &&
+            ee_head->offset + ee_head->width == ee_left->offset)
+          return ConcatExpr::create(
+              ExtractExpr::create(ee_left->expr, ee_head->offset,
+                                  ee_left->width + ee_head->width),
+              ce_right->getRight());
+      }
+    }
+
+    // Same for adjacent constants split across the chain head.
+    if (ConstantExpr *lCE = dyn_cast<ConstantExpr>(l))
+      if (ConstantExpr *headCE = dyn_cast<ConstantExpr>(ce_right->getLeft()))
+        return ConcatExpr::create(lCE->Concat(headCE), ce_right->getRight());
+
+    // When the stored wide value was itself a concatenation of byte
+    // reads, the Extract(Concat) rules reduce its byte extracts to the
+    // underlying ReadExprs before this function sees them, so the
+    // round-tripped load arrives as a chain of adjacent byte reads
+    // rather than of extracts. Group a run of such reads ahead of a
+    // foreign tail so it reassembles into the stored read's own shape.
+    if (ReadExpr *re_left = dyn_cast<ReadExpr>(l)) {
+      const ref<Expr> &head = ce_right->getLeft();
+      const ReadExpr *headHi = dyn_cast<ReadExpr>(leftmostLeaf(head.get()));
+      if (headHi && isAdjacentByteRead(re_left, headHi) &&
+          isByteReadRun(head.get())) {
+        // Regroup only once the run is severed from what follows;
+        // otherwise right-leaning chains still under construction
+        // (e.g. in createN) would be restructured while growing.
+        const ReadExpr *runLo =
+            cast<ReadExpr>(rightmostLeaf(head.get()));
+        const ReadExpr *tailHi =
+            dyn_cast<ReadExpr>(leftmostLeaf(ce_right->getRight().get()));
+        if (!tailHi || !isAdjacentByteRead(runLo, tailHi))
+          return ConcatExpr::create(ConcatExpr::alloc(l, head),
+                                    ce_right->getRight());
+      }
+    }
+  }
+
   return ConcatExpr::alloc(l, r);
 }
 
@@ -690,8 +959,29 @@ ref<Expr> ExtractExpr::create(ref<Expr> expr, unsigned off, Width w) {
       return ConcatExpr::create(ExtractExpr::create(ce->getKid(0), 0, w - ce->getKid(1)->getWidth() + off),
 				ExtractExpr::create(ce->getKid(1), off, ce->getKid(1)->getWidth() - off));
     }
+
+    // Extract(ZExt): bits below the source width come from the source,
+    // bits above it are zero.
+    if (ZExtExpr *ze = dyn_cast<ZExtExpr>(expr)) {
+      Width sw = ze->src->getWidth();
+      if (off >= sw)
+        return ConstantExpr::create(0, w);
+      if (off + w <= sw)
+        return ExtractExpr::create(ze->src, off, w);
+      return ZExtExpr::create(ExtractExpr::create(ze->src, off, sw - off), w);
+    }
+
+    // Extract(SExt): extracts confined to the source narrow directly; a
+    // low-bit extract covering the source is just a narrower SExt.
+    if (SExtExpr *se = dyn_cast<SExtExpr>(expr)) {
+      Width sw = se->src->getWidth();
+      if (off + w <= sw)
+        return ExtractExpr::create(se->src, off, w);
+      if (off == 0)
+        return SExtExpr::create(se->src, w);
+    }
   }
-  
+
   return ExtractExpr::alloc(expr, off, w);
 }
 
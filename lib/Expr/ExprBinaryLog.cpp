@@ -0,0 +1,564 @@
+//===-- ExprBinaryLog.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ExprBinaryLog.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Solver/Solver.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cassert>
+
+using namespace klee;
+using namespace klee::binlog;
+
+namespace {
+
+/// Record tags. Definition records (array, update, expression) always
+/// precede the records that reference them.
+enum RecordTag : std::uint8_t {
+  RecArray = 1,
+  RecUpdate = 2,
+  RecExpr = 3,
+  RecQuery = 4,
+  RecResult = 5,
+};
+
+void writeVarint(llvm::raw_ostream &os, std::uint64_t value) {
+  while (value >= 0x80) {
+    os << static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  os << static_cast<char>(value);
+}
+
+} // namespace
+
+namespace klee {
+namespace binlog {
+const char Magic[8] = {'K', 'L', 'E', 'E', 'Q', 'B', 'L', '\x01'};
+
+bool isBinaryLog(llvm::StringRef data) {
+  return data.size() >= sizeof(Magic) &&
+         data.startswith(llvm::StringRef(Magic, sizeof(Magic)));
+}
+} // namespace binlog
+} // namespace klee
+
+/* Writer */
+
+void Writer::writeMagic(llvm::raw_ostream &os) {
+  os.write(Magic, sizeof(Magic));
+}
+
+std::uint64_t Writer::defineArray(const Array *array) {
+  auto it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+
+  std::uint64_t id = nextArrayId++;
+  arrayIds.insert(std::make_pair(array, id));
+  newArrays.push_back(array);
+
+  os << static_cast<char>(RecArray);
+  writeVarint(os, id);
+  writeVarint(os, array->name.size());
+  os << array->name;
+  writeVarint(os, array->size);
+  writeVarint(os, array->getDomain());
+  writeVarint(os, array->getRange());
+  writeVarint(os, array->constantValues.size());
+  for (const auto &value : array->constantValues)
+    writeVarint(os, value->getZExtValue());
+  return id;
+}
+
+std::uint64_t Writer::defineExpr(const ref<Expr> &e) {
+  {
+    auto it = exprIds.find(e);
+    if (it != exprIds.end())
+      return it->second;
+  }
+
+  /// One pending node on the explicit traversal stack; exactly one of
+  /// e/un is set.
+  struct Item {
+    Expr *e;
+    const UpdateNode *un;
+  };
+  std::vector<Item> stack;
+  stack.push_back({e.get(), nullptr});
+
+  while (!stack.empty()) {
+    Item item = stack.back();
+
+    bool ready = true;
+    auto require = [this, &stack, &ready](const ref<Expr> &dep) {
+      if (!exprIds.count(dep)) {
+        stack.push_back({dep.get(), nullptr});
+        ready = false;
+      }
+    };
+
+    if (Expr *cur = item.e) {
+      ref<Expr> curRef(cur);
+      if (exprIds.count(curRef)) {
+        stack.pop_back();
+        continue;
+      }
+
+      std::uint64_t arrayId = 0, headId = 0;
+      if (ReadExpr *re = dyn_cast<ReadExpr>(cur)) {
+        require(re->index);
+        const UpdateNode *head = re->updates.head.get();
+        if (head && !updateIds.count(head)) {
+          stack.push_back({nullptr, head});
+          ready = false;
+        }
+        if (!ready)
+          continue;
+        arrayId = defineArray(re->updates.root);
+        if (head)
+          headId = updateIds[head];
+      } else {
+        for (unsigned i = 0, count = cur->getNumKids(); i != count; ++i)
+          require(cur->getKid(i));
+        if (!ready)
+          continue;
+      }
+
+      std::uint64_t id = nextExprId++;
+      exprIds.insert(std::make_pair(curRef, id));
+      newExprs.push_back(curRef);
+
+      os << static_cast<char>(RecExpr);
+      writeVarint(os, id);
+      os << static_cast<char>(cur->getKind());
+      writeVarint(os, cur->getWidth());
+      writeVarint(os, cur->getNumKids());
+      for (unsigned i = 0, count = cur->getNumKids(); i != count; ++i)
+        writeVarint(os, exprIds[cur->getKid(i)]);
+
+      switch (cur->getKind()) {
+      case Expr::Constant: {
+        const llvm::APInt &value = cast<ConstantExpr>(cur)->getAPValue();
+        writeVarint(os, value.getNumWords());
+        for (unsigned i = 0; i != value.getNumWords(); ++i)
+          writeVarint(os, value.getRawData()[i]);
+        break;
+      }
+      case Expr::Read:
+        writeVarint(os, arrayId);
+        writeVarint(os, headId);
+        break;
+      case Expr::Extract:
+        writeVarint(os, cast<ExtractExpr>(cur)->offset);
+        break;
+      default:
+        break;
+      }
+
+      stack.pop_back();
+    } else {
+      const UpdateNode *un = item.un;
+      if (updateIds.count(un)) {
+        stack.pop_back();
+        continue;
+      }
+
+      require(un->index);
+      require(un->value);
+      const UpdateNode *next = un->next.get();
+      if (next && !updateIds.count(next)) {
+        stack.push_back({nullptr, next});
+        ready = false;
+      }
+      if (!ready)
+        continue;
+
+      std::uint64_t id = nextUpdateId++;
+      updateIds.insert(std::make_pair(un, id));
+      newUpdates.push_back(un);
+
+      os << static_cast<char>(RecUpdate);
+      writeVarint(os, id);
+      writeVarint(os, next ? updateIds[next] : 0);
+      writeVarint(os, exprIds[un->index]);
+      writeVarint(os, exprIds[un->value]);
+
+      stack.pop_back();
+    }
+  }
+
+  return exprIds[e];
+}
+
+void Writer::beginQuery() {
+  inQuery = true;
+  newExprs.clear();
+  newUpdates.clear();
+  newArrays.clear();
+  pendingConstraints.clear();
+}
+
+void Writer::writeQuery(QueryType type, std::uint64_t instructions,
+                        const Query &query,
+                        const std::vector<ref<Expr> > *evalExprs,
+                        const std::vector<const Array *> *objects) {
+  assert(inQuery && "writeQuery() outside beginQuery()/commit()");
+
+  pendingConstraints.assign(query.constraints.begin(), query.constraints.end());
+
+  std::vector<std::uint64_t> constraintIds;
+  constraintIds.reserve(pendingConstraints.size());
+  for (const auto &constraint : pendingConstraints)
+    constraintIds.push_back(defineExpr(constraint));
+  std::uint64_t queryId = defineExpr(query.expr);
+
+  std::vector<std::uint64_t> evalIds, objectIds;
+  if (evalExprs)
+    for (const auto &e : *evalExprs)
+      evalIds.push_back(defineExpr(e));
+  if (objects)
+    for (const Array *array : *objects)
+      objectIds.push_back(defineArray(array));
+
+  // Length of the constraint prefix shared with the previously committed
+  // query; only the remainder is written.
+  std::size_t shared = 0;
+  while (shared < prevConstraints.size() &&
+         shared < pendingConstraints.size() &&
+         prevConstraints[shared] == pendingConstraints[shared])
+    ++shared;
+
+  os << static_cast<char>(RecQuery);
+  os << static_cast<char>(type);
+  writeVarint(os, instructions);
+  writeVarint(os, shared);
+  writeVarint(os, constraintIds.size() - shared);
+  for (std::size_t i = shared; i != constraintIds.size(); ++i)
+    writeVarint(os, constraintIds[i]);
+  writeVarint(os, queryId);
+  writeVarint(os, evalIds.size());
+  for (std::uint64_t id : evalIds)
+    writeVarint(os, id);
+  writeVarint(os, objectIds.size());
+  for (std::uint64_t id : objectIds)
+    writeVarint(os, id);
+}
+
+void Writer::writeResult(bool success, std::uint64_t elapsedUSec) {
+  os << static_cast<char>(RecResult);
+  os << static_cast<char>(success ? 1 : 0);
+  writeVarint(os, elapsedUSec);
+}
+
+void Writer::commit() {
+  if (!inQuery)
+    return;
+  inQuery = false;
+  prevConstraints = std::move(pendingConstraints);
+  pendingConstraints.clear();
+  newExprs.clear();
+  newUpdates.clear();
+  newArrays.clear();
+}
+
+void Writer::rollback() {
+  if (!inQuery)
+    return;
+  inQuery = false;
+  // The ids of a transaction are assigned contiguously, so dropping the
+  // map entries and winding the counters back restores the pre-query
+  // state exactly.
+  for (const auto &e : newExprs)
+    exprIds.erase(e);
+  for (const UpdateNode *un : newUpdates)
+    updateIds.erase(un);
+  for (const Array *array : newArrays)
+    arrayIds.erase(array);
+  nextExprId -= newExprs.size();
+  nextUpdateId -= newUpdates.size();
+  nextArrayId -= newArrays.size();
+  newExprs.clear();
+  newUpdates.clear();
+  newArrays.clear();
+  pendingConstraints.clear();
+}
+
+/* Reader */
+
+Reader::Reader(llvm::StringRef _data, ArrayCache &_arrayCache)
+    : data(_data), pos(0), arrayCache(_arrayCache) {
+  if (!isBinaryLog(data)) {
+    errorMessage = "missing binary query-log magic";
+    return;
+  }
+  pos = sizeof(Magic);
+  exprs.resize(1);
+  updates.resize(1);
+  arrays.resize(1, nullptr);
+}
+
+bool Reader::fail(const char *message) {
+  if (errorMessage.empty())
+    errorMessage = message;
+  return false;
+}
+
+bool Reader::readByte(std::uint8_t &byte) {
+  if (pos >= data.size())
+    return fail("truncated record");
+  byte = static_cast<std::uint8_t>(data[pos++]);
+  return true;
+}
+
+bool Reader::readVarint(std::uint64_t &value) {
+  value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    std::uint8_t byte;
+    if (!readByte(byte))
+      return false;
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return fail("malformed varint");
+}
+
+bool Reader::readArrayRecord() {
+  std::uint64_t id, nameLen, size, domain, range, numConstants;
+  if (!readVarint(id) || !readVarint(nameLen))
+    return false;
+  if (pos + nameLen > data.size())
+    return fail("truncated array name");
+  std::string name = data.substr(pos, nameLen).str();
+  pos += nameLen;
+  if (!readVarint(size) || !readVarint(domain) || !readVarint(range) ||
+      !readVarint(numConstants))
+    return false;
+
+  std::vector<ref<ConstantExpr> > constantValues;
+  constantValues.reserve(numConstants);
+  for (std::uint64_t i = 0; i != numConstants; ++i) {
+    std::uint64_t value;
+    if (!readVarint(value))
+      return false;
+    constantValues.push_back(ConstantExpr::alloc(value, range));
+  }
+
+  if (id != arrays.size())
+    return fail("array record out of order");
+  const ref<ConstantExpr> *begin = nullptr, *end = nullptr;
+  if (!constantValues.empty()) {
+    begin = &constantValues[0];
+    end = begin + constantValues.size();
+  }
+  arrays.push_back(
+      arrayCache.CreateArray(name, size, begin, end, domain, range));
+  return true;
+}
+
+bool Reader::readUpdateRecord() {
+  std::uint64_t id, nextId, indexId, valueId;
+  if (!readVarint(id) || !readVarint(nextId) || !readVarint(indexId) ||
+      !readVarint(valueId))
+    return false;
+  if (id != updates.size() || nextId >= updates.size() ||
+      indexId >= exprs.size() || valueId >= exprs.size())
+    return fail("update record out of order");
+  updates.push_back(
+      new UpdateNode(updates[nextId], exprs[indexId], exprs[valueId]));
+  return true;
+}
+
+bool Reader::readExprRecord() {
+  std::uint64_t id, width, numKids;
+  std::uint8_t kind;
+  if (!readVarint(id) || !readByte(kind) || !readVarint(width) ||
+      !readVarint(numKids))
+    return false;
+  if (id != exprs.size() || numKids > 8)
+    return fail("expression record out of order");
+
+  ref<Expr> kids[8];
+  for (std::uint64_t i = 0; i != numKids; ++i) {
+    std::uint64_t kidId;
+    if (!readVarint(kidId))
+      return false;
+    if (!kidId || kidId >= exprs.size())
+      return fail("expression record out of order");
+    kids[i] = exprs[kidId];
+  }
+
+  ref<Expr> e;
+  switch (kind) {
+  case Expr::Constant: {
+    std::uint64_t numWords;
+    if (!readVarint(numWords) || numWords == 0 || numWords > 64)
+      return fail("malformed constant record");
+    std::vector<std::uint64_t> words(numWords);
+    for (std::uint64_t i = 0; i != numWords; ++i)
+      if (!readVarint(words[i]))
+        return false;
+    e = ConstantExpr::alloc(llvm::APInt(
+        width, llvm::ArrayRef<std::uint64_t>(words.data(), words.size())));
+    break;
+  }
+
+  case Expr::Read: {
+    std::uint64_t arrayId, headId;
+    if (!readVarint(arrayId) || !readVarint(headId))
+      return false;
+    if (!arrayId || arrayId >= arrays.size() || headId >= updates.size() ||
+        numKids != 1)
+      return fail("malformed read record");
+    UpdateList ul(arrays[arrayId], updates[headId]);
+    e = ReadExpr::create(ul, kids[0]);
+    break;
+  }
+
+  case Expr::Extract: {
+    std::uint64_t offset;
+    if (!readVarint(offset) || numKids != 1)
+      return fail("malformed extract record");
+    e = ExtractExpr::create(kids[0], offset, width);
+    break;
+  }
+
+  case Expr::ZExt:
+  case Expr::SExt: {
+    if (numKids != 1)
+      return fail("malformed cast record");
+    std::vector<Expr::CreateArg> args;
+    args.push_back(Expr::CreateArg(kids[0]));
+    args.push_back(Expr::CreateArg(static_cast<Expr::Width>(width)));
+    e = Expr::createFromKind(static_cast<Expr::Kind>(kind), args);
+    break;
+  }
+
+  default: {
+    if (kind > Expr::LastKind)
+      return fail("unknown expression kind");
+    std::vector<Expr::CreateArg> args;
+    for (std::uint64_t i = 0; i != numKids; ++i)
+      args.push_back(Expr::CreateArg(kids[i]));
+    e = Expr::createFromKind(static_cast<Expr::Kind>(kind), args);
+    break;
+  }
+  }
+
+  exprs.push_back(e);
+  return true;
+}
+
+bool Reader::readQueryRecord(LoggedQuery &result) {
+  std::uint8_t type;
+  std::uint64_t instructions, shared, numNew, queryId, numEval, numObjects;
+  if (!readByte(type) || !readVarint(instructions) || !readVarint(shared) ||
+      !readVarint(numNew))
+    return false;
+  if (shared > prevConstraints.size())
+    return fail("malformed query record");
+
+  result.type = static_cast<QueryType>(type);
+  result.instructions = instructions;
+  result.constraints.assign(prevConstraints.begin(),
+                            prevConstraints.begin() + shared);
+  for (std::uint64_t i = 0; i != numNew; ++i) {
+    std::uint64_t id;
+    if (!readVarint(id))
+      return false;
+    if (!id || id >= exprs.size())
+      return fail("malformed query record");
+    result.constraints.push_back(exprs[id]);
+  }
+
+  if (!readVarint(queryId))
+    return false;
+  if (!queryId || queryId >= exprs.size())
+    return fail("malformed query record");
+  result.expr = exprs[queryId];
+
+  if (!readVarint(numEval))
+    return false;
+  result.evalExprs.clear();
+  for (std::uint64_t i = 0; i != numEval; ++i) {
+    std::uint64_t id;
+    if (!readVarint(id))
+      return false;
+    if (!id || id >= exprs.size())
+      return fail("malformed query record");
+    result.evalExprs.push_back(exprs[id]);
+  }
+
+  if (!readVarint(numObjects))
+    return false;
+  result.objects.clear();
+  for (std::uint64_t i = 0; i != numObjects; ++i) {
+    std::uint64_t id;
+    if (!readVarint(id))
+      return false;
+    if (!id || id >= arrays.size())
+      return fail("malformed query record");
+    result.objects.push_back(arrays[id]);
+  }
+
+  // The outcome record, when present, immediately follows its query.
+  result.haveResult = false;
+  if (pos < data.size() && static_cast<std::uint8_t>(data[pos]) == RecResult) {
+    ++pos;
+    std::uint8_t success;
+    if (!readByte(success) || !readVarint(result.elapsedUSec))
+      return false;
+    result.haveResult = true;
+    result.success = success != 0;
+  }
+
+  prevConstraints = result.constraints;
+  return true;
+}
+
+bool Reader::readQuery(LoggedQuery &result) {
+  if (!errorMessage.empty())
+    return false;
+
+  while (pos < data.size()) {
+    std::uint8_t tag = static_cast<std::uint8_t>(data[pos++]);
+    switch (tag) {
+    case RecArray:
+      if (!readArrayRecord())
+        return false;
+      break;
+    case RecUpdate:
+      if (!readUpdateRecord())
+        return false;
+      break;
+    case RecExpr:
+      if (!readExprRecord())
+        return false;
+      break;
+    case RecQuery:
+      return readQueryRecord(result);
+    case RecResult: {
+      // Outcome whose query record was flushed separately; skip it.
+      std::uint8_t success;
+      std::uint64_t elapsed;
+      if (!readByte(success) || !readVarint(elapsed))
+        return false;
+      break;
+    }
+    default:
+      return fail("unknown record tag");
+    }
+  }
+  return false; // clean end of log
+}
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Expr/ExprBuilder.h"
+#include "klee/Expr/ExprHashMap.h"
 
 using namespace klee;
 
@@ -18,7 +19,8 @@ ExprBuilder::~ExprBuilder() {
 }
 
 namespace {
-  class DefaultExprBuilder : public ExprBuilder {
+  class DefaultExprBuilder final : public ExprBuilder {
+  public:
     virtual ref<Expr> Constant(const llvm::APInt &Value) {
       return ConstantExpr::alloc(Value);
     }
@@ -154,6 +156,12 @@ namespace {
   /// ChainedBuilder - Helper class for construct specialized expression
   /// builders, which implements (non-virtual) methods which forward to a base
   /// expression builder, for all expressions.
+  ///
+  /// The base is typed by the BaseT template argument: instantiating with
+  /// a concrete final builder type lets the compiler devirtualize and
+  /// inline the forwarded calls, while BaseT = ExprBuilder keeps the
+  /// generic runtime chaining.
+  template <typename BaseT>
   class ChainedBuilder {
   protected:
     /// Builder - The builder that this specialized builder is contained
@@ -161,10 +169,10 @@ namespace {
     ExprBuilder *Builder;
 
     /// Base - The base builder class for constructing expressions.
-    ExprBuilder *Base;
+    BaseT *Base;
 
   public:
-    ChainedBuilder(ExprBuilder *_Builder, ExprBuilder *_Base) 
+    ChainedBuilder(ExprBuilder *_Builder, BaseT *_Base)
       : Builder(_Builder), Base(_Base) {}
     ~ChainedBuilder() { delete Base; }
 
@@ -308,11 +316,12 @@ namespace {
   /// implements methods for all the expression construction functions. These
   /// methods can be specialized to take [Non]ConstantExpr when desired.
   template<typename SpecializedBuilder>
-  class ConstantSpecializedExprBuilder : public ExprBuilder {
+  class ConstantSpecializedExprBuilder final : public ExprBuilder {
     SpecializedBuilder Builder;
 
   public:
-    ConstantSpecializedExprBuilder(ExprBuilder *Base) : Builder(this, Base) {}
+    template <typename BaseT>
+    ConstantSpecializedExprBuilder(BaseT *Base) : Builder(this, Base) {}
     ~ConstantSpecializedExprBuilder() {}
 
     virtual ref<Expr> Constant(const llvm::APInt &Value) {
@@ -690,11 +699,15 @@ namespace {
     }
   };
 
-  class ConstantFoldingBuilder :
-    public ChainedBuilder {
+  template <typename BaseT>
+  class ConstantFoldingBuilder : public ChainedBuilder<BaseT> {
+  protected:
+    using ChainedBuilder<BaseT>::Builder;
+    using ChainedBuilder<BaseT>::Base;
+
   public:
-    ConstantFoldingBuilder(ExprBuilder *Builder, ExprBuilder *Base)
-      : ChainedBuilder(Builder, Base) {}
+    ConstantFoldingBuilder(ExprBuilder *Builder, BaseT *Base)
+      : ChainedBuilder<BaseT>(Builder, Base) {}
 
     ref<Expr> Add(const ref<ConstantExpr> &LHS,
                   const ref<NonConstantExpr> &RHS) {
@@ -978,13 +991,18 @@ namespace {
     }
   };
 
-  typedef ConstantSpecializedExprBuilder<ConstantFoldingBuilder>
+  typedef ConstantSpecializedExprBuilder<ConstantFoldingBuilder<ExprBuilder>>
     ConstantFoldingExprBuilder;
 
-  class SimplifyingBuilder : public ChainedBuilder {
+  template <typename BaseT>
+  class SimplifyingBuilder : public ChainedBuilder<BaseT> {
+  protected:
+    using ChainedBuilder<BaseT>::Builder;
+    using ChainedBuilder<BaseT>::Base;
+
   public:
-    SimplifyingBuilder(ExprBuilder *Builder, ExprBuilder *Base)
-      : ChainedBuilder(Builder, Base) {}
+    SimplifyingBuilder(ExprBuilder *Builder, BaseT *Base)
+      : ChainedBuilder<BaseT>(Builder, Base) {}
 
     ref<Expr> Eq(const ref<ConstantExpr> &LHS, 
                  const ref<NonConstantExpr> &RHS) {
@@ -1050,8 +1068,176 @@ namespace {
     }
   };
 
-  typedef ConstantSpecializedExprBuilder<SimplifyingBuilder>
+  typedef ConstantSpecializedExprBuilder<SimplifyingBuilder<ExprBuilder>>
     SimplifyingExprBuilder;
+
+  /// The canonical simplifying stack (simplification over constant
+  /// folding over the default builder) composed at compile time: every
+  /// Base pointer has a concrete final type, so the per-node rule
+  /// dispatch devirtualizes and inlines and only the entry call into the
+  /// stack stays virtual. Mixed stacks use the generic builders above.
+  typedef ConstantSpecializedExprBuilder<
+      ConstantFoldingBuilder<DefaultExprBuilder>>
+      FusedConstantFoldingExprBuilder;
+  typedef ConstantSpecializedExprBuilder<
+      SimplifyingBuilder<FusedConstantFoldingExprBuilder>>
+      FusedSimplifyingExprBuilder;
+
+  /// HashConsingExprBuilder - Interns every expression constructed by the
+  /// base builder in a hash table so that structurally identical subtrees
+  /// are represented by a single node. Sharing makes deep expressions
+  /// from loop-heavy code cheap to keep around, and makes repeated
+  /// Expr::compare calls on shared subtrees exit early on the pointer
+  /// equality check.
+  class HashConsingExprBuilder : public ExprBuilder {
+    /// The table holds references, so it pins interned expressions; it is
+    /// dropped wholesale once it grows past \ref MaxTableSize to bound
+    /// the retained memory (sharing is rebuilt quickly afterwards).
+    static const size_t MaxTableSize = 1 << 20;
+
+    ExprBuilder *Base;
+    ExprHashSet table;
+
+    ref<Expr> intern(const ref<Expr> &e) {
+      if (table.size() >= MaxTableSize)
+        table.clear();
+      return *table.insert(e).first;
+    }
+
+  public:
+    HashConsingExprBuilder(ExprBuilder *Base) : Base(Base) {}
+    ~HashConsingExprBuilder() { delete Base; }
+
+    virtual ref<Expr> Constant(const llvm::APInt &Value) {
+      return intern(Base->Constant(Value));
+    }
+
+    virtual ref<Expr> NotOptimized(const ref<Expr> &Index) {
+      return intern(Base->NotOptimized(Index));
+    }
+
+    virtual ref<Expr> Read(const UpdateList &Updates, const ref<Expr> &Index) {
+      return intern(Base->Read(Updates, Index));
+    }
+
+    virtual ref<Expr> Select(const ref<Expr> &Cond, const ref<Expr> &LHS,
+                             const ref<Expr> &RHS) {
+      return intern(Base->Select(Cond, LHS, RHS));
+    }
+
+    virtual ref<Expr> Concat(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Concat(LHS, RHS));
+    }
+
+    virtual ref<Expr> Extract(const ref<Expr> &LHS, unsigned Offset,
+                              Expr::Width W) {
+      return intern(Base->Extract(LHS, Offset, W));
+    }
+
+    virtual ref<Expr> ZExt(const ref<Expr> &LHS, Expr::Width W) {
+      return intern(Base->ZExt(LHS, W));
+    }
+
+    virtual ref<Expr> SExt(const ref<Expr> &LHS, Expr::Width W) {
+      return intern(Base->SExt(LHS, W));
+    }
+
+    virtual ref<Expr> Add(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Add(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sub(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Sub(LHS, RHS));
+    }
+
+    virtual ref<Expr> Mul(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Mul(LHS, RHS));
+    }
+
+    virtual ref<Expr> UDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->UDiv(LHS, RHS));
+    }
+
+    virtual ref<Expr> SDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->SDiv(LHS, RHS));
+    }
+
+    virtual ref<Expr> URem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->URem(LHS, RHS));
+    }
+
+    virtual ref<Expr> SRem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->SRem(LHS, RHS));
+    }
+
+    virtual ref<Expr> Not(const ref<Expr> &LHS) {
+      return intern(Base->Not(LHS));
+    }
+
+    virtual ref<Expr> And(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->And(LHS, RHS));
+    }
+
+    virtual ref<Expr> Or(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Or(LHS, RHS));
+    }
+
+    virtual ref<Expr> Xor(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Xor(LHS, RHS));
+    }
+
+    virtual ref<Expr> Shl(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Shl(LHS, RHS));
+    }
+
+    virtual ref<Expr> LShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->LShr(LHS, RHS));
+    }
+
+    virtual ref<Expr> AShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->AShr(LHS, RHS));
+    }
+
+    virtual ref<Expr> Eq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Eq(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ne(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Ne(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ult(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Ult(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ule(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Ule(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ugt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Ugt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Uge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Uge(LHS, RHS));
+    }
+
+    virtual ref<Expr> Slt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Slt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sle(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Sle(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sgt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Sgt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return intern(Base->Sge(LHS, RHS));
+    }
+  };
 }
 
 ExprBuilder *klee::createDefaultExprBuilder() {
@@ -1065,3 +1251,12 @@ ExprBuilder *klee::createConstantFoldingExprBuilder(ExprBuilder *Base) {
 ExprBuilder *klee::createSimplifyingExprBuilder(ExprBuilder *Base) {
   return new SimplifyingExprBuilder(Base);
 }
+
+ExprBuilder *klee::createHashConsingExprBuilder(ExprBuilder *Base) {
+  return new HashConsingExprBuilder(Base);
+}
+
+ExprBuilder *klee::createFusedSimplifyingExprBuilder() {
+  return new FusedSimplifyingExprBuilder(
+      new FusedConstantFoldingExprBuilder(new DefaultExprBuilder()));
+}
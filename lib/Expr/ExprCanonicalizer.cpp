@@ -0,0 +1,143 @@
+//===-- ExprCanonicalizer.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ExprCanonicalizer.h"
+
+#include "klee/Expr/Expr.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+class CanonicalizingVisitor : public ExprVisitor {
+public:
+  explicit CanonicalizingVisitor(ExprVisitor::visited_ty *shared)
+      : ExprVisitor(false, shared) {}
+
+protected:
+  Action visitAdd(const AddExpr &e) override { return canonicalizeAC(e); }
+  Action visitMul(const MulExpr &e) override { return canonicalizeAC(e); }
+  Action visitAnd(const AndExpr &e) override { return canonicalizeAC(e); }
+  Action visitOr(const OrExpr &e) override { return canonicalizeAC(e); }
+  Action visitXor(const XorExpr &e) override { return canonicalizeAC(e); }
+
+private:
+  /// Append the leaves of the maximal \p kind chain rooted at \p e.
+  static void flatten(const ref<Expr> &e, Expr::Kind kind,
+                      std::vector<ref<Expr>> &leaves) {
+    std::vector<ref<Expr>> worklist{e};
+    while (!worklist.empty()) {
+      ref<Expr> cur = worklist.back();
+      worklist.pop_back();
+      if (cur->getKind() == kind) {
+        worklist.push_back(cur->getKid(0));
+        worklist.push_back(cur->getKid(1));
+      } else {
+        leaves.push_back(cur);
+      }
+    }
+  }
+
+  static ref<ConstantExpr> fold(Expr::Kind kind, const ref<ConstantExpr> &l,
+                                const ref<ConstantExpr> &r) {
+    switch (kind) {
+    case Expr::Add: return l->Add(r);
+    case Expr::Mul: return l->Mul(r);
+    case Expr::And: return l->And(r);
+    case Expr::Or:  return l->Or(r);
+    case Expr::Xor: return l->Xor(r);
+    default: assert(0 && "not an associative-commutative kind");
+      return l;
+    }
+  }
+
+  static bool isIdentity(Expr::Kind kind, const ref<ConstantExpr> &c) {
+    switch (kind) {
+    case Expr::Add:
+    case Expr::Or:
+    case Expr::Xor: return c->isZero();
+    case Expr::Mul: return c->isOne();
+    case Expr::And: return c->isAllOnes();
+    default: return false;
+    }
+  }
+
+  static ref<Expr> create(Expr::Kind kind, const ref<Expr> &l,
+                          const ref<Expr> &r) {
+    switch (kind) {
+    case Expr::Add: return AddExpr::create(l, r);
+    case Expr::Mul: return MulExpr::create(l, r);
+    case Expr::And: return AndExpr::create(l, r);
+    case Expr::Or:  return OrExpr::create(l, r);
+    case Expr::Xor: return XorExpr::create(l, r);
+    default: assert(0 && "not an associative-commutative kind");
+      return l;
+    }
+  }
+
+  /// Canonicalize a chain of an associative and commutative operator:
+  /// flatten it, fold its constants into a single leading term and sort
+  /// the remaining operands, so any association order of the same
+  /// operands rebuilds into the same structure.
+  Action canonicalizeAC(const Expr &e) {
+    Expr::Kind kind = e.getKind();
+
+    std::vector<ref<Expr>> leaves;
+    flatten(ref<Expr>(const_cast<Expr *>(&e)), kind, leaves);
+
+    // Canonicalize the leaves themselves; a rewritten leaf may have
+    // become another chain of the same kind, so flatten those too.
+    std::vector<ref<Expr>> operands;
+    ref<ConstantExpr> constant;
+    for (const ref<Expr> &leaf : leaves) {
+      ref<Expr> r = visit(leaf);
+      std::vector<ref<Expr>> flat;
+      if (r->getKind() == kind)
+        flatten(r, kind, flat);
+      else
+        flat.push_back(r);
+      for (const ref<Expr> &op : flat) {
+        if (ConstantExpr *CE = dyn_cast<ConstantExpr>(op))
+          constant =
+              constant.isNull() ? ref<ConstantExpr>(CE) : fold(kind, constant, CE);
+        else
+          operands.push_back(op);
+      }
+    }
+
+    if (operands.empty())
+      return Action::changeTo(constant);
+
+    std::sort(operands.begin(), operands.end(),
+              [](const ref<Expr> &a, const ref<Expr> &b) { return a < b; });
+
+    // Right-leaning chain over the sorted operands, constant first (the
+    // builders' convention), relying on the create() folds for
+    // absorbing constants (0 * X, 0 & X, ...).
+    ref<Expr> result = operands.back();
+    for (size_t i = operands.size() - 1; i-- > 0;)
+      result = create(kind, operands[i], result);
+    if (!constant.isNull() && !isIdentity(kind, constant))
+      result = create(kind, constant, result);
+
+    return Action::changeTo(result);
+  }
+};
+
+} // namespace
+
+ref<Expr> ExprCanonicalizer::canonicalize(const ref<Expr> &e) {
+  if (visited.size() > MaxTableSize)
+    visited.clear();
+  CanonicalizingVisitor visitor(&visited);
+  return visitor.visit(e);
+}
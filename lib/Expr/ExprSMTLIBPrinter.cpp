@@ -59,7 +59,7 @@ ExprSMTLIBPrinter::ExprSMTLIBPrinter()
     : usedArrays(), o(NULL), query(NULL), p(NULL), haveConstantArray(false),
       logicToUse(QF_AUFBV),
       humanReadable(ExprSMTLIBOptions::humanReadableSMTLIB),
-      smtlibBoolOptions(), arraysToCallGetValueOn(NULL) {
+      smtlibBoolOptions(), arraysToCallGetValueOn(NULL), finalOutput(NULL) {
   setConstantDisplayMode(ExprSMTLIBOptions::argConstantDisplayMode);
   setAbbreviationMode(ExprSMTLIBOptions::abbreviationMode);
 }
@@ -69,10 +69,16 @@ ExprSMTLIBPrinter::~ExprSMTLIBPrinter() {
 }
 
 void ExprSMTLIBPrinter::setOutput(llvm::raw_ostream &output) {
-  o = &output;
-  delete p;
-
-  p = new PrintContext(output);
+  finalOutput = &output;
+
+  // Serialize through a reusable in-memory buffer; generateOutput()
+  // writes the finished query to finalOutput in one piece.
+  if (!bufferOS) {
+    bufferOS.reset(new llvm::raw_svector_ostream(outputBuffer));
+    o = bufferOS.get();
+    delete p;
+    p = new PrintContext(*o);
+  }
 }
 
 void ExprSMTLIBPrinter::setQuery(const Query &q) {
@@ -123,7 +129,7 @@ void ExprSMTLIBPrinter::printConstant(const ref<ConstantExpr> &e) {
 
   /* Handle bitvector constants */
 
-  std::string value;
+  llvm::SmallString<64> value;
 
   /* SMTLIBv2 deduces the bit-width (should be 8-bits in our case)
    * from the length of the string (e.g. zero is #b00000000). LLVM
@@ -134,31 +140,31 @@ void ExprSMTLIBPrinter::printConstant(const ref<ConstantExpr> &e) {
 
   switch (cdm) {
   case BINARY:
-    e->toString(value, 2);
+    e->getAPValue().toString(value, 2, false);
     *p << "#b";
 
-    zeroPad = e->getWidth() - value.length();
+    zeroPad = e->getWidth() - value.size();
 
     for (unsigned int count = 0; count < zeroPad; count++)
       *p << "0";
 
-    *p << value;
+    *p << value.str();
     break;
 
   case HEX:
-    e->toString(value, 16);
+    e->getAPValue().toString(value, 16, false);
     *p << "#x";
 
-    zeroPad = (e->getWidth() / 4) - value.length();
+    zeroPad = (e->getWidth() / 4) - value.size();
     for (unsigned int count = 0; count < zeroPad; count++)
       *p << "0";
 
-    *p << value;
+    *p << value.str();
     break;
 
   case DECIMAL:
-    e->toString(value, 10);
-    *p << "(_ bv" << value << " " << e->getWidth() << ")";
+    e->getAPValue().toString(value, 10, false);
+    *p << "(_ bv" << value.str() << " " << e->getWidth() << ")";
     break;
 
   default:
@@ -517,7 +523,7 @@ void ExprSMTLIBPrinter::scanAll() {
 }
 
 void ExprSMTLIBPrinter::generateOutput() {
-  if (p == NULL || query == NULL || o == NULL) {
+  if (p == NULL || query == NULL || finalOutput == NULL) {
     llvm::errs() << "ExprSMTLIBPrinter::generateOutput() Can't print SMTLIBv2. "
                     "Output or query bad!\n";
     return;
@@ -536,6 +542,11 @@ void ExprSMTLIBPrinter::generateOutput() {
 
   printAction();
   printExit();
+
+  // Hand the serialized query to the output stream in one piece. clear()
+  // keeps the buffer's capacity for the next query.
+  finalOutput->write(outputBuffer.data(), outputBuffer.size());
+  outputBuffer.clear();
 }
 
 void ExprSMTLIBPrinter::printSetLogic() {
@@ -697,31 +708,50 @@ void ExprSMTLIBPrinter::scan(const ref<Expr> &e) {
   if (isa<ConstantExpr>(e))
     return; // we don't need to scan simple constants
 
-  if (seenExprs.insert(e).second) {
-    // We've not seen this expression before
+  // Single explicit-stack pass so deep expressions cannot overflow the
+  // call stack.
+  std::vector<ref<Expr> > stack;
+  stack.push_back(e);
 
-    if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+  while (!stack.empty()) {
+    ref<Expr> current = stack.back();
+    stack.pop_back();
 
-      if (usedArrays.insert(re->updates.root).second) {
-        // Array was not recorded before
+    if (seenExprs.insert(current).second) {
+      // We've not seen this expression before
 
-        // check if the array is constant
-        if (re->updates.root->isConstantArray())
-          haveConstantArray = true;
+      if (const ReadExpr *re = dyn_cast<ReadExpr>(current)) {
 
-        // scan the update list
-        scanUpdates(re->updates.head.get());
+        if (usedArrays.insert(re->updates.root).second) {
+          // Array was not recorded before
+
+          // check if the array is constant
+          if (re->updates.root->isConstantArray())
+            haveConstantArray = true;
+
+          // scan the update list
+          for (const auto *un = re->updates.head.get(); un;
+               un = un->next.get()) {
+            if (!isa<ConstantExpr>(un->index))
+              stack.push_back(un->index);
+            if (!isa<ConstantExpr>(un->value))
+              stack.push_back(un->value);
+          }
+        }
       }
-    }
 
-    // recurse into the children
-    Expr *ep = e.get();
-    for (unsigned int i = 0; i < ep->getNumKids(); i++)
-      scan(ep->getKid(i));
-  } else {
-    // Add the expression to the binding map. The semantics of std::map::insert
-    // are such that it will not be inserted twice.
-    bindings.insert(std::make_pair(e, bindings.size()+1));
+      // visit the children
+      Expr *ep = current.get();
+      for (unsigned int i = 0; i < ep->getNumKids(); i++) {
+        const ref<Expr> &kid = ep->getKid(i);
+        if (!isa<ConstantExpr>(kid))
+          stack.push_back(kid);
+      }
+    } else {
+      // Add the expression to the binding map. The semantics of
+      // std::map::insert are such that it will not be inserted twice.
+      bindings.insert(std::make_pair(current, bindings.size()+1));
+    }
   }
 }
 
@@ -817,14 +847,6 @@ void ExprSMTLIBPrinter::scanBindingExprDeps() {
   }
 }
 
-void ExprSMTLIBPrinter::scanUpdates(const UpdateNode *un) {
-  while (un != NULL) {
-    scan(un->index);
-    scan(un->value);
-    un = un->next.get();
-  }
-}
-
 void ExprSMTLIBPrinter::printExit() { *o << "(exit)\n"; }
 
 bool ExprSMTLIBPrinter::setLogic(SMTLIBv2Logic l) {
@@ -12,6 +12,8 @@
 #include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprVisitor.h"
 
+#include <algorithm>
+#include <mutex>
 #include <set>
 
 using namespace klee;
@@ -75,33 +77,144 @@ void klee::findReads(ref<Expr> e,
 
 ///
 
-namespace klee {
+namespace {
 
-class SymbolicObjectFinder : public ExprVisitor {
-protected:
-  Action visitRead(const ReadExpr &re) {
-    const UpdateList &ul = re.updates;
+/// Serializes access to the symbolicArrays caches: queries traverse
+/// shared expressions with the interpreter lock released, so discovery
+/// may run from several solver chains at once.
+std::mutex SymbolicArraysMutex;
 
-    // XXX should we memo better than what ExprVisitor is doing for us?
-    for (const auto *un = ul.head.get(); un; un = un->next.get()) {
-      visit(un->index);
-      visit(un->value);
-    }
+/// One pending node on the explicit traversal stack; exactly one of
+/// e/un is set.
+struct ArraySetItem {
+  Expr *e;
+  const UpdateNode *un;
+};
+
+const SymbolicArraySet &emptyArraySet() {
+  static SymbolicArraySet empty =
+      std::make_shared<const std::vector<const Array *> >();
+  return empty;
+}
+
+bool arrayIdLess(const Array *a, const Array *b) { return a->id < b->id; }
+
+/// Union of two id-sorted array sets. Returns one of the inputs when it
+/// already covers the other, so equal sets stay shared.
+SymbolicArraySet unionArraySets(const SymbolicArraySet &a,
+                                const SymbolicArraySet &b) {
+  if (a == b || b->empty())
+    return a;
+  if (a->empty())
+    return b;
+  std::vector<const Array *> merged;
+  merged.reserve(a->size() + b->size());
+  std::set_union(a->begin(), a->end(), b->begin(), b->end(),
+                 std::back_inserter(merged), arrayIdLess);
+  if (merged.size() == a->size())
+    return a;
+  if (merged.size() == b->size())
+    return b;
+  return std::make_shared<const std::vector<const Array *> >(
+      std::move(merged));
+}
 
-    if (ul.root->isSymbolicArray())
-      if (results.insert(ul.root).second)
-        objects.push_back(ul.root);
+/// Compute and cache the referenced-array sets for every node reachable
+/// from root that does not have one yet. Iterative so deep expressions
+/// and long update lists cannot overflow the call stack.
+void computeArraySets(Expr *root) {
+  std::vector<ArraySetItem> stack;
+  stack.push_back({root, nullptr});
 
-    return Action::doChildren();
+  while (!stack.empty()) {
+    ArraySetItem item = stack.back();
+
+    bool ready = true;
+    auto require = [&stack, &ready](Expr *dep) {
+      if (!dep->symbolicArrays) {
+        stack.push_back({dep, nullptr});
+        ready = false;
+      }
+    };
+
+    if (Expr *e = item.e) {
+      if (e->symbolicArrays) {
+        stack.pop_back();
+        continue;
+      }
+      if (isa<ConstantExpr>(e)) {
+        e->symbolicArrays = emptyArraySet();
+        stack.pop_back();
+        continue;
+      }
+
+      if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+        require(re->index.get());
+        const UpdateNode *head = re->updates.head.get();
+        if (head && !head->symbolicArrays) {
+          stack.push_back({nullptr, head});
+          ready = false;
+        }
+        if (!ready)
+          continue;
+
+        SymbolicArraySet set = re->index->symbolicArrays;
+        if (head)
+          set = unionArraySets(set, head->symbolicArrays);
+        const Array *array = re->updates.root;
+        if (array->isSymbolicArray() &&
+            !std::binary_search(set->begin(), set->end(), array,
+                                arrayIdLess)) {
+          std::vector<const Array *> withRoot(*set);
+          withRoot.insert(std::lower_bound(withRoot.begin(), withRoot.end(),
+                                           array, arrayIdLess),
+                          array);
+          set = std::make_shared<const std::vector<const Array *> >(
+              std::move(withRoot));
+        }
+        e->symbolicArrays = set;
+      } else {
+        unsigned count = e->getNumKids();
+        for (unsigned i = 0; i != count; ++i)
+          require(e->getKid(i).get());
+        if (!ready)
+          continue;
+
+        SymbolicArraySet set = emptyArraySet();
+        for (unsigned i = 0; i != count; ++i)
+          set = unionArraySets(set, e->getKid(i)->symbolicArrays);
+        e->symbolicArrays = set;
+      }
+      stack.pop_back();
+    } else {
+      const UpdateNode *un = item.un;
+      if (un->symbolicArrays) {
+        stack.pop_back();
+        continue;
+      }
+
+      require(un->index.get());
+      require(un->value.get());
+      const UpdateNode *next = un->next.get();
+      if (next && !next->symbolicArrays) {
+        stack.push_back({nullptr, next});
+        ready = false;
+      }
+      if (!ready)
+        continue;
+
+      SymbolicArraySet set = unionArraySets(un->index->symbolicArrays,
+                                            un->value->symbolicArrays);
+      if (next)
+        set = unionArraySets(set, next->symbolicArrays);
+      un->symbolicArrays = set;
+      stack.pop_back();
+    }
   }
+}
+}
 
-public:
-  std::set<const Array*> results;
-  std::vector<const Array*> &objects;
-  
-  SymbolicObjectFinder(std::vector<const Array*> &_objects)
-    : objects(_objects) {}
-};
+namespace klee {
 
 ExprVisitor::Action ConstantArrayFinder::visitRead(const ReadExpr &re) {
   const UpdateList &ul = re.updates;
@@ -121,12 +234,18 @@ ExprVisitor::Action ConstantArrayFinder::visitRead(const ReadExpr &re) {
 }
 
 template<typename InputIterator>
-void klee::findSymbolicObjects(InputIterator begin, 
+void klee::findSymbolicObjects(InputIterator begin,
                                InputIterator end,
                                std::vector<const Array*> &results) {
-  SymbolicObjectFinder of(results);
-  for (; begin!=end; ++begin)
-    of.visit(*begin);
+  std::lock_guard<std::mutex> guard(SymbolicArraysMutex);
+  SymbolicArraySet all = emptyArraySet();
+  for (; begin!=end; ++begin) {
+    Expr *e = begin->get();
+    if (!e->symbolicArrays)
+      computeArraySets(e);
+    all = unionArraySets(all, e->symbolicArrays);
+  }
+  results.insert(results.end(), all->begin(), all->end());
 }
 
 void klee::findSymbolicObjects(ref<Expr> e,
@@ -23,107 +23,191 @@ llvm::cl::opt<bool> UseVisitorHash(
 
 using namespace klee;
 
-ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
-  if (!UseVisitorHash || isa<ConstantExpr>(e)) {
-    return visitActual(e);
-  } else {
-    visited_ty::iterator it = visited.find(e);
-
-    if (it!=visited.end()) {
-      return it->second;
-    } else {
-      ref<Expr> res = visitActual(e);
-      visited.insert(std::make_pair(e, res));
-      return res;
-    }
-  }
+namespace {
+/// One pending expression on the explicit visit stack.
+struct VisitFrame {
+  enum Phase {
+    Expand,   ///< visitExpr and the kind-specific hook have not run yet
+    Children, ///< collecting the results of the children
+    Post      ///< recursive mode: waiting for the rebuilt expression
+  } phase;
+
+  /// The original expression this frame will produce a result for.
+  ref<Expr> e;
+
+  /// Visited children, filled in order.
+  ref<Expr> kids[8];
+
+  /// Index of the next child to visit.
+  unsigned nextKid;
+
+  /// Whether any child changed, forcing a rebuild.
+  bool rebuilt;
+
+  explicit VisitFrame(const ref<Expr> &_e)
+      : phase(Expand), e(_e), nextKid(0), rebuilt(false) {}
+};
 }
 
-ref<Expr> ExprVisitor::visitActual(const ref<Expr> &e) {
-  if (isa<ConstantExpr>(e)) {    
-    return e;
-  } else {
-    Expr &ep = *e.get();
+ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
+  // The tree is walked with an explicit stack so that deeply nested
+  // expressions cannot overflow the call stack. `result` carries the
+  // value a popped frame returns to the frame below it.
+  std::vector<VisitFrame> stack;
+  stack.push_back(VisitFrame(e));
+  ref<Expr> result;
+  bool haveResult = false;
+
+  visited_ty &memo = sharedVisited ? *sharedVisited : visited;
+  auto finish = [&](const ref<Expr> &value) {
+    if (UseVisitorHash)
+      memo.insert(std::make_pair(stack.back().e, value));
+    result = value;
+    haveResult = true;
+    stack.pop_back();
+  };
+
+  while (!stack.empty()) {
+    VisitFrame &f = stack.back();
+    switch (f.phase) {
+    case VisitFrame::Expand: {
+      if (isa<ConstantExpr>(f.e)) {
+        result = f.e;
+        haveResult = true;
+        stack.pop_back();
+        break;
+      }
 
-    Action res = visitExpr(ep);
-    switch(res.kind) {
-    case Action::DoChildren:
-      // continue with normal action
+      if (UseVisitorHash) {
+        visited_ty::iterator it = memo.find(f.e);
+        if (it != memo.end()) {
+          result = it->second;
+          haveResult = true;
+          stack.pop_back();
+          break;
+        }
+      }
+
+      Action res = visitDispatch(*f.e.get());
+      switch (res.kind) {
+      default:
+        assert(0 && "invalid kind");
+      case Action::DoChildren:
+        f.phase = VisitFrame::Children;
+        break;
+      case Action::SkipChildren:
+        finish(f.e);
+        break;
+      case Action::ChangeTo:
+        finish(res.argument);
+        break;
+      }
       break;
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      return res.argument;
     }
 
-    switch(ep.getKind()) {
-    case Expr::NotOptimized: res = visitNotOptimized(static_cast<NotOptimizedExpr&>(ep)); break;
-    case Expr::Read: res = visitRead(static_cast<ReadExpr&>(ep)); break;
-    case Expr::Select: res = visitSelect(static_cast<SelectExpr&>(ep)); break;
-    case Expr::Concat: res = visitConcat(static_cast<ConcatExpr&>(ep)); break;
-    case Expr::Extract: res = visitExtract(static_cast<ExtractExpr&>(ep)); break;
-    case Expr::ZExt: res = visitZExt(static_cast<ZExtExpr&>(ep)); break;
-    case Expr::SExt: res = visitSExt(static_cast<SExtExpr&>(ep)); break;
-    case Expr::Add: res = visitAdd(static_cast<AddExpr&>(ep)); break;
-    case Expr::Sub: res = visitSub(static_cast<SubExpr&>(ep)); break;
-    case Expr::Mul: res = visitMul(static_cast<MulExpr&>(ep)); break;
-    case Expr::UDiv: res = visitUDiv(static_cast<UDivExpr&>(ep)); break;
-    case Expr::SDiv: res = visitSDiv(static_cast<SDivExpr&>(ep)); break;
-    case Expr::URem: res = visitURem(static_cast<URemExpr&>(ep)); break;
-    case Expr::SRem: res = visitSRem(static_cast<SRemExpr&>(ep)); break;
-    case Expr::Not: res = visitNot(static_cast<NotExpr&>(ep)); break;
-    case Expr::And: res = visitAnd(static_cast<AndExpr&>(ep)); break;
-    case Expr::Or: res = visitOr(static_cast<OrExpr&>(ep)); break;
-    case Expr::Xor: res = visitXor(static_cast<XorExpr&>(ep)); break;
-    case Expr::Shl: res = visitShl(static_cast<ShlExpr&>(ep)); break;
-    case Expr::LShr: res = visitLShr(static_cast<LShrExpr&>(ep)); break;
-    case Expr::AShr: res = visitAShr(static_cast<AShrExpr&>(ep)); break;
-    case Expr::Eq: res = visitEq(static_cast<EqExpr&>(ep)); break;
-    case Expr::Ne: res = visitNe(static_cast<NeExpr&>(ep)); break;
-    case Expr::Ult: res = visitUlt(static_cast<UltExpr&>(ep)); break;
-    case Expr::Ule: res = visitUle(static_cast<UleExpr&>(ep)); break;
-    case Expr::Ugt: res = visitUgt(static_cast<UgtExpr&>(ep)); break;
-    case Expr::Uge: res = visitUge(static_cast<UgeExpr&>(ep)); break;
-    case Expr::Slt: res = visitSlt(static_cast<SltExpr&>(ep)); break;
-    case Expr::Sle: res = visitSle(static_cast<SleExpr&>(ep)); break;
-    case Expr::Sgt: res = visitSgt(static_cast<SgtExpr&>(ep)); break;
-    case Expr::Sge: res = visitSge(static_cast<SgeExpr&>(ep)); break;
-    case Expr::Constant:
-    default:
-      assert(0 && "invalid expression kind");
-    }
+    case VisitFrame::Children: {
+      if (haveResult) {
+        // A child frame just delivered its result.
+        if (result != f.e->getKid(f.nextKid))
+          f.rebuilt = true;
+        f.kids[f.nextKid] = result;
+        ++f.nextKid;
+        haveResult = false;
+      }
 
-    switch(res.kind) {
-    default:
-      assert(0 && "invalid kind");
-    case Action::DoChildren: {  
-      bool rebuild = false;
-      ref<Expr> e(&ep), kids[8];
-      unsigned count = ep.getNumKids();
-      for (unsigned i=0; i<count; i++) {
-        ref<Expr> kid = ep.getKid(i);
-        kids[i] = visit(kid);
-        if (kids[i] != kid)
-          rebuild = true;
+      if (f.nextKid < f.e->getNumKids()) {
+        ref<Expr> kid = f.e->getKid(f.nextKid);
+        // Invalidates f.
+        stack.push_back(VisitFrame(kid));
+        break;
       }
-      if (rebuild) {
-        e = ep.rebuild(kids);
-        if (recursive)
-          e = visit(e);
+
+      ref<Expr> r = f.e;
+      if (f.rebuilt) {
+        r = f.e->rebuild(f.kids);
+        if (recursive) {
+          f.phase = VisitFrame::Post;
+          // Invalidates f.
+          stack.push_back(VisitFrame(r));
+          break;
+        }
       }
-      if (!isa<ConstantExpr>(e)) {
-        res = visitExprPost(*e.get());
-        if (res.kind==Action::ChangeTo)
-          e = res.argument;
+      if (!isa<ConstantExpr>(r)) {
+        Action res = visitExprPost(*r.get());
+        if (res.kind == Action::ChangeTo)
+          r = res.argument;
       }
-      return e;
+      finish(r);
+      break;
+    }
+
+    case VisitFrame::Post: {
+      // `result` holds the fully revisited rebuilt expression.
+      ref<Expr> r = result;
+      haveResult = false;
+      if (!isa<ConstantExpr>(r)) {
+        Action res = visitExprPost(*r.get());
+        if (res.kind == Action::ChangeTo)
+          r = res.argument;
+      }
+      finish(r);
+      break;
     }
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      return res.argument;
     }
   }
+
+  return result;
+}
+
+ExprVisitor::Action ExprVisitor::visitDispatch(Expr &ep) {
+  Action res = visitExpr(ep);
+  switch(res.kind) {
+  case Action::DoChildren:
+    // continue with normal action
+    break;
+  case Action::SkipChildren:
+  case Action::ChangeTo:
+    return res;
+  }
+
+  switch(ep.getKind()) {
+  case Expr::NotOptimized: res = visitNotOptimized(static_cast<NotOptimizedExpr&>(ep)); break;
+  case Expr::Read: res = visitRead(static_cast<ReadExpr&>(ep)); break;
+  case Expr::Select: res = visitSelect(static_cast<SelectExpr&>(ep)); break;
+  case Expr::Concat: res = visitConcat(static_cast<ConcatExpr&>(ep)); break;
+  case Expr::Extract: res = visitExtract(static_cast<ExtractExpr&>(ep)); break;
+  case Expr::ZExt: res = visitZExt(static_cast<ZExtExpr&>(ep)); break;
+  case Expr::SExt: res = visitSExt(static_cast<SExtExpr&>(ep)); break;
+  case Expr::Add: res = visitAdd(static_cast<AddExpr&>(ep)); break;
+  case Expr::Sub: res = visitSub(static_cast<SubExpr&>(ep)); break;
+  case Expr::Mul: res = visitMul(static_cast<MulExpr&>(ep)); break;
+  case Expr::UDiv: res = visitUDiv(static_cast<UDivExpr&>(ep)); break;
+  case Expr::SDiv: res = visitSDiv(static_cast<SDivExpr&>(ep)); break;
+  case Expr::URem: res = visitURem(static_cast<URemExpr&>(ep)); break;
+  case Expr::SRem: res = visitSRem(static_cast<SRemExpr&>(ep)); break;
+  case Expr::Not: res = visitNot(static_cast<NotExpr&>(ep)); break;
+  case Expr::And: res = visitAnd(static_cast<AndExpr&>(ep)); break;
+  case Expr::Or: res = visitOr(static_cast<OrExpr&>(ep)); break;
+  case Expr::Xor: res = visitXor(static_cast<XorExpr&>(ep)); break;
+  case Expr::Shl: res = visitShl(static_cast<ShlExpr&>(ep)); break;
+  case Expr::LShr: res = visitLShr(static_cast<LShrExpr&>(ep)); break;
+  case Expr::AShr: res = visitAShr(static_cast<AShrExpr&>(ep)); break;
+  case Expr::Eq: res = visitEq(static_cast<EqExpr&>(ep)); break;
+  case Expr::Ne: res = visitNe(static_cast<NeExpr&>(ep)); break;
+  case Expr::Ult: res = visitUlt(static_cast<UltExpr&>(ep)); break;
+  case Expr::Ule: res = visitUle(static_cast<UleExpr&>(ep)); break;
+  case Expr::Ugt: res = visitUgt(static_cast<UgtExpr&>(ep)); break;
+  case Expr::Uge: res = visitUge(static_cast<UgeExpr&>(ep)); break;
+  case Expr::Slt: res = visitSlt(static_cast<SltExpr&>(ep)); break;
+  case Expr::Sle: res = visitSle(static_cast<SleExpr&>(ep)); break;
+  case Expr::Sgt: res = visitSgt(static_cast<SgtExpr&>(ep)); break;
+  case Expr::Sge: res = visitSge(static_cast<SgeExpr&>(ep)); break;
+  case Expr::Constant:
+  default:
+    assert(0 && "invalid expression kind");
+  }
+
+  return res;
 }
 
 ExprVisitor::Action ExprVisitor::visitExpr(const Expr&) {
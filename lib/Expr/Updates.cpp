@@ -10,6 +10,8 @@
 #include "klee/Expr/Expr.h"
 
 #include <cassert>
+#include <unordered_set>
+#include <vector>
 
 using namespace klee;
 
@@ -46,7 +48,30 @@ unsigned UpdateNode::computeHash() {
 ///
 
 UpdateList::UpdateList(const Array *_root, const ref<UpdateNode> &_head)
-    : root(_root), head(_head) {}
+    : root(_root), head(_head) {
+  if (root)
+    ++root->refCount;
+}
+
+UpdateList::UpdateList(const UpdateList &b) : root(b.root), head(b.head) {
+  if (root)
+    ++root->refCount;
+}
+
+UpdateList::~UpdateList() {
+  if (root)
+    --root->refCount;
+}
+
+UpdateList &UpdateList::operator=(const UpdateList &b) {
+  if (b.root)
+    ++b.root->refCount;
+  if (root)
+    --root->refCount;
+  root = b.root;
+  head = b.head;
+  return *this;
+}
 
 void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
   
@@ -58,6 +83,39 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
   head = new UpdateNode(head, index, value);
 }
 
+bool UpdateList::compact() {
+  if (!head)
+    return false;
+
+  // Walk newest to oldest; a constant-index write is dead once a newer
+  // write to the same index has been seen. Intervening writes do not
+  // matter: they only ever replace bytes, so the dropped write cannot
+  // influence any byte of the final array.
+  std::unordered_set<uint64_t> written;
+  std::vector<const UpdateNode *> kept;
+  kept.reserve(head->getSize());
+  bool dropped = false;
+
+  for (const UpdateNode *un = head.get(); un; un = un->next.get()) {
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(un->index)) {
+      if (!written.insert(ce->getZExtValue()).second) {
+        dropped = true;
+        continue;
+      }
+    }
+    kept.push_back(un);
+  }
+
+  if (!dropped)
+    return false;
+
+  ref<UpdateNode> newHead;
+  for (auto it = kept.rbegin(), ie = kept.rend(); it != ie; ++it)
+    newHead = new UpdateNode(newHead, (*it)->index, (*it)->value);
+  head = newHead;
+  return true;
+}
+
 int UpdateList::compare(const UpdateList &b) const {
   if (root->name != b.root->name)
     return root->name < b.root->name ? -1 : 1;
@@ -85,9 +143,9 @@ int UpdateList::compare(const UpdateList &b) const {
 }
 
 unsigned UpdateList::hash() const {
-  unsigned res = 0;
-  for (unsigned i = 0, e = root->name.size(); i != e; ++i)
-    res = (res * Expr::MAGIC_HASH_CONSTANT) + root->name[i];
+  // The root's hash is computed once at construction; rehashing its
+  // name here made every ReadExpr construction cost O(|name|).
+  unsigned res = root->hash();
   if (head)
     res ^= head->hash();
   return res;
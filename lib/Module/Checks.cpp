@@ -50,6 +50,12 @@ bool DivCheckPass::runOnModule(Module &M) {
             opcode != Instruction::SRem && opcode != Instruction::URem)
           continue;
 
+        // Vector divisions only survive to this point when the
+        // Scalarizer pass is disabled; the checker function takes a
+        // scalar denominator, so they are left unchecked.
+        if (binOp->getType()->isVectorTy())
+          continue;
+
         // Check if the operand is constant and not zero, skip in that case.
         const auto &operand = binOp->getOperand(1);
         if (const auto &coOp = dyn_cast<llvm::Constant>(operand)) {
@@ -105,6 +111,11 @@ bool OvershiftCheckPass::runOnModule(Module &M) {
             opcode != Instruction::AShr)
           continue;
 
+        // As in DivCheckPass, vector shifts are left unchecked when the
+        // Scalarizer pass is disabled.
+        if (binOp->getType()->isVectorTy())
+          continue;
+
         // Check if the operand is constant and not zero, skip in that case
         auto operand = binOp->getOperand(1);
         if (auto coOp = dyn_cast<llvm::ConstantInt>(operand)) {
@@ -29,6 +29,7 @@
 #include <cstdint>
 #include <map>
 #include <string>
+#include <unordered_map>
 
 using namespace klee;
 
@@ -81,8 +82,10 @@ buildInstructionToLineMap(const llvm::Module &m) {
   return mapping;
 }
 
-class DebugInfoExtractor {
+class klee::DebugInfoExtractor {
   std::vector<std::unique_ptr<std::string>> &internedStrings;
+  /// Interned strings by value, to avoid a linear scan per lookup.
+  std::unordered_map<std::string, std::string *> internedIndex;
   std::map<uintptr_t, uint64_t> lineTable;
 
   const llvm::Module &module;
@@ -96,17 +99,15 @@ public:
   }
 
   std::string &getInternedString(const std::string &s) {
-    auto found = std::find_if(internedStrings.begin(), internedStrings.end(),
-                              [&s](const std::unique_ptr<std::string> &item) {
-                                return *item.get() == s;
-                              });
-    if (found != internedStrings.end())
-      return *found->get();
+    auto found = internedIndex.find(s);
+    if (found != internedIndex.end())
+      return *found->second;
 
     auto newItem = std::unique_ptr<std::string>(new std::string(s));
     auto result = newItem.get();
 
     internedStrings.emplace_back(std::move(newItem));
+    internedIndex.insert(std::make_pair(s, result));
     return *result;
   }
 
@@ -164,48 +165,81 @@ public:
   }
 };
 
-InstructionInfoTable::InstructionInfoTable(const llvm::Module &m) {
-  // Generate all debug instruction information
-  DebugInfoExtractor DI(internedStrings, m);
+InstructionInfoTable::InstructionInfoTable(const llvm::Module &m) : module(m) {
+  // Only assign ids here; the debug information itself is extracted per
+  // function on first request. Instruction ids come first, in
+  // instruction order, followed by one id per function.
+  unsigned id = 0;
   for (const auto &Func : m) {
-    auto F = DI.getFunctionInfo(Func);
-    auto FR = F.get();
-    functionInfos.insert(std::make_pair(&Func, std::move(F)));
-
+    idRanges[&Func].firstInstructionId = id;
     for (auto it = llvm::inst_begin(Func), ie = llvm::inst_end(Func); it != ie;
-         ++it) {
-      auto instr = &*it;
-      infos.insert(std::make_pair(instr, DI.getInstructionInfo(*instr, FR)));
-    }
+         ++it)
+      ++id;
   }
+  for (const auto &Func : m)
+    idRanges[&Func].functionId = id++;
 
-  // Make sure that every item has a unique ID
-  size_t idCounter = 0;
-  for (auto &item : infos)
-    item.second->id = idCounter++;
-  for (auto &item : functionInfos)
-    item.second->id = idCounter++;
+  maxID = id;
+  unpopulatedFunctions = idRanges.size();
 }
 
-unsigned InstructionInfoTable::getMaxID() const {
-  return infos.size() + functionInfos.size();
+InstructionInfoTable::~InstructionInfoTable() = default;
+
+void InstructionInfoTable::populateFunction(const llvm::Function &Func) const {
+  if (!extractor)
+    extractor.reset(new DebugInfoExtractor(internedStrings, module));
+
+  const auto range = idRanges.at(&Func);
+  auto F = extractor->getFunctionInfo(Func);
+  auto FR = F.get();
+  FR->id = range.functionId;
+  functionInfos.insert(std::make_pair(&Func, std::move(F)));
+
+  unsigned id = range.firstInstructionId;
+  for (auto it = llvm::inst_begin(Func), ie = llvm::inst_end(Func); it != ie;
+       ++it) {
+    auto instr = &*it;
+    auto info = extractor->getInstructionInfo(*instr, FR);
+    info->id = id++;
+    infos.insert(std::make_pair(instr, std::move(info)));
+  }
+
+  // Release the line table once there is nothing left to populate.
+  if (--unpopulatedFunctions == 0)
+    extractor.reset();
 }
 
+unsigned InstructionInfoTable::getMaxID() const { return maxID; }
+
 const InstructionInfo &
 InstructionInfoTable::getInfo(const llvm::Instruction &inst) const {
+  std::lock_guard<std::mutex> guard(populationMutex);
   auto it = infos.find(&inst);
-  if (it == infos.end())
-    llvm::report_fatal_error("invalid instruction, not present in "
-                             "initial module!");
+  if (it == infos.end()) {
+    const llvm::Function *f = inst.getParent()->getParent();
+    if (!f || !idRanges.count(f))
+      llvm::report_fatal_error("invalid instruction, not present in "
+                               "initial module!");
+    populateFunction(*f);
+    it = infos.find(&inst);
+    if (it == infos.end())
+      llvm::report_fatal_error("invalid instruction, not present in "
+                               "initial module!");
+  }
   return *it->second.get();
 }
 
 const FunctionInfo &
 InstructionInfoTable::getFunctionInfo(const llvm::Function &f) const {
+  std::lock_guard<std::mutex> guard(populationMutex);
   auto found = functionInfos.find(&f);
-  if (found == functionInfos.end())
-    llvm::report_fatal_error("invalid instruction, not present in "
-                             "initial module!");
+  if (found == functionInfos.end()) {
+    if (!idRanges.count(&f))
+      llvm::report_fatal_error("invalid instruction, not present in "
+                               "initial module!");
+    populateFunction(f);
+    found = functionInfos.find(&f);
+  }
 
   return *found->second.get();
 }
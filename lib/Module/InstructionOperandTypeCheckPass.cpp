@@ -36,6 +36,22 @@ bool checkOperandTypeIsScalarInt(const Instruction *i, unsigned opNum) {
   return true;
 }
 
+bool checkOperandTypeIsInt(const Instruction *i, unsigned opNum,
+                           bool allowVectors) {
+  assert(opNum < i->getNumOperands());
+  llvm::Type *ty = i->getOperand(opNum)->getType();
+  if (allowVectors && ty->isVectorTy() &&
+      ty->getScalarType()->isIntegerTy())
+    return true;
+  if (!(ty->isIntegerTy())) {
+    printOperandWarning(allowVectors ? "integer or integer vector"
+                                     : "scalar integer",
+                        i, ty, opNum);
+    return false;
+  }
+  return true;
+}
+
 bool checkOperandTypeIsScalarIntOrPointer(const Instruction *i,
                                           unsigned opNum) {
   assert(opNum < i->getNumOperands());
@@ -47,6 +63,22 @@ bool checkOperandTypeIsScalarIntOrPointer(const Instruction *i,
   return true;
 }
 
+bool checkOperandTypeIsIntOrPointer(const Instruction *i, unsigned opNum,
+                                    bool allowVectors) {
+  assert(opNum < i->getNumOperands());
+  llvm::Type *ty = i->getOperand(opNum)->getType();
+  if (allowVectors && ty->isVectorTy() &&
+      ty->getScalarType()->isIntegerTy())
+    return true;
+  if (!(ty->isIntegerTy() || ty->isPointerTy())) {
+    printOperandWarning(allowVectors ? "integer, pointer or integer vector"
+                                     : "scalar integer or pointer",
+                        i, ty, opNum);
+    return false;
+  }
+  return true;
+}
+
 bool checkOperandTypeIsScalarPointer(const Instruction *i, unsigned opNum) {
   assert(opNum < i->getNumOperands());
   llvm::Type *ty = i->getOperand(opNum)->getType();
@@ -87,14 +119,14 @@ bool checkOperandsHaveSameType(const Instruction *i, unsigned opNum0,
   return true;
 }
 
-bool checkInstruction(const Instruction *i) {
+bool checkInstruction(const Instruction *i, bool allowVectors) {
   switch (i->getOpcode()) {
   case Instruction::Select: {
     // Note we do not enforce that operand 1 and 2 are scalar because the
     // scalarizer pass might not remove these. This could be selecting which
     // vector operand to feed to another instruction. The Executor can handle
     // this so case so this is not a problem
-    return checkOperandTypeIsScalarInt(i, 0) &
+    return checkOperandTypeIsInt(i, 0, allowVectors) &
            checkOperandsHaveSameType(i, 1, 2);
   }
   // Integer arithmetic, logical and shifting
@@ -111,18 +143,20 @@ bool checkInstruction(const Instruction *i) {
   case Instruction::Shl:
   case Instruction::LShr:
   case Instruction::AShr: {
-    return checkOperandTypeIsScalarInt(i, 0) &
-           checkOperandTypeIsScalarInt(i, 1);
+    return checkOperandTypeIsInt(i, 0, allowVectors) &
+           checkOperandTypeIsInt(i, 1, allowVectors);
   }
   // Integer comparison
   case Instruction::ICmp: {
-    return checkOperandTypeIsScalarIntOrPointer(i, 0) &
-           checkOperandTypeIsScalarIntOrPointer(i, 1);
+    return checkOperandTypeIsIntOrPointer(i, 0, allowVectors) &
+           checkOperandTypeIsIntOrPointer(i, 1, allowVectors);
   }
   // Integer Conversion
   case Instruction::Trunc:
   case Instruction::ZExt:
-  case Instruction::SExt:
+  case Instruction::SExt: {
+    return checkOperandTypeIsInt(i, 0, allowVectors);
+  }
   case Instruction::IntToPtr: {
     return checkOperandTypeIsScalarInt(i, 0);
   }
@@ -173,7 +207,7 @@ bool InstructionOperandTypeCheckPass::runOnModule(Module &M) {
       for (BasicBlock::iterator ii = bi->begin(), ie = bi->end(); ii != ie;
            ++ii) {
         Instruction *i = &*ii;
-        instructionOperandsConform &= checkInstruction(i);
+        instructionOperandsConform &= checkInstruction(i, allowVectorOperands);
       }
     }
   }
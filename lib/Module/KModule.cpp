@@ -11,6 +11,7 @@
 
 #include "Passes.h"
 
+#include "klee/Config/config.h"
 #include "klee/Config/Version.h"
 #include "klee/Core/Interpreter.h"
 #include "klee/Support/OptionCategories.h"
@@ -23,6 +24,10 @@
 #include "klee/Support/ModuleUtil.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #else
 #include "llvm/Bitcode/ReaderWriter.h"
@@ -31,15 +36,21 @@
 #include "llvm/IR/CallSite.h"
 #endif
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/ValueSymbolTable.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/raw_os_ostream.h"
@@ -110,6 +121,24 @@ namespace {
                              cl::desc("Allow optimization of functions that "
                                       "contain KLEE calls (default=true)"),
                              cl::init(true), cl::cat(ModuleCat));
+
+  cl::opt<std::string> PreparedModuleCacheDir(
+      "prepared-module-cache-dir",
+      cl::desc("Cache fully prepared modules in the given directory, keyed "
+               "by a hash of the input bitcode and preparation options. "
+               "Later runs with identical inputs skip linking, "
+               "instrumentation and optimization (default=off)"),
+      cl::init(""), cl::cat(ModuleCat));
+
+  cl::opt<bool> ScalarizeVectors(
+      "scalarize-vectors",
+      cl::desc("Split vector instructions into per-lane scalar instructions. "
+               "When disabled, the Executor executes integer vector "
+               "arithmetic, comparisons, casts, selects and shuffles "
+               "natively on the packed representation; note that division "
+               "and overshift checks do not cover vector instructions "
+               "(default=true)"),
+      cl::init(true), cl::cat(ModuleCat));
 }
 
 /***/
@@ -218,15 +247,131 @@ bool KModule::link(std::vector<std::unique_ptr<llvm::Module>> &modules,
   // Add the currently active module to the list of linkables
   modules.push_back(std::move(module));
   std::string error;
+  bool linkedSomething = false;
   module = std::unique_ptr<llvm::Module>(
-      klee::linkModules(modules, entryPoint, error));
+      klee::linkModules(modules, entryPoint, error, &linkedSomething));
   if (!module)
     klee_error("Could not link KLEE files %s", error.c_str());
 
   targetData = std::unique_ptr<llvm::DataLayout>(new DataLayout(module.get()));
 
-  // Check if we linked anything
-  return modules.size() != numRemainingModules;
+  // Check if we linked anything. With -link-only-needed, definitions can be
+  // imported without consuming a module, so the size check alone is not
+  // enough.
+  return linkedSomething || modules.size() != numRemainingModules;
+}
+
+/// Compute a stable key identifying the given input modules and
+/// preparation options. Serializing the inputs to hash them costs a
+/// small fraction of the pass pipeline a cache hit lets us skip.
+static std::string computePreparedModuleKey(
+    const std::vector<std::unique_ptr<llvm::Module>> &modules,
+    const Interpreter::ModuleOptions &opts) {
+  SmallVector<char, 0> buffer;
+  raw_svector_ostream os(buffer);
+  for (const auto &m : modules)
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+    WriteBitcodeToFile(*m, os);
+#else
+    WriteBitcodeToFile(m.get(), os);
+#endif
+  os << opts.LibraryDir << '\0' << opts.EntryPoint << '\0' << opts.OptSuffix
+     << '\0' << opts.Optimize << opts.CheckDivZero << opts.CheckOvershift
+     << '\0' << PACKAGE_STRING << '\0' << LLVM_VERSION_STRING;
+
+  MD5 hash;
+  MD5::MD5Result result;
+  hash.update(llvm::StringRef(buffer.data(), buffer.size()));
+  hash.final(result);
+  return std::string(result.digest().str());
+}
+
+bool KModule::loadCachedModule(
+    std::vector<std::unique_ptr<llvm::Module>> &modules,
+    const Interpreter::ModuleOptions &opts) {
+  if (PreparedModuleCacheDir.empty())
+    return false;
+
+  SmallString<128> path(PreparedModuleCacheDir);
+  llvm::sys::path::append(path,
+                          computePreparedModuleKey(modules, opts) + ".bc");
+
+  auto bufferOrErr = MemoryBuffer::getFile(path);
+  if (!bufferOrErr) {
+    preparedModuleCacheFile = std::string(path.str());
+    return false;
+  }
+
+  auto moduleOrErr = parseBitcodeFile((*bufferOrErr)->getMemBufferRef(),
+                                      modules[0]->getContext());
+  if (!moduleOrErr) {
+    llvm::consumeError(moduleOrErr.takeError());
+    klee_warning("ignoring unreadable prepared-module cache entry %s",
+                 path.c_str());
+    preparedModuleCacheFile = std::string(path.str());
+    return false;
+  }
+
+  module = std::move(*moduleOrErr);
+  targetData = std::unique_ptr<llvm::DataLayout>(new DataLayout(module.get()));
+  modules.clear();
+  klee_message("using prepared module %s", path.c_str());
+  return true;
+}
+
+void KModule::cachePreparedModule() {
+  if (preparedModuleCacheFile.empty())
+    return;
+
+  if (auto ec = llvm::sys::fs::create_directories(
+          llvm::sys::path::parent_path(preparedModuleCacheFile))) {
+    klee_warning("cannot create prepared-module cache directory: %s",
+                 ec.message().c_str());
+    return;
+  }
+
+  // Write to a temporary file and rename it into place so concurrent
+  // runs never observe a partial entry.
+  int fd;
+  SmallString<128> tmpPath;
+  if (llvm::sys::fs::createUniqueFile(preparedModuleCacheFile + ".tmp-%%%%%%",
+                                      fd, tmpPath)) {
+    klee_warning("cannot write prepared-module cache entry %s",
+                 preparedModuleCacheFile.c_str());
+    return;
+  }
+  {
+    raw_fd_ostream os(fd, /*shouldClose=*/true);
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+    WriteBitcodeToFile(*module, os);
+#else
+    WriteBitcodeToFile(module.get(), os);
+#endif
+  }
+  if (llvm::sys::fs::rename(tmpPath, preparedModuleCacheFile)) {
+    klee_warning("cannot write prepared-module cache entry %s",
+                 preparedModuleCacheFile.c_str());
+    llvm::sys::fs::remove(tmpPath);
+  }
+}
+
+const std::string &KModule::getModuleHash() {
+  if (!moduleHash.empty())
+    return moduleHash;
+
+  SmallVector<char, 0> buffer;
+  raw_svector_ostream os(buffer);
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+  WriteBitcodeToFile(*module, os);
+#else
+  WriteBitcodeToFile(module.get(), os);
+#endif
+  MD5 hash;
+  MD5::MD5Result result;
+  hash.update(llvm::StringRef(buffer.data(), buffer.size()));
+  hash.final(result);
+  moduleHash = std::string(result.digest().str());
+  return moduleHash;
 }
 
 void KModule::instrument(const Interpreter::ModuleOptions &opts) {
@@ -243,7 +388,8 @@ void KModule::instrument(const Interpreter::ModuleOptions &opts) {
   //
   // NOTE: Must come before division/overshift checks because those passes
   // don't know how to handle vector instructions.
-  pm.add(createScalarizerPass());
+  if (ScalarizeVectors)
+    pm.add(createScalarizerPass());
 
   // This pass will replace atomic instructions with non-atomic operations
   pm.add(createLowerAtomicPass());
@@ -293,7 +439,8 @@ void KModule::optimiseAndPrepare(
   default: klee_error("invalid --switch-type");
   }
   pm3.add(new IntrinsicCleanerPass(*targetData));
-  pm3.add(createScalarizerPass());
+  if (ScalarizeVectors)
+    pm3.add(createScalarizerPass());
   pm3.add(new PhiCleanerPass());
   pm3.add(new FunctionAliasPass());
   pm3.run(*module);
@@ -330,10 +477,9 @@ void KModule::manifest(InterpreterHandler *ih, bool forceSourceOutput) {
 
     auto kf = std::unique_ptr<KFunction>(new KFunction(&Function, this));
 
-    for (unsigned i=0; i<kf->numInstructions; ++i) {
-      KInstruction *ki = kf->instructions[i];
-      ki->info = &infos->getInfo(*ki->inst);
-    }
+    // The debug information of the instructions is assigned lazily on
+    // first entry (\see materializeDebugInfo()), so that functions which
+    // are never executed do not pay for the extraction.
 
     functionMap.insert(std::make_pair(&Function, kf.get()));
     functions.push_back(std::move(kf));
@@ -362,9 +508,25 @@ void KModule::manifest(InterpreterHandler *ih, bool forceSourceOutput) {
   }
 }
 
+void KModule::materializeDebugInfo(KFunction *kf) {
+  if (kf->debugInfoMaterialized.load(std::memory_order_acquire))
+    return;
+
+  std::lock_guard<std::mutex> guard(debugInfoMutex);
+  if (kf->debugInfoMaterialized.load(std::memory_order_relaxed))
+    return;
+
+  for (unsigned i = 0; i < kf->numInstructions; ++i) {
+    KInstruction *ki = kf->instructions[i];
+    ki->info = &infos->getInfo(*ki->inst);
+  }
+  kf->debugInfoMaterialized.store(true, std::memory_order_release);
+}
+
 void KModule::checkModule() {
   InstructionOperandTypeCheckPass *operandTypeCheckPass =
-      new InstructionOperandTypeCheckPass();
+      new InstructionOperandTypeCheckPass(/*allowVectorOperands=*/
+                                          !ScalarizeVectors);
 
   legacy::PassManager pm;
   if (!DontVerify)
@@ -426,18 +588,205 @@ static int getOperandNum(Value *v,
   }
 }
 
+/// A pure leaf computes its result from its arguments and loads from
+/// constant globals alone: no calls, stores, allocas or other
+/// side-effecting instructions. Its return value can then be memoized
+/// per argument tuple (see -use-function-summaries).
+static bool computePureLeaf(llvm::Function *function) {
+  if (function->isDeclaration() || function->isVarArg() ||
+      function->getReturnType()->isVoidTy())
+    return false;
+
+  for (const auto &bb : *function) {
+    for (const auto &inst : bb) {
+      if (inst.isBinaryOp() || inst.isCast())
+        continue;
+
+      switch (inst.getOpcode()) {
+      case Instruction::ICmp:
+      case Instruction::FCmp:
+      case Instruction::Select:
+      case Instruction::PHI:
+      case Instruction::Br:
+      case Instruction::Switch:
+      case Instruction::Ret:
+      case Instruction::GetElementPtr:
+        break;
+
+      case Instruction::Load: {
+        const auto *li = cast<LoadInst>(&inst);
+        if (!li->isSimple())
+          return false;
+
+        const Value *p = li->getPointerOperand();
+        while (true) {
+          if (const auto *gep = dyn_cast<GEPOperator>(p))
+            p = gep->getPointerOperand();
+          else if (const auto *bc = dyn_cast<BitCastOperator>(p))
+            p = bc->getOperand(0);
+          else
+            break;
+        }
+        const auto *gv = dyn_cast<GlobalVariable>(p);
+        if (!gv || !gv->isConstant())
+          return false;
+        break;
+      }
+
+      default:
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Recognize two-block counting loops whose effects have a closed
+/// form (see -summarize-loops): a header of phis ending in
+/// `br (icmp ult/slt i, bound), latch, exit` and a latch containing
+/// nothing but `add` updates of those phis by loop-invariant steps.
+/// The executor can then bind the exit values of the phis directly
+/// instead of unrolling the loop iteration by iteration.
+static void computeLoopSummaries(KFunction *kf) {
+  llvm::Function *function = kf->function;
+  llvm::DominatorTree dt(*function);
+  llvm::LoopInfo li(dt);
+
+  // KInstruction lookup by position within the owning block.
+  auto getKInst = [kf](Instruction *inst) -> KInstruction * {
+    unsigned index = kf->basicBlockEntry[inst->getParent()];
+    for (Instruction &probe : *inst->getParent()) {
+      if (&probe == inst)
+        break;
+      ++index;
+    }
+    return kf->instructions[index];
+  };
+
+  for (llvm::Loop *loop : li.getLoopsInPreorder()) {
+    if (loop->getNumBlocks() != 2)
+      continue;
+    BasicBlock *header = loop->getHeader();
+    BasicBlock *latch = loop->getLoopLatch();
+    BasicBlock *exit = loop->getExitBlock();
+    if (!latch || latch == header || !exit ||
+        exit->getSinglePredecessor() != header)
+      continue;
+
+    auto *bi = dyn_cast<BranchInst>(header->getTerminator());
+    if (!bi || !bi->isConditional() || bi->getSuccessor(0) != latch ||
+        bi->getSuccessor(1) != exit)
+      continue;
+    auto *cmp = dyn_cast<ICmpInst>(bi->getCondition());
+    if (!cmp || cmp->getParent() != header || !cmp->hasOneUse() ||
+        (cmp->getPredicate() != ICmpInst::ICMP_ULT &&
+         cmp->getPredicate() != ICmpInst::ICMP_SLT))
+      continue;
+    auto *indvar = dyn_cast<PHINode>(cmp->getOperand(0));
+    if (!indvar || indvar->getParent() != header ||
+        !indvar->getType()->isIntegerTy() ||
+        !loop->isLoopInvariant(cmp->getOperand(1)))
+      continue;
+    auto *latchBr = dyn_cast<BranchInst>(latch->getTerminator());
+    if (!latchBr || latchBr->isConditional())
+      continue;
+
+    KFunction::KLoopSummary summary;
+    summary.indvar = getKInst(indvar);
+    summary.cmp = getKInst(cmp);
+    summary.boundOperand = 1;
+    summary.isSigned = cmp->getPredicate() == ICmpInst::ICMP_SLT;
+    summary.exit = exit;
+
+    // Every phi must be the induction variable (advancing by exactly
+    // one), left unchanged, or an accumulator advanced by a
+    // loop-invariant step. The adds are remembered so that any other
+    // latch instruction rejects the loop below.
+    llvm::SmallPtrSet<Instruction *, 8> updates;
+    bool supported = true, indvarAdvances = false;
+    for (Instruction &inst : *header) {
+      auto *phi = dyn_cast<PHINode>(&inst);
+      if (!phi) {
+        if (&inst != cmp && &inst != bi)
+          supported = false;
+        continue;
+      }
+      Value *next = phi->getIncomingValueForBlock(latch);
+      if (next == phi)
+        continue;
+      auto *add = dyn_cast<BinaryOperator>(next);
+      if (!add || add->getOpcode() != Instruction::Add ||
+          add->getParent() != latch) {
+        supported = false;
+        break;
+      }
+      unsigned stepOperand = add->getOperand(0) == phi ? 1 : 0;
+      if (add->getOperand(1 - stepOperand) != phi ||
+          !loop->isLoopInvariant(add->getOperand(stepOperand))) {
+        supported = false;
+        break;
+      }
+      if (phi == indvar) {
+        auto *step = dyn_cast<ConstantInt>(add->getOperand(stepOperand));
+        if (!step || !step->isOne()) {
+          supported = false;
+          break;
+        }
+        indvarAdvances = true;
+      } else {
+        summary.accumulators.push_back(
+            {getKInst(phi), getKInst(add), stepOperand});
+      }
+      updates.insert(add);
+    }
+    if (!supported || !indvarAdvances)
+      continue;
+    for (Instruction &inst : *latch) {
+      if (&inst != latchBr && !updates.count(&inst)) {
+        supported = false;
+        break;
+      }
+    }
+    if (!supported)
+      continue;
+
+    kf->loopSummaries[header] = std::move(summary);
+  }
+}
+
 KFunction::KFunction(llvm::Function *_function,
                      KModule *km) 
   : function(_function),
     numArgs(function->arg_size()),
     numInstructions(0),
-    trackCoverage(true) {
+    trackCoverage(true),
+    isPureLeaf(computePureLeaf(_function)) {
   // Assign unique instruction IDs to each basic block
   for (auto &BasicBlock : *function) {
     basicBlockEntry[&BasicBlock] = numInstructions;
     numInstructions += BasicBlock.size();
   }
 
+  if (!function->isDeclaration()) {
+    // Precompute the automatically inferred merge points: the first
+    // instruction of the immediate post-dominator of every block ending
+    // in a conditional branch or switch (see -use-auto-merge).
+    llvm::PostDominatorTree pdt(*function);
+    for (auto &bb : *function) {
+      auto *ti = bb.getTerminator();
+      bool branchy = isa<SwitchInst>(ti);
+      if (auto *bi = dyn_cast<BranchInst>(ti))
+        branchy = bi->isConditional();
+      if (!branchy)
+        continue;
+
+      if (auto *node = pdt.getNode(&bb))
+        if (auto *idom = node->getIDom())
+          if (auto *mergeBB = idom->getBlock())
+            mergePoints[&bb] = &mergeBB->front();
+    }
+  }
+
   instructions = new KInstruction*[numInstructions];
 
   std::map<Instruction*, unsigned> registerMap;
@@ -499,6 +848,75 @@ KFunction::KFunction(llvm::Function *_function,
       instructions[i++] = ki;
     }
   }
+
+  // Recognize the superinstruction pairs that dominate dispatch
+  // overhead: when an instruction's only use is the instruction
+  // immediately following it in the same block, the executor can run
+  // both in one dispatch step. Restricted to a fixed set of hot
+  // patterns -- compare feeding a conditional branch, address
+  // computation feeding a load, arithmetic feeding a store -- whose
+  // first half can neither fork nor terminate the state.
+  for (unsigned j = 0; j + 1 < numInstructions; ++j) {
+    Instruction *inst = instructions[j]->inst;
+    Instruction *next = instructions[j + 1]->inst;
+    if (inst->getParent() != next->getParent() || !inst->hasOneUse() ||
+        inst->user_back() != next)
+      continue;
+
+    if (isa<ICmpInst>(inst)) {
+      if (BranchInst *bi = dyn_cast<BranchInst>(next))
+        instructions[j]->fuseNext =
+            bi->isConditional() && bi->getCondition() == inst;
+    } else if (isa<GetElementPtrInst>(inst)) {
+      if (LoadInst *li = dyn_cast<LoadInst>(next))
+        instructions[j]->fuseNext = li->getPointerOperand() == inst;
+    } else if (inst->getOpcode() == Instruction::Add ||
+               inst->getOpcode() == Instruction::Sub) {
+      if (StoreInst *si = dyn_cast<StoreInst>(next))
+        instructions[j]->fuseNext = si->getValueOperand() == inst;
+    }
+  }
+
+  // Lay out small entry-block allocas of constant size in a single
+  // per-frame region (see -frame-local-allocas). Entry-block allocas
+  // execute exactly once per call, so a fixed per-function layout is
+  // valid for every frame.
+  if (!function->isDeclaration()) {
+    for (auto &inst : function->getEntryBlock()) {
+      AllocaInst *ai = dyn_cast<AllocaInst>(&inst);
+      if (!ai || !ai->getAllocatedType()->isSized())
+        continue;
+      std::uint64_t size =
+          km->targetData->getTypeStoreSize(ai->getAllocatedType());
+      if (ai->isArrayAllocation()) {
+        ConstantInt *count = dyn_cast<ConstantInt>(ai->getArraySize());
+        if (!count)
+          continue;
+        size *= count->getZExtValue();
+      }
+      // Large allocas keep their own object; packing them would grow
+      // every frame's region for little churn saved.
+      if (size == 0 || size > 4096)
+        continue;
+      // Match the per-alloca allocation path, which forces at least
+      // 8-byte alignment (see Executor::getAllocationAlignment).
+      std::uint64_t alignment = std::max<std::uint64_t>(ai->getAlignment(), 8);
+      frameAllocaSize = (frameAllocaSize + alignment - 1) & ~(alignment - 1);
+      frameAllocaOffsets[&inst] = frameAllocaSize;
+      frameAllocaSize += size;
+      frameAllocaAlign = std::max(frameAllocaAlign, alignment);
+    }
+    // A region holding a single alloca saves nothing over the plain
+    // path.
+    if (frameAllocaOffsets.size() < 2) {
+      frameAllocaOffsets.clear();
+      frameAllocaSize = 0;
+      frameAllocaAlign = 0;
+    }
+  }
+
+  if (!function->isDeclaration())
+    computeLoopSummaries(this);
 }
 
 KFunction::~KFunction() {
@@ -26,8 +26,11 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/ValueSymbolTable.h"
+#include "klee/Support/OptionCategories.h"
+
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/Error.h"
 #include "llvm/Object/ObjectFile.h"
@@ -39,6 +42,7 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
 #include <llvm/Bitcode/BitcodeReader.h>
@@ -56,6 +60,16 @@
 using namespace llvm;
 using namespace klee;
 
+namespace {
+cl::opt<bool> LinkOnlyNeededSymbols(
+    "link-only-needed",
+    cl::desc("When resolving dependencies against the runtime libraries, "
+             "link in only the functions and globals a module actually "
+             "references rather than whole archive members; unreferenced "
+             "runtime code is never loaded (default=true)"),
+    cl::init(true), cl::cat(klee::ModuleCat));
+}
+
 /// Based on GetAllUndefinedSymbols() from LLVM3.2
 ///
 /// GetAllUndefinedSymbols - calculates the set of undefined symbols that still
@@ -143,18 +157,22 @@ GetAllUndefinedSymbols(Module *M, std::set<std::string> &UndefinedSymbols) {
 
 static bool linkTwoModules(llvm::Module *Dest,
                            std::unique_ptr<llvm::Module> Src,
-                           std::string &errorMsg) {
+                           std::string &errorMsg,
+                           unsigned Flags = Linker::Flags::None) {
   // Get the potential error message (Src is moved and won't be available later)
   errorMsg = "Linking module " + Src->getModuleIdentifier() + " failed";
-  auto linkResult = Linker::linkModules(*Dest, std::move(Src));
+  auto linkResult = Linker::linkModules(*Dest, std::move(Src), Flags);
 
   return !linkResult;
 }
 
 std::unique_ptr<llvm::Module>
 klee::linkModules(std::vector<std::unique_ptr<llvm::Module>> &modules,
-                  llvm::StringRef entryFunction, std::string &errorMsg) {
+                  llvm::StringRef entryFunction, std::string &errorMsg,
+                  bool *linkedSomething) {
   assert(!modules.empty() && "modules list should not be empty");
+  if (linkedSomething)
+    *linkedSomething = false;
 
   if (entryFunction.empty()) {
     // If no entry function is provided, link all modules together into one
@@ -163,8 +181,11 @@ klee::linkModules(std::vector<std::unique_ptr<llvm::Module>> &modules,
 
     // Just link all modules together
     for (auto &module : modules) {
-      if (linkTwoModules(composite.get(), std::move(module), errorMsg))
+      if (linkTwoModules(composite.get(), std::move(module), errorMsg)) {
+        if (linkedSomething)
+          *linkedSomething = true;
         continue;
+      }
 
       // Linking failed
       errorMsg = "Linking archive module with composite failed:" + errorMsg;
@@ -224,13 +245,25 @@ klee::linkModules(std::vector<std::unique_ptr<llvm::Module>> &modules,
       return nullptr;
     }
     module = nullptr;
+    if (linkedSomething)
+      *linkedSomething = true;
   }
 
   bool symbolsLinked = true;
+  std::set<std::string> previousUndefinedSymbols;
   while (symbolsLinked) {
     symbolsLinked = false;
     std::set<std::string> undefinedSymbols;
     GetAllUndefinedSymbols(composite.get(), undefinedSymbols);
+
+    // With -link-only-needed the members stay in the list, so a shrinking
+    // undefined set is the only measure of progress; stop if a round left
+    // it untouched (e.g. the linker declined to import a definition).
+    if (LinkOnlyNeededSymbols) {
+      if (undefinedSymbols == previousUndefinedSymbols)
+        break;
+      previousUndefinedSymbols = undefinedSymbols;
+    }
     auto hasRequiredDefinition = [&undefinedSymbols](
                                      const llvm::Module *module) {
       for (auto symbol : undefinedSymbols) {
@@ -257,13 +290,32 @@ klee::linkModules(std::vector<std::unique_ptr<llvm::Module>> &modules,
       if (!hasRequiredDefinition(module.get()))
         continue;
 
-      if (!linkTwoModules(composite.get(), std::move(module), errorMsg)) {
-        // Linking failed
-        errorMsg = "Linking archive module with composite failed:" + errorMsg;
-        return nullptr;
+      if (LinkOnlyNeededSymbols) {
+        // Import just the referenced definitions from a clone and keep the
+        // member around: a later round (or a later link() call after
+        // instrumentation) may need other functions from it.
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+        auto clone = CloneModule(*module);
+#else
+        auto clone = CloneModule(module.get());
+#endif
+        if (!linkTwoModules(composite.get(), std::move(clone), errorMsg,
+                            Linker::Flags::LinkOnlyNeeded)) {
+          // Linking failed
+          errorMsg = "Linking archive module with composite failed:" + errorMsg;
+          return nullptr;
+        }
+      } else {
+        if (!linkTwoModules(composite.get(), std::move(module), errorMsg)) {
+          // Linking failed
+          errorMsg = "Linking archive module with composite failed:" + errorMsg;
+          return nullptr;
+        }
+        module = nullptr;
       }
-      module = nullptr;
       symbolsLinked = true;
+      if (linkedSomething)
+        *linkedSomething = true;
     }
   }
 
@@ -16,15 +16,22 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Config/Version.h"
+#include "klee/Support/ErrorHandling.h"
 #include "klee/Support/OptionCategories.h"
+#include "klee/Support/Timer.h"
 
 #ifdef USE_WORKAROUND_LLVM_PR39177
 #include "Passes.h"
 #endif
 
+#include "llvm/Analysis/CFG.h"
 #include "llvm/Analysis/GlobalsModRef.h"
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Analysis/LoopPass.h"
+#if LLVM_VERSION_CODE < LLVM_VERSION(8, 0)
+#include "llvm/IR/CallSite.h"
+#endif
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -83,6 +90,14 @@ static cl::opt<bool>
 static cl::alias A1("S", cl::desc("Alias for --strip-debug"),
                     cl::aliasopt(StripDebug));
 
+static cl::opt<bool> PruneOptimizationPasses(
+    "prune-optimization-passes",
+    cl::desc("Skip optimization passes whose prerequisites are absent from "
+             "the module, e.g. the inliner when no calls to defined functions "
+             "remain. Cuts preparation time for pre-optimized bitcode "
+             "(default=false)"),
+    cl::init(false), cl::cat(klee::ModuleCat));
+
 // A utility function that adds a pass to the pass manager but will also add
 // a verifier pass after if we're supposed to verify.
 static inline void addPass(legacy::PassManager &PM, Pass *P) {
@@ -94,10 +109,67 @@ static inline void addPass(legacy::PassManager &PM, Pass *P) {
     PM.add(createVerifierPass());
 }
 
+// Cheap structural facts about the module, used with
+// -prune-optimization-passes to drop passes that cannot find anything to
+// do. The defaults assume every pass has work, which keeps the pipeline
+// unchanged when no scan is performed.
+namespace {
+struct ModuleFeatures {
+  bool hasAllocas = true;         // mem2reg / SROA have work
+  bool hasCallsToDefined = true;  // inliner / argpromotion have work
+  bool hasMemIntrinsics = true;   // memcpyopt has work
+  bool hasLoops = true;           // the loop passes have work
+};
+} // namespace
+
+static ModuleFeatures scanModuleFeatures(const Module *M) {
+  ModuleFeatures F;
+  F.hasAllocas = F.hasCallsToDefined = F.hasMemIntrinsics = F.hasLoops =
+      false;
+
+  for (const Function &f : *M) {
+    if (f.isDeclaration())
+      continue;
+
+    if (!F.hasLoops) {
+      SmallVector<std::pair<const BasicBlock *, const BasicBlock *>, 8>
+          backEdges;
+      FindFunctionBackedges(f, backEdges);
+      F.hasLoops = !backEdges.empty();
+    }
+
+    for (const BasicBlock &bb : f) {
+      for (const Instruction &i : bb) {
+        if (isa<AllocaInst>(i)) {
+          F.hasAllocas = true;
+        } else if (isa<MemIntrinsic>(i)) {
+          F.hasMemIntrinsics = true;
+        } else if (isa<CallInst>(i) || isa<InvokeInst>(i)) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(8, 0)
+          const Function *callee = cast<CallBase>(i).getCalledFunction();
+#else
+          const Function *callee =
+              ImmutableCallSite(&i).getCalledFunction();
+#endif
+          if (callee && !callee->isDeclaration())
+            F.hasCallsToDefined = true;
+        }
+      }
+    }
+
+    if (F.hasAllocas && F.hasCallsToDefined && F.hasMemIntrinsics &&
+        F.hasLoops)
+      break;
+  }
+
+  return F;
+}
+
 namespace llvm {
 
 
-static void AddStandardCompilePasses(legacy::PassManager &PM) {
+static void AddStandardCompilePasses(legacy::PassManager &PM,
+                                     const ModuleFeatures &MF) {
   PM.add(createVerifierPass());                  // Verify that input is correct
 
   // If the -strip-debug command line option was specified, do it.
@@ -105,7 +177,8 @@ static void AddStandardCompilePasses(legacy::PassManager &PM) {
     addPass(PM, createStripSymbolsPass(true));
 
   addPass(PM, createCFGSimplificationPass());    // Clean up disgusting code
-  addPass(PM, createPromoteMemoryToRegisterPass());// Kill useless allocas
+  if (MF.hasAllocas)
+    addPass(PM, createPromoteMemoryToRegisterPass());// Kill useless allocas
   addPass(PM, createGlobalOptimizerPass());      // Optimize out global vars
   addPass(PM, createGlobalDCEPass());            // Remove unused fns and globs
 #if LLVM_VERSION_CODE >= LLVM_VERSION(11, 0)
@@ -125,34 +198,41 @@ static void AddStandardCompilePasses(legacy::PassManager &PM) {
 #endif
   addPass(PM, createReversePostOrderFunctionAttrsPass()); // Deduce function attrs
 
-  if (!DisableInline)
+  if (!DisableInline && MF.hasCallsToDefined)
     addPass(PM, createFunctionInliningPass());   // Inline small functions
-  addPass(PM, createArgumentPromotionPass());    // Scalarize uninlined fn args
+  if (MF.hasCallsToDefined)
+    addPass(PM, createArgumentPromotionPass());  // Scalarize uninlined fn args
 
   addPass(PM, createInstructionCombiningPass()); // Cleanup for scalarrepl.
   addPass(PM, createJumpThreadingPass());        // Thread jumps.
   addPass(PM, createCFGSimplificationPass());    // Merge & remove BBs
+  if (MF.hasAllocas) {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
-  addPass(PM, createSROAPass());                 // Break up aggregate allocas
+    addPass(PM, createSROAPass());               // Break up aggregate allocas
 #else
-  addPass(PM, createScalarReplAggregatesPass()); // Break up aggregate allocas
+    addPass(PM, createScalarReplAggregatesPass()); // Break up aggregate allocas
 #endif
+  }
   addPass(PM, createInstructionCombiningPass()); // Combine silly seq's
 
-  addPass(PM, createTailCallEliminationPass());  // Eliminate tail calls
+  if (MF.hasCallsToDefined)
+    addPass(PM, createTailCallEliminationPass());// Eliminate tail calls
   addPass(PM, createCFGSimplificationPass());    // Merge & remove BBs
   addPass(PM, createReassociatePass());          // Reassociate expressions
-  addPass(PM, createLoopRotatePass());
-  addPass(PM, createLICMPass());                 // Hoist loop invariants
-  addPass(PM, createLoopUnswitchPass());         // Unswitch loops.
-  // FIXME : Removing instcombine causes nestedloop regression.
-  addPass(PM, createInstructionCombiningPass());
-  addPass(PM, createIndVarSimplifyPass());       // Canonicalize indvars
-  addPass(PM, createLoopDeletionPass());         // Delete dead loops
-  addPass(PM, createLoopUnrollPass());           // Unroll small loops
-  addPass(PM, createInstructionCombiningPass()); // Clean up after the unroller
+  if (MF.hasLoops) {
+    addPass(PM, createLoopRotatePass());
+    addPass(PM, createLICMPass());               // Hoist loop invariants
+    addPass(PM, createLoopUnswitchPass());       // Unswitch loops.
+    // FIXME : Removing instcombine causes nestedloop regression.
+    addPass(PM, createInstructionCombiningPass());
+    addPass(PM, createIndVarSimplifyPass());     // Canonicalize indvars
+    addPass(PM, createLoopDeletionPass());       // Delete dead loops
+    addPass(PM, createLoopUnrollPass());         // Unroll small loops
+    addPass(PM, createInstructionCombiningPass()); // Clean up after the unroller
+  }
   addPass(PM, createGVNPass());                  // Remove redundancies
-  addPass(PM, createMemCpyOptPass());            // Remove memcpy / form memset
+  if (MF.hasMemIntrinsics)
+    addPass(PM, createMemCpyOptPass());          // Remove memcpy / form memset
   addPass(PM, createSCCPPass());                 // Constant prop with SCCP
 
   // Run instcombine after redundancy elimination to exploit opportunities
@@ -182,8 +262,14 @@ void Optimize(Module *M, llvm::ArrayRef<const char *> preservedFunctions) {
   addPass(Passes, new klee::WorkaroundLLVMPR39177Pass());
 #endif
 
+  // Decide which passes can be skipped. Without -prune-optimization-passes
+  // the defaults keep every pass in and the pipeline is unchanged.
+  ModuleFeatures MF;
+  if (PruneOptimizationPasses)
+    MF = scanModuleFeatures(M);
+
   // DWD - Run the opt standard pass list as well.
-  AddStandardCompilePasses(Passes);
+  AddStandardCompilePasses(Passes, MF);
 
   // Now that composite has been compiled, scan through the module, looking
   // for a main function.  If main is defined, mark all other functions
@@ -227,7 +313,7 @@ void Optimize(Module *M, llvm::ArrayRef<const char *> preservedFunctions) {
   // calls, etc, so let instcombine do this.
   addPass(Passes, createInstructionCombiningPass());
 
-  if (!DisableInline)
+  if (!DisableInline && MF.hasCallsToDefined)
     addPass(Passes, createFunctionInliningPass()); // Inline small functions
 
   addPass(Passes, createPruneEHPass());         // Remove dead EH info
@@ -236,16 +322,19 @@ void Optimize(Module *M, llvm::ArrayRef<const char *> preservedFunctions) {
 
   // If we didn't decide to inline a function, check to see if we can
   // transform it to pass arguments by value instead of by reference.
-  addPass(Passes, createArgumentPromotionPass());
+  if (MF.hasCallsToDefined)
+    addPass(Passes, createArgumentPromotionPass());
 
   // The IPO passes may leave cruft around.  Clean up after them.
   addPass(Passes, createInstructionCombiningPass());
   addPass(Passes, createJumpThreadingPass()); // Thread jumps.
+  if (MF.hasAllocas) {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
-  addPass(Passes, createSROAPass()); // Break up allocas
+    addPass(Passes, createSROAPass()); // Break up allocas
 #else
-  addPass(Passes, createScalarReplAggregatesPass()); // Break up allocas
+    addPass(Passes, createScalarReplAggregatesPass()); // Break up allocas
 #endif
+  }
 
   // Run a few AA driven optimizations here and now, to cleanup the code.
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
@@ -256,16 +345,19 @@ void Optimize(Module *M, llvm::ArrayRef<const char *> preservedFunctions) {
   addPass(Passes, createReversePostOrderFunctionAttrsPass()); // Add nocapture
   addPass(Passes, createGlobalsAAWrapperPass()); // IP alias analysis
 
-  addPass(Passes, createLICMPass());                 // Hoist loop invariants
+  if (MF.hasLoops)
+    addPass(Passes, createLICMPass());               // Hoist loop invariants
   addPass(Passes, createGVNPass());                  // Remove redundancies
-  addPass(Passes, createMemCpyOptPass());            // Remove dead memcpy's
+  if (MF.hasMemIntrinsics)
+    addPass(Passes, createMemCpyOptPass());          // Remove dead memcpy's
   addPass(Passes, createDeadStoreEliminationPass()); // Nuke dead stores
 
   // Cleanup and simplify the code after the scalar optimizations.
   addPass(Passes, createInstructionCombiningPass());
 
   addPass(Passes, createJumpThreadingPass());           // Thread jumps.
-  addPass(Passes, createPromoteMemoryToRegisterPass()); // Cleanup jumpthread.
+  if (MF.hasAllocas)
+    addPass(Passes, createPromoteMemoryToRegisterPass()); // Cleanup jumpthread.
 
   // Delete basic blocks, which optimization passes may have killed...
   addPass(Passes, createCFGSimplificationPass());
@@ -286,6 +378,13 @@ void Optimize(Module *M, llvm::ArrayRef<const char *> preservedFunctions) {
   addPass(Passes, createGlobalDCEPass());
 
   // Run our queue of passes all at once now, efficiently.
+  klee::WallTimer timer;
   Passes.run(*M);
+  if (PruneOptimizationPasses)
+    klee::klee_message(
+        "optimizer: ran pipeline in %.3fs (skipped:%s%s%s%s)",
+        timer.delta().toSeconds(), MF.hasAllocas ? "" : " mem2reg/sroa",
+        MF.hasCallsToDefined ? "" : " inliner", MF.hasLoops ? "" : " loops",
+        MF.hasMemIntrinsics ? "" : " memcpyopt");
 }
 }
@@ -158,11 +158,15 @@ private:
 class InstructionOperandTypeCheckPass : public llvm::ModulePass {
 private:
   bool instructionOperandsConform;
+  /// Accept integer vector operands where the Executor supports them
+  /// natively (i.e. when the Scalarizer pass is disabled).
+  bool allowVectorOperands;
 
 public:
   static char ID;
-  InstructionOperandTypeCheckPass()
-      : llvm::ModulePass(ID), instructionOperandsConform(true) {}
+  InstructionOperandTypeCheckPass(bool allowVectorOperands = false)
+      : llvm::ModulePass(ID), instructionOperandsConform(true),
+        allowVectorOperands(allowVectorOperands) {}
   bool runOnModule(llvm::Module &M) override;
   bool checkPassed() const { return instructionOperandsConform; }
 };
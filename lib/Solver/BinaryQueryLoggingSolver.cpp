@@ -0,0 +1,138 @@
+//===-- BinaryQueryLoggingSolver.cpp --------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryLoggingSolver.h"
+
+#include "klee/Expr/ExprBinaryLog.h"
+#include "klee/Statistics/Statistics.h"
+#include "klee/System/Time.h"
+
+#include <cstring>
+
+using namespace klee;
+
+/// This QueryLoggingSolver logs queries in the compact binary query-log
+/// format (see ExprBinaryLog.h) and passes them down to the underlying
+/// solver. Queries are buffered like in the textual loggers; the
+/// writer's transaction interface keeps the persistent id tables
+/// consistent when a buffered query is discarded because it finished
+/// below the -min-query-time-to-log threshold.
+class BinaryQueryLoggingSolver : public QueryLoggingSolver {
+
+private:
+  binlog::Writer writer;
+  std::vector<ref<Expr> > evalExprs;
+
+  static binlog::QueryType queryType(const char *typeName) {
+    if (0 == strcmp(typeName, "Truth"))
+      return binlog::QueryTruth;
+    if (0 == strcmp(typeName, "Validity"))
+      return binlog::QueryValidity;
+    if (0 == strcmp(typeName, "Value"))
+      return binlog::QueryValue;
+    return binlog::QueryInitialValues;
+  }
+
+  void startQuery(const Query &query, const char *typeName,
+                  const Query *falseQuery = 0,
+                  const std::vector<const Array *> *objects = 0) override {
+    Statistic *S = theStatisticManager->getStatisticByName("Instructions");
+    uint64_t instructions = S ? S->getValue() : 0;
+    ++queryCount;
+
+    writer.beginQuery();
+    const Query *q = (0 == falseQuery) ? &query : falseQuery;
+    evalExprs.clear();
+    if (0 != falseQuery)
+      evalExprs.push_back(query.expr);
+    writer.writeQuery(queryType(typeName), instructions, *q,
+                      falseQuery ? &evalExprs : 0, objects);
+
+    startTime = time::getWallTime();
+  }
+
+  void finishQuery(bool success) override {
+    lastQueryDuration = time::getWallTime() - startTime;
+    writer.writeResult(success, lastQueryDuration.toMicroseconds());
+  }
+
+  void flushBufferConditionally(bool writeToFile) override {
+    // Discarded buffers must not leave the id tables referring to
+    // definition records that were never written.
+    if (writeToFile)
+      writer.commit();
+    else
+      writer.rollback();
+    QueryLoggingSolver::flushBufferConditionally(writeToFile);
+  }
+
+  void printQuery(const Query &query, const Query *falseQuery = 0,
+                  const std::vector<const Array *> *objects = 0) override {
+    // Unused; startQuery() writes the binary records directly.
+  }
+
+public:
+  BinaryQueryLoggingSolver(Solver *_solver, std::string path,
+                           time::Span queryTimeToLog, bool logTimedOut)
+      : QueryLoggingSolver(_solver, path, "", queryTimeToLog, logTimedOut),
+        writer(logBuffer) {
+    binlog::Writer::writeMagic(*os);
+  }
+
+  // The base class implementations append the solver's response to the
+  // buffer as commented text, which has no place in a binary stream, so
+  // the forwarding is repeated here without the text epilogue.
+
+  bool computeTruth(const Query &query, bool &isValid) override {
+    startQuery(query, "Truth");
+    bool success = solver->impl->computeTruth(query, isValid);
+    finishQuery(success);
+    flushBuffer();
+    return success;
+  }
+
+  bool computeValidity(const Query &query, Solver::Validity &result) override {
+    startQuery(query, "Validity");
+    bool success = solver->impl->computeValidity(query, result);
+    finishQuery(success);
+    flushBuffer();
+    return success;
+  }
+
+  bool computeValue(const Query &query, ref<Expr> &result) override {
+    Query withFalse = query.withFalse();
+    startQuery(query, "Value", &withFalse);
+    bool success = solver->impl->computeValue(query, result);
+    finishQuery(success);
+    flushBuffer();
+    return success;
+  }
+
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) override {
+    startQuery(query, "InitialValues", 0, &objects);
+    bool success =
+        solver->impl->computeInitialValues(query, objects, values, hasSolution);
+    finishQuery(success);
+    flushBuffer();
+    return success;
+  }
+};
+
+///
+
+Solver *klee::createBinaryQueryLoggingSolver(Solver *_solver, std::string path,
+                                             time::Span minQueryTimeToLog,
+                                             bool logTimedOut) {
+  return new Solver(new BinaryQueryLoggingSolver(_solver, path,
+                                                 minQueryTimeToLog,
+                                                 logTimedOut));
+}
@@ -0,0 +1,91 @@
+//===-- CacheTuner.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CacheTuner.h"
+
+#include "klee/Support/OptionCategories.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+llvm::cl::opt<bool> AutotuneCaches(
+    "solver-cache-autotune", llvm::cl::init(false),
+    llvm::cl::desc("Bypass solver cache layers whose measured overhead "
+                   "exceeds the time their hits save, probing them "
+                   "periodically so they can re-enable (default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> AutotuneWindow(
+    "solver-cache-autotune-window", llvm::cl::init(1024),
+    llvm::cl::desc("Number of consulted queries per cost/benefit evaluation "
+                   "window for -solver-cache-autotune (default=1024)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> AutotuneProbeInterval(
+    "solver-cache-autotune-probe-interval", llvm::cl::init(16),
+    llvm::cl::desc("While a cache layer is bypassed, still consult it for "
+                   "every Nth query so a phase where it pays off again "
+                   "re-enables it (default=16)"),
+    llvm::cl::cat(klee::SolvingCat));
+} // namespace
+
+bool CacheLayerTuner::shouldConsult() {
+  if (!AutotuneCaches)
+    return true;
+  ++queryCount;
+  if (!bypassed)
+    return true;
+  return AutotuneProbeInterval && queryCount % AutotuneProbeInterval == 0;
+}
+
+void CacheLayerTuner::updatePassThrough(time::Span passThrough) {
+  const std::uint64_t us = passThrough.toMicroseconds();
+  avgPassThroughUs = avgPassThroughUs ? (avgPassThroughUs * 7 + us) / 8 : us;
+}
+
+void CacheLayerTuner::recordHit(time::Span overhead) {
+  ++windowLookups;
+  const std::uint64_t us = overhead.toMicroseconds();
+  windowOverheadUs += us;
+  if (avgPassThroughUs > us) {
+    const std::uint64_t saved = avgPassThroughUs - us;
+    windowSavedUs += saved;
+    savedTime += saved;
+  }
+  closeWindowIfDue();
+}
+
+void CacheLayerTuner::recordMiss(time::Span overhead, time::Span passThrough) {
+  ++windowLookups;
+  windowOverheadUs += overhead.toMicroseconds();
+  updatePassThrough(passThrough);
+  closeWindowIfDue();
+}
+
+void CacheLayerTuner::recordBypassed(time::Span passThrough) {
+  updatePassThrough(passThrough);
+}
+
+void CacheLayerTuner::closeWindowIfDue() {
+  if (!AutotuneCaches)
+    return;
+  // While bypassed only probes reach the window, so it is shortened to
+  // keep the re-evaluation latency in the same order as when active.
+  std::uint64_t target = AutotuneWindow;
+  if (bypassed && AutotuneProbeInterval)
+    target = std::max<std::uint64_t>(target / AutotuneProbeInterval, 64);
+  if (windowLookups < target)
+    return;
+  bypassed = windowSavedUs < windowOverheadUs;
+  windowLookups = windowOverheadUs = windowSavedUs = 0;
+}
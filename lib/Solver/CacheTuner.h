@@ -0,0 +1,64 @@
+//===-- CacheTuner.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CACHETUNER_H
+#define KLEE_CACHETUNER_H
+
+#include "klee/Statistics/Statistic.h"
+#include "klee/System/Time.h"
+
+#include <cstdint>
+
+namespace klee {
+
+/// Windowed cost/benefit controller for one solver cache layer
+/// (-solver-cache-autotune). Each consulted query reports the time the
+/// layer itself spent (lookup and insertion) and, on a miss, the
+/// measured cost of passing through to the layers below. When a window
+/// closes with the layer's own time exceeding the time its hits saved
+/// -- each hit valued at the average observed pass-through cost -- the
+/// layer is bypassed; a fraction of later queries still probe it, so a
+/// workload phase where the cache pays for itself again re-enables it.
+/// The per-layer accounting feeds run.stats whether or not the
+/// controller itself is enabled.
+class CacheLayerTuner {
+public:
+  /// \param savedTime credited with the estimated time the layer's hits
+  /// saved, in microseconds.
+  explicit CacheLayerTuner(Statistic &savedTime) : savedTime(savedTime) {}
+
+  /// False when the layer should pass the current query straight
+  /// through to the underlying solver.
+  bool shouldConsult();
+
+  void recordHit(time::Span overhead);
+  void recordMiss(time::Span overhead, time::Span passThrough);
+
+  /// Pass-through cost of a bypassed query; keeps the average that the
+  /// benefit estimate uses current while the cache is not consulted.
+  void recordBypassed(time::Span passThrough);
+
+private:
+  void updatePassThrough(time::Span passThrough);
+  void closeWindowIfDue();
+
+  Statistic &savedTime;
+  bool bypassed = false;
+  std::uint64_t queryCount = 0;
+  /// Exponential moving average of pass-through cost in microseconds.
+  std::uint64_t avgPassThroughUs = 0;
+  // Current evaluation window.
+  std::uint64_t windowLookups = 0;
+  std::uint64_t windowOverheadUs = 0;
+  std::uint64_t windowSavedUs = 0;
+};
+
+} // namespace klee
+
+#endif /* KLEE_CACHETUNER_H */
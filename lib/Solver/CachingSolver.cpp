@@ -10,16 +10,32 @@
 
 #include "klee/Solver/Solver.h"
 
+#include "CacheTuner.h"
+
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/IncompleteSolver.h"
 #include "klee/Solver/SolverImpl.h"
 #include "klee/Solver/SolverStats.h"
+#include "klee/Support/OptionCategories.h"
+#include "klee/Support/Timer.h"
+
+#include "llvm/Support/CommandLine.h"
 
+#include <list>
 #include <unordered_map>
 
 using namespace klee;
 
+namespace {
+llvm::cl::opt<unsigned> QueryCacheBudget(
+    "query-cache-budget",
+    llvm::cl::desc("Approximate memory budget for the validity query cache "
+                   "in MiB. The least recently used entries are evicted once "
+                   "the budget is exceeded; 0 means unbounded (default=256)"),
+    llvm::cl::init(256), llvm::cl::cat(klee::SolvingCat));
+} // namespace
+
 class CachingSolver : public SolverImpl {
 private:
   ref<Expr> canonicalizeQuery(ref<Expr> originalQuery,
@@ -30,7 +46,9 @@ private:
 
   bool cacheLookup(const Query& query,
                    IncompleteSolver::PartialValidity &result);
-  
+
+  void cacheEvict();
+
   struct CacheEntry {
     CacheEntry(const ConstraintSet &c, ref<Expr> q)
         : constraints(c), query(q) {}
@@ -48,22 +66,56 @@ private:
 
   struct CacheEntryHash {
     unsigned operator()(const CacheEntry &ce) const {
-      unsigned result = ce.query->hash();
+      // The constraint-set hash is maintained incrementally as
+      // constraints are appended, so no per-lookup walk of the set.
+      return static_cast<unsigned>(ce.constraints.hash()) ^ ce.query->hash();
+    }
+  };
 
-      for (auto const &constraint : ce.constraints) {
-        result ^= constraint->hash();
-      }
+  typedef std::list<CacheEntry> lru_list;
 
-      return result;
-    }
+  struct CachedResult {
+    IncompleteSolver::PartialValidity validity;
+    size_t cost;
+    lru_list::iterator lruPosition;
   };
 
-  typedef std::unordered_map<CacheEntry, IncompleteSolver::PartialValidity,
-                             CacheEntryHash>
+  typedef std::unordered_map<CacheEntry, CachedResult, CacheEntryHash>
       cache_map;
 
+  /// Approximate memory charged to the cache for one entry: the map and
+  /// LRU nodes plus the per-entry copy of the constraint references.
+  /// Expression nodes are shared with the rest of the system and are not
+  /// charged here.
+  static size_t entryCost(const CacheEntry &ce) {
+    return 2 * sizeof(CacheEntry) + sizeof(CachedResult) +
+           2 * ce.constraints.size() * sizeof(ref<Expr>) + 64;
+  }
+
   Solver *solver;
   cache_map cache;
+  /// Cache entries ordered from most to least recently used.
+  lru_list lru;
+  /// Approximate memory held by the cache, per \ref entryCost.
+  size_t cacheMemory = 0;
+  /// Cost/benefit monitor for this layer (-solver-cache-autotune).
+  CacheLayerTuner tuner{stats::queryCacheSavedTime};
+
+  /// Charge the time since \p total to this layer and report a hit to
+  /// the tuner.
+  void recordLayerHit(const WallTimer &total) {
+    const time::Span overhead = total.delta();
+    stats::queryCacheTime += overhead.toMicroseconds();
+    tuner.recordHit(overhead);
+  }
+
+  /// Charge the time since \p total, minus the \p passThrough spent in
+  /// the solvers below, to this layer and report a miss to the tuner.
+  void recordLayerMiss(const WallTimer &total, time::Span passThrough) {
+    const time::Span overhead = total.delta() - passThrough;
+    stats::queryCacheTime += overhead.toMicroseconds();
+    tuner.recordMiss(overhead, passThrough);
+  }
 
 public:
   CachingSolver(Solver *s) : solver(s) {}
@@ -114,101 +166,166 @@ bool CachingSolver::cacheLookup(const Query& query,
 
   CacheEntry ce(query.constraints, canonicalQuery);
   cache_map::iterator it = cache.find(ce);
-  
+
   if (it != cache.end()) {
+    lru.splice(lru.begin(), lru, it->second.lruPosition);
     result = (negationUsed ?
-              IncompleteSolver::negatePartialValidity(it->second) :
-              it->second);
+              IncompleteSolver::negatePartialValidity(it->second.validity) :
+              it->second.validity);
     return true;
   }
-  
+
   return false;
 }
 
-/// Inserts the given query, result pair into the cache.
+/// Inserts the given query, result pair into the cache, evicting the
+/// least recently used entries if this pushes the cache over its memory
+/// budget.
 void CachingSolver::cacheInsert(const Query& query,
                                 IncompleteSolver::PartialValidity result) {
   bool negationUsed;
   ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
 
   CacheEntry ce(query.constraints, canonicalQuery);
-  IncompleteSolver::PartialValidity cachedResult = 
+  IncompleteSolver::PartialValidity cachedResult =
     (negationUsed ? IncompleteSolver::negatePartialValidity(result) : result);
-  
-  cache.insert(std::make_pair(ce, cachedResult));
+
+  cache_map::iterator it = cache.find(ce);
+  if (it != cache.end()) {
+    // Refine the existing entry (e.g. MayBeTrue to MustBeTrue).
+    it->second.validity = cachedResult;
+    lru.splice(lru.begin(), lru, it->second.lruPosition);
+    return;
+  }
+
+  lru.push_front(ce);
+  CachedResult &cr = cache[ce];
+  cr.validity = cachedResult;
+  cr.cost = entryCost(ce);
+  cr.lruPosition = lru.begin();
+  cacheMemory += cr.cost;
+
+  cacheEvict();
+}
+
+void CachingSolver::cacheEvict() {
+  const size_t budget = size_t(QueryCacheBudget) << 20;
+  if (!budget)
+    return;
+
+  while (cacheMemory > budget && !lru.empty()) {
+    cache_map::iterator it = cache.find(lru.back());
+    assert(it != cache.end() && "LRU entry missing from cache");
+    cacheMemory -= it->second.cost;
+    cache.erase(it);
+    lru.pop_back();
+    ++stats::queryCacheEvictions;
+  }
 }
 
 bool CachingSolver::computeValidity(const Query& query,
                                     Solver::Validity &result) {
+  if (!tuner.shouldConsult()) {
+    // Bypassed by the autotuner: pass straight through, but keep
+    // feeding the pass-through cost its benefit estimate uses.
+    ++stats::queryCacheMisses;
+    WallTimer passTimer;
+    if (!solver->impl->computeValidity(query, result))
+      return false;
+    tuner.recordBypassed(passTimer.delta());
+    return true;
+  }
+
+  WallTimer totalTimer;
   IncompleteSolver::PartialValidity cachedResult;
   bool tmp, cacheHit = cacheLookup(query, cachedResult);
-  
+
   if (cacheHit) {
     switch(cachedResult) {
-    case IncompleteSolver::MustBeTrue:   
+    case IncompleteSolver::MustBeTrue:
       result = Solver::True;
       ++stats::queryCacheHits;
+      recordLayerHit(totalTimer);
       return true;
-    case IncompleteSolver::MustBeFalse:  
+    case IncompleteSolver::MustBeFalse:
       result = Solver::False;
       ++stats::queryCacheHits;
+      recordLayerHit(totalTimer);
       return true;
-    case IncompleteSolver::TrueOrFalse:  
+    case IncompleteSolver::TrueOrFalse:
       result = Solver::Unknown;
       ++stats::queryCacheHits;
+      recordLayerHit(totalTimer);
       return true;
     case IncompleteSolver::MayBeTrue: {
       ++stats::queryCacheMisses;
+      WallTimer passTimer;
       if (!solver->impl->computeTruth(query, tmp))
         return false;
+      const time::Span passThrough = passTimer.delta();
       if (tmp) {
         cacheInsert(query, IncompleteSolver::MustBeTrue);
         result = Solver::True;
-        return true;
       } else {
         cacheInsert(query, IncompleteSolver::TrueOrFalse);
         result = Solver::Unknown;
-        return true;
       }
+      recordLayerMiss(totalTimer, passThrough);
+      return true;
     }
     case IncompleteSolver::MayBeFalse: {
       ++stats::queryCacheMisses;
+      WallTimer passTimer;
       if (!solver->impl->computeTruth(query.negateExpr(), tmp))
         return false;
+      const time::Span passThrough = passTimer.delta();
       if (tmp) {
         cacheInsert(query, IncompleteSolver::MustBeFalse);
         result = Solver::False;
-        return true;
       } else {
         cacheInsert(query, IncompleteSolver::TrueOrFalse);
         result = Solver::Unknown;
-        return true;
       }
+      recordLayerMiss(totalTimer, passThrough);
+      return true;
     }
     default: assert(0 && "unreachable");
     }
   }
 
   ++stats::queryCacheMisses;
-  
+
+  WallTimer passTimer;
   if (!solver->impl->computeValidity(query, result))
     return false;
+  const time::Span passThrough = passTimer.delta();
 
   switch (result) {
-  case Solver::True: 
+  case Solver::True:
     cachedResult = IncompleteSolver::MustBeTrue; break;
-  case Solver::False: 
+  case Solver::False:
     cachedResult = IncompleteSolver::MustBeFalse; break;
-  default: 
+  default:
     cachedResult = IncompleteSolver::TrueOrFalse; break;
   }
-  
+
   cacheInsert(query, cachedResult);
+  recordLayerMiss(totalTimer, passThrough);
   return true;
 }
 
 bool CachingSolver::computeTruth(const Query& query,
                                  bool &isValid) {
+  if (!tuner.shouldConsult()) {
+    ++stats::queryCacheMisses;
+    WallTimer passTimer;
+    if (!solver->impl->computeTruth(query, isValid))
+      return false;
+    tuner.recordBypassed(passTimer.delta());
+    return true;
+  }
+
+  WallTimer totalTimer;
   IncompleteSolver::PartialValidity cachedResult;
   bool cacheHit = cacheLookup(query, cachedResult);
 
@@ -217,14 +334,17 @@ bool CachingSolver::computeTruth(const Query& query,
   if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue) {
     ++stats::queryCacheHits;
     isValid = (cachedResult == IncompleteSolver::MustBeTrue);
+    recordLayerHit(totalTimer);
     return true;
   }
 
   ++stats::queryCacheMisses;
-  
+
   // cache miss: query solver
+  WallTimer passTimer;
   if (!solver->impl->computeTruth(query, isValid))
     return false;
+  const time::Span passThrough = passTimer.delta();
 
   if (isValid) {
     cachedResult = IncompleteSolver::MustBeTrue;
@@ -236,8 +356,9 @@ bool CachingSolver::computeTruth(const Query& query,
   } else {
     cachedResult = IncompleteSolver::MayBeFalse;
   }
-  
+
   cacheInsert(query, cachedResult);
+  recordLayerMiss(totalTimer, passThrough);
   return true;
 }
 
@@ -9,6 +9,8 @@
 
 #include "klee/Solver/Solver.h"
 
+#include "CacheTuner.h"
+
 #include "klee/ADT/MapOfSets.h"
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/Constraints.h"
@@ -23,6 +25,9 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <fstream>
+#include <sstream>
+
 using namespace klee;
 using namespace llvm;
 
@@ -50,11 +55,23 @@ cl::opt<bool> CexCacheExperimental(
     cl::desc("Optimization for validity queries (default=false)"),
     cl::cat(SolvingCat));
 
+cl::opt<std::string> CexCachePersistentFile(
+    "cex-cache-persistent", cl::init(""),
+    cl::desc("Path to a file used to persist the counterexample cache "
+             "across runs. Assignments are loaded from it on startup and "
+             "the table is written back on shutdown, warm-starting the "
+             "cache for reruns on the same target (default=off)"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
 ///
 
-typedef std::set< ref<Expr> > KeyType;
+// Cache keys are ordered by expression id: constraints are shared by
+// reference across the queries of forked states, so identity-based
+// ordering still deduplicates the common case while skipping the deep
+// structural compares that used to dominate lookups.
+typedef std::set<ref<Expr>, ExprIDLess> KeyType;
 
 struct AssignmentLessThan {
   bool operator()(const Assignment *a, const Assignment *b) const {
@@ -67,11 +84,14 @@ class CexCachingSolver : public SolverImpl {
   typedef std::set<Assignment*, AssignmentLessThan> assignmentsTable_ty;
 
   Solver *solver;
-  
-  MapOfSets<ref<Expr>, Assignment*> cache;
+
+  MapOfSets<ref<Expr>, Assignment *, ExprIDLess> cache;
   // memo table
   assignmentsTable_ty assignmentsTable;
 
+  /// Cost/benefit monitor for this layer (-solver-cache-autotune).
+  CacheLayerTuner tuner{stats::queryCexCacheSavedTime};
+
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
   
@@ -83,9 +103,23 @@ class CexCachingSolver : public SolverImpl {
   }
 
   bool getAssignment(const Query& query, Assignment *&result);
-  
+
+  /// Assignments loaded from the persistent cache file, keyed by array
+  /// name since Array pointers are not stable across runs. They are only
+  /// ever used after satisfies() has validated them against the current
+  /// query, so a stale file costs time but never correctness.
+  std::vector<std::map<std::string, std::vector<unsigned char> > >
+      loadedAssignments;
+
+  bool tryLoadedAssignments(KeyType &key, Assignment *&result);
+  void loadPersistentCache();
+  void savePersistentCache();
+
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver) : solver(_solver) {
+    if (!CexCachePersistentFile.empty())
+      loadPersistentCache();
+  }
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
@@ -219,20 +253,152 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
   return found;
 }
 
+/// tryLoadedAssignments - Look for an assignment loaded from the
+/// persistent cache file that satisfies \p key. Matching is by array
+/// name; candidates are validated with satisfies() before use and
+/// promoted into the in-memory cache on success.
+bool CexCachingSolver::tryLoadedAssignments(KeyType &key,
+                                            Assignment *&result) {
+  if (loadedAssignments.empty())
+    return false;
+
+  std::vector<const Array *> objects;
+  findSymbolicObjects(key.begin(), key.end(), objects);
+
+  for (const auto &loaded : loadedAssignments) {
+    std::vector<std::vector<unsigned char> > values;
+    values.reserve(objects.size());
+    for (const Array *array : objects) {
+      auto it = loaded.find(array->name);
+      values.push_back(it == loaded.end() ? std::vector<unsigned char>()
+                                          : it->second);
+    }
+
+    Assignment *candidate = new Assignment(objects, values);
+    if (!candidate->satisfies(key.begin(), key.end())) {
+      delete candidate;
+      continue;
+    }
+
+    auto res = assignmentsTable.insert(candidate);
+    if (!res.second) {
+      delete candidate;
+      candidate = *res.first;
+    }
+    result = candidate;
+    cache.insert(key, candidate);
+    return true;
+  }
+
+  return false;
+}
+
+void CexCachingSolver::loadPersistentCache() {
+  std::ifstream is(CexCachePersistentFile.c_str());
+  if (!is.good())
+    return; // Nothing persisted yet; the file is created on shutdown.
+
+  std::string line;
+  if (!std::getline(is, line) || line != "klee-cex-cache-v1") {
+    klee_warning("Ignoring persistent cex cache \"%s\": unknown format",
+                 CexCachePersistentFile.c_str());
+    return;
+  }
+
+  std::map<std::string, std::vector<unsigned char> > current;
+  while (std::getline(is, line)) {
+    if (line == "assignment") {
+      current.clear();
+    } else if (line == "end") {
+      loadedAssignments.push_back(current);
+    } else if (!line.empty()) {
+      std::istringstream ss(line);
+      std::string name, hex;
+      unsigned size;
+      if (!(ss >> name >> size >> hex) || hex.size() != 2 * size) {
+        klee_warning("Ignoring persistent cex cache \"%s\": malformed entry",
+                     CexCachePersistentFile.c_str());
+        loadedAssignments.clear();
+        return;
+      }
+      std::vector<unsigned char> data(size);
+      for (unsigned i = 0; i < size; ++i) {
+        unsigned byte;
+        std::istringstream(hex.substr(2 * i, 2)) >> std::hex >> byte;
+        data[i] = byte;
+      }
+      current[name] = data;
+    }
+  }
+
+  klee_message("Loaded %u assignments from persistent cex cache",
+               static_cast<unsigned>(loadedAssignments.size()));
+}
+
+void CexCachingSolver::savePersistentCache() {
+  std::ofstream os(CexCachePersistentFile.c_str(), std::ios::trunc);
+  if (!os.good()) {
+    klee_warning("Unable to write persistent cex cache \"%s\"",
+                 CexCachePersistentFile.c_str());
+    return;
+  }
+
+  static const char hexdigit[] = "0123456789abcdef";
+  os << "klee-cex-cache-v1\n";
+  for (const Assignment *a : assignmentsTable) {
+    os << "assignment\n";
+    for (const auto &binding : a->bindings) {
+      os << binding.first->name << " " << binding.second.size() << " ";
+      for (unsigned char byte : binding.second)
+        os << hexdigit[byte >> 4] << hexdigit[byte & 0xf];
+      os << "\n";
+    }
+    os << "end\n";
+  }
+}
+
 bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   KeyType key;
-  if (lookupAssignment(query, key, result))
-    return true;
+  WallTimer totalTimer;
+  const bool consult = tuner.shouldConsult();
+  if (consult) {
+    if (lookupAssignment(query, key, result)) {
+      tuner.recordHit(totalTimer.delta());
+      return true;
+    }
+
+    if (tryLoadedAssignments(key, result)) {
+      tuner.recordHit(totalTimer.delta());
+      return true;
+    }
+  } else {
+    // Bypassed by the autotuner: build the canonical key -- the object
+    // list and the insertion below still need it -- but skip the cache
+    // search.
+    key = KeyType(query.constraints.begin(), query.constraints.end());
+    ref<Expr> neg = Expr::createIsZero(query.expr);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(neg)) {
+      if (CE->isFalse()) {
+        result = (Assignment*) 0;
+        return true;
+      }
+    } else {
+      key.insert(neg);
+    }
+    ++stats::queryCexCacheMisses;
+  }
 
   std::vector<const Array*> objects;
   findSymbolicObjects(key.begin(), key.end(), objects);
 
   std::vector< std::vector<unsigned char> > values;
   bool hasSolution;
-  if (!solver->impl->computeInitialValues(query, objects, values, 
+  WallTimer passTimer;
+  if (!solver->impl->computeInitialValues(query, objects, values,
                                           hasSolution))
     return false;
-    
+  const time::Span passThrough = passTimer.delta();
+
   Assignment *binding;
   if (hasSolution) {
     binding = new Assignment(objects, values);
@@ -258,12 +424,19 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   result = binding;
   cache.insert(key, binding);
 
+  if (consult)
+    tuner.recordMiss(totalTimer.delta() - passThrough, passThrough);
+  else
+    tuner.recordBypassed(passThrough);
+
   return true;
 }
 
 ///
 
 CexCachingSolver::~CexCachingSolver() {
+  if (!CexCachePersistentFile.empty())
+    savePersistentCache();
   cache.clear();
   delete solver;
   for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
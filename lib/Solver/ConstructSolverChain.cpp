@@ -12,6 +12,7 @@
  */
 
 #include "klee/Solver/Common.h"
+#include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverCmdLine.h"
 #include "klee/Support/ErrorHandling.h"
 #include "klee/System/Time.h"
@@ -24,10 +25,40 @@ Solver *constructSolverChain(Solver *coreSolver,
                              std::string querySMT2LogPath,
                              std::string baseSolverQuerySMT2LogPath,
                              std::string queryKQueryLogPath,
-                             std::string baseSolverQueryKQueryLogPath) {
+                             std::string baseSolverQueryKQueryLogPath,
+                             std::string queryBinaryLogPath,
+                             std::string baseSolverQueryBinaryLogPath) {
   Solver *solver = coreSolver;
   const time::Span minQueryTimeToLog(MinQueryTimeToLog);
 
+  // With -benchmark-solver-stages, wrap each chain stage with a metering
+  // solver so per-stage query counts and times can be reported (see
+  // reportSolverStageMetrics()). Each stage records the name of the
+  // metered stage directly beneath it to allow hit-rate computation.
+  const char *meteredStage = nullptr;
+  auto meter = [&solver, &meteredStage](const char *name) {
+    if (!BenchmarkSolverStages)
+      return;
+    solver = createMeteredSolver(solver, name, meteredStage ? meteredStage : "");
+    meteredStage = name;
+  };
+
+  meter("core");
+
+  // The router sits directly above the core solver: trivial queries are
+  // already absorbed by the caches and the fast counterexample solver
+  // further up the chain, so it only separates moderate from hard.
+  if (UseQueryRouter) {
+    Solver *hardSolver = createCoreSolver(PORTFOLIO_SOLVER);
+    if (hardSolver) {
+      solver = createQueryRouterSolver(
+          solver, hardSolver, time::Span(QueryRouterHardTimeout));
+      meter("query-router");
+    } else {
+      klee_warning("-use-query-router ignored: no portfolio-capable solver");
+    }
+  }
+
   if (QueryLoggingOptions.isSet(SOLVER_KQUERY)) {
     solver = createKQueryLoggingSolver(solver, baseSolverQueryKQueryLogPath, minQueryTimeToLog, LogTimedOutQueries);
     klee_message("Logging queries that reach solver in .kquery format to %s\n",
@@ -40,20 +71,39 @@ Solver *constructSolverChain(Solver *coreSolver,
                  baseSolverQuerySMT2LogPath.c_str());
   }
 
+  if (QueryLoggingOptions.isSet(SOLVER_BINARY)) {
+    solver = createBinaryQueryLoggingSolver(solver, baseSolverQueryBinaryLogPath, minQueryTimeToLog, LogTimedOutQueries);
+    klee_message("Logging queries that reach solver in binary format to %s\n",
+                 baseSolverQueryBinaryLogPath.c_str());
+  }
+
   if (UseAssignmentValidatingSolver)
     solver = createAssignmentValidatingSolver(solver);
 
-  if (UseFastCexSolver)
+  if (UseFastCexSolver) {
     solver = createFastCexSolver(solver);
+    meter("fast-cex");
+  }
+
+  if (UseRangeSolver) {
+    solver = createRangeSolver(solver);
+    meter("range-solver");
+  }
 
-  if (UseCexCache)
+  if (UseCexCache) {
     solver = createCexCachingSolver(solver);
+    meter("cex-cache");
+  }
 
-  if (UseBranchCache)
+  if (UseBranchCache) {
     solver = createCachingSolver(solver);
+    meter("branch-cache");
+  }
 
-  if (UseIndependentSolver)
+  if (UseIndependentSolver) {
     solver = createIndependentSolver(solver);
+    meter("independent");
+  }
 
   if (DebugValidateSolver)
     solver = createValidatingSolver(solver, coreSolver);
@@ -69,6 +119,12 @@ Solver *constructSolverChain(Solver *coreSolver,
     klee_message("Logging all queries in .smt2 format to %s\n",
                  querySMT2LogPath.c_str());
   }
+  if (QueryLoggingOptions.isSet(ALL_BINARY)) {
+    solver = createBinaryQueryLoggingSolver(solver, queryBinaryLogPath, minQueryTimeToLog, LogTimedOutQueries);
+    klee_message("Logging all queries in binary format to %s\n",
+                 queryBinaryLogPath.c_str());
+  }
+
   if (DebugCrossCheckCoreSolverWith != NO_SOLVER) {
     Solver *oracleSolver = createCoreSolver(DebugCrossCheckCoreSolverWith);
     solver = createValidatingSolver(/*s=*/solver, /*oracle=*/oracleSolver);
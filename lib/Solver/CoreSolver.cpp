@@ -18,7 +18,10 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace klee {
 
@@ -50,6 +53,23 @@ Solver *createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case PORTFOLIO_SOLVER: {
+    std::vector<std::unique_ptr<Solver>> children;
+#ifdef ENABLE_STP
+    children.emplace_back(
+        new STPSolver(UseForkedCoreSolver, CoreSolverOptimizeDivides));
+#endif
+#ifdef ENABLE_Z3
+    children.emplace_back(new Z3Solver());
+#endif
+    if (children.empty()) {
+      klee_message("Not compiled with any portfolio-capable solver");
+      return NULL;
+    }
+    klee_message("Using portfolio solver backend over %u core solvers",
+                 static_cast<unsigned>(children.size()));
+    return createPortfolioSolver(std::move(children));
+  }
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
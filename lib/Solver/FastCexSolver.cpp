@@ -15,293 +15,78 @@
 #include "klee/Expr/ExprEvaluator.h"
 #include "klee/Expr/ExprRangeEvaluator.h"
 #include "klee/Expr/ExprVisitor.h"
+#include "klee/Expr/ValueRange.h"
 #include "klee/Solver/IncompleteSolver.h"
 #include "klee/Support/Debug.h"
 #include "klee/Support/IntEvaluation.h" // FIXME: Use APInt
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
 #include <map>
+#include <memory>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
 using namespace klee;
 
-// Hacker's Delight, pgs 58-63
-static uint64_t minOR(uint64_t a, uint64_t b,
-                      uint64_t c, uint64_t d) {
-  uint64_t temp, m = ((uint64_t) 1)<<63;
-  while (m) {
-    if (~a & c & m) {
-      temp = (a | m) & -m;
-      if (temp <= b) { a = temp; break; }
-    } else if (a & ~c & m) {
-      temp = (c | m) & -m;
-      if (temp <= d) { c = temp; break; }
-    }
-    m >>= 1;
-  }
-  
-  return a | c;
-}
-static uint64_t maxOR(uint64_t a, uint64_t b,
-                      uint64_t c, uint64_t d) {
-  uint64_t temp, m = ((uint64_t) 1)<<63;
-
-  while (m) {
-    if (b & d & m) {
-      temp = (b - m) | (m - 1);
-      if (temp >= a) { b = temp; break; }
-      temp = (d - m) | (m -1);
-      if (temp >= c) { d = temp; break; }
-    }
-    m >>= 1;
-  }
-
-  return b | d;
-}
-static uint64_t minAND(uint64_t a, uint64_t b,
-                       uint64_t c, uint64_t d) {
-  uint64_t temp, m = ((uint64_t) 1)<<63;
-  while (m) {
-    if (~a & ~c & m) {
-      temp = (a | m) & -m;
-      if (temp <= b) { a = temp; break; }
-      temp = (c | m) & -m;
-      if (temp <= d) { c = temp; break; }
-    }
-    m >>= 1;
-  }
-  
-  return a & c;
-}
-static uint64_t maxAND(uint64_t a, uint64_t b,
-                       uint64_t c, uint64_t d) {
-  uint64_t temp, m = ((uint64_t) 1)<<63;
-  while (m) {
-    if (b & ~d & m) {
-      temp = (b & ~m) | (m - 1);
-      if (temp >= a) { b = temp; break; }
-    } else if (~b & d & m) {
-      temp = (d & ~m) | (m - 1);
-      if (temp >= c) { d = temp; break; }
-    }
-    m >>= 1;
-  }
-  
-  return b & d;
-}
-
-///
-
-class ValueRange {
-private:
-  std::uint64_t m_min = 1, m_max = 0;
-
-public:
-  ValueRange() noexcept = default;
-  ValueRange(const ref<ConstantExpr> &ce) {
-    // FIXME: Support large widths.
-    m_min = m_max = ce->getLimitedValue();
-  }
-  explicit ValueRange(std::uint64_t value) noexcept
-      : m_min(value), m_max(value) {}
-  ValueRange(std::uint64_t _min, std::uint64_t _max) noexcept
-      : m_min(_min), m_max(_max) {}
-  ValueRange(const ValueRange &other) noexcept = default;
-  ValueRange &operator=(const ValueRange &other) noexcept = default;
-  ValueRange(ValueRange &&other) noexcept = default;
-  ValueRange &operator=(ValueRange &&other) noexcept = default;
-
-  void print(llvm::raw_ostream &os) const {
-    if (isFixed()) {
-      os << m_min;
-    } else {
-      os << "[" << m_min << "," << m_max << "]";
-    }
-  }
-
-  bool isEmpty() const noexcept { return m_min > m_max; }
-  bool contains(std::uint64_t value) const {
-    return this->intersects(ValueRange(value)); 
-  }
-  bool intersects(const ValueRange &b) const { 
-    return !this->set_intersection(b).isEmpty(); 
-  }
-
-  bool isFullRange(unsigned bits) const noexcept {
-    return m_min == 0 && m_max == bits64::maxValueOfNBits(bits);
-  }
-
-  ValueRange set_intersection(const ValueRange &b) const {
-    return ValueRange(std::max(m_min, b.m_min), std::min(m_max, b.m_max));
-  }
-  ValueRange set_union(const ValueRange &b) const {
-    return ValueRange(std::min(m_min, b.m_min), std::max(m_max, b.m_max));
-  }
-  ValueRange set_difference(const ValueRange &b) const {
-    if (b.isEmpty() || b.m_min > m_max || b.m_max < m_min) { // no intersection
-      return *this;
-    } else if (b.m_min <= m_min && b.m_max >= m_max) { // empty
-      return ValueRange(1, 0);
-    } else if (b.m_min <= m_min) { // one range out
-      // cannot overflow because b.m_max < m_max
-      return ValueRange(b.m_max + 1, m_max);
-    } else if (b.m_max >= m_max) {
-      // cannot overflow because b.min > m_min
-      return ValueRange(m_min, b.m_min - 1);
-    } else {
-      // two ranges, take bottom
-      return ValueRange(m_min, b.m_min - 1);
-    }
-  }
-  ValueRange binaryAnd(const ValueRange &b) const {
-    // XXX
-    assert(!isEmpty() && !b.isEmpty() && "XXX");
-    if (isFixed() && b.isFixed()) {
-      return ValueRange(m_min & b.m_min);
-    } else {
-      return ValueRange(minAND(m_min, m_max, b.m_min, b.m_max),
-                        maxAND(m_min, m_max, b.m_min, b.m_max));
-    }
-  }
-  ValueRange binaryAnd(std::uint64_t b) const {
-    return binaryAnd(ValueRange(b));
-  }
-  ValueRange binaryOr(ValueRange b) const {
-    // XXX
-    assert(!isEmpty() && !b.isEmpty() && "XXX");
-    if (isFixed() && b.isFixed()) {
-      return ValueRange(m_min | b.m_min);
-    } else {
-      return ValueRange(minOR(m_min, m_max, b.m_min, b.m_max),
-                        maxOR(m_min, m_max, b.m_min, b.m_max));
-    }
-  }
-  ValueRange binaryOr(std::uint64_t b) const { return binaryOr(ValueRange(b)); }
-  ValueRange binaryXor(ValueRange b) const {
-    if (isFixed() && b.isFixed()) {
-      return ValueRange(m_min ^ b.m_min);
-    } else {
-      std::uint64_t t = m_max | b.m_max;
-      while (!bits64::isPowerOfTwo(t))
-        t = bits64::withoutRightmostBit(t);
-      return ValueRange(0, (t << 1) - 1);
-    }
-  }
-
-  ValueRange binaryShiftLeft(unsigned bits) const {
-    return ValueRange(m_min << bits, m_max << bits);
-  }
-  ValueRange binaryShiftRight(unsigned bits) const {
-    return ValueRange(m_min >> bits, m_max >> bits);
-  }
-
-  ValueRange concat(const ValueRange &b, unsigned bits) const {
-    return binaryShiftLeft(bits).binaryOr(b);
-  }
-  ValueRange extract(std::uint64_t lowBit, std::uint64_t maxBit) const {
-    return binaryShiftRight(lowBit).binaryAnd(
-        bits64::maxValueOfNBits(maxBit - lowBit));
-  }
+// XXX waste of space, rather have ByteValueRange
+typedef ValueRange CexValueData;
 
-  ValueRange add(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
-  ValueRange sub(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
-  ValueRange mul(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
-  ValueRange udiv(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
-  ValueRange sdiv(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
-  ValueRange urem(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
-  ValueRange srem(const ValueRange &b, unsigned width) const {
-    return ValueRange(0, bits64::maxValueOfNBits(width));
-  }
+/// KnownBits - Bit-level abstract value for expressions of width <= 64:
+/// every bit is known-zero, known-one, or unknown. This complements the
+/// interval domain, which loses almost all information through masks,
+/// shifts and byte extraction; bits outside the expression width are
+/// unknown in both masks.
+struct KnownBits {
+  uint64_t zero; // bits known to be 0
+  uint64_t one;  // bits known to be 1
 
-  // use min() to get value if true (XXX should we add a method to
-  // make code clearer?)
-  bool isFixed() const noexcept { return m_min == m_max; }
+  KnownBits() : zero(0), one(0) {}
+  KnownBits(uint64_t _zero, uint64_t _one) : zero(_zero), one(_one) {}
 
-  bool operator==(const ValueRange &b) const noexcept {
-    return m_min == b.m_min && m_max == b.m_max;
-  }
-  bool operator!=(const ValueRange &b) const noexcept { return !(*this == b); }
+  static KnownBits top() { return KnownBits(); }
 
-  bool mustEqual(const std::uint64_t b) const noexcept {
-    return m_min == m_max && m_min == b;
+  static KnownBits constant(uint64_t value, unsigned width) {
+    uint64_t mask = bits64::maxValueOfNBits(width);
+    return KnownBits(~value & mask, value & mask);
   }
-  bool mayEqual(const std::uint64_t b) const noexcept {
-    return m_min <= b && m_max >= b;
-  }
-  
-  bool mustEqual(const ValueRange &b) const noexcept {
-    return isFixed() && b.isFixed() && m_min == b.m_min;
-  }
-  bool mayEqual(const ValueRange &b) const { return this->intersects(b); }
 
-  std::uint64_t min() const noexcept {
-    assert(!isEmpty() && "cannot get minimum of empty range");
-    return m_min; 
+  /// fromRange - The bits on which every value in the range agrees: the
+  /// common leading bits of the two bounds.
+  static KnownBits fromRange(const CexValueData &r, unsigned width) {
+    if (r.isEmpty())
+      return top();
+    uint64_t diff = r.min() ^ r.max();
+    unsigned firstDiffering = 0;
+    while (diff >> firstDiffering)
+      ++firstDiffering;
+    uint64_t agree =
+        bits64::maxValueOfNBits(width) & ~bits64::maxValueOfNBits(firstDiffering);
+    return KnownBits(~r.min() & agree, r.min() & agree);
   }
 
-  std::uint64_t max() const noexcept {
-    assert(!isEmpty() && "cannot get maximum of empty range");
-    return m_max; 
+  bool isConstant(unsigned width) const {
+    return (zero | one) == bits64::maxValueOfNBits(width);
   }
-  
-  std::int64_t minSigned(unsigned bits) const {
-    assert((m_min >> bits) == 0 && (m_max >> bits) == 0 &&
-           "range is outside given number of bits");
-
-    // if max allows sign bit to be set then it can be smallest value,
-    // otherwise since the range is not empty, min cannot have a sign
-    // bit
-
-    std::uint64_t smallest = (static_cast<std::uint64_t>(1) << (bits - 1));
-    if (m_max >= smallest) {
-      return ints::sext(smallest, 64, bits);
-    } else {
-      return m_min;
-    }
+  uint64_t value() const { return one; }
+  bool hasConflict() const { return zero & one; }
+  bool isTop() const { return !zero && !one; }
+
+  /// meet - Keep only the bits known in both (for merging control-flow
+  /// alternatives).
+  KnownBits meet(KnownBits b) const {
+    return KnownBits(zero & b.zero, one & b.one);
   }
 
-  std::int64_t maxSigned(unsigned bits) const {
-    assert((m_min >> bits) == 0 && (m_max >> bits) == 0 &&
-           "range is outside given number of bits");
-
-    std::uint64_t smallest = (static_cast<std::uint64_t>(1) << (bits - 1));
-
-    // if max and min have sign bit then max is max, otherwise if only
-    // max has sign bit then max is largest signed integer, otherwise
-    // max is max
-
-    if (m_min < smallest && m_max >= smallest) {
-      return smallest - 1;
-    } else {
-      return ints::sext(m_max, 64, bits);
-    }
+  /// combine - Merge two sources of knowledge about the same value.
+  KnownBits combine(KnownBits b) const {
+    return KnownBits(zero | b.zero, one | b.one);
   }
 };
 
-inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
-                                     const ValueRange &vr) {
-  vr.print(os);
-  return os;
-}
-
-// XXX waste of space, rather have ByteValueRange
-typedef ValueRange CexValueData;
-
 class CexObjectData {
   /// possibleContents - An array of "possible" values for the object.
   ///
@@ -315,11 +100,16 @@ class CexObjectData {
   /// for each array location.
   std::vector<CexValueData> exactContents;
 
+  /// knownBits - Per-byte known-bit masks, the bit-level counterpart of
+  /// exactContents; refined by CexData::propogateExactBits.
+  std::vector<KnownBits> knownBits;
+
   CexObjectData(const CexObjectData&); // DO NOT IMPLEMENT
   void operator=(const CexObjectData&); // DO NOT IMPLEMENT
 
 public:
-  CexObjectData(uint64_t size) : possibleContents(size), exactContents(size) {
+  CexObjectData(uint64_t size)
+      : possibleContents(size), exactContents(size), knownBits(size) {
     for (uint64_t i = 0; i != size; ++i) {
       possibleContents[i] = ValueRange(0, 255);
       exactContents[i] = ValueRange(0, 255);
@@ -336,13 +126,23 @@ public:
     possibleContents[index] = CexValueData(value);
   }
 
-  const CexValueData getExactValues(size_t index) const { 
+  const CexValueData getExactValues(size_t index) const {
     return exactContents[index];
   }
   void setExactValues(size_t index, CexValueData values) {
     exactContents[index] = values;
   }
 
+  KnownBits getKnownBits(size_t index) const { return knownBits[index]; }
+  void combineKnownBits(size_t index, KnownBits kb) {
+    KnownBits merged = knownBits[index].combine(kb);
+    // A conflict means the constraints admit no value for this byte at
+    // all; drop the new information rather than record nonsense (the
+    // range domain keeps such queries sound, as before).
+    if (!merged.hasConflict())
+      knownBits[index] = merged;
+  }
+
   /// getPossibleValue - Return some possible value.
   unsigned char getPossibleValue(size_t index) const {
     const CexValueData &cvd = possibleContents[index];
@@ -367,6 +167,30 @@ public:
   }
 };
 
+class CexConstrainedRangeEvaluator : public ExprRangeEvaluator<ValueRange> {
+public:
+  std::map<const Array*, CexObjectData*> &objects;
+  CexConstrainedRangeEvaluator(std::map<const Array*,
+                                        CexObjectData*> &_objects)
+    : objects(_objects) {}
+
+  /// Like CexRangeEvaluator, but reads come back with the exact range
+  /// propagated from the constraint set instead of the full [0, 255].
+  ValueRange getInitialReadRange(const Array &array, ValueRange index) {
+    if (array.isConstantArray() &&
+        index.isFixed() &&
+        index.min() < array.size)
+      return ValueRange(array.constantValues[index.min()]->getZExtValue(8));
+
+    std::map<const Array*, CexObjectData*>::iterator it =
+      objects.find(&array);
+    if (it != objects.end() && index.isFixed() && index.min() < array.size)
+      return it->second->getExactValues(index.min());
+
+    return ValueRange(0, 255);
+  }
+};
+
 class CexPossibleEvaluator : public ExprEvaluator {
 protected:
   ref<Expr> getInitialValue(const Array& array, unsigned index) {
@@ -909,10 +733,51 @@ public:
     }
 
     case Expr::Ult: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+
+      // Narrow each side against a sound range for the other; unlike the
+      // possible-value case both sides can be refined at once since any
+      // satisfying assignment lies in the intersection.
+      if (range.isFixed()) {
+        ValueRange left = evalRangeForExpr(be->left);
+        ValueRange right = evalRangeForExpr(be->right);
+
+        uint64_t maxValue = bits64::maxValueOfNBits(be->right->getWidth());
+
+        if (range.min()) {
+          if (right.max() > 0)
+            propogateExactValues(be->left, CexValueData(0, right.max() - 1));
+          if (left.min() < maxValue)
+            propogateExactValues(be->right, CexValueData(left.min() + 1,
+                                                         maxValue));
+        } else {
+          propogateExactValues(be->left, CexValueData(right.min(), maxValue));
+          propogateExactValues(be->right, CexValueData(0, left.max()));
+        }
+      }
       break;
     }
 
     case Expr::Ule: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+
+      if (range.isFixed()) {
+        ValueRange left = evalRangeForExpr(be->left);
+        ValueRange right = evalRangeForExpr(be->right);
+
+        uint64_t maxValue = bits64::maxValueOfNBits(be->right->getWidth());
+
+        if (range.min()) {
+          propogateExactValues(be->left, CexValueData(0, right.max()));
+          propogateExactValues(be->right, CexValueData(left.min(), maxValue));
+        } else {
+          if (right.min() < maxValue)
+            propogateExactValues(be->left, CexValueData(right.min() + 1,
+                                                        maxValue));
+          if (left.max() > 0)
+            propogateExactValues(be->right, CexValueData(0, left.max() - 1));
+        }
+      }
       break;
     }
 
@@ -928,6 +793,357 @@ public:
     }
   }
 
+  /// evalBits - Forward known-bits evaluation over the expression DAG,
+  /// reading per-byte bit masks and exact ranges at the leaves. Sound
+  /// with respect to any assignment consistent with the propagated
+  /// constraints, like the exact range domain.
+  KnownBits evalBits(const ref<Expr> &e) {
+    std::map<const Expr *, KnownBits> memo;
+    return evalBits(e, memo);
+  }
+
+  KnownBits evalBits(const ref<Expr> &e,
+                     std::map<const Expr *, KnownBits> &memo) {
+    Expr::Width width = e->getWidth();
+    if (width > 64)
+      return KnownBits::top();
+
+    std::map<const Expr *, KnownBits>::iterator it = memo.find(e.get());
+    if (it != memo.end())
+      return it->second;
+
+    KnownBits result = evalBitsActual(e, memo);
+    memo[e.get()] = result;
+    return result;
+  }
+
+  KnownBits evalBitsActual(const ref<Expr> &e,
+                           std::map<const Expr *, KnownBits> &memo) {
+    Expr::Width width = e->getWidth();
+    uint64_t mask = bits64::maxValueOfNBits(width);
+
+    switch (e->getKind()) {
+    case Expr::Constant:
+      return KnownBits::constant(cast<ConstantExpr>(e)->getZExtValue(), width);
+
+    case Expr::Read: {
+      ReadExpr *re = cast<ReadExpr>(e);
+      const Array *array = re->updates.root;
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index);
+      if (!CE)
+        return KnownBits::top();
+      uint64_t index = CE->getZExtValue();
+
+      for (const auto *un = re->updates.head.get(); un; un = un->next.get()) {
+        ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index);
+        if (!ui)
+          return KnownBits::top();
+        if (ui->getZExtValue() == index)
+          return evalBits(un->value, memo);
+      }
+
+      if (index >= array->size)
+        return KnownBits::top();
+      if (array->isConstantArray())
+        return KnownBits::constant(
+            array->constantValues[index]->getZExtValue(8), 8);
+      CexObjectData &cod = getObjectData(array);
+      return cod.getKnownBits(index).combine(
+          KnownBits::fromRange(cod.getExactValues(index), 8));
+    }
+
+    case Expr::Select: {
+      SelectExpr *se = cast<SelectExpr>(e);
+      KnownBits cond = evalBits(se->cond, memo);
+      if (cond.isConstant(Expr::Bool))
+        return evalBits(cond.value() ? se->trueExpr : se->falseExpr, memo);
+      return evalBits(se->trueExpr, memo).meet(evalBits(se->falseExpr, memo));
+    }
+
+    case Expr::Concat: {
+      ConcatExpr *ce = cast<ConcatExpr>(e);
+      unsigned lsbWidth = ce->getKid(1)->getWidth();
+      KnownBits msb = evalBits(ce->getKid(0), memo);
+      KnownBits lsb = evalBits(ce->getKid(1), memo);
+      return KnownBits(lsb.zero | (msb.zero << lsbWidth),
+                       lsb.one | (msb.one << lsbWidth));
+    }
+
+    case Expr::Extract: {
+      ExtractExpr *ee = cast<ExtractExpr>(e);
+      KnownBits src = evalBits(ee->expr, memo);
+      return KnownBits((src.zero >> ee->offset) & mask,
+                       (src.one >> ee->offset) & mask);
+    }
+
+    case Expr::ZExt: {
+      CastExpr *ce = cast<CastExpr>(e);
+      KnownBits src = evalBits(ce->src, memo);
+      uint64_t high = mask & ~bits64::maxValueOfNBits(ce->src->getWidth());
+      return KnownBits(src.zero | high, src.one);
+    }
+
+    case Expr::SExt: {
+      CastExpr *ce = cast<CastExpr>(e);
+      unsigned inBits = ce->src->getWidth();
+      KnownBits src = evalBits(ce->src, memo);
+      uint64_t signBit = UINT64_C(1) << (inBits - 1);
+      uint64_t high = mask & ~bits64::maxValueOfNBits(inBits);
+      if (src.zero & signBit)
+        return KnownBits(src.zero | high, src.one);
+      if (src.one & signBit)
+        return KnownBits(src.zero, src.one | high);
+      return src;
+    }
+
+    case Expr::Not: {
+      KnownBits src = evalBits(e->getKid(0), memo);
+      return KnownBits(src.one, src.zero);
+    }
+
+    case Expr::And: {
+      KnownBits l = evalBits(e->getKid(0), memo);
+      KnownBits r = evalBits(e->getKid(1), memo);
+      return KnownBits(l.zero | r.zero, l.one & r.one);
+    }
+
+    case Expr::Or: {
+      KnownBits l = evalBits(e->getKid(0), memo);
+      KnownBits r = evalBits(e->getKid(1), memo);
+      return KnownBits(l.zero & r.zero, l.one | r.one);
+    }
+
+    case Expr::Xor: {
+      KnownBits l = evalBits(e->getKid(0), memo);
+      KnownBits r = evalBits(e->getKid(1), memo);
+      uint64_t known = (l.zero | l.one) & (r.zero | r.one);
+      uint64_t val = l.one ^ r.one;
+      return KnownBits(known & ~val, known & val);
+    }
+
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(be->right);
+      if (!CE || CE->getZExtValue() >= width)
+        return KnownBits::top();
+      unsigned shift = CE->getZExtValue();
+      KnownBits src = evalBits(be->left, memo);
+      if (e->getKind() == Expr::Shl)
+        return KnownBits(((src.zero << shift) | bits64::maxValueOfNBits(shift)) &
+                             mask,
+                         (src.one << shift) & mask);
+      uint64_t vacated = mask & ~(mask >> shift);
+      if (e->getKind() == Expr::LShr)
+        return KnownBits((src.zero >> shift) | vacated, src.one >> shift);
+      // AShr: the vacated bits take the sign bit, when it is known.
+      uint64_t signBit = UINT64_C(1) << (width - 1);
+      KnownBits out(src.zero >> shift, src.one >> shift);
+      if (src.zero & signBit)
+        out.zero |= vacated;
+      else if (src.one & signBit)
+        out.one |= vacated;
+      return out;
+    }
+
+    case Expr::Add:
+    case Expr::Sub: {
+      KnownBits l = evalBits(e->getKid(0), memo);
+      KnownBits r = evalBits(e->getKid(1), memo);
+      if (e->getKind() == Expr::Sub)
+        r = KnownBits(r.one, r.zero); // a - b == a + ~b + 1
+      // Ripple the addition while the carry stays known; everything
+      // from the first unknown carry upwards is unknown.
+      KnownBits out;
+      unsigned carry = e->getKind() == Expr::Sub ? 1 : 0;
+      for (unsigned i = 0; i != width; ++i) {
+        uint64_t bit = UINT64_C(1) << i;
+        if (!((l.zero | l.one) & bit) || !((r.zero | r.one) & bit))
+          break;
+        unsigned sum = !!(l.one & bit) + !!(r.one & bit) + carry;
+        if (sum & 1)
+          out.one |= bit;
+        else
+          out.zero |= bit;
+        carry = sum >> 1;
+      }
+      return out;
+    }
+
+    case Expr::Eq: {
+      KnownBits l = evalBits(e->getKid(0), memo);
+      KnownBits r = evalBits(e->getKid(1), memo);
+      // Any bit known to differ decides the comparison.
+      if ((l.one & r.zero) | (l.zero & r.one))
+        return KnownBits::constant(0, Expr::Bool);
+      Expr::Width kidWidth = e->getKid(0)->getWidth();
+      if (kidWidth <= 64 && l.isConstant(kidWidth) && r.isConstant(kidWidth))
+        return KnownBits::constant(l.value() == r.value(), Expr::Bool);
+      return KnownBits::top();
+    }
+
+    default:
+      return KnownBits::top();
+    }
+  }
+
+  /// propogateExactBits - Backward counterpart of evalBits: \p kb is a
+  /// sound fact about the value of \p e under the constraints; push it
+  /// through masks, shifts, casts and concatenation towards the reads,
+  /// refining the per-byte known-bit masks.
+  void propogateExactBits(ref<Expr> e, KnownBits kb) {
+    if (e->getWidth() > 64 || kb.isTop() || kb.hasConflict())
+      return;
+
+    switch (e->getKind()) {
+    case Expr::Constant:
+      break;
+
+    case Expr::NotOptimized:
+      break;
+
+    case Expr::Read: {
+      ReadExpr *re = cast<ReadExpr>(e);
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index);
+      if (!CE)
+        break;
+      uint64_t index = CE->getZExtValue();
+
+      for (const auto *un = re->updates.head.get(); un; un = un->next.get()) {
+        ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index);
+        if (!ui)
+          return;
+        if (ui->getZExtValue() == index) {
+          propogateExactBits(un->value, kb);
+          return;
+        }
+      }
+
+      const Array *array = re->updates.root;
+      if (index < array->size && !array->isConstantArray())
+        getObjectData(array).combineKnownBits(index, kb);
+      break;
+    }
+
+    case Expr::Select: {
+      SelectExpr *se = cast<SelectExpr>(e);
+      KnownBits cond = evalBits(se->cond);
+      if (cond.isConstant(Expr::Bool))
+        propogateExactBits(cond.value() ? se->trueExpr : se->falseExpr, kb);
+      break;
+    }
+
+    case Expr::Concat: {
+      ConcatExpr *ce = cast<ConcatExpr>(e);
+      unsigned lsbWidth = ce->getKid(1)->getWidth();
+      uint64_t lsbMask = bits64::maxValueOfNBits(lsbWidth);
+      propogateExactBits(ce->getKid(1),
+                         KnownBits(kb.zero & lsbMask, kb.one & lsbMask));
+      propogateExactBits(ce->getKid(0),
+                         KnownBits(kb.zero >> lsbWidth, kb.one >> lsbWidth));
+      break;
+    }
+
+    case Expr::Extract: {
+      ExtractExpr *ee = cast<ExtractExpr>(e);
+      if (ee->expr->getWidth() > 64)
+        break;
+      // The surrounding bits of the source are simply unknown.
+      propogateExactBits(ee->expr,
+                         KnownBits(kb.zero << ee->offset, kb.one << ee->offset));
+      break;
+    }
+
+    case Expr::ZExt:
+    case Expr::SExt: {
+      CastExpr *ce = cast<CastExpr>(e);
+      uint64_t inMask = bits64::maxValueOfNBits(ce->src->getWidth());
+      propogateExactBits(ce->src,
+                         KnownBits(kb.zero & inMask, kb.one & inMask));
+      break;
+    }
+
+    case Expr::Not:
+      propogateExactBits(e->getKid(0), KnownBits(kb.one, kb.zero));
+      break;
+
+    case Expr::And: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      KnownBits l = evalBits(be->left);
+      KnownBits r = evalBits(be->right);
+      // A one in the output is a one in both inputs; a zero is a zero
+      // in an input wherever the other input is known one.
+      propogateExactBits(be->left, KnownBits(kb.zero & r.one, kb.one));
+      propogateExactBits(be->right, KnownBits(kb.zero & l.one, kb.one));
+      break;
+    }
+
+    case Expr::Or: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      KnownBits l = evalBits(be->left);
+      KnownBits r = evalBits(be->right);
+      propogateExactBits(be->left, KnownBits(kb.zero, kb.one & r.zero));
+      propogateExactBits(be->right, KnownBits(kb.zero, kb.one & l.zero));
+      break;
+    }
+
+    case Expr::Xor: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      KnownBits l = evalBits(be->left);
+      KnownBits r = evalBits(be->right);
+      uint64_t outKnown = kb.zero | kb.one;
+      uint64_t lKnown = outKnown & (r.zero | r.one);
+      uint64_t lVal = kb.one ^ r.one;
+      propogateExactBits(be->left,
+                         KnownBits(lKnown & ~lVal, lKnown & lVal));
+      uint64_t rKnown = outKnown & (l.zero | l.one);
+      uint64_t rVal = kb.one ^ l.one;
+      propogateExactBits(be->right,
+                         KnownBits(rKnown & ~rVal, rKnown & rVal));
+      break;
+    }
+
+    case Expr::Shl:
+    case Expr::LShr: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(be->right);
+      if (!CE || CE->getZExtValue() >= e->getWidth())
+        break;
+      unsigned shift = CE->getZExtValue();
+      uint64_t mask = bits64::maxValueOfNBits(e->getWidth());
+      if (e->getKind() == Expr::Shl)
+        propogateExactBits(be->left,
+                           KnownBits(kb.zero >> shift, kb.one >> shift));
+      else
+        propogateExactBits(be->left, KnownBits((kb.zero << shift) & mask,
+                                               (kb.one << shift) & mask));
+      break;
+    }
+
+    case Expr::Eq: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      if (!kb.isConstant(Expr::Bool))
+        break;
+      if (kb.value()) {
+        // The sides are equal: everything known about one side holds
+        // for the other.
+        propogateExactBits(be->right, evalBits(be->left));
+        propogateExactBits(be->left, evalBits(be->right));
+      } else if (be->right->getWidth() == Expr::Bool) {
+        if (ConstantExpr *CE = dyn_cast<ConstantExpr>(be->left))
+          propogateExactBits(be->right,
+                             KnownBits::constant(!CE->getZExtValue(),
+                                                 Expr::Bool));
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
   ValueRange evalRangeForExpr(const ref<Expr> &e) {
     CexRangeEvaluator ce(objects);
     return ce.evaluate(e);
@@ -1010,14 +1226,16 @@ static bool propogateValues(const Query& query, CexData &cd,
   for (const auto &constraint : query.constraints) {
     cd.propogatePossibleValue(constraint, 1);
     cd.propogateExactValue(constraint, 1);
+    cd.propogateExactBits(constraint, KnownBits::constant(1, Expr::Bool));
   }
   if (checkExpr) {
     cd.propogatePossibleValue(query.expr, 0);
     cd.propogateExactValue(query.expr, 0);
+    cd.propogateExactBits(query.expr, KnownBits::constant(0, Expr::Bool));
   }
 
   KLEE_DEBUG(cd.dump());
-  
+
   // Check the result.
   bool hasSatisfyingAssignment = true;
   if (checkExpr) {
@@ -1029,6 +1247,14 @@ static bool propogateValues(const Query& query, CexData &cd,
       isValid = true;
       return true;
     }
+
+    // The bit domain may decide the query when the interval domain
+    // cannot (masks, shifts, byte extraction).
+    KnownBits kb = cd.evalBits(query.expr);
+    if (kb.isConstant(Expr::Bool) && kb.value()) {
+      isValid = true;
+      return true;
+    }
   }
 
   for (const auto &constraint : query.constraints) {
@@ -1041,6 +1267,12 @@ static bool propogateValues(const Query& query, CexData &cd,
       isValid = true;
       return true;
     }
+
+    KnownBits kb = cd.evalBits(constraint);
+    if (kb.isConstant(Expr::Bool) && !kb.value()) {
+      isValid = true;
+      return true;
+    }
   }
 
   if (hasSatisfyingAssignment) {
@@ -1141,3 +1373,114 @@ FastCexSolver::computeInitialValues(const Query& query,
 Solver *klee::createFastCexSolver(Solver *s) {
   return new Solver(new StagedSolverImpl(new FastCexSolver(), s));
 }
+
+/* *** */
+
+/// RangeSolver - A solver stage that answers queries purely by interval
+/// reasoning.
+///
+/// FastCexSolver propagates ranges for the entire query on every call in
+/// order to construct a candidate counterexample. This stage is much
+/// cheaper: the per-cell ranges implied by the constraint set are
+/// propagated once and cached, and each query expression is then decided
+/// by a single interval evaluation against them. The cache is keyed by
+/// the constraint set the ranges were computed from, so a state picking
+/// up a new constraint simply misses and recomputes; no explicit
+/// invalidation hook is needed.
+class RangeSolver : public IncompleteSolver {
+  struct ConstraintRanges {
+    std::vector< ref<Expr> > constraints;
+    std::unique_ptr<CexData> data;
+  };
+
+  /// Propagation results, keyed by a hash of the constraint set. Hash
+  /// collisions just overwrite the previous entry; the whole table is
+  /// dropped once it grows past MaxCachedConstraintSets.
+  std::unordered_map<unsigned, ConstraintRanges> cache;
+  static const size_t MaxCachedConstraintSets = 1024;
+
+  CexData &getConstraintRanges(const Query &query);
+
+public:
+  IncompleteSolver::PartialValidity computeTruth(const Query&);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    // Constructing assignments is FastCexSolver's job; intervals alone
+    // cannot justify one.
+    return false;
+  }
+};
+
+CexData &RangeSolver::getConstraintRanges(const Query &query) {
+  unsigned hash = 0;
+  for (const auto &constraint : query.constraints)
+    hash = hash * Expr::MAGIC_HASH_CONSTANT + constraint->hash();
+
+  if (cache.size() >= MaxCachedConstraintSets)
+    cache.clear();
+
+  ConstraintRanges &cr = cache[hash];
+  if (!cr.data || cr.constraints.size() != query.constraints.size() ||
+      !std::equal(cr.constraints.begin(), cr.constraints.end(),
+                  query.constraints.begin())) {
+    cr.constraints.assign(query.constraints.begin(), query.constraints.end());
+    cr.data.reset(new CexData());
+    for (const auto &constraint : query.constraints) {
+      cr.data->propogateExactValue(constraint, 1);
+      cr.data->propogateExactBits(constraint, KnownBits::constant(1,
+                                                                  Expr::Bool));
+    }
+  }
+
+  return *cr.data;
+}
+
+IncompleteSolver::PartialValidity
+RangeSolver::computeTruth(const Query& query) {
+  CexData &cd = getConstraintRanges(query);
+
+  ValueRange range =
+    CexConstrainedRangeEvaluator(cd.objects).evaluate(query.expr);
+  if (range.mustEqual(1))
+    return IncompleteSolver::MustBeTrue;
+  if (range.mustEqual(0))
+    return IncompleteSolver::MustBeFalse;
+
+  // Fall back to the bit domain, which decides the mask/shift/byte
+  // extraction conditions intervals are blind to.
+  KnownBits kb = cd.evalBits(query.expr);
+  if (kb.isConstant(Expr::Bool))
+    return kb.value() ? IncompleteSolver::MustBeTrue
+                      : IncompleteSolver::MustBeFalse;
+
+  return IncompleteSolver::None;
+}
+
+bool RangeSolver::computeValue(const Query& query, ref<Expr> &result) {
+  CexData &cd = getConstraintRanges(query);
+
+  ValueRange range =
+    CexConstrainedRangeEvaluator(cd.objects).evaluate(query.expr);
+  if (range.isFixed()) {
+    result = ConstantExpr::create(range.min(), query.expr->getWidth());
+    return true;
+  }
+
+  Expr::Width width = query.expr->getWidth();
+  if (width <= 64) {
+    KnownBits kb = cd.evalBits(query.expr);
+    if (kb.isConstant(width)) {
+      result = ConstantExpr::create(kb.value(), width);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+Solver *klee::createRangeSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new RangeSolver(), s));
+}
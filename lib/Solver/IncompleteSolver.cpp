@@ -28,7 +28,23 @@ IncompleteSolver::negatePartialValidity(PartialValidity pv) {
   }
 }
 
-IncompleteSolver::PartialValidity 
+IncompleteSolver::PartialValidity
+IncompleteSolver::mergePartialValidity(PartialValidity a, PartialValidity b) {
+  if (a == None)
+    return b;
+  if (b == None || a == b)
+    return a;
+  // A complete result subsumes anything consistent with it.
+  if (a == MustBeTrue || a == MustBeFalse || a == TrueOrFalse)
+    return a;
+  if (b == MustBeTrue || b == MustBeFalse || b == TrueOrFalse)
+    return b;
+  // MayBeTrue and MayBeFalse: both kinds of assignment are known to
+  // exist.
+  return TrueOrFalse;
+}
+
+IncompleteSolver::PartialValidity
 IncompleteSolver::computeValidity(const Query& query) {
   PartialValidity trueResult = computeTruth(query);
 
@@ -69,44 +85,107 @@ StagedSolverImpl::~StagedSolverImpl() {
   delete secondary;
 }
 
+IncompleteSolver::PartialValidity
+StagedSolverImpl::lookupPartial(const Query &query) const {
+  auto it = partialCache.find(query.constraints.version());
+  if (it == partialCache.end())
+    return IncompleteSolver::None;
+  auto eit = it->second.find(query.expr);
+  return eit == it->second.end() ? IncompleteSolver::None : eit->second;
+}
+
+void StagedSolverImpl::rememberPartial(const Query &query,
+                                       IncompleteSolver::PartialValidity pv) {
+  if (pv == IncompleteSolver::None)
+    return;
+  if (partialCache.size() >= MaxPartialCacheVersions &&
+      !partialCache.count(query.constraints.version()))
+    partialCache.clear();
+  auto res = partialCache[query.constraints.version()].insert(
+      std::make_pair(query.expr, pv));
+  if (!res.second)
+    res.first->second =
+        IncompleteSolver::mergePartialValidity(res.first->second, pv);
+}
+
 bool StagedSolverImpl::computeTruth(const Query& query, bool &isValid) {
-  IncompleteSolver::PartialValidity trueResult = primary->computeTruth(query); 
-  
-  if (trueResult != IncompleteSolver::None) {
-    isValid = (trueResult == IncompleteSolver::MustBeTrue);
+  // Anything except MayBeTrue settles provability: a known false
+  // assignment refutes validity just as a proof confirms it.
+  IncompleteSolver::PartialValidity known = lookupPartial(query);
+  if (known != IncompleteSolver::None && known != IncompleteSolver::MayBeTrue) {
+    isValid = (known == IncompleteSolver::MustBeTrue);
     return true;
-  } 
+  }
+
+  IncompleteSolver::PartialValidity trueResult =
+      IncompleteSolver::mergePartialValidity(known,
+                                             primary->computeTruth(query));
 
-  return secondary->impl->computeTruth(query, isValid);
+  if (trueResult != IncompleteSolver::None) {
+    rememberPartial(query, trueResult);
+    if (trueResult != IncompleteSolver::MayBeTrue) {
+      isValid = (trueResult == IncompleteSolver::MustBeTrue);
+      return true;
+    }
+  }
+
+  if (!secondary->impl->computeTruth(query, isValid))
+    return false;
+  rememberPartial(query, isValid ? IncompleteSolver::MustBeTrue
+                         : trueResult == IncompleteSolver::MayBeTrue
+                             ? IncompleteSolver::TrueOrFalse
+                             : IncompleteSolver::MayBeFalse);
+  return true;
 }
 
 bool StagedSolverImpl::computeValidity(const Query& query,
                                        Solver::Validity &result) {
   bool tmp;
 
-  switch(primary->computeValidity(query)) {
-  case IncompleteSolver::MustBeTrue: 
+  IncompleteSolver::PartialValidity known = lookupPartial(query);
+  IncompleteSolver::PartialValidity pv = known;
+  if (pv == IncompleteSolver::None || pv == IncompleteSolver::MayBeTrue ||
+      pv == IncompleteSolver::MayBeFalse) {
+    // Compose the cheap pass with whatever an earlier query already
+    // established; one proven direction halves the backend work below.
+    pv = IncompleteSolver::mergePartialValidity(pv,
+                                                primary->computeValidity(query));
+    if (pv != known)
+      rememberPartial(query, pv);
+  }
+
+  switch (pv) {
+  case IncompleteSolver::MustBeTrue:
     result = Solver::True;
     break;
-  case IncompleteSolver::MustBeFalse: 
+  case IncompleteSolver::MustBeFalse:
     result = Solver::False;
     break;
-  case IncompleteSolver::TrueOrFalse: 
+  case IncompleteSolver::TrueOrFalse:
     result = Solver::Unknown;
     break;
   case IncompleteSolver::MayBeTrue:
     if (!secondary->impl->computeTruth(query, tmp))
       return false;
     result = tmp ? Solver::True : Solver::Unknown;
+    rememberPartial(query, tmp ? IncompleteSolver::MustBeTrue
+                               : IncompleteSolver::TrueOrFalse);
     break;
   case IncompleteSolver::MayBeFalse:
     if (!secondary->impl->computeTruth(query.negateExpr(), tmp))
       return false;
     result = tmp ? Solver::False : Solver::Unknown;
+    rememberPartial(query, tmp ? IncompleteSolver::MustBeFalse
+                               : IncompleteSolver::TrueOrFalse);
     break;
   default:
     if (!secondary->impl->computeValidity(query, result))
       return false;
+    rememberPartial(query, result == Solver::True
+                               ? IncompleteSolver::MustBeTrue
+                               : result == Solver::False
+                                     ? IncompleteSolver::MustBeFalse
+                                     : IncompleteSolver::TrueOrFalse);
     break;
   }
 
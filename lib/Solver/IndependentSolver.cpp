@@ -10,23 +10,47 @@
 #define DEBUG_TYPE "independent-solver"
 #include "klee/Solver/Solver.h"
 
+#include "klee/ADT/Ref.h"
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Support/Debug.h"
+#include "klee/Support/ErrorHandling.h"
+#include "klee/Support/OptionCategories.h"
+#include "klee/Solver/SolverCmdLine.h"
 #include "klee/Solver/SolverImpl.h"
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <condition_variable>
+#include <deque>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <ostream>
+#include <thread>
 #include <vector>
 
 using namespace klee;
 using namespace llvm;
 
+namespace {
+llvm::cl::opt<unsigned> IndependentParallelSolvers(
+    "independent-parallel-solvers", llvm::cl::init(0),
+    llvm::cl::desc("Number of extra core solver instances used to solve the "
+                   "independent factors of a counterexample query "
+                   "concurrently instead of one after another. Factor "
+                   "queries dispatched to the pool bypass the caching stages "
+                   "beneath the independent solver, so this pays off for "
+                   "states with many independent symbolic objects "
+                   "(default=0, meaning sequential)"),
+    llvm::cl::cat(klee::ParallelCat));
+}
+
 template<class T>
 class DenseSet {
   typedef std::set<T> set_ty;
@@ -72,6 +96,10 @@ public:
     return s.end();
   }
 
+  typename set_ty::const_iterator begin() const { return s.begin(); }
+
+  typename set_ty::const_iterator end() const { return s.end(); }
+
   void print(llvm::raw_ostream &os) const {
     bool first = true;
     os << "{";
@@ -255,97 +283,176 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
   return os;
 }
 
+// Cache of per-expression element sets. The same constraint expressions
+// recur in query after query (states re-query between appends, and forked
+// states share their constraint prefix), and the findReads traversal in
+// the IndependentElementSet constructor dominates the cost of
+// partitioning, so memoize it keyed by expression. Each IndependentSolver
+// owns one cache: a solver chain is only ever driven by one thread at a
+// time (parallel workers and the prefetch thread each construct private
+// chains), so per-instance state needs no locking where a table shared
+// between instances would.
+class ElementSetCache {
+  ExprHashMap<IndependentElementSet> cache;
+
+public:
+  const IndependentElementSet &get(const ref<Expr> &e) {
+    ExprHashMap<IndependentElementSet>::iterator it = cache.find(e);
+    if (it != cache.end())
+      return it->second;
+    return cache.insert(std::make_pair(e, IndependentElementSet(e)))
+        .first->second;
+  }
+
+  // Called between partition computations (never during one, so cached
+  // entries stay valid while in use) to keep the cache from pinning dead
+  // expressions forever.
+  void prune() {
+    static const size_t MaxCacheSize = 1 << 18;
+    if (cache.size() > MaxCacheSize)
+      cache.clear();
+  }
+};
+
+/// Computes the connected components of the "accesses the same symbolic
+/// memory" relation over a group of expressions. Instead of the old
+/// quadratic intersect-and-merge fixed point this unions each expression
+/// with per-cell anchors: one anchor per concrete (array, index) cell and
+/// one per symbolically indexed array, the latter subsuming the array's
+/// cell anchors. Two expressions end up in the same component exactly
+/// when a chain of overlapping accesses connects them, which is the same
+/// closure the fixed point computed.
+class IndependentComponentFinder {
+  std::vector<int> parent;
+  std::map<const Array *, int> wholeAnchor;
+  std::map<const Array *, std::map<unsigned, int>> elementAnchor;
+
+  void merge(int a, int b) {
+    a = find(a);
+    b = find(b);
+    if (a != b)
+      parent[a] = b;
+  }
+
+public:
+  int find(int x) {
+    while (parent[x] != x) {
+      parent[x] = parent[parent[x]];
+      x = parent[x];
+    }
+    return x;
+  }
+
+  int add(const IndependentElementSet &ies) {
+    int id = parent.size();
+    parent.push_back(id);
+
+    for (const Array *array : ies.wholeObjects) {
+      std::map<const Array *, int>::iterator wit = wholeAnchor.find(array);
+      if (wit != wholeAnchor.end()) {
+        merge(id, wit->second);
+      } else {
+        wholeAnchor[array] = id;
+        // A symbolic access overlaps every cell of the array; fold the
+        // existing per-cell anchors in and retire them.
+        std::map<const Array *, std::map<unsigned, int>>::iterator eit =
+            elementAnchor.find(array);
+        if (eit != elementAnchor.end()) {
+          for (auto const &cell : eit->second)
+            merge(id, cell.second);
+          elementAnchor.erase(eit);
+        }
+      }
+    }
+
+    for (auto const &access : ies.elements) {
+      const Array *array = access.first;
+      std::map<const Array *, int>::iterator wit = wholeAnchor.find(array);
+      if (wit != wholeAnchor.end()) {
+        merge(id, wit->second);
+        continue;
+      }
+      std::map<unsigned, int> &anchors = elementAnchor[array];
+      for (unsigned index : access.second) {
+        auto res = anchors.insert(std::make_pair(index, id));
+        if (!res.second)
+          merge(id, res.first->second);
+      }
+    }
+
+    return id;
+  }
+
+  bool connected(int a, int b) { return find(a) == find(b); }
+};
+
 // Breaks down a constraint into all of it's individual pieces, returning a
 // list of IndependentElementSets or the independent factors.
 //
 // Caller takes ownership of returned std::list.
 static std::list<IndependentElementSet>*
-getAllIndependentConstraintsSets(const Query &query) {
+getAllIndependentConstraintsSets(const Query &query,
+                                 ElementSetCache &elementSets) {
+  elementSets.prune();
+
   std::list<IndependentElementSet> *factors = new std::list<IndependentElementSet>();
+  std::vector<ref<Expr>> exprs;
   ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr);
   if (CE) {
     assert(CE && CE->isFalse() && "the expr should always be false and "
                                   "therefore not included in factors");
   } else {
-    ref<Expr> neg = Expr::createIsZero(query.expr);
-    factors->push_back(IndependentElementSet(neg));
+    exprs.push_back(Expr::createIsZero(query.expr));
   }
 
-  for (const auto &constraint : query.constraints) {
-    // iterate through all the previously separated constraints.  Until we
-    // actually return, factors is treated as a queue of expressions to be
-    // evaluated.  If the queue property isn't maintained, then the exprs
-    // could be returned in an order different from how they came it, negatively
-    // affecting later stages.
-    factors->push_back(IndependentElementSet(constraint));
-  }
-
-  bool doneLoop = false;
-  do {
-    doneLoop = true;
-    std::list<IndependentElementSet> *done =
-        new std::list<IndependentElementSet>;
-    while (factors->size() > 0) {
-      IndependentElementSet current = factors->front();
-      factors->pop_front();
-      // This list represents the set of factors that are separate from current.
-      // Those that are not inserted into this list (queue) intersect with
-      // current.
-      std::list<IndependentElementSet> *keep =
-          new std::list<IndependentElementSet>;
-      while (factors->size() > 0) {
-        IndependentElementSet compare = factors->front();
-        factors->pop_front();
-        if (current.intersects(compare)) {
-          if (current.add(compare)) {
-            // Means that we have added (z=y)added to (x=y)
-            // Now need to see if there are any (z=?)'s
-            doneLoop = false;
-          }
-        } else {
-          keep->push_back(compare);
-        }
-      }
-      done->push_back(current);
-      delete factors;
-      factors = keep;
+  for (const auto &constraint : query.constraints)
+    exprs.push_back(constraint);
+
+  IndependentComponentFinder finder;
+  std::vector<int> nodes;
+  nodes.reserve(exprs.size());
+  for (const auto &e : exprs)
+    nodes.push_back(finder.add(elementSets.get(e)));
+
+  // Emit one factor per component. Expressions are added in their
+  // original order so the exprs of each factor keep the order they came
+  // in, which later stages rely on.
+  std::map<int, IndependentElementSet *> components;
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    int root = finder.find(nodes[i]);
+    IndependentElementSet *&factor = components[root];
+    if (!factor) {
+      factors->push_back(IndependentElementSet());
+      factor = &factors->back();
     }
-    delete factors;
-    factors = done;
-  } while (!doneLoop);
+    factor->add(elementSets.get(exprs[i]));
+  }
 
   return factors;
 }
 
-static 
+static
 IndependentElementSet getIndependentConstraints(const Query& query,
-                                                std::vector< ref<Expr> > &result) {
+                                                std::vector< ref<Expr> > &result,
+                                                ElementSetCache &elementSets) {
+  elementSets.prune();
+
   IndependentElementSet eltsClosure(query.expr);
-  std::vector< std::pair<ref<Expr>, IndependentElementSet> > worklist;
 
+  IndependentComponentFinder finder;
+  int queryNode = finder.add(eltsClosure);
+  std::vector<int> nodes;
+  nodes.reserve(query.constraints.size());
   for (const auto &constraint : query.constraints)
-    worklist.push_back(
-        std::make_pair(constraint, IndependentElementSet(constraint)));
-
-  // XXX This should be more efficient (in terms of low level copy stuff).
-  bool done = false;
-  do {
-    done = true;
-    std::vector< std::pair<ref<Expr>, IndependentElementSet> > newWorklist;
-    for (std::vector< std::pair<ref<Expr>, IndependentElementSet> >::iterator
-           it = worklist.begin(), ie = worklist.end(); it != ie; ++it) {
-      if (it->second.intersects(eltsClosure)) {
-        if (eltsClosure.add(it->second))
-          done = false;
-        result.push_back(it->first);
-        // Means that we have added (z=y)added to (x=y)
-        // Now need to see if there are any (z=?)'s
-      } else {
-        newWorklist.push_back(*it);
-      }
+    nodes.push_back(finder.add(elementSets.get(constraint)));
+
+  unsigned i = 0;
+  for (const auto &constraint : query.constraints) {
+    if (finder.connected(nodes[i++], queryNode)) {
+      result.push_back(constraint);
+      eltsClosure.add(elementSets.get(constraint));
     }
-    worklist.swap(newWorklist);
-  } while (!done);
+  }
 
   KLEE_DEBUG(
     std::set< ref<Expr> > reqset(result.begin(), result.end());
@@ -390,10 +497,62 @@ class IndependentSolver : public SolverImpl {
 private:
   Solver *solver;
 
+  /// Memoized element sets for this instance's partition computations.
+  ElementSetCache elementSets;
+
+  /// One factored sub-problem of a computeInitialValues() query.
+  /// Written by exactly one pool worker (or the caller, when solving
+  /// sequentially); the caller reads it only after \c done is set.
+  struct FactorJob {
+    IndependentElementSet *factor;
+    std::vector<const Array *> arrays;
+    std::vector<std::vector<unsigned char>> values;
+    bool hasSolution = true;
+    bool success = false;
+    bool done = false;
+  };
+
+  /// Worker pool for -independent-parallel-solvers. The child chain is
+  /// not thread-safe, so each worker owns a private core solver; only
+  /// computeInitialValues() dispatches to the pool, and only while the
+  /// caller blocks, so jobs can live on its stack.
+  std::vector<std::unique_ptr<Solver>> poolSolvers;
+  std::vector<std::thread> poolThreads;
+  std::mutex poolMutex;
+  std::condition_variable poolWake, poolDone;
+  std::deque<FactorJob *> poolQueue;
+  bool poolShutdown = false;
+
+  void factorWorkerLoop(Solver *poolSolver);
+
 public:
-  IndependentSolver(Solver *_solver) 
-    : solver(_solver) {}
-  ~IndependentSolver() { delete solver; }
+  IndependentSolver(Solver *_solver) : solver(_solver) {
+    // Factor jobs hand query refs to pool workers; route reference
+    // counting through the shared atomic before they can exist.
+    if (IndependentParallelSolvers > 0)
+      ReferenceCounter::disableBias();
+    for (unsigned i = 0; i < IndependentParallelSolvers; ++i) {
+      Solver *poolSolver = createCoreSolver(CoreSolverToUse);
+      if (!poolSolver)
+        klee_error("Failed to create core solver for factor pool\n");
+      poolSolvers.emplace_back(poolSolver);
+    }
+    for (auto &poolSolver : poolSolvers)
+      poolThreads.emplace_back(&IndependentSolver::factorWorkerLoop, this,
+                               poolSolver.get());
+  }
+
+  ~IndependentSolver() {
+    {
+      std::lock_guard<std::mutex> guard(poolMutex);
+      poolShutdown = true;
+    }
+    poolWake.notify_all();
+    for (auto &thread : poolThreads)
+      thread.join();
+    poolSolvers.clear();
+    delete solver;
+  }
 
   bool computeTruth(const Query&, bool &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
@@ -411,7 +570,7 @@ bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
   IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+    getIndependentConstraints(query, required, elementSets);
   ConstraintSet tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
@@ -420,7 +579,7 @@ bool IndependentSolver::computeValidity(const Query& query,
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
   IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+    getIndependentConstraints(query, required, elementSets);
   ConstraintSet tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
@@ -429,7 +588,7 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
   IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+    getIndependentConstraints(query, required, elementSets);
   ConstraintSet tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
@@ -480,50 +639,93 @@ bool IndependentSolver::computeInitialValues(const Query& query,
   hasSolution = true;
   // FIXME: When we switch to C++11 this should be a std::unique_ptr so we don't need
   // to remember to manually call delete
-  std::list<IndependentElementSet> *factors = getAllIndependentConstraintsSets(query);
+  std::list<IndependentElementSet> *factors = getAllIndependentConstraintsSets(query, elementSets);
 
-  //Used to rearrange all of the answers into the correct order
-  std::map<const Array*, std::vector<unsigned char> > retMap;
+  // Collect the sub-problems first so they can be dispatched to the
+  // worker pool when one is configured.
+  std::vector<FactorJob> jobs;
   for (std::list<IndependentElementSet>::iterator it = factors->begin();
        it != factors->end(); ++it) {
-    std::vector<const Array*> arraysInFactor;
-    calculateArrayReferences(*it, arraysInFactor);
     // Going to use this as the "fresh" expression for the Query() invocation below
     assert(it->exprs.size() >= 1 && "No null/empty factors");
+    std::vector<const Array*> arraysInFactor;
+    calculateArrayReferences(*it, arraysInFactor);
     if (arraysInFactor.size() == 0){
       continue;
     }
-    ConstraintSet tmp(it->exprs);
-    std::vector<std::vector<unsigned char> > tempValues;
-    if (!solver->impl->computeInitialValues(Query(tmp, ConstantExpr::alloc(0, Expr::Bool)),
-                                            arraysInFactor, tempValues, hasSolution)){
+    FactorJob job;
+    job.factor = &*it;
+    job.arrays = std::move(arraysInFactor);
+    jobs.push_back(std::move(job));
+  }
+
+  if (!poolThreads.empty() && jobs.size() > 1) {
+    // The factors share nothing, so their counterexample queries can run
+    // on the pool concurrently; the caller just waits for the last one.
+    {
+      std::lock_guard<std::mutex> guard(poolMutex);
+      for (FactorJob &job : jobs)
+        poolQueue.push_back(&job);
+    }
+    poolWake.notify_all();
+    std::unique_lock<std::mutex> lock(poolMutex);
+    poolDone.wait(lock, [&jobs] {
+      for (const FactorJob &job : jobs)
+        if (!job.done)
+          return false;
+      return true;
+    });
+  } else {
+    for (FactorJob &job : jobs) {
+      ConstraintSet tmp(job.factor->exprs);
+      job.success = solver->impl->computeInitialValues(
+          Query(tmp, ConstantExpr::alloc(0, Expr::Bool)), job.arrays,
+          job.values, job.hasSolution);
+      job.done = true;
+      if (!job.success || !job.hasSolution)
+        break;
+    }
+  }
+
+  // Jobs left untouched by the sequential early exit are skipped here;
+  // the failure that stopped the loop decides the overall answer.
+  for (const FactorJob &job : jobs) {
+    if (job.done && !job.success) {
       values.clear();
       delete factors;
       return false;
-    } else if (!hasSolution){
+    }
+  }
+  for (const FactorJob &job : jobs) {
+    if (job.done && !job.hasSolution) {
       values.clear();
+      hasSolution = false;
       delete factors;
       return true;
-    } else {
-      assert(tempValues.size() == arraysInFactor.size() &&
-             "Should be equal number arrays and answers");
-      for (unsigned i = 0; i < tempValues.size(); i++){
-        if (retMap.count(arraysInFactor[i])){
-          // We already have an array with some partially correct answers,
-          // so we need to place the answers to the new query into the right
-          // spot while avoiding the undetermined values also in the array
-          std::vector<unsigned char> * tempPtr = &retMap[arraysInFactor[i]];
-          assert(tempPtr->size() == tempValues[i].size() &&
-                 "we're talking about the same array here");
-          ::DenseSet<unsigned> * ds = &(it->elements[arraysInFactor[i]]);
-          for (std::set<unsigned>::iterator it2 = ds->begin(); it2 != ds->end(); it2++){
-            unsigned index = * it2;
-            (* tempPtr)[index] = tempValues[i][index];
-          }
-        } else {
-          // Dump all the new values into the array
-          retMap[arraysInFactor[i]] = tempValues[i];
+    }
+  }
+
+  //Used to rearrange all of the answers into the correct order
+  std::map<const Array*, std::vector<unsigned char> > retMap;
+  for (FactorJob &job : jobs) {
+    assert(job.values.size() == job.arrays.size() &&
+           "Should be equal number arrays and answers");
+    for (unsigned i = 0; i < job.values.size(); i++){
+      if (retMap.count(job.arrays[i])){
+        // We already have an array with some partially correct answers,
+        // so we need to place the answers to the new query into the right
+        // spot while avoiding the undetermined values also in the array
+        std::vector<unsigned char> * tempPtr = &retMap[job.arrays[i]];
+        assert(tempPtr->size() == job.values[i].size() &&
+               "we're talking about the same array here");
+        ::DenseSet<unsigned> * ds = &(job.factor->elements[job.arrays[i]]);
+        for (std::set<unsigned>::iterator it2 = ds->begin(); it2 != ds->end(); it2++){
+          unsigned index = * it2;
+          (* tempPtr)[index] = job.values[i][index];
         }
+      } else {
+        // Dump all the new values into the array
+        retMap[job.arrays[i]] = job.values[i];
       }
     }
   }
@@ -545,6 +747,28 @@ bool IndependentSolver::computeInitialValues(const Query& query,
   return true;
 }
 
+void IndependentSolver::factorWorkerLoop(Solver *poolSolver) {
+  std::unique_lock<std::mutex> lock(poolMutex);
+  while (true) {
+    poolWake.wait(lock, [this] { return poolShutdown || !poolQueue.empty(); });
+    if (poolShutdown)
+      return;
+
+    FactorJob *job = poolQueue.front();
+    poolQueue.pop_front();
+    lock.unlock();
+
+    ConstraintSet tmp(job->factor->exprs);
+    job->success = poolSolver->impl->computeInitialValues(
+        Query(tmp, ConstantExpr::alloc(0, Expr::Bool)), job->arrays,
+        job->values, job->hasSolution);
+
+    lock.lock();
+    job->done = true;
+    poolDone.notify_all();
+  }
+}
+
 SolverImpl::SolverRunStatus IndependentSolver::getOperationStatusCode() {
   return solver->impl->getOperationStatusCode();      
 }
@@ -555,6 +779,10 @@ char *IndependentSolver::getConstraintLog(const Query& query) {
 
 void IndependentSolver::setCoreSolverTimeout(time::Span timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
+  // The pool is guaranteed idle here: it only runs while the caller is
+  // blocked inside computeInitialValues().
+  for (auto &poolSolver : poolSolvers)
+    poolSolver->impl->setCoreSolverTimeout(timeout);
 }
 
 Solver *klee::createIndependentSolver(Solver *s) {
@@ -10,7 +10,7 @@
 #ifndef KLEE_METASMTBUILDER_H
 #define KLEE_METASMTBUILDER_H
 
-#include "ConstantDivision.h"
+#include "klee/Expr/ConstantDivision.h"
 
 #include "klee/Config/config.h"
 #include "klee/Expr/ArrayExprHash.h"
@@ -53,24 +53,10 @@
 
 #include <errno.h>
 #include <signal.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-static unsigned char *shared_memory_ptr;
-static int shared_memory_id = 0;
-// Darwin by default has a very small limit on the maximum amount of shared
-// memory, which will quickly be exhausted by KLEE running its tests in
-// parallel. For now, we work around this by just requesting a smaller size --
-// in practice users hitting this limit on counterexample sizes probably already
-// are hitting more serious scalability issues.
-#ifdef __APPLE__
-static const unsigned shared_memory_size = 1 << 16;
-#else
-static const unsigned shared_memory_size = 1 << 20;
-#endif
-
 namespace klee {
 
 template <typename SolverContext> class MetaSMTSolverImpl : public SolverImpl {
@@ -82,6 +68,15 @@ private:
   bool _useForked;
   SolverRunStatus _runStatusCode;
 
+  // Persistent arena for passing counterexamples back from the forked
+  // solver; an anonymous shared mapping inherited across fork(), grown
+  // geometrically when a query's objects outgrow it.
+  unsigned char *_sharedMemory = nullptr;
+  size_t _sharedMemorySize = 0;
+
+  /// Ensure \ref _sharedMemory can hold at least \p required bytes.
+  void ensureSharedMemory(size_t required);
+
 public:
   MetaSMTSolverImpl(MetaSMTSolver<SolverContext> *solver, bool useForked,
                     bool optimizeDivides);
@@ -122,19 +117,31 @@ MetaSMTSolverImpl<SolverContext>::MetaSMTSolverImpl(
       _useForked(useForked) {
   assert(_solver && "unable to create MetaSMTSolver");
   assert(_builder && "unable to create MetaSMTBuilder");
+}
 
-  if (_useForked) {
-    shared_memory_id =
-        shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    assert(shared_memory_id >= 0 && "shmget failed");
-    shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, NULL, 0);
-    assert(shared_memory_ptr != (void *)-1 && "shmat failed");
-    shmctl(shared_memory_id, IPC_RMID, NULL);
-  }
+template <typename SolverContext>
+MetaSMTSolverImpl<SolverContext>::~MetaSMTSolverImpl() {
+  if (_sharedMemory)
+    munmap(_sharedMemory, _sharedMemorySize);
 }
 
 template <typename SolverContext>
-MetaSMTSolverImpl<SolverContext>::~MetaSMTSolverImpl() {}
+void MetaSMTSolverImpl<SolverContext>::ensureSharedMemory(size_t required) {
+  if (required <= _sharedMemorySize)
+    return;
+
+  size_t size = _sharedMemorySize ? _sharedMemorySize : (size_t)1 << 20;
+  while (size < required)
+    size *= 2;
+
+  if (_sharedMemory)
+    munmap(_sharedMemory, _sharedMemorySize);
+  _sharedMemory = (unsigned char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (_sharedMemory == MAP_FAILED)
+    llvm::report_fatal_error("unable to allocate shared memory region");
+  _sharedMemorySize = size;
+}
 
 template <typename SolverContext>
 char *MetaSMTSolverImpl<SolverContext>::getConstraintLog(const Query &) {
@@ -198,7 +205,16 @@ bool MetaSMTSolverImpl<SolverContext>::computeInitialValues(
   ++stats::queryCounterexamples;
 
   bool success = true;
-  if (_useForked) {
+  if (_useForked && _timeout) {
+    // Enforcing the timeout is the only thing the fork is for; without
+    // one the query runs in process on the persistent solver context,
+    // saving the fork and the full re-translation inside the child.
+    size_t sum = 0;
+    for (const auto object : objects)
+      sum += object->size;
+    sum += sizeof(stats::queryConstructs);
+    ensureSharedMemory(sum);
+
     _runStatusCode =
         runAndGetCexForked(query, objects, values, hasSolution, _timeout);
     success = ((SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == _runStatusCode) ||
@@ -273,17 +289,7 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
     time::Span timeout) {
-  unsigned char *pos = shared_memory_ptr;
-  unsigned sum = 0;
-  for (std::vector<const Array *>::const_iterator it = objects.begin(),
-                                                  ie = objects.end();
-       it != ie; ++it) {
-    sum += (*it)->size;
-  }
-  // sum += sizeof(uint64_t);
-  sum += sizeof(stats::queryConstructs);
-  assert(sum < shared_memory_size &&
-         "not enough shared memory for counterexample");
+  unsigned char *pos = _sharedMemory;
 
   fflush(stdout);
   fflush(stderr);
@@ -0,0 +1,229 @@
+//===-- MeteredSolver.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Support/ErrorHandling.h"
+#include "klee/Support/Timer.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// Process-wide registry of stage metrics, in registration (i.e. chain
+/// construction, innermost-first) order. Guarded by registryMutex since
+/// parallel workers construct their chains concurrently.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<SolverStageMetrics>> registry;
+
+/// A pass-through solver that counts the queries reaching a chain stage
+/// and the wall time spent below it.
+class MeteredSolver : public SolverImpl {
+private:
+  Solver *solver;
+  SolverStageMetrics *metrics;
+
+public:
+  MeteredSolver(Solver *s, const std::string &name, const std::string &inner)
+      : solver(s), metrics(registerSolverStageMetrics(name, inner)) {}
+  ~MeteredSolver() { delete solver; }
+
+  bool computeValidity(const Query &query, Solver::Validity &result) {
+    ++metrics->queries;
+    WallTimer timer;
+    bool success = solver->impl->computeValidity(query, result);
+    metrics->time += timer.delta();
+    return success;
+  }
+
+  bool computeTruth(const Query &query, bool &isValid) {
+    ++metrics->queries;
+    WallTimer timer;
+    bool success = solver->impl->computeTruth(query, isValid);
+    metrics->time += timer.delta();
+    return success;
+  }
+
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    ++metrics->queries;
+    WallTimer timer;
+    bool success = solver->impl->computeValue(query, result);
+    metrics->time += timer.delta();
+    return success;
+  }
+
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) {
+    ++metrics->queries;
+    WallTimer timer;
+    bool success =
+        solver->impl->computeInitialValues(query, objects, values, hasSolution);
+    metrics->time += timer.delta();
+    return success;
+  }
+
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+
+  void setCoreSolverTimeout(time::Span timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+/// Per-stage counters after aggregating all records of one name.
+struct StageTotals {
+  std::string inner;
+  std::uint64_t queries = 0;
+  std::uint64_t timeUSec = 0;
+};
+
+/// Parse the per-stage lines of a report written by
+/// reportSolverStageMetrics() from a previous run.
+std::map<std::string, StageTotals>
+parseBaseline(const std::string &baselinePath) {
+  std::map<std::string, StageTotals> baseline;
+
+  auto bufferOrErr = llvm::MemoryBuffer::getFile(baselinePath);
+  if (!bufferOrErr) {
+    klee_warning("cannot read benchmark baseline %s: %s", baselinePath.c_str(),
+                 bufferOrErr.getError().message().c_str());
+    return baseline;
+  }
+
+  llvm::SmallVector<llvm::StringRef, 32> lines;
+  (*bufferOrErr)->getBuffer().split(lines, '\n');
+  for (const auto &lineRef : lines) {
+    const std::string line = lineRef.str();
+    char stage[128];
+    unsigned long long queries, hits, timeUSec;
+    double hitRate;
+    if (std::sscanf(line.c_str(),
+                    " {\"stage\": \"%127[^\"]\", \"queries\": %llu, "
+                    "\"hits\": %llu, \"hit_rate\": %lf, \"time_us\": %llu",
+                    stage, &queries, &hits, &hitRate, &timeUSec) == 5) {
+      StageTotals &totals = baseline[stage];
+      totals.queries = queries;
+      totals.timeUSec = timeUSec;
+    }
+  }
+  return baseline;
+}
+
+/// Relative change in percent, or 0 when the baseline value is 0.
+double relativeChange(std::uint64_t baseline, std::uint64_t current) {
+  if (!baseline)
+    return 0.0;
+  return 100.0 * ((double)current - (double)baseline) / (double)baseline;
+}
+
+} // namespace
+
+SolverStageMetrics *
+klee::registerSolverStageMetrics(const std::string &name,
+                                 const std::string &inner) {
+  std::lock_guard<std::mutex> guard(registryMutex);
+  registry.emplace_back(new SolverStageMetrics());
+  registry.back()->name = name;
+  registry.back()->inner = inner;
+  return registry.back().get();
+}
+
+void klee::reportSolverStageMetrics(llvm::raw_ostream &os,
+                                    const std::string &baselinePath) {
+  // Aggregate the registered records by stage name, keeping the
+  // innermost-first registration order.
+  std::vector<std::string> order;
+  std::map<std::string, StageTotals> totals;
+  {
+    std::lock_guard<std::mutex> guard(registryMutex);
+    for (const auto &metrics : registry) {
+      auto it = totals.find(metrics->name);
+      if (it == totals.end()) {
+        order.push_back(metrics->name);
+        it = totals.emplace(metrics->name, StageTotals()).first;
+        it->second.inner = metrics->inner;
+      }
+      it->second.queries += metrics->queries;
+      it->second.timeUSec += metrics->time.toMicroseconds();
+    }
+  }
+
+  os << "{\n  \"stages\": [\n";
+  for (std::size_t i = 0, e = order.size(); i != e; ++i) {
+    const StageTotals &stage = totals[order[i]];
+
+    // Queries answered by this stage itself are those that did not reach
+    // the metered stage directly beneath it. The innermost metered stage
+    // has nothing to absorb queries from, so its hit count stays 0.
+    std::uint64_t hits = 0;
+    std::uint64_t selfTimeUSec = stage.timeUSec;
+    auto inner = totals.find(stage.inner);
+    if (!stage.inner.empty() && inner != totals.end()) {
+      const StageTotals &below = inner->second;
+      hits = stage.queries > below.queries ? stage.queries - below.queries : 0;
+      selfTimeUSec = stage.timeUSec > below.timeUSec
+                         ? stage.timeUSec - below.timeUSec
+                         : 0;
+    }
+    const double hitRate = stage.queries ? (double)hits / stage.queries : 0.0;
+
+    os << "    {\"stage\": \"" << order[i] << "\", \"queries\": "
+       << stage.queries << ", \"hits\": " << hits << ", \"hit_rate\": "
+       << llvm::format("%.4f", hitRate) << ", \"time_us\": " << stage.timeUSec
+       << ", \"self_time_us\": " << selfTimeUSec << "}"
+       << (i + 1 != e ? "," : "") << "\n";
+  }
+  os << "  ]\n}\n";
+
+  if (baselinePath.empty())
+    return;
+
+  const std::map<std::string, StageTotals> baseline =
+      parseBaseline(baselinePath);
+  for (const auto &name : order) {
+    auto it = baseline.find(name);
+    if (it == baseline.end())
+      continue;
+    const StageTotals &was = it->second;
+    const StageTotals &now = totals[name];
+    llvm::errs() << "benchmark: " << name << ": time " << was.timeUSec
+                 << "us -> " << now.timeUSec << "us ("
+                 << llvm::format("%+.1f%%",
+                                 relativeChange(was.timeUSec, now.timeUSec))
+                 << "), queries " << was.queries << " -> " << now.queries
+                 << " ("
+                 << llvm::format("%+.1f%%",
+                                 relativeChange(was.queries, now.queries))
+                 << ")\n";
+  }
+}
+
+Solver *klee::createMeteredSolver(Solver *s, const std::string &name,
+                                  const std::string &inner) {
+  return new Solver(new MeteredSolver(s, name, inner));
+}
@@ -0,0 +1,266 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/ADT/Ref.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// PortfolioSolverImpl - Dispatches each query to several child solvers
+/// on persistent worker threads and returns the first answer, so query
+/// latency tracks the fastest backend for that particular query rather
+/// than a single backend chosen at startup.
+///
+/// The SolverImpl interface has no way to interrupt a running backend,
+/// so "cancellation" of the losers is best-effort: a child still busy
+/// with a previous query is simply skipped when the next query is
+/// dispatched, and the core solver timeout bounds the wasted work.
+/// Children that lose a race keep running after the query has returned;
+/// they therefore operate on copies of the query data and only the race
+/// winner writes to the caller's output parameters.
+class PortfolioSolverImpl : public SolverImpl {
+  struct Child {
+    std::unique_ptr<Solver> solver;
+    std::thread thread;
+    // All remaining fields are protected by \ref mutex.
+    bool busy = false;
+    uint64_t job = 0;
+    std::function<void(Child *, std::unique_lock<std::mutex> &)> work;
+  };
+
+  std::vector<std::unique_ptr<Child>> children;
+  std::mutex mutex;
+  std::condition_variable workerWake, queryDone;
+  bool shuttingDown = false;
+
+  // Race state for the query currently being dispatched.
+  uint64_t currentJob = 0;
+  unsigned pendingChildren = 0;
+  bool resultSuccess = false;
+  SolverRunStatus lastStatus = SOLVER_RUN_STATUS_FAILURE;
+
+  void workerLoop(Child *c);
+  bool runOnPortfolio(
+      const std::function<void(Child *, std::unique_lock<std::mutex> &)>
+          &work);
+
+  /// Called by a worker, with the lock held, after its query returned
+  /// successfully. Returns true iff this worker is the first to answer
+  /// the current query; the winner then commits its results while the
+  /// caller is still blocked in runOnPortfolio().
+  bool claimWin(uint64_t job) {
+    if (job != currentJob || resultSuccess)
+      return false;
+    resultSuccess = true;
+    return true;
+  }
+
+public:
+  PortfolioSolverImpl(std::vector<std::unique_ptr<Solver>> solvers);
+  ~PortfolioSolverImpl();
+
+  bool computeTruth(const Query &, bool &isValid) override;
+  bool computeValidity(const Query &, Solver::Validity &result) override;
+  bool computeValue(const Query &, ref<Expr> &result) override;
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override;
+  SolverRunStatus getOperationStatusCode() override;
+  char *getConstraintLog(const Query &) override;
+  void setCoreSolverTimeout(time::Span timeout) override;
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    std::vector<std::unique_ptr<Solver>> solvers) {
+  // Submitted work captures ref graphs built on the submitting thread
+  // and destroys them on whichever worker loses the race; the biased
+  // reference counting fast path cannot balance such moves.
+  ReferenceCounter::disableBias();
+  for (auto &solver : solvers) {
+    auto c = std::make_unique<Child>();
+    c->solver = std::move(solver);
+    children.push_back(std::move(c));
+  }
+  for (auto &c : children)
+    c->thread = std::thread(&PortfolioSolverImpl::workerLoop, this, c.get());
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    shuttingDown = true;
+  }
+  workerWake.notify_all();
+  for (auto &c : children)
+    c->thread.join();
+}
+
+void PortfolioSolverImpl::workerLoop(Child *c) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    workerWake.wait(lock, [&] { return shuttingDown || c->work; });
+    if (shuttingDown)
+      return;
+
+    std::function<void(Child *, std::unique_lock<std::mutex> &)> work;
+    work.swap(c->work);
+    work(c, lock); // drops the lock around the underlying solver call
+
+    c->busy = false;
+    // Losers of an earlier race must not disturb the current dispatch.
+    if (c->job == currentJob)
+      --pendingChildren;
+    queryDone.notify_all();
+  }
+}
+
+bool PortfolioSolverImpl::runOnPortfolio(
+    const std::function<void(Child *, std::unique_lock<std::mutex> &)> &work) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  // Wait until at least one child is free; children still busy with the
+  // previous query (last race's losers) are skipped this round.
+  queryDone.wait(lock, [&] {
+    for (auto &c : children)
+      if (!c->busy)
+        return true;
+    return false;
+  });
+
+  ++currentJob;
+  resultSuccess = false;
+  pendingChildren = 0;
+  for (auto &c : children) {
+    if (c->busy)
+      continue;
+    c->busy = true;
+    c->job = currentJob;
+    c->work = work; // each child runs its own copy
+    ++pendingChildren;
+  }
+  workerWake.notify_all();
+
+  queryDone.wait(lock, [&] { return resultSuccess || pendingChildren == 0; });
+  return resultSuccess;
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  auto constraints = std::make_shared<ConstraintSet>(query.constraints);
+  ref<Expr> expr = query.expr;
+  return runOnPortfolio([=, &isValid](Child *c,
+                                      std::unique_lock<std::mutex> &lock) {
+    bool childIsValid = false;
+    uint64_t job = c->job;
+    Solver *s = c->solver.get();
+    lock.unlock();
+    bool ok = s->impl->computeTruth(Query(*constraints, expr), childIsValid);
+    lock.lock();
+    if (ok && claimWin(job)) {
+      isValid = childIsValid;
+      lastStatus = s->impl->getOperationStatusCode();
+    }
+  });
+}
+
+bool PortfolioSolverImpl::computeValidity(const Query &query,
+                                          Solver::Validity &result) {
+  auto constraints = std::make_shared<ConstraintSet>(query.constraints);
+  ref<Expr> expr = query.expr;
+  return runOnPortfolio([=, &result](Child *c,
+                                     std::unique_lock<std::mutex> &lock) {
+    Solver::Validity childResult = Solver::Unknown;
+    uint64_t job = c->job;
+    Solver *s = c->solver.get();
+    lock.unlock();
+    bool ok = s->impl->computeValidity(Query(*constraints, expr), childResult);
+    lock.lock();
+    if (ok && claimWin(job)) {
+      result = childResult;
+      lastStatus = s->impl->getOperationStatusCode();
+    }
+  });
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
+  auto constraints = std::make_shared<ConstraintSet>(query.constraints);
+  ref<Expr> expr = query.expr;
+  return runOnPortfolio([=, &result](Child *c,
+                                     std::unique_lock<std::mutex> &lock) {
+    ref<Expr> childResult;
+    uint64_t job = c->job;
+    Solver *s = c->solver.get();
+    lock.unlock();
+    bool ok = s->impl->computeValue(Query(*constraints, expr), childResult);
+    lock.lock();
+    if (ok && claimWin(job)) {
+      result = childResult;
+      lastStatus = s->impl->getOperationStatusCode();
+    }
+  });
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  auto constraints = std::make_shared<ConstraintSet>(query.constraints);
+  auto objectsCopy = std::make_shared<std::vector<const Array *>>(objects);
+  ref<Expr> expr = query.expr;
+  return runOnPortfolio([=, &values, &hasSolution](
+                            Child *c, std::unique_lock<std::mutex> &lock) {
+    std::vector<std::vector<unsigned char>> childValues;
+    bool childHasSolution = false;
+    uint64_t job = c->job;
+    Solver *s = c->solver.get();
+    lock.unlock();
+    bool ok = s->impl->computeInitialValues(Query(*constraints, expr),
+                                            *objectsCopy, childValues,
+                                            childHasSolution);
+    lock.lock();
+    if (ok && claimWin(job)) {
+      values = std::move(childValues);
+      hasSolution = childHasSolution;
+      lastStatus = s->impl->getOperationStatusCode();
+    }
+  });
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::getOperationStatusCode() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return lastStatus;
+}
+
+char *PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  // Any child will do; use the first.
+  return children[0]->solver->impl->getConstraintLog(query);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(time::Span timeout) {
+  for (auto &c : children)
+    c->solver->impl->setCoreSolverTimeout(timeout);
+}
+}
+
+namespace klee {
+Solver *createPortfolioSolver(std::vector<std::unique_ptr<Solver>> solvers) {
+  return new Solver(new PortfolioSolverImpl(std::move(solvers)));
+}
+}
@@ -44,7 +44,9 @@ QueryLoggingSolver::QueryLoggingSolver(Solver *_solver, std::string path,
 #ifdef HAVE_ZLIB_H
   } else {
     path.append(".gz");
-    os = klee_open_compressed_output_file(path, error);
+    // the query log is written on the solving path, so compress it
+    // asynchronously at a fast level
+    os = klee_open_async_compressed_output_file(path, error);
   }
 #endif
   if (!os) {
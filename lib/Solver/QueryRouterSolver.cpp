@@ -0,0 +1,168 @@
+//===-- QueryRouterSolver.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Support/OptionCategories.h"
+#include "klee/System/Time.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <unordered_set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+llvm::cl::opt<unsigned> QueryRouterHardNodes(
+    "query-router-hard-nodes",
+    llvm::cl::desc("Queries with at least this many distinct expression "
+                   "nodes are routed to the hard solver tier by "
+                   "--use-query-router (default=10000)"),
+    llvm::cl::init(10000), llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> QueryRouterHardArrays(
+    "query-router-hard-arrays",
+    llvm::cl::desc("Queries reading at least this many distinct symbolic "
+                   "arrays are routed to the hard solver tier by "
+                   "--use-query-router (default=16)"),
+    llvm::cl::init(16), llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> QueryRouterHardUpdates(
+    "query-router-hard-updates",
+    llvm::cl::desc("Queries containing a read through an update list of at "
+                   "least this length are routed to the hard solver tier by "
+                   "--use-query-router (default=256)"),
+    llvm::cl::init(256), llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> QueryRouterDivisionNodes(
+    "query-router-division-nodes",
+    llvm::cl::desc("Queries containing a symbolic division or remainder are "
+                   "routed to the hard solver tier at this (lower) node "
+                   "threshold by --use-query-router (default=1000)"),
+    llvm::cl::init(1000), llvm::cl::cat(klee::SolvingCat));
+
+/// QueryRouterSolverImpl - Routes each query to one of two solver tiers
+/// based on cheap structural features: queries predicted to be hard for
+/// the default backend go to a separate hard-tier solver with a longer
+/// timeout, everything else goes to the default tier as before.
+///
+/// The features are computed by a single bounded walk over the query
+/// expressions. The walk stops as soon as the hard-node threshold is
+/// reached, so classification costs O(threshold) even on huge queries.
+/// Trivial queries never reach the router at all: the caches and the
+/// fast counterexample solver sit above it in the solver chain.
+class QueryRouterSolverImpl : public SolverImpl {
+  Solver *solver;     ///< Default tier; owned.
+  Solver *hardSolver; ///< Hard tier; owned.
+  /// The solver that served the last query, for status forwarding.
+  Solver *lastUsed;
+
+  Solver *route(const Query &query);
+
+public:
+  QueryRouterSolverImpl(Solver *solver, Solver *hardSolver,
+                        time::Span hardTimeout)
+      : solver(solver), hardSolver(hardSolver), lastUsed(solver) {
+    hardSolver->setCoreSolverTimeout(hardTimeout);
+  }
+  ~QueryRouterSolverImpl() {
+    delete hardSolver;
+    delete solver;
+  }
+
+  bool computeTruth(const Query &query, bool &isValid) override {
+    return route(query)->impl->computeTruth(query, isValid);
+  }
+  bool computeValidity(const Query &query, Solver::Validity &result) override {
+    return route(query)->impl->computeValidity(query, result);
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) override {
+    return route(query)->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override {
+    return route(query)->impl->computeInitialValues(query, objects, values,
+                                                    hasSolution);
+  }
+  SolverRunStatus getOperationStatusCode() override {
+    return lastUsed->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) override {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) override {
+    // Only the default tier follows the global timeout; the hard tier
+    // keeps the longer budget it was constructed with.
+    solver->setCoreSolverTimeout(timeout);
+  }
+};
+
+Solver *QueryRouterSolverImpl::route(const Query &query) {
+  const unsigned hardNodes = QueryRouterHardNodes;
+  unsigned nodes = 0;
+  bool isHard = false;
+  bool hasDivision = false;
+
+  std::vector<const Expr *> stack;
+  std::unordered_set<const Expr *> visited;
+  std::unordered_set<const Array *> arrays;
+  stack.push_back(query.expr.get());
+  for (const auto &constraint : query.constraints)
+    stack.push_back(constraint.get());
+
+  while (!stack.empty() && !isHard) {
+    const Expr *e = stack.back();
+    stack.pop_back();
+    if (isa<ConstantExpr>(e) || !visited.insert(e).second)
+      continue;
+
+    ++nodes;
+    switch (e->getKind()) {
+    case Expr::Read: {
+      const ReadExpr *re = cast<ReadExpr>(e);
+      arrays.insert(re->updates.root);
+      if (arrays.size() >= QueryRouterHardArrays ||
+          re->updates.getSize() >= QueryRouterHardUpdates)
+        isHard = true;
+      break;
+    }
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+      // Symbolic division makes queries disproportionately expensive,
+      // so it lowers the size threshold below.
+      hasDivision = true;
+      break;
+    default:
+      break;
+    }
+    if (nodes >= hardNodes ||
+        (hasDivision && nodes >= QueryRouterDivisionNodes))
+      isHard = true;
+
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      stack.push_back(e->getKid(i).get());
+  }
+
+  lastUsed = isHard ? hardSolver : solver;
+  return lastUsed;
+}
+} // namespace
+
+Solver *klee::createQueryRouterSolver(Solver *solver, Solver *hardSolver,
+                                      time::Span hardTimeout) {
+  return new Solver(
+      new QueryRouterSolverImpl(solver, hardSolver, hardTimeout));
+}
@@ -15,7 +15,7 @@
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverStats.h"
 
-#include "ConstantDivision.h"
+#include "klee/Expr/ConstantDivision.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
@@ -54,22 +54,20 @@ namespace {
 
 
 STPArrayExprHash::~STPArrayExprHash() {
-  for (ArrayHashIter it = _array_hash.begin(); it != _array_hash.end(); ++it) {
-    ::VCExpr array_expr = it->second;
-    if (array_expr) {
-      ::vc_DeleteExpr(array_expr);
-      array_expr = 0;
-    }
-  }
+  clear();
+}
 
+void STPArrayExprHash::releaseArrayExpr(::VCExpr &exp) {
+  if (exp) {
+    ::vc_DeleteExpr(exp);
+    exp = 0;
+  }
+}
 
-  for (UpdateNodeHashConstIter it = _update_node_hash.begin();
-      it != _update_node_hash.end(); ++it) {
-    ::VCExpr un_expr = it->second;
-    if (un_expr) {
-      ::vc_DeleteExpr(un_expr);
-      un_expr = 0;
-    }
+void STPArrayExprHash::releaseUpdateNodeExpr(::VCExpr &exp) {
+  if (exp) {
+    ::vc_DeleteExpr(exp);
+    exp = 0;
   }
 }
 
@@ -354,12 +352,12 @@ ExprHandle STPBuilder::constructMulByConstant(ExprHandle expr, unsigned width, u
 ExprHandle STPBuilder::constructUDivByConstant(ExprHandle expr_n, unsigned width, uint64_t d) {
   assert(width==32 && "can only compute udiv constants for 32-bit division");
 
-  // Compute the constants needed to compute n/d for constant d w/o
-  // division by d.
-  uint32_t mprime, sh1, sh2;
-  ComputeUDivConstants32(d, mprime, sh1, sh2);
-  ExprHandle expr_sh1    = bvConst32( 32, sh1);
-  ExprHandle expr_sh2    = bvConst32( 32, sh2);
+  // The constants needed to compute n/d for constant d w/o division by
+  // d, memoized per divisor.
+  const UDivMagic &m = getUDivMagic(d);
+  uint32_t mprime = m.mprime;
+  ExprHandle expr_sh1    = bvConst32( 32, m.sh1);
+  ExprHandle expr_sh2    = bvConst32( 32, m.sh2);
 
   // t1  = MULUH(mprime, n) = ( (uint64_t)mprime * (uint64_t)n ) >> 32
   ExprHandle expr_n_64   = vc_bvConcatExpr( vc, bvZero(32), expr_n ); //extend to 64 bits
@@ -392,11 +390,12 @@ ExprHandle STPBuilder::constructSDivByConstant(ExprHandle expr_n, unsigned width
   // Refactor using APInt::ms APInt::magic();
   assert(width==32 && "can only compute udiv constants for 32-bit division");
 
-  // Compute the constants needed to compute n/d for constant d w/o division by d.
-  int32_t mprime, dsign, shpost;
-  ComputeSDivConstants32(d, mprime, dsign, shpost);
-  ExprHandle expr_dsign   = bvConst32( 32, dsign);
-  ExprHandle expr_shpost  = bvConst32( 32, shpost);
+  // The constants needed to compute n/d for constant d w/o division by
+  // d, memoized per divisor.
+  const SDivMagic &m = getSDivMagic(d);
+  int32_t mprime = m.mprime;
+  ExprHandle expr_dsign   = bvConst32( 32, m.dsign);
+  ExprHandle expr_shpost  = bvConst32( 32, m.shpost);
 
   // q0 = n + MULSH( mprime, n ) = n + (( (int64_t)mprime * (int64_t)n ) >> 32)
   int64_t mprime_64     = (int64_t)mprime;
@@ -435,8 +434,9 @@ ExprHandle STPBuilder::constructSDivByConstant(ExprHandle expr_n, unsigned width
   
   if (!hashed) {
     // STP uniques arrays by name, so we make sure the name is unique by
-    // using the size of the array hash as a counter.
-    std::string unique_id = llvm::utostr(_arr_hash._array_hash.size());
+    // suffixing a counter that never repeats (entries can be evicted, so
+    // the table size could).
+    std::string unique_id = llvm::utostr(_arr_hash.nextUniqueId());
     std::string unique_name = root->name + unique_id;
 
     array_expr = buildArray(unique_name.c_str(), root->getDomain(),
@@ -60,6 +60,10 @@ namespace klee {
   public:
     STPArrayExprHash() {};
     virtual ~STPArrayExprHash();
+
+  protected:
+    void releaseArrayExpr(::VCExpr &exp) override;
+    void releaseUpdateNodeExpr(::VCExpr &exp) override;
   };
 
 class STPBuilder {
@@ -24,8 +24,7 @@
 #include "llvm/Support/Errno.h"
 
 #include <csignal>
-#include <sys/ipc.h>
-#include <sys/shm.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -44,19 +43,6 @@ llvm::cl::opt<bool> IgnoreSolverFailures(
 
 #define vc_bvBoolExtract IAMTHESPAWNOFSATAN
 
-static unsigned char *shared_memory_ptr = nullptr;
-static int shared_memory_id = 0;
-// Darwin by default has a very small limit on the maximum amount of shared
-// memory, which will quickly be exhausted by KLEE running its tests in
-// parallel. For now, we work around this by just requesting a smaller size --
-// in practice users hitting this limit on counterexample sizes probably already
-// are hitting more serious scalability issues.
-#ifdef __APPLE__
-static const unsigned shared_memory_size = 1 << 16;
-#else
-static const unsigned shared_memory_size = 1 << 20;
-#endif
-
 static void stp_error_handler(const char *err_msg) {
   fprintf(stderr, "error: STP Error: %s\n", err_msg);
   abort();
@@ -72,6 +58,15 @@ private:
   bool useForkedSTP;
   SolverRunStatus runStatusCode;
 
+  // Persistent arena for passing counterexamples back from the forked
+  // solver; an anonymous shared mapping inherited across fork(), grown
+  // geometrically when a query's objects outgrow it.
+  unsigned char *sharedMemory = nullptr;
+  size_t sharedMemorySize = 0;
+
+  /// Ensure \ref sharedMemory can hold at least \p required bytes.
+  void ensureSharedMemory(size_t required);
+
 public:
   explicit STPSolverImpl(bool useForkedSTP, bool optimizeDivides = true);
   ~STPSolverImpl() override;
@@ -106,31 +101,34 @@ STPSolverImpl::STPSolverImpl(bool useForkedSTP, bool optimizeDivides)
   make_division_total(vc);
 
   vc_registerErrorHandler(::stp_error_handler);
-
-  if (useForkedSTP) {
-    assert(shared_memory_id == 0 && "shared memory id already allocated");
-    shared_memory_id =
-        shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    if (shared_memory_id < 0)
-      llvm::report_fatal_error("unable to allocate shared memory region");
-    shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, nullptr, 0);
-    if (shared_memory_ptr == (void *)-1)
-      llvm::report_fatal_error("unable to attach shared memory region");
-    shmctl(shared_memory_id, IPC_RMID, nullptr);
-  }
 }
 
 STPSolverImpl::~STPSolverImpl() {
-  // Detach the memory region.
-  shmdt(shared_memory_ptr);
-  shared_memory_ptr = nullptr;
-  shared_memory_id = 0;
+  if (sharedMemory)
+    munmap(sharedMemory, sharedMemorySize);
 
   delete builder;
 
   vc_Destroy(vc);
 }
 
+void STPSolverImpl::ensureSharedMemory(size_t required) {
+  if (required <= sharedMemorySize)
+    return;
+
+  size_t size = sharedMemorySize ? sharedMemorySize : (size_t)1 << 20;
+  while (size < required)
+    size *= 2;
+
+  if (sharedMemory)
+    munmap(sharedMemory, sharedMemorySize);
+  sharedMemory = (unsigned char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sharedMemory == MAP_FAILED)
+    llvm::report_fatal_error("unable to allocate shared memory region");
+  sharedMemorySize = size;
+}
+
 /***/
 
 char *STPSolverImpl::getConstraintLog(const Query &query) {
@@ -213,13 +211,9 @@ static SolverImpl::SolverRunStatus
 runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
                    const std::vector<const Array *> &objects,
                    std::vector<std::vector<unsigned char>> &values,
-                   bool &hasSolution, time::Span timeout) {
-  unsigned char *pos = shared_memory_ptr;
-  unsigned sum = 0;
-  for (const auto object : objects)
-    sum += object->size;
-  if (sum >= shared_memory_size)
-    llvm::report_fatal_error("not enough shared memory for counterexample");
+                   bool &hasSolution, time::Span timeout,
+                   unsigned char *sharedMemory) {
+  unsigned char *pos = sharedMemory;
 
   fflush(stdout);
   fflush(stderr);
@@ -340,9 +334,16 @@ bool STPSolverImpl::computeInitialValues(
   }
 
   bool success;
-  if (useForkedSTP) {
+  if (useForkedSTP && timeout) {
+    // Enforcing the timeout is the only thing the fork is for; without
+    // one the query runs in process and the per-query fork is saved.
+    size_t sum = 0;
+    for (const auto object : objects)
+      sum += object->size;
+    ensureSharedMemory(sum);
+
     runStatusCode = runAndGetCexForked(vc, builder, stp_e, objects, values,
-                                       hasSolution, timeout);
+                                       hasSolution, timeout, sharedMemory);
     success = ((SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == runStatusCode) ||
                (SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE == runStatusCode));
   } else {
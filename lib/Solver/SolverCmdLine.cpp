@@ -38,11 +38,36 @@ cl::extrahelp TimeFormatInfo(
 cl::OptionCategory SolvingCat("Constraint solving options",
                               "These options impact constraint solving.");
 
+// Defined here rather than in kleeCore so that solver-side options (e.g.
+// -independent-parallel-solvers) can use it from kleaver as well.
+cl::OptionCategory
+    ParallelCat("Parallel execution options",
+                "These options control the multi-threaded execution mode.");
+
 cl::opt<bool> UseFastCexSolver(
     "use-fast-cex-solver", cl::init(false),
     cl::desc("Enable an experimental range-based solver (default=false)"),
     cl::cat(SolvingCat));
 
+cl::opt<bool> UseRangeSolver(
+    "use-range-solver", cl::init(false),
+    cl::desc("Decide queries by interval reasoning over the constraint set "
+             "before they reach the core solver (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> UseQueryRouter(
+    "use-query-router", cl::init(false),
+    cl::desc("Route queries predicted to be hard for the core solver to a "
+             "portfolio tier with a longer timeout, based on structural "
+             "query features (see --query-router-*) (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<std::string> QueryRouterHardTimeout(
+    "query-router-hard-timeout",
+    cl::desc("Solver timeout for queries routed to the hard tier by "
+             "--use-query-router (default=0s (off))"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> UseCexCache("use-cex-cache", cl::init(true),
                           cl::desc("Use the counterexample cache (default=true)"),
                           cl::cat(SolvingCat));
@@ -99,15 +124,26 @@ cl::bits<QueryLoggingSolverType> QueryLoggingOptions(
                    "All queries in .kquery (KQuery) format"),
         clEnumValN(ALL_SMTLIB, "all:smt2",
                    "All queries in .smt2 (SMT-LIBv2) format"),
+        clEnumValN(ALL_BINARY, "all:bin",
+                   "All queries in the compact binary query-log format"),
         clEnumValN(
             SOLVER_KQUERY, "solver:kquery",
             "All queries reaching the solver in .kquery (KQuery) format"),
         clEnumValN(
             SOLVER_SMTLIB, "solver:smt2",
-            "All queries reaching the solver in .smt2 (SMT-LIBv2) format")
+            "All queries reaching the solver in .smt2 (SMT-LIBv2) format"),
+        clEnumValN(SOLVER_BINARY, "solver:bin",
+                   "All queries reaching the solver in the compact binary "
+                   "query-log format")
             KLEE_LLVM_CL_VAL_END),
     cl::CommaSeparated, cl::cat(SolvingCat));
 
+cl::opt<bool> BenchmarkSolverStages(
+    "benchmark-solver-stages", cl::init(false),
+    cl::desc("Meter each stage of the solver chain and report per-stage "
+             "query counts, wall times and hit rates (default=false)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> UseAssignmentValidatingSolver(
     "debug-assignment-validating-solver", cl::init(false),
     cl::desc("Debug the correctness of generated assignments (default=false)"),
@@ -195,7 +231,10 @@ cl::opt<CoreSolverType> CoreSolverToUse(
                clEnumValN(METASMT_SOLVER, "metasmt",
                           "metaSMT" METASMT_IS_DEFAULT_STR),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)
+               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+               clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                          "Race all available core solvers and take the "
+                          "first answer")
                    KLEE_LLVM_CL_VAL_END),
     cl::init(DEFAULT_CORE_SOLVER), cl::cat(SolvingCat));
 
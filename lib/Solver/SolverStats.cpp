@@ -11,17 +11,27 @@
 
 using namespace klee;
 
+Statistic stats::arrayOptCacheHits("ArrayOptCacheHits", "AOcache");
+Statistic stats::arrayOptIndexApplied("ArrayOptIndex", "AOidx");
+Statistic stats::arrayOptIndexFailed("ArrayOptIndexFailed", "AOidxF");
+Statistic stats::arrayOptValueApplied("ArrayOptValue", "AOval");
+Statistic stats::arrayOptValueFailed("ArrayOptValueFailed", "AOvalF");
 Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
 Statistic stats::queries("Queries", "Q");
 Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
+Statistic stats::queryCacheEvictions("QueryCacheEvictions", "QCevict");
 Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
+Statistic stats::queryCacheSavedTime("QueryCacheSavedTime", "QCsaved");
+Statistic stats::queryCacheTime("QueryCacheTime", "QCtime");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::queryCexCacheSavedTime("QueryCexCacheSavedTime", "QCexSaved");
 Statistic stats::queryConstructs("QueryConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
 Statistic stats::queryTime("QueryTime", "Qtime");
+Statistic stats::solverMemory("SolverMemory", "SMem");
 
 #ifdef KLEE_ARRAY_DEBUG
 Statistic stats::arrayHashTime("ArrayHashTime", "AHtime");
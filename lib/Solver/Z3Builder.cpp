@@ -11,14 +11,18 @@
 #include "Z3Builder.h"
 
 #include "klee/ADT/Bits.h"
+#include "klee/Expr/ConstantDivision.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
 #include "klee/Solver/SolverStats.h"
 #include "klee/Support/ErrorHandling.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+
 using namespace klee;
 
 namespace {
@@ -28,6 +32,15 @@ llvm::cl::opt<bool> UseConstructHashZ3(
     llvm::cl::init(true),
     llvm::cl::cat(klee::ExprCat));
 
+llvm::cl::opt<bool> Z3PersistentASTCache(
+    "z3-persistent-ast-cache",
+    llvm::cl::desc("Keep Z3 translations of expressions that are still "
+                   "referenced elsewhere alive across queries instead of "
+                   "rebuilding them; translations of dead expressions are "
+                   "swept periodically (default=true)"),
+    llvm::cl::init(true),
+    llvm::cl::cat(klee::ExprCat));
+
 // FIXME: This should be std::atomic<bool>. Need C++11 for that.
 bool Z3InterationLogOpen = false;
 }
@@ -69,13 +82,11 @@ void custom_z3_error_handler(Z3_context ctx, Z3_error_code ec) {
 
 Z3ArrayExprHash::~Z3ArrayExprHash() {}
 
-void Z3ArrayExprHash::clear() {
-  _update_node_hash.clear();
-  _array_hash.clear();
-}
-
-Z3Builder::Z3Builder(bool autoClearConstructCache, const char* z3LogInteractionFileArg)
-    : autoClearConstructCache(autoClearConstructCache), z3LogInteractionFile("") {
+Z3Builder::Z3Builder(bool autoClearConstructCache,
+                     const char *z3LogInteractionFileArg,
+                     bool eliminateConstantReads)
+    : autoClearConstructCache(autoClearConstructCache),
+      eliminateConstantReads(eliminateConstantReads), z3LogInteractionFile("") {
   if (z3LogInteractionFileArg)
     this->z3LogInteractionFile = std::string(z3LogInteractionFileArg);
   if (z3LogInteractionFile.length() > 0) {
@@ -97,12 +108,41 @@ Z3Builder::Z3Builder(bool autoClearConstructCache, const char* z3LogInteractionF
   Z3_del_config(cfg);
 }
 
+void Z3Builder::recycleConstructCache() {
+  if (!Z3PersistentASTCache) {
+    clearConstructCache();
+    return;
+  }
+
+  // Keep the cache across queries so shared subexpressions are only ever
+  // translated once, and sweep it when it has doubled since the last
+  // sweep: an entry whose expression is referenced by nothing but the
+  // cache key can never be looked up again.
+  if (constructed.size() <= constructedSweepThreshold)
+    return;
+
+  for (ExprHashMap<std::pair<Z3ASTHandle, unsigned>>::iterator
+           it = constructed.begin(),
+           ie = constructed.end();
+       it != ie;) {
+    if (it->first->_refCount.getCount() == 1)
+      it = constructed.erase(it);
+    else
+      ++it;
+  }
+
+  constructedSweepThreshold =
+      std::max<size_t>(constructed.size() * 2, MinConstructedSweepThreshold);
+}
+
 Z3Builder::~Z3Builder() {
   // Clear caches so exprs/sorts gets freed before the destroying context
   // they aren associated with.
   clearConstructCache();
   _arr_hash.clear();
   constant_array_assertions.clear();
+  cell_variables.clear();
+  cell_link_assertions.clear();
   Z3_del_context(ctx);
   if (z3LogInteractionFile.length() > 0) {
     Z3_close_log();
@@ -391,8 +431,9 @@ Z3ASTHandle Z3Builder::getInitialArray(const Array *root) {
 
   if (!hashed) {
     // Unique arrays by name, so we make sure the name is unique by
-    // using the size of the array hash as a counter.
-    std::string unique_id = llvm::utostr(_arr_hash._array_hash.size());
+    // suffixing a counter that never repeats (entries can be evicted, so
+    // the table size could).
+    std::string unique_id = llvm::utostr(_arr_hash.nextUniqueId());
     std::string unique_name = root->name + unique_id;
 
     array_expr = buildArray(unique_name.c_str(), root->getDomain(),
@@ -422,9 +463,43 @@ Z3ASTHandle Z3Builder::getInitialArray(const Array *root) {
 }
 
 Z3ASTHandle Z3Builder::getInitialRead(const Array *root, unsigned index) {
+  if (eliminateConstantReads) {
+    // If the cell was encoded as a variable it carries the constraints;
+    // the array itself may never have been asserted at all.
+    auto it = cell_variables.find(std::make_pair(root, index));
+    if (it != cell_variables.end())
+      return it->second;
+  }
   return readExpr(getInitialArray(root), bvConst32(32, index));
 }
 
+bool Z3Builder::isEliminableRead(const ReadExpr *re) {
+  return !re->updates.head && re->updates.root->isSymbolicArray() &&
+         isa<ConstantExpr>(re->index);
+}
+
+Z3ASTHandle Z3Builder::getCellVariable(const Array *root, unsigned index) {
+  auto key = std::make_pair(root, index);
+  auto it = cell_variables.find(key);
+  if (it != cell_variables.end())
+    return it->second;
+
+  // Unique cell names the same way getInitialArray() uniques array
+  // names: distinct KLEE arrays may share a name, and Z3 identifies
+  // constants of the same name and sort.
+  std::string unique_name = root->name + "_" + llvm::utostr(index) + "_" +
+                            llvm::utostr(_arr_hash.nextUniqueId());
+  Z3ASTHandle cell(Z3_mk_const(ctx,
+                               Z3_mk_string_symbol(ctx, unique_name.c_str()),
+                               getBvSort(root->getRange())),
+                   ctx);
+  cell_link_assertions[root].push_back(eqExpr(
+      readExpr(getInitialArray(root), bvConst32(root->getDomain(), index)),
+      cell));
+  cell_variables.emplace(key, cell);
+  return cell;
+}
+
 Z3ASTHandle Z3Builder::getArrayForUpdate(const Array *root,
                                          const UpdateNode *un) {
   if (!un) {
@@ -518,6 +593,9 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
     ReadExpr *re = cast<ReadExpr>(e);
     assert(re && re->updates.root);
     *width_out = re->updates.root->getRange();
+    if (eliminateConstantReads && isEliminableRead(re))
+      return getCellVariable(re->updates.root,
+                             cast<ConstantExpr>(re->index)->getZExtValue());
     return readExpr(getArrayForUpdate(re->updates.root, re->updates.head.get()),
                     construct(re->index, 0));
   }
@@ -625,6 +703,10 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
         uint64_t divisor = CE->getZExtValue();
         if (bits64::isPowerOfTwo(divisor))
           return bvRightShift(left, bits64::indexOfSingleBit(divisor));
+        if (CoreSolverOptimizeDivides && divisor &&
+            CE->getWidth() == Expr::Int32)
+          return construct(getUDivByConstantExpr(de->left, (uint32_t)divisor),
+                           width_out);
       }
     }
 
@@ -639,6 +721,16 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
     SDivExpr *de = cast<SDivExpr>(e);
     Z3ASTHandle left = construct(de->left, width_out);
     assert(*width_out != 1 && "uncanonicalized sdiv");
+
+    if (CoreSolverOptimizeDivides) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(de->right)) {
+        if (CE->getWidth() == Expr::Int32 && CE->getZExtValue())
+          return construct(
+              getSDivByConstantExpr(de->left, (int32_t)CE->getZExtValue(32)),
+              width_out);
+      }
+    }
+
     Z3ASTHandle right = construct(de->right, width_out);
     Z3ASTHandle result = Z3ASTHandle(Z3_mk_bvsdiv(ctx, left, right), ctx);
     assert(getBVLength(result) == static_cast<unsigned>(*width_out) &&
@@ -14,7 +14,9 @@
 #include "klee/Expr/ArrayExprHash.h"
 #include "klee/Expr/ExprHashMap.h"
 
+#include <map>
 #include <unordered_map>
+#include <utility>
 #include <z3.h>
 
 namespace klee {
@@ -98,7 +100,6 @@ class Z3ArrayExprHash : public ArrayExprHash<Z3ASTHandle> {
 public:
   Z3ArrayExprHash(){};
   virtual ~Z3ArrayExprHash();
-  void clear();
 };
 
 class Z3Builder {
@@ -158,6 +159,11 @@ private:
   Z3ASTHandle getInitialArray(const Array *os);
   Z3ASTHandle getArrayForUpdate(const Array *root, const UpdateNode *un);
 
+  /// Bitvector constant standing in for a single cell of a symbolic
+  /// array (\see eliminateConstantReads); created on first use together
+  /// with its defining equality in \ref cell_link_assertions.
+  Z3ASTHandle getCellVariable(const Array *root, unsigned index);
+
   Z3ASTHandle constructActual(ref<Expr> e, int *width_out);
   Z3ASTHandle construct(ref<Expr> e, int *width_out);
 
@@ -167,15 +173,43 @@ private:
   Z3SortHandle getBvSort(unsigned width);
   Z3SortHandle getArraySort(Z3SortHandle domainSort, Z3SortHandle rangeSort);
   bool autoClearConstructCache;
+  /// Encode reads at constant indices of symbolic arrays as plain
+  /// bitvector variables instead of array selects, so queries touching
+  /// arrays only that way become array-free (\see -z3-read-elimination).
+  bool eliminateConstantReads;
   std::string z3LogInteractionFile;
 
+  /// Cell variables created so far, keyed by (array, index). Consulted
+  /// by getInitialRead() so model extraction reads the variable that
+  /// actually carries the constraints on a cell.
+  std::map<std::pair<const Array *, unsigned>, Z3ASTHandle> cell_variables;
+
+  /// Sweep \ref constructed once it grows past this; doubled after each
+  /// sweep so sweeps stay amortized-constant per insertion.
+  static const size_t MinConstructedSweepThreshold = 1024;
+  size_t constructedSweepThreshold = MinConstructedSweepThreshold;
+
 public:
   Z3_context ctx;
   std::unordered_map<const Array *, std::vector<Z3ASTHandle> >
       constant_array_assertions;
-  Z3Builder(bool autoClearConstructCache, const char *z3LogInteractionFile);
+  /// Defining equalities (cell == select(array, index)) for the cell
+  /// variables of each array. Z3Solver.cpp asserts them only for arrays
+  /// a query still reads through the theory of arrays; for a fully
+  /// eliminated array the free cell variables admit exactly the same
+  /// models on their own.
+  std::unordered_map<const Array *, std::vector<Z3ASTHandle> >
+      cell_link_assertions;
+  Z3Builder(bool autoClearConstructCache, const char *z3LogInteractionFile,
+            bool eliminateConstantReads);
   ~Z3Builder();
 
+  /// Whether \p re reads a symbolic array at a constant index with no
+  /// intervening writes, i.e. names a single cell that a bitvector
+  /// variable can stand in for. The rule is local to the read so the
+  /// persistent construct cache stays valid across queries.
+  static bool isEliminableRead(const ReadExpr *re);
+
   Z3ASTHandle getTrue();
   Z3ASTHandle getFalse();
   Z3ASTHandle getInitialRead(const Array *os, unsigned index);
@@ -188,6 +222,12 @@ public:
   }
 
   void clearConstructCache() { constructed.clear(); }
+
+  /// Called after each query. With -z3-persistent-ast-cache (the
+  /// default) translations of expressions that are still alive elsewhere
+  /// are kept for later queries and entries for dead expressions are
+  /// swept periodically; otherwise the cache is simply cleared.
+  void recycleConstructCache();
 };
 }
 
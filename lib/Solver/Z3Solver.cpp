@@ -21,12 +21,16 @@
 
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Assignment.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <unordered_set>
+
 namespace {
 // NOTE: Very useful for debugging Z3 behaviour. These files can be given to
 // the z3 binary to replay all Z3 API calls using its `-log` option.
@@ -49,6 +53,40 @@ llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"),
                      llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> Z3UnsatCoreMinimization(
+    "z3-unsat-core-minimization", llvm::cl::init(false),
+    llvm::cl::desc("Track constraints with assumption literals to learn unsat "
+                   "cores, and try a cached core before shipping the full "
+                   "constraint set when the same query expression comes back "
+                   "(default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> Z3ReadElimination(
+    "z3-read-elimination", llvm::cl::init(false),
+    llvm::cl::desc("Encode reads at constant indices of symbolic arrays as "
+                   "plain bitvector variables; queries whose reads are all of "
+                   "that form become array-free and are solved with the "
+                   "cheaper QF_BV tactic. Ignored with -z3-incremental "
+                   "(default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3ContextRestartSize(
+    "z3-context-restart-size", llvm::cl::init(2048),
+    llvm::cl::desc("Rebuild the Z3 context when the backend's estimated "
+                   "allocation exceeds this many MiB. Long-lived contexts "
+                   "keep learned lemmas and fragmented allocations forever; "
+                   "a restart returns that memory before it eats into the "
+                   "states' budget. 0 disables (default=2048)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> Z3IncrementalSolving(
+    "z3-incremental", llvm::cl::init(false),
+    llvm::cl::desc("Keep a persistent Z3 solver and use push/pop to assert "
+                   "only the delta against the previous query's constraint "
+                   "prefix, falling back to a fresh solver when consecutive "
+                   "queries share no prefix (default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
 }
 
 #include "llvm/Support/ErrorHandling.h"
@@ -65,12 +103,59 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  // Incremental solving state: a persistent solver with one push scope
+  // per asserted constraint, mirrored by \ref assertedConstraints.
+  ::Z3_solver persistentSolver;
+  std::vector<ref<Expr>> assertedConstraints;
+
+  // Whether constant-index reads are blasted to cell variables. Off
+  // under -z3-incremental: the per-query decision of which defining
+  // equalities to ship does not compose with constraints asserted in
+  // earlier push scopes.
+  bool readElimination;
+
+  // Unsat cores learned for previously proven query expressions: the
+  // subset of constraints Z3 reported as sufficient for validity. A
+  // later query on the same expression is first tried against its core
+  // alone (sound, since an unsatisfiable subset stays unsatisfiable
+  // under more constraints) before the full constraint set is shipped.
+  ExprHashMap<std::vector<ref<Expr>>> unsatCoreCache;
+  bool inCoreProbe = false;
+  static const size_t MaxUnsatCoreCacheSize = 4096;
+
+  // The backend footprint last published to stats::solverMemory, so the
+  // gauge can be maintained by deltas.
+  std::uint64_t lastReportedMemory = 0;
+
+  /// Create the builder (and with it the Z3 context) and the solver
+  /// parameters that live on it. Called from the constructor and again
+  /// after a context restart.
+  void initContext();
+
+  /// Tear down and rebuild the Z3 context, releasing the lemmas and
+  /// allocator fragmentation it accumulated. Everything layered above
+  /// (caches keyed by klee exprs) survives; context-owned state (the
+  /// persistent incremental solver, the builder's AST cache) is rebuilt
+  /// on demand. Must only run between queries, with no Z3 handles live.
+  void restartContext();
+
+  /// Publish the backend's current footprint and restart the context
+  /// when it exceeds -z3-context-restart-size.
+  void updateMemoryUsage();
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
                          bool &hasSolution);
   bool validateZ3Model(::Z3_solver &theSolver, ::Z3_model &theModel);
 
+  /// Bring the persistent solver in sync with the constraints of
+  /// \p query: pop scopes beyond the shared prefix and push/assert the
+  /// new suffix, one scope per constraint. Creates a fresh solver when
+  /// there is none or when the query shares no prefix with the
+  /// previously asserted constraints (an unrelated state lineage).
+  ::Z3_solver prepareIncrementalSolver(const Query &query);
+
 public:
   Z3SolverImpl();
   ~Z3SolverImpl();
@@ -101,17 +186,10 @@ public:
 };
 
 Z3SolverImpl::Z3SolverImpl()
-    : builder(new Z3Builder(
-          /*autoClearConstructCache=*/false,
-          /*z3LogInteractionFileArg=*/Z3LogInteractionFile.size() > 0
-              ? Z3LogInteractionFile.c_str()
-              : NULL)),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
-  assert(builder && "unable to create Z3Builder");
-  solverParameters = Z3_mk_params(builder->ctx);
-  Z3_params_inc_ref(builder->ctx, solverParameters);
-  timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
-  setCoreSolverTimeout(timeout);
+    : builder(NULL), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      persistentSolver(NULL),
+      readElimination(Z3ReadElimination && !Z3IncrementalSolving) {
+  initContext();
 
   if (!Z3QueryDumpFile.empty()) {
     std::string error;
@@ -134,8 +212,116 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  if (persistentSolver)
+    Z3_solver_dec_ref(builder->ctx, persistentSolver);
+  Z3_params_dec_ref(builder->ctx, solverParameters);
+  delete builder;
+}
+
+void Z3SolverImpl::initContext() {
+  builder = new Z3Builder(
+      /*autoClearConstructCache=*/false,
+      /*z3LogInteractionFileArg=*/Z3LogInteractionFile.size() > 0
+          ? Z3LogInteractionFile.c_str()
+          : NULL,
+      /*eliminateConstantReads=*/readElimination);
+  assert(builder && "unable to create Z3Builder");
+  solverParameters = Z3_mk_params(builder->ctx);
+  Z3_params_inc_ref(builder->ctx, solverParameters);
+  timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
+  setCoreSolverTimeout(timeout);
+
+  if (Z3UnsatCoreMinimization)
+    Z3_params_set_bool(builder->ctx, solverParameters,
+                       Z3_mk_string_symbol(builder->ctx, "unsat_core"), true);
+}
+
+void Z3SolverImpl::restartContext() {
+  if (persistentSolver) {
+    Z3_solver_dec_ref(builder->ctx, persistentSolver);
+    persistentSolver = NULL;
+    assertedConstraints.clear();
+  }
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
+  initContext();
+}
+
+void Z3SolverImpl::updateMemoryUsage() {
+  // The estimate is a live gauge (it shrinks when Z3 frees memory), so
+  // publish deltas to keep the statistic tracking the current footprint.
+  std::uint64_t estimated = Z3_get_estimated_alloc_size();
+  stats::solverMemory += estimated - lastReportedMemory;
+  lastReportedMemory = estimated;
+
+  if (!Z3ContextRestartSize ||
+      (estimated >> 20) < (std::uint64_t)Z3ContextRestartSize)
+    return;
+
+  klee_message("Z3 backend grew to %llu MiB, restarting its context",
+               (unsigned long long)(estimated >> 20));
+  restartContext();
+
+  estimated = Z3_get_estimated_alloc_size();
+  stats::solverMemory += estimated - lastReportedMemory;
+  lastReportedMemory = estimated;
+}
+
+::Z3_solver Z3SolverImpl::prepareIncrementalSolver(const Query &query) {
+  std::vector<ref<Expr>> queryConstraints(query.constraints.begin(),
+                                          query.constraints.end());
+
+  size_t common = 0;
+  while (common < queryConstraints.size() &&
+         common < assertedConstraints.size() &&
+         queryConstraints[common] == assertedConstraints[common])
+    ++common;
+
+  if (persistentSolver && common == 0 && !assertedConstraints.empty()) {
+    // An unrelated state lineage: Z3's learned state is worthless here
+    // and popping everything is no cheaper than starting over.
+    Z3_solver_dec_ref(builder->ctx, persistentSolver);
+    persistentSolver = NULL;
+    assertedConstraints.clear();
+  }
+
+  if (!persistentSolver) {
+    persistentSolver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, persistentSolver);
+  }
+  // Reapply the parameters every query as the timeout may have changed.
+  Z3_solver_set_params(builder->ctx, persistentSolver, solverParameters);
+
+  if (assertedConstraints.size() > common) {
+    Z3_solver_pop(builder->ctx, persistentSolver,
+                  assertedConstraints.size() - common);
+    assertedConstraints.resize(common);
+  }
+
+  for (size_t i = common, e = queryConstraints.size(); i != e; ++i) {
+    const ref<Expr> &constraint = queryConstraints[i];
+    Z3_solver_push(builder->ctx, persistentSolver);
+    Z3_solver_assert(builder->ctx, persistentSolver,
+                     builder->construct(constraint));
+
+    // Constant array values have to live in the same scope as the
+    // constraint that introduced them so they survive exactly as long
+    // as it does.
+    ConstantArrayFinder constant_arrays;
+    constant_arrays.visit(constraint);
+    for (auto const &constant_array : constant_arrays.results) {
+      assert(builder->constant_array_assertions.count(constant_array) == 1 &&
+             "Constant array found in query, but not handled by Z3Builder");
+      for (auto const &arrayIndexValueExpr :
+           builder->constant_array_assertions[constant_array]) {
+        Z3_solver_assert(builder->ctx, persistentSolver, arrayIndexValueExpr);
+      }
+    }
+
+    assertedConstraints.push_back(constraint);
+  }
+
+  return persistentSolver;
 }
 
 Z3Solver::Z3Solver() : Solver(new Z3SolverImpl()) {}
@@ -155,8 +341,11 @@ char *Z3SolverImpl::getConstraintLog(const Query &query) {
   // cache.
   // NOTE: The builder does not set `z3LogInteractionFile` to avoid conflicting
   // with whatever the solver's builder is set to do.
+  // Cell variables would drag in the defining equality bookkeeping for
+  // no benefit here; log the classic encoding.
   Z3Builder temp_builder(/*autoClearConstructCache=*/false,
-                         /*z3LogInteractionFile=*/NULL);
+                         /*z3LogInteractionFile=*/NULL,
+                         /*eliminateConstantReads=*/false);
   ConstantArrayFinder constant_arrays_in_query;
   for (auto const &constraint : query.constraints) {
     assumptions.push_back(temp_builder.construct(constraint));
@@ -218,6 +407,8 @@ bool Z3SolverImpl::computeTruth(const Query &query, bool &isValid) {
   bool status =
       internalRunSolver(query, /*objects=*/NULL, /*values=*/NULL, hasSolution);
   isValid = !hasSolution;
+  // Safe point for a context restart: no Z3 handles are live here.
+  updateMemoryUsage();
   return status;
 }
 
@@ -243,30 +434,118 @@ bool Z3SolverImpl::computeValue(const Query &query, ref<Expr> &result) {
 bool Z3SolverImpl::computeInitialValues(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
-  return internalRunSolver(query, &objects, &values, hasSolution);
+  bool status = internalRunSolver(query, &objects, &values, hasSolution);
+  // Safe point for a context restart: no Z3 handles are live here.
+  updateMemoryUsage();
+  return status;
 }
 
 bool Z3SolverImpl::internalRunSolver(
     const Query &query, const std::vector<const Array *> *objects,
     std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
 
+  // If a core was learned for this query expression and all of its
+  // constraints are still present, probe the core alone first: an
+  // unsatisfiable subset stays unsatisfiable under more constraints, so
+  // an unsat probe proves validity without shipping the full set.
+  if (Z3UnsatCoreMinimization && !Z3IncrementalSolving && !inCoreProbe) {
+    auto coreIt = unsatCoreCache.find(query.expr);
+    if (coreIt != unsatCoreCache.end()) {
+      ExprHashSet current(query.constraints.begin(), query.constraints.end());
+      bool applicable = true;
+      for (const auto &constraint : coreIt->second) {
+        if (!current.count(constraint)) {
+          applicable = false;
+          break;
+        }
+      }
+      if (applicable) {
+        inCoreProbe = true;
+        bool probeHasSolution = true;
+        bool probeSuccess =
+            internalRunSolver(Query(ConstraintSet(coreIt->second), query.expr),
+                              /*objects=*/NULL, /*values=*/NULL,
+                              probeHasSolution);
+        inCoreProbe = false;
+        if (probeSuccess && !probeHasSolution) {
+          hasSolution = false;
+          return true;
+        }
+      }
+    }
+  }
+
   TimerStatIncrementer t(stats::queryTime);
-  // NOTE: Z3 will switch to using a slower solver internally if push/pop are
-  // used so for now it is likely that creating a new solver each time is the
-  // right way to go until Z3 changes its behaviour.
-  //
-  // TODO: Investigate using a custom tactic as described in
-  // https://github.com/klee/klee/issues/653
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
 
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
+  // Assert each constraint behind a fresh assumption literal so an
+  // unsat answer comes back with the subset that actually mattered.
+  bool trackCores = Z3UnsatCoreMinimization && !Z3IncrementalSolving &&
+                    !inCoreProbe && !query.constraints.empty();
+  std::vector<Z3ASTHandle> trackingLits;
+  std::map<::Z3_ast, ref<Expr>> litToConstraint;
+
+  // With read elimination each query decides its own encoding: an array
+  // whose every read in this query names a single cell needs no theory
+  // of arrays at all, and when that holds for every array (and no
+  // constant arrays appear) the whole query is plain bitvector logic.
+  // Arrays that are also read symbolically keep their array encoding,
+  // and the defining equalities tie their cell variables back in.
+  bool pureBitvector = false;
+  std::vector<const Array *> linkedArrays;
+  if (readElimination) {
+    std::vector<ref<ReadExpr>> reads;
+    for (auto const &constraint : query.constraints)
+      findReads(constraint, /*visitUpdates=*/true, reads);
+    findReads(query.expr, /*visitUpdates=*/true, reads);
+
+    pureBitvector = true;
+    std::unordered_set<const Array *> linked;
+    for (auto const &re : reads) {
+      if (Z3Builder::isEliminableRead(re.get()))
+        continue;
+      pureBitvector = false;
+      const Array *root = re->updates.root;
+      if (root->isSymbolicArray() && linked.insert(root).second)
+        linkedArrays.push_back(root);
+    }
+  }
+
   ConstantArrayFinder constant_arrays_in_query;
-  for (auto const &constraint : query.constraints) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
-    constant_arrays_in_query.visit(constraint);
+  Z3_solver theSolver;
+  if (Z3IncrementalSolving) {
+    // NOTE: Z3 switches to a slower internal solver once push/pop are
+    // used, but asserting only the delta against the shared constraint
+    // prefix wins on query streams from the same state lineage. The
+    // query expression itself is asserted in its own scope, popped
+    // after the check.
+    theSolver = prepareIncrementalSolver(query);
+    Z3_solver_push(builder->ctx, theSolver);
+  } else {
+    theSolver =
+        pureBitvector
+            ? Z3_mk_solver_for_logic(
+                  builder->ctx, Z3_mk_string_symbol(builder->ctx, "QF_BV"))
+            : Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+
+    for (auto const &constraint : query.constraints) {
+      if (trackCores) {
+        Z3ASTHandle lit(Z3_mk_fresh_const(builder->ctx, "kcore",
+                                          Z3_mk_bool_sort(builder->ctx)),
+                        builder->ctx);
+        Z3_solver_assert_and_track(builder->ctx, theSolver,
+                                   builder->construct(constraint), lit);
+        litToConstraint.emplace((::Z3_ast)lit, constraint);
+        trackingLits.push_back(lit);
+      } else {
+        Z3_solver_assert(builder->ctx, theSolver,
+                         builder->construct(constraint));
+      }
+      constant_arrays_in_query.visit(constraint);
+    }
   }
   ++stats::queries;
   if (objects)
@@ -285,6 +564,17 @@ bool Z3SolverImpl::internalRunSolver(
     }
   }
 
+  // Tie the cell variables of partially eliminated arrays back to the
+  // array encoding. Fully eliminated arrays are deliberately absent: the
+  // free cell variables admit exactly the models of the original cells.
+  for (const Array *array : linkedArrays) {
+    auto linkIt = builder->cell_link_assertions.find(array);
+    if (linkIt == builder->cell_link_assertions.end())
+      continue;
+    for (auto const &cellLinkExpr : linkIt->second)
+      Z3_solver_assert(builder->ctx, theSolver, cellLinkExpr);
+  }
+
   // KLEE Queries are validity queries i.e.
   // ∀ X Constraints(X) → query(X)
   // but Z3 works in terms of satisfiability so instead we ask the
@@ -307,13 +597,44 @@ bool Z3SolverImpl::internalRunSolver(
   runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
                                        hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
+  if (trackCores && satisfiable == Z3_L_FALSE) {
+    ::Z3_ast_vector core = Z3_solver_get_unsat_core(builder->ctx, theSolver);
+    Z3_ast_vector_inc_ref(builder->ctx, core);
+    std::vector<ref<Expr>> coreConstraints;
+    unsigned coreSize = Z3_ast_vector_size(builder->ctx, core);
+    coreConstraints.reserve(coreSize);
+    for (unsigned i = 0; i < coreSize; ++i) {
+      auto litIt =
+          litToConstraint.find(Z3_ast_vector_get(builder->ctx, core, i));
+      if (litIt != litToConstraint.end())
+        coreConstraints.push_back(litIt->second);
+    }
+    Z3_ast_vector_dec_ref(builder->ctx, core);
+
+    // Only worth remembering when it actually shrinks the query. An
+    // empty core (the negated expression is unsatisfiable on its own)
+    // is the best possible outcome.
+    if (coreConstraints.size() < query.constraints.size()) {
+      if (unsatCoreCache.size() > MaxUnsatCoreCacheSize)
+        unsatCoreCache.clear();
+      unsatCoreCache[query.expr] = std::move(coreConstraints);
+    }
+  }
+
+  if (Z3IncrementalSolving) {
+    // Discard the query scope but keep the asserted constraint scopes
+    // for the next query.
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
+  // Recycle the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and recycling now
   // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
+  // ``Query`` (and, with the persistent AST cache, across queries)
+  // rather than only sharing within a single call to
   // ``builder->construct()``.
-  builder->clearConstructCache();
+  builder->recycleConstructCache();
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
       runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
@@ -22,7 +22,7 @@
 namespace klee {
 
 compressed_fd_ostream::compressed_fd_ostream(const std::string &Filename,
-                                             std::string &ErrorInfo)
+                                             std::string &ErrorInfo, int Level)
     : llvm::raw_ostream(), pos(0) {
   ErrorInfo = "";
   // Open file in binary mode
@@ -47,7 +47,7 @@ compressed_fd_ostream::compressed_fd_ostream(const std::string &Filename,
   strm.avail_in = 0;
   strm.avail_out = BUFSIZE;
 
-  const auto ret = deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, 31,
+  const auto ret = deflateInit2(&strm, Level, Z_DEFLATED, 31,
                                 8 /* memory usage default, 0 smallest, 9 highest*/,
                                 Z_DEFAULT_STRATEGY);
   if (ret != Z_OK)
@@ -117,5 +117,58 @@ void compressed_fd_ostream::write_file(const char *Ptr, size_t Size) {
     Size -= ret;
   } while (Size > 0);
 }
+
+namespace {
+// Maximum number of bytes queued for the compression worker before the
+// writing thread has to wait; bounds memory when the compressor cannot
+// keep up with a burst of log data.
+const size_t ASYNC_QUEUE_CAPACITY = 16 * BUFSIZE;
+}
+
+async_compressed_fd_ostream::async_compressed_fd_ostream(
+    const std::string &Filename, std::string &ErrorInfo, int Level)
+    : stream(Filename, ErrorInfo, Level) {
+  if (!ErrorInfo.empty())
+    return;
+  worker = std::thread(&async_compressed_fd_ostream::compressLoop, this);
+}
+
+async_compressed_fd_ostream::~async_compressed_fd_ostream() {
+  flush();
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    done = true;
+  }
+  chunkAvailable.notify_one();
+  if (worker.joinable())
+    worker.join();
+}
+
+void async_compressed_fd_ostream::write_impl(const char *Ptr, size_t Size) {
+  pos += Size;
+  std::unique_lock<std::mutex> lock(mutex);
+  spaceAvailable.wait(lock,
+                      [this] { return queuedBytes < ASYNC_QUEUE_CAPACITY; });
+  chunks.emplace_back(Ptr, Size);
+  queuedBytes += Size;
+  chunkAvailable.notify_one();
+}
+
+void async_compressed_fd_ostream::compressLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    chunkAvailable.wait(lock, [this] { return done || !chunks.empty(); });
+    if (chunks.empty())
+      return; // done and fully drained
+    std::string chunk = std::move(chunks.front());
+    chunks.pop_front();
+    queuedBytes -= chunk.size();
+    spaceAvailable.notify_one();
+    // compress without holding the lock so the writer can keep queueing
+    lock.unlock();
+    stream.write(chunk.data(), chunk.size());
+    lock.lock();
+  }
+}
 }
 #endif
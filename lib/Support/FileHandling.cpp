@@ -44,5 +44,17 @@ klee_open_compressed_output_file(const std::string &path, std::string &error) {
   }
   return f;
 }
+
+std::unique_ptr<llvm::raw_ostream>
+klee_open_async_compressed_output_file(const std::string &path,
+                                       std::string &error) {
+  error = "";
+  std::unique_ptr<llvm::raw_ostream> f(
+      new async_compressed_fd_ostream(path, error));
+  if (!error.empty()) {
+    f.reset(nullptr);
+  }
+  return f;
+}
 #endif
 }
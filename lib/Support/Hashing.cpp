@@ -0,0 +1,93 @@
+//===-- Hashing.cpp -------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Support/Hashing.h"
+
+#include <cstring>
+
+namespace {
+
+const std::uint64_t Prime1 = 0x9e3779b185ebca87ULL;
+const std::uint64_t Prime2 = 0xc2b2ae3d27d4eb4fULL;
+const std::uint64_t Prime3 = 0x165667b19e3779f9ULL;
+const std::uint64_t Prime4 = 0x85ebca77c2b2ae63ULL;
+const std::uint64_t Prime5 = 0x27d4eb2f165667c5ULL;
+
+std::uint64_t rotl(std::uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// memcpy compiles to a single (possibly unaligned) load; indexing the
+// buffer as uint64_t directly would be undefined for unaligned input.
+std::uint64_t read64(const unsigned char *p) {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+std::uint32_t read32(const unsigned char *p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+std::uint64_t round_(std::uint64_t acc, std::uint64_t lane) {
+  return rotl(acc + lane * Prime2, 31) * Prime1;
+}
+
+std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t lane) {
+  return (acc ^ round_(0, lane)) * Prime1 + Prime4;
+}
+
+} // namespace
+
+std::uint64_t klee::hashing::hashBytes(const void *data, std::size_t len,
+                                       std::uint64_t seed) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  const unsigned char *end = p + len;
+  std::uint64_t h;
+
+  if (len >= 32) {
+    std::uint64_t v1 = seed + Prime1 + Prime2;
+    std::uint64_t v2 = seed + Prime2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - Prime1;
+    do {
+      v1 = round_(v1, read64(p));
+      v2 = round_(v2, read64(p + 8));
+      v3 = round_(v3, read64(p + 16));
+      v4 = round_(v4, read64(p + 24));
+      p += 32;
+    } while (p + 32 <= end);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = mergeRound(h, v1);
+    h = mergeRound(h, v2);
+    h = mergeRound(h, v3);
+    h = mergeRound(h, v4);
+  } else {
+    h = seed + Prime5;
+  }
+
+  h += len;
+  for (; p + 8 <= end; p += 8)
+    h = rotl(h ^ round_(0, read64(p)), 27) * Prime1 + Prime4;
+  if (p + 4 <= end) {
+    h = rotl(h ^ (read32(p) * Prime1), 23) * Prime2 + Prime3;
+    p += 4;
+  }
+  for (; p != end; ++p)
+    h = rotl(h ^ (*p * Prime5), 11) * Prime1;
+
+  h ^= h >> 33;
+  h *= Prime2;
+  h ^= h >> 29;
+  h *= Prime3;
+  h ^= h >> 32;
+  return h;
+}
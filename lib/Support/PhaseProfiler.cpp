@@ -0,0 +1,106 @@
+//===-- PhaseProfiler.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Support/PhaseProfiler.h"
+
+#include "klee/Support/FileHandling.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <sys/time.h>
+
+using namespace klee;
+
+volatile sig_atomic_t profiler::currentPhase = profiler::Other;
+
+namespace {
+
+const char *phaseNames[profiler::NumPhases] = {
+    "other", "instruction dispatch", "fork", "solver", "searcher", "stats"};
+
+/// Per-phase totals; fetch_add on lock-free atomics is safe from the
+/// signal handler.
+std::atomic<std::uint64_t> sampleCounts[profiler::NumPhases];
+
+/// Chronological record of each sample's phase for the timeline view.
+/// Samples past the capacity still land in sampleCounts.
+const std::uint64_t TimelineCapacity = UINT64_C(1) << 20;
+unsigned char timeline[TimelineCapacity];
+std::atomic<std::uint64_t> samplesTaken{0};
+
+unsigned samplingFrequency = 0;
+
+void handleSample(int) {
+  sig_atomic_t phase = profiler::currentPhase;
+  if (phase < 0 || phase >= profiler::NumPhases)
+    phase = profiler::Other;
+  sampleCounts[phase].fetch_add(1, std::memory_order_relaxed);
+  std::uint64_t n = samplesTaken.fetch_add(1, std::memory_order_relaxed);
+  if (n < TimelineCapacity)
+    timeline[n] = static_cast<unsigned char>(phase);
+}
+
+} // namespace
+
+void profiler::start(unsigned frequency) {
+  if (!frequency)
+    return;
+  samplingFrequency = std::min(frequency, 10000u);
+
+  struct sigaction sa;
+  std::memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handleSample;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, nullptr);
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 1000000 / samplingFrequency;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void profiler::stop() {
+  struct itimerval timer;
+  std::memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  signal(SIGPROF, SIG_IGN);
+}
+
+bool profiler::writeSpeedscope(const std::string &path, std::string &error) {
+  auto os = klee_open_output_file(path, error);
+  if (!os)
+    return false;
+
+  const double weight =
+      samplingFrequency ? 1000.0 / samplingFrequency : 0.0;
+  const std::uint64_t recorded =
+      std::min(samplesTaken.load(), TimelineCapacity);
+
+  *os << "{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",\n"
+      << "\"shared\":{\"frames\":[";
+  for (unsigned i = 0; i != NumPhases; ++i)
+    *os << (i ? "," : "") << "{\"name\":\"" << phaseNames[i] << "\"}";
+  *os << "]},\n"
+      << "\"profiles\":[{\"type\":\"sampled\",\"name\":\"klee phases\","
+      << "\"unit\":\"milliseconds\",\"startValue\":0,\"endValue\":"
+      << static_cast<std::uint64_t>(recorded * weight) << ",\n\"samples\":[";
+  for (std::uint64_t i = 0; i != recorded; ++i)
+    *os << (i ? ",[" : "[") << static_cast<unsigned>(timeline[i]) << "]";
+  *os << "],\n\"weights\":[";
+  for (std::uint64_t i = 0; i != recorded; ++i)
+    *os << (i ? "," : "") << weight;
+  *os << "]}]}\n";
+  return true;
+}
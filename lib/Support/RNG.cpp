@@ -157,3 +157,91 @@ bool RNG::getBool() {
   bits ^= bits >> 1U;
   return bits & 1U;
 }
+
+/*
+   SplittableRNG is xoshiro256** 1.0 by David Blackman and Sebastiano
+   Vigna, seeded through splitmix64 as its authors recommend; both are
+   public domain (CC0, http://prng.di.unimi.it).
+*/
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/* advances the given splitmix64 state and returns the next output */
+static uint64_t splitmix64(uint64_t &x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27U)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31U);
+}
+
+SplittableRNG::SplittableRNG() {
+  seed(RNGInitialSeed);
+}
+
+SplittableRNG::SplittableRNG(uint64_t s) {
+  seed(s);
+}
+
+void SplittableRNG::seed(uint64_t x) {
+  for (int i = 0; i < 4; i++)
+    s[i] = splitmix64(x);
+}
+
+SplittableRNG SplittableRNG::split(uint64_t tag) {
+  /* mix one output of this stream with the tag, so the child stream is
+     a deterministic function of the fork path alone */
+  uint64_t x = next() ^ (tag * 0x9e3779b97f4a7c15ULL);
+  return SplittableRNG(splitmix64(x));
+}
+
+uint64_t SplittableRNG::next() {
+  const uint64_t result = rotl64(s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17U;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl64(s[3], 45);
+
+  return result;
+}
+
+unsigned int SplittableRNG::getInt32() {
+  return (unsigned int)(next() >> 32U);
+}
+
+int SplittableRNG::getInt31() {
+  return (int)(getInt32() >> 1U);
+}
+
+double SplittableRNG::getDoubleLR() {
+  return getInt32()*(1.0/4294967295.0);
+}
+
+double SplittableRNG::getDoubleL() {
+  return getInt32()*(1.0/4294967296.0);
+}
+
+double SplittableRNG::getDouble() {
+  return (((double)getInt32()) + 0.5)*(1.0/4294967296.0);
+}
+
+float SplittableRNG::getFloatLR() {
+  return getInt32()*(1.0f/4294967295.0f);
+}
+
+float SplittableRNG::getFloatL() {
+  return getInt32()*(1.0f/4294967296.0f);
+}
+
+float SplittableRNG::getFloat() {
+  return (getInt32() + 0.5f)*(1.0f/4294967296.0f);
+}
+
+bool SplittableRNG::getBool() {
+  return next() & 1U;
+}
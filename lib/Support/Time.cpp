@@ -124,6 +124,7 @@ time::Span time::operator*(const time::Span &span, unsigned factor) { return tim
 time::Span time::operator*(unsigned factor, const time::Span &span) { return time::Span(span.duration * factor); }
 time::Span time::operator/(const time::Span &span, unsigned divisor) { return time::Span(span.duration / divisor); }
 bool time::operator==(const time::Span &lhs, const time::Span &rhs) { return lhs.duration == rhs.duration; }
+bool time::operator!=(const time::Span &lhs, const time::Span &rhs) { return lhs.duration != rhs.duration; }
 bool time::operator<=(const time::Span &lhs, const time::Span &rhs) { return lhs.duration <= rhs.duration; }
 bool time::operator>=(const time::Span &lhs, const time::Span &rhs) { return lhs.duration >= rhs.duration; }
 bool time::operator<(const time::Span &lhs, const time::Span &rhs) { return lhs.duration < rhs.duration; }
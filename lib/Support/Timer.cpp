@@ -11,6 +11,8 @@
 #include "klee/Support/Timer.h"
 #include "klee/System/Time.h"
 
+#include <algorithm>
+
 
 using namespace klee;
 
@@ -47,6 +49,17 @@ void Timer::reset(const time::Point &currentTime) {
 
 // TimerGroup
 
+namespace {
+  /// Number of clock checks aimed for per minimum timer interval; timers may
+  /// fire late by up to a 1/kChecksPerInterval fraction of that interval.
+  const std::uint64_t kChecksPerInterval = 8;
+  /// Upper bound on calls skipped between clock checks. It bounds how long
+  /// timers can be deferred when the call rate suddenly collapses (e.g. every
+  /// instruction starts hitting the solver): at most one batch of this many
+  /// calls passes before the distance is recalibrated to the new rate.
+  const std::uint64_t kMaxCallsPerClockCheck = 1 << 12;
+}
+
 TimerGroup::TimerGroup(const time::Span &minInterval) :
   invocationTimer{
     minInterval,
@@ -55,7 +68,8 @@ TimerGroup::TimerGroup(const time::Span &minInterval) :
       for (auto &timer : timers)
         timer->invoke(currentTime);
     }
-  } {};
+  },
+  lastCheckTime{time::getWallTime()} {};
 
 void TimerGroup::add(std::unique_ptr<klee::Timer> timer) {
   const auto &interval = timer->getInterval();
@@ -69,13 +83,41 @@ void TimerGroup::add(std::unique_ptr<klee::Timer> timer) {
 }
 
 void TimerGroup::invoke() {
-  currentTime = time::getWallTime();
+  if (--callsUntilClockCheck > 0)
+    return;
+
+  const auto now = time::getWallTime();
+  const time::Span observed{now - lastCheckTime};
+  lastCheckTime = now;
+
+  // recalibrate the clock check distance from the observed call rate
+  const auto elapsed = observed.toMicroseconds();
+  const auto target =
+      invocationTimer.getInterval().toMicroseconds() / kChecksPerInterval;
+  if (target > 0) {
+    if (elapsed == 0) {
+      // faster than the clock resolution, back off
+      callsPerClockCheck =
+          std::min(callsPerClockCheck * 2, kMaxCallsPerClockCheck);
+    } else {
+      const auto calibrated = callsPerClockCheck * target / elapsed;
+      callsPerClockCheck = std::max(std::uint64_t{1},
+                                    std::min(calibrated,
+                                             kMaxCallsPerClockCheck));
+    }
+  }
+  callsUntilClockCheck = callsPerClockCheck;
+
+  currentTime = now;
   invocationTimer.invoke(currentTime);
 }
 
 void TimerGroup::reset() {
   currentTime = time::getWallTime();
   invocationTimer.reset(currentTime);
+  lastCheckTime = currentTime;
+  callsPerClockCheck = 1;
+  callsUntilClockCheck = 1;
   for (auto &timer : timers)
     timer->reset(currentTime);
 }
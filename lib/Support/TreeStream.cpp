@@ -12,26 +12,40 @@
 
 #include "klee/Support/Debug.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 #include <fstream>
 #include <iterator>
-#include <map>
 
 #include "llvm/Support/raw_ostream.h"
 #include <string.h>
 
 using namespace klee;
 
+// On-disk layout, all integers LEB128 varints:
+//
+//   fork record: varint(parent << 1 | 1), varint(child)
+//   data record: varint(id << 1), varint(size), followed by the payload
+//
+// The writer additionally keeps an in-memory index of data record
+// locations per stream together with each stream's fork point, so
+// readStream() seeks directly to the records making up one stream's
+// path instead of scanning the whole file.
+
 ///
 
-TreeStreamWriter::TreeStreamWriter(const std::string &_path) 
+TreeStreamWriter::TreeStreamWriter(const std::string &_path)
   : lastID(0),
     bufferCount(0),
     path(_path),
-    output(new std::ofstream(path.c_str(), 
+    output(new std::ofstream(path.c_str(),
                              std::ios::out | std::ios::binary)),
-    ids(1) {
+    ids(1),
+    fileOffset(0),
+    parents(1, 0),
+    forkOffsets(1, 0),
+    index(1) {
   if (!output->good()) {
     delete output;
     output = 0;
@@ -55,14 +69,16 @@ TreeOStream TreeStreamWriter::open(const TreeOStream &os) {
   assert(output && os.writer==this);
   flushBuffer();
   unsigned id = ids++;
-  output->write(reinterpret_cast<const char*>(&os.id), 4);
-  unsigned tag = id | (1<<31);
-  output->write(reinterpret_cast<const char*>(&tag), 4);
+  parents.push_back(os.id);
+  forkOffsets.push_back(fileOffset);
+  index.resize(ids);
+  writeVarint((uint64_t(os.id) << 1) | 1);
+  writeVarint(id);
   return TreeOStream(*this, id);
 }
 
 void TreeStreamWriter::write(TreeOStream &os, const char *s, unsigned size) {
-  if (bufferCount && 
+  if (bufferCount &&
       (os.id!=lastID || size+bufferCount>bufferSize))
     flushBuffer();
   if (bufferCount) { // (os.id==lastID && size+bufferCount<=bufferSize)
@@ -73,17 +89,32 @@ void TreeStreamWriter::write(TreeOStream &os, const char *s, unsigned size) {
     memcpy(buffer, s, size);
     bufferCount = size;
   } else {
-    output->write(reinterpret_cast<const char*>(&os.id), 4);
-    output->write(reinterpret_cast<const char*>(&size), 4);
-    output->write(s, size);
+    writeRecord(os.id, s, size);
   }
 }
 
+void TreeStreamWriter::writeVarint(uint64_t value) {
+  do {
+    unsigned char byte = value & 0x7f;
+    value >>= 7;
+    if (value)
+      byte |= 0x80;
+    output->put(static_cast<char>(byte));
+    ++fileOffset;
+  } while (value);
+}
+
+void TreeStreamWriter::writeRecord(unsigned id, const char *s, unsigned size) {
+  writeVarint(uint64_t(id) << 1);
+  writeVarint(size);
+  index[id].push_back(std::make_pair(fileOffset, size));
+  output->write(s, size);
+  fileOffset += size;
+}
+
 void TreeStreamWriter::flushBuffer() {
-  if (bufferCount) {    
-    output->write(reinterpret_cast<const char*>(&lastID), 4);
-    output->write(reinterpret_cast<const char*>(&bufferCount), 4);
-    output->write(buffer, bufferCount);
+  if (bufferCount) {
+    writeRecord(lastID, buffer, bufferCount);
     bufferCount = 0;
   }
 }
@@ -97,67 +128,32 @@ void TreeStreamWriter::readStream(TreeStreamID streamID,
                                   std::vector<unsigned char> &out) {
   assert(streamID>0 && streamID<ids);
   flush();
-  
+  KLEE_DEBUG(llvm::errs() << "finding chain for: " << streamID << "\n");
+
+  // Gather the data records of the stream and its ancestors from the
+  // index, excluding ancestor data written after the respective fork.
+  std::vector<std::pair<uint64_t, unsigned> > records;
+  uint64_t forkOffset = UINT64_MAX;
+  for (unsigned id = streamID; id; id = parents[id]) {
+    KLEE_DEBUG(llvm::errs() << "root: " << id << "\n");
+    for (const auto &record : index[id]) {
+      if (record.first < forkOffset)
+        records.push_back(record);
+    }
+    forkOffset = forkOffsets[id];
+  }
+  std::sort(records.begin(), records.end());
+
   std::ifstream is(path.c_str(),
                    std::ios::in | std::ios::binary);
   assert(is.good());
-  KLEE_DEBUG(llvm::errs() << "finding chain for: " << streamID << "\n");
-
-  std::map<unsigned,unsigned> parents;
-  std::vector<unsigned> roots;
-  for (;;) {
+  for (const auto &record : records) {
+    size_t at = out.size();
+    out.resize(at + record.second);
+    is.seekg(record.first, std::ios::beg);
+    is.read(reinterpret_cast<char*>(&out[at]), record.second);
     assert(is.good());
-    unsigned id;
-    unsigned tag;
-    is.read(reinterpret_cast<char*>(&id), 4);
-    is.read(reinterpret_cast<char*>(&tag), 4);
-    if (tag&(1<<31)) { // fork
-      unsigned child = tag ^ (1<<31);
-
-      if (child==streamID) {
-        roots.push_back(child);
-        while (id) {
-          roots.push_back(id);
-          std::map<unsigned, unsigned>::iterator it = parents.find(id);
-          assert(it!=parents.end());
-          id = it->second;
-        } 
-        break;
-      } else {
-        parents.insert(std::make_pair(child,id));
-      }
-    } else {
-      unsigned size = tag;
-      while (size--) is.get();
-    }
   }
-  KLEE_DEBUG({
-      llvm::errs() << "roots: ";
-      for (size_t i = 0, e = roots.size(); i < e; ++i) {
-        llvm::errs() << roots[i] << " ";
-      }
-      llvm::errs() << "\n";
-    });
-  is.seekg(0, std::ios::beg);
-  for (;;) {
-    unsigned id;
-    unsigned tag;
-    is.read(reinterpret_cast<char*>(&id), 4);
-    is.read(reinterpret_cast<char*>(&tag), 4);
-    if (!is.good()) break;
-    if (tag&(1<<31)) { // fork
-      unsigned child = tag ^ (1<<31);
-      if (id==roots.back() && roots.size()>1 && child==roots[roots.size()-2])
-        roots.pop_back();
-    } else {
-      unsigned size = tag;
-      if (id==roots.back()) {
-        while (size--) out.push_back(is.get());
-      } else {
-        while (size--) is.get();
-      }
-    }
-  }  
 }
 
 ///
@@ -195,4 +191,3 @@ void TreeOStream::flush() {
   assert(writer);
   writer->flush();
 }
-
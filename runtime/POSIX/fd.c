@@ -76,8 +76,22 @@ static void *__concretize_ptr(const void *p);
 static size_t __concretize_size(size_t s);
 static const char *__concretize_string(const char *s);
 
-/* Returns pointer to the file entry for a valid fd */
-static exe_file_t *__get_file(int fd) {
+/* Move file bytes with the executor's native copy, which handles any
+   transfer size in one step instead of an interpreted byte loop. Fall
+   back to plain memcpy when an argument is symbolic, since klee_memcpy
+   requires concrete arguments. */
+static void __df_memcpy(void *dst, const void *src, size_t count) {
+  if (klee_is_symbolic((uintptr_t)dst) || klee_is_symbolic((uintptr_t)src) ||
+      klee_is_symbolic(count))
+    memcpy(dst, src, count);
+  else
+    klee_memcpy(dst, src, count);
+}
+
+/* Returns pointer to the file entry for a valid fd, without
+   materializing a deferred symbolic stream (for close and dup, which
+   do not look at the contents) */
+static exe_file_t *__get_file_entry(int fd) {
   if (fd>=0 && fd<MAX_FDS) {
     exe_file_t *f = &__exe_env.fds[fd];
     if (f->flags & eOpen)
@@ -87,6 +101,29 @@ static exe_file_t *__get_file(int fd) {
   return 0;
 }
 
+/* Returns pointer to the file entry for a valid fd */
+static exe_file_t *__get_file(int fd) {
+  exe_file_t *f = __get_file_entry(fd);
+
+  if (f) {
+    /* Symbolic stdin/stdout are created on first access; dup'd
+       entries share the same dfile, as they would have eagerly. */
+    if (f->flags & eDeferredStdin) {
+      if (!__exe_fs.sym_stdin)
+        __create_sym_stdin();
+      f->dfile = __exe_fs.sym_stdin;
+      f->flags &= ~eDeferredStdin;
+    } else if (f->flags & eDeferredStdout) {
+      if (!__exe_fs.sym_stdout)
+        __create_sym_stdout();
+      f->dfile = __exe_fs.sym_stdout;
+      f->flags &= ~eDeferredStdout;
+    }
+  }
+
+  return f;
+}
+
 int access(const char *pathname, int mode) {
   exe_disk_file_t *dfile = __get_sym_file(pathname);
   
@@ -316,11 +353,11 @@ int close(int fd) {
   
   n_calls++;  
 
-  f = __get_file(fd);
+  f = __get_file_entry(fd);
   if (!f) {
     errno = EBADF;
     return -1;
-  } 
+  }
 
   if (__exe_fs.max_failures && *__exe_fs.close_fail == n_calls) {
     __exe_fs.max_failures--;
@@ -399,7 +436,7 @@ ssize_t read(int fd, void *buf, size_t count) {
       count = f->dfile->size - f->off;
     }
     
-    memcpy(buf, f->dfile->contents + f->off, count);
+    __df_memcpy(buf, f->dfile->contents + f->off, count);
     f->off += count;
     
     return count;
@@ -463,7 +500,7 @@ ssize_t write(int fd, const void *buf, size_t count) {
     }
     
     if (actual_count)
-      memcpy(f->dfile->contents + f->off, buf, actual_count);
+      __df_memcpy(f->dfile->contents + f->off, buf, actual_count);
     
     if (count != actual_count)
       klee_warning("write() ignores bytes.\n");
@@ -1121,7 +1158,9 @@ int fsync(int fd) {
 }
 
 int dup2(int oldfd, int newfd) {
-  exe_file_t *f = __get_file(oldfd);
+  /* the copied entry keeps any deferred-stream flag, so both fds
+     materialize to the same dfile on first access */
+  exe_file_t *f = __get_file_entry(oldfd);
 
   if (!f || !(newfd>=0 && newfd<MAX_FDS)) {
     errno = EBADF;
@@ -1146,7 +1185,7 @@ int dup2(int oldfd, int newfd) {
 }
 
 int dup(int oldfd) {
-  exe_file_t *f = __get_file(oldfd);
+  exe_file_t *f = __get_file_entry(oldfd);
   if (!f) {
     errno = EBADF;
     return -1;
@@ -47,7 +47,11 @@ typedef enum {
   eOpen         = (1 << 0),
   eCloseOnExec  = (1 << 1),
   eReadable     = (1 << 2),
-  eWriteable    = (1 << 3)
+  eWriteable    = (1 << 3),
+  /* backing symbolic stream not created yet; materialized on first
+     access through __get_file */
+  eDeferredStdin  = (1 << 4),
+  eDeferredStdout = (1 << 5)
 } exe_file_flag_t;
 
 typedef struct {      
@@ -64,6 +68,10 @@ typedef struct {
   exe_disk_file_t *sym_stdin, *sym_stdout;
   unsigned stdout_writes; /* how many chars were written to stdout */
   exe_disk_file_t *sym_files;
+  /* size of the symbolic stdin requested but not yet created; the
+     backing object materializes on first access (see __get_file) so
+     that never-touched streams cost no symbolic arrays */
+  unsigned deferred_stdin_size;
   /* --- */
   /* the maximum number of failures on one path; gets decremented after each failure */
   unsigned max_failures; 
@@ -96,6 +104,11 @@ void klee_init_fds(unsigned n_files, unsigned file_length,
                    int do_all_writes_flag, unsigned max_failures);
 void klee_init_env(int *argcPtr, char ***argvPtr);
 
+/* Create the symbolic stdin/stdout objects whose creation klee_init_fds
+   deferred (fd_init.c). */
+void __create_sym_stdin(void);
+void __create_sym_stdout(void);
+
 /* *** */
 
 int __fd_open(const char *pathname, int flags, mode_t mode);
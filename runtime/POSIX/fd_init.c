@@ -54,6 +54,9 @@ static void __create_new_dfile(exe_disk_file_t *dfile, unsigned size,
 
   assert(size);
 
+  /* Allocated once, before any forking: every state then shares these
+     contents copy-on-write through its address space, so only states
+     that write the file ever pay for their own copy. */
   dfile->size = size;
   dfile->contents = malloc(dfile->size);
   if (!dfile->contents)
@@ -96,6 +99,26 @@ static void __create_new_dfile(exe_disk_file_t *dfile, unsigned size,
   dfile->stat = s;
 }
 
+/* Stat defaults captured at klee_init_fds time for the deferred
+   stdin/stdout objects. */
+static struct stat64 __std_defaults;
+
+void __create_sym_stdin(void) {
+  __exe_fs.sym_stdin = malloc(sizeof(*__exe_fs.sym_stdin));
+  if (!__exe_fs.sym_stdin)
+    klee_report_error(__FILE__, __LINE__, "out of memory in klee_init_env", "user.err");
+  __create_new_dfile(__exe_fs.sym_stdin, __exe_fs.deferred_stdin_size, "stdin",
+                     &__std_defaults);
+}
+
+void __create_sym_stdout(void) {
+  __exe_fs.sym_stdout = malloc(sizeof(*__exe_fs.sym_stdout));
+  if (!__exe_fs.sym_stdout)
+    klee_report_error(__FILE__, __LINE__, "out of memory in klee_init_env", "user.err");
+  __create_new_dfile(__exe_fs.sym_stdout, 1024, "stdout", &__std_defaults);
+  __exe_fs.stdout_writes = 0;
+}
+
 static unsigned __sym_uint32(const char *name) {
   unsigned x;
   klee_make_symbolic(&x, sizeof x, name);
@@ -128,15 +151,14 @@ void klee_init_fds(unsigned n_files, unsigned file_length,
     __create_new_dfile(&__exe_fs.sym_files[k], file_length, name, &s);
   }
   
-  /* setting symbolic stdin */
-  if (stdin_length) {
-    __exe_fs.sym_stdin = malloc(sizeof(*__exe_fs.sym_stdin));
-    if (!__exe_fs.sym_stdin)
-      klee_report_error(__FILE__, __LINE__, "out of memory in klee_init_env", "user.err");
-    __create_new_dfile(__exe_fs.sym_stdin, stdin_length, "stdin", &s);
-    __exe_env.fds[0].dfile = __exe_fs.sym_stdin;
-  }
-  else __exe_fs.sym_stdin = NULL;
+  /* symbolic stdin is only created on first access (__get_file): many
+     targets never read it, and deferral keeps its array out of the
+     startup allocations and solver queries of every state */
+  __std_defaults = s;
+  __exe_fs.sym_stdin = NULL;
+  __exe_fs.deferred_stdin_size = stdin_length;
+  if (stdin_length)
+    __exe_env.fds[0].flags |= eDeferredStdin;
 
   __exe_fs.max_failures = max_failures;
   if (__exe_fs.max_failures) {
@@ -156,17 +178,12 @@ void klee_init_fds(unsigned n_files, unsigned file_length,
     klee_make_symbolic(__exe_fs.getcwd_fail, sizeof(*__exe_fs.getcwd_fail), "getcwd_fail");
   }
 
-  /* setting symbolic stdout */
-  if (sym_stdout_flag) {
-    __exe_fs.sym_stdout = malloc(sizeof(*__exe_fs.sym_stdout));
-    if (!__exe_fs.sym_stdout)
-      klee_report_error(__FILE__, __LINE__, "out of memory in klee_init_env", "user.err");
-    __create_new_dfile(__exe_fs.sym_stdout, 1024, "stdout", &s);
-    __exe_env.fds[1].dfile = __exe_fs.sym_stdout;
-    __exe_fs.stdout_writes = 0;
-  }
-  else __exe_fs.sym_stdout = NULL;
-  
+  /* symbolic stdout is deferred the same way as stdin */
+  __exe_fs.sym_stdout = NULL;
+  if (sym_stdout_flag)
+    __exe_env.fds[1].flags |= eDeferredStdout;
+
+
   __exe_env.save_all_writes = save_all_writes_flag;
   __exe_env.version = __sym_uint32("model_version");
   klee_assume(__exe_env.version == 1);
@@ -10,21 +10,153 @@
 /* Straight C for linking simplicity */
 
 #include <assert.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "klee/klee.h"
 
 #include "klee/ADT/KTest.h"
 
 static KTest *testData = 0;
+/* v2 files are kept memory-mapped and decoded lazily */
+static KTest2 *testData2 = 0;
 static unsigned testPosition = 0;
 
+static unsigned testNumObjects(void) {
+  return testData2 ? kTest2_numObjects(testData2) : testData->numObjects;
+}
+
+static const char *testObjectName(unsigned i) {
+  return testData2 ? kTest2_objectName(testData2, i) : testData->objects[i].name;
+}
+
+static unsigned testObjectNumBytes(unsigned i) {
+  return testData2 ? kTest2_objectNumBytes(testData2, i)
+                   : testData->objects[i].numBytes;
+}
+
+static const unsigned char *testObjectBytes(unsigned i) {
+  return testData2 ? kTest2_objectBytes(testData2, i) : testData->objects[i].bytes;
+}
+
+/* Fork server (see klee-replay --fork-server): when KLEE_FORKSRV names a
+ * control and a status pipe fd ("ctl,st"), the constructor below turns
+ * this fully loaded process into a server that forks one child per
+ * received .ktest path, so a replay driver pays exec and loader costs
+ * only once per worker. Protocol, all integers in host byte order:
+ *
+ *   server -> driver   uint32 hello (KLEE_FORKSRV_HELLO)
+ *   driver -> server   uint32 path length, followed by the path
+ *                      (length 0 shuts the server down)
+ *   server -> driver   uint32 wait(2) status of the finished child
+ */
+#define KLEE_FORKSRV_HELLO 0x4b464b53u
+
+static pid_t forksrv_child = 0;
+
+static int forksrv_read(int fd, void *buf, size_t count) {
+  char *p = buf;
+  while (count) {
+    ssize_t n = read(fd, p, count);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      return 0;
+    }
+    p += n;
+    count -= n;
+  }
+  return 1;
+}
+
+static int forksrv_write(int fd, const void *buf, size_t count) {
+  const char *p = buf;
+  while (count) {
+    ssize_t n = write(fd, p, count);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      return 0;
+    }
+    p += n;
+    count -= n;
+  }
+  return 1;
+}
+
+static void forksrv_alarm(int sig) {
+  if (forksrv_child > 0)
+    kill(forksrv_child, SIGKILL);
+}
+
+__attribute__((constructor)) static void klee_fork_server(void) {
+  const char *spec = getenv("KLEE_FORKSRV");
+  int ctl, st;
+  unsigned timeout = 0;
+  uint32_t hello = KLEE_FORKSRV_HELLO;
+
+  if (!spec || sscanf(spec, "%d,%d", &ctl, &st) != 2)
+    return;
+
+  const char *t = getenv("KLEE_REPLAY_TIMEOUT");
+  if (t)
+    timeout = atoi(t);
+
+  if (!forksrv_write(st, &hello, 4))
+    _exit(1);
+
+  for (;;) {
+    uint32_t len, status32;
+    char path[4096];
+    int status;
+    pid_t pid;
+
+    if (!forksrv_read(ctl, &len, 4) || !len || len >= sizeof path)
+      _exit(0);
+    if (!forksrv_read(ctl, path, len))
+      _exit(0);
+    path[len] = '\0';
+
+    pid = fork();
+    if (pid < 0)
+      _exit(1);
+    if (pid == 0) {
+      /* child: run main() against this test */
+      close(ctl);
+      close(st);
+      setenv("KTEST_FILE", path, 1);
+      unsetenv("KLEE_FORKSRV");
+      return;
+    }
+
+    forksrv_child = pid;
+    if (timeout) {
+      signal(SIGALRM, forksrv_alarm);
+      alarm(timeout);
+    }
+    while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR)
+        _exit(1);
+    }
+    alarm(0);
+    forksrv_child = 0;
+
+    status32 = status;
+    if (!forksrv_write(st, &status32, 4))
+      _exit(0);
+  }
+}
+
 static unsigned char rand_byte(void) {
   unsigned x = rand();
   x ^= x >> 16;
@@ -81,7 +213,7 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
     return;
   }
 
-  if (!testData) {
+  if (!testData && !testData2) {
     char tmp[256];
     char *name = getenv("KTEST_FILE");
 
@@ -95,38 +227,51 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
       }
       tmp[strlen(tmp) - 1] = '\0'; /* kill newline */
     }
-    testData = kTest_fromFile(name);
-    if (!testData) {
+    if (kTest_isKTest2File(name)) {
+      testData2 = kTest2_open(name);
+    } else {
+      testData = kTest_fromFile(name);
+    }
+    if (!testData && !testData2) {
       fprintf(stderr, "KLEE-RUNTIME: unable to open .ktest file\n");
       exit(1);
     }
   }
 
   for (;; ++testPosition) {
-    if (testPosition >= testData->numObjects) {
+    if (testPosition >= testNumObjects()) {
       report_internal_error("out of inputs. Will use zero if continuing.");
       memset(array, 0, nbytes);
       break;
     } else {
-      KTestObject *o = &testData->objects[testPosition];
-      if (strcmp("model_version", o->name) == 0 &&
+      const char *objName = testObjectName(testPosition);
+      unsigned numBytes = testObjectNumBytes(testPosition);
+      const unsigned char *bytes;
+      if (strcmp("model_version", objName) == 0 &&
           strcmp("model_version", name) != 0) {
         // Skip over this KTestObject because we've hit
         // `model_version` which is from the POSIX runtime
         // and the caller didn't ask for it.
         continue;
       }
-      if (strcmp(name, o->name) != 0) {
+      if (strcmp(name, objName) != 0) {
         report_internal_error(
             "object name mismatch. Requesting \"%s\" but returning \"%s\"",
-            name, o->name);
+            name, objName);
       }
-      memcpy(array, o->bytes, nbytes < o->numBytes ? nbytes : o->numBytes);
-      if (nbytes != o->numBytes) {
+      bytes = testObjectBytes(testPosition);
+      if (!bytes) {
+        report_internal_error("cannot decode object \"%s\"", objName);
+        memset(array, 0, nbytes);
+        ++testPosition;
+        break;
+      }
+      memcpy(array, bytes, nbytes < numBytes ? nbytes : numBytes);
+      if (nbytes != numBytes) {
         report_internal_error("object sizes differ. Expected %zu but got %u",
-                              nbytes, o->numBytes);
-        if (o->numBytes < nbytes)
-          memset((char *)array + o->numBytes, 0, nbytes - o->numBytes);
+                              nbytes, numBytes);
+        if (numBytes < nbytes)
+          memset((char *)array + numBytes, 0, nbytes - numBytes);
       }
       ++testPosition;
       break;
@@ -134,6 +279,47 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
   }
 }
 
+void klee_make_symbolic_batch(const klee_sym_region *regions, size_t count) {
+  size_t i;
+  for (i = 0; i != count; ++i)
+    klee_make_symbolic(regions[i].address, regions[i].nbytes, regions[i].name);
+}
+
+/* Persistent replay server: iterate many tests from one process. The
+   next klee_make_symbolic() call picks up the bindings of the newly
+   loaded test; v2 files go through the lazy mmap reader. */
+int klee_replay_set_test(const char *path) {
+  KTest *newData = 0;
+  KTest2 *newData2 = 0;
+
+  if (kTest_isKTest2File(path)) {
+    newData2 = kTest2_open(path);
+    if (!newData2)
+      return 0;
+  } else {
+    newData = kTest_fromFile(path);
+    if (!newData)
+      return 0;
+  }
+
+  klee_replay_end_test();
+  testData = newData;
+  testData2 = newData2;
+  return 1;
+}
+
+void klee_replay_end_test(void) {
+  if (testData) {
+    kTest_free(testData);
+    testData = 0;
+  }
+  if (testData2) {
+    kTest2_close(testData2);
+    testData2 = 0;
+  }
+  testPosition = 0;
+}
+
 void klee_silent_exit(int x) { exit(x); }
 
 uintptr_t klee_choose(uintptr_t n) {
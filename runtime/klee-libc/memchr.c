@@ -34,14 +34,21 @@
  * SUCH DAMAGE.
  */
 
+#include "klee/klee.h"
+
 #include <string.h>
 
+/* Executor-side model, as for strlen (strlen.c). */
+void *__klee_memchr(const void *s, int c, size_t n);
+
 void *
 memchr(s, c, n)
 	const void *s;
 	int c;
 	size_t n;
 {
+	if (!klee_is_symbolic((uintptr_t)s) && !klee_is_symbolic(n))
+		return __klee_memchr(s, c, n);
 	if (n != 0) {
 		const unsigned char *p = s;
 
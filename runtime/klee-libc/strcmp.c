@@ -7,7 +7,14 @@
 //
 //===----------------------------------------------------------------------===*/
 
+#include "klee/klee.h"
+
+/* Executor-side model, as for strlen (strlen.c). */
+int __klee_strcmp(const char *a, const char *b);
+
 int strcmp(const char *a, const char *b) {
+  if (!klee_is_symbolic((uintptr_t)a) && !klee_is_symbolic((uintptr_t)b))
+    return __klee_strcmp(a, b);
   while (*a && *a == *b)
     ++a, ++b;
   return *a - *b;
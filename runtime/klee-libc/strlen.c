@@ -7,10 +7,19 @@
 //
 //===----------------------------------------------------------------------===*/
 
+#include "klee/klee.h"
+
 #include <string.h>
 
+/* Executor-side model (SpecialFunctionHandler): scans concrete bytes
+   natively and emits one combined expression for a symbolic tail
+   instead of forking per byte. Requires a concrete pointer. */
+size_t __klee_strlen(const char *str);
+
 size_t strlen(const char *str) {
   const char *s = str;
+  if (!klee_is_symbolic((uintptr_t)str))
+    return __klee_strlen(str);
   while (*s)
     ++s;
   return s - str;
@@ -0,0 +1,24 @@
+// RUN: %clang %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out-1 %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-1 --search=random-state --write-paths --record-schedule=%t.sched %t1.bc
+// RUN: %klee --output-dir=%t.klee-out-2 --search=random-state --write-paths --replay-schedule=%t.sched %t1.bc
+//
+// With the recorded schedule replayed, states complete in the same
+// order, so corresponding test cases describe the same paths.
+// RUN: diff %t.klee-out-1/test000001.path %t.klee-out-2/test000001.path
+// RUN: diff %t.klee-out-1/test000004.path %t.klee-out-2/test000004.path
+// RUN: diff %t.klee-out-1/test000008.path %t.klee-out-2/test000008.path
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char c[3];
+  klee_make_symbolic(&c, sizeof(c), "c");
+
+  int n = 0;
+  for (int i = 0; i < 3; ++i)
+    if (c[i] & 1)
+      ++n;
+
+  return n;
+}
@@ -0,0 +1,31 @@
+// RUN: %clang %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --shared-constant-globals --exit-on-error %t1.bc
+// RUN: %clang %s -emit-llvm -g -c -o %t2.bc -DWRITE_CONSTANT
+// RUN: rm -rf %t.klee-out
+// RUN: not %klee --output-dir=%t.klee-out --shared-constant-globals --exit-on-error %t2.bc 2>%t2.log
+// RUN: FileCheck --input-file=%t2.log %s
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+const int table[8] = {3, 1, 4, 1, 5, 9, 2, 6};
+
+int main() {
+  unsigned i;
+  klee_make_symbolic(&i, sizeof(i), "i");
+  klee_assume(i < 8);
+
+  // Reads resolve through the shared immortal binding, both with a
+  // concrete and with a symbolic index.
+  assert(table[2] == 4);
+  assert(table[i] <= 9);
+
+#ifdef WRITE_CONSTANT
+  // CHECK: memory error: object read only
+  *(int *)&table[i] = 0;
+#endif
+
+  return 0;
+}
@@ -8,8 +8,10 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Config/Version.h"
+#include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprBinaryLog.h"
 #include "klee/Expr/ExprBuilder.h"
 #include "klee/Expr/ExprPPrinter.h"
 #include "klee/Expr/ExprSMTLIBPrinter.h"
@@ -30,6 +32,9 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
+#include <thread>
+
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -63,7 +68,8 @@ static llvm::cl::opt<ToolActions> ToolAction(
 enum BuilderKinds {
   DefaultBuilder,
   ConstantFoldingBuilder,
-  SimplifyingBuilder
+  SimplifyingBuilder,
+  HashConsingBuilder
 };
 
 static llvm::cl::opt<BuilderKinds> BuilderKind(
@@ -74,7 +80,10 @@ static llvm::cl::opt<BuilderKinds> BuilderKind(
                      clEnumValN(ConstantFoldingBuilder, "constant-folding",
                                 "Fold constant expressions."),
                      clEnumValN(SimplifyingBuilder, "simplify",
-                                "Fold constants and simplify expressions.")
+                                "Fold constants and simplify expressions."),
+                     clEnumValN(HashConsingBuilder, "hash-consing",
+                                "Fold constants, simplify expressions and "
+                                "share identical subtrees.")
                          KLEE_LLVM_CL_VAL_END),
     llvm::cl::cat(klee::ExprCat));
 
@@ -89,6 +98,19 @@ llvm::cl::opt<bool> ClearArrayAfterQuery(
     llvm::cl::desc("Discard the previous array declarations after a query "
                    "is performed (default=false)"),
     llvm::cl::init(false), llvm::cl::cat(klee::ExprCat));
+
+llvm::cl::opt<unsigned> ReplayThreads(
+    "replay-threads",
+    llvm::cl::desc("Number of worker threads to evaluate the queries with; "
+                   "each worker gets an independent solver chain and results "
+                   "are printed in input order (default=1)"),
+    llvm::cl::init(1), llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<std::string> BenchmarkBaseline(
+    "benchmark-baseline",
+    llvm::cl::desc("Compare the -benchmark-solver-stages report against the "
+                   "JSON output of a previous run"),
+    llvm::cl::cat(klee::SolvingCat));
 } // namespace
 
 static std::string getQueryLogPath(const char filename[])
@@ -183,6 +205,132 @@ static bool PrintInputAST(const char *Filename,
   return success;
 }
 
+/// Build a core solver and full solver chain. logPrefix distinguishes
+/// the query-log files of parallel workers, like the per-worker solver
+/// chains in the executor do.
+static Solver *buildSolverChain(const std::string &logPrefix) {
+  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
+
+  if (CoreSolverToUse != DUMMY_SOLVER) {
+    const time::Span maxCoreSolverTime(MaxCoreSolverTime);
+    if (maxCoreSolverTime) {
+      coreSolver->setCoreSolverTimeout(maxCoreSolverTime);
+    }
+  }
+
+  return constructSolverChain(
+      coreSolver,
+      getQueryLogPath((logPrefix + ALL_QUERIES_SMT2_FILE_NAME).c_str()),
+      getQueryLogPath((logPrefix + SOLVER_QUERIES_SMT2_FILE_NAME).c_str()),
+      getQueryLogPath((logPrefix + ALL_QUERIES_KQUERY_FILE_NAME).c_str()),
+      getQueryLogPath((logPrefix + SOLVER_QUERIES_KQUERY_FILE_NAME).c_str()),
+      getQueryLogPath((logPrefix + ALL_QUERIES_BINARY_FILE_NAME).c_str()),
+      getQueryLogPath((logPrefix + SOLVER_QUERIES_BINARY_FILE_NAME).c_str()));
+}
+
+/// Evaluate a single query command, writing the result in the usual
+/// "VALID"/"INVALID"/"FAIL" form (without the query header or trailing
+/// line break).
+static void EvaluateQueryCommand(Solver *S, const QueryCommand *QC,
+                                 llvm::raw_ostream &os) {
+  assert("FIXME: Support counterexample query commands!");
+  if (QC->Values.empty() && QC->Objects.empty()) {
+    bool result;
+    if (S->mustBeTrue(Query(ConstraintSet(QC->Constraints), QC->Query),
+                      result)) {
+      os << (result ? "VALID" : "INVALID");
+    } else {
+      os << "FAIL (reason: "
+         << SolverImpl::getOperationStatusString(
+                S->impl->getOperationStatusCode())
+         << ")";
+    }
+  } else if (!QC->Values.empty()) {
+    assert(QC->Objects.empty() &&
+           "FIXME: Support counterexamples for values and objects!");
+    assert(QC->Values.size() == 1 &&
+           "FIXME: Support counterexamples for multiple values!");
+    assert(QC->Query->isFalse() &&
+           "FIXME: Support counterexamples with non-trivial query!");
+    ref<ConstantExpr> result;
+    if (S->getValue(Query(ConstraintSet(QC->Constraints), QC->Values[0]),
+                    result)) {
+      os << "INVALID\n";
+      os << "\tExpr 0:\t" << result;
+    } else {
+      os << "FAIL (reason: "
+         << SolverImpl::getOperationStatusString(
+                S->impl->getOperationStatusCode())
+         << ")";
+    }
+  } else {
+    std::vector<std::vector<unsigned char> > result;
+
+    if (S->getInitialValues(Query(ConstraintSet(QC->Constraints), QC->Query),
+                            QC->Objects, result)) {
+      os << "INVALID\n";
+
+      for (unsigned i = 0, e = result.size(); i != e; ++i) {
+        os << "\tArray " << i << ":\t" << QC->Objects[i]->name << "[";
+        for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
+          os << (unsigned)result[i][j];
+          if (j + 1 != QC->Objects[i]->size)
+            os << ", ";
+        }
+        os << "]";
+        if (i + 1 != e)
+          os << "\n";
+      }
+    } else {
+      SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
+      if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
+        os << " FAIL (reason: " << SolverImpl::getOperationStatusString(retCode)
+           << ")";
+      } else {
+        os << "VALID (counterexample request ignored)";
+      }
+    }
+  }
+}
+
+/// Shard the query commands across ReplayThreads workers, each with an
+/// independent solver chain, and print the results in input order.
+static void EvaluateQueriesParallel(
+    const std::vector<const QueryCommand *> &queries) {
+  std::vector<std::string> results(queries.size());
+  std::atomic<std::size_t> nextQuery(0);
+  const time::Point replayStart = time::getWallTime();
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < ReplayThreads; ++i) {
+    workers.emplace_back([&queries, &results, &nextQuery, i] {
+      std::string prefix = "w" + llvm::utostr(i) + "-";
+      Solver *S = buildSolverChain(prefix);
+
+      while (true) {
+        std::size_t index = nextQuery.fetch_add(1);
+        if (index >= queries.size())
+          break;
+        llvm::raw_string_ostream os(results[index]);
+        EvaluateQueryCommand(S, queries[index], os);
+        os.flush();
+      }
+
+      delete S;
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  for (std::size_t i = 0, e = results.size(); i != e; ++i)
+    llvm::outs() << "Query " << i << ":\t" << results[i] << "\n";
+
+  const time::Span elapsed = time::getWallTime() - replayStart;
+  llvm::outs() << "--\n"
+               << "replayed " << queries.size() << " queries with "
+               << ReplayThreads.getValue() << " threads in " << elapsed << "\n";
+}
+
 static bool EvaluateInputAST(const char *Filename,
                              const MemoryBuffer *MB,
                              ExprBuilder *Builder) {
@@ -202,93 +350,24 @@ static bool EvaluateInputAST(const char *Filename,
   if (!success)
     return false;
 
-  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
-
-  if (CoreSolverToUse != DUMMY_SOLVER) {
-    const time::Span maxCoreSolverTime(MaxCoreSolverTime);
-    if (maxCoreSolverTime) {
-      coreSolver->setCoreSolverTimeout(maxCoreSolverTime);
-    }
-  }
-
-  Solver *S = constructSolverChain(coreSolver,
-                                   getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
-                                   getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
-                                   getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME),
-                                   getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME));
-
-  unsigned Index = 0;
+  std::vector<const QueryCommand *> queries;
   for (std::vector<Decl*>::iterator it = Decls.begin(),
-         ie = Decls.end(); it != ie; ++it) {
-    Decl *D = *it;
-    if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
-      llvm::outs() << "Query " << Index << ":\t";
-
-      assert("FIXME: Support counterexample query commands!");
-      if (QC->Values.empty() && QC->Objects.empty()) {
-        bool result;
-        if (S->mustBeTrue(Query(ConstraintSet(QC->Constraints), QC->Query),
-                          result)) {
-          llvm::outs() << (result ? "VALID" : "INVALID");
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else if (!QC->Values.empty()) {
-        assert(QC->Objects.empty() && 
-               "FIXME: Support counterexamples for values and objects!");
-        assert(QC->Values.size() == 1 &&
-               "FIXME: Support counterexamples for multiple values!");
-        assert(QC->Query->isFalse() &&
-               "FIXME: Support counterexamples with non-trivial query!");
-        ref<ConstantExpr> result;
-        if (S->getValue(Query(ConstraintSet(QC->Constraints), QC->Values[0]),
-                        result)) {
-          llvm::outs() << "INVALID\n";
-          llvm::outs() << "\tExpr 0:\t" << result;
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else {
-        std::vector< std::vector<unsigned char> > result;
+         ie = Decls.end(); it != ie; ++it)
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(*it))
+      queries.push_back(QC);
 
-        if (S->getInitialValues(
-                Query(ConstraintSet(QC->Constraints), QC->Query), QC->Objects,
-                result)) {
-          llvm::outs() << "INVALID\n";
-
-          for (unsigned i = 0, e = result.size(); i != e; ++i) {
-            llvm::outs() << "\tArray " << i << ":\t"
-                       << QC->Objects[i]->name
-                       << "[";
-            for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
-              llvm::outs() << (unsigned) result[i][j];
-              if (j + 1 != QC->Objects[i]->size)
-                llvm::outs() << ", ";
-            }
-            llvm::outs() << "]";
-            if (i + 1 != e)
-              llvm::outs() << "\n";
-          }
-        } else {
-          SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
-          if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
-            llvm::outs() << " FAIL (reason: "
-                      << SolverImpl::getOperationStatusString(retCode)
-                      << ")";
-          }           
-          else {
-            llvm::outs() << "VALID (counterexample request ignored)";
-          }
-        }
-      }
+  if (ReplayThreads > 1) {
+    EvaluateQueriesParallel(queries);
+  } else {
+    Solver *S = buildSolverChain("");
 
+    for (std::size_t i = 0, e = queries.size(); i != e; ++i) {
+      llvm::outs() << "Query " << i << ":\t";
+      EvaluateQueryCommand(S, queries[i], llvm::outs());
       llvm::outs() << "\n";
-      ++Index;
     }
+
+    delete S;
   }
 
   for (std::vector<Decl*>::iterator it = Decls.begin(),
@@ -296,7 +375,8 @@ static bool EvaluateInputAST(const char *Filename,
     delete *it;
   delete P;
 
-  delete S;
+  if (BenchmarkSolverStages)
+    reportSolverStageMetrics(llvm::outs(), BenchmarkBaseline);
 
   if (uint64_t queries = *theStatisticManager->getStatisticByName("Queries")) {
     llvm::outs()
@@ -315,6 +395,130 @@ static bool EvaluateInputAST(const char *Filename,
   return success;
 }
 
+/// Print the queries of a binary query log (see ExprBinaryLog.h) in
+/// .kquery format.
+static bool PrintBinaryQueryLog(const char *Filename, const MemoryBuffer *MB) {
+  ArrayCache arrayCache;
+  binlog::Reader reader(MB->getBuffer(), arrayCache);
+
+  unsigned NumQueries = 0;
+  binlog::LoggedQuery LQ;
+  while (reader.readQuery(LQ)) {
+    llvm::outs() << "# Query " << ++NumQueries << "\n";
+
+    const ref<Expr> *evalExprsBegin = 0;
+    const ref<Expr> *evalExprsEnd = 0;
+    if (!LQ.evalExprs.empty()) {
+      evalExprsBegin = &LQ.evalExprs[0];
+      evalExprsEnd = evalExprsBegin + LQ.evalExprs.size();
+    }
+    const Array *const *evalArraysBegin = 0;
+    const Array *const *evalArraysEnd = 0;
+    if (!LQ.objects.empty()) {
+      evalArraysBegin = &LQ.objects[0];
+      evalArraysEnd = evalArraysBegin + LQ.objects.size();
+    }
+
+    ConstraintSet constraints(LQ.constraints);
+    ExprPPrinter::printQuery(llvm::outs(), constraints, LQ.expr,
+                             evalExprsBegin, evalExprsEnd, evalArraysBegin,
+                             evalArraysEnd);
+  }
+
+  if (!reader.error().empty()) {
+    llvm::errs() << Filename << ": replay failure: " << reader.error() << "\n";
+    return false;
+  }
+  return true;
+}
+
+/// Replay the queries of a binary query log against a freshly
+/// constructed solver chain.
+static bool EvaluateBinaryQueryLog(const char *Filename,
+                                   const MemoryBuffer *MB) {
+  ArrayCache arrayCache;
+  binlog::Reader reader(MB->getBuffer(), arrayCache);
+
+  Solver *S = buildSolverChain("");
+
+  unsigned Index = 0;
+  binlog::LoggedQuery LQ;
+  while (reader.readQuery(LQ)) {
+    llvm::outs() << "Query " << Index << ":\t";
+
+    ConstraintSet constraints(LQ.constraints);
+    switch (LQ.type) {
+    case binlog::QueryTruth:
+    case binlog::QueryValidity: {
+      bool result;
+      if (S->mustBeTrue(Query(constraints, LQ.expr), result)) {
+        llvm::outs() << (result ? "VALID" : "INVALID");
+      } else {
+        llvm::outs() << "FAIL (reason: "
+                     << SolverImpl::getOperationStatusString(
+                            S->impl->getOperationStatusCode())
+                     << ")";
+      }
+      break;
+    }
+
+    case binlog::QueryValue: {
+      // Value queries are logged with a false query expression and the
+      // evaluated expression alongside.
+      ref<Expr> value = LQ.evalExprs.empty() ? LQ.expr : LQ.evalExprs[0];
+      ref<ConstantExpr> result;
+      if (S->getValue(Query(constraints, value), result)) {
+        llvm::outs() << "INVALID\n";
+        llvm::outs() << "\tExpr 0:\t" << result;
+      } else {
+        llvm::outs() << "FAIL (reason: "
+                     << SolverImpl::getOperationStatusString(
+                            S->impl->getOperationStatusCode())
+                     << ")";
+      }
+      break;
+    }
+
+    case binlog::QueryInitialValues: {
+      std::vector<std::vector<unsigned char> > result;
+      if (S->getInitialValues(Query(constraints, LQ.expr), LQ.objects,
+                              result)) {
+        llvm::outs() << "INVALID\n";
+        for (unsigned i = 0, e = result.size(); i != e; ++i) {
+          llvm::outs() << "\tArray " << i << ":\t" << LQ.objects[i]->name
+                       << "[";
+          for (unsigned j = 0; j != LQ.objects[i]->size; ++j) {
+            llvm::outs() << (unsigned)result[i][j];
+            if (j + 1 != LQ.objects[i]->size)
+              llvm::outs() << ", ";
+          }
+          llvm::outs() << "]";
+          if (i + 1 != e)
+            llvm::outs() << "\n";
+        }
+      } else {
+        llvm::outs() << "VALID (counterexample request ignored)";
+      }
+      break;
+    }
+    }
+
+    llvm::outs() << "\n";
+    ++Index;
+  }
+
+  delete S;
+
+  if (BenchmarkSolverStages)
+    reportSolverStageMetrics(llvm::outs(), BenchmarkBaseline);
+
+  if (!reader.error().empty()) {
+    llvm::errs() << Filename << ": replay failure: " << reader.error() << "\n";
+    return false;
+  }
+  return true;
+}
+
 static bool printInputAsSMTLIBv2(const char *Filename,
                              const MemoryBuffer *MB,
                              ExprBuilder *Builder)
@@ -409,7 +613,18 @@ int main(int argc, char **argv) {
     return 1;
   }
   std::unique_ptr<MemoryBuffer> &MB = *MBResult;
-  
+
+  // Binary query logs are self-describing and bypass the parser.
+  if (binlog::isBinaryLog(MB->getBuffer())) {
+    const char *Name = InputFile == "-" ? "<stdin>" : InputFile.c_str();
+    if (ToolAction == Evaluate)
+      success = EvaluateBinaryQueryLog(Name, MB.get());
+    else
+      success = PrintBinaryQueryLog(Name, MB.get());
+    llvm::llvm_shutdown();
+    return success ? 0 : 1;
+  }
+
   ExprBuilder *Builder = 0;
   switch (BuilderKind) {
   case DefaultBuilder:
@@ -420,9 +635,11 @@ int main(int argc, char **argv) {
     Builder = createConstantFoldingExprBuilder(Builder);
     break;
   case SimplifyingBuilder:
-    Builder = createDefaultExprBuilder();
-    Builder = createConstantFoldingExprBuilder(Builder);
-    Builder = createSimplifyingExprBuilder(Builder);
+    Builder = createFusedSimplifyingExprBuilder();
+    break;
+  case HashConsingBuilder:
+    Builder = createFusedSimplifyingExprBuilder();
+    Builder = createHashConsingExprBuilder(Builder);
     break;
   }
 
@@ -14,6 +14,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,9 +52,13 @@ static unsigned monitored_pid = 0;
 static unsigned monitored_timeout;
 
 static char *rootdir = NULL;
+static unsigned num_fork_servers = 0;
+static const char *summary_path = NULL;
 static struct option long_options[] = {
   {"create-files-only", required_argument, 0, 'f'},
   {"chroot-to-dir", required_argument, 0, 'r'},
+  {"fork-server", required_argument, 0, 'j'},
+  {"summary-file", required_argument, 0, 's'},
   {"help", no_argument, 0, 'h'},
   {"keep-replay-dir", no_argument, 0, 'k'},
   {0, 0, 0, 0},
@@ -247,6 +252,197 @@ static void run_monitored(char *executable, int argc, char **argv) {
   }
 }
 
+/* Fork-server batch mode.  The target is loaded once per worker and
+   forks per test from the initialized image; the server loop lives in
+   libkleeRuntest (see runtime/Runtest/intrinsics.c for the protocol),
+   so the target must be linked against it and take its inputs via
+   klee_make_symbolic.  Tests are handed to whichever worker is idle and
+   one summary line per test is streamed as results come in. */
+
+#define KLEE_FORKSRV_HELLO 0x4b464b53u
+
+struct fork_server {
+  pid_t pid;
+  int ctl;      /* driver -> server: test paths */
+  int st;       /* server -> driver: wait(2) statuses */
+  int test;     /* index of the test in flight, or -1 */
+  time_t start;
+};
+
+static int read_full(int fd, void *buf, size_t count) {
+  char *p = buf;
+  while (count) {
+    ssize_t n = read(fd, p, count);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      return 0;
+    }
+    p += n;
+    count -= n;
+  }
+  return 1;
+}
+
+static int write_full(int fd, const void *buf, size_t count) {
+  const char *p = buf;
+  while (count) {
+    ssize_t n = write(fd, p, count);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      return 0;
+    }
+    p += n;
+    count -= n;
+  }
+  return 1;
+}
+
+static void start_fork_server(struct fork_server *server, char *executable) {
+  int ctl_pipe[2], st_pipe[2];
+  if (pipe(ctl_pipe) < 0 || pipe(st_pipe) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  server->pid = fork();
+  if (server->pid < 0) {
+    perror("fork");
+    exit(1);
+  } else if (server->pid == 0) {
+    char spec[64];
+    char *argv[2];
+    snprintf(spec, sizeof(spec), "%d,%d", ctl_pipe[0], st_pipe[1]);
+    setenv("KLEE_FORKSRV", spec, 1);
+    close(ctl_pipe[1]);
+    close(st_pipe[0]);
+    argv[0] = executable;
+    argv[1] = NULL;
+    execv(executable, argv);
+    perror("execv");
+    _exit(66);
+  }
+
+  close(ctl_pipe[0]);
+  close(st_pipe[1]);
+  server->ctl = ctl_pipe[1];
+  server->st = st_pipe[0];
+  server->test = -1;
+
+  uint32_t hello;
+  if (!read_full(server->st, &hello, 4) || hello != KLEE_FORKSRV_HELLO) {
+    fputs("KLEE-REPLAY: ERROR: fork server handshake failed; is the "
+          "executable linked against libkleeRuntest?\n", stderr);
+    exit(1);
+  }
+}
+
+static void dispatch_test(struct fork_server *server, char *path, int test) {
+  uint32_t len = strlen(path);
+  if (!write_full(server->ctl, &len, 4) ||
+      !write_full(server->ctl, path, len)) {
+    fputs("KLEE-REPLAY: ERROR: fork server went away\n", stderr);
+    exit(1);
+  }
+  server->test = test;
+  server->start = time(0);
+}
+
+static void summarize_test(FILE *summary, const char *path, int status,
+                           time_t elapsed) {
+  if (WIFSIGNALED(status)) {
+    fprintf(summary, "%s: CRASHED signal %d (%d seconds)\n", path,
+            WTERMSIG(status), (int) elapsed);
+  } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+    fprintf(summary, "%s: ABNORMAL %d (%d seconds)\n", path,
+            WEXITSTATUS(status), (int) elapsed);
+  } else {
+    fprintf(summary, "%s: NORMAL (%d seconds)\n", path, (int) elapsed);
+  }
+  fflush(summary);
+}
+
+static void run_fork_servers(char *executable, char **tests, int num_tests) {
+  struct fork_server *servers;
+  struct pollfd *fds;
+  unsigned num_servers = num_fork_servers;
+  unsigned i, running;
+  int next_test = 0;
+  FILE *summary = stdout;
+
+  if ((int) num_servers > num_tests)
+    num_servers = num_tests;
+
+  if (summary_path) {
+    summary = fopen(summary_path, "w");
+    if (!summary) {
+      perror(summary_path);
+      exit(1);
+    }
+  }
+
+  servers = calloc(num_servers, sizeof(*servers));
+  fds = calloc(num_servers, sizeof(*fds));
+  if (!servers || !fds) {
+    fputs("KLEE-REPLAY: ERROR: out of memory\n", stderr);
+    exit(1);
+  }
+
+  for (i = 0; i != num_servers; ++i) {
+    start_fork_server(&servers[i], executable);
+    dispatch_test(&servers[i], tests[next_test], next_test);
+    ++next_test;
+  }
+
+  running = num_servers;
+  while (running) {
+    int res;
+    for (i = 0; i != num_servers; ++i) {
+      fds[i].fd = servers[i].st;
+      fds[i].events = servers[i].test >= 0 ? POLLIN : 0;
+      fds[i].revents = 0;
+    }
+    do {
+      res = poll(fds, num_servers, -1);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0) {
+      perror("poll");
+      exit(1);
+    }
+
+    for (i = 0; i != num_servers; ++i) {
+      uint32_t status;
+      if (!(fds[i].revents & (POLLIN | POLLHUP)))
+        continue;
+      if (!read_full(servers[i].st, &status, 4)) {
+        fputs("KLEE-REPLAY: ERROR: fork server went away\n", stderr);
+        exit(1);
+      }
+      summarize_test(summary, tests[servers[i].test], (int) status,
+                     time(0) - servers[i].start);
+      servers[i].test = -1;
+      if (next_test < num_tests) {
+        dispatch_test(&servers[i], tests[next_test], next_test);
+        ++next_test;
+      } else {
+        uint32_t done = 0;
+        write_full(servers[i].ctl, &done, 4);
+        close(servers[i].ctl);
+        close(servers[i].st);
+        while (waitpid(servers[i].pid, NULL, 0) < 0 && errno == EINTR)
+          ;
+        --running;
+      }
+    }
+  }
+
+  free(fds);
+  free(servers);
+  if (summary != stdout)
+    fclose(summary);
+}
+
 #ifdef HAVE_SYS_CAPABILITY_H
 /* ensure this process has CAP_SYS_CHROOT capability. */
 void ensure_capsyschroot(const char *executable) {
@@ -272,6 +468,11 @@ static void usage(void) {
     "   or: %s --create-files-only <ktest-file>\n"
     "\n"
     "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n"
+    "-j, --fork-server=N      batch mode: load the executable once per worker\n"
+    "                         and fork per test from the initialized image;\n"
+    "                         requires a target linked against libkleeRuntest\n"
+    "-s, --summary-file=FILE  stream one result line per test to FILE\n"
+    "                         (fork-server mode only, default=stdout)\n"
     "-k, --keep-replay-dir    do not delete replay directory\n"
     "-h, --help               display this help and exit\n"
     "\n"
@@ -293,7 +494,7 @@ int main(int argc, char** argv) {
     usage();
 
   int c, opt_index;
-  while ((c = getopt_long(argc, argv, "f:r:k", long_options, &opt_index)) != -1) {
+  while ((c = getopt_long(argc, argv, "f:r:j:s:k", long_options, &opt_index)) != -1) {
     switch (c) {
     case 'f': {
       /* Special case hack for only creating files and not actually executing
@@ -322,6 +523,19 @@ int main(int argc, char** argv) {
       rootdir = optarg;
       break;
 
+    case 'j':
+      num_fork_servers = atoi(optarg);
+      if (!num_fork_servers) {
+        fprintf(stderr, "KLEE-REPLAY: ERROR: invalid fork server count (%s)\n",
+                optarg);
+        exit(1);
+      }
+      break;
+
+    case 's':
+      summary_path = optarg;
+      break;
+
     case 'k':
       keep_temps = 1;
       break;
@@ -351,6 +565,16 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
+  if (num_fork_servers) {
+    if (rootdir) {
+      fputs("KLEE-REPLAY: ERROR: --fork-server cannot be combined with "
+            "--chroot-to-dir.\n", stderr);
+      exit(1);
+    }
+    run_fork_servers(executable, argv + optind + 1, argc - optind - 1);
+    return 0;
+  }
+
   int idx = 0;
   for (idx = optind + 1; idx != argc; ++idx) {
     char* input_fname = argv[idx];
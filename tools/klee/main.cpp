@@ -54,12 +54,17 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 
 using namespace llvm;
@@ -85,6 +90,41 @@ namespace {
             cl::desc("Do not generate any test files (default=false)"),
             cl::cat(TestCaseCat));
 
+  cl::opt<bool>
+  WriteKTestV2("write-ktest-v2",
+               cl::init(false),
+               cl::desc("Write .ktest files in the mmap-friendly KTESTv2 "
+                        "format instead of the classic one (default=false)"),
+               cl::cat(TestCaseCat));
+
+  cl::opt<bool>
+  CompressKTests("compress-ktests",
+                 cl::init(false),
+                 cl::desc("Compress object data in KTESTv2 files, requires "
+                          "-write-ktest-v2 (default=false)"),
+                 cl::cat(TestCaseCat));
+
+#ifdef HAVE_ZLIB_H
+  cl::opt<bool>
+  CompressTestFiles("compress-test-files",
+                    cl::init(false),
+                    cl::desc("Write the per-test artifact files (.kquery, "
+                             ".path, .err, ...) gzip-compressed with a .gz "
+                             "suffix; .ktest files are unaffected "
+                             "(default=false)"),
+                    cl::cat(TestCaseCat));
+#endif
+
+  cl::opt<unsigned>
+  TestShardSize("test-shard-size",
+                cl::init(0),
+                cl::desc("Group every N consecutive test ids into their own "
+                         "shard-NNNN subdirectory of the output directory, "
+                         "keeping per-directory metadata operations fast "
+                         "beyond ~10k files.  Set to 0 to disable "
+                         "(default=0)"),
+                cl::cat(TestCaseCat));
+
   cl::opt<bool>
   WriteCVCs("write-cvcs",
             cl::desc("Write .cvc files for each test case (default=false)"),
@@ -120,6 +160,14 @@ namespace {
                 cl::desc("Write .sym.path files for each test case (default=false)"),
                 cl::cat(TestCaseCat));
 
+  cl::opt<unsigned>
+  TestWriterThreads("test-writer-threads",
+                    cl::init(1),
+                    cl::desc("Number of background threads that serialize and "
+                             "write test case files. 0 writes synchronously "
+                             "on the interpreter thread (default=1)"),
+                    cl::cat(TestCaseCat));
+
 
   /*** Startup options ***/
 
@@ -252,6 +300,35 @@ namespace {
                  cl::value_desc("path file"),
                  cl::cat(ReplayCat));
 
+  cl::opt<std::string>
+  ResumeDir("resume",
+            cl::desc("Resume exploration from a checkpoint directory "
+                     "written by -checkpoint-dir: the frontier states are "
+                     "reconstructed by replaying their branch paths and "
+                     "exploration continues from there. The run must use "
+                     "the same program and options as the checkpointed one"),
+            cl::value_desc("checkpoint directory"),
+            cl::cat(ReplayCat));
+
+  cl::opt<std::string>
+  ReplayPathPrefixFile("replay-path-prefix",
+                       cl::desc("Specify a path file whose branch decisions "
+                                "fix only the start of the exploration; "
+                                "once exhausted, exploration continues "
+                                "normally in the subtree below the prefix"),
+                       cl::value_desc("path file"),
+                       cl::cat(ReplayCat));
+
+  cl::opt<std::string>
+  ReplayToLocation("replay-to-location",
+                   cl::desc("Replay the branch-path prefix that first "
+                            "reached the given source location in an "
+                            "earlier run with -write-location-index, then "
+                            "explore only the subtree below it. The file "
+                            "component is matched as a path suffix"),
+                   cl::value_desc("location.index:file:line"),
+                   cl::cat(ReplayCat));
+
 
 
   cl::list<std::string>
@@ -307,7 +384,8 @@ private:
   SmallString<128> m_outputDirectory;
 
   unsigned m_numTotalTests;     // Number of tests received from the interpreter
-  unsigned m_numGeneratedTests; // Number of tests successfully generated
+  unsigned m_createdShards = 0; // Shard directories created so far (-test-shard-size)
+  std::atomic<unsigned> m_numGeneratedTests; // Number of tests successfully generated
   unsigned m_pathsCompleted; // number of completed paths
   unsigned m_pathsExplored; // number of partially explored and completed paths
 
@@ -315,6 +393,46 @@ private:
   int m_argc;
   char **m_argv;
 
+  /// A fully materialized test case, ready to be written to disk
+  /// without access to the interpreter or the terminated state.
+  struct TestCaseData {
+    unsigned id;
+    bool writeKTest = false;
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> objects;
+    bool writeError = false;
+    std::string errorMessage;
+    std::string errorSuffix;
+    bool writePath = false;
+    std::vector<unsigned char> concreteBranches;
+    bool writeKQuery = false;
+    std::string kqueryConstraints;
+    bool writeCVC = false;
+    std::string cvcConstraints;
+    bool writeSMT2 = false;
+    std::string smt2Constraints;
+    bool writeSymPath = false;
+    std::vector<unsigned char> symbolicBranches;
+    bool writeCov = false;
+    std::map<const std::string *, std::set<unsigned>> coveredLines;
+    time::Point startTime;
+  };
+
+  /// Background test-case writer pool. processTestCase gathers
+  /// everything that needs the terminated state or the interpreter and
+  /// queues the result; the workers only serialize and write files.
+  /// The queue is bounded so that a slow disk throttles exploration
+  /// instead of buffering an unbounded number of test cases.
+  static const size_t MaxQueuedTestCases = 64;
+  std::vector<std::thread> m_writerThreads;
+  std::mutex m_writerMutex;
+  std::condition_variable m_writerCond;      // queue non-empty or exiting
+  std::condition_variable m_writerSpaceCond; // queue has space again
+  std::deque<TestCaseData> m_writerQueue;
+  bool m_writerExit = false;
+
+  void writeTestCaseFiles(TestCaseData &data);
+  void testCaseWriterLoop();
+
 public:
   KleeHandler(int argc, char **argv);
   ~KleeHandler();
@@ -334,15 +452,25 @@ public:
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  /// Wait until all queued test cases have been written and stop the
+  /// writer threads. Must be called before the interpreter is
+  /// destroyed, since queued data points into its module tables.
+  void flushTestCaseWriters();
+
   std::string getOutputFilename(const std::string &filename);
   std::unique_ptr<llvm::raw_fd_ostream> openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
-  std::unique_ptr<llvm::raw_fd_ostream> openTestFile(const std::string &suffix, unsigned id);
+  std::unique_ptr<llvm::raw_ostream> openTestFile(const std::string &suffix, unsigned id);
 
   // load a .path file
   static void loadPathFile(std::string name,
                            std::vector<bool> &buffer);
 
+  // look up a location's first-reach prefix in a location.index file
+  // (-replay-to-location)
+  static void loadLocationPrefix(const std::string &spec,
+                                 std::vector<bool> &buffer);
+
   static void getKTestFilesInDir(std::string directoryPath,
                                  std::vector<std::string> &results);
 
@@ -420,6 +548,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
 }
 
 KleeHandler::~KleeHandler() {
+  flushTestCaseWriters();
   delete m_pathWriter;
   delete m_symPathWriter;
   fclose(klee_warning_file);
@@ -465,12 +594,28 @@ KleeHandler::openOutputFile(const std::string &filename) {
 
 std::string KleeHandler::getTestFilename(const std::string &suffix, unsigned id) {
   std::stringstream filename;
+  if (TestShardSize)
+    filename << "shard-" << std::setfill('0') << std::setw(4)
+             << (id - 1) / TestShardSize << '/';
   filename << "test" << std::setfill('0') << std::setw(6) << id << '.' << suffix;
   return filename.str();
 }
 
-std::unique_ptr<llvm::raw_fd_ostream>
+std::unique_ptr<llvm::raw_ostream>
 KleeHandler::openTestFile(const std::string &suffix, unsigned id) {
+#ifdef HAVE_ZLIB_H
+  if (CompressTestFiles) {
+    // Compression runs right here, but this already is a writer thread
+    // (or an error path that must be written out synchronously anyway).
+    std::string Error;
+    std::string path = getOutputFilename(getTestFilename(suffix, id)) + ".gz";
+    auto f = klee_open_compressed_output_file(path, Error);
+    if (!f)
+      klee_warning("error opening file \"%s\" (%s)", path.c_str(),
+                   Error.c_str());
+    return f;
+  }
+#endif
   return openOutputFile(getTestFilename(suffix, id));
 }
 
@@ -480,123 +625,89 @@ void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorMessage,
                                   const char *errorSuffix) {
   if (!WriteNone) {
-    std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
-    bool success = m_interpreter->getSymbolicSolution(state, out);
+    // Gather everything that needs the state or the interpreter here;
+    // the file writes themselves run on the writer threads.
+    TestCaseData data;
+    bool success = m_interpreter->getSymbolicSolution(state, data.objects);
 
     if (!success)
       klee_warning("unable to get symbolic solution, losing test case");
+    data.writeKTest = success;
 
-    const auto start_time = time::getWallTime();
-
-    unsigned id = ++m_numTotalTests;
-
-    if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
+    data.startTime = time::getWallTime();
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-        klee_warning("unable to write output test case, losing it");
-      } else {
-        ++m_numGeneratedTests;
-      }
+    data.id = ++m_numTotalTests;
 
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
+    // Ids are handed out monotonically on this thread, so each shard
+    // directory is created exactly once, before any writer needs it.
+    if (TestShardSize) {
+      const unsigned shard = (data.id - 1) / TestShardSize;
+      if (shard >= m_createdShards) {
+        std::stringstream dir;
+        dir << "shard-" << std::setfill('0') << std::setw(4) << shard;
+        llvm::sys::fs::create_directory(getOutputFilename(dir.str()));
+        m_createdShards = shard + 1;
+      }
     }
 
     if (errorMessage) {
-      auto f = openTestFile(errorSuffix, id);
-      if (f)
-        *f << errorMessage;
+      data.writeError = true;
+      data.errorMessage = errorMessage;
+      data.errorSuffix = errorSuffix;
     }
 
     if (m_pathWriter) {
-      std::vector<unsigned char> concreteBranches;
+      data.writePath = true;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
-                               concreteBranches);
-      auto f = openTestFile("path", id);
-      if (f) {
-        for (const auto &branch : concreteBranches) {
-          *f << branch << '\n';
-        }
-      }
+                               data.concreteBranches);
     }
 
     if (errorMessage || WriteKQueries) {
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      auto f = openTestFile("kquery", id);
-      if (f)
-        *f << constraints;
+      data.writeKQuery = true;
+      m_interpreter->getConstraintLog(state, data.kqueryConstraints,
+                                      Interpreter::KQUERY);
     }
 
     if (WriteCVCs) {
-      // FIXME: If using Z3 as the core solver the emitted file is actually
-      // SMT-LIBv2 not CVC which is a bit confusing
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      auto f = openTestFile("cvc", id);
-      if (f)
-        *f << constraints;
+      data.writeCVC = true;
+      m_interpreter->getConstraintLog(state, data.cvcConstraints,
+                                      Interpreter::STP);
     }
 
     if (WriteSMT2s) {
-      std::string constraints;
-        m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        auto f = openTestFile("smt2", id);
-        if (f)
-          *f << constraints;
+      data.writeSMT2 = true;
+      m_interpreter->getConstraintLog(state, data.smt2Constraints,
+                                      Interpreter::SMTLIB2);
     }
 
     if (m_symPathWriter) {
-      std::vector<unsigned char> symbolicBranches;
+      data.writeSymPath = true;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
-                                  symbolicBranches);
-      auto f = openTestFile("sym.path", id);
-      if (f) {
-        for (const auto &branch : symbolicBranches) {
-          *f << branch << '\n';
-        }
-      }
+                                  data.symbolicBranches);
     }
 
     if (WriteCov) {
-      std::map<const std::string*, std::set<unsigned> > cov;
-      m_interpreter->getCoveredLines(state, cov);
-      auto f = openTestFile("cov", id);
-      if (f) {
-        for (const auto &entry : cov) {
-          for (const auto &line : entry.second) {
-            *f << *entry.first << ':' << line << '\n';
-          }
-        }
-      }
+      data.writeCov = true;
+      m_interpreter->getCoveredLines(state, data.coveredLines);
     }
 
-    if (m_numGeneratedTests == MaxTests)
-      m_interpreter->setHaltExecution(true);
-
-    if (WriteTestInfo) {
-      time::Span elapsed_time(time::getWallTime() - start_time);
-      auto f = openTestFile("info", id);
-      if (f)
-        *f << "Time to generate test case: " << elapsed_time << '\n';
+    if (TestWriterThreads == 0 || errorMessage) {
+      // Error cases may exit the process below via -exit-on-error;
+      // write them synchronously so their files exist by then.
+      writeTestCaseFiles(data);
+    } else {
+      std::unique_lock<std::mutex> lock(m_writerMutex);
+      if (m_writerThreads.empty())
+        for (unsigned i = 0; i < TestWriterThreads; ++i)
+          m_writerThreads.emplace_back(&KleeHandler::testCaseWriterLoop, this);
+      m_writerSpaceCond.wait(
+          lock, [this] { return m_writerQueue.size() < MaxQueuedTestCases; });
+      m_writerQueue.push_back(std::move(data));
+      m_writerCond.notify_one();
     }
+
+    if (MaxTests && m_numGeneratedTests >= MaxTests)
+      m_interpreter->setHaltExecution(true);
   } // if (!WriteNone)
 
   if (errorMessage && OptExitOnError) {
@@ -605,6 +716,131 @@ void KleeHandler::processTestCase(const ExecutionState &state,
   }
 }
 
+void KleeHandler::writeTestCaseFiles(TestCaseData &data) {
+  const unsigned id = data.id;
+
+  if (data.writeKTest) {
+    KTest b;
+    b.numArgs = m_argc;
+    b.args = m_argv;
+    b.symArgvs = 0;
+    b.symArgvLen = 0;
+    b.numObjects = data.objects.size();
+    // The writers only read the KTest, so the objects can point
+    // straight into the solver assignment gathered by processTestCase
+    // instead of copying every byte vector again.
+    std::vector<KTestObject> objects(b.numObjects);
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &objects[i];
+      o->name = const_cast<char*>(data.objects[i].first.c_str());
+      o->numBytes = data.objects[i].second.size();
+      o->bytes = data.objects[i].second.data();
+    }
+    b.objects = objects.data();
+
+    const std::string path = getOutputFilename(getTestFilename("ktest", id));
+    const int written = WriteKTestV2
+                            ? kTest_toFile2(&b, path.c_str(), CompressKTests)
+                            : kTest_toFile(&b, path.c_str());
+    if (!written) {
+      klee_warning("unable to write output test case, losing it");
+    } else {
+      ++m_numGeneratedTests;
+    }
+  }
+
+  if (data.writeError) {
+    auto f = openTestFile(data.errorSuffix, id);
+    if (f)
+      *f << data.errorMessage;
+  }
+
+  if (data.writePath) {
+    auto f = openTestFile("path", id);
+    if (f) {
+      for (const auto &branch : data.concreteBranches) {
+        *f << branch << '\n';
+      }
+    }
+  }
+
+  if (data.writeKQuery) {
+    auto f = openTestFile("kquery", id);
+    if (f)
+      *f << data.kqueryConstraints;
+  }
+
+  if (data.writeCVC) {
+    // FIXME: If using Z3 as the core solver the emitted file is actually
+    // SMT-LIBv2 not CVC which is a bit confusing
+    auto f = openTestFile("cvc", id);
+    if (f)
+      *f << data.cvcConstraints;
+  }
+
+  if (data.writeSMT2) {
+    auto f = openTestFile("smt2", id);
+    if (f)
+      *f << data.smt2Constraints;
+  }
+
+  if (data.writeSymPath) {
+    auto f = openTestFile("sym.path", id);
+    if (f) {
+      for (const auto &branch : data.symbolicBranches) {
+        *f << branch << '\n';
+      }
+    }
+  }
+
+  if (data.writeCov) {
+    auto f = openTestFile("cov", id);
+    if (f) {
+      for (const auto &entry : data.coveredLines) {
+        for (const auto &line : entry.second) {
+          *f << *entry.first << ':' << line << '\n';
+        }
+      }
+    }
+  }
+
+  if (WriteTestInfo) {
+    time::Span elapsed_time(time::getWallTime() - data.startTime);
+    auto f = openTestFile("info", id);
+    if (f)
+      *f << "Time to generate test case: " << elapsed_time << '\n';
+  }
+}
+
+void KleeHandler::testCaseWriterLoop() {
+  for (;;) {
+    TestCaseData data;
+    {
+      std::unique_lock<std::mutex> lock(m_writerMutex);
+      m_writerCond.wait(
+          lock, [this] { return !m_writerQueue.empty() || m_writerExit; });
+      if (m_writerQueue.empty())
+        return;
+      data = std::move(m_writerQueue.front());
+      m_writerQueue.pop_front();
+    }
+    m_writerSpaceCond.notify_one();
+    writeTestCaseFiles(data);
+  }
+}
+
+void KleeHandler::flushTestCaseWriters() {
+  {
+    std::lock_guard<std::mutex> lock(m_writerMutex);
+    m_writerExit = true;
+  }
+  m_writerCond.notify_all();
+  for (auto &thread : m_writerThreads)
+    thread.join();
+  m_writerThreads.clear();
+  m_writerExit = false;
+}
+
   // load a .path file
 void KleeHandler::loadPathFile(std::string name,
                                      std::vector<bool> &buffer) {
@@ -613,14 +849,53 @@ void KleeHandler::loadPathFile(std::string name,
   if (!f.good())
     assert(0 && "unable to open path file");
 
-  while (f.good()) {
-    unsigned value;
-    f >> value;
+  unsigned value;
+  while (f >> value) {
     buffer.push_back(!!value);
     f.get();
   }
 }
 
+void KleeHandler::loadLocationPrefix(const std::string &spec,
+                                     std::vector<bool> &buffer) {
+  // <location.index>:<file>:<line>, split from the right so the index
+  // path may itself contain colons
+  std::size_t lineSep = spec.rfind(':');
+  std::size_t fileSep =
+      lineSep == std::string::npos ? std::string::npos
+                                   : spec.rfind(':', lineSep - 1);
+  if (fileSep == std::string::npos || fileSep == 0)
+    klee_error("-replay-to-location: expected <location.index>:<file>:<line>");
+  std::string indexFile = spec.substr(0, fileSep);
+  std::string target = spec.substr(fileSep + 1);
+
+  std::ifstream f(indexFile.c_str());
+  if (!f.good())
+    klee_error("unable to open location index \"%s\"", indexFile.c_str());
+
+  std::string line;
+  while (std::getline(f, line)) {
+    std::size_t sep = line.rfind(' ');
+    if (sep == std::string::npos)
+      continue;
+    std::string key = line.substr(0, sep);
+    // match the full recorded location or a path suffix of it
+    if (key != target &&
+        !(key.size() > target.size() + 1 &&
+          key.compare(key.size() - target.size(), target.size(), target) == 0 &&
+          key[key.size() - target.size() - 1] == '/'))
+      continue;
+    for (std::size_t i = sep + 1; i < line.size(); ++i)
+      buffer.push_back(line[i] == '1');
+    klee_message("replaying %zu-branch prefix to %s", buffer.size(),
+                 key.c_str());
+    return;
+  }
+  klee_error("location %s not found in \"%s\" (was the recording run made "
+             "with -write-location-index?)",
+             target.c_str(), indexFile.c_str());
+}
+
 void KleeHandler::getKTestFilesInDir(std::string directoryPath,
                                      std::vector<std::string> &results) {
   std::error_code ec;
@@ -1391,8 +1666,43 @@ int main(int argc, char **argv, char **envp) {
 
   std::vector<bool> replayPath;
 
+  if ((ReplayPathFile != "") + (ReplayPathPrefixFile != "") +
+          (ReplayToLocation != "") > 1)
+    klee_error("cannot combine -replay-path, -replay-path-prefix and "
+               "-replay-to-location");
   if (ReplayPathFile != "") {
     KleeHandler::loadPathFile(ReplayPathFile, replayPath);
+  } else if (ReplayPathPrefixFile != "") {
+    KleeHandler::loadPathFile(ReplayPathPrefixFile, replayPath);
+  } else if (ReplayToLocation != "") {
+    KleeHandler::loadLocationPrefix(ReplayToLocation, replayPath);
+  }
+
+  std::vector<std::vector<bool>> resumePaths;
+
+  if (ResumeDir != "") {
+    if (ReplayPathFile != "" || ReplayPathPrefixFile != "" ||
+        ReplayToLocation != "")
+      klee_error("cannot combine -resume with -replay-path, "
+                 "-replay-path-prefix or -replay-to-location");
+    std::error_code ec;
+    std::vector<std::string> pathFiles;
+    for (llvm::sys::fs::directory_iterator i(ResumeDir, ec), e;
+         i != e && !ec; i.increment(ec)) {
+      if (StringRef(i->path()).endswith(".path"))
+        pathFiles.push_back(i->path());
+    }
+    if (ec)
+      klee_error("cannot read checkpoint directory %s: %s",
+                 ResumeDir.c_str(), ec.message().c_str());
+    if (pathFiles.empty())
+      klee_error("no .path files in checkpoint directory %s",
+                 ResumeDir.c_str());
+    std::sort(pathFiles.begin(), pathFiles.end());
+    for (const auto &pathFile : pathFiles) {
+      resumePaths.emplace_back();
+      KleeHandler::loadPathFile(pathFile, resumePaths.back());
+    }
   }
 
   Interpreter::InterpreterOptions IOpts;
@@ -1421,6 +1731,13 @@ int main(int argc, char **argv, char **envp) {
 
   if (ReplayPathFile != "") {
     interpreter->setReplayPath(&replayPath);
+  } else if (ReplayPathPrefixFile != "" || ReplayToLocation != "") {
+    interpreter->setReplayPath(&replayPath, /*isPrefix=*/true);
+  }
+
+  if (!resumePaths.empty()) {
+    klee_message("resuming %zu checkpointed states", resumePaths.size());
+    interpreter->setResumePaths(std::move(resumePaths));
   }
 
 
@@ -1554,6 +1871,10 @@ int main(int argc, char **argv, char **envp) {
     delete[] pArgv[i];
   delete[] pArgv;
 
+  // Finish writing any queued test cases before the interpreter (and
+  // with it the module tables the queued data points into) goes away.
+  handler->flushTestCaseWriters();
+
   delete interpreter;
 
   uint64_t queries =
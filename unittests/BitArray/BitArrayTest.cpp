@@ -0,0 +1,120 @@
+#include "klee/ADT/BitArray.h"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+using namespace klee;
+
+TEST(BitArrayTest, Basic) {
+  BitArray ba(100);
+  EXPECT_FALSE(ba.get(0));
+  ba.set(42);
+  EXPECT_TRUE(ba.get(42));
+  ba.unset(42);
+  EXPECT_FALSE(ba.get(42));
+
+  BitArray full(100, true);
+  EXPECT_TRUE(full.get(0));
+  EXPECT_TRUE(full.get(99));
+}
+
+TEST(BitArrayTest, FindNextSet) {
+  BitArray ba(1000);
+  EXPECT_EQ(1000u, ba.findNextSet(0, 1000));
+
+  ba.set(0);
+  ba.set(63);
+  ba.set(64);
+  ba.set(999);
+  EXPECT_EQ(0u, ba.findNextSet(0, 1000));
+  EXPECT_EQ(63u, ba.findNextSet(1, 1000));
+  EXPECT_EQ(64u, ba.findNextSet(64, 1000));
+  EXPECT_EQ(999u, ba.findNextSet(65, 1000));
+  // hits outside the queried range are not reported
+  EXPECT_EQ(999u, ba.findNextSet(65, 999));
+
+  ba.unset(999);
+  EXPECT_EQ(1000u, ba.findNextSet(65, 1000));
+}
+
+TEST(BitArrayTest, UnsetRange) {
+  BitArray ba(256, true);
+  ba.unsetRange(10, 200);
+  EXPECT_TRUE(ba.get(9));
+  EXPECT_FALSE(ba.get(10));
+  EXPECT_FALSE(ba.get(199));
+  EXPECT_TRUE(ba.get(200));
+  EXPECT_EQ(200u, ba.findNextSet(10, 256));
+
+  // within one word, and empty
+  ba.unsetRange(201, 203);
+  EXPECT_TRUE(ba.get(200));
+  EXPECT_FALSE(ba.get(202));
+  EXPECT_TRUE(ba.get(203));
+  ba.unsetRange(204, 204);
+  EXPECT_TRUE(ba.get(204));
+}
+
+TEST(BitArrayTest, AllSetRange) {
+  BitArray ba(256, true);
+  EXPECT_TRUE(ba.allSetRange(0, 256));
+  EXPECT_TRUE(ba.allSetRange(31, 33));
+  // empty ranges hold vacuously
+  EXPECT_TRUE(ba.allSetRange(10, 10));
+
+  ba.unset(100);
+  EXPECT_TRUE(ba.allSetRange(0, 100));
+  EXPECT_FALSE(ba.allSetRange(0, 101));
+  EXPECT_FALSE(ba.allSetRange(100, 101));
+  EXPECT_FALSE(ba.allSetRange(64, 128));
+  EXPECT_TRUE(ba.allSetRange(101, 256));
+
+  // within one word
+  EXPECT_TRUE(ba.allSetRange(101, 103));
+  ba.unset(102);
+  EXPECT_FALSE(ba.allSetRange(101, 103));
+}
+
+TEST(BitArrayTest, RandomizedScan) {
+  std::mt19937 rng(7);
+
+  for (int round = 0; round < 20; ++round) {
+    unsigned size = 1 + rng() % 3000;
+    BitArray ba(size, rng() & 1);
+    std::vector<bool> ref(size, ba.get(0));
+
+    for (int op = 0; op < 300; ++op) {
+      unsigned i = rng() % size;
+      switch (rng() % 3) {
+      case 0:
+        ba.set(i);
+        ref[i] = true;
+        break;
+      case 1:
+        ba.unset(i);
+        ref[i] = false;
+        break;
+      case 2: {
+        unsigned b = rng() % (size + 1), e = rng() % (size + 1);
+        if (b > e)
+          std::swap(b, e);
+        ba.unsetRange(b, e);
+        for (unsigned j = b; j < e; ++j)
+          ref[j] = false;
+        break;
+      }
+      }
+    }
+
+    unsigned next = ba.findNextSet(0, size);
+    for (unsigned i = 0; i < size; ++i) {
+      ASSERT_EQ((bool)ref[i], ba.get(i));
+      if (ref[i]) {
+        ASSERT_EQ(i, next);
+        next = ba.findNextSet(i + 1, size);
+      }
+    }
+    ASSERT_EQ(size, next);
+  }
+}
@@ -7,11 +7,18 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <iostream>
 #include "gtest/gtest.h"
 
 #include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprBinaryLog.h"
+#include "klee/Expr/ExprCanonicalizer.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Expr/ExprVisitor.h"
+#include "klee/Solver/Solver.h"
 
 using namespace klee;
 
@@ -29,6 +36,40 @@ TEST(ExprTest, BasicConstruction) {
                             ConstantExpr::alloc(10, 32)));
 }
 
+TEST(ExprTest, Canonicalize) {
+  ArrayCache ac;
+  const Array *arrayA = ac.CreateArray("canonA", 256);
+  const Array *arrayB = ac.CreateArray("canonB", 256);
+  const Array *arrayC = ac.CreateArray("canonC", 256);
+  ref<Expr> a = Expr::createTempRead(arrayA, 32);
+  ref<Expr> b = Expr::createTempRead(arrayB, 32);
+  ref<Expr> c = Expr::createTempRead(arrayC, 32);
+  ref<Expr> two = getConstant(2, 32);
+  ref<Expr> three = getConstant(3, 32);
+
+  ExprCanonicalizer canon;
+
+  // The same sum built in different association orders with scattered
+  // constants must end up with identical structure.
+  ref<Expr> lhs = AddExpr::create(
+      AddExpr::create(a, two),
+      AddExpr::create(three, AddExpr::create(b, c)));
+  ref<Expr> rhs = AddExpr::create(
+      AddExpr::create(c, three),
+      AddExpr::create(b, AddExpr::create(two, a)));
+  EXPECT_EQ(canon.canonicalize(lhs), canon.canonicalize(rhs));
+
+  // Identity constants disappear.
+  ref<Expr> zero = getConstant(0, 32);
+  EXPECT_EQ(canon.canonicalize(AddExpr::create(zero, AddExpr::create(a, b))),
+            canon.canonicalize(AddExpr::create(b, a)));
+
+  // Mixed operators canonicalize independently.
+  ref<Expr> andLhs = AndExpr::create(AndExpr::create(a, b), c);
+  ref<Expr> andRhs = AndExpr::create(c, AndExpr::create(b, a));
+  EXPECT_EQ(canon.canonicalize(andLhs), canon.canonicalize(andRhs));
+}
+
 TEST(ExprTest, ConcatExtract) {
   ArrayCache ac;
   const Array *array = ac.CreateArray("arr0", 256);
@@ -82,6 +123,52 @@ TEST(ExprTest, ConcatExtract) {
   EXPECT_EQ(Expr::Constant, extract10->getKind());
 }
 
+TEST(ExprTest, ConcatChainFolding) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr10", 256);
+  ref<Expr> read64 = Expr::createTempRead(array, 64);
+  const Array *array2 = ac.CreateArray("arr11", 256);
+  ref<Expr> read8_2 = Expr::createTempRead(array2, 8);
+
+  // Byte-wise reassembly of a stored wide value, in the right-leaning
+  // order the ObjectState read loops produce, folds back to the value.
+  ref<Expr> chain = read8_2;
+  for (unsigned i = 0; i != 8; ++i)
+    chain = ConcatExpr::create(ExtractExpr::create(read64, 8 * i, 8), chain);
+  EXPECT_EQ(Expr::Concat, chain->getKind());
+  EXPECT_EQ(read64, chain->getKid(0));
+  EXPECT_EQ(read8_2, chain->getKid(1));
+
+  // Adjacent constants merge through the chain head too.
+  ref<Expr> cchain = ConcatExpr::create(
+      getConstant(0xAB, 8),
+      ConcatExpr::create(getConstant(0xCD, 8), read8_2));
+  EXPECT_EQ(Expr::Concat, cchain->getKind());
+  EXPECT_EQ(ref<Expr>(getConstant(0xABCD, 16)), cchain->getKid(0));
+  EXPECT_EQ(read8_2, cchain->getKid(1));
+}
+
+TEST(ExprTest, ExtractCastFolding) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr12", 256);
+  ref<Expr> read8 = Expr::createTempRead(array, 8);
+
+  ref<Expr> zext = ZExtExpr::create(read8, 32);
+  EXPECT_EQ(read8, ExtractExpr::create(zext, 0, 8));
+  EXPECT_EQ(ref<Expr>(getConstant(0, 8)), ExtractExpr::create(zext, 16, 8));
+  // an extract straddling the source width keeps only the source bits
+  ref<Expr> straddle = ExtractExpr::create(zext, 4, 8);
+  EXPECT_EQ(Expr::ZExt, straddle->getKind());
+  EXPECT_EQ(ExtractExpr::create(read8, 4, 4), straddle->getKid(0));
+
+  ref<Expr> sext = SExtExpr::create(read8, 32);
+  EXPECT_EQ(read8, ExtractExpr::create(sext, 0, 8));
+  EXPECT_EQ(ExtractExpr::create(read8, 2, 4), ExtractExpr::create(sext, 2, 4));
+  ref<Expr> low16 = ExtractExpr::create(sext, 0, 16);
+  EXPECT_EQ(Expr::SExt, low16->getKind());
+  EXPECT_EQ(read8, low16->getKid(0));
+}
+
 TEST(ExprTest, ExtractConcat) {
   ArrayCache ac;
   const Array *array = ac.CreateArray("arr2", 256);
@@ -212,6 +299,195 @@ TEST(ExprTest, ReadExprFoldingConstantMultipleUpdate) {
   EXPECT_EQ(UINT64_C(64), c->getZExtValue());
 }
 
+TEST(ExprTest, UpdateListCompact) {
+  unsigned size = 5;
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", size);
+  const Array *symIndexArray = ac.CreateArray("idx", 4);
+
+  ref<Expr> symIndex = Expr::createTempRead(symIndexArray, Expr::Int32);
+  ref<Expr> index = ConstantExpr::create(0, Expr::Int32);
+
+  UpdateList ul(array, 0);
+  ul.extend(index, ConstantExpr::create(32, Expr::Int8));
+  ul.extend(symIndex, ConstantExpr::create(17, Expr::Int8));
+  ul.extend(index, ConstantExpr::create(64, Expr::Int8));
+  UpdateList snapshot = ul;
+
+  // The write of 32 is shadowed by the write of 64, the symbolic-index
+  // write in between notwithstanding.
+  EXPECT_TRUE(ul.compact());
+  EXPECT_EQ(2u, ul.getSize());
+  ref<Expr> read = ReadExpr::create(ul, index);
+  EXPECT_EQ(Expr::Constant, read.get()->getKind());
+  EXPECT_EQ(UINT64_C(64),
+            static_cast<ConstantExpr *>(read.get())->getZExtValue());
+
+  // nothing left to drop, and earlier snapshots are unaffected
+  EXPECT_FALSE(ul.compact());
+  EXPECT_EQ(3u, snapshot.getSize());
+}
+
+namespace {
+class ReadToOneVisitor : public ExprVisitor {
+public:
+  unsigned dispatched = 0;
+  explicit ReadToOneVisitor(visited_ty *shared = nullptr)
+      : ExprVisitor(false, shared) {}
+  Action visitExpr(const Expr &) override {
+    ++dispatched;
+    return Action::doChildren();
+  }
+  Action visitRead(const ReadExpr &) override {
+    return Action::changeTo(ConstantExpr::create(1, Expr::Int8));
+  }
+};
+}
+
+TEST(ExprTest, VisitorDeepExpr) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("deep_arr", 8);
+  UpdateList ul(array, 0);
+
+  // Deep enough to overflow the call stack with a recursive visitor.
+  const unsigned N = 50000;
+  ref<Expr> e = ReadExpr::create(ul, ConstantExpr::create(0, Expr::Int32));
+  for (unsigned i = 0; i < N; ++i)
+    e = AddExpr::create(
+        ReadExpr::create(ul, ConstantExpr::create(i % 8, Expr::Int32)), e);
+
+  // Replacing every read by 1 folds the whole sum to a constant.
+  ReadToOneVisitor v;
+  ref<Expr> res = v.visit(e);
+  ConstantExpr *ce = dyn_cast<ConstantExpr>(res);
+  ASSERT_TRUE(ce != nullptr);
+  EXPECT_EQ((N + 1) % 256, ce->getZExtValue());
+
+  // A second visitor sharing the memo table revisits nothing.
+  ExprVisitor::visited_ty memo;
+  ReadToOneVisitor v1(&memo);
+  ref<Expr> r1 = v1.visit(e);
+  ReadToOneVisitor v2(&memo);
+  ref<Expr> r2 = v2.visit(e);
+  EXPECT_EQ(r1, r2);
+  EXPECT_LT(0u, v1.dispatched);
+  EXPECT_EQ(0u, v2.dispatched);
+}
+
+TEST(ExprTest, FindSymbolicObjects) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("fso_a", 8);
+  const Array *b = ac.CreateArray("fso_b", 8);
+  const Array *c = ac.CreateArray("fso_c", 8);
+
+  // a read of a, indexed by c, through an update whose value reads b
+  UpdateList ul(a, 0);
+  UpdateList ulb(b, 0);
+  ul.extend(ConstantExpr::create(1, Expr::Int32),
+            ReadExpr::create(ulb, ConstantExpr::create(0, Expr::Int32)));
+  ref<Expr> e = ReadExpr::create(ul, Expr::createTempRead(c, Expr::Int32));
+
+  std::vector<const Array *> objects;
+  findSymbolicObjects(e, objects);
+  ASSERT_EQ(3u, objects.size());
+  // Results are unique and ordered by creation id.
+  for (unsigned i = 1; i < objects.size(); ++i)
+    EXPECT_LT(objects[i - 1]->id, objects[i]->id);
+  for (const Array *array : {a, b, c})
+    EXPECT_TRUE(std::find(objects.begin(), objects.end(), array) !=
+                objects.end());
+
+  // A second query reuses the per-node caches and agrees.
+  std::vector<const Array *> objects2;
+  findSymbolicObjects(e, objects2);
+  EXPECT_EQ(objects, objects2);
+}
+
+TEST(ExprTest, BinaryLogRoundTrip) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("bl_a", 8);
+  UpdateList ul(a, 0);
+  ul.extend(ConstantExpr::create(3, Expr::Int32),
+            ConstantExpr::create(7, Expr::Int8));
+  ref<Expr> r = ReadExpr::create(ul, Expr::createTempRead(a, Expr::Int32));
+  ref<Expr> c1 = UltExpr::create(r, ConstantExpr::create(100, Expr::Int8));
+  ref<Expr> c2 = EqExpr::create(ExtractExpr::create(r, 0, 4),
+                                ConstantExpr::create(5, 4));
+
+  std::string log;
+  llvm::raw_string_ostream os(log);
+  binlog::Writer::writeMagic(os);
+  binlog::Writer writer(os);
+
+  ConstraintSet cs1;
+  cs1.push_back(c1);
+  Query q1(cs1, EqExpr::create(r, ConstantExpr::create(9, Expr::Int8)));
+  writer.beginQuery();
+  writer.writeQuery(binlog::QueryTruth, 11, q1, nullptr, nullptr);
+  writer.writeResult(true, 42);
+  writer.commit();
+
+  // The second query shares its first constraint with the first, so only
+  // the new suffix is written.
+  ConstraintSet cs2;
+  cs2.push_back(c1);
+  cs2.push_back(c2);
+  Query q2(cs2, ConstantExpr::create(0, Expr::Bool));
+  std::vector<const Array *> objects{a};
+  writer.beginQuery();
+  writer.writeQuery(binlog::QueryInitialValues, 22, q2, nullptr, &objects);
+  writer.writeResult(false, 7);
+  writer.commit();
+  os.flush();
+
+  binlog::Reader reader(log, ac);
+  binlog::LoggedQuery q;
+
+  ASSERT_TRUE(reader.readQuery(q));
+  EXPECT_EQ(binlog::QueryTruth, q.type);
+  ASSERT_EQ(1u, q.constraints.size());
+  EXPECT_EQ(c1, q.constraints[0]);
+  EXPECT_EQ(q1.expr, q.expr);
+  EXPECT_TRUE(q.haveResult);
+  EXPECT_TRUE(q.success);
+  EXPECT_EQ(42u, q.elapsedUSec);
+
+  ASSERT_TRUE(reader.readQuery(q));
+  EXPECT_EQ(binlog::QueryInitialValues, q.type);
+  ASSERT_EQ(2u, q.constraints.size());
+  EXPECT_EQ(c2, q.constraints[1]);
+  ASSERT_EQ(1u, q.objects.size());
+  EXPECT_EQ(a, q.objects[0]);
+
+  EXPECT_FALSE(reader.readQuery(q));
+  EXPECT_TRUE(reader.error().empty());
+}
+
+TEST(ExprTest, ArrayCacheCollect) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("gc_arr", 8);
+
+  {
+    // While an UpdateList references the array it must survive collection.
+    UpdateList ul(array, 0);
+    std::unordered_set<const Array *> live;
+    EXPECT_EQ(0u, ac.collect(live));
+
+    // An array in the live set survives even without references.
+    const Array *keep = ac.CreateArray("gc_keep", 8);
+    live.insert(keep);
+    EXPECT_EQ(0u, ac.collect(live));
+    EXPECT_EQ(keep, ac.CreateArray("gc_keep", 8));
+  }
+
+  // Both arrays are now unreferenced and reclaimable.
+  EXPECT_EQ(2u, ac.collect(std::unordered_set<const Array *>()));
+
+  // A fresh array under the old name is a distinct object again.
+  const Array *recreated = ac.CreateArray("gc_arr", 8);
+  EXPECT_TRUE(recreated->isSymbolicArray());
+}
+
 TEST(ExprTest, ReadExprFoldingSymbolicValueUpdate) {
   unsigned size = 5;
 
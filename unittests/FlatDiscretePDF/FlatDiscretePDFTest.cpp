@@ -0,0 +1,75 @@
+#include "klee/ADT/FlatDiscretePDF.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+using namespace klee;
+
+TEST(FlatDiscretePDFTest, InsertUpdateRemove) {
+  FlatDiscretePDF<int> pdf;
+
+  ASSERT_TRUE(pdf.empty());
+
+  for (auto i = 0; i < 9; ++i)
+    pdf.insert(i + 10, 0.1 * i);
+
+  for (auto i = 9; i > 0; --i)
+    pdf.insert(i + 100, 0.01 * i);
+
+  ASSERT_FALSE(pdf.empty());
+
+  ASSERT_TRUE(pdf.inTree(101));
+  pdf.remove(101);
+  ASSERT_FALSE(pdf.inTree(101));
+  pdf.insert(101, 0.01);
+  ASSERT_EQ(0.01, pdf.getWeight(101));
+
+  pdf.choose(0);
+  pdf.choose(0.9999999);
+
+  pdf.update(101, 0.9);
+  ASSERT_EQ(0.9, pdf.getWeight(101));
+
+  for (auto i = 0; i < 9; ++i)
+    pdf.remove(i + 10);
+  for (auto i = 9; i > 0; --i)
+    pdf.remove(i + 100);
+
+  ASSERT_TRUE(pdf.empty());
+
+  pdf.insert(1, 0);
+#ifndef NDEBUG
+  ASSERT_DEATH({ pdf.insert(1, 0); }, "already in tree");
+#endif
+
+  while (!pdf.empty())
+    pdf.remove(pdf.choose(0));
+
+  pdf.insert(1, 1);
+  pdf.insert(2, 2);
+
+  ASSERT_EQ(1, pdf.getWeight(1));
+  ASSERT_EQ(2, pdf.getWeight(2));
+}
+
+TEST(FlatDiscretePDFTest, ChooseMatchesWeights) {
+  FlatDiscretePDF<int> pdf;
+
+  // Weights 1..100; item i owns the cumulative interval
+  // [sum(1..i-1), sum(1..i)) of the total 5050.
+  for (auto i = 1; i <= 100; ++i)
+    pdf.insert(i, i);
+
+  double total = 5050;
+  ASSERT_EQ(1, pdf.choose(0));
+  ASSERT_EQ(1, pdf.choose(0.9 / total));
+  ASSERT_EQ(2, pdf.choose(1.0 / total));
+  ASSERT_EQ(100, pdf.choose(0.9999999));
+
+  // Zeroing a weight makes the item unreachable; batched updates must
+  // be visible to the next choose.
+  for (auto i = 1; i <= 100; ++i)
+    if (i != 42)
+      pdf.update(i, 0);
+  for (double p = 0; p < 1; p += 0.125)
+    ASSERT_EQ(42, pdf.choose(p));
+}
@@ -0,0 +1,181 @@
+#include "klee/ADT/ImmutableMap.h"
+#include "gtest/gtest.h"
+
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace klee;
+
+typedef ImmutableMap<unsigned, unsigned> Map;
+
+namespace {
+
+void expectEqual(const Map &map, const std::map<unsigned, unsigned> &ref) {
+  EXPECT_EQ(ref.size(), map.size());
+  EXPECT_EQ(ref.empty(), map.empty());
+
+  auto it = map.begin(), ie = map.end();
+  for (const auto &kv : ref) {
+    ASSERT_TRUE(it != ie);
+    EXPECT_EQ(kv.first, it->first);
+    EXPECT_EQ(kv.second, it->second);
+    ++it;
+  }
+  EXPECT_TRUE(it == ie);
+
+  if (!ref.empty()) {
+    EXPECT_EQ(ref.begin()->first, map.min().first);
+    EXPECT_EQ(ref.rbegin()->first, map.max().first);
+  }
+}
+
+} // namespace
+
+TEST(ImmutableBTreeTest, Basic) {
+  Map m;
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(nullptr, m.lookup(1));
+
+  m = m.insert(std::make_pair(3u, 30u));
+  m = m.insert(std::make_pair(1u, 10u));
+  m = m.insert(std::make_pair(2u, 20u));
+  EXPECT_EQ(3u, m.size());
+  EXPECT_EQ(20u, m.lookup(2)->second);
+
+  // insert does not overwrite, replace does
+  m = m.insert(std::make_pair(2u, 99u));
+  EXPECT_EQ(20u, m.lookup(2)->second);
+  m = m.replace(std::make_pair(2u, 21u));
+  EXPECT_EQ(21u, m.lookup(2)->second);
+
+  m = m.remove(2);
+  EXPECT_EQ(nullptr, m.lookup(2));
+  EXPECT_EQ(2u, m.size());
+}
+
+TEST(ImmutableBTreeTest, LookupPrevious) {
+  Map m;
+  for (unsigned k = 10; k <= 100; k += 10)
+    m = m.insert(std::make_pair(k, k));
+
+  EXPECT_EQ(nullptr, m.lookup_previous(9));
+  EXPECT_EQ(10u, m.lookup_previous(10)->first);
+  EXPECT_EQ(10u, m.lookup_previous(19)->first);
+  EXPECT_EQ(100u, m.lookup_previous(1000)->first);
+}
+
+TEST(ImmutableBTreeTest, PersistentForks) {
+  Map m;
+  for (unsigned k = 0; k < 100; ++k)
+    m = m.insert(std::make_pair(k, k));
+
+  Map fork = m.remove(50).replace(std::make_pair(51u, 0u));
+  EXPECT_EQ(100u, m.size());
+  EXPECT_EQ(50u, m.lookup(50)->second);
+  EXPECT_EQ(51u, m.lookup(51)->second);
+  EXPECT_EQ(99u, fork.size());
+  EXPECT_EQ(nullptr, fork.lookup(50));
+  EXPECT_EQ(0u, fork.lookup(51)->second);
+}
+
+TEST(ImmutableBTreeTest, Bounds) {
+  Map m;
+  for (unsigned k = 0; k < 50; k += 2)
+    m = m.insert(std::make_pair(k, k));
+
+  EXPECT_EQ(10u, m.lower_bound(10)->first);
+  EXPECT_EQ(12u, m.lower_bound(11)->first);
+  EXPECT_EQ(12u, m.upper_bound(10)->first);
+  EXPECT_TRUE(m.lower_bound(49) == m.end());
+  EXPECT_TRUE(m.find(10) != m.end());
+  EXPECT_TRUE(m.find(11) == m.end());
+
+  // walking backwards from upper_bound, as address resolution does
+  auto it = m.upper_bound(20);
+  unsigned expected = 20;
+  while (it != m.begin()) {
+    --it;
+    EXPECT_EQ(expected, it->first);
+    if (!expected)
+      break;
+    expected -= 2;
+  }
+}
+
+TEST(ImmutableBTreeTest, DeferredReclamation) {
+  // Dead subtrees are torn down a few nodes per allocation; keep using
+  // a surviving fork while the dead copies drain to check shared nodes
+  // are not reclaimed out from under it.
+  Map m;
+  for (unsigned k = 0; k < 1000; ++k)
+    m = m.insert(std::make_pair(k, k));
+
+  {
+    std::vector<Map> forks;
+    for (unsigned f = 0; f < 10; ++f) {
+      Map fork = m;
+      for (unsigned k = 0; k < 200; ++k)
+        fork = fork.replace(std::make_pair(k * 5, f));
+      forks.push_back(fork);
+    }
+  } // all forks die here
+
+  for (unsigned k = 1000; k < 2000; ++k)
+    m = m.insert(std::make_pair(k, k));
+
+  EXPECT_EQ(2000u, m.size());
+  for (unsigned k = 0; k < 2000; ++k) {
+    ASSERT_NE(nullptr, m.lookup(k));
+    EXPECT_EQ(k, m.lookup(k)->second);
+  }
+}
+
+TEST(ImmutableBTreeTest, RandomizedAgainstStdMap) {
+  std::mt19937 rng(12345);
+
+  for (int round = 0; round < 10; ++round) {
+    Map m;
+    std::map<unsigned, unsigned> ref;
+    std::vector<Map> snapshots;
+    std::vector<std::map<unsigned, unsigned>> refSnapshots;
+
+    for (int i = 0; i < 500; ++i) {
+      unsigned k = rng() % 256;
+      switch (rng() % 5) {
+      case 0:
+      case 1:
+      case 2: {
+        unsigned v = rng();
+        m = m.replace(std::make_pair(k, v));
+        ref[k] = v;
+        break;
+      }
+      case 3:
+        m = m.remove(k);
+        ref.erase(k);
+        break;
+      case 4:
+        snapshots.push_back(m);
+        refSnapshots.push_back(ref);
+        break;
+      }
+
+      unsigned q = rng() % 300;
+      const auto *prev = m.lookup_previous(q);
+      auto rp = ref.upper_bound(q);
+      if (rp == ref.begin()) {
+        EXPECT_EQ(nullptr, prev);
+      } else {
+        --rp;
+        ASSERT_NE(nullptr, prev);
+        EXPECT_EQ(rp->first, prev->first);
+      }
+    }
+    expectEqual(m, ref);
+
+    for (size_t s = 0; s < snapshots.size(); ++s)
+      expectEqual(snapshots[s], refSnapshots[s]);
+  }
+}
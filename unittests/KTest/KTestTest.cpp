@@ -0,0 +1,92 @@
+//===-- KTestTest.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/ADT/KTest.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+TEST(KTestTest, Version2RoundTrip) {
+  char arg0[] = "prog";
+  char arg1[] = "--sym-stdin";
+  char *args[] = {arg0, arg1};
+
+  unsigned char small[] = {0, 1, 0, 0};
+  std::vector<unsigned char> big(4096);
+  for (unsigned i = 0; i < big.size(); ++i)
+    big[i] = i % 7; // compressible
+
+  char name0[] = "model_version";
+  char name1[] = "stdin";
+  KTestObject objects[2];
+  objects[0].name = name0;
+  objects[0].numBytes = sizeof(small);
+  objects[0].bytes = small;
+  objects[1].name = name1;
+  objects[1].numBytes = big.size();
+  objects[1].bytes = big.data();
+
+  KTest kt;
+  kt.version = kTest_getCurrentVersion();
+  kt.numArgs = 2;
+  kt.args = args;
+  kt.symArgvs = 1;
+  kt.symArgvLen = 2;
+  kt.numObjects = 2;
+  kt.objects = objects;
+
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("ktest2-roundtrip", "ktest", path));
+  const std::string pathStr = path.str().str();
+
+  ASSERT_TRUE(kTest_toFile2(&kt, pathStr.c_str(), /*compress=*/1));
+  EXPECT_TRUE(kTest_isKTest2File(pathStr.c_str()));
+  // the magic shares the "KTEST" prefix with the old format
+  EXPECT_TRUE(kTest_isKTestFile(pathStr.c_str()));
+
+  // lazy reader
+  KTest2 *kt2 = kTest2_open(pathStr.c_str());
+  ASSERT_TRUE(kt2);
+  EXPECT_EQ(2u, kTest2_numArgs(kt2));
+  EXPECT_STREQ("--sym-stdin", kTest2_arg(kt2, 1));
+  EXPECT_EQ(1u, kTest2_symArgvs(kt2));
+  EXPECT_EQ(2u, kTest2_symArgvLen(kt2));
+  ASSERT_EQ(2u, kTest2_numObjects(kt2));
+  EXPECT_STREQ("stdin", kTest2_objectName(kt2, 1));
+  ASSERT_EQ(big.size(), kTest2_objectNumBytes(kt2, 1));
+  const unsigned char *bytes = kTest2_objectBytes(kt2, 1);
+  ASSERT_TRUE(bytes);
+  EXPECT_EQ(0, std::memcmp(bytes, big.data(), big.size()));
+  // decoded objects are cached
+  EXPECT_EQ(bytes, kTest2_objectBytes(kt2, 1));
+  kTest2_close(kt2);
+
+  // the legacy API materializes v2 files transparently
+  KTest *back = kTest_fromFile(pathStr.c_str());
+  ASSERT_TRUE(back);
+  EXPECT_EQ(2u, back->numArgs);
+  EXPECT_STREQ("prog", back->args[0]);
+  ASSERT_EQ(2u, back->numObjects);
+  EXPECT_STREQ("model_version", back->objects[0].name);
+  ASSERT_EQ(sizeof(small), back->objects[0].numBytes);
+  EXPECT_EQ(0, std::memcmp(back->objects[0].bytes, small, sizeof(small)));
+  kTest_free(back);
+
+  llvm::sys::fs::remove(path);
+}
+
+} // namespace
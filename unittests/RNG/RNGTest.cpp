@@ -47,3 +47,27 @@ TEST(RNG, SeedEquality) {
 
   ASSERT_EQ(noseed.getInt32(), seed.getInt32());
 }
+
+/* identically seeded parents derive identical child streams */
+TEST(SplittableRNG, SplitDeterminism) {
+  SplittableRNG a(42U);
+  SplittableRNG b(42U);
+
+  SplittableRNG childA = a.split(1U);
+  SplittableRNG childB = b.split(1U);
+
+  ASSERT_EQ(childA.getInt32(), childB.getInt32());
+  ASSERT_EQ(a.getInt32(), b.getInt32());
+}
+
+/* children split off with different tags get different streams, and
+   splitting does not make the parent repeat itself */
+TEST(SplittableRNG, SplitIndependence) {
+  SplittableRNG parent(42U);
+
+  SplittableRNG left = parent.split(0U);
+  SplittableRNG right = parent.split(1U);
+
+  ASSERT_NE(left.getInt32(), right.getInt32());
+  ASSERT_NE(parent.getInt32(), left.getInt32());
+}
@@ -46,3 +46,27 @@ TEST(TreeStreamTest, WriteLargerThanBufferSize) {
   for (unsigned i=0; i<out.size(); i++)
     ASSERT_EQ('A', out[i]);
 }
+
+/* Forked streams share the parent data written before the fork, but
+   not data the parent writes afterwards.  */
+TEST(TreeStreamTest, ForkedStreams) {
+  TreeStreamWriter tsw("tsw3.out");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream parent = tsw.open();
+  parent.write("01", 2);
+  TreeOStream child = tsw.open(parent);
+  parent.write("0", 1);
+  child.write("11", 2);
+  parent.flush();
+
+  std::vector<unsigned char> out;
+  tsw.readStream(child.getID(), out);
+  ASSERT_EQ(4u, out.size());
+  EXPECT_EQ(0, memcmp(out.data(), "0111", 4));
+
+  out.clear();
+  tsw.readStream(parent.getID(), out);
+  ASSERT_EQ(3u, out.size());
+  EXPECT_EQ(0, memcmp(out.data(), "010", 3));
+}